@@ -0,0 +1,216 @@
+#include "NetlinkNetworkMonitor.h"
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace
+{
+    // Large enough for a few links per read of a dump, the kernel splits it.
+    constexpr std::size_t k_BufferSize = 32 * 1024;
+
+    int OpenRouteSocket(std::uint32_t groups)
+    {
+        int handle = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+        if (handle < 0)
+            return -1;
+
+        sockaddr_nl address = {};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = groups;
+        if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            close(handle);
+            return -1;
+        }
+
+        return handle;
+    }
+}
+
+NetlinkNetworkMonitor::NetlinkNetworkMonitor():
+    m_EventSocket(-1),
+    m_StopEvent(-1)
+{
+    DebugLog("NetlinkNetworkMonitor::NetlinkNetworkMonitor::Started...");
+
+    m_EventSocket = OpenRouteSocket(RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR);
+    m_StopEvent = eventfd(0, EFD_CLOEXEC);
+
+    // Without notifications, WaitForChange only returns on its timeout and the forced refreshes still work.
+    if (m_EventSocket < 0 || m_StopEvent < 0)
+    {
+        DebugLog("NetlinkNetworkMonitor::NetlinkNetworkMonitor | No rtnetlink notifications");
+        return;
+    }
+
+    m_Thread = std::thread(&NetlinkNetworkMonitor::Listen, this);
+
+    DebugLog("NetlinkNetworkMonitor::NetlinkNetworkMonitor::Ended");
+}
+
+NetlinkNetworkMonitor::~NetlinkNetworkMonitor()
+{
+    if (m_Thread.joinable())
+    {
+        const std::uint64_t value = 1;
+        ssize_t written = write(m_StopEvent, &value, sizeof(value));
+        (void)written;
+
+        m_Thread.join();
+    }
+
+    if (m_EventSocket >= 0)
+        close(m_EventSocket);
+    if (m_StopEvent >= 0)
+        close(m_StopEvent);
+}
+
+void NetlinkNetworkMonitor::Listen()
+{
+    alignas(nlmsghdr) static thread_local char buffer[k_BufferSize];
+
+    pollfd fds[2] = {};
+    fds[0].fd = m_EventSocket;
+    fds[0].events = POLLIN;
+    fds[1].fd = m_StopEvent;
+    fds[1].events = POLLIN;
+
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (fds[1].revents != 0)
+            break;
+
+        if ((fds[0].revents & POLLIN) == 0)
+            continue;
+
+        ssize_t size = recv(m_EventSocket, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (size < 0)
+        {
+            // The socket buffer overflowed and notifications were lost, refresh anyway.
+            if (errno == ENOBUFS)
+                NotifyChange();
+            else if (errno != EAGAIN && errno != EINTR)
+                break;
+            continue;
+        }
+
+        bool changed = false;
+        int remaining = static_cast<int>(size);
+        for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+        {
+            switch (header->nlmsg_type)
+            {
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    changed = true;
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        if (changed)
+        {
+            NotifyChange();
+        }
+    }
+}
+
+void NetlinkNetworkMonitor::Refresh(bool onlyConnectedNetworks)
+{
+    int handle = OpenRouteSocket(0);
+    if (handle < 0)
+        return;
+
+    // A dump can't hang Update if the kernel never answers.
+    timeval timeout = {};
+    timeout.tv_sec = 1;
+    setsockopt(handle, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct
+    {
+        nlmsghdr m_Header;
+        ifinfomsg m_Message;
+    } request = {};
+    request.m_Header.nlmsg_len = sizeof(request);
+    request.m_Header.nlmsg_type = RTM_GETLINK;
+    request.m_Header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.m_Header.nlmsg_seq = 1;
+    request.m_Message.ifi_family = AF_UNSPEC;
+
+    sockaddr_nl kernel = {};
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(handle, &request, sizeof(request), 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0)
+    {
+        close(handle);
+        return;
+    }
+
+    alignas(nlmsghdr) static thread_local char buffer[k_BufferSize];
+
+    bool done = false;
+    while (!done)
+    {
+        ssize_t size = recv(handle, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR)
+            continue;
+        if (size <= 0)
+            break;
+
+        int remaining = static_cast<int>(size);
+        for (const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer); NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining))
+        {
+            if (header->nlmsg_type == NLMSG_DONE || header->nlmsg_type == NLMSG_ERROR)
+            {
+                done = true;
+                break;
+            }
+
+            if (header->nlmsg_type != RTM_NEWLINK)
+                continue;
+
+            const ifinfomsg* info = static_cast<const ifinfomsg*>(NLMSG_DATA(header));
+            if ((info->ifi_flags & IFF_LOOPBACK) != 0)
+                continue;
+
+            bool connected = (info->ifi_flags & IFF_UP) != 0 && (info->ifi_flags & IFF_RUNNING) != 0;
+            if (onlyConnectedNetworks && !connected)
+                continue;
+
+            int attributesSize = static_cast<int>(IFLA_PAYLOAD(header));
+            for (const rtattr* attribute = IFLA_RTA(info); RTA_OK(attribute, attributesSize); attribute = RTA_NEXT(attribute, attributesSize))
+            {
+                if (attribute->rta_type != IFLA_IFNAME)
+                    continue;
+
+                const char* name = static_cast<const char*>(RTA_DATA(attribute));
+                std::size_t length = strnlen(name, RTA_PAYLOAD(attribute));
+
+                GUID adapterId = {};
+                std::memcpy(&adapterId, name, length < sizeof(GUID) ? length : sizeof(GUID) - 1);
+                AddResult(adapterId, NLM_NETWORK_CATEGORY_PRIVATE);
+                break;
+            }
+        }
+    }
+
+    close(handle);
+}
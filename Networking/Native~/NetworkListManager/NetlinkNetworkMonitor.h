@@ -0,0 +1,35 @@
+#pragma once
+#include "NetworkMonitor.h"
+
+#include <thread>
+
+// Linux backend: rtnetlink stands in for the Network List Manager.
+//
+// A thread listens to the link and address notifications of the kernel and signals NetworkMonitor::WaitForChange.
+// Refresh dumps the links: one result per interface other than loopback, connected meaning up with a carrier.
+// Linux has no adapter GUIDs nor network categories, so the adapter GUID holds the interface name (at most 15
+// characters, zero padded to the 16 bytes of the GUID) and every network is reported as private.
+class NetlinkNetworkMonitor : public NetworkMonitor
+{
+public:
+
+    // DLL API
+    NetlinkNetworkMonitor();
+    ~NetlinkNetworkMonitor() override;
+
+protected:
+
+    void Refresh(bool onlyConnectedNetworks) override;
+
+private:
+
+    void Listen();
+
+    // Subscribed to the link and address changes.
+    int m_EventSocket;
+
+    // Written to stop the listening thread.
+    int m_StopEvent;
+
+    std::thread m_Thread;
+};
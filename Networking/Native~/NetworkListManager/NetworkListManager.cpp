@@ -2,8 +2,6 @@
 #include "COMUtilities.h"
 
 NLMWrapper::NLMWrapper():
-    m_StateChanged(false),
-    m_Results(),
     m_Manager(nullptr),
     m_ConnectionPointContainer(nullptr),
     m_ConnectionPoint(nullptr),
@@ -43,30 +41,11 @@ NLMWrapper::~NLMWrapper()
     DebugLog("NLMWrapper::~NLMWrapper::Ended");
 }
 
-UpdateOutputFlags NLMWrapper::Update(UpdateInputFlags inputFlags)
+void NLMWrapper::Refresh(bool onlyConnectedNetworks)
 {
-    bool forceRefresh = (inputFlags & UpdateInputFlags::ForceRefresh) != UpdateInputFlags::None;
-    bool onlyConnectedNetworks = (inputFlags & UpdateInputFlags::OnlyConnectedNetworks) != UpdateInputFlags::OnlyConnectedNetworks;
-
-    bool stateHasChanged = m_StateChanged.exchange(false);
-
-    if (forceRefresh || stateHasChanged)
-    {
-        return Refresh(onlyConnectedNetworks);
-    }
-
-    return UpdateOutputFlags::None;
-}
-
-UpdateOutputFlags NLMWrapper::Refresh(bool onlyConnectedNetworks)
-{
-    UpdateOutputFlags outputFlags = UpdateOutputFlags::Refreshed;
-
-    m_Results.clear();
-
     CComPtr<IEnumNetworks> networks;
     HRESULT hr = m_Manager->GetNetworks(onlyConnectedNetworks ? NLM_ENUM_NETWORK_CONNECTED : NLM_ENUM_NETWORK_ALL, &networks);
-    RETURN_VALUE_IF_NOT_OK(hr, outputFlags);
+    RETURN_IF_NOT_OK(hr);
 
     EnumeratorWrapper<INetwork, IEnumNetworks, 4> networkEnumerator(*networks);
     while (true)
@@ -102,24 +81,9 @@ UpdateOutputFlags NLMWrapper::Refresh(bool onlyConnectedNetworks)
             hr = connection->GetAdapterId(&adapterId);
             SKIP_LOOP_IF_NOT_OK(hr);
 
-            m_Results.push_back({ adapterId, networkCategory });
+            AddResult(adapterId, networkCategory);
         }
     }
-
-    return outputFlags;
-}
-
-PopOutputFlags NLMWrapper::PopResult(Result& outResult)
-{
-    if (m_Results.size() > 0)
-    {
-        outResult = m_Results.front();
-        m_Results.pop_front();
-
-        return PopOutputFlags::None;
-    }
-
-    return PopOutputFlags::Empty;
 }
 
 
@@ -152,7 +116,7 @@ void DebugLogConnections(GUID networkId, INetworkListManager& manager)
 
 STDMETHODIMP NLMWrapper::NetworkSink::NetworkAdded(GUID networkId)
 {
-    m_Wrapper->m_StateChanged.store(true);
+    m_Wrapper->NotifyChange();
 
 #if NLM_ENABLE_DEBUG_LOG
     DebugLog("NLMWrapper::NetworkAdded | " + NetworkToString(networkId, *m_Wrapper->m_Manager));
@@ -164,7 +128,7 @@ STDMETHODIMP NLMWrapper::NetworkSink::NetworkAdded(GUID networkId)
 
 STDMETHODIMP NLMWrapper::NetworkSink::NetworkDeleted(GUID networkId)
 {
-    m_Wrapper->m_StateChanged.store(true);
+    m_Wrapper->NotifyChange();
 
 #if NLM_ENABLE_DEBUG_LOG
     DebugLog("NLMWrapper::NetworkDeleted | " + NetworkToString(networkId, *m_Wrapper->m_Manager));
@@ -190,7 +154,7 @@ STDMETHODIMP NLMWrapper::NetworkSink::NetworkPropertyChanged(GUID networkId, NLM
     if ((flags & NLM_NETWORK_PROPERTY_CHANGE_CONNECTION) > 0 ||
         (flags & NLM_NETWORK_PROPERTY_CHANGE_CATEGORY_VALUE) > 0)
     {
-        m_Wrapper->m_StateChanged.store(true);
+        m_Wrapper->NotifyChange();
     }
 
 #if NLM_ENABLE_DEBUG_LOG
@@ -0,0 +1,138 @@
+#include "NetworkMonitor.h"
+
+#include <chrono>
+#include <cstring>
+
+NetworkMonitor::NetworkMonitor():
+    m_StateChanged(false),
+    m_Woken(false),
+    m_Results(),
+    m_ResultsCount(0),
+    m_ResultsRead(0),
+    m_RefreshCount(0),
+    m_RefreshChanged(false),
+    m_Generation(0)
+{
+}
+
+UpdateOutputFlags NetworkMonitor::Update(UpdateInputFlags inputFlags)
+{
+    bool forceRefresh = (inputFlags & UpdateInputFlags::ForceRefresh) != UpdateInputFlags::None;
+    bool onlyConnectedNetworks = (inputFlags & UpdateInputFlags::OnlyConnectedNetworks) != UpdateInputFlags::OnlyConnectedNetworks;
+
+    bool stateHasChanged = false;
+    {
+        std::lock_guard<std::mutex> lock(m_ChangeMutex);
+        stateHasChanged = m_StateChanged;
+        m_StateChanged = false;
+    }
+
+    if (!forceRefresh && !stateHasChanged)
+    {
+        return UpdateOutputFlags::None;
+    }
+
+    m_RefreshCount = 0;
+    m_RefreshChanged = false;
+
+    Refresh(onlyConnectedNetworks);
+
+    if (m_RefreshChanged || m_RefreshCount != m_ResultsCount)
+    {
+        ++m_Generation;
+    }
+
+    m_ResultsCount = m_RefreshCount;
+    m_ResultsRead = 0;
+
+    return UpdateOutputFlags::Refreshed;
+}
+
+void NetworkMonitor::AddResult(const GUID& adapterId, NLM_NETWORK_CATEGORY networkCategory)
+{
+    if (m_RefreshCount == m_Results.size())
+    {
+        DebugLog("NetworkMonitor::AddResult | Too many network connections, skipped");
+        return;
+    }
+
+    Result& result = m_Results[m_RefreshCount];
+    if (m_RefreshCount >= m_ResultsCount ||
+        std::memcmp(&result.m_AdapterGuid, &adapterId, sizeof(GUID)) != 0 ||
+        result.m_NetworkCategory != networkCategory)
+    {
+        m_RefreshChanged = true;
+    }
+
+    result = { adapterId, networkCategory };
+    ++m_RefreshCount;
+}
+
+PopOutputFlags NetworkMonitor::PopResult(Result& outResult)
+{
+    if (m_ResultsRead < m_ResultsCount)
+    {
+        outResult = m_Results[m_ResultsRead++];
+
+        return PopOutputFlags::None;
+    }
+
+    return PopOutputFlags::Empty;
+}
+
+std::int32_t NetworkMonitor::PopResults(Result* outResults, std::int32_t capacity)
+{
+    std::int32_t count = 0;
+    while (count < capacity && m_ResultsRead < m_ResultsCount)
+    {
+        outResults[count++] = m_Results[m_ResultsRead++];
+    }
+
+    return count;
+}
+
+WaitOutputFlags NetworkMonitor::WaitForChange(std::int32_t timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(m_ChangeMutex);
+
+    auto isSignaled = [this]() { return m_StateChanged || m_Woken; };
+    if (timeoutMs < 0)
+    {
+        m_ChangeCondition.wait(lock, isSignaled);
+    }
+    else
+    {
+        m_ChangeCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), isSignaled);
+    }
+
+    WaitOutputFlags outputFlags = WaitOutputFlags::None;
+    if (m_StateChanged)
+    {
+        outputFlags |= WaitOutputFlags::Changed;
+    }
+    if (m_Woken)
+    {
+        outputFlags |= WaitOutputFlags::Woken;
+        m_Woken = false;
+    }
+
+    return outputFlags;
+}
+
+void NetworkMonitor::Wake()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ChangeMutex);
+        m_Woken = true;
+    }
+    m_ChangeCondition.notify_all();
+}
+
+void NetworkMonitor::NotifyChange()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_ChangeMutex);
+        m_StateChanged = true;
+    }
+    m_ChangeCondition.notify_all();
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include "Utilities.h"
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#if defined(_WIN32)
+#    include <windows.h>
+#    include <netlistmgr.h>
+
+#    ifdef NETWORKLISTMANAGER_EXPORTS
+#        define NETWORKLISTMANAGER_API __declspec(dllexport)
+#    else
+#        define NETWORKLISTMANAGER_API __declspec(dllimport)
+#    endif
+#else
+#    include <type_traits>
+
+#    define NETWORKLISTMANAGER_API __attribute__((visibility("default")))
+
+// Same layout as the Windows GUID, which C# marshals as a System.Guid.
+struct GUID
+{
+    std::uint32_t Data1;
+    std::uint16_t Data2;
+    std::uint16_t Data3;
+    std::uint8_t Data4[8];
+};
+
+enum NLM_NETWORK_CATEGORY
+{
+    NLM_NETWORK_CATEGORY_PUBLIC = 0,
+    NLM_NETWORK_CATEGORY_PRIVATE = 0x1,
+    NLM_NETWORK_CATEGORY_DOMAIN_AUTHENTICATED = 0x2,
+};
+
+#    define DEFINE_ENUM_FLAG_OPERATORS(T) \
+        inline T operator|(T a, T b) { return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) | static_cast<std::underlying_type<T>::type>(b)); } \
+        inline T operator&(T a, T b) { return static_cast<T>(static_cast<std::underlying_type<T>::type>(a) & static_cast<std::underlying_type<T>::type>(b)); } \
+        inline T& operator|=(T& a, T b) { return a = a | b; }
+#endif
+
+enum class UpdateInputFlags
+{
+    None = 0,
+    ForceRefresh = 1 << 0,
+    OnlyConnectedNetworks = 1 << 1,
+};
+DEFINE_ENUM_FLAG_OPERATORS(UpdateInputFlags)
+
+enum class UpdateOutputFlags
+{
+    None = 0,
+    Refreshed = 1 << 0,
+};
+DEFINE_ENUM_FLAG_OPERATORS(UpdateOutputFlags)
+
+enum class PopOutputFlags
+{
+    None = 0,
+    Empty = 1 << 0,
+};
+DEFINE_ENUM_FLAG_OPERATORS(PopOutputFlags)
+
+enum class WaitOutputFlags
+{
+    None = 0,
+    Changed = 1 << 0,
+    Woken = 1 << 1,
+};
+DEFINE_ENUM_FLAG_OPERATORS(WaitOutputFlags)
+
+struct Result
+{
+    GUID m_AdapterGuid;
+    NLM_NETWORK_CATEGORY m_NetworkCategory;
+};
+
+// The platform independent part of the plugin: the results of the last refresh and the change notifications.
+//
+// A backend reports the changes from its own threads with NotifyChange and lists the (Adapter GUID, Network Category)
+// pairs with AddResult when Update calls Refresh. C# waits for a change with WaitForChange then calls Update, so that
+// the networks are only enumerated after a change.
+class NetworkMonitor
+{
+public:
+
+    // DLL API
+    NetworkMonitor();
+    virtual ~NetworkMonitor() = default;
+
+    NetworkMonitor(const NetworkMonitor&) = delete;
+    NetworkMonitor& operator=(const NetworkMonitor&) = delete;
+
+    // Refreshes if forced or if a change was notified since the last refresh.
+    // Don't call from Unity's main thread, use a different thread spawned from C# instead.
+    UpdateOutputFlags Update(UpdateInputFlags inputFlags);
+
+    // Call from the same thread as NetworkMonitor::Update.
+    PopOutputFlags PopResult(Result& outResult);
+
+    // Copies up to capacity results at once. Returns the number copied.
+    // Call from the same thread as NetworkMonitor::Update.
+    std::int32_t PopResults(Result* outResults, std::int32_t capacity);
+
+    // Incremented by the refreshes whose results differ from the previous ones.
+    // Call from the same thread as NetworkMonitor::Update.
+    std::uint32_t GetGeneration() const { return m_Generation; }
+
+    // Blocks until a change is notified, Wake is called or timeoutMs elapsed (negative to wait forever).
+    // Returns immediately while a change is pending, Update consumes it. Thread-safe.
+    WaitOutputFlags WaitForChange(std::int32_t timeoutMs);
+
+    // Makes the current or next WaitForChange return, e.g. to stop the thread waiting. Thread-safe.
+    void Wake();
+
+protected:
+
+    // Called by the backend, from any thread.
+    void NotifyChange();
+
+    // Lists the current networks with AddResult. Called by Update.
+    virtual void Refresh(bool onlyConnectedNetworks) = 0;
+
+    void AddResult(const GUID& adapterId, NLM_NETWORK_CATEGORY networkCategory);
+
+private:
+
+    std::mutex m_ChangeMutex;
+    std::condition_variable m_ChangeCondition;
+    bool m_StateChanged;
+    bool m_Woken;
+
+    // A network connection per adapter, a handful at most. The ones past the capacity are dropped.
+    static constexpr std::size_t k_MaxResults = 64;
+
+    // Pre-allocated, rewritten by each refresh and popped from m_ResultsRead.
+    // The previous results are compared in place while they are overwritten.
+    std::array<Result, k_MaxResults> m_Results;
+    std::size_t m_ResultsCount;
+    std::size_t m_ResultsRead;
+    std::size_t m_RefreshCount;
+    bool m_RefreshChanged;
+    std::uint32_t m_Generation;
+};
+
+// DLL API
+extern "C" NETWORKLISTMANAGER_API void* Create();
+extern "C" NETWORKLISTMANAGER_API void Destroy(void* instance);
+extern "C" NETWORKLISTMANAGER_API std::int32_t Update(void* instance, std::int32_t updateFlags);
+extern "C" NETWORKLISTMANAGER_API std::int32_t PopResult(void* instance, GUID& outAdapterGuid, std::int32_t& networkCategory);
+extern "C" NETWORKLISTMANAGER_API std::int32_t PopResults(void* instance, Result* outResults, std::int32_t capacity);
+extern "C" NETWORKLISTMANAGER_API std::uint32_t GetGeneration(void* instance);
+extern "C" NETWORKLISTMANAGER_API std::int32_t WaitForChange(void* instance, std::int32_t timeoutMs);
+extern "C" NETWORKLISTMANAGER_API void Wake(void* instance);
@@ -1,29 +1,40 @@
+#if defined(_WIN32)
 #include "NetworkListManager.h"
+#elif defined(__linux__)
+#include "NetlinkNetworkMonitor.h"
+#endif
 
-void NETWORKLISTMANAGER_API* Create()
+// The instances are handed to C# as NetworkMonitor pointers, whatever the backend.
+NETWORKLISTMANAGER_API void* Create()
 {
-    NLMWrapper* instance = new NLMWrapper();
+#if defined(_WIN32)
+    NetworkMonitor* instance = new NLMWrapper();
+#elif defined(__linux__)
+    NetworkMonitor* instance = new NetlinkNetworkMonitor();
+#else
+    NetworkMonitor* instance = nullptr;
+#endif
     return instance;
 }
 
-void NETWORKLISTMANAGER_API Destroy(void* instance)
+NETWORKLISTMANAGER_API void Destroy(void* instance)
 {
     if (instance == nullptr)
         return;
 
-    NLMWrapper* casted = reinterpret_cast<NLMWrapper*>(instance);
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
     if (casted == nullptr)
         return;
 
     delete casted;
 }
 
-std::int32_t NETWORKLISTMANAGER_API Update(void* instance, std::int32_t updateFlags)
+NETWORKLISTMANAGER_API std::int32_t Update(void* instance, std::int32_t updateFlags)
 {
     if (instance == nullptr)
         return -1;
 
-    NLMWrapper* casted = reinterpret_cast<NLMWrapper*>(instance);
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
     if (casted == nullptr)
         return -1;
 
@@ -33,14 +44,14 @@ std::int32_t NETWORKLISTMANAGER_API Update(void* instance, std::int32_t updateFl
     return result;
 }
 
-std::int32_t NETWORKLISTMANAGER_API PopResult(void* instance, GUID& outAdapterGuid, std::int32_t& networkCategory)
+NETWORKLISTMANAGER_API std::int32_t PopResult(void* instance, GUID& outAdapterGuid, std::int32_t& networkCategory)
 {
     if (instance == nullptr)
     {
         return -1;
     }
 
-    NLMWrapper* casted = reinterpret_cast<NLMWrapper*>(instance);
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
     if (casted == nullptr)
     {
         return -1;
@@ -54,3 +65,47 @@ std::int32_t NETWORKLISTMANAGER_API PopResult(void* instance, GUID& outAdapterGu
     std::int32_t outputFlags = static_cast<std::int32_t>(popOutputFlags);
     return outputFlags;
 }
+
+NETWORKLISTMANAGER_API std::int32_t PopResults(void* instance, Result* outResults, std::int32_t capacity)
+{
+    if (instance == nullptr || (outResults == nullptr && capacity > 0))
+    {
+        return -1;
+    }
+
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
+    return casted->PopResults(outResults, capacity);
+}
+
+NETWORKLISTMANAGER_API std::uint32_t GetGeneration(void* instance)
+{
+    if (instance == nullptr)
+    {
+        return 0;
+    }
+
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
+    return casted->GetGeneration();
+}
+
+NETWORKLISTMANAGER_API std::int32_t WaitForChange(void* instance, std::int32_t timeoutMs)
+{
+    if (instance == nullptr)
+    {
+        return -1;
+    }
+
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
+    WaitOutputFlags waitOutputFlags = casted->WaitForChange(timeoutMs);
+    std::int32_t outputFlags = static_cast<std::int32_t>(waitOutputFlags);
+    return outputFlags;
+}
+
+NETWORKLISTMANAGER_API void Wake(void* instance)
+{
+    if (instance == nullptr)
+        return;
+
+    NetworkMonitor* casted = reinterpret_cast<NetworkMonitor*>(instance);
+    casted->Wake();
+}
@@ -0,0 +1,271 @@
+#include "NetworkMonitor.h"
+
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+// Runs the plugin in a network namespace of its own, where only the test changes the links: a veth pair is
+// added, raised and deleted through rtnetlink and each change must wake WaitForChange and show in the results.
+// Needs CAP_SYS_ADMIN for the namespace and the veth driver, the test is skipped without them.
+
+#define CHECK(condition)                                                                        \
+    do                                                                                          \
+    {                                                                                           \
+        if (!(condition))                                                                       \
+        {                                                                                       \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            std::exit(1);                                                                       \
+        }                                                                                       \
+    } while (false)
+
+namespace
+{
+    // Returned to ctest, see SKIP_RETURN_CODE in CMakeLists.txt.
+    constexpr int k_SkipReturnCode = 77;
+
+    // As NetworkMonitor::Update reads it: without OnlyConnectedNetworks, only the connected networks are listed.
+    constexpr std::int32_t k_AllNetworks = static_cast<std::int32_t>(UpdateInputFlags::OnlyConnectedNetworks);
+    constexpr std::int32_t k_ConnectedNetworks = static_cast<std::int32_t>(UpdateInputFlags::None);
+    constexpr std::int32_t k_Refreshed = static_cast<std::int32_t>(UpdateOutputFlags::Refreshed);
+    constexpr std::int32_t k_Changed = static_cast<std::int32_t>(WaitOutputFlags::Changed);
+    constexpr std::int32_t k_Woken = static_cast<std::int32_t>(WaitOutputFlags::Woken);
+
+    // A rtnetlink request and its attributes, sent with an acknowledgement.
+    class LinkRequest
+    {
+    public:
+
+        LinkRequest(std::uint16_t type, std::uint16_t flags)
+        {
+            std::memset(&m_Request, 0, sizeof(m_Request));
+            m_Request.m_Header.nlmsg_len = NLMSG_LENGTH(sizeof(ifinfomsg));
+            m_Request.m_Header.nlmsg_type = type;
+            m_Request.m_Header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
+            m_Request.m_Message.ifi_family = AF_UNSPEC;
+        }
+
+        ifinfomsg& GetMessage() { return m_Request.m_Message; }
+
+        rtattr* AddAttribute(std::uint16_t type, const void* data, std::size_t size)
+        {
+            rtattr* attribute = reinterpret_cast<rtattr*>(reinterpret_cast<char*>(&m_Request) + NLMSG_ALIGN(m_Request.m_Header.nlmsg_len));
+            attribute->rta_type = type;
+            attribute->rta_len = static_cast<unsigned short>(RTA_LENGTH(size));
+            if (size > 0)
+                std::memcpy(RTA_DATA(attribute), data, size);
+            m_Request.m_Header.nlmsg_len = NLMSG_ALIGN(m_Request.m_Header.nlmsg_len) + RTA_ALIGN(attribute->rta_len);
+            CHECK(m_Request.m_Header.nlmsg_len <= sizeof(m_Request));
+            return attribute;
+        }
+
+        // Raw bytes in the current nested attribute, e.g. the ifinfomsg of a veth peer.
+        void AddData(const void* data, std::size_t size)
+        {
+            std::memcpy(reinterpret_cast<char*>(&m_Request) + NLMSG_ALIGN(m_Request.m_Header.nlmsg_len), data, size);
+            m_Request.m_Header.nlmsg_len = NLMSG_ALIGN(m_Request.m_Header.nlmsg_len) + NLMSG_ALIGN(size);
+            CHECK(m_Request.m_Header.nlmsg_len <= sizeof(m_Request));
+        }
+
+        void AddName(std::uint16_t type, const char* name)
+        {
+            AddAttribute(type, name, std::strlen(name) + 1);
+        }
+
+        // The attributes added until EndNested are nested in this one.
+        rtattr* BeginNested(std::uint16_t type)
+        {
+            return AddAttribute(type, nullptr, 0);
+        }
+
+        void EndNested(rtattr* attribute)
+        {
+            attribute->rta_len = static_cast<unsigned short>(reinterpret_cast<char*>(&m_Request) + m_Request.m_Header.nlmsg_len - reinterpret_cast<char*>(attribute));
+        }
+
+        // Returns the error of the kernel, 0 on success.
+        int Send()
+        {
+            int handle = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+            CHECK(handle >= 0);
+
+            sockaddr_nl kernel = {};
+            kernel.nl_family = AF_NETLINK;
+            CHECK(sendto(handle, &m_Request, m_Request.m_Header.nlmsg_len, 0, reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) >= 0);
+
+            alignas(nlmsghdr) char reply[4096];
+            ssize_t size = recv(handle, reply, sizeof(reply), 0);
+            close(handle);
+
+            const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(reply);
+            CHECK(size > 0 && NLMSG_OK(header, static_cast<int>(size)) && header->nlmsg_type == NLMSG_ERROR);
+            return -static_cast<const nlmsgerr*>(NLMSG_DATA(header))->error;
+        }
+
+    private:
+
+        struct
+        {
+            nlmsghdr m_Header;
+            ifinfomsg m_Message;
+            char m_Attributes[512];
+        } m_Request;
+    };
+
+    int AddVethPair(const char* name, const char* peerName)
+    {
+        LinkRequest request(RTM_NEWLINK, NLM_F_CREATE | NLM_F_EXCL);
+        request.AddName(IFLA_IFNAME, name);
+
+        rtattr* linkInfo = request.BeginNested(IFLA_LINKINFO);
+        request.AddName(IFLA_INFO_KIND, "veth");
+        rtattr* data = request.BeginNested(IFLA_INFO_DATA);
+        // The peer holds an ifinfomsg, then the attributes of the peer link.
+        rtattr* peer = request.BeginNested(VETH_INFO_PEER);
+        const ifinfomsg peerMessage = {};
+        request.AddData(&peerMessage, sizeof(peerMessage));
+        request.AddName(IFLA_IFNAME, peerName);
+        request.EndNested(peer);
+        request.EndNested(data);
+        request.EndNested(linkInfo);
+
+        return request.Send();
+    }
+
+    void SetLinkUp(const char* name)
+    {
+        LinkRequest request(RTM_NEWLINK, 0);
+        request.GetMessage().ifi_index = static_cast<int>(if_nametoindex(name));
+        request.GetMessage().ifi_flags = IFF_UP;
+        request.GetMessage().ifi_change = IFF_UP;
+        CHECK(request.GetMessage().ifi_index != 0 && request.Send() == 0);
+    }
+
+    void DeleteLink(const char* name)
+    {
+        LinkRequest request(RTM_DELLINK, 0);
+        request.GetMessage().ifi_index = static_cast<int>(if_nametoindex(name));
+        CHECK(request.GetMessage().ifi_index != 0 && request.Send() == 0);
+    }
+
+    std::string GetName(const Result& result)
+    {
+        const char* name = reinterpret_cast<const char*>(&result.m_AdapterGuid);
+        return std::string(name, strnlen(name, sizeof(GUID)));
+    }
+
+    // Waits for the notifications until a refresh lists count networks. Returns the names of the networks.
+    std::string WaitForResults(void* monitor, std::int32_t updateFlags, std::int32_t count)
+    {
+        for (int i = 0; i < 20; ++i)
+        {
+            CHECK((WaitForChange(monitor, 2000) & k_Changed) != 0);
+            CHECK(Update(monitor, updateFlags) == k_Refreshed);
+
+            Result results[8];
+            std::int32_t popped = PopResults(monitor, results, 8);
+            if (popped != count)
+                continue;
+
+            std::string names;
+            for (std::int32_t r = 0; r < popped; ++r)
+            {
+                CHECK(results[r].m_NetworkCategory == NLM_NETWORK_CATEGORY_PRIVATE);
+                names += (r > 0 ? " " : "") + GetName(results[r]);
+            }
+            return names;
+        }
+
+        CHECK(false);
+        return std::string();
+    }
+
+    void ReportsTheLinkChanges()
+    {
+        void* monitor = Create();
+        CHECK(monitor != nullptr);
+
+        // Only the loopback, which isn't listed, and nothing changes until the test does.
+        Result results[8];
+        CHECK(Update(monitor, k_AllNetworks | static_cast<std::int32_t>(UpdateInputFlags::ForceRefresh)) == k_Refreshed);
+        CHECK(PopResults(monitor, results, 8) == 0);
+        CHECK(Update(monitor, k_AllNetworks) == 0);
+        CHECK(WaitForChange(monitor, 200) == 0);
+        std::uint32_t generation = GetGeneration(monitor);
+
+        CHECK(AddVethPair("lcm0", "lcm1") == 0);
+        // In the order of the interface indices: the peer is created first.
+        CHECK(WaitForResults(monitor, k_AllNetworks, 2) == "lcm1 lcm0");
+        CHECK(GetGeneration(monitor) > generation);
+        generation = GetGeneration(monitor);
+
+        // Down, so not connected.
+        CHECK(Update(monitor, k_ConnectedNetworks | static_cast<std::int32_t>(UpdateInputFlags::ForceRefresh)) == k_Refreshed);
+        CHECK(PopResults(monitor, results, 8) == 0);
+
+        // Connected once both ends are up and the carrier follows.
+        SetLinkUp("lcm0");
+        SetLinkUp("lcm1");
+        CHECK(WaitForResults(monitor, k_ConnectedNetworks, 2) == "lcm1 lcm0");
+
+        // Deleting one end deletes the pair.
+        DeleteLink("lcm0");
+        CHECK(WaitForResults(monitor, k_AllNetworks, 0).empty());
+        CHECK(GetGeneration(monitor) > generation);
+
+        Destroy(monitor);
+    }
+
+    void WakeReleasesAWait()
+    {
+        void* monitor = Create();
+        CHECK(monitor != nullptr);
+        Update(monitor, static_cast<std::int32_t>(UpdateInputFlags::ForceRefresh));
+
+        std::int32_t waitResult = 0;
+        std::thread waiter([monitor, &waitResult]() { waitResult = WaitForChange(monitor, -1); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        Wake(monitor);
+        waiter.join();
+        CHECK(waitResult == k_Woken);
+
+        // A wake is consumed by the wait it released.
+        CHECK(WaitForChange(monitor, 0) == 0);
+
+        Destroy(monitor);
+    }
+}
+
+int main()
+{
+    if (unshare(CLONE_NEWNET) != 0)
+    {
+        std::printf("Skipped: no network namespace\n");
+        return k_SkipReturnCode;
+    }
+
+    // The veth driver may be missing, the probe pair is deleted with the namespace.
+    if (AddVethPair("lcmprobe0", "lcmprobe1") != 0)
+    {
+        std::printf("Skipped: no veth links\n");
+        return k_SkipReturnCode;
+    }
+    DeleteLink("lcmprobe0");
+
+    std::printf("ReportsTheLinkChanges\n");
+    ReportsTheLinkChanges();
+    std::printf("WakeReleasesAWait\n");
+    WakeReleasesAWait();
+    return 0;
+}
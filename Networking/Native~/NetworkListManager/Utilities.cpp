@@ -1,6 +1,8 @@
 #include "Utilities.h"
 
+#if defined(_WIN32)
 #include <combaseapi.h>
+#endif
 
 #include <cstdio>
 #include <fstream>
@@ -1,7 +1,11 @@
 #pragma once
 #include <functional>
-#include <guiddef.h>
 #include <mutex>
+#include <string>
+
+#if defined(_WIN32)
+#include <guiddef.h>
+#endif
 
 // Control log file output (0 = disabled, 1 = enabled)
 #define NLM_ENABLE_DEBUG_LOG 0
@@ -39,6 +43,7 @@ private:
 };
 #endif
 
+#if defined(_WIN32)
 template<> struct std::hash<GUID>
 {
     size_t operator()(const GUID& guid) const noexcept
@@ -50,3 +55,4 @@ template<> struct std::hash<GUID>
         return bits;
     }
 };
+#endif
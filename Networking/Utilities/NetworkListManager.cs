@@ -51,7 +51,10 @@ namespace Unity.LiveCapture.Networking
         }
 
         readonly ConcurrentDictionary<Guid, NetworkCategory> m_Cache;
+        readonly object m_Lock = new object();
         Thread m_Thread;
+        NetworkListManagerWorker m_Worker;
+        volatile bool m_Disposed;
 
         public NetworkListManagerThreaded()
         {
@@ -71,19 +74,26 @@ namespace Unity.LiveCapture.Networking
 
             using (var nlm = new NetworkListManagerWorker(cache))
             {
-                try
+                // Published so that Dispose can wake the thread up.
+                lock (m_Lock)
                 {
-                    nlm.Update(true);
+                    m_Worker = nlm;
+                }
+
+                nlm.Update(true);
 
-                    while (true)
+                // The plugin signals the network changes, there is nothing to do in between.
+                while (!m_Disposed)
+                {
+                    if (nlm.WaitForChange(Timeout.Infinite).HasFlag(WaitOutputFlags.Changed))
                     {
                         nlm.Update(false);
-                        Thread.Sleep(100);
                     }
                 }
-                catch(ThreadAbortException)
+
+                lock (m_Lock)
                 {
-                    Profiler.EndThreadProfiling();
+                    m_Worker = null;
                 }
             }
 
@@ -125,7 +135,13 @@ namespace Unity.LiveCapture.Networking
         public void Dispose()
         {
 #if LIVE_CAPTURE_NLM_SUPPORTED
-            m_Thread?.Abort();
+            lock (m_Lock)
+            {
+                m_Disposed = true;
+                m_Worker?.Wake();
+            }
+
+            m_Thread?.Join();
             m_Thread = null;
 #endif
         }
@@ -136,7 +152,12 @@ namespace Unity.LiveCapture.Networking
 #if LIVE_CAPTURE_NLM_SUPPORTED
         static readonly ProfilerMarker k_UpdateMarker = new ProfilerMarker($"{nameof(NetworkListManagerBase)}.{nameof(Update)}");
 
+        // Matches the capacity of the plugin, a refresh is read in one call.
+        const int k_MaxResults = 64;
+
         readonly NetworkListManagerPlugin m_Plugin;
+        readonly Result[] m_Results = new Result[k_MaxResults];
+        uint m_Generation;
 #endif
 
         protected NetworkListManagerBase()
@@ -158,26 +179,48 @@ namespace Unity.LiveCapture.Networking
                 }
 
                 var updateOutputFlags = m_Plugin.Update(updateInputFlags);
-                if (updateOutputFlags.HasFlag(UpdateOutputFlags.Refreshed))
+                if (!updateOutputFlags.HasFlag(UpdateOutputFlags.Refreshed))
                 {
-                    ProcessRefresh();
+                    return;
                 }
 
-                while (true)
+                // The results are read even when they are skipped, so that the next refresh starts empty.
+                var generation = m_Plugin.GetGeneration();
+                var count = m_Plugin.PopResults(m_Results);
+
+                if (!forceRefresh && generation == m_Generation)
                 {
-                    var flags = m_Plugin.PopResult(out var result);
+                    return;
+                }
 
-                    if (flags.HasFlag(PopOutputFlags.Empty))
-                    {
-                        break;
-                    }
+                m_Generation = generation;
 
-                    ProcessResult(result, flags);
+                ProcessRefresh();
+
+                for (var i = 0; i < count; ++i)
+                {
+                    ProcessResult(m_Results[i], PopOutputFlags.None);
                 }
             }
 #endif
         }
 
+        public WaitOutputFlags WaitForChange(int timeoutMs)
+        {
+#if LIVE_CAPTURE_NLM_SUPPORTED
+            return m_Plugin.WaitForChange(timeoutMs);
+#else
+            return WaitOutputFlags.None;
+#endif
+        }
+
+        public void Wake()
+        {
+#if LIVE_CAPTURE_NLM_SUPPORTED
+            m_Plugin.Wake();
+#endif
+        }
+
         protected abstract void ProcessRefresh();
 
         protected abstract void ProcessResult(Result result, PopOutputFlags flags);
@@ -256,6 +299,14 @@ namespace Unity.LiveCapture.Networking
         Empty = 1 << 0,
     }
 
+    [Flags]
+    enum WaitOutputFlags
+    {
+        None = 0,
+        Changed = 1 << 0,
+        Woken = 1 << 1,
+    }
+
     struct Result
     {
         public Guid m_AdapterId;
@@ -298,6 +349,38 @@ namespace Unity.LiveCapture.Networking
             return (UpdateOutputFlags)outFlags;
         }
 
+        public int PopResults(Result[] results)
+        {
+            var count = PopResults(m_Instance, results, results.Length);
+            if (count < 0)
+            {
+                throw new InvalidOperationException("Invalid instance.");
+            }
+
+            return count;
+        }
+
+        public uint GetGeneration()
+        {
+            return GetGeneration(m_Instance);
+        }
+
+        public WaitOutputFlags WaitForChange(int timeoutMs)
+        {
+            var flags = WaitForChange(m_Instance, timeoutMs);
+            if (flags < 0)
+            {
+                throw new InvalidOperationException("Invalid instance.");
+            }
+
+            return (WaitOutputFlags)flags;
+        }
+
+        public void Wake()
+        {
+            Wake(m_Instance);
+        }
+
         public PopOutputFlags PopResult(out Result outResult)
         {
             var flags = PopResult(m_Instance, out Guid adapterId, out int networkCategory);
@@ -327,6 +410,18 @@ namespace Unity.LiveCapture.Networking
 
         [DllImport(PluginName)]
         static extern int PopResult(IntPtr instance, out Guid adapterId, out int networkCategory);
+
+        [DllImport(PluginName)]
+        static extern int PopResults(IntPtr instance, [Out] Result[] results, int capacity);
+
+        [DllImport(PluginName)]
+        static extern uint GetGeneration(IntPtr instance);
+
+        [DllImport(PluginName)]
+        static extern int WaitForChange(IntPtr instance, int timeoutMs);
+
+        [DllImport(PluginName)]
+        static extern void Wake(IntPtr instance);
     }
 #endif
 }
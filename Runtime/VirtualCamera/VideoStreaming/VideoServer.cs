@@ -38,6 +38,12 @@ namespace Unity.LiveCapture.VirtualCamera
             set => m_Camera = value;
         }
 
+        /// <summary>
+        /// The timecode of the current frame, embedded in the encoded video frames so that they can be aligned
+        /// with the recorded takes.
+        /// </summary>
+        public FrameTimeWithRate? CurrentTime { get; set; }
+
         /// <summary>
         /// Is the server is currently running.
         /// </summary>
@@ -164,6 +170,29 @@ namespace Unity.LiveCapture.VirtualCamera
             return Vector2Int.RoundToInt(res * VideoServerSettings.Instance.ResolutionScale);
         }
 
+        /// <inheritdoc/>
+        FrameTimecode IVideoStreamSink.GetTimecode()
+        {
+            if (!CurrentTime.HasValue || !CurrentTime.Value.Rate.IsValid)
+                return default;
+
+            var time = CurrentTime.Value;
+            var timecode = time.ToTimecode();
+
+            return new FrameTimecode
+            {
+                hours = timecode.Hours,
+                minutes = timecode.Minutes,
+                seconds = timecode.Seconds,
+                frames = timecode.Frames,
+                subframe = timecode.Subframe.Value,
+                subframeResolution = timecode.Subframe.Resolution,
+                rateNumerator = time.Rate.Numerator,
+                rateDenominator = time.Rate.Denominator,
+                isDropFrame = timecode.IsDropFrame ? 1 : 0,
+            };
+        }
+
         /// <inheritdoc/>
         bool IVideoStreamSink.ShouldPrioritizeLatency()
         {
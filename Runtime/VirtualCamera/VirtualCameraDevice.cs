@@ -798,6 +798,7 @@ namespace Unity.LiveCapture.VirtualCamera
             var camera = GetCamera();
             m_FocusPlaneRenderer.SetCamera(camera);
             m_VideoServer.Camera = camera;
+            m_VideoServer.CurrentTime = Synchronizer?.TimecodeSource?.CurrentTime;
             m_VideoServer.Update();
 
             UpdateClient();
@@ -5,17 +5,29 @@
 #define ENABLE_TRACE 0
 
 #if ENABLE_TRACE
+#define LIVECAPTURE_LOG_LEVEL 0
+
 #include <codecvt>
 #include <chrono>
-#include <fstream>
 #include <locale>
 #include <mutex>
 #include <sstream>
 
-static std::ofstream g_logFile;
+#include "AsyncLogger.h"
+
+// The message is formatted on the calling thread, the file is written by the logger thread.
 #define TRACE_HEX(val) std::hex << std::uppercase << val << std::nouppercase << std::dec
 #define TRACE_TIMESTAMP (std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::time_point_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch()).count())
-#define TRACE(msg) { std::stringstream os; os << TRACE_TIMESTAMP << " | " << msg << std::endl; g_logFile << os.str(); g_logFile.flush(); }
+#define TRACE(msg) \
+{ \
+	auto& logger = LiveCaptureNative::AsyncLogger::Get(); \
+	if (logger.IsEnabled(LiveCaptureNative::LogLevel::Debug)) \
+	{ \
+		std::stringstream os; \
+		os << msg; \
+		logger.Write(LiveCaptureNative::LogLevel::Debug, os.str().c_str()); \
+	} \
+}
 #else
 #define TRACE(msg) {}
 #endif
@@ -31,6 +43,12 @@ static std::ofstream g_logFile;
 #include <vector>
 #include <wmcodecdsp.h>
 
+#include "EncodeFrameContext.h"
+#include "EncoderStats.h"
+#include "TimecodeSei.h"
+#include "TraceRecorder.h"
+#include "UnityEncoderProfiler.h"
+
 #pragma comment(lib, "mfplat.lib")
 #pragma comment(lib, "mfuuid.lib")
 #pragma comment(lib, "wmcodecdspuuid.lib")
@@ -295,7 +313,21 @@ public:
 		return static_cast<uint32_t>(m_Pps.size());
 	}
 
-	bool Encode(const uint8_t* const pixelData, const uint64_t timeStampNs)
+	// Timing of the last frame returned by EndConsume.
+	void GetFrameTiming(uint64_t& sequenceOut, uint64_t& encodeLatencyNsOut) const
+	{
+		sequenceOut = m_LastSequence;
+		encodeLatencyNsOut = m_LastEncodeLatency;
+	}
+
+	// Counters and latency histograms, see GetEncoderStats. The MFT has no output queue: the
+	// encode latency runs to EndConsume and the consume latency from BeginConsume.
+	void GetStats(LiveCaptureNative::EncoderStatsSnapshot& snapshot) const
+	{
+		m_Stats.Snapshot(snapshot);
+	}
+
+	bool Encode(const uint8_t* const pixelData, const uint64_t timeStampNs, const LiveCaptureNative::FrameTimecode& timecode)
 	{
 #if ENABLE_TRACE
 		auto start = TRACE_TIMESTAMP;
@@ -325,20 +357,29 @@ public:
 		BYTE* dataPtr = nullptr;
 		CHECK_HR_RET(mediaBuffer->Lock(&dataPtr, nullptr, nullptr), "Could not lock media buffer");
 		TRACE("memcpy");
+		{
+			LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Copy);
+			LiveCaptureNative::TraceScope traceScope("Encoder.Copy", timeStampNs);
+			const auto copyStart = LiveCaptureNative::GetEncodeClockNs();
 #if USE_TEST_CONTENT
-		memcpy(dataPtr, m_TempImage.data(), m_TempImage.size());
+			memcpy(dataPtr, m_TempImage.data(), m_TempImage.size());
 #elif USE_MONOCHROME_CONTENT
-		const int pixCount = m_Width * m_Height;
-		memcpy(dataPtr, pixelData, pixCount);
-		memset(dataPtr + pixCount, 127, pixCount / 2);
+			const int pixCount = m_Width * m_Height;
+			memcpy(dataPtr, pixelData, pixCount);
+			memset(dataPtr + pixCount, 127, pixCount / 2);
 #else
-		memcpy(dataPtr, pixelData, bufferSize);
+			memcpy(dataPtr, pixelData, bufferSize);
 #endif
+			m_Stats.RecordCopy(LiveCaptureNative::GetEncodeClockNs() - copyStart);
+		}
 		TRACE("IMFMediaBuffer::Unlock");
 		mediaBuffer->Unlock();
 		TRACE("IMFMediaBuffer::SetCurrentLength");
 		CHECK_HR_RET(mediaBuffer->SetCurrentLength(bufferSize), "Could not set buffer length");
 
+		// The sample time comes back on the output sample, it is used to find the frame timing.
+		m_FrameContexts.Begin(timeStampNs, timecode);
+
 		TRACE("IMFSample::SetSampleTime");
 		const LONGLONG sampleTimeHNS = timeStampNs / 100;
 		CHECK_HR_RET(mediaSample->SetSampleTime(sampleTimeHNS), "Could not set sample time");
@@ -348,12 +389,18 @@ public:
 		CHECK_HR_RET(mediaSample->SetSampleDuration(frameDurationHNS), "Could not set sample duration");
 
 		TRACE("IMFTransform::ProcessInput");
-		HRESULT hr = m_Transform->ProcessInput(0, mediaSample, 0);
+		HRESULT hr;
+		{
+			LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::EncodePicture);
+			LiveCaptureNative::TraceScope traceScope("Encoder.Submit", timeStampNs, LiveCaptureNative::TraceFlow::Step);
+			hr = m_Transform->ProcessInput(0, mediaSample, 0);
+		}
 		if (!SUCCEEDED(hr))
 		{
 			TRACE("The resampler H264 ProcessInput call failed");
 			return false;
 		}
+		m_Stats.RecordSubmit();
 
 		TRACE("H264Encoder::Encode done: " << (TRACE_TIMESTAMP - start));
 		return true;
@@ -418,8 +465,11 @@ public:
 		}
 
 		TRACE("GetNextEncodedBuffer");
-		if (!GetNextEncodedBuffer())
-			return false;
+		{
+			LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::WaitCompletion);
+			if (!GetNextEncodedBuffer())
+				return false;
+		}
 
 		// If the output buffer is not set at this point, it's because the transform provide IMFSamples, so it's our
 		// job to extract the buffer from the sample.
@@ -437,6 +487,11 @@ public:
 		// FIXME: Trying something. If we expose the prefix as well, this triggers H264 slicing in the
 		// client, which will do the same job we'd have to do on the RTP packetization side. Give it a try...
 		sizeOut = length; //  -kAnnexBPrefixSize;
+
+		// The timecode SEI is inserted by EndConsume, the caller sizes its buffer for it.
+		PrepareTimecodeSei(length);
+		sizeOut += static_cast<uint32_t>(m_SeiSize);
+		m_OutputReadyTime = LiveCaptureNative::GetEncodeClockNs();
 		TRACE("H264Encoder::BeginConsume done: " << (TRACE_TIMESTAMP - start));
 		return true;
 	}
@@ -467,6 +522,8 @@ public:
 		else
 			TRACE("Nalu lenght information not available.");
 
+		LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::LockBitstream);
+
 		DWORD bufLength = 0;
 		CHECK_HR_RET(outputBuffer->GetCurrentLength(&bufLength), "Get buffer length failed.\n");
 		uint8_t* src = nullptr;
@@ -478,11 +535,35 @@ public:
 #endif
 		// FIXME: Trying something. See equivalent FIXME in BeginConsume for actually exposing the prefix.
 		const size_t offsetInBuffer = 0; //  kAnnexBPrefixSize;
-		memcpy(dst, src + offsetInBuffer, bufLength - offsetInBuffer);
+		const size_t encodedSize = bufLength - offsetInBuffer;
+		if (m_SeiSize > 0 && m_SeiOffset <= encodedSize)
+		{
+			memcpy(dst, src + offsetInBuffer, m_SeiOffset);
+			memcpy(dst + m_SeiOffset, m_SeiNal.data(), m_SeiSize);
+			memcpy(dst + m_SeiOffset + m_SeiSize, src + offsetInBuffer + m_SeiOffset, encodedSize - m_SeiOffset);
+		}
+		else
+		{
+			memcpy(dst, src + offsetInBuffer, encodedSize);
+		}
+		m_SeiSize = 0;
 		CHECK_HR_RET(outputBuffer->Unlock(), "Could not unlock buffer");
+
+		auto& profiler = LiveCaptureNative::GetEncoderProfiler();
+		if (profiler.IsEnabled())
+		{
+			profiler.SetCounter(LiveCaptureNative::EncoderCounter::FrameBytes, bufLength - offsetInBuffer);
+		}
 		LONGLONG sampleTime = 0;
 		CHECK_HR_RET(outputSample->GetSampleTime(&sampleTime), "Could not get sample time");
-		timeStampNsOut = sampleTime;
+
+		LiveCaptureNative::EncodeFrameContext context;
+		const bool hasContext = FindFrameContext(sampleTime, context);
+
+		timeStampNsOut = hasContext ? context.timestamp : static_cast<uint64_t>(sampleTime) * 100;
+		m_LastSequence = hasContext ? context.sequence : 0;
+		const auto outputTime = LiveCaptureNative::GetEncodeClockNs();
+		m_LastEncodeLatency = hasContext ? outputTime - context.submitTime : 0;
 
 		UINT32 isKey = 0;
 		hr = outputSample->GetUINT32(MFSampleExtension_CleanPoint, &isKey);
@@ -494,6 +575,13 @@ public:
 			isKeyFrame = isKey != 0;
 
 		TRACE("H264Encoder::EndConsume isKeyFrame: " << isKey);
+		m_Stats.RecordEncoded(m_LastEncodeLatency, bufLength - offsetInBuffer, isKey != 0, 0);
+		m_Stats.RecordConsumed(outputTime - m_OutputReadyTime, 0);
+		if (hasContext)
+		{
+			LiveCaptureNative::TraceComplete("Encoder.Encode", context.timestamp, context.submitTime, m_OutputReadyTime);
+			LiveCaptureNative::TraceComplete("Encoder.Queue", context.timestamp, m_OutputReadyTime, outputTime);
+		}
 		if (!isKeyFrame)
 			return true;
 
@@ -504,6 +592,45 @@ public:
 
 private:
 
+	// The sample time is in 100ns units, the submitted context keeps the exact capture time.
+	bool FindFrameContext(LONGLONG sampleTime, LiveCaptureNative::EncodeFrameContext& context) const
+	{
+		return m_FrameContexts.FindIf([sampleTime](const LiveCaptureNative::EncodeFrameContext& c)
+		{
+			return static_cast<LONGLONG>(c.timestamp / 100) == sampleTime;
+		}, context);
+	}
+
+	// Writes the timecode SEI of the output sample and finds where it goes, before the first slice.
+	// The SEI is skipped when the frame context was lost.
+	void PrepareTimecodeSei(DWORD length)
+	{
+		m_SeiSize = 0;
+
+		LONGLONG sampleTime = 0;
+		LiveCaptureNative::EncodeFrameContext context;
+		if (FAILED(m_OutputData.pSample->GetSampleTime(&sampleTime)) || !FindFrameContext(sampleTime, context))
+			return;
+
+		uint8_t* src = nullptr;
+		if (FAILED(m_OutputBuffer->Lock(&src, nullptr, nullptr)))
+			return;
+		m_SeiOffset = LiveCaptureNative::Sei::GetMetadataOffset(LiveCaptureNative::Sei::Codec::H264, src, length);
+		m_OutputBuffer->Unlock();
+
+		if (m_SeiOffset == length)
+		{
+			TRACE("No slice found for the timecode SEI.");
+			return;
+		}
+
+		LiveCaptureNative::Sei::FrameMetadata metadata;
+		metadata.timecode = context.timecode;
+		metadata.sequence = context.sequence;
+		metadata.timestamp = context.timestamp;
+		m_SeiSize = LiveCaptureNative::Sei::WriteMetadataNal(LiveCaptureNative::Sei::Codec::H264, metadata, m_SeiNal.data(), m_SeiNal.size());
+	}
+
 	bool ParseSpsPps()
 	{
         IMFMediaTypePtr mediaType;
@@ -644,6 +771,14 @@ private:
 	IMFSamplePtr           m_OutputSample;
 	std::vector<uint8_t>   m_Sps;
 	std::vector<uint8_t>   m_Pps;
+	LiveCaptureNative::EncodeFrameContextTable<16> m_FrameContexts;
+	uint64_t               m_LastSequence = 0;
+	uint64_t               m_LastEncodeLatency = 0;
+	uint64_t               m_OutputReadyTime = 0;
+	std::array<uint8_t, LiveCaptureNative::Sei::k_MaxNalSize> m_SeiNal;
+	size_t                 m_SeiSize = 0;   // Timecode SEI of the sample between BeginConsume and EndConsume.
+	size_t                 m_SeiOffset = 0;
+	LiveCaptureNative::EncoderStats m_Stats;
 #if USE_TEST_CONTENT
 	std::vector<uint8_t>   m_TempImage;
 #endif
@@ -659,12 +794,32 @@ void InitLog()
 		return;
 	std::string logPath(home.data());
 	logPath.append("\\H264Encoder.log");
-	g_logFile.open(logPath, std::fstream::out | std::fstream::trunc);
+	LiveCaptureNative::AsyncLogger::Get().Open(logPath);
 }
 #endif
 
 #define PINVOKE_ENTRY_POINT extern "C" __declspec(dllexport)
 
+// Installed as the encoder profiler while the plugin is loaded.
+static std::unique_ptr<LiveCaptureNative::UnityEncoderProfiler> s_EncoderProfiler;
+
+// Unity calls these for every native plugin it loads, even when only used through P/Invoke.
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginLoad(IUnityInterfaces* unityInterfaces)
+{
+	const auto unityProfiler = (unityInterfaces != nullptr) ? unityInterfaces->Get<IUnityProfiler>() : nullptr;
+	if (unityProfiler)
+	{
+		s_EncoderProfiler.reset(new LiveCaptureNative::UnityEncoderProfiler(unityProfiler));
+		LiveCaptureNative::SetEncoderProfiler(s_EncoderProfiler.get());
+	}
+}
+
+extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API UnityPluginUnload()
+{
+	// An encoder may still be sampling the profiler, it is only destroyed with the plugin.
+	LiveCaptureNative::SetEncoderProfiler(nullptr);
+}
+
 PINVOKE_ENTRY_POINT H264Encoder* Create(uint32_t width, uint32_t height, uint32_t frameRateNumerator, uint32_t frameRateDenominator, uint32_t averageBitRate, uint32_t gopSize)
 {
 #if ENABLE_TRACE
@@ -679,6 +834,14 @@ PINVOKE_ENTRY_POINT H264Encoder* Create(uint32_t width, uint32_t height, uint32_
 	return nullptr;
 }
 
+// Lowest LiveCaptureNative::LogLevel traced, only effective when ENABLE_TRACE is set.
+PINVOKE_ENTRY_POINT void SetLogLevel(int level)
+{
+#if ENABLE_TRACE
+	LiveCaptureNative::AsyncLogger::Get().SetLevel(static_cast<LiveCaptureNative::LogLevel>(level));
+#endif
+}
+
 PINVOKE_ENTRY_POINT bool Destroy(H264Encoder* encoder)
 {
 	delete encoder;
@@ -695,9 +858,9 @@ PINVOKE_ENTRY_POINT uint32_t GetPps(H264Encoder* encoder, uint8_t* ppsOut)
 	return encoder == nullptr ? 0 : encoder->GetPps(ppsOut);
 }
 
-PINVOKE_ENTRY_POINT bool Encode(H264Encoder* encoder, uint8_t* pixelData, uint64_t timeStampNs)
+PINVOKE_ENTRY_POINT bool Encode(H264Encoder* encoder, uint8_t* pixelData, uint64_t timeStampNs, const LiveCaptureNative::FrameTimecode* timecode)
 {
-	return encoder != nullptr && encoder->Encode(pixelData, timeStampNs);
+	return encoder != nullptr && encoder->Encode(pixelData, timeStampNs, timecode != nullptr ? *timecode : LiveCaptureNative::FrameTimecode());
 }
 
 PINVOKE_ENTRY_POINT bool BeginConsume(H264Encoder* encoder, uint32_t* sizeOut)
@@ -710,3 +873,59 @@ PINVOKE_ENTRY_POINT bool EndConsume(H264Encoder* encoder, uint8_t* dst, uint64_t
 	return encoder != nullptr && dst != nullptr && timeStampNsOut != nullptr && isKeyFrameOut != nullptr && 
 		encoder->EndConsume(dst, *timeStampNsOut, *isKeyFrameOut);
 }
+
+PINVOKE_ENTRY_POINT bool GetFrameTiming(H264Encoder* encoder, uint64_t* sequenceOut, uint64_t* encodeLatencyNsOut)
+{
+	if (encoder == nullptr || sequenceOut == nullptr || encodeLatencyNsOut == nullptr)
+		return false;
+
+	encoder->GetFrameTiming(*sequenceOut, *encodeLatencyNsOut);
+	return true;
+}
+
+PINVOKE_ENTRY_POINT bool GetEncoderStats(H264Encoder* encoder, LiveCaptureNative::EncoderStatsSnapshot* stats)
+{
+	if (encoder == nullptr || stats == nullptr)
+		return false;
+
+	encoder->GetStats(*stats);
+	return true;
+}
+
+// Pipeline trace, see TraceRecorder. The managed side records its stages through the same
+// recorder so that all the events share one clock.
+PINVOKE_ENTRY_POINT void TraceSetEnabled(bool enabled)
+{
+	LiveCaptureNative::TraceRecorder::Get().SetEnabled(enabled);
+}
+
+PINVOKE_ENTRY_POINT void TraceClear()
+{
+	LiveCaptureNative::TraceRecorder::Get().Clear();
+}
+
+PINVOKE_ENTRY_POINT int TraceRegisterName(const char* name)
+{
+	return LiveCaptureNative::TraceRecorder::Get().RegisterName(name);
+}
+
+PINVOKE_ENTRY_POINT void TraceSetThreadName(const char* name)
+{
+	LiveCaptureNative::TraceRecorder::Get().SetThreadName(name);
+}
+
+PINVOKE_ENTRY_POINT void TraceBegin(int nameId, uint64_t frameId, int flow)
+{
+	LiveCaptureNative::TraceBeginNamed(nameId, frameId, static_cast<LiveCaptureNative::TraceFlow>(flow));
+}
+
+PINVOKE_ENTRY_POINT void TraceEnd(int nameId, uint64_t frameId)
+{
+	LiveCaptureNative::TraceEndNamed(nameId, frameId);
+}
+
+// Writes the recorded events to a Chrome trace JSON file.
+PINVOKE_ENTRY_POINT bool TraceDump(const char* path)
+{
+	return LiveCaptureNative::TraceRecorder::Get().DumpChromeJson(path);
+}
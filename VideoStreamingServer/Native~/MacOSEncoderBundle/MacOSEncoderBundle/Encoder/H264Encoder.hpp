@@ -7,8 +7,10 @@
 #include <chrono>
 #endif
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <vector>
-#include <queue>
 
 #import <CoreMedia/CoreMedia.h>
 #import <CoreVideo/CoreVideo.h>
@@ -17,8 +19,16 @@
 #import <Metal/Metal.h>
 
 #include "PluginUtils.hpp"
+#include "EncodedFrameQueue.h"
+#include "EncodeFrameContext.h"
+#include "EncoderStats.h"
+#include "Fmp4Recorder.h"
+#include "ReplayExporter.h"
+#include "TimecodeSei.h"
 #include "MacOSEncoderSessionDataPlugin.hpp"
 
+struct IUnityGraphicsMetalV1;
+
 namespace MacOsEncodingPlugin
 {
 
@@ -42,32 +52,90 @@ enum class MacOSEncoderStatus
 
 class MetalGraphicsEncoderDevice;
 
+static const int k_DefaultEncodedFrameQueueLength = 8;
+static const int k_EncodedFrameQueueCapacity = 2 * LiveCaptureNative::k_MaxOutputQueueLength;
+static const int k_FrameContextCount = 16;
+
+// An encoded frame with the timing of its submission.
+struct EncodedFrameEntry
+{
+    EncodedFrame frame;
+    uint64_t     sequence = 0;      // Submission order of the frame.
+    uint64_t     encodeLatency = 0; // Submit to output time, in nanoseconds.
+    uint64_t     outputTime = 0;    // GetEncodeClockNs() when the frame was queued.
+};
+
+// Written by the VideoToolbox callback thread, read by the Unity thread.
+using EncodedFrameRing = LiveCaptureNative::EncodedFrameQueue<EncodedFrameEntry, k_EncodedFrameQueueCapacity>;
+using FrameContextTable = LiveCaptureNative::EncodeFrameContextTable<k_FrameContextCount>;
+
 class H264Encoder
 {
     
 public: // Methods
     
-    H264Encoder(const MacOSEncoderSessionData& frameData, MetalGraphicsEncoderDevice* const device);
+    H264Encoder(const MacOSEncoderSessionData& frameData,
+                MetalGraphicsEncoderDevice* const device,
+                CVMetalTextureCacheRef textureCache,
+                IUnityGraphicsMetalV1* metalGraphics,
+                const LiveCaptureNative::EncoderBufferingSettings& buffering = {});
     ~H264Encoder();
     
     void Initialize(bool useSRGB, bool allocateBuffers = true);
     void Dispose();
-    bool EncodeFrame(void* frameSource, unsigned long long int timestamp);
+    bool EncodeFrame(void* frameSource,
+                     unsigned long long int timestamp,
+                     const LiveCaptureNative::FrameTimecode& timecode);
     
     bool RemoveEncodedFrame();
     EncodedFrame*  GetEncodedFrame();
+    EncodedFrameEntry* GetEncodedFrameEntry();
     
     inline bool IsInitialized() { return m_InitializationResult == MacOSEncoderStatus::Success; }
-    inline std::queue<EncodedFrame>& GetFrameQueue() { return m_FrameQueue; }
-    inline int GetMaxQueueLength() const { return k_MaxQueueLength; }
-    inline unsigned long long int GetLatestTimestamp() { return m_LatestTimestamp; }
+    inline EncodedFrameRing& GetFrameQueue() { return m_FrameQueue; }
+    inline const FrameContextTable& GetFrameContexts() const { return m_FrameContexts; }
+    inline LiveCaptureNative::EncoderStats& GetStats() { return m_Stats; }
+    inline const LiveCaptureNative::EncoderBufferingSettings& GetBuffering() const { return m_Buffering; }
+    
+    // VideoToolbox callback thread, once per submitted frame whatever its status: the encoder is
+    // done with the pixel buffer it was submitted with.
+    inline void OnFrameOutput(int bufferIndex) { m_BufferBusy[bufferIndex].store(false, std::memory_order_release); }
+    
+    // Input textures backed by the IOSurfaces of the session pixel buffers. Unity can render
+    // into them directly: a frame submitted with one of these textures is encoded without a copy,
+    // once the Unity command buffer rendering it has completed.
+    inline int GetInputTextureCount() const { return m_BufferCount; }
+    void* GetInputTexture(int index) const;
+    
+    // Recording of the encoded stream to a fragmented MP4 file. Every encoded frame is recorded,
+    // including the ones the frame queue drops. Called from the Unity thread.
+    bool StartRecording(const char* path, const LiveCaptureNative::Fmp4RecorderSettings& settings);
+    void StopRecording();
+    void GetRecordingStats(LiveCaptureNative::Fmp4RecorderStats& stats);
+    
+    // Instant replay: the last encoded frames are kept in memory while the replay buffer is
+    // enabled (settings not null), SaveReplay() writes them to a fragmented MP4 file in the
+    // background. Called from the Unity thread.
+    void ConfigureReplayBuffer(const LiveCaptureNative::ReplayBufferSettings* settings);
+    bool SaveReplay(const char* path, uint64_t durationNs);
+    bool GetReplayBufferStats(LiveCaptureNative::ReplayBufferStats& stats);
+    void GetReplayExportStats(LiveCaptureNative::Fmp4RecorderStats& stats);
+    
+    // VideoToolbox callback thread. Frames the queue drops are parsed into GetDroppedFrame() when
+    // recording or when the replay buffer is enabled.
+    inline bool IsRetainingFrames() const { return m_IsRetainingFrames.load(std::memory_order_relaxed); }
+    inline EncodedFrame& GetDroppedFrame() { return m_DroppedFrame; }
+    void RecordFrame(const EncodedFrame& frame);
     
 private: // Members
 
+    // Default and maximum number of frames in flight (see EncoderBufferingSettings::inFlightDepth).
     static const NSInteger k_BufferedFrameNumbers = 3;
-    static const int k_MaxQueueLength = 8;
+    static const NSInteger k_MaxBufferedFrameNumbers = LiveCaptureNative::k_MaxInFlightDepth;
     
     MetalGraphicsEncoderDevice* m_GraphicDevice;
+    IUnityGraphicsMetalV1*      m_MetalGraphics;
+    CVMetalTextureCacheRef      m_TextureCache;
     VTCompressionSessionRef     m_EncodingSession;
     bool                        m_SessionCreated;
     bool                        m_UseSRGB;
@@ -76,10 +144,45 @@ private: // Members
     MacOSEncoderSessionData     m_FrameData;
     uint64                      m_FrameCount;
     
-    CVPixelBufferRef            m_PixelBuffers[k_BufferedFrameNumbers];
-    id<MTLTexture>              m_RenderTextures[k_BufferedFrameNumbers];
-    std::queue<EncodedFrame>    m_FrameQueue;
-    unsigned long long int      m_LatestTimestamp;
+    // Buffering as requested by the session settings, and as validated in Initialize().
+    LiveCaptureNative::EncoderBufferingSettings m_RequestedBuffering;
+    LiveCaptureNative::EncoderBufferingSettings m_Buffering;
+    
+    // Only the first m_BufferCount (the validated in-flight depth) are allocated.
+    int                         m_BufferCount;
+    std::atomic<bool>           m_BufferBusy[k_MaxBufferedFrameNumbers]; // Submitted, not output yet.
+    CVPixelBufferRef            m_PixelBuffers[k_MaxBufferedFrameNumbers];
+    CVMetalTextureRef           m_MetalTextures[k_MaxBufferedFrameNumbers];
+    id<MTLTexture>              m_RenderTextures[k_MaxBufferedFrameNumbers]; // Owned by m_MetalTextures.
+    
+    // Counters and latency histograms, exported through GetEncoderStats.
+    LiveCaptureNative::EncoderStats m_Stats;
+    
+    EncodedFrameRing            m_FrameQueue;
+    
+    // Timing of the frames in flight, looked up from the sourceFrameRefCon of each output.
+    FrameContextTable           m_FrameContexts;
+    
+    // Frames waiting for their Unity command buffer to complete before being submitted. Shared with
+    // the completion handlers, the encoder detaches itself when the session ends.
+    struct DeferredFrames
+    {
+        std::mutex   mutex;
+        H264Encoder* encoder = nullptr;
+        int          count = 0;
+    };
+    std::shared_ptr<DeferredFrames> m_DeferredFrames;
+    
+    // Recording and replay buffer, the mutex serializes their setup with the callback thread. The
+    // stats of the last recording are kept once it is stopped. The exporter reads the replay
+    // buffer, it is declared after it so that it is destroyed first.
+    std::mutex                                       m_RecorderMutex;
+    std::unique_ptr<LiveCaptureNative::Fmp4Recorder> m_Recorder;
+    std::atomic<bool>                                m_IsRetainingFrames; // Recorder or replay buffer.
+    LiveCaptureNative::Fmp4RecorderStats             m_LastRecordingStats;
+    std::unique_ptr<LiveCaptureNative::ReplayBuffer> m_ReplayBuffer;
+    LiveCaptureNative::ReplayExporter                m_ReplayExporter;
+    EncodedFrame                                     m_DroppedFrame;
     
 private: // Methods
     
@@ -89,7 +192,13 @@ private: // Methods
     bool allocateBuffers();
     void releaseBuffers();
     
+    void configureBuffering();
+    int acquireInputBuffer(int bufferIndex);
+    bool hasDeferredFrames();
+    bool deferSubmit(int bufferIndex, const LiveCaptureNative::EncodeFrameContext& context);
+    bool submitFrame(int bufferIndex, const LiveCaptureNative::EncodeFrameContext& context);
     bool copyBuffer(void* frameSource, int frameIndex);
+    int findInputTexture(void* frameSource) const;
 };
 
 }
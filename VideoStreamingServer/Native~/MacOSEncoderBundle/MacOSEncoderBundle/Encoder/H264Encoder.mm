@@ -1,34 +1,67 @@
 #include "H264Encoder.hpp"
 #include "MetalGraphicsEncoderDevice.hpp"
+#include "../Unity/IUnityGraphicsMetal.h"
+#include "AnnexBConverter.h"
+#include "EncoderProfiler.h"
+#include "TraceRecorder.h"
 
 #define ENABLE_COLORSPACE_CONVERSION 0
 
 namespace MacOsEncodingPlugin
 {
     const NSInteger H264Encoder::k_BufferedFrameNumbers;
-    const int H264Encoder::k_MaxQueueLength;
+    const NSInteger H264Encoder::k_MaxBufferedFrameNumbers;
 
     H264Encoder::H264Encoder(const MacOSEncoderSessionData& frameData,
-                             MetalGraphicsEncoderDevice* const device)
+                             MetalGraphicsEncoderDevice* const device,
+                             CVMetalTextureCacheRef textureCache,
+                             IUnityGraphicsMetalV1* metalGraphics,
+                             const LiveCaptureNative::EncoderBufferingSettings& buffering)
         : m_GraphicDevice(device)
+        , m_MetalGraphics(metalGraphics)
+        , m_TextureCache(textureCache)
         , m_EncodingSession(nullptr)
         , m_SessionCreated(false)
         , m_InitializationResult(MacOSEncoderStatus::NotInitialized)
         , m_FrameData(frameData)
         , m_FrameCount(0)
+        , m_RequestedBuffering(buffering)
+        , m_Buffering()
+        , m_BufferCount(k_BufferedFrameNumbers)
+        , m_BufferBusy()
+        , m_PixelBuffers()
+        , m_MetalTextures()
+        , m_RenderTextures()
+        , m_FrameQueue(m_Stats)
+        , m_IsRetainingFrames(false)
+        , m_LastRecordingStats()
     {
         WriteFileDebug("Info: [H264Encoder()] - Constructor called.\n");
+        
+        // The cache is shared by the encoders of the device, keep it alive as long as our textures.
+        if (m_TextureCache != nullptr)
+        {
+            CFRetain(m_TextureCache);
+        }
     }
     
     H264Encoder::~H264Encoder()
     {
         Dispose();
+        
+        if (m_TextureCache != nullptr)
+        {
+            CFRelease(m_TextureCache);
+            m_TextureCache = nullptr;
+        }
     }
     
     void H264Encoder::Initialize(bool useSRGB, bool buffersAllocation)
     {
         m_UseSRGB = useSRGB;
         
+        configureBuffering();
+        
         auto sessionCreated = createSession();
         auto buffersCreated = (buffersAllocation) ? allocateBuffers() : true;
         
@@ -36,6 +69,9 @@ namespace MacOsEncodingPlugin
         {
             m_InitializationResult = MacOSEncoderStatus::Success;
             m_SessionCreated = true;
+            
+            m_DeferredFrames = std::make_shared<DeferredFrames>();
+            m_DeferredFrames->encoder = this;
         }
         else
         {
@@ -52,26 +88,87 @@ namespace MacOsEncodingPlugin
             return;
         
         WriteFileDebug("Info: ~[H264Encoder()] - encoding session is valid.\n");
+        
+        // The frames still waiting for their command buffer are dropped, waiting here could block
+        // Unity from committing it.
+        if (m_DeferredFrames != nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_DeferredFrames->mutex);
+            m_DeferredFrames->encoder = nullptr;
+        }
+        m_DeferredFrames.reset();
     
         endSession();
         m_EncodingSession = nullptr;
         m_SessionCreated = false;
+        
+        // After the session, which outputs its last frames when it ends.
+        StopRecording();
+        ConfigureReplayBuffer(nullptr);
+    }
+
+    namespace internal
+    {
+        // The sourceFrameRefCon of a frame carries its sequence number and the index of its pixel buffer.
+        const int k_BufferIndexBits = 8;
+        static_assert(LiveCaptureNative::k_MaxInFlightDepth <= (1 << k_BufferIndexBits), "The buffer index must fit in the low bits");
+        
+        inline void* MakeFrameRefCon(uint64_t sequence, int bufferIndex)
+        {
+            return reinterpret_cast<void*>(static_cast<uintptr_t>((sequence << k_BufferIndexBits) | static_cast<uint64_t>(bufferIndex)));
+        }
+        
+        inline void ParseFrameRefCon(void* refCon, uint64_t& sequence, int& bufferIndex)
+        {
+            const auto value = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(refCon));
+            sequence = value >> k_BufferIndexBits;
+            bufferIndex = static_cast<int>(value & ((1 << k_BufferIndexBits) - 1));
+        }
+        
+        // Convenience function for creating a dictionary.
+        inline CFDictionaryRef CreateCFDictionary(CFTypeRef* keys,
+                                                  CFTypeRef* values,
+                                                  size_t size)
+        {
+            return CFDictionaryCreate(kCFAllocatorDefault, keys, values, size,
+                                      &kCFTypeDictionaryKeyCallBacks,
+                                      &kCFTypeDictionaryValueCallBacks);
+        }
     }
 
-    void postEncodeParser(H264Encoder* encoder, CMSampleBufferRef sampleBuffer)
+    void postEncodeParser(H264Encoder* encoder, CMSampleBufferRef sampleBuffer, uint64_t sequence)
     {
-        EncodedFrame encodedFrameClass;
+        auto& frameQueue = encoder->GetFrameQueue();
         
         CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
         
-        // Check if the actual frame is a KeyFrame / IDR frame.
-        encodedFrameClass.isKeyFrame = false;
+        // Check if the actual frame is a KeyFrame / IDR frame, the backpressure policy depends on it.
+        bool isKeyFrame = false;
         if(attachments != nullptr && CFArrayGetCount(attachments))
         {
             CFDictionaryRef attachment = static_cast<CFDictionaryRef>(CFArrayGetValueAtIndex(attachments, 0));
-            encodedFrameClass.isKeyFrame = !CFDictionaryContainsKey(attachment, kCMSampleAttachmentKey_NotSync);
+            isKeyFrame = !CFDictionaryContainsKey(attachment, kCMSampleAttachmentKey_NotSync);
         }
         
+        // The slot is filled in place and only published once complete, its buffers are reused.
+        // Null when the policy drops the frame, the queue records it in the stats.
+        EncodedFrameEntry* slot = frameQueue.BeginWrite(isKeyFrame);
+        if (slot == nullptr)
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - too much encoded frames in the queue.\n");
+            LiveCaptureNative::ProfileFrameDropped(frameQueue);
+            
+            // The recording and the replay buffer still get the frame, parsed into a buffer of its own.
+            if (!encoder->IsRetainingFrames())
+                return;
+        }
+        
+        EncodedFrame& encodedFrameClass = (slot != nullptr) ? slot->frame : encoder->GetDroppedFrame();
+        encodedFrameClass.spsSequence.clear();
+        encodedFrameClass.ppsSequence.clear();
+        encodedFrameClass.imageData.clear();
+        encodedFrameClass.isKeyFrame = isKeyFrame;
+        
         CMVideoFormatDescriptionRef description = CMSampleBufferGetFormatDescription(sampleBuffer);
         
         int nalu_header_size = 0;
@@ -84,7 +181,7 @@ namespace MacOsEncodingPlugin
                                                                              &nalu_header_size);
         if (status != noErr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - H264ParameterSetAtIndex failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - H264ParameterSetAtIndex failed.\n");
             return;
         }
         
@@ -109,7 +206,7 @@ namespace MacOsEncodingPlugin
                                                                                  0);
             if (status != noErr)
             {
-                WriteFileDebug("Error: [postEncodeParser] - Get SPS failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Get SPS failed.\n");
                 return;
             }
             
@@ -122,110 +219,112 @@ namespace MacOsEncodingPlugin
                                                                         0);
             if (status != noErr)
             {
-                WriteFileDebug("Error: [postEncodeParser] - Get PPS failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Get PPS failed.\n");
                 return;
             }
             
-            encodedFrameClass.spsSequence.insert(encodedFrameClass.spsSequence.end(),
-                                                 &sps[0],
-                                                 &sps[spsSize]);
-            
-            encodedFrameClass.ppsSequence.insert(encodedFrameClass.ppsSequence.end(),
-                                                 &pps[0],
-                                                 &pps[ppsSize]);
+            encodedFrameClass.spsSequence.assign(&sps[0], &sps[spsSize]);
+            encodedFrameClass.ppsSequence.assign(&pps[0], &pps[ppsSize]);
         }
         
         CMBlockBufferRef block_buffer = CMSampleBufferGetDataBuffer(sampleBuffer);
 
         if (block_buffer == nullptr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - CMSampleBufferGetDataBuffer failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - CMSampleBufferGetDataBuffer failed.\n");
             return;
         }
         
-        CMBlockBufferRef contiguous_buffer = nullptr;
-        
-        // Make sure block buffer is contiguous.
-        if (!CMBlockBufferIsRangeContiguous(block_buffer, 0, 0))
+        // Copy the sample into the frame slot in one go, CMBlockBufferCopyDataBytes gathers the
+        // fragments when the block buffer isn't contiguous. The length fields are then rewritten
+        // as start codes in place; VideoToolbox uses 4-byte lengths so the size doesn't change.
+        if (nalu_header_size != 4)
         {
-            WriteFileDebug("Info: [postEncodeParser] - Create contiguous buffer.\n");
-            status = CMBlockBufferCreateContiguous(nullptr,
-                                                   block_buffer,
-                                                   nullptr,
-                                                   nullptr,
-                                                   0,
-                                                   0,
-                                                   0,
-                                                   &contiguous_buffer);
-            if (status != noErr)
-            {
-                WriteFileDebug("Error: [postEncodeParser] - Buffer is not contiguous.\n");
-                return;
-            }
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Unsupported NAL unit header size.\n");
+            return;
         }
-        else
+        
+        const size_t block_buffer_size = CMBlockBufferGetDataLength(block_buffer);
+        encodedFrameClass.imageData.resize(block_buffer_size);
+        
         {
-            contiguous_buffer = block_buffer;
-            CFRetain(contiguous_buffer);
-            block_buffer = nullptr;
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::LockBitstream);
+            
+            status = CMBlockBufferCopyDataBytes(block_buffer,
+                                                0,
+                                                block_buffer_size,
+                                                encodedFrameClass.imageData.data());
         }
-        
-        // Now copy the actual data.
-        char* data_ptr = nullptr;
-        size_t block_buffer_size = CMBlockBufferGetDataLength(contiguous_buffer);
-        status = CMBlockBufferGetDataPointer(contiguous_buffer,
-                                             0,
-                                             nullptr,
-                                             nullptr,
-                                             &data_ptr);
         if (status != noErr)
         {
-            WriteFileDebug("Error: [postEncodeParser] - Failed to get block buffer data.\n");
-            CFRelease(contiguous_buffer);
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Failed to get block buffer data.\n");
             return;
         }
         
-        const char kAnnexBHeaderBytes[4] = {0, 0, 0, 1};
-        size_t bytes_remaining = block_buffer_size;
-        
-        while (bytes_remaining > 0)
         {
-            uint32_t* uint32_data_ptr = reinterpret_cast<uint32*>(data_ptr);
-            uint32_t packet_size = CFSwapInt32BigToHost(*uint32_data_ptr);
-
-            encodedFrameClass.imageData.insert(encodedFrameClass.imageData.end(),
-                                               &kAnnexBHeaderBytes[0],
-                                               &kAnnexBHeaderBytes[4]);
-              
-            encodedFrameClass.imageData.insert(encodedFrameClass.imageData.end(),
-                                               data_ptr + nalu_header_size,
-                                               data_ptr + nalu_header_size + packet_size);
-    
-            size_t bytes_written = packet_size + nalu_header_size;
-              
-            bytes_remaining -= bytes_written;
-            data_ptr += bytes_written;
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Convert);
+            
+            if (!LiveCaptureNative::AnnexB::AvccToAnnexBInPlace(encodedFrameClass.imageData.data(),
+                                                                encodedFrameClass.imageData.size()))
+            {
+                WriteFileDebug(LogLevel::Error, "Error: [postEncodeParser] - Invalid NAL unit length.\n");
+                return;
+            }
         }
         
-        if (bytes_remaining > 0)
+        LiveCaptureNative::EncodeFrameContext context;
+        if (!encoder->GetFrameContexts().Find(sequence, context))
         {
-            WriteFileDebug("Error: [postEncodeParser] - bytes_remaining > 0.\n");
+            // The presentation time is the capture time, only the latency is lost.
+            WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - No timing found for the encoded frame.\n");
+            
+            const CMTime presentationTime = CMTimeConvertScale(CMSampleBufferGetPresentationTimeStamp(sampleBuffer),
+                                                               1000000000,
+                                                               kCMTimeRoundingMethod_Default);
+            context.timestamp = static_cast<uint64_t>(presentationTime.value);
+            context.sequence = sequence;
+            context.submitTime = 0;
+        }
+        else
+        {
+            // Before recording, so that the files carry the timecode as well.
+            LiveCaptureNative::Sei::FrameMetadata metadata;
+            metadata.timecode = context.timecode;
+            metadata.sequence = context.sequence;
+            metadata.timestamp = context.timestamp;
+            
+            if (!LiveCaptureNative::Sei::InsertMetadata(LiveCaptureNative::Sei::Codec::H264, metadata, encodedFrameClass.imageData))
+            {
+                WriteFileDebug(LogLevel::Warning, "Warning: [postEncodeParser] - No slice found for the timecode SEI.\n");
+            }
         }
         
-        encodedFrameClass.timestamp = encoder->GetLatestTimestamp();
-        auto& frameQueue = encoder->GetFrameQueue();
+        encodedFrameClass.timestamp = context.timestamp;
         
-        if (frameQueue.size() < encoder->GetMaxQueueLength())
+        // Recorded before publishing, once published the Unity thread may consume and recycle the slot.
+        if (encoder->IsRetainingFrames())
         {
-            frameQueue.push(std::move(encodedFrameClass));
+            encoder->RecordFrame(encodedFrameClass);
         }
-        else
+        
+        if (slot == nullptr)
+            return;
+        
+        slot->sequence = context.sequence;
+        slot->outputTime = LiveCaptureNative::GetEncodeClockNs();
+        slot->encodeLatency = (context.submitTime != 0)
+            ? slot->outputTime - context.submitTime
+            : 0;
+        
+        const uint64_t encodeLatency = slot->encodeLatency;
         {
-            WriteFileDebug("Warning: [postEncodeParser] - too much encoded frames in the queue.\n");
-            
-            frameQueue.pop();
-            frameQueue.push(std::move(encodedFrameClass));
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::QueueFrame);
+            frameQueue.Publish();
         }
+        
+        encoder->GetStats().RecordEncoded(encodeLatency, block_buffer_size, isKeyFrame, frameQueue.GetSize());
+        LiveCaptureNative::TraceComplete("Encoder.Encode", context.timestamp, context.submitTime, context.submitTime + encodeLatency);
+        LiveCaptureNative::ProfileFrameQueued(frameQueue, block_buffer_size);
     }
 
     void postEncodeCallback(void *outputCallbackRefCon,
@@ -234,40 +333,34 @@ namespace MacOsEncodingPlugin
                             VTEncodeInfoFlags infoFlags,
                             CMSampleBufferRef sampleBuffer )
     {
-        if (status != noErr)
-        {
-            WriteFileDebug("Error: [postEncodeCallback] - Frame received is invalid.\n");
-            return;
-        }
+        H264Encoder* encoder = reinterpret_cast<H264Encoder*>(outputCallbackRefCon);
         
-        if (!CMSampleBufferDataIsReady(sampleBuffer))
+        if(encoder == nullptr)
         {
-            WriteFileDebug("Error: [postEncodeCallback] - Frame received is not ready.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Params received are invalid.\n");
             return;
         }
         
-        H264Encoder* encoder = reinterpret_cast<H264Encoder*>(outputCallbackRefCon);
+        uint64_t sequence;
+        int bufferIndex;
+        internal::ParseFrameRefCon(sourceFrameRefCon, sequence, bufferIndex);
         
-        if(encoder == nullptr)
+        // The input pixel buffer is released, even if the frame failed or was dropped.
+        encoder->OnFrameOutput(bufferIndex);
+        
+        if (status != noErr)
         {
-            WriteFileDebug("Error: [postEncodeCallback] - Params received are invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Frame received is invalid.\n");
             return;
         }
         
-        postEncodeParser(encoder, sampleBuffer);
-    }
-
-    namespace internal
-    {
-        // Convenience function for creating a dictionary.
-        inline CFDictionaryRef CreateCFDictionary(CFTypeRef* keys,
-                                                  CFTypeRef* values,
-                                                  size_t size)
+        if (!CMSampleBufferDataIsReady(sampleBuffer))
         {
-            return CFDictionaryCreate(kCFAllocatorDefault, keys, values, size,
-                                      &kCFTypeDictionaryKeyCallBacks,
-                                      &kCFTypeDictionaryValueCallBacks);
+            WriteFileDebug(LogLevel::Error, "Error: [postEncodeCallback] - Frame received is not ready.\n");
+            return;
         }
+        
+        postEncodeParser(encoder, sampleBuffer, sequence);
     }
 
     bool H264Encoder::createSession()
@@ -324,7 +417,7 @@ namespace MacOsEncodingPlugin
          
         if (status != 0)
         {
-            WriteFileDebug("Error: [createSession] - VTCompressionSessionCreate session creation failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [createSession] - VTCompressionSessionCreate session creation failed.\n");
             return false;
         }
         
@@ -361,12 +454,24 @@ namespace MacOsEncodingPlugin
                              kVTCompressionPropertyKey_AverageBitRate,
                              (__bridge CFTypeRef _Nonnull)(bitRate));
         
+        // The encoder must output a frame before it would hold all our pixel buffers. Not every
+        // encoder supports the limit, the in-flight count still bounds the submissions then.
+        NSNumber *maxFrameDelay = [NSNumber numberWithInt:(m_BufferCount - 1)];
+        status = VTSessionSetProperty(m_EncodingSession,
+                                      kVTCompressionPropertyKey_MaxFrameDelayCount,
+                                      (__bridge CFTypeRef _Nonnull)(maxFrameDelay));
+        
+        if (status != noErr)
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning: [createSession] - MaxFrameDelayCount is not supported by the encoder.\n");
+        }
+        
         // Tell the encoder to start encoding
         status = VTCompressionSessionPrepareToEncodeFrames(m_EncodingSession);
         
         if (status != 0)
         {
-            WriteFileDebug("Error: [createSession] - VTCompressionSessionPrepareToEncodeFrames session creation failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [createSession] - VTCompressionSessionPrepareToEncodeFrames session creation failed.\n");
             return false;
         }
         
@@ -377,6 +482,8 @@ namespace MacOsEncodingPlugin
 
     void H264Encoder::endSession()
     {
+        // The output callbacks of the pending frames must not wait for room in the queue.
+        m_FrameQueue.SetCancelled(true);
         VTCompressionSessionCompleteFrames(m_EncodingSession, kCMTimeInvalid);
         VTCompressionSessionInvalidate(m_EncodingSession);
         
@@ -388,49 +495,59 @@ namespace MacOsEncodingPlugin
 
     bool H264Encoder::allocateBuffers()
     {
-        CVPixelBufferPoolRef pixelBufferPool;
-        pixelBufferPool = VTCompressionSessionGetPixelBufferPool(m_EncodingSession);
+        if (m_EncodingSession == nullptr || m_TextureCache == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - Invalid session or texture cache.\n");
+            return false;
+        }
         
-        for(NSInteger i = 0; i < k_BufferedFrameNumbers; i++)
+        // The pixel buffers come from the session pool: they are IOSurface-backed and already in
+        // the layout the encoder expects, so the textures wrapping them share their memory.
+        CVPixelBufferPoolRef pixelBufferPool = VTCompressionSessionGetPixelBufferPool(m_EncodingSession);
+        if (pixelBufferPool == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - VTCompressionSessionGetPixelBufferPool failed.\n");
+            return false;
+        }
+        
+        // Allow Unity to render into the textures directly, not only to copy into them.
+        NSDictionary* textureAttributes = @{
+            (__bridge NSString*)kCVMetalTextureUsage : @(MTLTextureUsageShaderRead |
+                                                         MTLTextureUsageShaderWrite |
+                                                         MTLTextureUsageRenderTarget)
+        };
+        
+        auto width = m_FrameData.width;
+        auto height = m_FrameData.height;
+        auto format = m_UseSRGB ? MTLPixelFormatBGRA8Unorm_sRGB : MTLPixelFormatBGRA8Unorm;
+        
+        for(NSInteger i = 0; i < m_BufferCount; i++)
         {
             CVReturn result = CVPixelBufferPoolCreatePixelBuffer(NULL, pixelBufferPool, &m_PixelBuffers[i]);
             if (result != kCVReturnSuccess)
             {
-                WriteFileDebug("Error: [allocateBuffers] - CVPixelBufferPoolCreatePixelBuffer failed.\n");
-                return false;
-            }
-            
-            id<MTLDevice> device_ = (__bridge id<MTLDevice>)m_GraphicDevice->GetEncodeDevicePtr();
-
-            CVMetalTextureCacheRef textureCache;
-            result = CVMetalTextureCacheCreate(kCFAllocatorDefault, nil, device_, nil, &textureCache);
-            if(result != kCVReturnSuccess)
-            {
-                WriteFileDebug("Error: [allocateBuffers] - CVMetalTextureCacheCreate failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - CVPixelBufferPoolCreatePixelBuffer failed.\n");
+                releaseBuffers();
                 return false;
             }
-
-            CVMetalTextureRef imageTexture;
-            auto width = m_FrameData.width;
-            auto height = m_FrameData.height;
-            auto format = m_UseSRGB ? MTLPixelFormatBGRA8Unorm_sRGB : MTLPixelFormatBGRA8Unorm;
             
             result = CVMetalTextureCacheCreateTextureFromImage(kCFAllocatorDefault,
-                                                               textureCache,
+                                                               m_TextureCache,
                                                                m_PixelBuffers[i],
-                                                               nullptr,
+                                                               (__bridge CFDictionaryRef)textureAttributes,
                                                                format,
                                                                width,
                                                                height,
                                                                0,
-                                                               &imageTexture);
+                                                               &m_MetalTextures[i]);
             if (result != kCVReturnSuccess)
             {
-                WriteFileDebug("Error: [allocateBuffers] - CVMetalTextureCacheCreateTextureFromImage failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error: [allocateBuffers] - CVMetalTextureCacheCreateTextureFromImage failed.\n");
+                releaseBuffers();
                 return false;
             }
             
-            m_RenderTextures[i] = CVMetalTextureGetTexture(imageTexture);
+            m_RenderTextures[i] = CVMetalTextureGetTexture(m_MetalTextures[i]);
         }
         
         WriteFileDebug("Success: [allocateBuffers] - Buffers are allocated.\n");
@@ -439,22 +556,95 @@ namespace MacOsEncodingPlugin
 
     void H264Encoder::releaseBuffers()
     {
-        if (m_InitializationResult != MacOSEncoderStatus::Success)
-            return;
-        
-        for (int i = 0; i < k_BufferedFrameNumbers; ++i)
+        for (int i = 0; i < k_MaxBufferedFrameNumbers; ++i)
         {
-            [m_RenderTextures[i] release];
-            CVPixelBufferRelease(m_PixelBuffers[i]);
-            
+            // The texture belongs to the CVMetalTexture, it is released with it.
             m_RenderTextures[i] = nil;
-            m_PixelBuffers[i] = nil;
+            
+            if (m_MetalTextures[i] != nullptr)
+            {
+                CFRelease(m_MetalTextures[i]);
+                m_MetalTextures[i] = nullptr;
+            }
+            
+            if (m_PixelBuffers[i] != nullptr)
+            {
+                CVPixelBufferRelease(m_PixelBuffers[i]);
+                m_PixelBuffers[i] = nullptr;
+            }
         }
         
-        while (m_FrameQueue.size() > 0)
+        // Let the shared cache drop the entries of the released buffers.
+        if (m_TextureCache != nullptr)
         {
-            m_FrameQueue.pop();
+            CVMetalTextureCacheFlush(m_TextureCache, 0);
         }
+        
+        m_FrameQueue.Clear();
+    }
+
+    void H264Encoder::configureBuffering()
+    {
+        // VideoToolbox has no cap for the frames in flight, the pixel buffers come from its pool.
+        m_Buffering = LiveCaptureNative::ValidateBufferingSettings(m_RequestedBuffering,
+                                                                   k_BufferedFrameNumbers,
+                                                                   k_MaxBufferedFrameNumbers,
+                                                                   k_DefaultEncodedFrameQueueLength);
+        m_BufferCount = m_Buffering.inFlightDepth;
+        for (auto& busy : m_BufferBusy)
+        {
+            busy.store(false, std::memory_order_relaxed);
+        }
+        m_FrameQueue.Configure(m_Buffering);
+        m_FrameQueue.SetCancelled(false);
+        m_Stats.SetBuffering(m_Buffering);
+        
+        WriteFileDebug("Info: [configureBuffering] - In-flight depth: ", m_Buffering.inFlightDepth);
+        WriteFileDebug("Info: [configureBuffering] - Output queue length: ", m_Buffering.outputQueueLength);
+        WriteFileDebug("Info: [configureBuffering] - Backpressure policy: ", m_Buffering.policy);
+    }
+
+    int H264Encoder::acquireInputBuffer(int bufferIndex)
+    {
+        // The given buffer for a zero-copy frame, otherwise the first free one in submission order.
+        int freeIndex = -1;
+        const auto isFree = [this, bufferIndex, &freeIndex]()
+        {
+            for (int i = 0; i < m_BufferCount; ++i)
+            {
+                const int index = (bufferIndex >= 0) ? bufferIndex : static_cast<int>((m_FrameCount + i) % m_BufferCount);
+                if (!m_BufferBusy[index].load(std::memory_order_acquire))
+                {
+                    freeIndex = index;
+                    return true;
+                }
+                if (bufferIndex >= 0)
+                    break;
+            }
+            return false;
+        };
+        
+        bool hasFreed = isFree();
+        
+        // The pixel buffer is still read by the encoder, which is behind. A submitted frame can't be
+        // cancelled, so only Block waits for it, the other policies drop the new frame.
+        if (!hasFreed && m_Buffering.policy == static_cast<int32_t>(LiveCaptureNative::BackpressurePolicy::Block))
+        {
+            const auto waitStart = LiveCaptureNative::GetEncodeClockNs();
+            hasFreed = LiveCaptureNative::WaitUntil(isFree, LiveCaptureNative::k_BackpressureTimeoutNs);
+            m_Stats.RecordBlocked(LiveCaptureNative::GetEncodeClockNs() - waitStart);
+        }
+        
+        if (!hasFreed)
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning: [encodeFrame] - No free input buffer, frame dropped.\n");
+            m_Stats.RecordInputDropped();
+            return -1;
+        }
+        
+        // Until the output callback of the frame, whether it is submitted or not is settled below.
+        m_BufferBusy[freeIndex].store(true, std::memory_order_relaxed);
+        return freeIndex;
     }
 
     bool H264Encoder::copyBuffer(void* frameSource, int frameIndex)
@@ -463,67 +653,341 @@ namespace MacOsEncodingPlugin
         
         if (tex == nullptr)
         {
-            WriteFileDebug("Error: [copyBuffer] - current renderTexture is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [copyBuffer] - current renderTexture is null.\n");
             return false;
         }
         
-        return m_GraphicDevice->CopyResourceFromNative(tex, frameSource);
+        LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Copy);
+        const auto copyStart = LiveCaptureNative::GetEncodeClockNs();
+        
+        if (!m_GraphicDevice->CopyResourceFromNative(tex, frameSource))
+            return false;
+        
+        m_Stats.RecordCopy(LiveCaptureNative::GetEncodeClockNs() - copyStart);
+        return true;
     }
 
-    bool H264Encoder::EncodeFrame(void* frameSource, unsigned long long int timestamp)
+    int H264Encoder::findInputTexture(void* frameSource) const
+    {
+        for (int i = 0; i < m_BufferCount; ++i)
+        {
+            if (m_RenderTextures[i] != nil && (__bridge void*)m_RenderTextures[i] == frameSource)
+                return i;
+        }
+        return -1;
+    }
+
+    void* H264Encoder::GetInputTexture(int index) const
+    {
+        if (!m_SessionCreated || index < 0 || index >= m_BufferCount)
+            return nullptr;
+        
+        return (__bridge void*)m_RenderTextures[index];
+    }
+
+    bool H264Encoder::EncodeFrame(void* frameSource,
+                                  unsigned long long int timestamp,
+                                  const LiveCaptureNative::FrameTimecode& timecode)
     {
         if (frameSource == nullptr)
         {
-            WriteFileDebug("Error: [encodeFrame] - Received frame is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Received frame is invalid.\n");
             return false;
         }
         
-        uint32 bufferIndexToWrite = m_FrameCount % k_BufferedFrameNumbers;
+        // Zero-copy: the frame was rendered into one of our input textures, encode its pixel
+        // buffer directly. Otherwise blit the Unity texture into a free pixel buffer. Either way
+        // the buffer must not be read by the encoder anymore.
+        const int inputTexture = findInputTexture(frameSource);
+        const int bufferIndexToWrite = acquireInputBuffer(inputTexture);
+        if (bufferIndexToWrite < 0)
+            return false;
+        
+        if (inputTexture < 0)
+        {
+            LiveCaptureNative::TraceScope traceScope("Encoder.Copy", timestamp);
+            if (!copyBuffer(frameSource, bufferIndexToWrite))
+            {
+                WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Received frame source is invalid.\n");
+                m_BufferBusy[bufferIndexToWrite].store(false, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        
+        // Use the capture time rather than a time derived from the frame count, so that dropped
+        // frames don't shift the following ones.
+        const auto context = m_FrameContexts.Begin(timestamp, timecode);
+        m_FrameCount++;
+        
+        // A zero-copy frame is still being rendered by Unity's current command buffer. The frames
+        // following a deferred one are deferred as well, to be submitted in order.
+        if ((inputTexture >= 0 || hasDeferredFrames()) && deferSubmit(bufferIndexToWrite, context))
+            return true;
+        
+        return submitFrame(bufferIndexToWrite, context);
+    }
+
+    bool H264Encoder::hasDeferredFrames()
+    {
+        if (m_DeferredFrames == nullptr)
+            return false;
+        
+        std::lock_guard<std::mutex> lock(m_DeferredFrames->mutex);
+        return m_DeferredFrames->count > 0;
+    }
+
+    bool H264Encoder::deferSubmit(int bufferIndex, const LiveCaptureNative::EncodeFrameContext& context)
+    {
+        if (m_MetalGraphics == nullptr || m_DeferredFrames == nullptr)
+            return false;
         
-        if (!copyBuffer(frameSource, bufferIndexToWrite))
+        id<MTLCommandBuffer> commandBuffer = m_MetalGraphics->CurrentCommandBuffer();
+        if (commandBuffer == nil)
         {
-            WriteFileDebug("Error: [encodeFrame] - Received frame source is invalid.\n");
+            WriteFileDebug(LogLevel::Warning, "Warning: [encodeFrame] - No Unity command buffer, the frame is submitted without waiting for the GPU.\n");
             return false;
         }
         
-        CMTime presentationTimeStamp = CMTimeMake(m_FrameCount * 1000 / m_FrameData.frameRate, 1000);
+        // Close the pass that rendered the frame, Unity opens a new encoder for its next commands.
+        m_MetalGraphics->EndCurrentCommandEncoder();
+        
+        // The handler holds the shared state rather than the encoder, which may be disposed first.
+        auto deferredFrames = m_DeferredFrames;
+        {
+            std::lock_guard<std::mutex> lock(deferredFrames->mutex);
+            ++deferredFrames->count;
+        }
+        
+        [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer> completedBuffer)
+        {
+            std::lock_guard<std::mutex> lock(deferredFrames->mutex);
+            --deferredFrames->count;
+            
+            H264Encoder* encoder = deferredFrames->encoder;
+            if (encoder == nullptr)
+                return;
+            
+            if (completedBuffer.status != MTLCommandBufferStatusCompleted)
+            {
+                WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Unity command buffer failed, frame dropped.\n");
+                encoder->m_BufferBusy[bufferIndex].store(false, std::memory_order_relaxed);
+                encoder->m_Stats.RecordInputDropped();
+                return;
+            }
+            
+            encoder->submitFrame(bufferIndex, context);
+        }];
+        
+        return true;
+    }
+
+    bool H264Encoder::submitFrame(int bufferIndex, const LiveCaptureNative::EncodeFrameContext& context)
+    {
+        CMTime presentationTimeStamp = CMTimeMake(static_cast<int64_t>(context.timestamp), 1000000000);
+        
+        // A frame was dropped with DropToKeyFrame, the following ones are skipped until a key frame.
+        CFDictionaryRef frameProperties = nullptr;
+        if (m_FrameQueue.ConsumeKeyFrameRequest())
+        {
+            CFTypeRef keys[] = { kVTEncodeFrameOptionKey_ForceKeyFrame };
+            CFTypeRef values[] = { kCFBooleanTrue };
+            frameProperties = internal::CreateCFDictionary(keys, values, 1);
+        }
         
         VTEncodeInfoFlags flags;
-        OSStatus status = VTCompressionSessionEncodeFrame(m_EncodingSession,
-                                                          m_PixelBuffers[bufferIndexToWrite],
-                                                          presentationTimeStamp,
-                                                          kCMTimeInvalid,
-                                                          nullptr,
-                                                          nullptr,
-                                                          &flags);
+        OSStatus status;
+        {
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::EncodePicture);
+            LiveCaptureNative::TraceScope traceScope("Encoder.Submit", context.timestamp, LiveCaptureNative::TraceFlow::Step);
+            
+            status = VTCompressionSessionEncodeFrame(m_EncodingSession,
+                                                     m_PixelBuffers[bufferIndex],
+                                                     presentationTimeStamp,
+                                                     kCMTimeInvalid,
+                                                     frameProperties,
+                                                     internal::MakeFrameRefCon(context.sequence, bufferIndex),
+                                                     &flags);
+        }
+        
+        if (frameProperties != nullptr)
+        {
+            CFRelease(frameProperties);
+        }
         
         if (status != noErr)
         {
-            WriteFileDebug("Error: [encodeFrame] - Encoding failed for the current frame.\n");
+            // No output callback for a frame that wasn't accepted.
+            m_BufferBusy[bufferIndex].store(false, std::memory_order_relaxed);
+            WriteFileDebug(LogLevel::Error, "Error: [encodeFrame] - Encoding failed for the current frame.\n");
             return false;
         }
         
-        m_LatestTimestamp = timestamp;
-        m_FrameCount++;
+        m_Stats.RecordSubmit();
         return true;
     }
 
     EncodedFrame* H264Encoder::GetEncodedFrame()
     {
-        if (m_FrameQueue.size() > 0)
-        {
-            return &m_FrameQueue.front();
-        }
-        return nullptr;
+        // The consumption of a frame starts here, RemoveEncodedFrame() pops the same one.
+        m_FrameQueue.TrimOldest();
+        auto entry = m_FrameQueue.Front();
+        return (entry != nullptr) ? &entry->frame : nullptr;
+    }
+
+    EncodedFrameEntry* H264Encoder::GetEncodedFrameEntry()
+    {
+        return m_FrameQueue.Front();
     }
 
     bool H264Encoder::RemoveEncodedFrame()
     {
-        if (m_FrameQueue.size() > 0)
+        const auto entry = m_FrameQueue.Front();
+        const auto outputTime = (entry != nullptr) ? entry->outputTime : 0;
+        const auto timestamp = (entry != nullptr) ? entry->frame.timestamp : 0;
+        
+        if (!m_FrameQueue.Pop())
+            return false;
+        
+        const auto consumeTime = LiveCaptureNative::GetEncodeClockNs();
+        m_Stats.RecordConsumed(consumeTime - outputTime, m_FrameQueue.GetSize());
+        LiveCaptureNative::TraceComplete("Encoder.Queue", timestamp, outputTime, consumeTime);
+        return true;
+    }
+    
+    bool H264Encoder::StartRecording(const char* path, const LiveCaptureNative::Fmp4RecorderSettings& settings)
+    {
+        StopRecording();
+        
+        std::unique_ptr<LiveCaptureNative::Fmp4Recorder> recorder(new LiveCaptureNative::Fmp4Recorder());
+        if (!recorder->Open(path,
+                            static_cast<uint32_t>(m_FrameData.width),
+                            static_cast<uint32_t>(m_FrameData.height),
+                            settings))
         {
-            m_FrameQueue.pop();
-            return true;
+            WriteFileDebug(LogLevel::Error, "Error: [StartRecording] - Failed to create the recording file.\n");
+            recorder->GetStats(m_LastRecordingStats);
+            return false;
+        }
+        
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        m_Recorder = std::move(recorder);
+        m_IsRetainingFrames.store(true, std::memory_order_relaxed);
+        return true;
+    }
+    
+    void H264Encoder::StopRecording()
+    {
+        std::unique_ptr<LiveCaptureNative::Fmp4Recorder> recorder;
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            m_IsRetainingFrames.store(m_ReplayBuffer != nullptr, std::memory_order_relaxed);
+            recorder = std::move(m_Recorder);
+        }
+        
+        // Outside of the lock, closing waits for the last fragments to be written.
+        if (recorder != nullptr)
+        {
+            recorder->Close();
+            recorder->GetStats(m_LastRecordingStats);
+        }
+    }
+    
+    void H264Encoder::GetRecordingStats(LiveCaptureNative::Fmp4RecorderStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        if (m_Recorder != nullptr)
+        {
+            m_Recorder->GetStats(stats);
+        }
+        else
+        {
+            stats = m_LastRecordingStats;
+        }
+    }
+    
+    void H264Encoder::RecordFrame(const EncodedFrame& frame)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        
+        // Key frames carry the parameter sets, the recorder starts the file with the first ones.
+        if (m_ReplayBuffer != nullptr)
+        {
+            m_ReplayBuffer->Append(frame.imageData.data(),
+                                   frame.imageData.size(),
+                                   frame.timestamp,
+                                   frame.isKeyFrame,
+                                   frame.spsSequence.data(),
+                                   frame.spsSequence.size(),
+                                   frame.ppsSequence.data(),
+                                   frame.ppsSequence.size());
+        }
+        
+        if (m_Recorder != nullptr &&
+            !m_Recorder->WriteFrame(frame.imageData.data(),
+                                    frame.imageData.size(),
+                                    frame.timestamp,
+                                    frame.isKeyFrame,
+                                    frame.spsSequence.data(),
+                                    frame.spsSequence.size(),
+                                    frame.ppsSequence.data(),
+                                    frame.ppsSequence.size()))
+        {
+            WriteFileDebug("Info: [RecordFrame] - Encoded frame not recorded.\n");
+        }
+    }
+    
+    void H264Encoder::ConfigureReplayBuffer(const LiveCaptureNative::ReplayBufferSettings* settings)
+    {
+        // The export in progress reads the current buffer.
+        m_ReplayExporter.Wait();
+        
+        // Allocated and released outside of the lock, the slab can be large.
+        std::unique_ptr<LiveCaptureNative::ReplayBuffer> replayBuffer;
+        if (settings != nullptr)
+        {
+            replayBuffer.reset(new LiveCaptureNative::ReplayBuffer(*settings));
         }
-        return false;
+        
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            std::swap(m_ReplayBuffer, replayBuffer);
+            m_IsRetainingFrames.store(m_Recorder != nullptr || m_ReplayBuffer != nullptr, std::memory_order_relaxed);
+        }
+    }
+    
+    bool H264Encoder::SaveReplay(const char* path, uint64_t durationNs)
+    {
+        if (m_ReplayExporter.IsBusy())
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning: [SaveReplay] - A replay is already being saved.\n");
+            return false;
+        }
+        
+        LiveCaptureNative::ReplayRange range;
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            if (m_ReplayBuffer == nullptr || !m_ReplayBuffer->AcquireLast(durationNs, range))
+                return false;
+        }
+        
+        return m_ReplayExporter.Start(std::move(range),
+                                      path,
+                                      static_cast<uint32_t>(m_FrameData.width),
+                                      static_cast<uint32_t>(m_FrameData.height));
+    }
+    
+    bool H264Encoder::GetReplayBufferStats(LiveCaptureNative::ReplayBufferStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        if (m_ReplayBuffer == nullptr)
+            return false;
+        
+        m_ReplayBuffer->GetStats(stats);
+        return true;
+    }
+    
+    void H264Encoder::GetReplayExportStats(LiveCaptureNative::Fmp4RecorderStats& stats)
+    {
+        m_ReplayExporter.GetStats(stats);
     }
 }
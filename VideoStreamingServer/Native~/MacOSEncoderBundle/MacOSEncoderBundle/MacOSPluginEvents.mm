@@ -7,6 +7,8 @@
 #include "ObjectIDMap.hpp"
 #include "PluginUtils.hpp"
 #include "MacOSEncoderSessionDataPlugin.hpp"
+#include "UnityEncoderProfiler.h"
+#include "TraceRecorder.h"
 
 #include "Encoder/H264Encoder.mm"
 #include "Encoder/MetalGraphicsEncoderDevice.hpp"
@@ -26,19 +28,34 @@ using namespace MacOsEncodingPlugin;
 
 namespace MacOsEncodingPlugin
 {
+    // Initialize data: the C# EncoderSettingsID ends with the buffering settings, after the
+    // fields shared with the other events.
+    struct EncoderSettingsBufferingID
+    {
+        EncoderSettingsID                           settingsID;
+        LiveCaptureNative::EncoderBufferingSettings buffering;
+    };
+    
+    // Encode data: the C# EncoderTextureID ends with the timecode written to the SEI of the frame.
+    struct EncoderTextureTimecodeID
+    {
+        EncoderTextureID                 textureID;
+        LiveCaptureNative::FrameTimecode timecode;
+    };
+    
     static IUnityInterfaces*         s_UnityInterfaces = nullptr;
     static IUnityGraphics*           s_UnityGraphics = nullptr;
     static IUnityGraphicsMetalV1*    s_MetalGraphics = nullptr;
     static MetalGraphicsEncoderDevice* s_GraphicsEncoderDevice = nullptr;
+    static CVMetalTextureCacheRef    s_TextureCache = nullptr; // Shared by the encoders of the device.
+    
+    // Installed as the encoder profiler while the plugin is loaded.
+    static std::unique_ptr<LiveCaptureNative::UnityEncoderProfiler> s_EncoderProfiler;
     static bool                      s_Initialized = false;
     
     static IDObjectMap<H264Encoder>  s_EncoderMap;
     static IDObjectMap<EncodedFrame> s_EncodedFrameMap;
     
-#ifdef DEBUG_LOG
-    static std::once_flag InitLogOnce;
-#endif
-    
     static bool GetRenderDeviceInterface(UnityGfxRenderer renderer)
     {
         switch (renderer)
@@ -47,7 +64,7 @@ namespace MacOsEncodingPlugin
             s_MetalGraphics = s_UnityInterfaces->Get<IUnityGraphicsMetalV1>();
             return true;
         default:
-            WriteFileDebug("Error - [GetRenderDeviceInterface] graphics API not supported.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [GetRenderDeviceInterface] graphics API not supported.\n");
             return false;
         }
     }
@@ -76,6 +93,13 @@ namespace MacOsEncodingPlugin
             s_UnityGraphics = nullptr;
             s_MetalGraphics = nullptr;
             s_GraphicsEncoderDevice = nullptr;
+            
+            // The encoders still alive hold their own reference.
+            if (s_TextureCache != nullptr)
+            {
+                CFRelease(s_TextureCache);
+                s_TextureCache = nullptr;
+            }
         }
     }
    
@@ -84,7 +108,8 @@ namespace MacOsEncodingPlugin
         UnityPluginLoad(IUnityInterfaces * unityInterfaces)
     {
 #ifdef DEBUG_LOG
-        std::call_once(InitLogOnce, MacOsEncodingPlugin::InitLog);
+        // Opening an already opened log does nothing.
+        MacOsEncodingPlugin::InitLog();
 #endif
         
         WriteFileDebug("Info - [UnityPluginLoad] Load plugin.\n", false);
@@ -100,6 +125,13 @@ namespace MacOsEncodingPlugin
                 
                 OnGraphicsDeviceEvent(kUnityGfxDeviceEventInitialize);
             }
+            
+            const auto unityProfiler = s_UnityInterfaces->Get<IUnityProfiler>();
+            if (unityProfiler)
+            {
+                s_EncoderProfiler.reset(new LiveCaptureNative::UnityEncoderProfiler(unityProfiler));
+                LiveCaptureNative::SetEncoderProfiler(s_EncoderProfiler.get());
+            }
         }
     }
 
@@ -111,6 +143,13 @@ namespace MacOsEncodingPlugin
         {
             s_UnityGraphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
         }
+        
+        // A VideoToolbox callback may still be sampling the profiler, it is only destroyed with the plugin.
+        LiveCaptureNative::SetEncoderProfiler(nullptr);
+        
+#ifdef DEBUG_LOG
+        CloseLog();
+#endif
     }
 
     void Initialize(void* data);
@@ -160,13 +199,13 @@ namespace MacOsEncodingPlugin
     {
         if (!data)
         {
-            WriteFileDebug("Error, Data send is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Data send is null.\n");
             return true;
         }
 
         if (!s_MetalGraphics)
         {
-            WriteFileDebug("Error, s_MetalGraphics is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, s_MetalGraphics is null.\n");
             return true;
         }
 
@@ -179,22 +218,25 @@ namespace MacOsEncodingPlugin
         
         if (!AreParametersValid(data))
         {
-            WriteFileDebug("Error - [Initialize] Invalid data.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Invalid data.\n");
             return;
         }
         
-        auto encoderData = static_cast<EncoderSettingsID*>(data);
-        if (encoderData == nullptr)
+        auto encoderBufferingData = static_cast<EncoderSettingsBufferingID*>(data);
+        if (encoderBufferingData == nullptr)
         {
-            WriteFileDebug("Error - [Initialize] Invalid encoder data.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Invalid encoder data.\n");
             return;
         }
         
+        auto encoderData = &encoderBufferingData->settingsID;
+        
         WriteFileDebug("Info - [Initialize] Width: ", encoderData->settings.width);
         WriteFileDebug("Info - [Initialize] Height: ", encoderData->settings.height);
         WriteFileDebug("Info - [Initialize] FrameRate: ", encoderData->settings.frameRate);
         WriteFileDebug("Info - [Initialize] Bitrate: ", encoderData->settings.bitRate);
         WriteFileDebug("Info - [Initialize] GopSize: ", encoderData->settings.gopSize);
+        WriteFileDebug("Info - [Initialize] InFlightDepth: ", encoderBufferingData->buffering.inFlightDepth);
         
         if (s_GraphicsEncoderDevice == nullptr && s_MetalGraphics)
         {
@@ -203,16 +245,30 @@ namespace MacOsEncodingPlugin
         }
         else
         {
-            WriteFileDebug("Error - [Initialize] Encoder device is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Initialize] Encoder device is invalid.\n");
+        }
+        
+        if (s_TextureCache == nullptr && s_MetalGraphics)
+        {
+            id<MTLDevice> device = s_MetalGraphics->MetalDevice();
+            if (CVMetalTextureCacheCreate(kCFAllocatorDefault, nil, device, nil, &s_TextureCache) != kCVReturnSuccess)
+            {
+                WriteFileDebug(LogLevel::Error, "Error - [Initialize] CVMetalTextureCacheCreate failed.\n");
+                s_TextureCache = nullptr;
+            }
         }
         
         auto metalDevice = static_cast<MetalGraphicsEncoderDevice*>(s_GraphicsEncoderDevice);
-        auto instanceEncoder = new H264Encoder(encoderData->settings, metalDevice);
+        auto instanceEncoder = new H264Encoder(encoderData->settings,
+                                               metalDevice,
+                                               s_TextureCache,
+                                               s_MetalGraphics,
+                                               encoderBufferingData->buffering);
         instanceEncoder->Initialize(encoderData->useSRGB);
         
         s_EncoderMap.Add(encoderData->id, instanceEncoder);
         
-        WriteFileDebug("Error - [Initialize] Added encoder ", encoderData->id);
+        WriteFileDebug("Info - [Initialize] Added encoder ", encoderData->id);
     }
 
     void Update(void* data)
@@ -234,7 +290,7 @@ namespace MacOsEncodingPlugin
         }
         else
         {
-            WriteFileDebug("Error - [Update] invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error - [Update] invalid parameters.\n");
         }
          */
     }
@@ -244,13 +300,14 @@ namespace MacOsEncodingPlugin
         if (!AreParametersValid(data))
             return;
 
-        auto encoderData = static_cast<EncoderTextureID*>(data);
-        if (encoderData && encoderData->id > 0)
+        auto encoderTimecodeData = static_cast<EncoderTextureTimecodeID*>(data);
+        auto encoderData = &encoderTimecodeData->textureID;
+        if (encoderData->id > 0)
         {
             auto encoder = s_EncoderMap.GetInstance(encoderData->id);
             if (encoder)
             {
-                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp);
+                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp, encoderTimecodeData->timecode);
             }
         }
     }
@@ -300,6 +357,12 @@ namespace MacOsEncodingPlugin
         return false;
     }
 
+    // Lowest LogLevel written to the log, only effective for the levels compiled in.
+    extern "C" void UNITY_INTERFACE_EXPORT SetLogLevel(int level)
+    {
+        LiveCaptureNative::AsyncLogger::Get().SetLevel(static_cast<LogLevel>(level));
+    }
+
     extern "C" int UNITY_INTERFACE_EXPORT EncoderIsCompatible()
     {
         return static_cast<int>(true);
@@ -475,4 +538,167 @@ namespace MacOsEncodingPlugin
 
         return encodedFrame->isKeyFrame;
     }
+
+    extern "C" int UNITY_INTERFACE_EXPORT GetInputTextureCount(int* id)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        return (encoder && encoder->IsInitialized()) ? encoder->GetInputTextureCount() : 0;
+    }
+
+    extern "C" void* UNITY_INTERFACE_EXPORT GetInputTexture(int* id, int index)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        return (encoder && encoder->IsInitialized()) ? encoder->GetInputTexture(index) : nullptr;
+    }
+
+    EncodedFrameEntry* IsEncodedFrameEntryValid(int* id)
+    {
+        if (IsEncodedFrameValid(id) == nullptr)
+            return nullptr;
+
+        auto encoder = s_EncoderMap.GetInstance(*id);
+        return (encoder != nullptr) ? encoder->GetEncodedFrameEntry() : nullptr;
+    }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetSequenceNumber(int* id)
+    {
+        auto entry = IsEncodedFrameEntryValid(id);
+        if (entry == nullptr)
+            return 0;
+
+        return entry->sequence;
+    }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetEncodeLatency(int* id)
+    {
+        auto entry = IsEncodedFrameEntryValid(id);
+        if (entry == nullptr)
+            return 0;
+
+        return entry->encodeLatency;
+    }
+
+    // Snapshot of the encoder counters and latency histograms, callable from any thread.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetEncoderStats(int* id, LiveCaptureNative::EncoderStatsSnapshot* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetStats().Snapshot(*stats);
+        return true;
+    }
+
+    // Records the encoded stream to a fragmented MP4 file (UTF-8 path) until StopRecording, or until
+    // the encoder is destroyed. Settings may be null for the defaults.
+    extern "C" bool UNITY_INTERFACE_EXPORT StartRecording(int* id, const char* path, const LiveCaptureNative::Fmp4RecorderSettings* settings)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || path == nullptr)
+            return false;
+
+        const LiveCaptureNative::Fmp4RecorderSettings defaultSettings = { 0, 0 };
+        return encoder->StartRecording(path, (settings != nullptr) ? *settings : defaultSettings);
+    }
+
+    // Writes the last fragment and closes the file.
+    extern "C" void UNITY_INTERFACE_EXPORT StopRecording(int* id)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr)
+            return;
+
+        encoder->StopRecording();
+    }
+
+    // Stats of the current recording, or of the last one once stopped.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetRecordingStats(int* id, LiveCaptureNative::Fmp4RecorderStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetRecordingStats(*stats);
+        return true;
+    }
+
+    // Keeps the last encoded frames in memory for SaveReplay, with the given size. Null settings
+    // release the replay buffer.
+    extern "C" bool UNITY_INTERFACE_EXPORT ConfigureReplayBuffer(int* id, const LiveCaptureNative::ReplayBufferSettings* settings)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr)
+            return false;
+
+        encoder->ConfigureReplayBuffer(settings);
+        return true;
+    }
+
+    // Writes the last durationNs of the replay buffer (all of it for 0) to a fragmented MP4 file
+    // (UTF-8 path), in the background. See GetReplayExportStats for the progress.
+    extern "C" bool UNITY_INTERFACE_EXPORT SaveReplay(int* id, const char* path, unsigned long long int durationNs)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || path == nullptr)
+            return false;
+
+        return encoder->SaveReplay(path, durationNs);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetReplayBufferStats(int* id, LiveCaptureNative::ReplayBufferStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        return encoder->GetReplayBufferStats(*stats);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetReplayExportStats(int* id, LiveCaptureNative::Fmp4RecorderStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetReplayExportStats(*stats);
+        return true;
+    }
+
+    // Pipeline trace, see TraceRecorder. The managed side records its stages through the same
+    // recorder so that all the events share one clock.
+    extern "C" void UNITY_INTERFACE_EXPORT TraceSetEnabled(bool enabled)
+    {
+        LiveCaptureNative::TraceRecorder::Get().SetEnabled(enabled);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceClear()
+    {
+        LiveCaptureNative::TraceRecorder::Get().Clear();
+    }
+
+    extern "C" int UNITY_INTERFACE_EXPORT TraceRegisterName(const char* name)
+    {
+        return LiveCaptureNative::TraceRecorder::Get().RegisterName(name);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceSetThreadName(const char* name)
+    {
+        LiveCaptureNative::TraceRecorder::Get().SetThreadName(name);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceBegin(int nameId, unsigned long long int frameId, int flow)
+    {
+        LiveCaptureNative::TraceBeginNamed(nameId, frameId, static_cast<LiveCaptureNative::TraceFlow>(flow));
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceEnd(int nameId, unsigned long long int frameId)
+    {
+        LiveCaptureNative::TraceEndNamed(nameId, frameId);
+    }
+
+    // Writes the recorded events to a Chrome trace JSON file.
+    extern "C" bool UNITY_INTERFACE_EXPORT TraceDump(const char* path)
+    {
+        return LiveCaptureNative::TraceRecorder::Get().DumpChromeJson(path);
+    }
 }
@@ -3,72 +3,25 @@
 namespace MacOsEncodingPlugin
 {
     static const std::string k_FileName = "/MacOS_debug_file.log";
-    static std::string k_DefinitiveFilePath = "";
 
     void InitLog()
     {
+#if LIVECAPTURE_LOG_LEVEL < 4
         char* home = getenv("HOME");
         if (home == nullptr)
             return;
         
-        k_DefinitiveFilePath = home;
-        k_DefinitiveFilePath.append(k_FileName);
-    }
-
-    void WriteFileDebug(const char* const message, const bool append)
-    {
-#ifdef DEBUG_LOG
-        std::ofstream myfile;
+        std::string filePath = home;
+        filePath.append(k_FileName);
         
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
-
-        myfile << message;
-        myfile.close();
+        LiveCaptureNative::AsyncLogger::Get().Open(filePath);
 #endif
     }
 
-    void WriteFileDebug(const char* const message, int value, const bool append)
+    void CloseLog()
     {
-#ifdef DEBUG_LOG
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
-
-        myfile << message << value << "\n";
-        myfile.close();
+#if LIVECAPTURE_LOG_LEVEL < 4
+        LiveCaptureNative::AsyncLogger::Get().Close();
 #endif
     }
-
-    void WriteFileDebug(const char* const message, unsigned long long value, const bool append)
-    {
-    #ifdef DEBUG_LOG
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_DefinitiveFilePath, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_DefinitiveFilePath);
-        }
-
-        myfile << message << value << "\n";
-        myfile.close();
-    #endif
-    }
 }
@@ -3,13 +3,52 @@
 #include <fstream>
 #include <sstream>
 
+// DEBUG_LOG builds log every level, the other builds compile the logging out.
+#if defined(DEBUG_LOG) && !defined(LIVECAPTURE_LOG_LEVEL)
+#define LIVECAPTURE_LOG_LEVEL 0
+#endif
+
+#include "AsyncLogger.h"
+
 namespace MacOsEncodingPlugin
 {
+    using LiveCaptureNative::LogLevel;
+
+    // Opens the log file in the home directory and starts the logger.
     void InitLog();
 
-    void WriteFileDebug(const char* const message, const bool append = true);
+    // Writes the pending messages and stops the logger.
+    void CloseLog();
+
+    // The messages are queued to the asynchronous logger at the level given, Info without one.
+    // The append flag is kept for compatibility, the log file is truncated once by InitLog().
+    inline void WriteFileDebug(LogLevel level, const char* const message)
+    {
+        LIVECAPTURE_LOG(level, "%s", message);
+    }
+
+    inline void WriteFileDebug(LogLevel level, const char* const message, int value)
+    {
+        LIVECAPTURE_LOG(level, "%s%d", message, value);
+    }
+
+    inline void WriteFileDebug(LogLevel level, const char* const message, unsigned long long value)
+    {
+        LIVECAPTURE_LOG(level, "%s%llu", message, value);
+    }
+
+    inline void WriteFileDebug(const char* const message, const bool append = true)
+    {
+        LIVECAPTURE_LOG(LogLevel::Info, "%s", message);
+    }
 
-    void WriteFileDebug(const char* const message, int value, const bool append = true);
+    inline void WriteFileDebug(const char* const message, int value, const bool append = true)
+    {
+        LIVECAPTURE_LOG(LogLevel::Info, "%s%d", message, value);
+    }
 
-    void WriteFileDebug(const char* const message, unsigned long long value, const bool append = true);
+    inline void WriteFileDebug(const char* const message, unsigned long long value, const bool append = true)
+    {
+        LIVECAPTURE_LOG(LogLevel::Info, "%s%llu", message, value);
+    }
 }
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace NvencPlugin
+{
+    // Monotonic fence signaled by the GPU queue running the copies.
+    class ICopyFence
+    {
+    public:
+        virtual ~ICopyFence() {}
+
+        // Last value reached by the fence.
+        virtual uint64_t GetCompletedValue() = 0;
+
+        // Blocks the calling thread until the fence reaches value.
+        virtual void WaitForValue(uint64_t value) = 0;
+    };
+
+    // Hands out the copy slots (a command allocator and its command list each) in round robin,
+    // and the fence value signaled after the copy recorded in a slot. A slot is only reused once
+    // the copy it last recorded has executed, so with enough slots the copy of a frame overlaps
+    // with the rendering of the next one and the caller never waits on the GPU.
+    class CopySlotScheduler final
+    {
+    public:
+        CopySlotScheduler(ICopyFence& fence, uint32_t slotCount) :
+            m_Fence(&fence),
+            m_SlotFenceValues(slotCount > 0 ? slotCount : 1, 0),
+            m_NextSlot(0),
+            m_LastFenceValue(0),
+            m_StallCount(0)
+        {
+        }
+
+        // Returns the slot to record the next copy in, waiting for the copy previously recorded
+        // in it if that one is still executing.
+        uint32_t AcquireSlot()
+        {
+            const auto slot = m_NextSlot;
+            if (WaitFor(m_SlotFenceValues[slot]))
+            {
+                ++m_StallCount;
+            }
+            return slot;
+        }
+
+        // Records that the copy of the slot was submitted, and returns the fence value the queue
+        // must signal after it. Consumers of the copied texture wait on that value only.
+        uint64_t Submit(uint32_t slot)
+        {
+            const auto value = ++m_LastFenceValue;
+            m_SlotFenceValues[slot] = value;
+            m_NextSlot = (slot + 1) % GetSlotCount();
+            return value;
+        }
+
+        bool IsComplete(uint64_t value)
+        {
+            return m_Fence->GetCompletedValue() >= value;
+        }
+
+        // Waits for all the submitted copies, before the slots are released.
+        void WaitIdle()
+        {
+            WaitFor(m_LastFenceValue);
+        }
+
+        uint32_t GetSlotCount() const
+        {
+            return static_cast<uint32_t>(m_SlotFenceValues.size());
+        }
+
+        uint64_t GetLastFenceValue() const
+        {
+            return m_LastFenceValue;
+        }
+
+        // Number of AcquireSlot() calls that had to wait for the GPU.
+        uint64_t GetStallCount() const
+        {
+            return m_StallCount;
+        }
+
+    private:
+        // Returns true if the calling thread had to block.
+        bool WaitFor(uint64_t value)
+        {
+            if (value == 0 || IsComplete(value))
+                return false;
+
+            m_Fence->WaitForValue(value);
+            return true;
+        }
+
+        ICopyFence*             m_Fence;
+        std::vector<uint64_t>   m_SlotFenceValues;
+        uint32_t                m_NextSlot;
+        uint64_t                m_LastFenceValue;
+        uint64_t                m_StallCount;
+    };
+}
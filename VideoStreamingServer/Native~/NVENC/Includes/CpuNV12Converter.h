@@ -0,0 +1,190 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "INV12Converter.h"
+
+namespace NvencPlugin
+{
+    // 8-bit image in system memory. BGRA images hold 4 bytes per pixel; NV12 images hold the luma
+    // plane followed by the interleaved chroma plane, both with the same stride.
+    struct CpuImage
+    {
+        uint8_t* data;
+        int      width;
+        int      height;
+        int      stride;
+    };
+
+    // CPU implementation of the conversion done by the D3D11 video processor: bilinear scaling,
+    // full range RGB to BT.709 studio range YCbCr, chroma averaged over each 2x2 block. It is the
+    // reference for the scaling stage of simulcast, which can be tested without a GPU.
+    class CpuNV12Converter final : public INV12Converter
+    {
+    public:
+        CpuNV12Converter(int inWidth, int inHeight, int outWidth, int outHeight) :
+            m_Input(nullptr),
+            m_InWidth(inWidth),
+            m_InHeight(inHeight),
+            m_OutWidth(outWidth),
+            m_OutHeight(outHeight)
+        {
+            Initialize();
+        }
+
+        // Reads from an image shared with other converters (simulcast).
+        CpuNV12Converter(const CpuImage* input, int outWidth, int outHeight) :
+            m_Input(input),
+            m_InWidth(input != nullptr ? input->width : 0),
+            m_InHeight(input != nullptr ? input->height : 0),
+            m_OutWidth(outWidth),
+            m_OutHeight(outHeight)
+        {
+            Initialize();
+        }
+
+        bool ConvertRGBToNV12(void* source, void* dest) override
+        {
+            return Convert(static_cast<const CpuImage*>(source), static_cast<CpuImage*>(dest));
+        }
+
+        bool ConvertToNV12(void* dest) override
+        {
+            return Convert(m_Input, static_cast<CpuImage*>(dest));
+        }
+
+    private:
+        // Fixed point sample position: the two nearest source texels and the weight of the second, out of 256.
+        struct Tap
+        {
+            int first;
+            int second;
+            int weight;
+        };
+
+        static void ComputeTaps(int inSize, int outSize, std::vector<Tap>& taps)
+        {
+            taps.resize(outSize);
+            for (int i = 0; i < outSize; ++i)
+            {
+                // Texel centers are aligned: the output texel i covers [i, i + 1) * inSize / outSize.
+                int64_t position = ((2 * static_cast<int64_t>(i) + 1) * inSize * 256) / (2 * static_cast<int64_t>(outSize)) - 128;
+                position = (std::max)(position, static_cast<int64_t>(0));
+
+                auto& tap = taps[i];
+                tap.first = (std::min)(static_cast<int>(position >> 8), inSize - 1);
+                tap.second = (std::min)(tap.first + 1, inSize - 1);
+                tap.weight = static_cast<int>(position & 255);
+            }
+        }
+
+        void Initialize()
+        {
+            m_IsValid = m_InWidth > 0 && m_InHeight > 0 && m_OutWidth > 0 && m_OutHeight > 0 &&
+                m_OutWidth % 2 == 0 && m_OutHeight % 2 == 0;
+
+            if (!m_IsValid)
+                return;
+
+            ComputeTaps(m_InWidth, m_OutWidth, m_Columns);
+            ComputeTaps(m_InHeight, m_OutHeight, m_Rows);
+
+            for (auto& line : m_Lines)
+            {
+                line.resize(3 * static_cast<size_t>(m_OutWidth));
+            }
+        }
+
+        // Fills line with the scaled R, G, B values of an output row.
+        void ScaleRow(const CpuImage& source, int row, std::vector<int>& line) const
+        {
+            const auto& rowTap = m_Rows[row];
+            const uint8_t* first = source.data + static_cast<size_t>(rowTap.first) * source.stride;
+            const uint8_t* second = source.data + static_cast<size_t>(rowTap.second) * source.stride;
+
+            for (int x = 0; x < m_OutWidth; ++x)
+            {
+                const auto& columnTap = m_Columns[x];
+                const uint8_t* a = first + 4 * columnTap.first;
+                const uint8_t* b = first + 4 * columnTap.second;
+                const uint8_t* c = second + 4 * columnTap.first;
+                const uint8_t* d = second + 4 * columnTap.second;
+
+                // BGRA to RGB.
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    const int index = 2 - channel;
+                    const int top = a[index] * (256 - columnTap.weight) + b[index] * columnTap.weight;
+                    const int bottom = c[index] * (256 - columnTap.weight) + d[index] * columnTap.weight;
+                    const int value = top * (256 - rowTap.weight) + bottom * rowTap.weight;
+                    line[3 * x + channel] = (value + (1 << 15)) >> 16;
+                }
+            }
+        }
+
+        static uint8_t ToLuma(int r, int g, int b)
+        {
+            return static_cast<uint8_t>(((11966 * r + 40254 * g + 4064 * b + (1 << 15)) >> 16) + 16);
+        }
+
+        bool Convert(const CpuImage* source, CpuImage* dest)
+        {
+            if (!m_IsValid || source == nullptr || dest == nullptr || source->data == nullptr || dest->data == nullptr ||
+                source->width != m_InWidth || source->height != m_InHeight ||
+                dest->width != m_OutWidth || dest->height != m_OutHeight)
+            {
+                return false;
+            }
+
+            uint8_t* chromaPlane = dest->data + static_cast<size_t>(dest->stride) * m_OutHeight;
+
+            for (int y = 0; y < m_OutHeight; y += 2)
+            {
+                ScaleRow(*source, y, m_Lines[0]);
+                ScaleRow(*source, y + 1, m_Lines[1]);
+
+                for (int line = 0; line < 2; ++line)
+                {
+                    uint8_t* luma = dest->data + static_cast<size_t>(y + line) * dest->stride;
+                    const auto& rgb = m_Lines[line];
+                    for (int x = 0; x < m_OutWidth; ++x)
+                    {
+                        luma[x] = ToLuma(rgb[3 * x], rgb[3 * x + 1], rgb[3 * x + 2]);
+                    }
+                }
+
+                uint8_t* chroma = chromaPlane + static_cast<size_t>(y / 2) * dest->stride;
+                for (int x = 0; x < m_OutWidth; x += 2)
+                {
+                    int sum[3];
+                    for (int channel = 0; channel < 3; ++channel)
+                    {
+                        sum[channel] = m_Lines[0][3 * x + channel] + m_Lines[0][3 * x + 3 + channel] +
+                            m_Lines[1][3 * x + channel] + m_Lines[1][3 * x + 3 + channel];
+                    }
+
+                    // Sums of 4 samples: the shift also divides by 4. The offset keeps the values positive.
+                    const int r = sum[0];
+                    const int g = sum[1];
+                    const int b = sum[2];
+                    chroma[x] = static_cast<uint8_t>((-6597 * r - 22187 * g + 28784 * b + (128 << 18) + (1 << 17)) >> 18);
+                    chroma[x + 1] = static_cast<uint8_t>((28784 * r - 26148 * g - 2636 * b + (128 << 18) + (1 << 17)) >> 18);
+                }
+            }
+
+            return true;
+        }
+
+        const CpuImage*  m_Input;
+        int              m_InWidth;
+        int              m_InHeight;
+        int              m_OutWidth;
+        int              m_OutHeight;
+        bool             m_IsValid;
+        std::vector<Tap> m_Columns;
+        std::vector<Tap> m_Rows;
+        std::vector<int> m_Lines[2];
+    };
+}
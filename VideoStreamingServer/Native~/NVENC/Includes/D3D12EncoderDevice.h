@@ -2,6 +2,9 @@
 
 #include <comdef.h>
 #include <iostream>
+#include <memory>
+#include <vector>
+#include "CopySlotScheduler.h"
 #include "d3d11_4.h"
 #include "d3d12.h"
 #include "IGraphicsEncoderDevice.h"
@@ -14,6 +17,34 @@ namespace NvencPlugin
     DefPtr(ID3D12CommandAllocator);
     DefPtr(ID3D12GraphicsCommandList4);
 
+    // Copy fence waited on by the CPU through an event.
+    class D3D12CopyFence final : public ICopyFence
+    {
+    public:
+        D3D12CopyFence(ID3D12Fence* fence, HANDLE handle) :
+            m_Fence(fence),
+            m_EventHandle(handle)
+        {
+        }
+
+        virtual uint64_t GetCompletedValue() override
+        {
+            return m_Fence->GetCompletedValue();
+        }
+
+        virtual void WaitForValue(uint64_t value) override
+        {
+            if (SUCCEEDED(m_Fence->SetEventOnCompletion(value, m_EventHandle)))
+            {
+                WaitForSingleObject(m_EventHandle, INFINITE);
+            }
+        }
+
+    private:
+        ID3D12Fence*    m_Fence;
+        HANDLE          m_EventHandle;
+    };
+
     // Solution from Unity Japan team, WebRTC.
     // https://github.com/Unity-Technologies/com.unity.webrtc
     class D3D12EncoderDevice : public IGraphicsEncoderDevice
@@ -23,14 +54,15 @@ namespace NvencPlugin
         virtual ~D3D12EncoderDevice();
 
         virtual bool Initialize() override;
-        virtual void InitializeConverter(const int width, const int height) override;
+        virtual INV12Converter* CreateConverter(const int width, const int height) override;
+        virtual INV12Converter* CreateScalingConverter(ITexture2D* source, const int width, const int height) override;
         virtual bool InitializeMultithreadingSecurity() override;
         virtual void Cleanup() override;
 
         virtual GraphicsDeviceType GetDeviceType() override;
         virtual ITexture2D* CreateDefaultTexture(uint32_t w, uint32_t h, bool forceNV12) override;
 
-        virtual bool ConvertRGBToNV12(IUnknown* nativeSrc, void* nativeDest) override;
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) override;
         virtual bool CopyResource(IUnknown* nativeDest, void* nativeSrc) override;
 
         // Since NVENC does not support D3D12, we use new a D3D12 resource to create a ID3D11Texture2D
@@ -38,21 +70,24 @@ namespace NvencPlugin
         inline IUnknown* GetDevice() { return m_d3d11Device; }
 
     private:
-        void WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t* fenceValue);
-
         ID3D12Device* m_d3d12Device;
         ID3D12CommandQueue* m_d3d12CommandQueue;
 
         ID3D11Device5* m_d3d11Device;
         ID3D11DeviceContext4* m_d3d11Context;
-        std::unique_ptr<RGBToNV12ConverterD3D11> m_Converter;
 
-        ID3D12CommandAllocatorPtr m_commandAllocator;
-        ID3D12GraphicsCommandList4Ptr m_commandList;
+        // One command allocator and list per copy slot, so that a copy is recorded while the previous ones execute.
+        std::vector<ID3D12CommandAllocatorPtr> m_commandAllocators;
+        std::vector<ID3D12GraphicsCommandList4Ptr> m_commandLists;
 
         ID3D12Fence* m_copyResourceFence;
         HANDLE       m_copyResourceEventHandle;
-        uint64_t     m_copyResourceFenceValue;
+
+        // The copy fence opened on the D3D11 device, null if it can't be shared (the copies are then waited on the CPU).
+        ID3D11Fence* m_d3d11CopyFence;
+
+        std::unique_ptr<D3D12CopyFence> m_copyFence;
+        std::unique_ptr<CopySlotScheduler> m_copyScheduler;
 
         // Create a D3D11 NV12 texture.
         ID3D11Texture2D* CreateNV12Texture(uint32_t width, uint32_t height);
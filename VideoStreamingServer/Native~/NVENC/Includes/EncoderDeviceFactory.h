@@ -1,9 +1,45 @@
 #pragma once
 
+#include <mutex>
+#include <vector>
+
 #include "nvEncodeAPI.h"
 #include "d3d11.h"
 
+#include "IGraphicsEncoderDevice.h"
+#include "Unity/IUnityGraphicsD3D11.h"
+#include "Unity/IUnityGraphicsD3D12.h"
+
 namespace NvencPlugin
 {
+    // Registry of the graphics encoder devices, one per Unity graphics device, shared by
+    // every encoder (active or parked) created on it. Each encoder holds a reference, the
+    // device is cleaned up when the last one is released.
+    class EncoderDeviceFactory
+    {
+    public:
+        // Returns the encoder device for the Unity graphics device, creating it on first use.
+        // Returns nullptr if the graphics API isn't supported or the device failed to initialize.
+        static IGraphicsEncoderDevice* Acquire(IUnknown* nativeDevice,
+                                               IUnityGraphicsD3D11* unityGraphicsD3D11,
+                                               IUnityGraphicsD3D12v5* unityGraphicsD3D12);
+        static void Retain(IGraphicsEncoderDevice* device);
+        static void Release(IGraphicsEncoderDevice* device);
+
+        // Destroys every device, whatever its reference count. Only used on graphics device shutdown.
+        static void ReleaseAll();
+
+    private:
+        struct DeviceEntry
+        {
+            IUnknown*               nativeDevice;
+            IGraphicsEncoderDevice* device;
+            int                     refCount;
+        };
+
+        static void DestroyDevice(IGraphicsEncoderDevice* device);
 
+        static std::mutex               s_Mutex;
+        static std::vector<DeviceEntry> s_Devices;
+    };
 }
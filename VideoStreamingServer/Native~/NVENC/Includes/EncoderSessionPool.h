@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <mutex>
+
+namespace NvencPlugin
+{
+    // Keeps idle encoder sessions warm so that a stream restart or a resolution switch
+    // doesn't have to open a new hardware session and register its resources again.
+    //
+    // TKey must provide:
+    //     int Match(const TKey& request) const;
+    // returning a negative value when the parked session can't serve the request, and a
+    // higher value for a better candidate (e.g. same size, no resource reallocation).
+    //
+    // The pool only owns parked sessions: Acquire hands the ownership back to the caller,
+    // Release takes it. Evicted sessions are given to the destroy callback. Idle memory is
+    // capped both in bytes and in session count (hardware encoders limit the number of
+    // concurrent sessions, idle ones included); the least recently parked sessions go first.
+    template <typename TKey, typename TSession> class EncoderSessionPool final
+    {
+    public:
+        using DestroyCallback = std::function<void(TSession*)>;
+
+        EncoderSessionPool(size_t maxIdleBytes, size_t maxIdleSessions, DestroyCallback destroy) :
+            m_MaxIdleBytes(maxIdleBytes),
+            m_MaxIdleSessions(maxIdleSessions),
+            m_IdleBytes(0),
+            m_Destroy(destroy)
+        {
+        }
+
+        EncoderSessionPool(const EncoderSessionPool&) = delete;
+        EncoderSessionPool& operator=(const EncoderSessionPool&) = delete;
+
+        ~EncoderSessionPool()
+        {
+            Clear();
+        }
+
+        // Returns the best parked session for the request, or nullptr if none matches.
+        // On success, key receives the key the session was parked with.
+        TSession* Acquire(const TKey& request, TKey* key = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            auto best = m_Idle.end();
+            int bestScore = -1;
+
+            // Most recently parked first, so that ties keep the warmest session.
+            for (auto it = m_Idle.begin(); it != m_Idle.end(); ++it)
+            {
+                const int score = it->key.Match(request);
+                if (score > bestScore)
+                {
+                    best = it;
+                    bestScore = score;
+                }
+            }
+
+            if (best == m_Idle.end())
+                return nullptr;
+
+            auto session = best->session;
+            if (key != nullptr)
+            {
+                *key = best->key;
+            }
+
+            m_IdleBytes -= best->bytes;
+            m_Idle.erase(best);
+
+            return session;
+        }
+
+        // Parks a session. It may be destroyed right away if it doesn't fit in the budget.
+        void Release(const TKey& key, TSession* session, size_t bytes)
+        {
+            if (session == nullptr)
+                return;
+
+            std::list<Entry> evicted;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+
+                m_Idle.push_front({ key, session, bytes });
+                m_IdleBytes += bytes;
+
+                while (!m_Idle.empty() &&
+                       (m_IdleBytes > m_MaxIdleBytes || m_Idle.size() > m_MaxIdleSessions))
+                {
+                    m_IdleBytes -= m_Idle.back().bytes;
+                    evicted.splice(evicted.end(), m_Idle, std::prev(m_Idle.end()));
+                }
+            }
+
+            DestroyEntries(evicted);
+        }
+
+        // Destroys the parked sessions for which the predicate returns true.
+        void RemoveIf(const std::function<bool(const TKey&)>& predicate)
+        {
+            std::list<Entry> evicted;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+
+                for (auto it = m_Idle.begin(); it != m_Idle.end();)
+                {
+                    auto current = it++;
+                    if (predicate(current->key))
+                    {
+                        m_IdleBytes -= current->bytes;
+                        evicted.splice(evicted.end(), m_Idle, current);
+                    }
+                }
+            }
+
+            DestroyEntries(evicted);
+        }
+
+        void Clear()
+        {
+            RemoveIf([](const TKey&) { return true; });
+        }
+
+        inline size_t GetIdleCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Idle.size();
+        }
+
+        inline size_t GetIdleBytes() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_IdleBytes;
+        }
+
+    private:
+        struct Entry
+        {
+            TKey      key;
+            TSession* session;
+            size_t    bytes;
+        };
+
+        // Called outside of the lock, destroying a hardware session can take a while.
+        void DestroyEntries(std::list<Entry>& entries)
+        {
+            for (auto& entry : entries)
+            {
+                if (m_Destroy)
+                {
+                    m_Destroy(entry.session);
+                }
+            }
+        }
+
+        const size_t       m_MaxIdleBytes;
+        const size_t       m_MaxIdleSessions;
+        size_t             m_IdleBytes;
+        DestroyCallback    m_Destroy;
+        mutable std::mutex m_Mutex;
+        std::list<Entry>   m_Idle;
+    };
+}
@@ -12,6 +12,8 @@ namespace NvencPlugin
     };
 
     class ITexture2D;
+    class INV12Converter;
+
     class IGraphicsEncoderDevice
     {
     public:
@@ -19,11 +21,12 @@ namespace NvencPlugin
         virtual ~IGraphicsEncoderDevice() {}
 
         virtual bool Initialize() = 0;
-        virtual void InitializeConverter(const int width, const int height) = 0;
+        virtual INV12Converter* CreateConverter(const int width, const int height) = 0;
+        virtual INV12Converter* CreateScalingConverter(ITexture2D* source, const int width, const int height) = 0;
         virtual bool InitializeMultithreadingSecurity() = 0;
         virtual void Cleanup() = 0;
 
-        virtual bool ConvertRGBToNV12(IUnknown* nativeSrc, void* nativeDest) = 0;
+        virtual bool ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* nativeDest) = 0;
         virtual bool CopyResource(IUnknown* nativeSrc, void* nativeDest) = 0;
 
         virtual ITexture2D* CreateDefaultTexture(uint32_t width, uint32_t height, bool forceNV12) = 0;
@@ -0,0 +1,20 @@
+#pragma once
+
+namespace NvencPlugin
+{
+    // Converts BGRA frames to the NV12 input of an encoder, scaled to the encoder size.
+    // The images are the native handles of the implementation: ID3D11Texture2D for the D3D11
+    // video processor, CpuImage for the CPU path.
+    class INV12Converter
+    {
+    public:
+        virtual ~INV12Converter() {}
+
+        // Converts a frame of the input size into dest.
+        virtual bool ConvertRGBToNV12(void* source, void* dest) = 0;
+
+        // Converts the current content of the input, filled once per frame by the caller and
+        // shared by the converters of a simulcast group.
+        virtual bool ConvertToNV12(void* dest) = 0;
+    };
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include "nvEncodeAPI.h"
+#include "windows.h"
+
+namespace NvencPlugin
+{
+    enum class ENvencSupport
+    {
+        Supported,
+        NotSupportedOnPlatform,
+        NoDriver,
+        DriverVersionNotSupported
+    };
+
+    enum class ENvencStatus
+    {
+        NotInitialized,
+        Success,
+        DriverNotInstalled,
+        DriverVersionDoesNotSupportAPI,
+        APINotFound,
+        EncoderInitializationFailed
+    };
+
+    // Capabilities reported by the driver for one codec on one device.
+    struct NvencCodecCaps
+    {
+        bool asyncEncode = false;
+        int  widthMax = 0;
+        int  heightMax = 0;
+        bool intraRefresh = false;
+        int  numMaxBFrames = 0;
+    };
+
+    // Process-wide NVENC driver state, shared by every NvEncoder instance.
+    // The module and the API function list are loaded once; the codec capabilities
+    // and preset configurations are queried by the first session that needs them
+    // and served from a cache afterwards. Encoders hold a reference between
+    // InitEncoder and DestroyResources. The module stays resident when the last
+    // reference is released so that restarting a stream doesn't reload the driver;
+    // it is only freed by UnloadIfUnused (plugin unload / graphics device shutdown).
+    class NvencDriverContext
+    {
+        using NvEncodeAPICreateInstance_Type = NVENCSTATUS(NVENCAPI*)(NV_ENCODE_API_FUNCTION_LIST*);
+        using NvEncodeAPIGetMaxSupportedVersion_Type = NVENCSTATUS(NVENCAPI*)(uint32_t*);
+
+    public:
+        // Returns the shared context and adds a reference to it. Never returns null,
+        // check GetStatus() to know if the driver could be loaded.
+        static NvencDriverContext* Acquire();
+        static void Release();
+
+        // Frees the driver module and the caches if no encoder holds a reference.
+        static void UnloadIfUnused();
+
+        // Checks the driver without keeping the module loaded when no encoder uses it.
+        static ENvencSupport QuerySupport();
+
+        inline ENvencStatus GetStatus() const { return m_Status; }
+        inline const NV_ENCODE_API_FUNCTION_LIST& GetFunctionList() const { return m_Nvenc; }
+
+        // Both methods need an opened encode session to query the driver the first time
+        // a (device, codec) pair is requested.
+        bool GetCodecCaps(const void* device, void* encoder, const GUID& codecGuid, NvencCodecCaps& caps);
+        bool GetPresetConfig(const void* device,
+                             void* encoder,
+                             const GUID& codecGuid,
+                             const GUID& presetGuid,
+                             NV_ENC_PRESET_CONFIG& presetConfig);
+
+    private:
+        struct CodecCapsEntry
+        {
+            const void*    device;
+            GUID           codecGuid;
+            NvencCodecCaps caps;
+        };
+
+        struct PresetEntry
+        {
+            const void*          device;
+            GUID                 codecGuid;
+            GUID                 presetGuid;
+            NV_ENC_PRESET_CONFIG presetConfig;
+        };
+
+        NvencDriverContext();
+        ~NvencDriverContext();
+
+        ENvencStatus Load();
+        void         Unload();
+
+        static HMODULE LoadModule();
+        static void    FreeModule(HMODULE module);
+        static bool    CheckDriverVersion(HMODULE module);
+
+        int QueryCap(void* encoder, const GUID& codecGuid, NV_ENC_CAPS cap) const;
+
+        static std::mutex          s_Mutex;
+        static NvencDriverContext* s_Instance;
+        static int                 s_RefCount;
+
+        HMODULE                     m_HModule;
+        NV_ENCODE_API_FUNCTION_LIST m_Nvenc;
+        ENvencStatus                m_Status;
+
+        // Guards the caches, encoders on different threads can query them concurrently.
+        std::mutex                  m_CacheMutex;
+        std::vector<CodecCapsEntry> m_CodecCaps;
+        std::vector<PresetEntry>    m_Presets;
+    };
+}
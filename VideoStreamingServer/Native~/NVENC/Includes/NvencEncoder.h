@@ -2,7 +2,9 @@
 
 #include <mutex>
 #include <queue>
+#include <deque>
 #include <list>
+#include <memory>
 
 #include "nvEncodeAPI.h"
 #include "d3d11.h"
@@ -11,28 +13,21 @@
 #include "NvencFrame.h"
 #include "NvencEncoderSessionData.h"
 #include "IGraphicsEncoderDevice.h"
+#include "RGBToNV12ConverterD3D11.h"
+#include "NvencDriverContext.h"
 
 #include "NvThread.h"
+#include "EncodedFrameQueue.h"
+#include "EncodeFrameContext.h"
+#include "EncoderStats.h"
+#include "Fmp4Recorder.h"
+#include "ReplayExporter.h"
+#include "TimecodeSei.h"
 
 namespace NvencPlugin
 {
-    enum class ENvencSupport
-    {
-        Supported,
-        NotSupportedOnPlatform,
-        NoDriver,
-        DriverVersionNotSupported
-    };
-
-    enum class ENvencStatus
-    {
-        NotInitialized,
-        Success,
-        DriverNotInstalled,
-        DriverVersionDoesNotSupportAPI,
-        APINotFound,
-        EncoderInitializationFailed
-    };
+    using LiveCaptureNative::EncodeFrameContext;
+    using LiveCaptureNative::EncoderBufferingSettings;
 
     struct EncodedFrameDataKey
     {
@@ -41,71 +36,147 @@ namespace NvencPlugin
         bool isKeyFrame;
     };
 
+    // Identifies what a parked encoder session can be reused for.
+    struct NvencSessionKey
+    {
+        const void*          device = nullptr;
+        GUID                 codec = {};
+        NV_ENC_BUFFER_FORMAT format = NV_ENC_BUFFER_FORMAT_UNDEFINED;
+        int                  maxWidth = 0;
+        int                  maxHeight = 0;
+        int                  width = 0;
+        int                  height = 0;
+        int                  sliceCount = 0;
+        int                  inFlightDepth = 0; // As requested, the input buffers are allocated for it.
+
+        // Negative if the session can't serve the request, 1 if no resources need to be reallocated.
+        int Match(const NvencSessionKey& request) const;
+    };
+
     class NvEncoder
     {
-        using NvEncodeAPICreateInstance_Type = NVENCSTATUS(NVENCAPI*)(NV_ENCODE_API_FUNCTION_LIST*);
         using DataSequence = std::vector<uint8_t>;
 
         const int  k_MaxWidth = 3840;
         const int  k_MaxHeight = 2160;
-        const int  k_MaxQueueLength = 8;
+        static const int k_DefaultQueueLength = 8;
+        static const int k_FrameQueueCapacity = 2 * LiveCaptureNative::k_MaxOutputQueueLength;
+        static const int k_FrameContextCount = 16;
+        const int  k_MaxSliceQueueLength = 64;
+        const int  k_MaxSliceCount = 32;
 
     public:
         NvEncoder(NV_ENC_DEVICE_TYPE deviceType,
                   const NvencEncoderSessionData& other,
                   IGraphicsEncoderDevice* device,
-                  bool forceNv12);
+                  bool forceNv12,
+                  int sliceCount = 0,
+                  const EncoderBufferingSettings& buffering = {});
 
         ~NvEncoder() = default;
 
         static ENvencSupport IsEncoderAvailable();
+        static NvencSessionKey MakeSessionRequest(IGraphicsEncoderDevice* device,
+                                                  const NvencEncoderSessionData& settings,
+                                                  bool forceNv12,
+                                                  int sliceCount,
+                                                  const EncoderBufferingSettings& buffering);
 
         // Initialization
         ENvencStatus InitEncoder();
         void         DestroyResources();
 
+        // Session pooling: Park keeps the hardware session and its registered resources alive
+        // but stops the encoding thread, Resume reconfigures it for a new stream (the in-flight
+        // depth is part of the session key, the output queue and the policy can change).
+        void            Park();
+        bool            Resume(const NvencEncoderSessionData& settings, const EncoderBufferingSettings& buffering);
+        NvencSessionKey GetSessionKey() const;
+        size_t          GetResidentBytes() const;
+
         // Update & Encode
         bool         UpdateEncoderSessionData(const NvencEncoderSessionData& other);
-        void         EncodeFrame(void* frameSourceData, unsigned long long int timeStamp);
+        void         EncodeFrame(void* frameSourceData,
+                                 unsigned long long int timeStamp,
+                                 const LiveCaptureNative::FrameTimecode& timecode);
+
+        // Simulcast: scales the shared source (already filled for this frame) into this encoder's input.
+        void         EncodeScaledFrame(ITexture2D* source,
+                                       unsigned long long int timeStamp,
+                                       const LiveCaptureNative::FrameTimecode& timecode);
 
         // Get encoded frames
         bool          RemoveEncodedFrame();
         EncodedFrame* GetEncodedFrame();
         void          GetSequenceParams(DataSequence& spsSequence, DataSequence& ppsSequence);
 
+        // Get encoded slices, only produced when the encoder was created with more than one slice.
+        // The consumer can read them from another thread while the frame is still being encoded.
+        bool          RemoveEncodedSlice();
+        EncodedSlice* GetEncodedSlice();
+
         // Getters
         inline bool  IsInitialized() { return m_InitializationResult == ENvencStatus::Success; }
+        inline IGraphicsEncoderDevice* GetGraphicsDevice() const { return m_Device; }
+        inline int   GetFrameRate() const { return m_FrameData.frameRate; }
+        inline void  GetStats(LiveCaptureNative::EncoderStatsSnapshot& snapshot) const { m_Stats.Snapshot(snapshot); }
+        inline const EncoderBufferingSettings& GetBuffering() const { return m_Buffering; }
+
+        // Recording of the encoded stream to a fragmented MP4 file. Every encoded frame is
+        // recorded, including the ones the frame queue drops. Called from the Unity thread.
+        bool         StartRecording(const char* path, const LiveCaptureNative::Fmp4RecorderSettings& settings);
+        void         StopRecording();
+        void         GetRecordingStats(LiveCaptureNative::Fmp4RecorderStats& stats);
+
+        // Instant replay: the last encoded frames are kept in memory while the replay buffer is
+        // enabled (settings not null), SaveReplay() writes them to a fragmented MP4 file in the
+        // background. Called from the Unity thread.
+        void         ConfigureReplayBuffer(const LiveCaptureNative::ReplayBufferSettings* settings);
+        bool         SaveReplay(const char* path, uint64_t durationNs);
+        bool         GetReplayBufferStats(LiveCaptureNative::ReplayBufferStats& stats);
+        void         GetReplayExportStats(LiveCaptureNative::Fmp4RecorderStats& stats);
 
     private:
         // Initialize / destroy resources
-        static HMODULE LoadModule();
-        static bool    CheckDriverVersion(HMODULE module);
         ENvencStatus   LoadCodec();
         void           SetEncoderParameters();
+        void           ConfigureBuffering(const EncoderBufferingSettings& requested);
 
         // Initialize encoding resources
         void                  MapResources(InputFrame& inputFrame);
         void                  InitEncoderResources();
         NV_ENC_REGISTERED_PTR RegisterResource(void* buffer, NV_ENC_BUFFER_FORMAT format);
         NV_ENC_OUTPUT_PTR     InitializeBitstreamBuffer();
+        void                  InitializeConverter();
 
         //Encoding frames
         void UpdateSettings();
+        bool AcquireInputSlot(int frameIndex);
         bool CopyBufferResources(int frameIndex, void* frameSourceData);
+        void SubmitFrame(int frameIndex, unsigned long long int timeStamp, const LiveCaptureNative::FrameTimecode& timecode);
         void ProcessEncodedFrame(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
+        bool ProcessEncodedSlices(Frame& frame, EncodeFrameContext& context, bool isKeyFrame);
+        void ResolveFrameContext(uint64_t sequence, EncodeFrameContext& context);
+        void AddEncodedSlice(const uint8_t* data, uint32_t size, const EncodeFrameContext& context,
+                             uint32_t sliceIndex, bool isLastSlice, bool isKeyFrame);
+        inline bool IsSubFrameOutputEnabled() const { return m_SliceCount > 1; }
 
         // Release Resources
-        void UnloadModule();
+        void ReleaseCodec();
         void ReleaseFrameInputBuffer(Frame& frame);
         void ReleaseEncoderResources();
         void ClearEncodedFrameQueue();
 
         // Encoded frame actions
-        void AddEncodedFrame(Frame& frame, unsigned long long int timeStamp, bool isKeyFrame);
+        void AddEncodedFrame(Frame& frame, const EncodeFrameContext& context, bool isKeyFrame);
+        void RecordFrame(const Frame& frame, const EncodeFrameContext& context, bool isKeyFrame);
+        void InsertTimecodeSei(std::vector<uint8_t>& accessUnit, const EncodeFrameContext& context);
 
         // Async methods
         void InitializeAsyncResources();
         void DestroyAsyncResources();
+        void StartAsyncThread();
+        void StopAsyncThread();
 
         void* GetCompletionEvent(uint32_t eventIdx);
         Frame& GetBufferedFrame(int index);
@@ -113,12 +184,14 @@ namespace NvencPlugin
         static void ProcessEncodedFrameAsyncSingle(NvEncoder* encoder);
 
     private:
-        // Device specific
-        IGraphicsEncoderDevice* m_Device;
+        // Device specific, the device is shared with the other encoders, the converter is not.
+        IGraphicsEncoderDevice*                  m_Device;
+        std::unique_ptr<INV12Converter> m_Converter;
+        void*                                    m_SimulcastInput;
 
         // Load Codec
-        void* m_HModule;
-        void* m_HEncoder;
+        NvencDriverContext* m_Driver;
+        void*               m_HEncoder;
 
         // Open an encode session
         NV_ENCODE_API_FUNCTION_LIST m_Nvenc;
@@ -135,14 +208,44 @@ namespace NvencPlugin
         uint64_t                m_FrameCount;
         uint64_t                m_GOPCount;
         bool                    m_ForceNV12;
+
+        // Sub-frame output
+        int                      m_SliceCount;
+        std::vector<uint32_t>    m_SliceOffsets;
+        std::deque<EncodedSlice> m_SliceQueue;
+        std::mutex               m_SliceMutex;
         
+        // Buffering as requested by the session settings, and as validated against the driver caps.
+        EncoderBufferingSettings m_RequestedBuffering;
+        EncoderBufferingSettings m_Buffering;
+
         // Global resources. Note from NVIDIA doc:
         // "It is also recommended to allocate many input and output buffers
         // in order to avoid resource hazards and improve overall encoder throughput."
-        ITexture2D* m_RenderTextures[k_BufferedFrameNum];
-        Frame       m_BufferedFrames[k_BufferedFrameNum];
-
-        std::queue<EncodedFrame>  m_FrameQueue;
+        // Only the first m_BufferedFrameCount (the validated in-flight depth) are used.
+        uint32_t    m_BufferedFrameCount;
+        ITexture2D* m_RenderTextures[k_MaxBufferedFrameNum];
+        Frame       m_BufferedFrames[k_MaxBufferedFrameNum];
+
+        // Counters and latency histograms, exported through GetEncoderStats.
+        LiveCaptureNative::EncoderStats m_Stats;
+
+        // Filled by the encode (or async) thread, read by the Unity thread.
+        LiveCaptureNative::EncodedFrameQueue<EncodedFrame, k_FrameQueueCapacity> m_FrameQueue;
+
+        // Recording and replay buffer, the mutex serializes their setup with the encode (or async)
+        // thread. The stats of the last recording are kept once it is stopped. The exporter reads
+        // the replay buffer, it is declared after it so that it is destroyed first.
+        std::mutex                                       m_RecorderMutex;
+        std::unique_ptr<LiveCaptureNative::Fmp4Recorder> m_Recorder;
+        LiveCaptureNative::Fmp4RecorderStats             m_LastRecordingStats;
+        std::unique_ptr<LiveCaptureNative::ReplayBuffer> m_ReplayBuffer;
+        LiveCaptureNative::ReplayExporter                m_ReplayExporter;
+        DataSequence                                     m_RecordedSps;
+        DataSequence                                     m_RecordedPps;
+
+        // Timing of the frames in flight, looked up from the bitstream outputTimeStamp.
+        LiveCaptureNative::EncodeFrameContextTable<k_FrameContextCount> m_FrameContexts;
 
         // Async members
         std::vector<void*> m_vpCompletionEvent;
@@ -150,6 +253,7 @@ namespace NvencPlugin
 
         NvThread* m_Thread;
         NvSpinlock m_NvSpinlock;
+        std::atomic<bool> m_IsThreadRunning;
 
         int32_t m_nEncoderBuffer = 0;
         bool m_IsAsync;
@@ -2,6 +2,9 @@
 
 #include <iostream>
 
+#include "EncoderBuffering.h"
+#include "FrameTimecode.h"
+
 namespace NvencPlugin
 {
     static const uint64_t BitRateInKilobits = 1000;
@@ -42,6 +45,8 @@ namespace NvencPlugin
         NvencEncoderSessionData settings;
         int id;
         EncoderFormat encoderFormat;
+        int sliceCount; // Slices per frame, sub-frame output is enabled when greater than 1.
+        LiveCaptureNative::EncoderBufferingSettings buffering;
     };
 
     // Retrieve the encoder by using the id parameter and encode the renderTexture parameter.
@@ -50,6 +55,29 @@ namespace NvencPlugin
         void* renderTexture;
         int id;
         unsigned long long int timestamp;
+        LiveCaptureNative::FrameTimecode timecode; // Written to the timecode SEI of the frame.
+    };
+
+    // Retrieve the simulcast group by using the id parameter and encode the renderTexture parameter
+    // into each of its scheduled layers.
+    struct EncoderSimulcastTextureID
+    {
+        void* renderTexture;
+        int id;
+        int width;
+        int height;
+        unsigned long long int timestamp;
+        LiveCaptureNative::FrameTimecode timecode; // Written to the timecode SEI of each layer.
+    };
+
+    // Creates, updates or (when layerCount is 0) destroys the simulcast group identified by the id parameter.
+    // Each layer is an encoder, previously initialized, fed by the group's source texture.
+    struct EncoderSimulcastGroupID
+    {
+        int id;
+        int layerCount;
+        int encoderIds[4];
+        int priorities[4];
     };
 
     // Retrieve the encoder by using the id parameter, and get it's status.
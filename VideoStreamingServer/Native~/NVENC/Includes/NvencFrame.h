@@ -13,7 +13,9 @@ namespace NvencPlugin
 {
     using OutputFrame = NV_ENC_OUTPUT_PTR;
 
+    // Default and maximum number of frames in flight (see EncoderBufferingSettings::inFlightDepth).
     const uint32_t k_BufferedFrameNum = 4;
+    const uint32_t k_MaxBufferedFrameNum = 16;
     const uint32_t k_GOPSize = 2;
 
     struct InputFrame
@@ -39,5 +41,18 @@ namespace NvencPlugin
         std::vector<uint8_t>   imageData;
         unsigned long long int timestamp;
         bool                   isKeyFrame;
+        uint64_t               sequence;      // Submission order of the frame.
+        uint64_t               encodeLatency; // Submit to output time, in nanoseconds.
+        uint64_t               outputTime;    // GetEncodeClockNs() when the frame was queued.
+    };
+
+    // Part of a frame, available as soon as the encoder has written it (sub-frame output).
+    struct EncodedSlice
+    {
+        std::vector<uint8_t>   data;
+        unsigned long long int timestamp;
+        uint32_t               sliceIndex;
+        bool                   isLastSlice;
+        bool                   isKeyFrame;
     };
 }
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "NvencEncoder.h"
+#include "NvencEncoderSessionData.h"
+#include "SimulcastScheduler.h"
+
+namespace NvencPlugin
+{
+    // Encodes one source texture into several encoders (layers) of different sizes and bitrates.
+    // The source is copied once per frame into a staging texture; each scheduled layer then
+    // scales it into its own NV12 input with its video processor. Every layer keeps its own
+    // encoder id, so its output is consumed like the output of a standalone encoder.
+    class NvencSimulcastGroup
+    {
+    public:
+        using EncoderLookup = std::function<NvEncoder*(int)>;
+
+        NvencSimulcastGroup() = default;
+        ~NvencSimulcastGroup();
+
+        NvencSimulcastGroup(const NvencSimulcastGroup&) = delete;
+        NvencSimulcastGroup& operator=(const NvencSimulcastGroup&) = delete;
+
+        void Configure(const EncoderSimulcastGroupID& config, const EncoderLookup& getEncoder);
+        void EncodeFrame(void* frameSourceData,
+                         int width,
+                         int height,
+                         unsigned long long int timeStamp,
+                         const LiveCaptureNative::FrameTimecode& timecode,
+                         const EncoderLookup& getEncoder);
+
+        // Releases the staging texture and its device reference.
+        void ReleaseResources();
+
+    private:
+        bool PrepareStaging(IGraphicsEncoderDevice* device, int width, int height);
+
+        SimulcastScheduler      m_Scheduler;
+        std::vector<int>        m_ScheduledLayers;
+        IGraphicsEncoderDevice* m_Device = nullptr;
+        ITexture2D*             m_Staging = nullptr;
+    };
+}
@@ -69,6 +69,12 @@ namespace NvencPlugin
             return nullptr;
         }
 
+        template <typename F> inline void ForEach(F function) const
+        {
+            for (auto it = map_.begin(); it != map_.end(); ++it)
+                function(it->first, it->second);
+        }
+
     private:
         std::unordered_map<int, T*> map_;
     };
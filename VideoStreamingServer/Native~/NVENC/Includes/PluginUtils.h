@@ -9,11 +9,52 @@
 #include <sstream>
 #include <unordered_map>
 
+// Debug builds log every level, release builds compile the logging out.
+#if defined(DEBUG_MODE) && !defined(LIVECAPTURE_LOG_LEVEL)
+#define LIVECAPTURE_LOG_LEVEL 0
+#endif
+
+#include "AsyncLogger.h"
+
 namespace NvencPlugin
 {
-    void WriteFileDebug(const char* const message, const bool append = true);
+    using LiveCaptureNative::LogLevel;
+
+    // Opens the log file and starts the logger, called when the plugin is loaded.
+    void InitLog();
+
+    // Writes the pending messages and stops the logger, called when the plugin is unloaded.
+    void CloseLog();
+
+    // The messages are queued to the asynchronous logger at the level given, Info without one.
+    // The append flag is kept for compatibility, the log file is truncated once by InitLog().
+    inline void WriteFileDebug(LogLevel level, const char* const message)
+    {
+        LIVECAPTURE_LOG(level, "%s", message);
+    }
+
+    inline void WriteFileDebug(LogLevel level, const char* const message, int value)
+    {
+        LIVECAPTURE_LOG(level, "%s%d", message, value);
+    }
+
+    inline void WriteFileDebug(LogLevel level, const char* const message, NVENCSTATUS status)
+    {
+        LIVECAPTURE_LOG(level, "%sError is: %d", message, static_cast<int>(status));
+    }
+
+    inline void WriteFileDebug(const char* const message, const bool append = true)
+    {
+        LIVECAPTURE_LOG(LogLevel::Info, "%s", message);
+    }
 
-    void WriteFileDebug(const char* const message, int value, const bool append = true);
+    inline void WriteFileDebug(const char* const message, int value, const bool append = true)
+    {
+        LIVECAPTURE_LOG(LogLevel::Info, "%s%d", message, value);
+    }
 
-    void WriteFileDebug(const char* const message, NVENCSTATUS status, const bool append = true);
+    inline void WriteFileDebug(const char* const message, NVENCSTATUS status, const bool append = true)
+    {
+        WriteFileDebug(LogLevel::Error, message, status);
+    }
 }
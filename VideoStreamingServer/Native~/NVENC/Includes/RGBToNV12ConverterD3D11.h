@@ -2,6 +2,7 @@
 
 #include "nvEncodeAPI.h"
 #include "d3d11.h"
+#include "INV12Converter.h"
 
 #include <vector>
 #include <atomic>
@@ -11,7 +12,8 @@
 
 namespace NvencPlugin
 {
-    class RGBToNV12ConverterD3D11
+    // The images are ID3D11Texture2D pointers.
+    class RGBToNV12ConverterD3D11 final : public INV12Converter
     {
         using MapTextureOutputView = std::unordered_map<ID3D11Texture2D*, ID3D11VideoProcessorOutputView*>;
 
@@ -21,10 +23,20 @@ namespace NvencPlugin
                                 int nWidth,
                                 int nHeight);
 
+        // Reads from a BGRA texture shared with other converters (simulcast) and scales it
+        // to the output size. The source is filled once per frame by the caller.
+        RGBToNV12ConverterD3D11(ID3D11Device* pDevice,
+                                ID3D11DeviceContext* pContext,
+                                ID3D11Texture2D* pSourceTexture,
+                                int nOutWidth,
+                                int nOutHeight);
+
         ~RGBToNV12ConverterD3D11();
 
-        bool ConvertRGBToNV12(ID3D11Texture2D* pRGBSrcTexture,
-                              ID3D11Texture2D* pDestTexture);
+        bool ConvertRGBToNV12(void* pRGBSrcTexture, void* pDestTexture) override;
+
+        // Converts the current content of the input texture, without copying a source first.
+        bool ConvertToNV12(void* pDestTexture) override;
 
     private:
         ID3D11Device*           m_D3D11Device;
@@ -41,6 +53,7 @@ namespace NvencPlugin
         MapTextureOutputView m_OutputViewMap;
         bool                 m_IsValid;
 
+        void CreateVideoProcessor(UINT nInWidth, UINT nInHeight, UINT nOutWidth, UINT nOutHeight);
         void SetOutputColorSpace();
         void SetStreamColorSpace();
     };
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace NvencPlugin
+{
+    const int k_MaxSimulcastLayers = 4;
+
+    struct SimulcastLayerDesc
+    {
+        int id;
+        int frameRate;
+        int priority;
+    };
+
+    // Decides which simulcast layers encode a given source frame. Each layer runs at its own
+    // frame rate (e.g. a 60 Hz monitor output and a 30 Hz tablet output fed by the same 60 Hz
+    // source); the layers are returned by decreasing priority so that the most important
+    // output is submitted to the encoder first.
+    class SimulcastScheduler final
+    {
+    public:
+        // Replaces the layer set. Layers that keep their id also keep their timing state.
+        void SetLayers(const SimulcastLayerDesc* layers, int count)
+        {
+            std::vector<LayerState> states;
+            states.reserve(count);
+
+            for (int i = 0; i < count; ++i)
+            {
+                LayerState state;
+                state.desc = layers[i];
+                state.nextDue = 0;
+                state.started = false;
+
+                for (const auto& previous : m_Layers)
+                {
+                    if (previous.desc.id == layers[i].id)
+                    {
+                        state.nextDue = previous.nextDue;
+                        state.started = previous.started;
+                        break;
+                    }
+                }
+                states.push_back(state);
+            }
+
+            // Stable, layers with the same priority keep the configuration order.
+            std::stable_sort(states.begin(), states.end(), [](const LayerState& a, const LayerState& b)
+            {
+                return a.desc.priority > b.desc.priority;
+            });
+
+            m_Layers.swap(states);
+        }
+
+        // Fills the ids of the layers to encode for a source frame sampled at timestamp (in nanoseconds).
+        void Schedule(uint64_t timestamp, std::vector<int>& layerIds)
+        {
+            layerIds.clear();
+
+            for (auto& layer : m_Layers)
+            {
+                if (layer.desc.frameRate <= 0)
+                {
+                    layerIds.push_back(layer.desc.id);
+                    continue;
+                }
+
+                const uint64_t period = k_NanosecondsPerSecond / static_cast<uint64_t>(layer.desc.frameRate);
+
+                // Accept frames a bit early to absorb the source timing jitter.
+                const uint64_t tolerance = period / 4;
+
+                if (!layer.started || timestamp + tolerance >= layer.nextDue)
+                {
+                    // Stay on the ideal cadence unless the layer fell behind by more than a period.
+                    layer.nextDue = (layer.started && timestamp < layer.nextDue + period)
+                        ? layer.nextDue + period
+                        : timestamp + period;
+                    layer.started = true;
+
+                    layerIds.push_back(layer.desc.id);
+                }
+            }
+        }
+
+        inline int GetLayerCount() const { return static_cast<int>(m_Layers.size()); }
+
+    private:
+        static const uint64_t k_NanosecondsPerSecond = 1000000000ull;
+
+        struct LayerState
+        {
+            SimulcastLayerDesc desc;
+            uint64_t           nextDue;
+            bool               started;
+        };
+
+        std::vector<LayerState> m_Layers;
+    };
+}
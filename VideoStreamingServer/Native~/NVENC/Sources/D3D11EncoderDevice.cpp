@@ -25,12 +25,21 @@ namespace NvencPlugin
         return m_D3d11Device != nullptr && m_D3d11Context != nullptr;
     }
 
-    void D3D11EncoderDevice::InitializeConverter(const int width, const int height)
+    INV12Converter* D3D11EncoderDevice::CreateConverter(const int width, const int height)
     {
-        m_Converter.reset(new RGBToNV12ConverterD3D11(m_D3d11Device,
+        return new RGBToNV12ConverterD3D11(m_D3d11Device,
             m_D3d11Context,
             width,
-            height));
+            height);
+    }
+
+    INV12Converter* D3D11EncoderDevice::CreateScalingConverter(ITexture2D* const source, const int width, const int height)
+    {
+        return new RGBToNV12ConverterD3D11(m_D3d11Device,
+            m_D3d11Context,
+            static_cast<ID3D11Texture2D*>(source->GetEncodeTexturePtrV()),
+            width,
+            height);
     }
 
     bool D3D11EncoderDevice::InitializeMultithreadingSecurity()
@@ -75,12 +84,15 @@ namespace NvencPlugin
         return new D3D11Texture2D(width, height, texture);
     }
 
-    bool D3D11EncoderDevice::ConvertRGBToNV12(IUnknown* nativeSrc, void* tex2DDest)
+    bool D3D11EncoderDevice::ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrc, void* tex2DDest)
     {
+        if (converter == nullptr)
+            return false;
+
         auto text2D = static_cast<D3D11Texture2D*>(tex2DDest);
         auto nativeDest = text2D->GetNativeTexturePtrV();
 
-        return m_Converter->ConvertRGBToNV12(static_cast<ID3D11Texture2D*>(nativeSrc),
+        return converter->ConvertRGBToNV12(static_cast<ID3D11Texture2D*>(nativeSrc),
                                              static_cast<ID3D11Texture2D*>(nativeDest));
     }
 
@@ -1,5 +1,6 @@
 #include "D3D12EncoderDevice.h"
 #include "D3D12Texture2D.h"
+#include "NvencFrame.h"
 
 // Disable the 'unscoped enum' Nvenc warnings
 #pragma warning(disable : 26812)
@@ -11,9 +12,9 @@ namespace NvencPlugin
         m_d3d12CommandQueue(unityInterface->GetCommandQueue()),
         m_d3d11Device(nullptr),
         m_d3d11Context(nullptr),
-        m_copyResourceEventHandle(nullptr),
         m_copyResourceFence(nullptr),
-        m_copyResourceFenceValue(1)
+        m_copyResourceEventHandle(nullptr),
+        m_d3d11CopyFence(nullptr)
     {
     }
 
@@ -42,28 +43,70 @@ namespace NvencPlugin
         legacyDevice->GetImmediateContext(&legacyContext);
         legacyContext->QueryInterface(IID_PPV_ARGS(&m_d3d11Context));
 
-        m_d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocator));
-        m_d3d12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocator, nullptr, IID_PPV_ARGS(&m_commandList));
+        // As many copy slots as frames buffered by the encoder.
+        m_commandAllocators.resize(k_BufferedFrameNum);
+        m_commandLists.resize(k_BufferedFrameNum);
+
+        for (uint32_t i = 0; i < k_BufferedFrameNum; ++i)
+        {
+            m_d3d12Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_commandAllocators[i]));
+            m_d3d12Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_commandAllocators[i], nullptr, IID_PPV_ARGS(&m_commandLists[i]));
+
+            // Command lists are created in the recording state, but there is nothing
+            // to record yet. The main loop expects it to be closed, so close it now.
+            m_commandLists[i]->Close();
+        }
+
+        // The fence is shared with the D3D11 device, so that the D3D11 work reading a copied
+        // texture waits for its copy on the GPU instead of blocking the render thread.
+        if (FAILED(m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_SHARED, IID_PPV_ARGS(&m_copyResourceFence))))
+        {
+            m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_copyResourceFence));
+        }
+        else
+        {
+            HANDLE fenceHandle = nullptr;
+            if (SUCCEEDED(m_d3d12Device->CreateSharedHandle(m_copyResourceFence, nullptr, GENERIC_ALL, nullptr, &fenceHandle)))
+            {
+                if (FAILED(m_d3d11Device->OpenSharedFence(fenceHandle, IID_PPV_ARGS(&m_d3d11CopyFence))))
+                {
+                    m_d3d11CopyFence = nullptr;
+                }
+                CloseHandle(fenceHandle);
+            }
+        }
 
-        // Command lists are created in the recording state, but there is nothing
-        // to record yet. The main loop expects it to be closed, so close it now.
-        m_commandList->Close();
+        if (m_copyResourceFence == nullptr)
+            return false;
 
-        m_d3d12Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_copyResourceFence));
         m_copyResourceEventHandle = CreateEvent(nullptr, FALSE, FALSE, nullptr);
         if (m_copyResourceEventHandle == nullptr)
         {
             HRESULT_FROM_WIN32(GetLastError());
+            return false;
         }
+
+        m_copyFence.reset(new D3D12CopyFence(m_copyResourceFence, m_copyResourceEventHandle));
+        m_copyScheduler.reset(new CopySlotScheduler(*m_copyFence, k_BufferedFrameNum));
         return true;
     }
 
-    void D3D12EncoderDevice::InitializeConverter(const int width, const int height)
+    INV12Converter* D3D12EncoderDevice::CreateConverter(const int width, const int height)
     {
-        m_Converter.reset(new RGBToNV12ConverterD3D11(m_d3d11Device,
-                          m_d3d11Context,
-                          width,
-                          height));
+        return new RGBToNV12ConverterD3D11(m_d3d11Device,
+                                           m_d3d11Context,
+                                           width,
+                                           height);
+    }
+
+    INV12Converter* D3D12EncoderDevice::CreateScalingConverter(ITexture2D* const source, const int width, const int height)
+    {
+        // The encode texture is the D3D11 texture shared with the D3D12 resource.
+        return new RGBToNV12ConverterD3D11(m_d3d11Device,
+                                           m_d3d11Context,
+                                           static_cast<ID3D11Texture2D*>(source->GetEncodeTexturePtrV()),
+                                           width,
+                                           height);
     }
 
     bool D3D12EncoderDevice::InitializeMultithreadingSecurity()
@@ -76,8 +119,17 @@ namespace NvencPlugin
 
     void D3D12EncoderDevice::Cleanup()
     {
-        m_commandList->Release();
-        m_commandAllocator->Release();
+        // The allocators can't be released while their copies execute.
+        if (m_copyScheduler)
+        {
+            m_copyScheduler->WaitIdle();
+        }
+        m_copyScheduler.reset();
+        m_copyFence.reset();
+
+        // Smart pointers, clearing the vectors releases them (the device can now be deleted).
+        m_commandLists.clear();
+        m_commandAllocators.clear();
 
         if (m_d3d11Device)
         {
@@ -91,6 +143,12 @@ namespace NvencPlugin
             m_d3d11Context = nullptr;
         }
 
+        if (m_d3d11CopyFence)
+        {
+            m_d3d11CopyFence->Release();
+            m_d3d11CopyFence = nullptr;
+        }
+
         if (m_copyResourceFence)
         {
             m_copyResourceFence->Release();
@@ -124,8 +182,11 @@ namespace NvencPlugin
         return new D3D12Texture2D(width, height, nativeTex, handle, sharedTex, nv12Tex);
     }
 
-    bool D3D12EncoderDevice::ConvertRGBToNV12(IUnknown* nativeSrcD3D12, void* tex2DDest)
+    bool D3D12EncoderDevice::ConvertRGBToNV12(INV12Converter* converter, IUnknown* nativeSrcD3D12, void* tex2DDest)
     {
+        if (converter == nullptr)
+            return false;
+
         // Convert the shared D3D11Texture to another one in the NV12 format.
         auto text2D = static_cast<D3D12Texture2D*>(tex2DDest);
 
@@ -134,7 +195,7 @@ namespace NvencPlugin
 
         auto nativeSrcD3D11 = static_cast<ID3D11Texture2D*>(text2D->GetEncodeTexturePtrV());
         auto nativeDstD3D11 = static_cast<ID3D11Texture2D*>(text2D->GetNV12Texture());
-        return m_Converter->ConvertRGBToNV12(nativeSrcD3D11, nativeDstD3D11);
+        return converter->ConvertRGBToNV12(nativeSrcD3D11, nativeDstD3D11);
     }
 
     bool D3D12EncoderDevice::CopyResource(IUnknown* nativeSrc, void* tex2DDest)
@@ -147,27 +208,38 @@ namespace NvencPlugin
             return false;
         if (nativeSrcRes == nullptr || nativeDestRes == nullptr)
             return false;
+        if (!m_copyScheduler)
+            return false;
+
+        // Only blocks if the slot's previous copy, k_BufferedFrameNum copies ago, is still executing.
+        const auto slot = m_copyScheduler->AcquireSlot();
+        auto& allocator = m_commandAllocators[slot];
+        auto& commandList = m_commandLists[slot];
 
-        m_commandAllocator->Reset();
+        allocator->Reset();
 
-        m_commandList->Reset(m_commandAllocator, nullptr);
-        m_commandList->CopyResource(nativeDestRes, nativeSrcRes);
-        m_commandList->Close();
+        commandList->Reset(allocator, nullptr);
+        commandList->CopyResource(nativeDestRes, nativeSrcRes);
+        commandList->Close();
 
-        ID3D12CommandList* cmdList[] = { m_commandList };
+        ID3D12CommandList* cmdList[] = { commandList };
         m_d3d12CommandQueue->ExecuteCommandLists(_countof(cmdList), cmdList);
 
-        WaitForFence(m_copyResourceFence, m_copyResourceEventHandle, &m_copyResourceFenceValue);
+        const auto fenceValue = m_copyScheduler->Submit(slot);
+        m_d3d12CommandQueue->Signal(m_copyResourceFence, fenceValue);
 
-        return true;
-    }
+        // The conversion and the encode of the destination are submitted to the D3D11 context
+        // after this, so they only wait for this copy.
+        if (m_d3d11CopyFence != nullptr)
+        {
+            m_d3d11Context->Wait(m_d3d11CopyFence, fenceValue);
+        }
+        else
+        {
+            m_copyFence->WaitForValue(fenceValue);
+        }
 
-    void D3D12EncoderDevice::WaitForFence(ID3D12Fence* fence, HANDLE handle, uint64_t* fenceValue)
-    {
-        m_d3d12CommandQueue->Signal(fence, *fenceValue);
-        fence->SetEventOnCompletion(*fenceValue, handle);
-        WaitForSingleObject(handle, INFINITE);
-        ++(*fenceValue);
+        return true;
     }
 
     ID3D12Resource* D3D12EncoderDevice::CreateD3D12Resource(uint32_t width, uint32_t height)
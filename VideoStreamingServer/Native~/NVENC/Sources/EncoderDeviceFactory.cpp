@@ -1,6 +1,124 @@
 #include "EncoderDeviceFactory.h"
+#include "D3D11EncoderDevice.h"
+#include "D3D12EncoderDevice.h"
+#include "PluginUtils.h"
 
 namespace NvencPlugin
 {
+    std::mutex                                     EncoderDeviceFactory::s_Mutex;
+    std::vector<EncoderDeviceFactory::DeviceEntry> EncoderDeviceFactory::s_Devices;
 
+    IGraphicsEncoderDevice* EncoderDeviceFactory::Acquire(IUnknown* const nativeDevice,
+                                                          IUnityGraphicsD3D11* const unityGraphicsD3D11,
+                                                          IUnityGraphicsD3D12v5* const unityGraphicsD3D12)
+    {
+        if (nativeDevice == nullptr)
+            return nullptr;
+
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        for (auto& entry : s_Devices)
+        {
+            if (entry.nativeDevice == nativeDevice)
+            {
+                ++entry.refCount;
+                return entry.device;
+            }
+        }
+
+        IGraphicsEncoderDevice* device = nullptr;
+        if (unityGraphicsD3D11)
+        {
+            device = new D3D11EncoderDevice(static_cast<ID3D11Device*>(nativeDevice));
+            WriteFileDebug("D3D11 encoder device succesfully created.\n");
+        }
+        else if (unityGraphicsD3D12)
+        {
+            device = new D3D12EncoderDevice(static_cast<ID3D12Device*>(nativeDevice), unityGraphicsD3D12);
+            WriteFileDebug("D3D12 encoder device succesfully created.\n");
+        }
+        else
+        {
+            WriteFileDebug(LogLevel::Error, "Error, graphics API failed to create an Encoder device.\n");
+            return nullptr;
+        }
+
+        if (!device->Initialize())
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Failed to Initialize Graphics encoder device.\n");
+            delete device;
+            return nullptr;
+        }
+
+        s_Devices.push_back({ nativeDevice, device, 1 });
+        return device;
+    }
+
+    void EncoderDeviceFactory::Retain(IGraphicsEncoderDevice* const device)
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        for (auto& entry : s_Devices)
+        {
+            if (entry.device == device)
+            {
+                ++entry.refCount;
+                return;
+            }
+        }
+    }
+
+    void EncoderDeviceFactory::Release(IGraphicsEncoderDevice* const device)
+    {
+        if (device == nullptr)
+            return;
+
+        IGraphicsEncoderDevice* unused = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(s_Mutex);
+
+            for (auto it = s_Devices.begin(); it != s_Devices.end(); ++it)
+            {
+                if (it->device == device)
+                {
+                    if (--it->refCount == 0)
+                    {
+                        unused = it->device;
+                        s_Devices.erase(it);
+                    }
+                    break;
+                }
+            }
+        }
+
+        if (unused != nullptr)
+        {
+            DestroyDevice(unused);
+        }
+    }
+
+    void EncoderDeviceFactory::ReleaseAll()
+    {
+        std::vector<DeviceEntry> devices;
+        {
+            std::lock_guard<std::mutex> lock(s_Mutex);
+            devices.swap(s_Devices);
+        }
+
+        for (auto& entry : devices)
+        {
+            if (entry.refCount > 0)
+            {
+                WriteFileDebug(LogLevel::Warning, "Warning, encoder device destroyed while still in use: ", entry.refCount);
+            }
+            DestroyDevice(entry.device);
+        }
+    }
+
+    void EncoderDeviceFactory::DestroyDevice(IGraphicsEncoderDevice* const device)
+    {
+        WriteFileDebug("Info, destroying graphics encoder device.\n");
+        device->Cleanup();
+        delete device;
+    }
 }
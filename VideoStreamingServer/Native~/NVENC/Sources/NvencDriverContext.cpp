@@ -0,0 +1,296 @@
+#include "NvencDriverContext.h"
+#include "PluginUtils.h"
+
+// Disable the 'unscoped enum' Nvenc warnings
+#pragma warning(disable : 26812)
+
+namespace NvencPlugin
+{
+    std::mutex          NvencDriverContext::s_Mutex;
+    NvencDriverContext* NvencDriverContext::s_Instance = nullptr;
+    int                 NvencDriverContext::s_RefCount = 0;
+
+    // Only a supported driver is cached: a missing or outdated one may be updated while the editor runs.
+    static bool s_SupportQueried = false;
+
+#pragma region Lifetime
+    NvencDriverContext* NvencDriverContext::Acquire()
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        if (s_Instance == nullptr)
+        {
+            s_Instance = new NvencDriverContext();
+        }
+
+        // A previous load may have failed (e.g. driver installed while the editor was running).
+        if (s_Instance->m_Status != ENvencStatus::Success)
+        {
+            s_Instance->m_Status = s_Instance->Load();
+        }
+
+        ++s_RefCount;
+        return s_Instance;
+    }
+
+    void NvencDriverContext::Release()
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        if (s_RefCount > 0)
+        {
+            --s_RefCount;
+        }
+    }
+
+    void NvencDriverContext::UnloadIfUnused()
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        if (s_Instance == nullptr || s_RefCount > 0)
+            return;
+
+        WriteFileDebug("Info, unloading the NVENC driver module.\n");
+
+        delete s_Instance;
+        s_Instance = nullptr;
+        s_SupportQueried = false;
+    }
+
+    ENvencSupport NvencDriverContext::QuerySupport()
+    {
+        std::lock_guard<std::mutex> lock(s_Mutex);
+
+        if (s_Instance != nullptr && s_Instance->m_Status == ENvencStatus::Success)
+            return ENvencSupport::Supported;
+
+        if (s_SupportQueried)
+            return ENvencSupport::Supported;
+
+        auto module = LoadModule();
+
+        if (module == nullptr)
+            return ENvencSupport::NoDriver;
+
+        const auto support = CheckDriverVersion(module)
+            ? ENvencSupport::Supported
+            : ENvencSupport::DriverVersionNotSupported;
+
+        FreeModule(module);
+
+        s_SupportQueried = support == ENvencSupport::Supported;
+        return support;
+    }
+
+    NvencDriverContext::NvencDriverContext() :
+        m_HModule(nullptr),
+        m_Nvenc{ NV_ENCODE_API_FUNCTION_LIST_VER },
+        m_Status(ENvencStatus::NotInitialized)
+    {
+    }
+
+    NvencDriverContext::~NvencDriverContext()
+    {
+        Unload();
+    }
+
+    ENvencStatus NvencDriverContext::Load()
+    {
+        WriteFileDebug("Start to call: NvencDriverContext::Load\n");
+
+        if (m_HModule == nullptr)
+        {
+            m_HModule = LoadModule();
+        }
+
+        if (m_HModule == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, DriverNotInstalled in NVENC library\n");
+            return ENvencStatus::DriverNotInstalled;
+        }
+
+        if (!CheckDriverVersion(m_HModule))
+        {
+            WriteFileDebug(LogLevel::Error, "Error, DriverVersionDoesNotSupportAPI in NVENC library\n");
+            Unload();
+            return ENvencStatus::DriverVersionDoesNotSupportAPI;
+        }
+
+#if defined(_WIN32)
+        auto NvEncodeAPICreateInstance =
+            (NvEncodeAPICreateInstance_Type)GetProcAddress(m_HModule, "NvEncodeAPICreateInstance");
+#else
+        auto NvEncodeAPICreateInstance =
+            (NvEncodeAPICreateInstance_Type)dlsym(m_HModule, "NvEncodeAPICreateInstance");
+#endif
+
+        if (!NvEncodeAPICreateInstance)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, APINotFound (NvEncodeAPICreateInstance) in NVENC library\n");
+            Unload();
+            return ENvencStatus::APINotFound;
+        }
+
+        m_Nvenc = { NV_ENCODE_API_FUNCTION_LIST_VER };
+        if (NvEncodeAPICreateInstance(&m_Nvenc) != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, APINotFound (NvEncodeAPICreateInstance) in Nvenc.\n");
+            Unload();
+            return ENvencStatus::APINotFound;
+        }
+
+        WriteFileDebug("End to call: NvencDriverContext::Load\n");
+
+        return ENvencStatus::Success;
+    }
+
+    void NvencDriverContext::Unload()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_CacheMutex);
+            m_CodecCaps.clear();
+            m_Presets.clear();
+        }
+
+        m_Nvenc = { NV_ENCODE_API_FUNCTION_LIST_VER };
+        m_Status = ENvencStatus::NotInitialized;
+
+        if (m_HModule != nullptr)
+        {
+            FreeModule(m_HModule);
+            m_HModule = nullptr;
+        }
+    }
+#pragma endregion
+
+#pragma region Module
+    HMODULE NvencDriverContext::LoadModule()
+    {
+#if defined(_WIN32)
+#if defined(_WIN64)
+        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
+#else
+        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI.dll"));
+#endif
+#else
+        void* module = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
+#endif
+
+        return module;
+    }
+
+    void NvencDriverContext::FreeModule(HMODULE module)
+    {
+#if defined(_WIN32)
+        FreeLibrary(module);
+#else
+        dlclose(module);
+#endif
+    }
+
+    bool NvencDriverContext::CheckDriverVersion(HMODULE module)
+    {
+#if defined(_WIN32)
+        auto NvEncodeAPIGetMaxSupportedVersion =
+            (NvEncodeAPIGetMaxSupportedVersion_Type)GetProcAddress(module, "NvEncodeAPIGetMaxSupportedVersion");
+#else
+        auto NvEncodeAPIGetMaxSupportedVersion =
+            (NvEncodeAPIGetMaxSupportedVersion_Type)dlsym(module, "NvEncodeAPIGetMaxSupportedVersion");
+#endif
+        if (!NvEncodeAPIGetMaxSupportedVersion)
+            return false;
+
+        uint32_t version = 0;
+        uint32_t currentVersion = (NVENCAPI_MAJOR_VERSION << 4) | NVENCAPI_MINOR_VERSION;
+        NvEncodeAPIGetMaxSupportedVersion(&version);
+        return (currentVersion > version) ? false : true;
+    }
+#pragma endregion
+
+#pragma region Caches
+    int NvencDriverContext::QueryCap(void* encoder, const GUID& codecGuid, NV_ENC_CAPS cap) const
+    {
+        NV_ENC_CAPS_PARAM capsParam = { 0 };
+        capsParam.version = NV_ENC_CAPS_PARAM_VER;
+        capsParam.capsToQuery = cap;
+
+        int value = 0;
+        if (m_Nvenc.nvEncGetEncodeCaps(encoder, codecGuid, &capsParam, &value) != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Failed to get NVEncoder capability: ", static_cast<int>(cap));
+            return 0;
+        }
+        return value;
+    }
+
+    bool NvencDriverContext::GetCodecCaps(const void* device, void* encoder, const GUID& codecGuid, NvencCodecCaps& caps)
+    {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+
+        for (const auto& entry : m_CodecCaps)
+        {
+            if (entry.device == device && entry.codecGuid == codecGuid)
+            {
+                caps = entry.caps;
+                return true;
+            }
+        }
+
+        if (encoder == nullptr || !m_Nvenc.nvEncGetEncodeCaps)
+            return false;
+
+        CodecCapsEntry entry;
+        entry.device = device;
+        entry.codecGuid = codecGuid;
+        entry.caps.asyncEncode = QueryCap(encoder, codecGuid, NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT) == 1;
+        entry.caps.widthMax = QueryCap(encoder, codecGuid, NV_ENC_CAPS_WIDTH_MAX);
+        entry.caps.heightMax = QueryCap(encoder, codecGuid, NV_ENC_CAPS_HEIGHT_MAX);
+        entry.caps.intraRefresh = QueryCap(encoder, codecGuid, NV_ENC_CAPS_SUPPORT_INTRA_REFRESH) == 1;
+        entry.caps.numMaxBFrames = QueryCap(encoder, codecGuid, NV_ENC_CAPS_NUM_MAX_BFRAMES);
+
+        m_CodecCaps.push_back(entry);
+        caps = entry.caps;
+
+        WriteFileDebug("Info, cached NVENC codec capabilities.\n");
+        return true;
+    }
+
+    bool NvencDriverContext::GetPresetConfig(const void* device,
+                                             void* encoder,
+                                             const GUID& codecGuid,
+                                             const GUID& presetGuid,
+                                             NV_ENC_PRESET_CONFIG& presetConfig)
+    {
+        std::lock_guard<std::mutex> lock(m_CacheMutex);
+
+        for (const auto& entry : m_Presets)
+        {
+            if (entry.device == device && entry.codecGuid == codecGuid && entry.presetGuid == presetGuid)
+            {
+                presetConfig = entry.presetConfig;
+                return true;
+            }
+        }
+
+        if (encoder == nullptr || !m_Nvenc.nvEncGetEncodePresetConfig)
+            return false;
+
+        PresetEntry entry;
+        entry.device = device;
+        entry.codecGuid = codecGuid;
+        entry.presetGuid = presetGuid;
+        entry.presetConfig = { NV_ENC_PRESET_CONFIG_VER, { NV_ENC_CONFIG_VER } };
+
+        const auto errorCode = m_Nvenc.nvEncGetEncodePresetConfig(encoder, codecGuid, presetGuid, &entry.presetConfig);
+        if (errorCode != NV_ENC_SUCCESS)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Failed to select NVEncoder preset config: ", errorCode);
+            return false;
+        }
+
+        m_Presets.push_back(entry);
+        presetConfig = entry.presetConfig;
+        return true;
+    }
+#pragma endregion
+}
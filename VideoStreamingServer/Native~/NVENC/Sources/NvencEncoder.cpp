@@ -2,6 +2,8 @@
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "NvencEncoder.h"
 #include "windows.h"
@@ -9,7 +11,8 @@
 #include "PluginUtils.h"
 #include "D3D11EncoderDevice.h"
 
-#include "Unity/IUnityProfiler.h"
+#include "EncoderProfiler.h"
+#include "TraceRecorder.h"
 
 // Disable the 'unscoped enum' Nvenc warnings
 #pragma warning(disable : 26812)
@@ -20,104 +23,76 @@ namespace NvencPlugin
 
     ENvencSupport NvEncoder::IsEncoderAvailable()
     {
-        auto module = LoadModule();
+        return NvencDriverContext::QuerySupport();
+    }
 
-        if (module == nullptr)
-        {
-            return ENvencSupport::NoDriver;
-        }
-        else if (!CheckDriverVersion(module))
-        {
-            return ENvencSupport::DriverVersionNotSupported;
-        }
+    NvencSessionKey NvEncoder::MakeSessionRequest(IGraphicsEncoderDevice* device,
+                                                  const NvencEncoderSessionData& settings,
+                                                  bool forceNv12,
+                                                  int sliceCount,
+                                                  const EncoderBufferingSettings& buffering)
+    {
+        NvencSessionKey request;
+        request.device = device;
+        request.codec = NV_ENC_CODEC_H264_GUID;
+        request.format = (forceNv12) ? NV_ENC_BUFFER_FORMAT_NV12 : NV_ENC_BUFFER_FORMAT_ARGB;
+        request.maxWidth = settings.width;
+        request.maxHeight = settings.height;
+        request.width = settings.width;
+        request.height = settings.height;
+        request.sliceCount = sliceCount;
+        request.inFlightDepth = buffering.inFlightDepth;
+        return request;
+    }
+
+    int NvencSessionKey::Match(const NvencSessionKey& request) const
+    {
+        if (device != request.device || codec != request.codec || format != request.format ||
+            sliceCount != request.sliceCount || inFlightDepth != request.inFlightDepth)
+            return -1;
 
-        return ENvencSupport::Supported;
+        if (request.width > maxWidth || request.height > maxHeight)
+            return -1;
+
+        return (request.width == width && request.height == height) ? 1 : 0;
     }
 
     ENvencStatus NvEncoder::LoadCodec()
     {
         WriteFileDebug("Start to call: LoadCodec\n");
 
-        m_Nvenc = { NV_ENCODE_API_FUNCTION_LIST_VER };
-
-        auto module = LoadModule();
-        if (module == nullptr)
+        if (m_Driver == nullptr)
         {
-            WriteFileDebug("Error, DriverNotInstalled in NVENC library\n");
-            return ENvencStatus::DriverNotInstalled;
+            m_Driver = NvencDriverContext::Acquire();
         }
-        m_HModule = module;
 
-        if (!CheckDriverVersion(module))
+        const auto status = m_Driver->GetStatus();
+        if (status != ENvencStatus::Success)
         {
-            WriteFileDebug("Error, DriverVersionDoesNotSupportAPI in NVENC library\n");
-            return ENvencStatus::DriverVersionDoesNotSupportAPI;
+            WriteFileDebug(LogLevel::Error, "Error, NVENC driver context failed to load.\n");
+            ReleaseCodec();
+            return status;
         }
 
-#if defined(_WIN32)
-        auto NvEncodeAPICreateInstance =
-            (NvEncodeAPICreateInstance_Type)GetProcAddress((HMODULE)m_HModule, "NvEncodeAPICreateInstance");
-#else
-        auto NvEncodeAPICreateInstance =
-            (NvEncodeAPICreateInstance_Type)dlsym(s_HModule, "NvEncodeAPICreateInstance");
-#endif
-
-        if (!NvEncodeAPICreateInstance)
-        {
-            WriteFileDebug("Error, APINotFound (NvEncodeAPICreateInstance) in NVENC library\n");
-            return ENvencStatus::APINotFound;
-        }
-
-        if (NvEncodeAPICreateInstance(&m_Nvenc) != NV_ENC_SUCCESS)
-        {
-            WriteFileDebug("Error, APINotFound (NvEncodeAPICreateInstance) in Nvenc.\n");
-            return ENvencStatus::APINotFound;
-        }
+        // The function list is loaded once per process, copying it is cheap.
+        m_Nvenc = m_Driver->GetFunctionList();
 
         WriteFileDebug("End to call: LoadCodec\n");
 
         return ENvencStatus::Success;
     }
-
-    bool NvEncoder::CheckDriverVersion(HMODULE module)
-    {
-        using NvEncodeAPIGetMaxSupportedVersion_Type = NVENCSTATUS(NVENCAPI*)(uint32_t*);
-#if defined(_WIN32)
-        auto NvEncodeAPIGetMaxSupportedVersion =
-            (NvEncodeAPIGetMaxSupportedVersion_Type)GetProcAddress(module, "NvEncodeAPIGetMaxSupportedVersion");
-#else
-        auto NvEncodeAPIGetMaxSupportedVersion =
-            (NvEncodeAPIGetMaxSupportedVersion_Type)dlsym(s_HModule, "NvEncodeAPIGetMaxSupportedVersion");
-#endif
-        uint32_t version = 0;
-        uint32_t currentVersion = (NVENCAPI_MAJOR_VERSION << 4) | NVENCAPI_MINOR_VERSION;
-        NvEncodeAPIGetMaxSupportedVersion(&version);
-        return (currentVersion > version) ? false : true;
-    }
-
-    HMODULE NvEncoder::LoadModule()
-    {
-#if defined(_WIN32)
-#if defined(_WIN64)
-        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI64.dll"));
-#else
-        HMODULE module = LoadLibrary(TEXT("nvEncodeAPI.dll"));
-#endif
-#else
-        void* module = dlopen("libnvidia-encode.so.1", RTLD_LAZY);
-#endif
-
-        return module;
-    }
 #pragma endregion
 
 #pragma region Constructor & Initialize
     NvEncoder::NvEncoder(const NV_ENC_DEVICE_TYPE deviceType,
         const NvencEncoderSessionData& other,
         IGraphicsEncoderDevice* device,
-        bool forceNv12) :
+        bool forceNv12,
+        int sliceCount,
+        const EncoderBufferingSettings& buffering) :
         m_Device(device),
-        m_HModule(nullptr),
+        m_SimulcastInput(nullptr),
+        m_Driver(nullptr),
         m_HEncoder(nullptr),
         m_InitializationResult(ENvencStatus::NotInitialized),
         m_IsIdrFrame(false),
@@ -127,11 +102,23 @@ namespace NvencPlugin
         m_FrameCount(0),
         m_GOPCount(0),
         m_ForceNV12(forceNv12),
+        m_SliceCount(sliceCount),
+        m_RequestedBuffering(buffering),
+        m_Buffering(),
+        m_BufferedFrameCount(k_BufferedFrameNum),
+        m_FrameQueue(m_Stats),
+        m_LastRecordingStats(),
         m_Thread(nullptr),
+        m_IsThreadRunning(false),
         m_IsAsync(false)
     {
         WriteFileDebug("--- Initialize NvEncoder ---\n", false);
 
+        if (m_SliceCount > k_MaxSliceCount)
+        {
+            m_SliceCount = k_MaxSliceCount;
+        }
+
         for (auto& renderTexture : m_RenderTextures)
         {
             renderTexture = nullptr;
@@ -149,20 +136,20 @@ namespace NvencPlugin
 
         if (m_InitializationResult != ENvencStatus::Success)
         {
-            WriteFileDebug("Nvec failed to initialize (LoadCodec).\n");
+            WriteFileDebug(LogLevel::Error, "Nvec failed to initialize (LoadCodec).\n");
             return m_InitializationResult;
         }
 
         auto device = m_Device->GetDevice();
         if (device == nullptr)
         {
-            WriteFileDebug("Error, graphics device is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, graphics device is null.\n");
             return ENvencStatus::NotInitialized;
         }
 
         if (!m_Nvenc.nvEncOpenEncodeSession)
         {
-            WriteFileDebug("Error, EncodeAPI not found.\n");
+            WriteFileDebug(LogLevel::Error, "Error, EncodeAPI not found.\n");
         }
 
         NV_ENC_OPEN_ENCODE_SESSION_EX_PARAMS openEncodeSessionExParams = { 0 };
@@ -174,14 +161,13 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncOpenEncodeSessionEx(&openEncodeSessionExParams, &m_HEncoder);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, nvEncOpenEncodeSessionEx failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error, nvEncOpenEncodeSessionEx failed.\n");
             m_InitializationResult = ENvencStatus::EncoderInitializationFailed;
             return m_InitializationResult;
         }
 
         SetEncoderParameters();
-
-        m_Device->InitializeConverter(m_FrameData.width, m_FrameData.height);
+        InitializeConverter();
 
         WriteFileDebug("End to call: InitEncoder\n");
         m_InitializationResult = ENvencStatus::Success;
@@ -199,7 +185,7 @@ namespace NvencPlugin
         if (m_FrameData.width > k_MaxWidth || m_FrameData.height > k_MaxHeight ||
             m_FrameData.width < 0 || m_FrameData.height < 0)
         {
-            WriteFileDebug("Error, size is invalid.\n");
+            WriteFileDebug(LogLevel::Error, "Error, size is invalid.\n");
         }
 
         // Set initialization parameters
@@ -214,25 +200,32 @@ namespace NvencPlugin
         m_NvEncInitializeParams.frameRateNum = m_FrameData.frameRate;
         m_NvEncInitializeParams.frameRateDen = 1;
         m_NvEncInitializeParams.enablePTD = 1;
-        m_NvEncInitializeParams.reportSliceOffsets = 0;
-        m_NvEncInitializeParams.enableSubFrameWrite = 0;
+        // Sub-frame output: the bitstream is written slice by slice and can be read while the
+        // rest of the frame is still encoding (polled with nvEncLockBitstream doNotWait).
+        m_NvEncInitializeParams.reportSliceOffsets = IsSubFrameOutputEnabled() ? 1 : 0;
+        m_NvEncInitializeParams.enableSubFrameWrite = IsSubFrameOutputEnabled() ? 1 : 0;
         m_NvEncInitializeParams.maxEncodeWidth = 3840;
         m_NvEncInitializeParams.maxEncodeHeight = 2160;
 
-        // Get encoder capability
-        NV_ENC_CAPS_PARAM capsParam = { 0 };
-        capsParam.version = NV_ENC_CAPS_PARAM_VER;
-        capsParam.capsToQuery = NV_ENC_CAPS_ASYNC_ENCODE_SUPPORT;
-        signed int asyncMode = 0;
-        auto errorCode = m_Nvenc.nvEncGetEncodeCaps(m_HEncoder,
-                                                    m_NvEncInitializeParams.encodeGUID,
-                                                    &capsParam,
-                                                    &asyncMode);
-        if (errorCode != NV_ENC_SUCCESS)
+        // Get encoder capability (cached per device and codec by the driver context).
+        NvencCodecCaps caps;
+        if (!m_Driver->GetCodecCaps(m_Device->GetDevice(), m_HEncoder, m_NvEncInitializeParams.encodeGUID, caps))
         {
-            WriteFileDebug("Error, Failed to get NVEncoder capability params.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Failed to get NVEncoder capability params.\n");
         }
 
+        if (caps.widthMax > 0 && caps.heightMax > 0)
+        {
+            m_NvEncInitializeParams.maxEncodeWidth = (std::min)(m_NvEncInitializeParams.maxEncodeWidth, static_cast<uint32_t>(caps.widthMax));
+            m_NvEncInitializeParams.maxEncodeHeight = (std::min)(m_NvEncInitializeParams.maxEncodeHeight, static_cast<uint32_t>(caps.heightMax));
+
+            if (m_FrameData.width > caps.widthMax || m_FrameData.height > caps.heightMax)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, size is not supported by the device.\n");
+            }
+        }
+
+        const signed int asyncMode = caps.asyncEncode ? 1 : 0;
         if (asyncMode == 1)
         {
             m_IsAsync = m_Device->InitializeMultithreadingSecurity() && std::thread::hardware_concurrency() > 0;
@@ -242,27 +235,28 @@ namespace NvencPlugin
             {
                 WriteFileDebug("Info, AsyncMode is enabled.\n");
                 // The second thread is used to retrieve the data when async mode is available.
-                m_Thread = new NvThread(std::thread(ProcessEncodedFrameAsyncSingle, this));
+                StartAsyncThread();
             }
             else
                 WriteFileDebug("Info, AsyncMode is disabled.\n");
         }
         else
-            WriteFileDebug("Error, AsyncMode is disabled.\n");
+            WriteFileDebug(LogLevel::Error, "Error, AsyncMode is disabled.\n");
+
+        ConfigureBuffering(m_RequestedBuffering);
 
         m_NvEncInitializeParams.encodeConfig = &m_NvEncConfig;
 
         // Get and set preset config
         NV_ENC_PRESET_CONFIG presetConfig = { NV_ENC_PRESET_CONFIG_VER, { NV_ENC_CONFIG_VER } };
 
-        errorCode = m_Nvenc.nvEncGetEncodePresetConfig(m_HEncoder,
-            m_NvEncInitializeParams.encodeGUID,
-            m_NvEncInitializeParams.presetGUID,
-            &presetConfig);
-
-        if (errorCode != NV_ENC_SUCCESS)
+        if (!m_Driver->GetPresetConfig(m_Device->GetDevice(),
+                                       m_HEncoder,
+                                       m_NvEncInitializeParams.encodeGUID,
+                                       m_NvEncInitializeParams.presetGUID,
+                                       presetConfig))
         {
-            WriteFileDebug("Error, Failed to select NVEncoder preset config.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Failed to select NVEncoder preset config.\n");
         }
 
         std::memcpy(&m_NvEncConfig, &presetConfig.presetCfg, sizeof(NV_ENC_CONFIG));
@@ -271,8 +265,10 @@ namespace NvencPlugin
         m_NvEncConfig.gopLength = NVENC_INFINITE_GOPLENGTH;
 
         m_NvEncConfig.encodeCodecConfig.h264Config.idrPeriod = m_NvEncConfig.gopLength;
-        m_NvEncConfig.encodeCodecConfig.h264Config.sliceMode = 0;
-        m_NvEncConfig.encodeCodecConfig.h264Config.sliceModeData = 0;
+        // Slice mode 3: sliceModeData is the number of slices per picture.
+        m_NvEncConfig.encodeCodecConfig.h264Config.sliceMode = IsSubFrameOutputEnabled() ? 3 : 0;
+        m_NvEncConfig.encodeCodecConfig.h264Config.sliceModeData = IsSubFrameOutputEnabled() ? m_SliceCount : 0;
+        m_SliceOffsets.assign(IsSubFrameOutputEnabled() ? m_SliceCount : 0, 0);
         m_NvEncConfig.encodeCodecConfig.h264Config.disableSPSPPS = 1;
         m_NvEncConfig.encodeCodecConfig.h264Config.repeatSPSPPS = 1;
         m_NvEncConfig.encodeCodecConfig.h264Config.enableIntraRefresh = 1;
@@ -303,15 +299,15 @@ namespace NvencPlugin
         m_NvEncConfig.rcParams.vbvInitialDelay = m_NvEncConfig.rcParams.vbvBufferSize;
 
         // Initialize hardware encoder session
-        errorCode = m_Nvenc.nvEncInitializeEncoder(m_HEncoder, &m_NvEncInitializeParams);
+        const auto errorCode = m_Nvenc.nvEncInitializeEncoder(m_HEncoder, &m_NvEncInitializeParams);
 
         if (errorCode != NV_ENC_SUCCESS)
         {
             std::ostringstream errorLog;
-            WriteFileDebug("Error, Failed to initialize NVEncoder.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Failed to initialize NVEncoder.\n");
             errorLog << "Error is: " << errorCode << "\n";
             auto test = errorLog.str();
-            WriteFileDebug(test.c_str());
+            WriteFileDebug(LogLevel::Error, test.c_str());
             return;
         }
         else
@@ -327,9 +323,28 @@ namespace NvencPlugin
         InitEncoderResources();
     }
 
+    void NvEncoder::ConfigureBuffering(const EncoderBufferingSettings& requested)
+    {
+        // NVENC has no cap for the number of frames in flight, but without async mode each frame
+        // is read back right after it is submitted: more input buffers would only use memory.
+        const auto maxInFlightDepth = (m_IsAsync) ? static_cast<int32_t>(k_MaxBufferedFrameNum) : 1;
+
+        m_Buffering = LiveCaptureNative::ValidateBufferingSettings(requested,
+                                                                   k_BufferedFrameNum,
+                                                                   maxInFlightDepth,
+                                                                   k_DefaultQueueLength);
+        m_BufferedFrameCount = static_cast<uint32_t>(m_Buffering.inFlightDepth);
+        m_FrameQueue.Configure(m_Buffering);
+        m_Stats.SetBuffering(m_Buffering);
+
+        WriteFileDebug("Info, in-flight depth: ", m_Buffering.inFlightDepth);
+        WriteFileDebug("Info, output queue length: ", m_Buffering.outputQueueLength);
+        WriteFileDebug("Info, backpressure policy: ", m_Buffering.policy);
+    }
+
     void NvEncoder::InitializeAsyncResources()
     {
-        m_vpCompletionEvent.resize(k_BufferedFrameNum, nullptr);
+        m_vpCompletionEvent.resize(m_BufferedFrameCount, nullptr);
 
         for (uint32_t i = 0; i < m_vpCompletionEvent.size(); i++)
         {
@@ -342,7 +357,7 @@ namespace NvencPlugin
 
     void NvEncoder::InitEncoderResources()
     {
-        for (auto i = 0; i < k_BufferedFrameNum; i++)
+        for (uint32_t i = 0; i < m_BufferedFrameCount; i++)
         {
             m_RenderTextures[i] = m_Device->CreateDefaultTexture(m_FrameData.width, m_FrameData.height, m_ForceNV12);
 
@@ -373,7 +388,7 @@ namespace NvencPlugin
 
         if (!registerResource.resourceToRegister)
         {
-            WriteFileDebug("Error, ResourceToRegister: resource is not initialized.\n");
+            WriteFileDebug(LogLevel::Error, "Error, ResourceToRegister: resource is not initialized.\n");
         }
         registerResource.width = m_FrameData.width;
         registerResource.height = m_FrameData.height;
@@ -383,7 +398,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncRegisterResource(m_HEncoder, &registerResource);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, Error on register resource: nvEncRegisterResource.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Error on register resource: nvEncRegisterResource.\n");
         }
         return registerResource.registeredResource;
     }
@@ -396,11 +411,21 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncCreateBitstreamBuffer(m_HEncoder, &createBitstreamBuffer);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, Error on creation: nvEncCreateBitstreamBuffer.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Error on creation: nvEncCreateBitstreamBuffer.\n");
         }
         return createBitstreamBuffer.bitstreamBuffer;
     }
 
+    void NvEncoder::InitializeConverter()
+    {
+        // Only the NV12 path needs the video processor.
+        if (m_ForceNV12)
+        {
+            m_Converter.reset(m_Device->CreateConverter(m_FrameData.width, m_FrameData.height));
+        }
+        m_SimulcastInput = nullptr;
+    }
+
     void NvEncoder::MapResources(InputFrame& inputFrame)
     {
         NV_ENC_MAP_INPUT_RESOURCE mapInputResource = { 0 };
@@ -410,7 +435,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncMapInputResource(m_HEncoder, &mapInputResource);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error on creation: nvEncCreateBitstreamBuffer.\n");
+            WriteFileDebug(LogLevel::Error, "Error on creation: nvEncCreateBitstreamBuffer.\n");
         }
         inputFrame.mappedResource = mapInputResource.mappedResource;
     }
@@ -476,7 +501,7 @@ namespace NvencPlugin
             const auto result = m_Nvenc.nvEncReconfigureEncoder(m_HEncoder, &nvEncReconfigureParams);
             if (result != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Failed to reconfigure encoder setting.\n");
+                WriteFileDebug(LogLevel::Error, "Failed to reconfigure encoder setting.\n");
             }
 
             // Reconfigure the Textures size (width & height).
@@ -484,8 +509,7 @@ namespace NvencPlugin
             {
                 ReleaseEncoderResources();
                 InitEncoderResources();
-
-                m_Device->InitializeConverter(m_FrameData.width, m_FrameData.height);
+                InitializeConverter();
 
                 WriteFileDebug("New Width: ", m_FrameData.width);
                 WriteFileDebug("New Height: ", m_FrameData.height);
@@ -496,18 +520,43 @@ namespace NvencPlugin
 
     void* NvEncoder::GetCompletionEvent(uint32_t eventIdx)
     {
-        return (m_vpCompletionEvent.size() == k_BufferedFrameNum)
+        return (eventIdx < m_vpCompletionEvent.size())
             ? m_vpCompletionEvent[eventIdx]
             : nullptr;
     }
 
+    bool NvEncoder::AcquireInputSlot(int frameIndex)
+    {
+        const auto& frame = m_BufferedFrames[frameIndex];
+        if (!frame.isEncoding)
+            return true;
+
+        // Every input buffer is in flight, the encoder is behind. The hardware work can't be
+        // cancelled, so only Block waits for the buffer, the other policies drop the new frame
+        // (it was never submitted, the stream stays decodable).
+        if (m_Buffering.policy == static_cast<int32_t>(LiveCaptureNative::BackpressurePolicy::Block))
+        {
+            const auto waitStart = LiveCaptureNative::GetEncodeClockNs();
+            const auto isFree = LiveCaptureNative::WaitUntil([&frame]() { return !frame.isEncoding; },
+                                                             LiveCaptureNative::k_BackpressureTimeoutNs);
+            m_Stats.RecordBlocked(LiveCaptureNative::GetEncodeClockNs() - waitStart);
+
+            if (isFree)
+                return true;
+        }
+
+        WriteFileDebug(LogLevel::Warning, "Warning, no free input buffer, frame dropped.\n");
+        m_Stats.RecordInputDropped();
+        return false;
+    }
+
     bool NvEncoder::CopyBufferResources(int frameIndex, void* frameSourceData)
     {
         const auto destTexture = m_RenderTextures[frameIndex];
 
         if (!destTexture || !frameSourceData)
         {
-            WriteFileDebug("Error, incorrect input texture(s).\n");
+            WriteFileDebug(LogLevel::Error, "Error, incorrect input texture(s).\n");
             return false;
         }
 
@@ -515,52 +564,125 @@ namespace NvencPlugin
 
         if (!destTexture || !nativeSrc)
         {
-            WriteFileDebug("Error, invalid IUnknown resource(s).\n");
+            WriteFileDebug(LogLevel::Error, "Error, invalid IUnknown resource(s).\n");
             return false;
         }
 
+        const auto copyStart = LiveCaptureNative::GetEncodeClockNs();
+
         if (m_ForceNV12)
         {
-            if (!m_Device->ConvertRGBToNV12(nativeSrc, destTexture))
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Convert);
+
+            if (!m_Device->ConvertRGBToNV12(m_Converter.get(), nativeSrc, destTexture))
             {
-                WriteFileDebug("Error, Conversion from RGB to NV12 failed.\n");
+                WriteFileDebug(LogLevel::Error, "Error, Conversion from RGB to NV12 failed.\n");
             }
         }
         else
         {
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Copy);
+
             if (!m_Device->CopyResource(nativeSrc, destTexture))
             {
-                WriteFileDebug("Error, Couldn't copy resources.\n");
+                WriteFileDebug(LogLevel::Error, "Error, Couldn't copy resources.\n");
                 return false;
             }
 
         }
+
+        m_Stats.RecordCopy(LiveCaptureNative::GetEncodeClockNs() - copyStart);
         return true;
     }
 
-    void NvEncoder::EncodeFrame(void* frameSourceData, unsigned long long int timeStamp)
+    void NvEncoder::EncodeFrame(void* frameSourceData,
+                                unsigned long long int timeStamp,
+                                const LiveCaptureNative::FrameTimecode& timecode)
     {
         if (frameSourceData == nullptr)
         {
-            WriteFileDebug("Error, Encoded frame data is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Encoded frame data is null.\n");
             return;
         }
 
-        const int frameIndex = m_FrameCount % k_BufferedFrameNum;
+        // The converter was last bound to a simulcast source, go back to a converter owning its input.
+        if (m_SimulcastInput != nullptr)
+        {
+            InitializeConverter();
+        }
+
+        const int frameIndex = m_FrameCount % m_BufferedFrameCount;
+
+        // Before the copy, the buffer may still be read by the encoder.
+        if (!AcquireInputSlot(frameIndex))
+            return;
+
+        {
+            LiveCaptureNative::TraceScope traceScope("Encoder.Copy", timeStamp);
+
+            if (!CopyBufferResources(frameIndex, frameSourceData))
+            {
+                WriteFileDebug(LogLevel::Error, "Error, copy resources failed.\n");
+                return;
+            }
+        }
 
-        if (!CopyBufferResources(frameIndex, frameSourceData))
+        SubmitFrame(frameIndex, timeStamp, timecode);
+    }
+
+    void NvEncoder::EncodeScaledFrame(ITexture2D* source,
+                                      unsigned long long int timeStamp,
+                                      const LiveCaptureNative::FrameTimecode& timecode)
+    {
+        if (source == nullptr || !m_ForceNV12)
         {
-            WriteFileDebug("Error, copy resources failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error, simulcast layers must use the NV12 conversion path.\n");
             return;
         }
 
+        // The converter holds a reference on its input, so the pointer can't be recycled while bound.
+        auto input = source->GetEncodeTexturePtrV();
+        if (m_Converter == nullptr || m_SimulcastInput != input)
+        {
+            m_Converter.reset(m_Device->CreateScalingConverter(source, m_FrameData.width, m_FrameData.height));
+            m_SimulcastInput = input;
+        }
+
+        const int frameIndex = m_FrameCount % m_BufferedFrameCount;
+        const auto destTexture = m_RenderTextures[frameIndex];
+
+        if (!AcquireInputSlot(frameIndex))
+            return;
+
+        {
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::Convert);
+            LiveCaptureNative::TraceScope traceScope("Encoder.Convert", timeStamp);
+            const auto convertStart = LiveCaptureNative::GetEncodeClockNs();
+
+            if (destTexture == nullptr ||
+                !m_Converter->ConvertToNV12(destTexture->GetNV12Texture()))
+            {
+                WriteFileDebug(LogLevel::Error, "Error, simulcast scaling failed.\n");
+                return;
+            }
+
+            m_Stats.RecordCopy(LiveCaptureNative::GetEncodeClockNs() - convertStart);
+        }
+
+        SubmitFrame(frameIndex, timeStamp, timecode);
+    }
+
+    void NvEncoder::SubmitFrame(int frameIndex,
+                                unsigned long long int timeStamp,
+                                const LiveCaptureNative::FrameTimecode& timecode)
+    {
         WriteFileDebug("Info, Start encoding new frame.\n");
 
         auto& bufferedFrame = m_BufferedFrames[frameIndex];
 
         if (bufferedFrame.isEncoding)
         {
-            WriteFileDebug("Error: frame is already encoding.\n");
+            WriteFileDebug(LogLevel::Error, "Error: frame is already encoding.\n");
             return;
         }
         bufferedFrame.isEncoded = false;
@@ -575,11 +697,19 @@ namespace NvencPlugin
         picParams.inputWidth = m_NvEncInitializeParams.encodeWidth;
         picParams.inputHeight = m_NvEncInitializeParams.encodeHeight;
         picParams.outputBitstream = bufferedFrame.outputFrame;
-        picParams.inputTimeStamp = m_FrameCount;
+        // The sequence number comes back as the bitstream outputTimeStamp, to find the frame timing.
+        const auto context = m_FrameContexts.Begin(timeStamp, timecode);
+        picParams.inputTimeStamp = context.sequence;
 
         if (m_NvEncInitializeParams.enableEncodeAsync == 1)
         {
-            picParams.completionEvent = GetCompletionEvent(m_FrameCount % k_BufferedFrameNum);
+            picParams.completionEvent = GetCompletionEvent(frameIndex);
+        }
+
+        // A frame was dropped with DropToKeyFrame, the following ones are skipped until an IDR.
+        if (m_FrameQueue.ConsumeKeyFrameRequest())
+        {
+            m_GOPCount = 0;
         }
 
         const int gopIndex = m_GOPCount % k_GOPSize;
@@ -595,14 +725,22 @@ namespace NvencPlugin
         }
         m_GOPCount++;
 
-        const auto errorCode = m_Nvenc.nvEncEncodePicture(m_HEncoder, &picParams);
+        NVENCSTATUS errorCode;
+        {
+            LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::EncodePicture);
+            LiveCaptureNative::TraceScope traceScope("Encoder.Submit", timeStamp, LiveCaptureNative::TraceFlow::Step);
+            errorCode = m_Nvenc.nvEncEncodePicture(m_HEncoder, &picParams);
+        }
+
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Failed to encode frame: ", errorCode, true);
+            WriteFileDebug(LogLevel::Error, "Failed to encode frame: ", errorCode);
             bufferedFrame.isEncoding = false;
             return;
         }
 
+        m_Stats.RecordSubmit();
+
         if (m_NvEncInitializeParams.enableEncodeAsync == 1)
         {
             EncodedFrameDataKey dataKey;
@@ -631,7 +769,11 @@ namespace NvencPlugin
 
     void NvEncoder::ProcessEncodedFrameAsyncSingle(NvEncoder* encoder)
     {
-        while (encoder->m_IsAsync)
+        auto& profiler = LiveCaptureNative::GetEncoderProfiler();
+        profiler.RegisterThread("NVENC Output");
+        LiveCaptureNative::TraceRecorder::Get().SetThreadName("NVENC Output");
+
+        while (encoder->m_IsThreadRunning)
         {
             EncodedFrameDataKey dataKey;
             {
@@ -642,26 +784,47 @@ namespace NvencPlugin
                 encoder->m_BufferToRead.pop();
             }
 
-            if (WaitForSingleObject(encoder->m_vpCompletionEvent[dataKey.index], 1000) == WAIT_FAILED)
+            // In sub-frame mode, the slices are polled as they are written instead of waiting for the whole frame.
+            if (!encoder->IsSubFrameOutputEnabled())
             {
-                WriteFileDebug("Failed in the ProcessEncodedFrameAsync.\n");
-                continue;
+                LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::WaitCompletion);
+
+                if (WaitForSingleObject(encoder->m_vpCompletionEvent[dataKey.index], 1000) == WAIT_FAILED)
+                {
+                    WriteFileDebug(LogLevel::Error, "Failed in the ProcessEncodedFrameAsync.\n");
+                    continue;
+                }
             }
             auto& frame = encoder->GetBufferedFrame(dataKey.index);
             encoder->ProcessEncodedFrame(frame, dataKey.timestamp, dataKey.isKeyFrame);
             frame.isEncoded = true;
             WriteFileDebug("Info, frameIndex used from the queue.\n");
         }
+
+        profiler.UnregisterThread();
     }
 
     void NvEncoder::ProcessEncodedFrame(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
     {
         if (!frame.isEncoding)
         {
-            WriteFileDebug("Error; the frame hasn't been encoded.\n");
+            WriteFileDebug(LogLevel::Error, "Error; the frame hasn't been encoded.\n");
             return;
         }
-        frame.isEncoding = false;
+
+        // Only the capture time is known until the bitstream gives back the frame sequence number.
+        EncodeFrameContext context = { timestamp, 0, 0, {} };
+
+        // The slot (input texture and output bitstream) is released once the picture is complete
+        // and its bitstream unlocked. In sub-frame mode that is after the last slice, not before the first.
+        if (IsSubFrameOutputEnabled() && ProcessEncodedSlices(frame, context, isKeyFrame))
+        {
+            frame.isEncoding = false;
+            AddEncodedFrame(frame, context, isKeyFrame);
+            return;
+        }
+
+        LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::LockBitstream);
 
         NV_ENC_LOCK_BITSTREAM lockBitStream = { 0 };
         lockBitStream.version = NV_ENC_LOCK_BITSTREAM_VER;
@@ -671,9 +834,15 @@ namespace NvencPlugin
         auto errorCode = m_Nvenc.nvEncLockBitstream(m_HEncoder, &lockBitStream);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, failed to lock bit stream.\n");
+            WriteFileDebug(LogLevel::Error, "Error, failed to lock bit stream.\n");
+        }
+        else
+        {
+            ResolveFrameContext(lockBitStream.outputTimeStamp, context);
         }
 
+        // The buffer holds a previously consumed frame, swapped back from the frame queue.
+        frame.encodedFrame.clear();
         if (lockBitStream.bitstreamSizeInBytes)
         {
             WriteFileDebug("Success, encoded size: ", static_cast<int>(lockBitStream.bitstreamSizeInBytes));
@@ -684,60 +853,215 @@ namespace NvencPlugin
         errorCode = m_Nvenc.nvEncUnlockBitstream(m_HEncoder, frame.outputFrame);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, failed to unlock bit stream.\n");
+            WriteFileDebug(LogLevel::Error, "Error, failed to unlock bit stream.\n");
         }
+        frame.isEncoding = false;
 
         // Add encoded data to a queue.
-        AddEncodedFrame(frame, timestamp, isKeyFrame);
+        AddEncodedFrame(frame, context, isKeyFrame);
     }
-#pragma endregion
 
-#pragma region Encoded frame actions
-    void NvEncoder::AddEncodedFrame(Frame& frame, unsigned long long int timestamp, bool isKeyFrame)
+    void NvEncoder::ResolveFrameContext(uint64_t sequence, EncodeFrameContext& context)
+    {
+        if (!m_FrameContexts.Find(sequence, context))
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, no timing found for the encoded frame.\n");
+        }
+    }
+
+    bool NvEncoder::ProcessEncodedSlices(Frame& frame, EncodeFrameContext& context, bool isKeyFrame)
     {
-        EncodedFrame encodedFrame;
-        encodedFrame.imageData = std::move(frame.encodedFrame);
-        GetSequenceParams(encodedFrame.spsSequence, encodedFrame.ppsSequence);
-        encodedFrame.timestamp = timestamp;
-        encodedFrame.isKeyFrame = isKeyFrame;
+        LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::LockBitstream);
 
-        WriteFileDebug("--------\n");
-        WriteFileDebug("IMG SIZE: ", encodedFrame.imageData.size(), true);
-        WriteFileDebug("SPS SIZE: ", encodedFrame.spsSequence.size(), true);
-        WriteFileDebug("PPS SIZE: ", encodedFrame.ppsSequence.size(), true);
+        const auto start = std::chrono::steady_clock::now();
+        uint32_t emittedSlices = 0;
+        bool isContextResolved = false;
 
-        if (m_FrameQueue.size() < k_MaxQueueLength)
+        for (;;)
         {
-            m_FrameQueue.push(std::move(encodedFrame));
-            WriteFileDebug("Info, encoded frame added in the queue.\n");
+            NV_ENC_LOCK_BITSTREAM lockBitStream = { 0 };
+            lockBitStream.version = NV_ENC_LOCK_BITSTREAM_VER;
+            lockBitStream.outputBitstream = frame.outputFrame;
+            lockBitStream.doNotWait = 1;
+            lockBitStream.sliceOffsets = m_SliceOffsets.data();
+
+            const auto errorCode = m_Nvenc.nvEncLockBitstream(m_HEncoder, &lockBitStream);
+            if (errorCode == NV_ENC_ERR_LOCK_BUSY || errorCode == NV_ENC_ERR_ENCODER_BUSY)
+            {
+                if (std::chrono::steady_clock::now() - start > std::chrono::seconds(1))
+                {
+                    WriteFileDebug(LogLevel::Error, "Error, timeout while polling encoded slices.\n");
+                    return false;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+
+            if (errorCode != NV_ENC_SUCCESS)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, failed to lock bit stream (sub-frame): ", errorCode);
+                return false;
+            }
+
+            if (!isContextResolved)
+            {
+                ResolveFrameContext(lockBitStream.outputTimeStamp, context);
+                isContextResolved = true;
+            }
+
+            // hwEncodeStatus is 2 once the whole picture is written. Until then, the last reported
+            // slice may still be growing: only the slices followed by another one are emitted.
+            const bool isComplete = lockBitStream.hwEncodeStatus == 2;
+            const uint32_t writtenSlices = (std::min)(lockBitStream.numSlices, static_cast<uint32_t>(m_SliceOffsets.size()));
+            const uint32_t readySlices = (isComplete || writtenSlices == 0) ? writtenSlices : writtenSlices - 1;
+            const auto data = static_cast<const uint8_t*>(lockBitStream.bitstreamBufferPtr);
+
+            for (; emittedSlices < readySlices; ++emittedSlices)
+            {
+                const uint32_t begin = m_SliceOffsets[emittedSlices];
+                const uint32_t end = (emittedSlices + 1 < writtenSlices)
+                    ? m_SliceOffsets[emittedSlices + 1]
+                    : lockBitStream.bitstreamSizeInBytes;
+
+                if (end > begin)
+                {
+                    const bool isLastSlice = isComplete && emittedSlices + 1 == writtenSlices;
+                    AddEncodedSlice(data + begin, end - begin, context, emittedSlices, isLastSlice, isKeyFrame);
+                }
+            }
+
+            if (isComplete)
+            {
+                frame.encodedFrame.assign(data, data + lockBitStream.bitstreamSizeInBytes);
+            }
+
+            if (m_Nvenc.nvEncUnlockBitstream(m_HEncoder, frame.outputFrame) != NV_ENC_SUCCESS)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, failed to unlock bit stream.\n");
+            }
+
+            if (isComplete)
+                return true;
+
+            std::this_thread::yield();
         }
-        else
+    }
+#pragma endregion
+
+#pragma region Encoded frame actions
+    void NvEncoder::AddEncodedSlice(const uint8_t* data,
+                                    uint32_t size,
+                                    const EncodeFrameContext& context,
+                                    uint32_t sliceIndex,
+                                    bool isLastSlice,
+                                    bool isKeyFrame)
+    {
+        EncodedSlice slice;
+        slice.data.assign(data, data + size);
+        slice.timestamp = context.timestamp;
+        slice.sliceIndex = sliceIndex;
+        slice.isLastSlice = isLastSlice;
+        slice.isKeyFrame = isKeyFrame;
+
+        // The first slice holds the parameter sets, the SEI goes between them and the slice data.
+        if (sliceIndex == 0)
         {
-            m_FrameQueue.pop();
-            m_FrameQueue.push(std::move(encodedFrame));
+            InsertTimecodeSei(slice.data, context);
+        }
+
+        std::lock_guard<std::mutex> lock(m_SliceMutex);
 
-            WriteFileDebug("Warning, too much encoded frames in the queue.\n");
+        // Drop the new slice rather than an old one: the consumer may be reading the front element,
+        // and erasing from a deque would invalidate it.
+        if (m_SliceQueue.size() >= static_cast<size_t>(k_MaxSliceQueueLength))
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, too much encoded slices in the queue.\n");
+            return;
         }
+        m_SliceQueue.push_back(std::move(slice));
     }
 
-    EncodedFrame* NvEncoder::GetEncodedFrame()
+    EncodedSlice* NvEncoder::GetEncodedSlice()
+    {
+        std::lock_guard<std::mutex> lock(m_SliceMutex);
+        return m_SliceQueue.empty() ? nullptr : &m_SliceQueue.front();
+    }
+
+    bool NvEncoder::RemoveEncodedSlice()
     {
-        if (m_FrameQueue.size() > 0)
+        std::lock_guard<std::mutex> lock(m_SliceMutex);
+        if (m_SliceQueue.empty())
+            return false;
+
+        m_SliceQueue.pop_front();
+        return true;
+    }
+
+    void NvEncoder::AddEncodedFrame(Frame& frame, const EncodeFrameContext& context, bool isKeyFrame)
+    {
+        InsertTimecodeSei(frame.encodedFrame, context);
+
+        // Before the queue, the recording keeps the frames the backpressure policy drops.
+        RecordFrame(frame, context, isKeyFrame);
+
+        LiveCaptureNative::EncoderProfilerScope profilerScope(LiveCaptureNative::EncoderMarker::QueueFrame);
+
+        // Null when the backpressure policy drops the frame, the queue records it in the stats.
+        auto encodedFrame = m_FrameQueue.BeginWrite(isKeyFrame);
+        if (encodedFrame == nullptr)
         {
-            return &m_FrameQueue.front();
+            WriteFileDebug(LogLevel::Warning, "Warning, too much encoded frames in the queue.\n");
+            LiveCaptureNative::ProfileFrameDropped(m_FrameQueue);
+            return;
         }
-        return nullptr;
+
+        // Swap rather than move, the frame gets the slot's previous buffer back and reuses its capacity.
+        std::swap(encodedFrame->imageData, frame.encodedFrame);
+        GetSequenceParams(encodedFrame->spsSequence, encodedFrame->ppsSequence);
+        encodedFrame->timestamp = context.timestamp;
+        encodedFrame->isKeyFrame = isKeyFrame;
+        encodedFrame->sequence = context.sequence;
+        encodedFrame->outputTime = LiveCaptureNative::GetEncodeClockNs();
+        encodedFrame->encodeLatency = (context.submitTime != 0)
+            ? encodedFrame->outputTime - context.submitTime
+            : 0;
+
+        WriteFileDebug("--------\n");
+        WriteFileDebug("IMG SIZE: ", encodedFrame->imageData.size(), true);
+        WriteFileDebug("SPS SIZE: ", encodedFrame->spsSequence.size(), true);
+        WriteFileDebug("PPS SIZE: ", encodedFrame->ppsSequence.size(), true);
+
+        const auto frameBytes = encodedFrame->imageData.size();
+        const auto encodeLatency = encodedFrame->encodeLatency;
+        m_FrameQueue.Publish();
+        WriteFileDebug("Info, encoded frame added in the queue.\n");
+
+        m_Stats.RecordEncoded(encodeLatency, frameBytes, isKeyFrame, m_FrameQueue.GetSize());
+        LiveCaptureNative::TraceComplete("Encoder.Encode", context.timestamp, context.submitTime, context.submitTime + encodeLatency);
+        LiveCaptureNative::ProfileFrameQueued(m_FrameQueue, frameBytes);
+    }
+
+    EncodedFrame* NvEncoder::GetEncodedFrame()
+    {
+        // The consumption of a frame starts here, RemoveEncodedFrame() pops the same one.
+        m_FrameQueue.TrimOldest();
+        return m_FrameQueue.Front();
     }
 
     bool NvEncoder::RemoveEncodedFrame()
     {
+        const auto encodedFrame = m_FrameQueue.Front();
+        const auto outputTime = (encodedFrame != nullptr) ? encodedFrame->outputTime : 0;
+        const auto timestamp = (encodedFrame != nullptr) ? encodedFrame->timestamp : 0;
+
         // Should always be true if it was true for the previous call.
-        if (m_FrameQueue.size() > 0)
-        {
-            m_FrameQueue.pop();
-            return true;
-        }
-        return false;
+        if (!m_FrameQueue.Pop())
+            return false;
+
+        const auto consumeTime = LiveCaptureNative::GetEncodeClockNs();
+        m_Stats.RecordConsumed(consumeTime - outputTime, m_FrameQueue.GetSize());
+        LiveCaptureNative::TraceComplete("Encoder.Queue", timestamp, outputTime, consumeTime);
+        return true;
     }
 
     void NvEncoder::GetSequenceParams(DataSequence& spsSequence, DataSequence& ppsSequence)
@@ -757,7 +1081,7 @@ namespace NvencPlugin
         const auto errorCode = m_Nvenc.nvEncGetSequenceParams(m_HEncoder, &payload);
         if (errorCode != NV_ENC_SUCCESS)
         {
-            WriteFileDebug("Error, nvEncGetSequenceParams failed.\n");
+            WriteFileDebug(LogLevel::Error, "Error, nvEncGetSequenceParams failed.\n");
             return;
         }
 
@@ -773,7 +1097,7 @@ namespace NvencPlugin
             i_sps += 1;
             if (i_sps >= spsppsSize)
             {
-                WriteFileDebug("Error, Invalid SPS/PPS.\n");
+                WriteFileDebug(LogLevel::Error, "Error, Invalid SPS/PPS.\n");
                 return;
             }
         }
@@ -792,48 +1116,310 @@ namespace NvencPlugin
         spsSequence.insert(spsSequence.begin(), &sps[4], &sps[i_sps]);
         ppsSequence.insert(ppsSequence.begin(), &pps[4], &pps[i_pps]);
     }
+
+    void NvEncoder::RecordFrame(const Frame& frame, const EncodeFrameContext& context, bool isKeyFrame)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        if ((m_Recorder == nullptr && m_ReplayBuffer == nullptr) || frame.encodedFrame.empty())
+            return;
+
+        // Only the parameter sets of key frames are read, to start the file (or the replayed GOP)
+        // and to check that they didn't change.
+        if (isKeyFrame)
+        {
+            GetSequenceParams(m_RecordedSps, m_RecordedPps);
+        }
+
+        if (m_ReplayBuffer != nullptr)
+        {
+            m_ReplayBuffer->Append(frame.encodedFrame.data(),
+                                   frame.encodedFrame.size(),
+                                   context.timestamp,
+                                   isKeyFrame,
+                                   m_RecordedSps.data(),
+                                   m_RecordedSps.size(),
+                                   m_RecordedPps.data(),
+                                   m_RecordedPps.size());
+        }
+
+        if (m_Recorder != nullptr &&
+            !m_Recorder->WriteFrame(frame.encodedFrame.data(),
+                                    frame.encodedFrame.size(),
+                                    context.timestamp,
+                                    isKeyFrame,
+                                    m_RecordedSps.data(),
+                                    isKeyFrame ? m_RecordedSps.size() : 0,
+                                    m_RecordedPps.data(),
+                                    isKeyFrame ? m_RecordedPps.size() : 0))
+        {
+            WriteFileDebug("Info, encoded frame not recorded.\n");
+        }
+    }
+
+    void NvEncoder::InsertTimecodeSei(std::vector<uint8_t>& accessUnit, const EncodeFrameContext& context)
+    {
+        // The context of the frame was lost, its sequence number and timecode are unknown.
+        if (context.submitTime == 0 || accessUnit.empty())
+            return;
+
+        LiveCaptureNative::Sei::FrameMetadata metadata;
+        metadata.timecode = context.timecode;
+        metadata.sequence = context.sequence;
+        metadata.timestamp = context.timestamp;
+
+        if (!LiveCaptureNative::Sei::InsertMetadata(LiveCaptureNative::Sei::Codec::H264, metadata, accessUnit))
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, no slice found for the timecode SEI.\n");
+        }
+    }
+
+    void NvEncoder::ConfigureReplayBuffer(const LiveCaptureNative::ReplayBufferSettings* settings)
+    {
+        // The export in progress reads the current buffer.
+        m_ReplayExporter.Wait();
+
+        // Allocated and released outside of the lock, the slab can be large.
+        std::unique_ptr<LiveCaptureNative::ReplayBuffer> replayBuffer;
+        if (settings != nullptr)
+        {
+            replayBuffer.reset(new LiveCaptureNative::ReplayBuffer(*settings));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            std::swap(m_ReplayBuffer, replayBuffer);
+        }
+    }
+
+    bool NvEncoder::SaveReplay(const char* path, uint64_t durationNs)
+    {
+        if (m_ReplayExporter.IsBusy())
+        {
+            WriteFileDebug(LogLevel::Warning, "Warning, a replay is already being saved.\n");
+            return false;
+        }
+
+        LiveCaptureNative::ReplayRange range;
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            if (m_ReplayBuffer == nullptr || !m_ReplayBuffer->AcquireLast(durationNs, range))
+                return false;
+        }
+
+        return m_ReplayExporter.Start(std::move(range),
+                                      path,
+                                      static_cast<uint32_t>(m_FrameData.width),
+                                      static_cast<uint32_t>(m_FrameData.height));
+    }
+
+    bool NvEncoder::GetReplayBufferStats(LiveCaptureNative::ReplayBufferStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        if (m_ReplayBuffer == nullptr)
+            return false;
+
+        m_ReplayBuffer->GetStats(stats);
+        return true;
+    }
+
+    void NvEncoder::GetReplayExportStats(LiveCaptureNative::Fmp4RecorderStats& stats)
+    {
+        m_ReplayExporter.GetStats(stats);
+    }
+
+    bool NvEncoder::StartRecording(const char* path, const LiveCaptureNative::Fmp4RecorderSettings& settings)
+    {
+        StopRecording();
+
+        std::unique_ptr<LiveCaptureNative::Fmp4Recorder> recorder(new LiveCaptureNative::Fmp4Recorder());
+        if (!recorder->Open(path,
+                            static_cast<uint32_t>(m_FrameData.width),
+                            static_cast<uint32_t>(m_FrameData.height),
+                            settings))
+        {
+            WriteFileDebug(LogLevel::Error, "Error, failed to create the recording file.\n");
+            recorder->GetStats(m_LastRecordingStats);
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        m_Recorder = std::move(recorder);
+        return true;
+    }
+
+    void NvEncoder::StopRecording()
+    {
+        std::unique_ptr<LiveCaptureNative::Fmp4Recorder> recorder;
+        {
+            std::lock_guard<std::mutex> lock(m_RecorderMutex);
+            recorder = std::move(m_Recorder);
+        }
+
+        // Outside of the lock, closing waits for the last fragments to be written.
+        if (recorder != nullptr)
+        {
+            recorder->Close();
+            recorder->GetStats(m_LastRecordingStats);
+        }
+    }
+
+    void NvEncoder::GetRecordingStats(LiveCaptureNative::Fmp4RecorderStats& stats)
+    {
+        std::lock_guard<std::mutex> lock(m_RecorderMutex);
+        if (m_Recorder != nullptr)
+        {
+            m_Recorder->GetStats(stats);
+        }
+        else
+        {
+            stats = m_LastRecordingStats;
+        }
+    }
 #pragma endregion 
 
+#pragma region Session pooling
+    void NvEncoder::StartAsyncThread()
+    {
+        if (m_Thread != nullptr)
+            return;
+
+        m_FrameQueue.SetCancelled(false);
+        m_IsThreadRunning = true;
+        m_Thread = new NvThread(std::thread(ProcessEncodedFrameAsyncSingle, this));
+    }
+
+    void NvEncoder::StopAsyncThread()
+    {
+        // Releases the thread if it is blocked on a full output queue.
+        m_FrameQueue.SetCancelled(true);
+        m_IsThreadRunning = false;
+        if (m_Thread != nullptr)
+        {
+            delete m_Thread;
+            m_Thread = nullptr;
+        }
+
+        // Wait for the frames still in flight so that their buffers can be reused, the output is dropped.
+        std::lock_guard<NvSpinlock> lock(m_NvSpinlock);
+        while (!m_BufferToRead.empty())
+        {
+            const auto dataKey = m_BufferToRead.front();
+            m_BufferToRead.pop();
+
+            WaitForSingleObject(m_vpCompletionEvent[dataKey.index], 1000);
+            GetBufferedFrame(dataKey.index).isEncoding = false;
+        }
+    }
+
+    void NvEncoder::Park()
+    {
+        WriteFileDebug("Info, parking encoder session.\n");
+
+        if (m_IsAsync)
+        {
+            StopAsyncThread();
+        }
+
+        // The recording and the replay belong to the stream, not to the pooled session.
+        StopRecording();
+        ConfigureReplayBuffer(nullptr);
+        ClearEncodedFrameQueue();
+
+        for (auto& frame : m_BufferedFrames)
+        {
+            frame.isEncoding = false;
+            frame.isEncoded = false;
+        }
+    }
+
+    bool NvEncoder::Resume(const NvencEncoderSessionData& settings, const EncoderBufferingSettings& buffering)
+    {
+        if (!IsInitialized())
+            return false;
+
+        WriteFileDebug("Info, resuming encoder session.\n");
+
+        // Restart the GOP so that the first frame of the new stream is an IDR.
+        m_FrameCount = 0;
+        m_GOPCount = 0;
+
+        // The statistics describe the stream, not the pooled session. The encoding thread is stopped.
+        m_Stats.Reset();
+        m_LastRecordingStats = LiveCaptureNative::Fmp4RecorderStats();
+
+        // Same in-flight depth (part of the session key), the rest may differ.
+        m_RequestedBuffering = buffering;
+        ConfigureBuffering(buffering);
+
+        UpdateEncoderSessionData(settings);
+
+        if (m_IsAsync)
+        {
+            StartAsyncThread();
+        }
+
+        return true;
+    }
+
+    NvencSessionKey NvEncoder::GetSessionKey() const
+    {
+        NvencSessionKey key;
+        key.device = m_Device;
+        key.codec = m_NvEncInitializeParams.encodeGUID;
+        key.format = (m_ForceNV12) ? NV_ENC_BUFFER_FORMAT_NV12 : NV_ENC_BUFFER_FORMAT_ARGB;
+        key.maxWidth = static_cast<int>(m_NvEncInitializeParams.maxEncodeWidth);
+        key.maxHeight = static_cast<int>(m_NvEncInitializeParams.maxEncodeHeight);
+        key.width = m_FrameData.width;
+        key.height = m_FrameData.height;
+        key.sliceCount = m_SliceCount;
+        key.inFlightDepth = m_RequestedBuffering.inFlightDepth;
+        return key;
+    }
+
+    size_t NvEncoder::GetResidentBytes() const
+    {
+        // Estimate: one input texture and one bitstream buffer (sized by the driver,
+        // assumed to be about one NV12 frame) per buffered frame.
+        const size_t pixels = static_cast<size_t>(m_FrameData.width) * static_cast<size_t>(m_FrameData.height);
+        const size_t textureBytes = (m_ForceNV12) ? pixels * 3 / 2 : pixels * 4;
+        const size_t bitstreamBytes = pixels * 3 / 2;
+        return m_BufferedFrameCount * (textureBytes + bitstreamBytes);
+    }
+#pragma endregion
+
 #pragma region Liberate resources
     void NvEncoder::DestroyResources()
     {
-        auto asyncMode = m_IsAsync;
         if (m_IsAsync)
         {
-            m_IsAsync = false;
-            if (m_Thread != nullptr)
-            delete m_Thread;
-
+            StopAsyncThread();
             DestroyAsyncResources();
+            m_IsAsync = false;
         }
 
         ReleaseEncoderResources();
         ClearEncodedFrameQueue();
+        m_Converter.reset();
 
         if (m_HEncoder)
         {
             if (m_Nvenc.nvEncDestroyEncoder(m_HEncoder) != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Failed to destroy NV encoder interface.\n");
+                WriteFileDebug(LogLevel::Error, "Failed to destroy NV encoder interface.\n");
             }
             m_HEncoder = nullptr;
         }
 
-        UnloadModule();
+        ReleaseCodec();
         m_InitializationResult = ENvencStatus::NotInitialized;
     }
 
-    void NvEncoder::UnloadModule()
+    void NvEncoder::ReleaseCodec()
     {
-
-        if (m_HModule != nullptr)
+        if (m_Driver != nullptr)
         {
-#if defined(_WIN32)
-            FreeLibrary((HMODULE)m_HModule);
-#else
-            dlclose(s_hModule);
-#endif
-            m_HModule = nullptr;
+            NvencDriverContext::Release();
+            m_Driver = nullptr;
         }
     }
 
@@ -842,14 +1428,15 @@ namespace NvencPlugin
         if (m_InitializationResult != ENvencStatus::Success)
             return;
 
-        for (Frame& frame : m_BufferedFrames)
+        for (uint32_t i = 0; i < m_BufferedFrameCount; i++)
         {
+            auto& frame = m_BufferedFrames[i];
             ReleaseFrameInputBuffer(frame);
 
             auto errorCode = m_Nvenc.nvEncDestroyBitstreamBuffer(m_HEncoder, frame.outputFrame);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to destroy output buffer bit stream.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to destroy output buffer bit stream.\n");
             }
             frame.outputFrame = nullptr;
         }
@@ -874,14 +1461,14 @@ namespace NvencPlugin
             auto errorCode = m_Nvenc.nvEncUnmapInputResource(m_HEncoder, frame.inputFrame.mappedResource);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to unmap input resource.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to unmap input resource.\n");
             }
             frame.inputFrame.mappedResource = nullptr;
 
             errorCode = m_Nvenc.nvEncUnregisterResource(m_HEncoder, frame.inputFrame.registeredResource);
             if (errorCode != NV_ENC_SUCCESS)
             {
-                WriteFileDebug("Error, failed to unregister input buffer resource.\n");
+                WriteFileDebug(LogLevel::Error, "Error, failed to unregister input buffer resource.\n");
             }
             frame.inputFrame.registeredResource = nullptr;
         }
@@ -889,10 +1476,10 @@ namespace NvencPlugin
 
     void NvEncoder::ClearEncodedFrameQueue()
     {
-        while (!m_FrameQueue.empty())
-        {
-            m_FrameQueue.pop();
-        }
+        m_FrameQueue.Clear();
+
+        std::lock_guard<std::mutex> lock(m_SliceMutex);
+        m_SliceQueue.clear();
     }
 
     void NvEncoder::DestroyAsyncResources()
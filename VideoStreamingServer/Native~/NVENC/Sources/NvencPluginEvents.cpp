@@ -9,10 +9,12 @@
 #include "NvencPluginEvents.h"
 #include "NvencEncoder.h"
 #include "ObjectIDMap.h"
+#include "EncoderSessionPool.h"
+#include "EncoderDeviceFactory.h"
+#include "NvencSimulcastGroup.h"
 #include "PluginUtils.h"
-
-#include "D3D11EncoderDevice.h"
-#include "D3D12EncoderDevice.h"
+#include "UnityEncoderProfiler.h"
+#include "TraceRecorder.h"
 
 #include "Unity/IUnityRenderingExtensions.h"
 #include "Unity/IUnityGraphicsD3D11.h"
@@ -26,7 +28,9 @@ enum class VideoStreamRenderEventID
     Initialize = 0,
     Update,
     Encode,
-    Finalize
+    Finalize,
+    EncodeSimulcast,
+    ConfigureSimulcast
 };
 
 namespace NvencPlugin
@@ -36,18 +40,44 @@ namespace NvencPlugin
     static IUnityGraphicsD3D11*    s_UnityGraphicsD3D11 = nullptr;
     static IUnityGraphicsD3D12v5*  s_UnityGraphicsD3D12 = nullptr;
 
-    static IGraphicsEncoderDevice* s_GraphicsEncoderDevice = nullptr;
     static IUnknown*               s_GraphicsDevice = nullptr;
     static bool                    s_Initialized = false;
 
+    // Installed as the encoder profiler while the plugin is loaded.
+    static std::unique_ptr<LiveCaptureNative::UnityEncoderProfiler> s_EncoderProfiler;
+
     static IDObjectMap<NvEncoder>      s_EncoderMap;
     static IDObjectMap<EncodedFrame>   s_EncodedFrameMap;
+    static IDObjectMap<EncodedSlice>   s_EncodedSliceMap;
+    static IDObjectMap<NvencSimulcastGroup> s_SimulcastGroupMap;
+
+    // Idle sessions count against the driver's limit of concurrent sessions, keep only a few.
+    static const size_t k_MaxIdleSessionBytes = 256 * 1024 * 1024;
+    static const size_t k_MaxIdleSessions = 2;
+
+    // Every encoder holds a reference on its graphics encoder device.
+    static void DestroyEncoder(NvEncoder* encoder)
+    {
+        auto device = encoder->GetGraphicsDevice();
+
+        encoder->DestroyResources();
+        delete encoder;
+
+        EncoderDeviceFactory::Release(device);
+    }
+
+    static EncoderSessionPool<NvencSessionKey, NvEncoder> s_SessionPool(k_MaxIdleSessionBytes,
+                                                                        k_MaxIdleSessions,
+                                                                        DestroyEncoder);
+
+    static void ReleaseGraphicsEncoderDevices();
 
 #pragma region Low Level Plugin Interface
     // Override the function defining the load of the plugin
     extern "C" void UNITY_INTERFACE_EXPORT UNITY_INTERFACE_API
         UnityPluginLoad(IUnityInterfaces * unityInterfaces)
     {
+        InitLog();
         WriteFileDebug("Load plugin\n", false);
         if (unityInterfaces)
         {
@@ -59,6 +89,13 @@ namespace NvencPlugin
                 s_UnityGraphics = unityGraphics;
                 unityGraphics->RegisterDeviceEventCallback(OnGraphicsDeviceEvent);
             }
+
+            const auto unityProfiler = s_UnityInterfaces->Get<IUnityProfiler>();
+            if (unityProfiler)
+            {
+                s_EncoderProfiler.reset(new LiveCaptureNative::UnityEncoderProfiler(unityProfiler));
+                LiveCaptureNative::SetEncoderProfiler(s_EncoderProfiler.get());
+            }
         }
     }
 
@@ -70,6 +107,14 @@ namespace NvencPlugin
         {
             s_UnityGraphics->UnregisterDeviceEventCallback(OnGraphicsDeviceEvent);
         }
+
+        ReleaseGraphicsEncoderDevices();
+        NvencDriverContext::UnloadIfUnused();
+
+        // An encoder thread may still be sampling the profiler, it is only destroyed with the plugin.
+        LiveCaptureNative::SetEncoderProfiler(nullptr);
+
+        CloseLog();
     }
 
     static bool GetRenderDeviceInterface(UnityGfxRenderer renderer)
@@ -85,7 +130,7 @@ namespace NvencPlugin
             s_GraphicsDevice = s_UnityGraphicsD3D12->GetDevice();
             return true;
         default:
-            WriteFileDebug("Error, graphics API not supported.\n");
+            WriteFileDebug(LogLevel::Error, "Error, graphics API not supported.\n");
             return false;
         }
     }
@@ -107,10 +152,15 @@ namespace NvencPlugin
         }
         else if (eventType == kUnityGfxDeviceEventShutdown)
         {
+            ReleaseGraphicsEncoderDevices();
+
             s_Initialized = false;
             s_UnityGraphicsD3D11 = nullptr;
             s_UnityGraphicsD3D12 = nullptr;
             s_GraphicsDevice = nullptr;
+
+            // The cached capabilities are keyed by device, drop them with the device.
+            NvencDriverContext::UnloadIfUnused();
         }
     }
 
@@ -124,6 +174,8 @@ namespace NvencPlugin
     void Update(void* data);
     void Encode(void* data);
     void Finalize(void* data);
+    void EncodeSimulcast(void* data);
+    void ConfigureSimulcast(void* data);
 
     // Plugin function to handle a specific rendering event
     static void UNITY_INTERFACE_API OnRenderEvent(int eventID, void* data)
@@ -151,6 +203,16 @@ namespace NvencPlugin
             Finalize(data);
             break;
         }
+        case VideoStreamRenderEventID::EncodeSimulcast:
+        {
+            EncodeSimulcast(data);
+            break;
+        }
+        case VideoStreamRenderEventID::ConfigureSimulcast:
+        {
+            ConfigureSimulcast(data);
+            break;
+        }
         default:
             break;
         }
@@ -163,19 +225,36 @@ namespace NvencPlugin
     {
         if (!data)
         {
-            WriteFileDebug("Error, Data send is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Data send is null.\n");
             return true;
         }
 
         if (!s_GraphicsDevice)
         {
-            WriteFileDebug("Error, s_D3D11Device is null.\n");
+            WriteFileDebug(LogLevel::Error, "Error, s_D3D11Device is null.\n");
             return true;
         }
 
         return true;
     }
 
+    // The encoder takes over the device reference held by the caller.
+    NvEncoder* CreateEncoder(IGraphicsEncoderDevice* device,
+                             const NvencEncoderSessionData& settings,
+                             bool forceNV12,
+                             int sliceCount,
+                             const LiveCaptureNative::EncoderBufferingSettings& buffering)
+    {
+        auto encoder = new NvEncoder(_NV_ENC_DEVICE_TYPE::NV_ENC_DEVICE_TYPE_DIRECTX,
+                                     settings,
+                                     device,
+                                     forceNV12,
+                                     sliceCount,
+                                     buffering);
+        encoder->InitEncoder();
+        return encoder;
+    }
+
     void Initialize(void* data)
     {
         WriteFileDebug("OnRenderEvent: Initialize\n");
@@ -191,51 +270,60 @@ namespace NvencPlugin
             WriteFileDebug("Initial FrameRate: ", encoderData->settings.frameRate);
             WriteFileDebug("Initial Bitrate: ", encoderData->settings.bitRate);
             WriteFileDebug("Initial GopSize: ", encoderData->settings.gopSize);
+            WriteFileDebug("Initial SliceCount: ", encoderData->sliceCount);
+            WriteFileDebug("Initial InFlightDepth: ", encoderData->buffering.inFlightDepth);
+
+            bool forceNV12 = encoderData->encoderFormat != EncoderFormat::NV12;
+
+            auto device = EncoderDeviceFactory::Acquire(s_GraphicsDevice, s_UnityGraphicsD3D11, s_UnityGraphicsD3D12);
+            if (device == nullptr)
+                return;
+
+            auto encoder = s_SessionPool.Acquire(NvEncoder::MakeSessionRequest(device,
+                                                                                 encoderData->settings,
+                                                                                 forceNV12,
+                                                                                 encoderData->sliceCount,
+                                                                                 encoderData->buffering));
 
-            if (s_GraphicsEncoderDevice == nullptr)
+            if (encoder != nullptr && encoder->Resume(encoderData->settings, encoderData->buffering))
             {
-                if (s_UnityGraphicsD3D11)
-                {
-                    auto d3d11Device = static_cast<ID3D11Device*>(s_GraphicsDevice);
-                    s_GraphicsEncoderDevice = new D3D11EncoderDevice(d3d11Device);
-                    WriteFileDebug("D3D11 encoder device succesfully created.\n");
-                }
-                else if (s_UnityGraphicsD3D12)
-                {
-                    auto d3d12Device = static_cast<ID3D12Device*>(s_GraphicsDevice);
-                    s_GraphicsEncoderDevice = new D3D12EncoderDevice(d3d12Device, s_UnityGraphicsD3D12);
-                    WriteFileDebug("D3D12 encoder device succesfully created.\n");
-                }
-                else
+                // The parked encoder already holds a reference on the device.
+                EncoderDeviceFactory::Release(device);
+                WriteFileDebug("Info, reusing a warm encoder session.\n");
+            }
+            else
+            {
+                if (encoder != nullptr)
                 {
-                    WriteFileDebug("Error, graphics API failed to create an Encoder device.\n");
-                    return;
+                    DestroyEncoder(encoder);
                 }
 
-                if (!s_GraphicsEncoderDevice->Initialize())
+                encoder = CreateEncoder(device, encoderData->settings, forceNV12, encoderData->sliceCount, encoderData->buffering);
+
+                // Opening a session can fail because parked sessions hold the driver's session slots.
+                if (!encoder->IsInitialized() && s_SessionPool.GetIdleCount() > 0)
                 {
-                    WriteFileDebug("Error, Failed to Initialize Graphics encoder device.\n");
-                    return;
-                }
-            }
+                    WriteFileDebug(LogLevel::Warning, "Warning, releasing idle encoder sessions and retrying.\n");
 
-            bool forceNV12 = encoderData->encoderFormat != EncoderFormat::NV12;
+                    // Keep the device alive while the failed encoder and the parked ones are destroyed.
+                    device = EncoderDeviceFactory::Acquire(s_GraphicsDevice, s_UnityGraphicsD3D11, s_UnityGraphicsD3D12);
+                    DestroyEncoder(encoder);
+                    s_SessionPool.Clear();
 
-            auto encoder = new NvEncoder(_NV_ENC_DEVICE_TYPE::NV_ENC_DEVICE_TYPE_DIRECTX,
-                                         encoderData->settings,
-                                         s_GraphicsEncoderDevice,
-                                         forceNV12);
+                    encoder = CreateEncoder(device, encoderData->settings, forceNV12, encoderData->sliceCount, encoderData->buffering);
+                }
 
-            if (encoder->InitEncoder() != NvencPlugin::ENvencStatus::Success)
-            {
-                WriteFileDebug("Error, Failed to Initialize 'InitEncoder'\n");
+                if (!encoder->IsInitialized())
+                {
+                    WriteFileDebug(LogLevel::Error, "Error, Failed to Initialize 'InitEncoder'\n");
+                }
             }
 
             s_EncoderMap.Add(encoderData->id, encoder);
         }
         else
         {
-            WriteFileDebug("Error, Initialize: invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Initialize: invalid parameters.\n");
         }
     }
 
@@ -255,7 +343,7 @@ namespace NvencPlugin
         }
         else
         {
-            WriteFileDebug("Error, Update: invalid parameters.\n");
+            WriteFileDebug(LogLevel::Error, "Error, Update: invalid parameters.\n");
         }
     }
 
@@ -270,7 +358,7 @@ namespace NvencPlugin
             auto encoder = s_EncoderMap.GetInstance(encoderData->id);
             if (encoder)
             {
-                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp);
+                encoder->EncodeFrame(encoderData->renderTexture, encoderData->timestamp, encoderData->timecode);
             }
         }
     }
@@ -285,20 +373,90 @@ namespace NvencPlugin
             auto encoder = s_EncoderMap.GetInstance(*id);
             if (encoder)
             {
-                encoder->DestroyResources();
-                delete encoder;
-                encoder = nullptr;
                 s_EncoderMap.Remove(*id);
+
+                if (encoder->IsInitialized())
+                {
+                    encoder->Park();
+                    s_SessionPool.Release(encoder->GetSessionKey(), encoder, encoder->GetResidentBytes());
+                }
+                else
+                {
+                    DestroyEncoder(encoder);
+                }
             }
         }
+    }
 
-        if (s_GraphicsEncoderDevice != nullptr)
+    static NvEncoder* GetEncoder(int id)
+    {
+        return s_EncoderMap.GetInstance(id);
+    }
+
+    void EncodeSimulcast(void* data)
+    {
+        if (!AreParametersValid(data))
+            return;
+
+        auto encoderData = static_cast<EncoderSimulcastTextureID*>(data);
+        if (encoderData && encoderData->id > 0)
+        {
+            auto group = s_SimulcastGroupMap.GetInstance(encoderData->id);
+            if (group)
+            {
+                group->EncodeFrame(encoderData->renderTexture,
+                                   encoderData->width,
+                                   encoderData->height,
+                                   encoderData->timestamp,
+                                   encoderData->timecode,
+                                   GetEncoder);
+            }
+        }
+    }
+
+    void ConfigureSimulcast(void* data)
+    {
+        WriteFileDebug("OnRenderEvent: ConfigureSimulcast\n");
+
+        auto groupData = static_cast<EncoderSimulcastGroupID*>(data);
+        if (!groupData || groupData->id <= 0)
         {
-            s_GraphicsEncoderDevice->Cleanup();
-            s_GraphicsEncoderDevice = nullptr;
+            WriteFileDebug(LogLevel::Error, "Error, ConfigureSimulcast: invalid parameters.\n");
+            return;
+        }
+
+        auto group = s_SimulcastGroupMap.GetInstance(groupData->id);
+
+        if (groupData->layerCount <= 0)
+        {
+            if (group)
+            {
+                delete group;
+                s_SimulcastGroupMap.Remove(groupData->id);
+            }
+            return;
+        }
+
+        if (group == nullptr)
+        {
+            group = new NvencSimulcastGroup();
+            s_SimulcastGroupMap.Add(groupData->id, group);
         }
 
-        s_Initialized = false;
+        group->Configure(*groupData, GetEncoder);
+    }
+
+    // The parked sessions release their device reference, the devices still used by active
+    // encoders are destroyed anyway since the Unity device is going away.
+    static void ReleaseGraphicsEncoderDevices()
+    {
+        s_SimulcastGroupMap.ForEach([](int, NvencSimulcastGroup* group)
+        {
+            group->ReleaseResources();
+        });
+
+        s_SessionPool.Clear();
+        EncoderDeviceFactory::ReleaseAll();
     }
 #pragma endregion
 
@@ -313,6 +471,12 @@ namespace NvencPlugin
         return false;
     }
 
+    // Lowest LogLevel written to the log, only effective for the levels compiled in.
+    extern "C" void UNITY_INTERFACE_EXPORT SetLogLevel(int level)
+    {
+        LiveCaptureNative::AsyncLogger::Get().SetLevel(static_cast<LogLevel>(level));
+    }
+
     extern "C" int UNITY_INTERFACE_EXPORT EncoderIsCompatible()
     {
         return static_cast<int>(NvencPlugin::NvEncoder::IsEncoderAvailable());
@@ -411,5 +575,222 @@ namespace NvencPlugin
 
         return encodedFrame->isKeyFrame;
     }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetSequenceNumber(int* id)
+    {
+        auto encodedFrame = IsEncodedFrameValid(id);
+        if (encodedFrame == nullptr)
+            return 0;
+
+        return encodedFrame->sequence;
+    }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetEncodeLatency(int* id)
+    {
+        auto encodedFrame = IsEncodedFrameValid(id);
+        if (encodedFrame == nullptr)
+            return 0;
+
+        return encodedFrame->encodeLatency;
+    }
+
+    // Snapshot of the encoder counters and latency histograms, callable from any thread.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetEncoderStats(int* id, LiveCaptureNative::EncoderStatsSnapshot* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetStats(*stats);
+        return true;
+    }
+
+    // Records the encoded stream to a fragmented MP4 file (UTF-8 path) until StopRecording, or until
+    // the encoder is destroyed. Settings may be null for the defaults.
+    extern "C" bool UNITY_INTERFACE_EXPORT StartRecording(int* id, const char* path, const LiveCaptureNative::Fmp4RecorderSettings* settings)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || path == nullptr)
+            return false;
+
+        const LiveCaptureNative::Fmp4RecorderSettings defaultSettings = { 0, 0 };
+        return encoder->StartRecording(path, (settings != nullptr) ? *settings : defaultSettings);
+    }
+
+    // Writes the last fragment and closes the file.
+    extern "C" void UNITY_INTERFACE_EXPORT StopRecording(int* id)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr)
+            return;
+
+        encoder->StopRecording();
+    }
+
+    // Stats of the current recording, or of the last one once stopped.
+    extern "C" bool UNITY_INTERFACE_EXPORT GetRecordingStats(int* id, LiveCaptureNative::Fmp4RecorderStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetRecordingStats(*stats);
+        return true;
+    }
+
+    // Keeps the last encoded frames in memory for SaveReplay, with the given size. Null settings
+    // release the replay buffer.
+    extern "C" bool UNITY_INTERFACE_EXPORT ConfigureReplayBuffer(int* id, const LiveCaptureNative::ReplayBufferSettings* settings)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr)
+            return false;
+
+        encoder->ConfigureReplayBuffer(settings);
+        return true;
+    }
+
+    // Writes the last durationNs of the replay buffer (all of it for 0) to a fragmented MP4 file
+    // (UTF-8 path), in the background. See GetReplayExportStats for the progress.
+    extern "C" bool UNITY_INTERFACE_EXPORT SaveReplay(int* id, const char* path, unsigned long long int durationNs)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || path == nullptr)
+            return false;
+
+        return encoder->SaveReplay(path, durationNs);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetReplayBufferStats(int* id, LiveCaptureNative::ReplayBufferStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        return encoder->GetReplayBufferStats(*stats);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetReplayExportStats(int* id, LiveCaptureNative::Fmp4RecorderStats* stats)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder == nullptr || stats == nullptr)
+            return false;
+
+        encoder->GetReplayExportStats(*stats);
+        return true;
+    }
+
+    // Pipeline trace, see TraceRecorder. The managed side records its stages through the same
+    // recorder so that all the events share one clock.
+    extern "C" void UNITY_INTERFACE_EXPORT TraceSetEnabled(bool enabled)
+    {
+        LiveCaptureNative::TraceRecorder::Get().SetEnabled(enabled);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceClear()
+    {
+        LiveCaptureNative::TraceRecorder::Get().Clear();
+    }
+
+    extern "C" int UNITY_INTERFACE_EXPORT TraceRegisterName(const char* name)
+    {
+        return LiveCaptureNative::TraceRecorder::Get().RegisterName(name);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceSetThreadName(const char* name)
+    {
+        LiveCaptureNative::TraceRecorder::Get().SetThreadName(name);
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceBegin(int nameId, unsigned long long int frameId, int flow)
+    {
+        LiveCaptureNative::TraceBeginNamed(nameId, frameId, static_cast<LiveCaptureNative::TraceFlow>(flow));
+    }
+
+    extern "C" void UNITY_INTERFACE_EXPORT TraceEnd(int nameId, unsigned long long int frameId)
+    {
+        LiveCaptureNative::TraceEndNamed(nameId, frameId);
+    }
+
+    // Writes the recorded events to a Chrome trace JSON file.
+    extern "C" bool UNITY_INTERFACE_EXPORT TraceDump(const char* path)
+    {
+        return LiveCaptureNative::TraceRecorder::Get().DumpChromeJson(path);
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT BeginConsumeSlice(int* id)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+
+        auto currentSlice = (encoder && encoder->IsInitialized())
+            ? encoder->GetEncodedSlice()
+            : nullptr;
+
+        if (currentSlice != nullptr)
+        {
+            s_EncodedSliceMap.Add(*id, currentSlice);
+        }
+        return currentSlice != nullptr;
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT EndConsumeSlice(int* id)
+    {
+        auto encoder = (id && *id > 0) ? s_EncoderMap.GetInstance(*id) : nullptr;
+        if (encoder && encoder->IsInitialized() && s_EncodedSliceMap[*id] != nullptr)
+        {
+            s_EncodedSliceMap.Remove(*id);
+            return encoder->RemoveEncodedSlice();
+        }
+        return false;
+    }
+
+    EncodedSlice* IsEncodedSliceValid(int* id)
+    {
+        if (id && *id > 0)
+            return s_EncodedSliceMap[*id];
+
+        return nullptr;
+    }
+
+    extern "C" uint32_t UNITY_INTERFACE_EXPORT GetSliceData(int* id, uint8_t * dataOut)
+    {
+        auto encodedSlice = IsEncodedSliceValid(id);
+        if (encodedSlice == nullptr)
+            return 0;
+
+        const auto sizeSliceData = encodedSlice->data.size();
+        if (dataOut != nullptr)
+        {
+            memcpy(dataOut, encodedSlice->data.data(), sizeSliceData);
+        }
+        return static_cast<uint32_t>(sizeSliceData);
+    }
+
+    extern "C" unsigned long long int UNITY_INTERFACE_EXPORT GetSliceTimeStamp(int* id)
+    {
+        auto encodedSlice = IsEncodedSliceValid(id);
+        if (encodedSlice == nullptr)
+            return 0;
+
+        return encodedSlice->timestamp;
+    }
+
+    extern "C" uint32_t UNITY_INTERFACE_EXPORT GetSliceIndex(int* id)
+    {
+        auto encodedSlice = IsEncodedSliceValid(id);
+        if (encodedSlice == nullptr)
+            return 0;
+
+        return encodedSlice->sliceIndex;
+    }
+
+    extern "C" bool UNITY_INTERFACE_EXPORT GetSliceIsLast(int* id)
+    {
+        auto encodedSlice = IsEncodedSliceValid(id);
+        if (encodedSlice == nullptr)
+            return false;
+
+        return encodedSlice->isLastSlice;
+    }
 #pragma endregion
 }
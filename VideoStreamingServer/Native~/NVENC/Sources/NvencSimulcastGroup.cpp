@@ -0,0 +1,120 @@
+#include "NvencSimulcastGroup.h"
+#include "EncoderDeviceFactory.h"
+#include "ITexture2D.h"
+#include "PluginUtils.h"
+
+namespace NvencPlugin
+{
+    static_assert(sizeof(EncoderSimulcastGroupID::encoderIds) / sizeof(int) == k_MaxSimulcastLayers,
+                  "EncoderSimulcastGroupID must hold k_MaxSimulcastLayers layers.");
+
+    NvencSimulcastGroup::~NvencSimulcastGroup()
+    {
+        ReleaseResources();
+    }
+
+    void NvencSimulcastGroup::Configure(const EncoderSimulcastGroupID& config, const EncoderLookup& getEncoder)
+    {
+        SimulcastLayerDesc layers[k_MaxSimulcastLayers];
+        int count = 0;
+
+        for (int i = 0; i < config.layerCount && i < k_MaxSimulcastLayers; ++i)
+        {
+            auto encoder = getEncoder(config.encoderIds[i]);
+            if (encoder == nullptr)
+            {
+                WriteFileDebug(LogLevel::Warning, "Warning, simulcast layer refers to an unknown encoder: ", config.encoderIds[i]);
+                continue;
+            }
+
+            layers[count++] = { config.encoderIds[i], encoder->GetFrameRate(), config.priorities[i] };
+        }
+
+        m_Scheduler.SetLayers(layers, count);
+
+        WriteFileDebug("Info, simulcast layers: ", count);
+    }
+
+    void NvencSimulcastGroup::EncodeFrame(void* frameSourceData,
+                                          int width,
+                                          int height,
+                                          unsigned long long int timeStamp,
+                                          const LiveCaptureNative::FrameTimecode& timecode,
+                                          const EncoderLookup& getEncoder)
+    {
+        if (frameSourceData == nullptr)
+        {
+            WriteFileDebug(LogLevel::Error, "Error, Encoded frame data is null.\n");
+            return;
+        }
+
+        m_Scheduler.Schedule(timeStamp, m_ScheduledLayers);
+
+        // Single copy of the source, shared by all the layers encoded for this frame.
+        bool sourceReady = false;
+
+        for (const auto id : m_ScheduledLayers)
+        {
+            auto encoder = getEncoder(id);
+            if (encoder == nullptr || !encoder->IsInitialized())
+                continue;
+
+            if (!sourceReady)
+            {
+                if (!PrepareStaging(encoder->GetGraphicsDevice(), width, height) ||
+                    !m_Device->CopyResource(static_cast<IUnknown*>(frameSourceData), m_Staging))
+                {
+                    WriteFileDebug(LogLevel::Error, "Error, simulcast source copy failed.\n");
+                    return;
+                }
+                sourceReady = true;
+            }
+
+            // All the layers must be created on the same graphics device as the staging texture.
+            if (encoder->GetGraphicsDevice() != m_Device)
+            {
+                WriteFileDebug(LogLevel::Error, "Error, simulcast layer uses another graphics device: ", id);
+                continue;
+            }
+
+            encoder->EncodeScaledFrame(m_Staging, timeStamp, timecode);
+        }
+    }
+
+    bool NvencSimulcastGroup::PrepareStaging(IGraphicsEncoderDevice* device, int width, int height)
+    {
+        if (m_Staging != nullptr && m_Device == device &&
+            m_Staging->IsSize(static_cast<uint32_t>(width), static_cast<uint32_t>(height)))
+        {
+            return true;
+        }
+
+        ReleaseResources();
+
+        if (device == nullptr || width <= 0 || height <= 0)
+            return false;
+
+        // The group keeps the device alive as long as it holds the staging texture.
+        EncoderDeviceFactory::Retain(device);
+        m_Device = device;
+        m_Staging = device->CreateDefaultTexture(static_cast<uint32_t>(width), static_cast<uint32_t>(height), false);
+
+        WriteFileDebug("Info, simulcast staging texture created.\n");
+        return m_Staging != nullptr;
+    }
+
+    void NvencSimulcastGroup::ReleaseResources()
+    {
+        if (m_Staging != nullptr)
+        {
+            delete m_Staging;
+            m_Staging = nullptr;
+        }
+
+        if (m_Device != nullptr)
+        {
+            EncoderDeviceFactory::Release(m_Device);
+            m_Device = nullptr;
+        }
+    }
+}
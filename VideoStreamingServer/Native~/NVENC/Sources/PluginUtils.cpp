@@ -7,52 +7,17 @@ namespace NvencPlugin
 {
     static const std::string k_FileName = "C:/NvencLogs/Nvenc_debug_file.txt";
 
-    void WriteFileDebug(const char* const message, const bool append)
+    void InitLog()
     {
-#ifdef DEBUG_MODE
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_FileName, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_FileName);
-        }
-
-        myfile << message;
-        myfile.close();
-#endif
-    }
-
-    void WriteFileDebug(const char* const message, int value, const bool append)
-    {
-#ifdef DEBUG_MODE
-        std::ofstream myfile;
-
-        if (append)
-        {
-            myfile.open(k_FileName, std::ios_base::app | std::ios_base::out);
-        }
-        else
-        {
-            myfile.open(k_FileName);
-        }
-
-        myfile << message << value << "\n";
-        myfile.close();
+#if LIVECAPTURE_LOG_LEVEL < 4
+        LiveCaptureNative::AsyncLogger::Get().Open(k_FileName);
 #endif
     }
 
-    void WriteFileDebug(const char* const message, NVENCSTATUS status, const bool append)
+    void CloseLog()
     {
-#ifdef DEBUG_MODE
-        std::ostringstream errorLog;
-        WriteFileDebug(message, append);
-        errorLog << "Error is: " << status << "\n";
-        auto test = errorLog.str();
-        WriteFileDebug(test.c_str(), append);
+#if LIVECAPTURE_LOG_LEVEL < 4
+        LiveCaptureNative::AsyncLogger::Get().Close();
 #endif
     }
 }
@@ -33,14 +33,48 @@ namespace NvencPlugin
         desc.CPUAccessFlags = 0;
         pDevice->CreateTexture2D(&desc, NULL, &m_TexBgra);
 
-        pDevice->QueryInterface(__uuidof(ID3D11VideoDevice), (void**)&m_VideoDevice);
-        pContext->QueryInterface(__uuidof(ID3D11VideoContext), (void**)&m_VideoContext);
+        CreateVideoProcessor(desc.Width, desc.Height, desc.Width, desc.Height);
+    }
 
+    RGBToNV12ConverterD3D11::RGBToNV12ConverterD3D11(ID3D11Device* const pDevice,
+                                                     ID3D11DeviceContext* const pContext,
+                                                     ID3D11Texture2D* const pSourceTexture,
+                                                     const int nOutWidth,
+                                                     const int nOutHeight) :
+        m_D3D11Device(pDevice),
+        m_D3D11Context(pContext),
+        m_VideoDevice(nullptr),
+        m_VideoContext(nullptr),
+        m_VideoProcessor(nullptr),
+        m_TexBgra(pSourceTexture),
+        m_InputView(nullptr),
+        m_OutputView(nullptr),
+        m_VideoProcessorEnumerator(nullptr)
+    {
+        m_D3D11Device->AddRef();
+        m_D3D11Context->AddRef();
+        m_TexBgra->AddRef();
+
+        D3D11_TEXTURE2D_DESC desc;
+        m_TexBgra->GetDesc(&desc);
+
+        CreateVideoProcessor(desc.Width, desc.Height, static_cast<UINT>(nOutWidth), static_cast<UINT>(nOutHeight));
+    }
+
+    void RGBToNV12ConverterD3D11::CreateVideoProcessor(const UINT nInWidth,
+                                                       const UINT nInHeight,
+                                                       const UINT nOutWidth,
+                                                       const UINT nOutHeight)
+    {
+        m_D3D11Device->QueryInterface(__uuidof(ID3D11VideoDevice), (void**)&m_VideoDevice);
+        m_D3D11Context->QueryInterface(__uuidof(ID3D11VideoContext), (void**)&m_VideoContext);
+
+        // The video processor scales the input to the output size when they differ.
         D3D11_VIDEO_PROCESSOR_CONTENT_DESC contentDesc =
         {
             D3D11_VIDEO_FRAME_FORMAT_PROGRESSIVE,
-            { 1, 1 }, desc.Width, desc.Height,
-            { 1, 1 }, desc.Width, desc.Height,
+            { 1, 1 }, nInWidth, nInHeight,
+            { 1, 1 }, nOutWidth, nOutHeight,
             D3D11_VIDEO_USAGE_PLAYBACK_NORMAL
         };
 
@@ -111,13 +145,22 @@ namespace NvencPlugin
         m_D3D11Device->Release();
     }
 
-    bool RGBToNV12ConverterD3D11::ConvertRGBToNV12(ID3D11Texture2D* const pRGBSrcTexture,
-                                                   ID3D11Texture2D* const pDestTexture)
+    bool RGBToNV12ConverterD3D11::ConvertRGBToNV12(void* const pRGBSrcTexture, void* const pDestTexture)
     {
         if (!m_IsValid)
             return false;
 
-        m_D3D11Context->CopyResource(m_TexBgra, pRGBSrcTexture);
+        m_D3D11Context->CopyResource(m_TexBgra, static_cast<ID3D11Texture2D*>(pRGBSrcTexture));
+
+        return ConvertToNV12(pDestTexture);
+    }
+
+    bool RGBToNV12ConverterD3D11::ConvertToNV12(void* const pDestTextureHandle)
+    {
+        auto pDestTexture = static_cast<ID3D11Texture2D*>(pDestTextureHandle);
+        if (!m_IsValid || pDestTexture == nullptr)
+            return false;
+
         ID3D11VideoProcessorOutputView* pOutputView = nullptr;
         auto it = m_OutputViewMap.find(pDestTexture);
         if (it == m_OutputViewMap.end())
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Socket.h"
+
+namespace LiveCaptureNative
+{
+    // Readiness notifications for the sockets of the RTSP server, on one thread: epoll on Linux,
+    // kqueue on macOS and WSAPoll on Windows. Each socket is registered with the events it waits
+    // for and a context pointer handed back when it is ready.
+    //
+    // Wake() interrupts Wait() from another thread, through a loopback UDP socket sending to
+    // itself, which every backend can wait on.
+    class EventLoop final
+    {
+    public:
+        enum Events : uint32_t
+        {
+            k_Readable = 1,
+            k_Writable = 2,
+            k_Closed = 4, // Error or hang up, reported whatever the events asked for.
+        };
+
+        struct Event
+        {
+            void*    context;
+            uint32_t events;
+        };
+
+        EventLoop();
+        ~EventLoop();
+
+        EventLoop(const EventLoop&) = delete;
+        EventLoop& operator=(const EventLoop&) = delete;
+
+        bool Initialize();
+
+        bool Add(Net::SocketHandle socket, uint32_t events, void* context);
+        bool Modify(Net::SocketHandle socket, uint32_t events, void* context);
+        void Remove(Net::SocketHandle socket);
+
+        // Waits up to timeoutMs for events and returns them, without the wake ups. Returns false
+        // on an error of the backend.
+        bool Wait(int timeoutMs, std::vector<Event>& events);
+
+        // Any thread: makes the current or next Wait() return.
+        void Wake();
+
+    private:
+        void DrainWakeUps();
+
+        Net::SocketHandle m_WakeSocket;
+
+#if defined(__linux__) || defined(__APPLE__)
+        int m_Handle;
+#else
+        std::vector<pollfd> m_Sockets;
+        std::vector<void*>  m_Contexts;
+#endif
+    };
+}
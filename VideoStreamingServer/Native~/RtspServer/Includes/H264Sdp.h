@@ -0,0 +1,289 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace LiveCaptureNative
+{
+    // The session description of the H264 stream (RFC 6184 section 8.2.1), built from the
+    // parameter sets of the encoder: the profile and level come from the SPS, which is also
+    // parsed for the picture size, and both parameter sets are carried in sprop-parameter-sets
+    // so a client can set up its decoder before the first key frame.
+    namespace H264Sdp
+    {
+        struct SpsInfo
+        {
+            uint8_t  profile;
+            uint8_t  constraints;
+            uint8_t  level;
+            uint32_t width;
+            uint32_t height;
+        };
+
+        namespace Detail
+        {
+            // Exp-Golomb bit reader over an RBSP (emulation prevention bytes removed).
+            class BitReader final
+            {
+            public:
+                BitReader(const uint8_t* data, size_t size) :
+                    m_Data(data),
+                    m_Size(size),
+                    m_Position(0),
+                    m_IsOverrun(false)
+                {
+                }
+
+                uint32_t ReadBits(uint32_t count)
+                {
+                    uint32_t value = 0;
+                    for (uint32_t i = 0; i < count; ++i)
+                    {
+                        value = (value << 1) | ReadBit();
+                    }
+                    return value;
+                }
+
+                uint32_t ReadUnsigned()
+                {
+                    uint32_t zeros = 0;
+                    while (ReadBit() == 0 && !m_IsOverrun && zeros < 32)
+                    {
+                        ++zeros;
+                    }
+                    if (zeros >= 32)
+                    {
+                        m_IsOverrun = true;
+                        return 0;
+                    }
+                    return ((1u << zeros) - 1) + ReadBits(zeros);
+                }
+
+                int32_t ReadSigned()
+                {
+                    const auto value = ReadUnsigned();
+                    return (value & 1) ? static_cast<int32_t>((value + 1) / 2) : -static_cast<int32_t>(value / 2);
+                }
+
+                bool IsOverrun() const { return m_IsOverrun; }
+
+            private:
+                uint32_t ReadBit()
+                {
+                    if (m_Position >= m_Size * 8)
+                    {
+                        m_IsOverrun = true;
+                        return 0;
+                    }
+                    const auto bit = (m_Data[m_Position / 8] >> (7 - m_Position % 8)) & 1;
+                    ++m_Position;
+                    return bit;
+                }
+
+                const uint8_t* m_Data;
+                size_t         m_Size;
+                size_t         m_Position;
+                bool           m_IsOverrun;
+            };
+
+            inline void SkipScalingList(BitReader& reader, int size)
+            {
+                int32_t last = 8;
+                int32_t next = 8;
+                for (int i = 0; i < size && next != 0; ++i)
+                {
+                    next = (last + reader.ReadSigned() + 256) % 256;
+                    if (next != 0)
+                        last = next;
+                }
+            }
+        }
+
+        // Parses a SPS NAL unit (with its header byte, no start code). Returns false if it isn't one
+        // or is truncated.
+        inline bool ParseSps(const uint8_t* nal, size_t size, SpsInfo& info)
+        {
+            if (nal == nullptr || size < 4 || (nal[0] & 0x1f) != 7)
+                return false;
+
+            std::vector<uint8_t> rbsp;
+            rbsp.reserve(size);
+            for (size_t i = 1; i < size; ++i)
+            {
+                if (i + 2 < size && nal[i] == 0 && nal[i + 1] == 0 && nal[i + 2] == 3)
+                {
+                    rbsp.push_back(0);
+                    rbsp.push_back(0);
+                    i += 2;
+                    continue;
+                }
+                rbsp.push_back(nal[i]);
+            }
+
+            Detail::BitReader reader(rbsp.data(), rbsp.size());
+            info.profile = static_cast<uint8_t>(reader.ReadBits(8));
+            info.constraints = static_cast<uint8_t>(reader.ReadBits(8));
+            info.level = static_cast<uint8_t>(reader.ReadBits(8));
+            reader.ReadUnsigned(); // seq_parameter_set_id
+
+            uint32_t chromaFormat = 1;
+            switch (info.profile)
+            {
+                case 100: case 110: case 122: case 244: case 44: case 83: case 86: case 118: case 128: case 138: case 139: case 134: case 135:
+                {
+                    chromaFormat = reader.ReadUnsigned();
+                    if (chromaFormat == 3)
+                        reader.ReadBits(1); // separate_colour_plane_flag
+                    reader.ReadUnsigned();  // bit_depth_luma_minus8
+                    reader.ReadUnsigned();  // bit_depth_chroma_minus8
+                    reader.ReadBits(1);     // qpprime_y_zero_transform_bypass_flag
+                    if (reader.ReadBits(1)) // seq_scaling_matrix_present_flag
+                    {
+                        const auto count = (chromaFormat != 3) ? 8 : 12;
+                        for (int i = 0; i < count; ++i)
+                        {
+                            if (reader.ReadBits(1))
+                                Detail::SkipScalingList(reader, (i < 6) ? 16 : 64);
+                        }
+                    }
+                    break;
+                }
+                default:
+                    break;
+            }
+
+            reader.ReadUnsigned(); // log2_max_frame_num_minus4
+            const auto pocType = reader.ReadUnsigned();
+            if (pocType == 0)
+            {
+                reader.ReadUnsigned(); // log2_max_pic_order_cnt_lsb_minus4
+            }
+            else if (pocType == 1)
+            {
+                reader.ReadBits(1);    // delta_pic_order_always_zero_flag
+                reader.ReadSigned();   // offset_for_non_ref_pic
+                reader.ReadSigned();   // offset_for_top_to_bottom_field
+                const auto cycle = reader.ReadUnsigned();
+                for (uint32_t i = 0; i < cycle && !reader.IsOverrun(); ++i)
+                {
+                    reader.ReadSigned();
+                }
+            }
+            reader.ReadUnsigned(); // max_num_ref_frames
+            reader.ReadBits(1);    // gaps_in_frame_num_value_allowed_flag
+
+            const auto widthInMbs = reader.ReadUnsigned() + 1;
+            const auto heightInMapUnits = reader.ReadUnsigned() + 1;
+            const auto frameMbsOnly = reader.ReadBits(1);
+            if (!frameMbsOnly)
+                reader.ReadBits(1); // mb_adaptive_frame_field_flag
+            reader.ReadBits(1);     // direct_8x8_inference_flag
+
+            uint32_t cropLeft = 0;
+            uint32_t cropRight = 0;
+            uint32_t cropTop = 0;
+            uint32_t cropBottom = 0;
+            if (reader.ReadBits(1))
+            {
+                cropLeft = reader.ReadUnsigned();
+                cropRight = reader.ReadUnsigned();
+                cropTop = reader.ReadUnsigned();
+                cropBottom = reader.ReadUnsigned();
+            }
+            if (reader.IsOverrun())
+                return false;
+
+            // Crop units, for 4:2:0 and 4:2:2 chroma (4:4:4 and monochrome crop by luma samples).
+            const uint32_t cropX = (chromaFormat == 1 || chromaFormat == 2) ? 2 : 1;
+            const uint32_t cropY = ((chromaFormat == 1) ? 2 : 1) * (2 - frameMbsOnly);
+
+            const auto width = widthInMbs * 16;
+            const auto height = heightInMapUnits * 16 * (2 - frameMbsOnly);
+            const auto cropWidth = (cropLeft + cropRight) * cropX;
+            const auto cropHeight = (cropTop + cropBottom) * cropY;
+            if (cropWidth >= width || cropHeight >= height)
+                return false;
+
+            info.width = width - cropWidth;
+            info.height = height - cropHeight;
+            return true;
+        }
+
+        inline std::string EncodeBase64(const uint8_t* data, size_t size)
+        {
+            static const char k_Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+            std::string text;
+            text.reserve((size + 2) / 3 * 4);
+            for (size_t i = 0; i < size; i += 3)
+            {
+                const uint32_t value = (static_cast<uint32_t>(data[i]) << 16) |
+                    ((i + 1 < size) ? static_cast<uint32_t>(data[i + 1]) << 8 : 0) |
+                    ((i + 2 < size) ? data[i + 2] : 0);
+
+                text += k_Alphabet[(value >> 18) & 0x3f];
+                text += k_Alphabet[(value >> 12) & 0x3f];
+                text += (i + 1 < size) ? k_Alphabet[(value >> 6) & 0x3f] : '=';
+                text += (i + 2 < size) ? k_Alphabet[value & 0x3f] : '=';
+            }
+            return text;
+        }
+
+        // The SDP of the stream. sps and pps may be empty until the encoder produced them, the
+        // client then reads them in band.
+        inline std::string Build(const std::vector<uint8_t>& sps,
+                                 const std::vector<uint8_t>& pps,
+                                 uint8_t payloadType,
+                                 uint64_t sessionId,
+                                 const char* localAddress)
+        {
+            char line[256];
+            std::string sdp;
+
+            std::snprintf(line, sizeof(line), "v=0\r\no=- %llu 1 IN IP4 %s\r\n", static_cast<unsigned long long>(sessionId), localAddress);
+            sdp += line;
+            sdp += "s=Live Capture\r\n";
+            sdp += "c=IN IP4 0.0.0.0\r\n";
+            sdp += "t=0 0\r\n";
+            sdp += "a=control:*\r\n";
+            sdp += "a=range:npt=0-\r\n";
+
+            std::snprintf(line, sizeof(line), "m=video 0 RTP/AVP %u\r\na=rtpmap:%u H264/90000\r\n", payloadType, payloadType);
+            sdp += line;
+
+            std::snprintf(line, sizeof(line), "a=fmtp:%u packetization-mode=1", payloadType);
+            sdp += line;
+
+            SpsInfo info;
+            const auto hasSps = ParseSps(sps.data(), sps.size(), info);
+            if (hasSps)
+            {
+                std::snprintf(line, sizeof(line), ";profile-level-id=%02x%02x%02x", info.profile, info.constraints, info.level);
+                sdp += line;
+            }
+            if (!sps.empty() && !pps.empty())
+            {
+                sdp += ";sprop-parameter-sets=";
+                sdp += EncodeBase64(sps.data(), sps.size());
+                sdp += ',';
+                sdp += EncodeBase64(pps.data(), pps.size());
+            }
+            sdp += "\r\n";
+
+            if (hasSps)
+            {
+                std::snprintf(line, sizeof(line), "a=framesize:%u %u-%u\r\n", payloadType, info.width, info.height);
+                sdp += line;
+            }
+
+            // Lost packets are retransmitted on NACK (RFC 4585).
+            std::snprintf(line, sizeof(line), "a=rtcp-fb:%u nack\r\n", payloadType);
+            sdp += line;
+            sdp += "a=control:trackID=0\r\n";
+            return sdp;
+        }
+    }
+}
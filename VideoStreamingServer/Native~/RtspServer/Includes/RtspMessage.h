@@ -0,0 +1,349 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace LiveCaptureNative
+{
+    // RTSP 1.0 requests (RFC 2326) read from a connection, and the replies written to it. The
+    // parser is incremental: it is handed what the connection received so far and returns
+    // Incomplete until a whole request is there, so it never blocks the event loop. A client
+    // may also send interleaved RTCP ('$' frames) on the connection, they are returned apart.
+    namespace Rtsp
+    {
+        // Longest request accepted, headers and body, before the connection is considered broken.
+        const size_t k_MaxRequestSize = 16 * 1024;
+
+        enum class ParseResult
+        {
+            Incomplete,  // Wait for more bytes.
+            Request,     // A request was read.
+            Interleaved, // An interleaved frame was read.
+            Invalid,     // Malformed or too long, reply 400 and close the connection.
+        };
+
+        struct Request
+        {
+            std::string                                      method;
+            std::string                                      uri;
+            std::vector<std::pair<std::string, std::string>> headers;
+            std::string                                      body;
+            int32_t                                          cseq;
+
+            // Header value by case-insensitive name, nullptr if missing.
+            const std::string* GetHeader(const char* name) const
+            {
+                for (const auto& header : headers)
+                {
+                    if (EqualsIgnoreCase(header.first, name))
+                        return &header.second;
+                }
+                return nullptr;
+            }
+
+            static bool EqualsIgnoreCase(const std::string& a, const char* b)
+            {
+                const auto size = std::strlen(b);
+                if (a.size() != size)
+                    return false;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    if (ToLower(a[i]) != ToLower(b[i]))
+                        return false;
+                }
+                return true;
+            }
+
+            static char ToLower(char c) { return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c; }
+        };
+
+        // An interleaved frame received from a client: its channel and the packet it carries.
+        struct InterleavedFrame
+        {
+            uint8_t        channel;
+            const uint8_t* data;
+            size_t         size;
+        };
+
+        namespace Detail
+        {
+            inline std::string Trim(const char* begin, const char* end)
+            {
+                while (begin < end && (*begin == ' ' || *begin == '\t'))
+                {
+                    ++begin;
+                }
+                while (end > begin && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r'))
+                {
+                    --end;
+                }
+                return std::string(begin, end);
+            }
+
+            inline const char* FindHeaderEnd(const char* data, size_t size)
+            {
+                for (size_t i = 0; i + 3 < size; ++i)
+                {
+                    if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n')
+                        return data + i + 4;
+                }
+                return nullptr;
+            }
+        }
+
+        // Reads the request or interleaved frame at the start of data. On Request and Interleaved,
+        // consumed is the number of bytes it spans; the frame points into data.
+        inline ParseResult Parse(const uint8_t* data, size_t size, size_t& consumed, Request& request, InterleavedFrame& frame)
+        {
+            consumed = 0;
+            if (size == 0)
+                return ParseResult::Incomplete;
+
+            if (data[0] == '$')
+            {
+                if (size < 4)
+                    return ParseResult::Incomplete;
+
+                const size_t frameSize = (static_cast<size_t>(data[2]) << 8) | data[3];
+                if (size - 4 < frameSize)
+                    return ParseResult::Incomplete;
+
+                frame.channel = data[1];
+                frame.data = data + 4;
+                frame.size = frameSize;
+                consumed = 4 + frameSize;
+                return ParseResult::Interleaved;
+            }
+
+            const auto text = reinterpret_cast<const char*>(data);
+            const auto headerEnd = Detail::FindHeaderEnd(text, size);
+            if (headerEnd == nullptr)
+                return (size > k_MaxRequestSize) ? ParseResult::Invalid : ParseResult::Incomplete;
+
+            // Request line: method, URI, version.
+            auto lineEnd = static_cast<const char*>(std::memchr(text, '\n', headerEnd - text));
+            const auto firstSpace = static_cast<const char*>(std::memchr(text, ' ', lineEnd - text));
+            if (firstSpace == nullptr)
+                return ParseResult::Invalid;
+            const auto secondSpace = static_cast<const char*>(std::memchr(firstSpace + 1, ' ', lineEnd - firstSpace - 1));
+            if (secondSpace == nullptr || Detail::Trim(secondSpace + 1, lineEnd).compare(0, 5, "RTSP/") != 0)
+                return ParseResult::Invalid;
+
+            request.method.assign(text, firstSpace);
+            request.uri.assign(firstSpace + 1, secondSpace);
+            request.headers.clear();
+            request.body.clear();
+            request.cseq = -1;
+
+            size_t contentLength = 0;
+            for (auto line = lineEnd + 1; line < headerEnd - 2; line = lineEnd + 1)
+            {
+                lineEnd = static_cast<const char*>(std::memchr(line, '\n', headerEnd - line));
+                const auto colon = static_cast<const char*>(std::memchr(line, ':', lineEnd - line));
+                if (colon == nullptr)
+                    return ParseResult::Invalid;
+
+                request.headers.emplace_back(Detail::Trim(line, colon), Detail::Trim(colon + 1, lineEnd));
+                const auto& header = request.headers.back();
+                if (Request::EqualsIgnoreCase(header.first, "CSeq"))
+                {
+                    request.cseq = std::atoi(header.second.c_str());
+                }
+                else if (Request::EqualsIgnoreCase(header.first, "Content-Length"))
+                {
+                    contentLength = static_cast<size_t>(std::strtoul(header.second.c_str(), nullptr, 10));
+                }
+            }
+
+            const auto headerSize = static_cast<size_t>(headerEnd - text);
+            if (contentLength > k_MaxRequestSize - std::min(headerSize, k_MaxRequestSize))
+                return ParseResult::Invalid;
+            if (size - headerSize < contentLength)
+                return ParseResult::Incomplete;
+
+            request.body.assign(headerEnd, contentLength);
+            consumed = headerSize + contentLength;
+            return ParseResult::Request;
+        }
+
+        inline const char* GetReasonPhrase(int status)
+        {
+            switch (status)
+            {
+                case 200: return "OK";
+                case 400: return "Bad Request";
+                case 404: return "Not Found";
+                case 405: return "Method Not Allowed";
+                case 454: return "Session Not Found";
+                case 455: return "Method Not Valid in This State";
+                case 459: return "Aggregate Operation Not Allowed";
+                case 461: return "Unsupported Transport";
+                case 500: return "Internal Server Error";
+                case 503: return "Service Unavailable";
+                default: return "Error";
+            }
+        }
+
+        // Builds a reply: status line and CSeq, then the headers added, then the body.
+        class Response final
+        {
+        public:
+            // cseq is negative when the request had none, e.g. a 400 reply.
+            Response(int status, int32_t cseq)
+            {
+                char line[96];
+                std::snprintf(line, sizeof(line), "RTSP/1.0 %d %s\r\n", status, GetReasonPhrase(status));
+                m_Text = line;
+                if (cseq >= 0)
+                {
+                    std::snprintf(line, sizeof(line), "CSeq: %d\r\n", static_cast<int>(cseq));
+                    m_Text += line;
+                }
+                m_Text += "Server: Live Capture\r\n";
+            }
+
+            void AddHeader(const char* name, const std::string& value)
+            {
+                m_Text += name;
+                m_Text += ": ";
+                m_Text += value;
+                m_Text += "\r\n";
+            }
+
+            // Ends the headers, with the body and its type if there is one.
+            const std::string& Finish(const char* contentType = nullptr, const std::string& body = std::string())
+            {
+                if (contentType != nullptr)
+                {
+                    AddHeader("Content-Type", contentType);
+                    AddHeader("Content-Length", std::to_string(body.size()));
+                }
+                m_Text += "\r\n";
+                m_Text += body;
+                return m_Text;
+            }
+
+        private:
+            std::string m_Text;
+        };
+
+        // What the client asked for in the Transport header of SETUP, the first of its choices the
+        // server supports: unicast UDP to a port pair, or interleaved in the RTSP connection.
+        struct Transport
+        {
+            bool     isInterleaved;
+            uint16_t clientRtpPort;
+            uint16_t clientRtcpPort;
+            uint8_t  rtpChannel;
+            uint8_t  rtcpChannel;
+        };
+
+        namespace Detail
+        {
+            // "a-b" or "a", b is a + 1 when missing.
+            inline bool ParsePair(const std::string& value, uint32_t max, uint32_t& first, uint32_t& second)
+            {
+                char* end = nullptr;
+                const auto a = std::strtoul(value.c_str(), &end, 10);
+                if (end == value.c_str() || a > max)
+                    return false;
+
+                auto b = a + 1;
+                if (*end == '-')
+                {
+                    const auto start = end + 1;
+                    b = std::strtoul(start, &end, 10);
+                    if (end == start)
+                        return false;
+                }
+                if (b > max)
+                    return false;
+
+                first = static_cast<uint32_t>(a);
+                second = static_cast<uint32_t>(b);
+                return true;
+            }
+
+            inline bool ParseTransportSpec(const std::string& spec, Transport& transport)
+            {
+                bool isTcp = false;
+                bool isMulticast = false;
+                bool hasPorts = false;
+                bool hasChannels = false;
+
+                size_t begin = 0;
+                for (size_t index = 0; begin <= spec.size(); ++index)
+                {
+                    auto end = spec.find(';', begin);
+                    if (end == std::string::npos)
+                        end = spec.size();
+                    const auto parameter = Trim(spec.c_str() + begin, spec.c_str() + end);
+                    begin = end + 1;
+
+                    if (index == 0)
+                    {
+                        if (parameter == "RTP/AVP/TCP")
+                            isTcp = true;
+                        else if (parameter != "RTP/AVP" && parameter != "RTP/AVP/UDP")
+                            return false;
+                        continue;
+                    }
+
+                    uint32_t first = 0;
+                    uint32_t second = 0;
+                    if (parameter == "multicast")
+                    {
+                        isMulticast = true;
+                    }
+                    else if (parameter.compare(0, 12, "client_port=") == 0 && ParsePair(parameter.substr(12), 0xffff, first, second))
+                    {
+                        transport.clientRtpPort = static_cast<uint16_t>(first);
+                        transport.clientRtcpPort = static_cast<uint16_t>(second);
+                        hasPorts = first != 0;
+                    }
+                    else if (parameter.compare(0, 12, "interleaved=") == 0 && ParsePair(parameter.substr(12), 0xff, first, second))
+                    {
+                        transport.rtpChannel = static_cast<uint8_t>(first);
+                        transport.rtcpChannel = static_cast<uint8_t>(second);
+                        hasChannels = true;
+                    }
+                }
+
+                if (isMulticast)
+                    return false;
+
+                transport.isInterleaved = isTcp;
+                if (isTcp && !hasChannels)
+                {
+                    transport.rtpChannel = 0;
+                    transport.rtcpChannel = 1;
+                }
+                return isTcp || hasPorts;
+            }
+        }
+
+        inline bool ParseTransport(const std::string& header, Transport& transport)
+        {
+            size_t begin = 0;
+            while (begin <= header.size())
+            {
+                auto end = header.find(',', begin);
+                if (end == std::string::npos)
+                    end = header.size();
+
+                transport = Transport();
+                if (Detail::ParseTransportSpec(header.substr(begin, end - begin), transport))
+                    return true;
+                begin = end + 1;
+            }
+            return false;
+        }
+    }
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "EventLoop.h"
+#include "H264RtpPacketizer.h"
+#include "RtpFanout.h"
+#include "RtpInterleavedSender.h"
+#include "RtpRetransmissionBuffer.h"
+#include "RtspMessage.h"
+#include "Socket.h"
+
+namespace LiveCaptureNative
+{
+    // Blittable: the layout is mirrored by the C# RtspServerSettings, keep both in sync. Zero
+    // fields select the defaults.
+    struct RtspServerSettings
+    {
+        int32_t port;                   // RTSP port, 0 lets the system pick one.
+        int32_t rtpPort;                // First port tried for the RTP/RTCP pair of the UDP clients.
+        int32_t maxPayloadSize;         // Of the RTP packets, below the path MTU.
+        int32_t interleavedPolicy;      // BackpressurePolicy of the TCP clients.
+        int32_t interleavedQueueLength; // Access units waiting for the socket of a TCP client.
+        int32_t sessionTimeoutSeconds;  // Without RTSP or RTCP, a UDP session is closed.
+        int32_t retransmissionCapacityKB;
+    };
+
+    // Blittable, mirrored by the C# RtspServerStats.
+    struct RtspServerStats
+    {
+        int32_t  connections;
+        int32_t  playingClients;
+        uint64_t accessUnitsPushed;
+        uint64_t packetsSent;          // UDP, all clients together.
+        uint64_t packetsDropped;       // UDP, the socket buffer was full.
+        uint64_t packetsRetransmitted; // UDP, on NACK.
+        uint64_t interleavedBytesSent;
+        uint64_t interleavedDropped;   // Access units dropped by the backpressure policy of the TCP clients.
+    };
+
+    // RTSP server of one H264 stream, replacing the managed RtspServer and RTSPListener on the
+    // video path. One event loop thread accepts the connections, parses the requests with
+    // Rtsp::Parse, keeps the session of each connection (SETUP, PLAY, PAUSE, TEARDOWN) and reads
+    // the RTCP feedback of the clients. The encoder thread pushes each encoded frame once with
+    // PushFrame(): it is packetized once and sent from that thread to every playing client,
+    //   - over UDP, from one RTP/RTCP socket pair shared by all the clients (RtpFanout), with
+    //     the NACKed packets retransmitted from a RtpRetransmissionBuffer;
+    //   - or interleaved in the RTSP connection (RtpInterleavedSender), with the backpressure
+    //     policy of the settings when the client can't keep up.
+    // The UDP clients share the SSRC and the sequence numbers of the stream, so one history
+    // serves all their NACKs. A client starts receiving at the next key frame.
+    //
+    // The connections and sessions are guarded by m_Mutex, the encoder thread only holds it to
+    // take a snapshot of the playing clients and never while sending.
+    class RtspServerCore final
+    {
+    public:
+        static const int32_t k_DefaultRtpPort = 50000;
+        static const int32_t k_RtpPortRange = 1000;
+        static const int32_t k_DefaultSessionTimeoutSeconds = 60;
+
+        explicit RtspServerCore(const RtspServerSettings& settings);
+        ~RtspServerCore();
+
+        RtspServerCore(const RtspServerCore&) = delete;
+        RtspServerCore& operator=(const RtspServerCore&) = delete;
+
+        // Binds the sockets and starts the event loop.
+        bool Start();
+
+        // Not concurrent with PushFrame().
+        void Stop();
+
+        uint16_t GetPort() const { return m_Port; }
+
+        // Encoder thread: sends an encoded frame to the playing clients. The parameter sets are
+        // NAL units without start code, empty when unchanged; the picture is Annex B.
+        bool PushFrame(const uint8_t* sps,
+                       size_t spsSize,
+                       const uint8_t* pps,
+                       size_t ppsSize,
+                       const uint8_t* picture,
+                       size_t pictureSize,
+                       uint64_t timestampNs);
+
+        int32_t GetPlayingCount() const;
+        void GetStats(RtspServerStats& stats) const;
+
+    private:
+        enum class SessionState
+        {
+            None,
+            Ready,   // After SETUP.
+            Playing, // After PLAY.
+        };
+
+        // The socket of a connection, shared with the encoder thread once its client receives
+        // interleaved packets, so that it is only closed after the last send.
+        struct ConnectionSocket
+        {
+            Net::SocketHandle                     handle;
+            std::unique_ptr<RtpInterleavedSender> sender; // Set by an interleaved SETUP.
+
+            explicit ConnectionSocket(Net::SocketHandle socket) : handle(socket) {}
+            ~ConnectionSocket() { Net::Close(handle); }
+        };
+
+        struct Connection
+        {
+            std::shared_ptr<ConnectionSocket> socket;
+            std::vector<uint8_t>              input;
+            std::string                       output; // Replies not written yet, before an interleaved SETUP.
+            uint32_t                          events; // Registered with the event loop.
+            uint64_t                          lastActivityNs;
+            bool                              isClosing;
+            Net::Endpoint                     peer;
+            std::string                       localAddress;
+
+            SessionState       state;
+            std::string        sessionId;
+            Rtsp::Transport    transport;
+            Net::Endpoint      rtpEndpoint;  // UDP clients.
+            Net::Endpoint      rtcpEndpoint;
+            int32_t            fanoutClient; // RtpFanout::k_InvalidClient until the first key frame.
+            bool               isWaitingForKeyFrame;
+        };
+
+        void Run();
+        void Accept();
+        void Read(Connection& connection);
+        void ReadRtcp();
+        void HandleRequest(Connection& connection, const Rtsp::Request& request);
+        void HandleSetup(Connection& connection, const Rtsp::Request& request);
+        void Reply(Connection& connection, const std::string& text);
+        void WriteOutput(Connection& connection);
+        void UpdateEvents(Connection& connection);
+        void EndSession(Connection& connection);
+        void CloseConnection(Connection& connection);
+        void CloseExpired(uint64_t nowNs);
+        bool IsSession(const Connection& connection, const Rtsp::Request& request) const;
+        bool BindRtpSockets();
+
+        const RtspServerSettings m_Settings;
+
+        EventLoop         m_Loop;
+        std::thread       m_Thread;
+        std::atomic<bool> m_IsRunning;
+
+        Net::SocketHandle m_Listener;
+        Net::SocketHandle m_RtpSocket;
+        Net::SocketHandle m_RtcpSocket;
+        uint16_t          m_Port;
+        uint16_t          m_RtpPort;
+        uint32_t          m_Ssrc;
+        uint64_t          m_SessionVersion;
+
+        mutable std::mutex                       m_Mutex;
+        std::vector<std::unique_ptr<Connection>> m_Connections;
+        std::vector<uint8_t>                     m_Sps;
+        std::vector<uint8_t>                     m_Pps;
+
+        // Encoder thread.
+        H264RtpPacketizer                              m_Packetizer;
+        std::unique_ptr<RtpFanout>                     m_Fanout; // On the RTP socket, created by Start().
+        RtpRetransmissionBuffer                        m_History;
+        uint16_t                                       m_Sequence; // Of the next UDP packet.
+        std::vector<uint8_t>                           m_AccessUnit;
+        std::vector<uint8_t>                           m_Packet;
+        std::vector<std::shared_ptr<ConnectionSocket>> m_InterleavedClients;
+
+        std::atomic<uint64_t> m_AccessUnitsPushed;
+        std::atomic<uint64_t> m_PacketsRetransmitted;
+
+        // Of the interleaved senders of the closed connections.
+        uint64_t m_ClosedInterleavedBytesSent;
+        uint64_t m_ClosedInterleavedDropped;
+    };
+}
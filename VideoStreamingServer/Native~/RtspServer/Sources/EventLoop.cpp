@@ -0,0 +1,281 @@
+#include "EventLoop.h"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#elif defined(__APPLE__)
+#include <sys/event.h>
+#include <sys/time.h>
+#endif
+
+namespace LiveCaptureNative
+{
+    namespace
+    {
+        const size_t k_MaxEvents = 64;
+    }
+
+    EventLoop::EventLoop() :
+        m_WakeSocket(Net::k_InvalidSocket)
+#if defined(__linux__) || defined(__APPLE__)
+        , m_Handle(-1)
+#endif
+    {
+    }
+
+    EventLoop::~EventLoop()
+    {
+        if (m_WakeSocket != Net::k_InvalidSocket)
+            Net::Close(m_WakeSocket);
+#if defined(__linux__) || defined(__APPLE__)
+        if (m_Handle >= 0)
+            close(m_Handle);
+#endif
+    }
+
+    bool EventLoop::Initialize()
+    {
+#if defined(__linux__)
+        m_Handle = epoll_create1(EPOLL_CLOEXEC);
+#elif defined(__APPLE__)
+        m_Handle = kqueue();
+#endif
+#if defined(__linux__) || defined(__APPLE__)
+        if (m_Handle < 0)
+            return false;
+#endif
+
+        // The wake up socket sends to itself on the loopback interface.
+        m_WakeSocket = socket(AF_INET, SOCK_DGRAM, 0);
+        if (m_WakeSocket == Net::k_InvalidSocket)
+            return false;
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        Net::SocketLength size = sizeof(address);
+        if (bind(m_WakeSocket, reinterpret_cast<sockaddr*>(&address), size) != 0 ||
+            getsockname(m_WakeSocket, reinterpret_cast<sockaddr*>(&address), &size) != 0 ||
+            connect(m_WakeSocket, reinterpret_cast<sockaddr*>(&address), size) != 0 ||
+            !Net::SetNonBlocking(m_WakeSocket))
+            return false;
+
+        return Add(m_WakeSocket, k_Readable, this);
+    }
+
+#if defined(__linux__)
+    namespace
+    {
+        uint32_t ToEpoll(uint32_t events)
+        {
+            return ((events & EventLoop::k_Readable) ? static_cast<uint32_t>(EPOLLIN) : 0u) |
+                   ((events & EventLoop::k_Writable) ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        }
+    }
+
+    bool EventLoop::Add(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        epoll_event event = {};
+        event.events = ToEpoll(events);
+        event.data.ptr = context;
+        return epoll_ctl(m_Handle, EPOLL_CTL_ADD, socket, &event) == 0;
+    }
+
+    bool EventLoop::Modify(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        epoll_event event = {};
+        event.events = ToEpoll(events);
+        event.data.ptr = context;
+        return epoll_ctl(m_Handle, EPOLL_CTL_MOD, socket, &event) == 0;
+    }
+
+    void EventLoop::Remove(Net::SocketHandle socket)
+    {
+        epoll_event event = {};
+        epoll_ctl(m_Handle, EPOLL_CTL_DEL, socket, &event);
+    }
+
+    bool EventLoop::Wait(int timeoutMs, std::vector<Event>& events)
+    {
+        events.clear();
+
+        epoll_event ready[k_MaxEvents];
+        const auto count = epoll_wait(m_Handle, ready, static_cast<int>(k_MaxEvents), timeoutMs);
+        if (count < 0)
+            return Net::IsInterrupted(Net::GetLastError());
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (ready[i].data.ptr == this)
+            {
+                DrainWakeUps();
+                continue;
+            }
+
+            Event event;
+            event.context = ready[i].data.ptr;
+            event.events = ((ready[i].events & EPOLLIN) ? k_Readable : 0u) |
+                           ((ready[i].events & EPOLLOUT) ? k_Writable : 0u) |
+                           ((ready[i].events & (EPOLLERR | EPOLLHUP)) ? k_Closed : 0u);
+            events.push_back(event);
+        }
+        return true;
+    }
+
+#elif defined(__APPLE__)
+    namespace
+    {
+        bool Change(int queue, Net::SocketHandle socket, uint32_t events, void* context, bool isAdded)
+        {
+            struct kevent changes[2];
+            const auto read = (events & EventLoop::k_Readable) ? EV_ENABLE : EV_DISABLE;
+            const auto write = (events & EventLoop::k_Writable) ? EV_ENABLE : EV_DISABLE;
+            const auto add = isAdded ? EV_ADD : 0;
+            EV_SET(&changes[0], socket, EVFILT_READ, add | read, 0, 0, context);
+            EV_SET(&changes[1], socket, EVFILT_WRITE, add | write, 0, 0, context);
+            return kevent(queue, changes, 2, nullptr, 0, nullptr) == 0;
+        }
+    }
+
+    bool EventLoop::Add(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        return Change(m_Handle, socket, events, context, true);
+    }
+
+    bool EventLoop::Modify(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        return Change(m_Handle, socket, events, context, false);
+    }
+
+    void EventLoop::Remove(Net::SocketHandle socket)
+    {
+        struct kevent changes[2];
+        EV_SET(&changes[0], socket, EVFILT_READ, EV_DELETE, 0, 0, nullptr);
+        EV_SET(&changes[1], socket, EVFILT_WRITE, EV_DELETE, 0, 0, nullptr);
+        kevent(m_Handle, changes, 2, nullptr, 0, nullptr);
+    }
+
+    bool EventLoop::Wait(int timeoutMs, std::vector<Event>& events)
+    {
+        events.clear();
+
+        timespec timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+
+        struct kevent ready[k_MaxEvents];
+        const auto count = kevent(m_Handle, nullptr, 0, ready, static_cast<int>(k_MaxEvents), (timeoutMs >= 0) ? &timeout : nullptr);
+        if (count < 0)
+            return Net::IsInterrupted(Net::GetLastError());
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (ready[i].udata == this)
+            {
+                DrainWakeUps();
+                continue;
+            }
+
+            Event event;
+            event.context = ready[i].udata;
+            event.events = ((ready[i].filter == EVFILT_READ) ? k_Readable : 0u) |
+                           ((ready[i].filter == EVFILT_WRITE) ? k_Writable : 0u) |
+                           ((ready[i].flags & (EV_EOF | EV_ERROR)) ? k_Closed : 0u);
+            events.push_back(event);
+        }
+        return true;
+    }
+
+#else
+    namespace
+    {
+        short ToPoll(uint32_t events)
+        {
+            return static_cast<short>(((events & EventLoop::k_Readable) ? POLLIN : 0) |
+                                      ((events & EventLoop::k_Writable) ? POLLOUT : 0));
+        }
+    }
+
+    bool EventLoop::Add(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        pollfd entry;
+        entry.fd = socket;
+        entry.events = ToPoll(events);
+        entry.revents = 0;
+        m_Sockets.push_back(entry);
+        m_Contexts.push_back(context);
+        return true;
+    }
+
+    bool EventLoop::Modify(Net::SocketHandle socket, uint32_t events, void* context)
+    {
+        for (size_t i = 0; i < m_Sockets.size(); ++i)
+        {
+            if (m_Sockets[i].fd == socket)
+            {
+                m_Sockets[i].events = ToPoll(events);
+                m_Contexts[i] = context;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void EventLoop::Remove(Net::SocketHandle socket)
+    {
+        for (size_t i = 0; i < m_Sockets.size(); ++i)
+        {
+            if (m_Sockets[i].fd == socket)
+            {
+                m_Sockets.erase(m_Sockets.begin() + i);
+                m_Contexts.erase(m_Contexts.begin() + i);
+                return;
+            }
+        }
+    }
+
+    bool EventLoop::Wait(int timeoutMs, std::vector<Event>& events)
+    {
+        events.clear();
+
+        const auto count = Net::Poll(m_Sockets.data(), m_Sockets.size(), timeoutMs);
+        if (count < 0)
+            return Net::IsInterrupted(Net::GetLastError());
+
+        // The handlers may add and remove sockets, the events are collected first.
+        for (size_t i = 0; i < m_Sockets.size(); ++i)
+        {
+            const auto ready = m_Sockets[i].revents;
+            if (ready == 0)
+                continue;
+
+            if (m_Contexts[i] == this)
+            {
+                DrainWakeUps();
+                continue;
+            }
+
+            Event event;
+            event.context = m_Contexts[i];
+            event.events = ((ready & POLLIN) ? k_Readable : 0u) |
+                           ((ready & POLLOUT) ? k_Writable : 0u) |
+                           ((ready & (POLLERR | POLLHUP | POLLNVAL)) ? k_Closed : 0u);
+            events.push_back(event);
+        }
+        return true;
+    }
+#endif
+
+    void EventLoop::Wake()
+    {
+        const char byte = 0;
+        send(m_WakeSocket, &byte, 1, 0);
+    }
+
+    void EventLoop::DrainWakeUps()
+    {
+        char bytes[64];
+        while (recv(m_WakeSocket, bytes, sizeof(bytes), 0) > 0)
+        {
+        }
+    }
+}
@@ -0,0 +1,874 @@
+#include "RtspServerCore.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+#include "AnnexBConverter.h"
+#include "EncodeFrameContext.h"
+#include "H264Sdp.h"
+
+namespace LiveCaptureNative
+{
+    namespace
+    {
+        const int      k_LoopTimeoutMs = 100;
+        const uint64_t k_HousekeepingIntervalNs = 1000 * 1000 * 1000;
+        const int      k_RtpSendBufferSize = 1024 * 1024;
+        const uint8_t  k_StartCode[] = { 0, 0, 0, 1 };
+
+        uint32_t GetRandom()
+        {
+            static std::mt19937 s_Generator{ std::random_device{}() };
+            static std::mutex   s_Mutex;
+
+            std::lock_guard<std::mutex> lock(s_Mutex);
+            return static_cast<uint32_t>(s_Generator());
+        }
+
+        void SetPort(Net::Endpoint& endpoint, uint16_t port)
+        {
+            if (endpoint.address.ss_family == AF_INET6)
+                reinterpret_cast<sockaddr_in6*>(&endpoint.address)->sin6_port = htons(port);
+            else
+                reinterpret_cast<sockaddr_in*>(&endpoint.address)->sin_port = htons(port);
+        }
+
+        bool IsSameEndpoint(const Net::Endpoint& a, const Net::Endpoint& b)
+        {
+            if (a.address.ss_family != b.address.ss_family)
+                return false;
+
+            if (a.address.ss_family == AF_INET6)
+            {
+                const auto& x = *reinterpret_cast<const sockaddr_in6*>(&a.address);
+                const auto& y = *reinterpret_cast<const sockaddr_in6*>(&b.address);
+                return x.sin6_port == y.sin6_port && std::memcmp(&x.sin6_addr, &y.sin6_addr, sizeof(x.sin6_addr)) == 0;
+            }
+
+            const auto& x = *reinterpret_cast<const sockaddr_in*>(&a.address);
+            const auto& y = *reinterpret_cast<const sockaddr_in*>(&b.address);
+            return x.sin_port == y.sin_port && x.sin_addr.s_addr == y.sin_addr.s_addr;
+        }
+
+        std::string GetAddressText(const sockaddr_storage& address)
+        {
+            char text[INET6_ADDRSTRLEN] = "0.0.0.0";
+            if (address.ss_family == AF_INET6)
+                inet_ntop(AF_INET6, const_cast<in6_addr*>(&reinterpret_cast<const sockaddr_in6*>(&address)->sin6_addr), text, sizeof(text));
+            else
+                inet_ntop(AF_INET, const_cast<in_addr*>(&reinterpret_cast<const sockaddr_in*>(&address)->sin_addr), text, sizeof(text));
+            return text;
+        }
+
+        Net::SocketHandle BindUdp(uint16_t port)
+        {
+            const auto handle = socket(AF_INET, SOCK_DGRAM, 0);
+            if (handle == Net::k_InvalidSocket)
+                return handle;
+
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_ANY);
+            address.sin_port = htons(port);
+            if (bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || !Net::SetNonBlocking(handle))
+            {
+                Net::Close(handle);
+                return Net::k_InvalidSocket;
+            }
+            return handle;
+        }
+
+        // The session id up to the parameters, e.g. "1A2B3C4D;timeout=60".
+        std::string GetSessionId(const std::string& header)
+        {
+            const auto end = header.find(';');
+            return Rtsp::Detail::Trim(header.c_str(), header.c_str() + ((end == std::string::npos) ? header.size() : end));
+        }
+    }
+
+    RtspServerCore::RtspServerCore(const RtspServerSettings& settings) :
+        m_Settings(settings),
+        m_IsRunning(false),
+        m_Listener(Net::k_InvalidSocket),
+        m_RtpSocket(Net::k_InvalidSocket),
+        m_RtcpSocket(Net::k_InvalidSocket),
+        m_Port(0),
+        m_RtpPort(0),
+        m_Ssrc(GetRandom()),
+        m_SessionVersion(GetRandom()),
+        m_Packetizer((settings.maxPayloadSize > 0) ? static_cast<size_t>(settings.maxPayloadSize) : H264RtpPacketizer::k_DefaultMaxPayloadSize),
+        m_History(RtpRetransmissionSettings{ settings.retransmissionCapacityKB, 0, 0, 0 }),
+        m_Sequence(static_cast<uint16_t>(GetRandom())),
+        m_AccessUnitsPushed(0),
+        m_PacketsRetransmitted(0),
+        m_ClosedInterleavedBytesSent(0),
+        m_ClosedInterleavedDropped(0)
+    {
+    }
+
+    RtspServerCore::~RtspServerCore()
+    {
+        Stop();
+    }
+
+    bool RtspServerCore::Start()
+    {
+        if (m_IsRunning || !m_Loop.Initialize())
+            return false;
+
+        m_Listener = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_Listener == Net::k_InvalidSocket)
+            return false;
+
+        const int reuse = 1;
+        setsockopt(m_Listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(static_cast<uint16_t>(m_Settings.port));
+        Net::SocketLength size = sizeof(address);
+        if (bind(m_Listener, reinterpret_cast<sockaddr*>(&address), size) != 0 ||
+            listen(m_Listener, SOMAXCONN) != 0 ||
+            getsockname(m_Listener, reinterpret_cast<sockaddr*>(&address), &size) != 0 ||
+            !Net::SetNonBlocking(m_Listener) ||
+            !BindRtpSockets())
+        {
+            Stop();
+            return false;
+        }
+        m_Port = ntohs(address.sin_port);
+        m_Fanout.reset(new RtpFanout(m_RtpSocket));
+
+        if (!m_Loop.Add(m_Listener, EventLoop::k_Readable, &m_Listener) ||
+            !m_Loop.Add(m_RtpSocket, EventLoop::k_Readable, &m_RtpSocket) ||
+            !m_Loop.Add(m_RtcpSocket, EventLoop::k_Readable, &m_RtcpSocket))
+        {
+            Stop();
+            return false;
+        }
+
+        m_IsRunning = true;
+        m_Thread = std::thread(&RtspServerCore::Run, this);
+        return true;
+    }
+
+    void RtspServerCore::Stop()
+    {
+        m_IsRunning = false;
+        if (m_Thread.joinable())
+        {
+            m_Loop.Wake();
+            m_Thread.join();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Connections.clear();
+        }
+        m_Fanout.reset();
+
+        for (auto socket : { &m_Listener, &m_RtpSocket, &m_RtcpSocket })
+        {
+            if (*socket != Net::k_InvalidSocket)
+            {
+                Net::Close(*socket);
+                *socket = Net::k_InvalidSocket;
+            }
+        }
+    }
+
+    bool RtspServerCore::BindRtpSockets()
+    {
+        const auto first = (m_Settings.rtpPort > 0) ? m_Settings.rtpPort & ~1 : k_DefaultRtpPort;
+        for (auto port = first; port < first + k_RtpPortRange && port + 1 <= 0xffff; port += 2)
+        {
+            m_RtpSocket = BindUdp(static_cast<uint16_t>(port));
+            if (m_RtpSocket == Net::k_InvalidSocket)
+                continue;
+
+            m_RtcpSocket = BindUdp(static_cast<uint16_t>(port + 1));
+            if (m_RtcpSocket != Net::k_InvalidSocket)
+            {
+                // Room for a few key frames to all the clients.
+                setsockopt(m_RtpSocket, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&k_RtpSendBufferSize), sizeof(k_RtpSendBufferSize));
+                m_RtpPort = static_cast<uint16_t>(port);
+                return true;
+            }
+
+            Net::Close(m_RtpSocket);
+            m_RtpSocket = Net::k_InvalidSocket;
+        }
+        return false;
+    }
+
+    bool RtspServerCore::PushFrame(const uint8_t* sps,
+                                   size_t spsSize,
+                                   const uint8_t* pps,
+                                   size_t ppsSize,
+                                   const uint8_t* picture,
+                                   size_t pictureSize,
+                                   uint64_t timestampNs)
+    {
+        if (!m_IsRunning || picture == nullptr || pictureSize == 0)
+            return false;
+
+        bool isKeyFrame = false;
+        AnnexB::ForEachNalUnit(picture, pictureSize, [&isKeyFrame](const uint8_t* nal, size_t)
+        {
+            isKeyFrame |= (nal[0] & 0x1f) == 5;
+        });
+
+        // The parameter sets go in band before the picture, like the managed server sends them,
+        // and in the SDP of the next DESCRIBE.
+        m_AccessUnit.clear();
+        for (const auto& nal : { std::make_pair(sps, spsSize), std::make_pair(pps, ppsSize) })
+        {
+            if (nal.first != nullptr && nal.second > 0)
+            {
+                m_AccessUnit.insert(m_AccessUnit.end(), k_StartCode, k_StartCode + sizeof(k_StartCode));
+                m_AccessUnit.insert(m_AccessUnit.end(), nal.first, nal.first + nal.second);
+            }
+        }
+        m_AccessUnit.insert(m_AccessUnit.end(), picture, picture + pictureSize);
+
+        if (sps != nullptr && spsSize > 0 && pps != nullptr && ppsSize > 0)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (m_Sps.size() != spsSize || std::memcmp(m_Sps.data(), sps, spsSize) != 0 ||
+                m_Pps.size() != ppsSize || std::memcmp(m_Pps.data(), pps, ppsSize) != 0)
+            {
+                m_Sps.assign(sps, sps + spsSize);
+                m_Pps.assign(pps, pps + ppsSize);
+                ++m_SessionVersion;
+            }
+        }
+
+        const auto accessUnit = m_Packetizer.Packetize(m_AccessUnit.data(), m_AccessUnit.size(), timestampNs, isKeyFrame);
+        if (accessUnit == nullptr)
+            return false;
+        ++m_AccessUnitsPushed;
+
+        // The clients that wait for a key frame join on this one.
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (const auto& connection : m_Connections)
+            {
+                if (connection->isClosing || connection->state != SessionState::Playing)
+                    continue;
+
+                if (connection->isWaitingForKeyFrame)
+                {
+                    if (!isKeyFrame)
+                        continue;
+
+                    connection->isWaitingForKeyFrame = false;
+                    if (!connection->transport.isInterleaved)
+                        connection->fanoutClient = m_Fanout->AddClient(connection->rtpEndpoint, m_Ssrc, m_Sequence);
+                }
+
+                if (connection->transport.isInterleaved && connection->socket->sender != nullptr)
+                    m_InterleavedClients.push_back(connection->socket);
+            }
+        }
+
+        const auto nowNs = GetEncodeClockNs();
+        if (m_Fanout->GetClientCount() > 0)
+        {
+            for (size_t i = 0; i < accessUnit->packets.size(); ++i)
+            {
+                const auto& packet = accessUnit->packets[i];
+                m_Packet.resize(Rtp::k_HeaderSize + packet.size);
+                accessUnit->WriteHeader(packet, static_cast<uint16_t>(m_Sequence + i), m_Ssrc, m_Packet.data());
+                std::memcpy(m_Packet.data() + Rtp::k_HeaderSize, accessUnit->GetPayload(packet), packet.size);
+                m_History.Add(m_Packet.data(), m_Packet.size(), nowNs);
+            }
+            m_Fanout->Send(*accessUnit);
+        }
+        m_Sequence = static_cast<uint16_t>(m_Sequence + accessUnit->packets.size());
+
+        // A client that couldn't take the whole access unit is flushed by the event loop.
+        bool isWakeNeeded = false;
+        for (const auto& client : m_InterleavedClients)
+        {
+            const auto result = client->sender->Send(accessUnit);
+            isWakeNeeded |= result == RtpInterleavedResult::Queued || result == RtpInterleavedResult::Disconnected;
+        }
+        m_InterleavedClients.clear();
+
+        if (isWakeNeeded)
+            m_Loop.Wake();
+        return true;
+    }
+
+    int32_t RtspServerCore::GetPlayingCount() const
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+
+        int32_t count = 0;
+        for (const auto& connection : m_Connections)
+        {
+            if (!connection->isClosing && connection->state == SessionState::Playing)
+                ++count;
+        }
+        return count;
+    }
+
+    void RtspServerCore::GetStats(RtspServerStats& stats) const
+    {
+        std::memset(&stats, 0, sizeof(stats));
+        stats.accessUnitsPushed = m_AccessUnitsPushed;
+        stats.packetsRetransmitted = m_PacketsRetransmitted;
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (m_Fanout != nullptr)
+        {
+            RtpFanoutStats fanout;
+            m_Fanout->GetStats(fanout);
+            stats.packetsSent = fanout.packetsSent;
+            stats.packetsDropped = fanout.packetsDropped;
+        }
+
+        stats.interleavedBytesSent = m_ClosedInterleavedBytesSent;
+        stats.interleavedDropped = m_ClosedInterleavedDropped;
+        for (const auto& connection : m_Connections)
+        {
+            if (connection->isClosing)
+                continue;
+
+            ++stats.connections;
+            if (connection->state == SessionState::Playing)
+                ++stats.playingClients;
+
+            if (connection->socket->sender != nullptr)
+            {
+                RtpInterleavedStats interleaved;
+                connection->socket->sender->GetStats(interleaved);
+                stats.interleavedBytesSent += interleaved.bytesSent;
+                stats.interleavedDropped += interleaved.accessUnitsDropped;
+            }
+        }
+    }
+
+    void RtspServerCore::Run()
+    {
+        std::vector<EventLoop::Event> events;
+        auto lastHousekeepingNs = GetEncodeClockNs();
+
+        while (m_IsRunning)
+        {
+            if (!m_Loop.Wait(k_LoopTimeoutMs, events))
+                break;
+
+            for (const auto& event : events)
+            {
+                if (event.context == &m_Listener)
+                {
+                    Accept();
+                }
+                else if (event.context == &m_RtcpSocket)
+                {
+                    ReadRtcp();
+                }
+                else if (event.context == &m_RtpSocket)
+                {
+                    // Clients may send to the RTP port to open their NAT, nothing to do with it.
+                    uint8_t packet[2048];
+                    while (recv(m_RtpSocket, reinterpret_cast<char*>(packet), sizeof(packet), 0) > 0)
+                    {
+                    }
+                }
+                else
+                {
+                    auto& connection = *static_cast<Connection*>(event.context);
+                    if (connection.isClosing)
+                        continue;
+
+                    if ((event.events & EventLoop::k_Writable) != 0)
+                        WriteOutput(connection);
+                    if ((event.events & (EventLoop::k_Readable | EventLoop::k_Closed)) != 0 && !connection.isClosing)
+                        Read(connection);
+                }
+            }
+
+            const auto nowNs = GetEncodeClockNs();
+            if (nowNs - lastHousekeepingNs >= k_HousekeepingIntervalNs)
+            {
+                CloseExpired(nowNs);
+                lastHousekeepingNs = nowNs;
+            }
+
+            // Watch the sockets with something to write, which the encoder thread may have queued,
+            // and forget the connections closed in this pass.
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (auto it = m_Connections.begin(); it != m_Connections.end();)
+            {
+                auto& connection = **it;
+                if (!connection.isClosing)
+                    UpdateEvents(connection);
+
+                if (connection.isClosing)
+                    it = m_Connections.erase(it);
+                else
+                    ++it;
+            }
+        }
+    }
+
+    void RtspServerCore::Accept()
+    {
+        for (;;)
+        {
+            sockaddr_storage peer;
+            Net::SocketLength peerSize = sizeof(peer);
+            const auto handle = accept(m_Listener, reinterpret_cast<sockaddr*>(&peer), &peerSize);
+            if (handle == Net::k_InvalidSocket)
+                return;
+
+            std::unique_ptr<Connection> connection(new Connection());
+            connection->socket = std::make_shared<ConnectionSocket>(handle);
+            if (!Net::SetNonBlocking(handle))
+                continue;
+            Net::SetNoDelay(handle);
+
+            sockaddr_storage local;
+            Net::SocketLength localSize = sizeof(local);
+            if (getsockname(handle, reinterpret_cast<sockaddr*>(&local), &localSize) == 0)
+                connection->localAddress = GetAddressText(local);
+
+            connection->peer.address = peer;
+            connection->peer.size = peerSize;
+            connection->events = EventLoop::k_Readable;
+            connection->lastActivityNs = GetEncodeClockNs();
+            connection->isClosing = false;
+            connection->state = SessionState::None;
+            connection->transport = Rtsp::Transport();
+            connection->fanoutClient = RtpFanout::k_InvalidClient;
+            connection->isWaitingForKeyFrame = false;
+
+            if (!m_Loop.Add(handle, connection->events, connection.get()))
+                continue;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Connections.push_back(std::move(connection));
+        }
+    }
+
+    void RtspServerCore::Read(Connection& connection)
+    {
+        for (;;)
+        {
+            uint8_t bytes[4096];
+            const auto received = recv(connection.socket->handle, reinterpret_cast<char*>(bytes), sizeof(bytes), 0);
+            if (received > 0)
+            {
+                connection.input.insert(connection.input.end(), bytes, bytes + received);
+                continue;
+            }
+
+            const auto error = (received < 0) ? Net::GetLastError() : 0;
+            if (received < 0 && Net::IsInterrupted(error))
+                continue;
+            if (received == 0 || !Net::IsWouldBlock(error))
+            {
+                CloseConnection(connection);
+                return;
+            }
+            break;
+        }
+
+        size_t offset = 0;
+        while (!connection.isClosing)
+        {
+            Rtsp::Request request;
+            Rtsp::InterleavedFrame frame;
+            size_t consumed = 0;
+            const auto result = Rtsp::Parse(connection.input.data() + offset, connection.input.size() - offset, consumed, request, frame);
+            if (result == Rtsp::ParseResult::Incomplete)
+                break;
+
+            if (result == Rtsp::ParseResult::Invalid)
+            {
+                Rtsp::Response response(400, -1);
+                Reply(connection, response.Finish());
+                CloseConnection(connection);
+                break;
+            }
+
+            offset += consumed;
+            connection.lastActivityNs = GetEncodeClockNs();
+            if (result == Rtsp::ParseResult::Request)
+                HandleRequest(connection, request);
+
+            // The receiver reports of an interleaved client only keep the session alive.
+        }
+        connection.input.erase(connection.input.begin(), connection.input.begin() + offset);
+    }
+
+    void RtspServerCore::ReadRtcp()
+    {
+        for (;;)
+        {
+            uint8_t packet[2048];
+            Net::Endpoint source;
+            source.size = sizeof(source.address);
+            const auto received = recvfrom(m_RtcpSocket,
+                                           reinterpret_cast<char*>(packet),
+                                           sizeof(packet),
+                                           0,
+                                           reinterpret_cast<sockaddr*>(&source.address),
+                                           &source.size);
+            if (received <= 0)
+                return;
+
+            Net::Endpoint destination;
+            bool isFound = false;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                for (const auto& connection : m_Connections)
+                {
+                    if (!connection->isClosing && connection->state != SessionState::None &&
+                        !connection->transport.isInterleaved && IsSameEndpoint(connection->rtcpEndpoint, source))
+                    {
+                        connection->lastActivityNs = GetEncodeClockNs();
+                        destination = connection->rtpEndpoint;
+                        isFound = true;
+                        break;
+                    }
+                }
+            }
+            if (!isFound)
+                continue;
+
+            m_PacketsRetransmitted += m_History.HandleRtcp(packet, static_cast<size_t>(received), m_Ssrc, GetEncodeClockNs(),
+                [this, &destination](const uint8_t* data, size_t size)
+            {
+                auto buffer = Net::MakeBuffer(data, size);
+                Net::Datagram datagram;
+                datagram.endpoint = &destination;
+                datagram.buffers = &buffer;
+                datagram.bufferCount = 1;
+
+                int error = 0;
+                Net::SendDatagrams(m_RtpSocket, &datagram, 1, error);
+            });
+        }
+    }
+
+    bool RtspServerCore::IsSession(const Connection& connection, const Rtsp::Request& request) const
+    {
+        const auto header = request.GetHeader("Session");
+        return header != nullptr && connection.state != SessionState::None && GetSessionId(*header) == connection.sessionId;
+    }
+
+    void RtspServerCore::HandleRequest(Connection& connection, const Rtsp::Request& request)
+    {
+        const auto& method = request.method;
+        if (request.cseq < 0)
+        {
+            Rtsp::Response response(400, request.cseq);
+            Reply(connection, response.Finish());
+            return;
+        }
+
+        if (method == "OPTIONS")
+        {
+            Rtsp::Response response(200, request.cseq);
+            response.AddHeader("Public", "OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER");
+            Reply(connection, response.Finish());
+        }
+        else if (method == "DESCRIBE")
+        {
+            std::string sdp;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                sdp = H264Sdp::Build(m_Sps, m_Pps, H264RtpPacketizer::k_DefaultPayloadType, m_SessionVersion, connection.localAddress.c_str());
+            }
+
+            auto base = request.uri;
+            if (base.empty() || base.back() != '/')
+                base += '/';
+
+            Rtsp::Response response(200, request.cseq);
+            response.AddHeader("Content-Base", base);
+            Reply(connection, response.Finish("application/sdp", sdp));
+        }
+        else if (method == "SETUP")
+        {
+            HandleSetup(connection, request);
+        }
+        else if (method == "PLAY" || method == "PAUSE" || method == "TEARDOWN")
+        {
+            if (!IsSession(connection, request))
+            {
+                Rtsp::Response response(454, request.cseq);
+                Reply(connection, response.Finish());
+                return;
+            }
+
+            Rtsp::Response response(200, request.cseq);
+            if (method == "PLAY")
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    if (connection.state != SessionState::Playing)
+                    {
+                        connection.state = SessionState::Playing;
+                        connection.isWaitingForKeyFrame = true;
+                    }
+                }
+                response.AddHeader("Session", connection.sessionId);
+                response.AddHeader("Range", "npt=0.000-");
+                response.AddHeader("RTP-Info", "url=" + request.uri);
+            }
+            else if (method == "PAUSE")
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    connection.state = SessionState::Ready;
+                    if (connection.fanoutClient != RtpFanout::k_InvalidClient)
+                    {
+                        m_Fanout->RemoveClient(connection.fanoutClient);
+                        connection.fanoutClient = RtpFanout::k_InvalidClient;
+                    }
+                }
+                response.AddHeader("Session", connection.sessionId);
+            }
+            else
+            {
+                EndSession(connection);
+            }
+            Reply(connection, response.Finish());
+        }
+        else if (method == "GET_PARAMETER" || method == "SET_PARAMETER")
+        {
+            // Keep alive.
+            Rtsp::Response response(200, request.cseq);
+            if (IsSession(connection, request))
+                response.AddHeader("Session", connection.sessionId);
+            Reply(connection, response.Finish());
+        }
+        else
+        {
+            Rtsp::Response response(405, request.cseq);
+            response.AddHeader("Allow", "OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER");
+            Reply(connection, response.Finish());
+        }
+    }
+
+    void RtspServerCore::HandleSetup(Connection& connection, const Rtsp::Request& request)
+    {
+        const auto sessionHeader = request.GetHeader("Session");
+        if (sessionHeader != nullptr && !IsSession(connection, request))
+        {
+            Rtsp::Response response(454, request.cseq);
+            Reply(connection, response.Finish());
+            return;
+        }
+
+        // One stream, so one session per connection.
+        if (sessionHeader == nullptr && connection.state != SessionState::None)
+        {
+            Rtsp::Response response(459, request.cseq);
+            Reply(connection, response.Finish());
+            return;
+        }
+
+        const auto transportHeader = request.GetHeader("Transport");
+        Rtsp::Transport transport;
+        if (transportHeader == nullptr || !Rtsp::ParseTransport(*transportHeader, transport))
+        {
+            Rtsp::Response response(461, request.cseq);
+            Reply(connection, response.Finish());
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (connection.fanoutClient != RtpFanout::k_InvalidClient)
+            {
+                m_Fanout->RemoveClient(connection.fanoutClient);
+                connection.fanoutClient = RtpFanout::k_InvalidClient;
+                connection.isWaitingForKeyFrame = connection.state == SessionState::Playing;
+            }
+
+            connection.transport = transport;
+            if (transport.isInterleaved)
+            {
+                auto& socket = *connection.socket;
+                if (socket.sender == nullptr)
+                {
+                    const auto policy = IsValidBackpressurePolicy(m_Settings.interleavedPolicy)
+                        ? static_cast<BackpressurePolicy>(m_Settings.interleavedPolicy)
+                        : BackpressurePolicy::DropToKeyFrame;
+                    socket.sender.reset(new RtpInterleavedSender(socket.handle,
+                                                                 transport.rtpChannel,
+                                                                 m_Ssrc,
+                                                                 static_cast<uint16_t>(GetRandom()),
+                                                                 policy,
+                                                                 m_Settings.interleavedQueueLength));
+                }
+            }
+            else
+            {
+                connection.rtpEndpoint = connection.peer;
+                SetPort(connection.rtpEndpoint, transport.clientRtpPort);
+                connection.rtcpEndpoint = connection.peer;
+                SetPort(connection.rtcpEndpoint, transport.clientRtcpPort);
+            }
+
+            if (connection.state == SessionState::None)
+            {
+                char id[16];
+                std::snprintf(id, sizeof(id), "%08X", GetRandom());
+                connection.sessionId = id;
+                connection.state = SessionState::Ready;
+            }
+        }
+
+        // The replies written so far go first, the interleaved sender writes the next ones.
+        if (connection.socket->sender != nullptr && !connection.output.empty())
+        {
+            const auto result = connection.socket->sender->SendData(reinterpret_cast<const uint8_t*>(connection.output.data()), connection.output.size());
+            connection.output.clear();
+            if (result == RtpInterleavedResult::Disconnected)
+            {
+                CloseConnection(connection);
+                return;
+            }
+        }
+
+        char value[128];
+        if (transport.isInterleaved)
+        {
+            std::snprintf(value, sizeof(value), "RTP/AVP/TCP;unicast;interleaved=%u-%u;ssrc=%08X",
+                          transport.rtpChannel, transport.rtcpChannel, m_Ssrc);
+        }
+        else
+        {
+            std::snprintf(value, sizeof(value), "RTP/AVP;unicast;client_port=%u-%u;server_port=%u-%u;ssrc=%08X",
+                          transport.clientRtpPort, transport.clientRtcpPort, m_RtpPort, m_RtpPort + 1, m_Ssrc);
+        }
+
+        const auto timeout = (m_Settings.sessionTimeoutSeconds > 0) ? m_Settings.sessionTimeoutSeconds : k_DefaultSessionTimeoutSeconds;
+
+        Rtsp::Response response(200, request.cseq);
+        response.AddHeader("Transport", value);
+        response.AddHeader("Session", connection.sessionId + ";timeout=" + std::to_string(timeout));
+        Reply(connection, response.Finish());
+    }
+
+    void RtspServerCore::Reply(Connection& connection, const std::string& text)
+    {
+        if (connection.isClosing)
+            return;
+
+        const auto& sender = connection.socket->sender;
+        if (sender != nullptr)
+        {
+            if (sender->SendData(reinterpret_cast<const uint8_t*>(text.data()), text.size()) == RtpInterleavedResult::Disconnected)
+                CloseConnection(connection);
+            return;
+        }
+
+        connection.output += text;
+        WriteOutput(connection);
+    }
+
+    void RtspServerCore::WriteOutput(Connection& connection)
+    {
+        size_t written = 0;
+        while (written < connection.output.size())
+        {
+            const auto result = send(connection.socket->handle, connection.output.data() + written, static_cast<int>(connection.output.size() - written), 0);
+            if (result > 0)
+            {
+                written += static_cast<size_t>(result);
+                continue;
+            }
+
+            const auto error = Net::GetLastError();
+            if (Net::IsInterrupted(error))
+                continue;
+            if (!Net::IsWouldBlock(error))
+            {
+                CloseConnection(connection);
+                return;
+            }
+            break;
+        }
+        connection.output.erase(0, written);
+
+        const auto& sender = connection.socket->sender;
+        if (sender != nullptr && sender->Flush() == RtpInterleavedResult::Disconnected)
+            CloseConnection(connection);
+    }
+
+    void RtspServerCore::UpdateEvents(Connection& connection)
+    {
+        const auto& sender = connection.socket->sender;
+        const auto isWriting = !connection.output.empty() || (sender != nullptr && sender->HasQueued());
+        const auto events = EventLoop::k_Readable | (isWriting ? EventLoop::k_Writable : 0u);
+        if (events != connection.events && m_Loop.Modify(connection.socket->handle, events, &connection))
+            connection.events = events;
+    }
+
+    void RtspServerCore::EndSession(Connection& connection)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        if (connection.fanoutClient != RtpFanout::k_InvalidClient)
+        {
+            m_Fanout->RemoveClient(connection.fanoutClient);
+            connection.fanoutClient = RtpFanout::k_InvalidClient;
+        }
+        connection.state = SessionState::None;
+        connection.sessionId.clear();
+        connection.isWaitingForKeyFrame = false;
+    }
+
+    void RtspServerCore::CloseConnection(Connection& connection)
+    {
+        if (connection.isClosing)
+            return;
+
+        EndSession(connection);
+        m_Loop.Remove(connection.socket->handle);
+
+        // Removed from the list at the end of the pass of the event loop. The encoder thread may
+        // still hold the socket, it is closed after its last send.
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        connection.isClosing = true;
+        if (connection.socket->sender != nullptr)
+        {
+            RtpInterleavedStats stats;
+            connection.socket->sender->GetStats(stats);
+            m_ClosedInterleavedBytesSent += stats.bytesSent;
+            m_ClosedInterleavedDropped += stats.accessUnitsDropped;
+        }
+    }
+
+    void RtspServerCore::CloseExpired(uint64_t nowNs)
+    {
+        // The interleaved clients are watched by their connection, the others must send RTSP or
+        // RTCP within the timeout.
+        const auto timeout = (m_Settings.sessionTimeoutSeconds > 0) ? m_Settings.sessionTimeoutSeconds : k_DefaultSessionTimeoutSeconds;
+        const auto timeoutNs = static_cast<uint64_t>(timeout) * 1000 * 1000 * 1000;
+
+        std::vector<Connection*> expired;
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (const auto& connection : m_Connections)
+            {
+                const auto isInterleaved = connection->state != SessionState::None && connection->transport.isInterleaved;
+                if (!connection->isClosing && !isInterleaved && nowNs - connection->lastActivityNs > timeoutNs)
+                    expired.push_back(connection.get());
+            }
+        }
+
+        for (auto connection : expired)
+        {
+            CloseConnection(*connection);
+        }
+    }
+}
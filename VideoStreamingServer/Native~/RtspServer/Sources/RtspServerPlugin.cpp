@@ -0,0 +1,86 @@
+#include "RtspServerCore.h"
+
+#include "Unity/IUnityInterface.h"
+
+using namespace LiveCaptureNative;
+
+namespace
+{
+#if defined(_WIN32)
+    struct WinsockScope
+    {
+        bool isStarted;
+
+        WinsockScope()
+        {
+            WSADATA data;
+            isStarted = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }
+
+        ~WinsockScope()
+        {
+            if (isStarted)
+                WSACleanup();
+        }
+    };
+#endif
+}
+
+// Starts a server, null if its sockets couldn't be bound. settings may be null for the defaults.
+extern "C" UNITY_INTERFACE_EXPORT void* RtspServerCreate(const RtspServerSettings* settings)
+{
+#if defined(_WIN32)
+    static WinsockScope s_Winsock;
+    if (!s_Winsock.isStarted)
+        return nullptr;
+#endif
+
+    std::unique_ptr<RtspServerCore> server(new RtspServerCore((settings != nullptr) ? *settings : RtspServerSettings()));
+    return server->Start() ? server.release() : nullptr;
+}
+
+extern "C" UNITY_INTERFACE_EXPORT void RtspServerDestroy(void* server)
+{
+    delete static_cast<RtspServerCore*>(server);
+}
+
+extern "C" UNITY_INTERFACE_EXPORT int RtspServerGetPort(void* server)
+{
+    return (server != nullptr) ? static_cast<RtspServerCore*>(server)->GetPort() : 0;
+}
+
+extern "C" UNITY_INTERFACE_EXPORT int RtspServerGetPlayingCount(void* server)
+{
+    return (server != nullptr) ? static_cast<RtspServerCore*>(server)->GetPlayingCount() : 0;
+}
+
+// One encoded frame: sps and pps without start code (may be empty), image in Annex B.
+extern "C" UNITY_INTERFACE_EXPORT bool RtspServerPushFrame(void* server,
+                                                           const uint8_t* sps,
+                                                           int spsSize,
+                                                           const uint8_t* pps,
+                                                           int ppsSize,
+                                                           const uint8_t* image,
+                                                           int imageSize,
+                                                           uint64_t timestampNs)
+{
+    if (server == nullptr || spsSize < 0 || ppsSize < 0 || imageSize < 0)
+        return false;
+
+    return static_cast<RtspServerCore*>(server)->PushFrame(sps,
+                                                           static_cast<size_t>(spsSize),
+                                                           pps,
+                                                           static_cast<size_t>(ppsSize),
+                                                           image,
+                                                           static_cast<size_t>(imageSize),
+                                                           timestampNs);
+}
+
+extern "C" UNITY_INTERFACE_EXPORT bool RtspServerGetStats(void* server, RtspServerStats* stats)
+{
+    if (server == nullptr || stats == nullptr)
+        return false;
+
+    static_cast<RtspServerCore*>(server)->GetStats(*stats);
+    return true;
+}
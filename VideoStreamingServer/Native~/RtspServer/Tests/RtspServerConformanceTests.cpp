@@ -0,0 +1,502 @@
+#include "RtspServerCore.h"
+#include "TestUtils.h"
+#include "UdpLoopback.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+// A scripted RTSP client, as VLC or ffmpeg would talk to the server: DESCRIBE, SETUP over UDP
+// and interleaved in the connection, PLAY, TEARDOWN, and the errors and timeouts around them.
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    // 1280x720, Baseline 3.1.
+    const uint8_t k_Sps[] = { 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe4 };
+    const uint8_t k_Pps[] = { 0x68, 0xce, 0x38, 0x80 };
+
+    struct Reply
+    {
+        int         status;
+        std::string head; // Status line and headers.
+        std::string body;
+
+        // The value of a header, empty when missing.
+        std::string GetHeader(const char* name) const
+        {
+            const auto key = std::string("\r\n") + name + ": ";
+            const auto start = head.find(key);
+            if (start == std::string::npos)
+                return std::string();
+
+            const auto end = head.find("\r\n", start + key.size());
+            return head.substr(start + key.size(), end - start - key.size());
+        }
+    };
+
+    // An interleaved RTP or RTCP packet.
+    struct Frame
+    {
+        uint8_t              channel;
+        std::vector<uint8_t> packet;
+    };
+
+    // An RTSP connection to the server, reading the replies and the interleaved frames between them.
+    class RtspClient final
+    {
+    public:
+        explicit RtspClient(uint16_t port)
+        {
+            m_Socket = socket(AF_INET, SOCK_STREAM, 0);
+            TEST_CHECK(m_Socket >= 0);
+
+            timeval timeout = { 3, 0 };
+            setsockopt(m_Socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+            const auto address = Tests::UdpLoopback::MakeAddress(port);
+            TEST_CHECK(connect(m_Socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+        }
+
+        ~RtspClient()
+        {
+            close(m_Socket);
+        }
+
+        RtspClient(const RtspClient&) = delete;
+        RtspClient& operator=(const RtspClient&) = delete;
+
+        void Send(const std::string& text)
+        {
+            TEST_CHECK(send(m_Socket, text.data(), text.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(text.size()));
+        }
+
+        void SendRequest(const char* method, const std::string& uri, int cseq, const std::string& headers = std::string())
+        {
+            Send(std::string(method) + " " + uri + " RTSP/1.0\r\nCSeq: " + std::to_string(cseq) + "\r\n" + headers + "\r\n");
+        }
+
+        Reply Request(const char* method, const std::string& uri, int cseq, const std::string& headers = std::string())
+        {
+            SendRequest(method, uri, cseq, headers);
+            Reply reply;
+            TEST_CHECK(ReadReply(reply));
+            TEST_CHECK(reply.GetHeader("CSeq") == std::to_string(cseq));
+            return reply;
+        }
+
+        // Reads up to the next reply, keeping the interleaved frames before it. Returns false
+        // once the server closed the connection.
+        bool ReadReply(Reply& reply)
+        {
+            while (!Parse(reply))
+            {
+                if (!Receive())
+                    return false;
+            }
+            return true;
+        }
+
+        // Reads the interleaved frames sent for the duration, without any reply.
+        void ReadFrames(int milliseconds)
+        {
+            const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+            while (std::chrono::steady_clock::now() < end)
+            {
+                Receive();
+                Reply reply;
+                TEST_CHECK(!Parse(reply) && !m_IsClosed);
+            }
+        }
+
+        // Waits for the server to close the connection. Returns false after 3 s.
+        bool WaitForClose()
+        {
+            while (Receive())
+            {
+            }
+            return m_IsClosed;
+        }
+
+        std::vector<Frame> frames;
+
+    private:
+        // Takes the interleaved frames received, up to a reply. Returns false if no reply was
+        // received whole.
+        bool Parse(Reply& reply)
+        {
+            while (!m_Buffer.empty())
+            {
+                if (m_Buffer[0] != '$')
+                {
+                    const auto end = m_Buffer.find("\r\n\r\n");
+                    if (end == std::string::npos)
+                        return false;
+
+                    reply.head = m_Buffer.substr(0, end + 2);
+                    const auto length = reply.GetHeader("Content-Length");
+                    const auto bodySize = length.empty() ? 0 : static_cast<size_t>(std::atoi(length.c_str()));
+                    if (m_Buffer.size() < end + 4 + bodySize)
+                        return false;
+
+                    TEST_CHECK(reply.head.compare(0, 9, "RTSP/1.0 ") == 0);
+                    reply.status = std::atoi(reply.head.c_str() + 9);
+                    reply.body = m_Buffer.substr(end + 4, bodySize);
+                    m_Buffer.erase(0, end + 4 + bodySize);
+                    return true;
+                }
+
+                if (m_Buffer.size() < 4)
+                    return false;
+                const size_t length = Rtp::ReadUInt16(reinterpret_cast<const uint8_t*>(&m_Buffer[2]));
+                if (m_Buffer.size() < 4 + length)
+                    return false;
+
+                Frame frame;
+                frame.channel = static_cast<uint8_t>(m_Buffer[1]);
+                frame.packet.assign(m_Buffer.begin() + 4, m_Buffer.begin() + 4 + length);
+                frames.push_back(std::move(frame));
+                m_Buffer.erase(0, 4 + length);
+            }
+            return false;
+        }
+
+        // Returns false on a timeout or once the connection is closed.
+        bool Receive()
+        {
+            char data[64 * 1024];
+            const auto size = recv(m_Socket, data, sizeof(data), 0);
+            if (size <= 0)
+            {
+                m_IsClosed |= size == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+                return false;
+            }
+            m_Buffer.append(data, static_cast<size_t>(size));
+            return true;
+        }
+
+        int         m_Socket;
+        std::string m_Buffer;
+        bool        m_IsClosed = false;
+    };
+
+    // A started server, with a thread pushing frames at 100 fps and a key frame every 30 frames.
+    class TestServer final
+    {
+    public:
+        explicit TestServer(int32_t sessionTimeoutSeconds = 0)
+            : m_Server(MakeSettings(sessionTimeoutSeconds)),
+              m_IsPushing(true)
+        {
+            TEST_CHECK(m_Server.Start());
+            PushFrame(0);
+            m_Thread = std::thread([this]()
+            {
+                for (uint32_t i = 1; m_IsPushing; ++i)
+                {
+                    PushFrame(i);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+            });
+        }
+
+        ~TestServer()
+        {
+            m_IsPushing = false;
+            m_Thread.join();
+            m_Server.Stop();
+        }
+
+        RtspServerCore& Get() { return m_Server; }
+
+        std::string GetUrl() const
+        {
+            return "rtsp://127.0.0.1:" + std::to_string(m_Server.GetPort()) + "/live";
+        }
+
+    private:
+        static RtspServerSettings MakeSettings(int32_t sessionTimeoutSeconds)
+        {
+            RtspServerSettings settings = {};
+            settings.sessionTimeoutSeconds = sessionTimeoutSeconds;
+            return settings;
+        }
+
+        void PushFrame(uint32_t index)
+        {
+            const bool isKeyFrame = (index % 30) == 0;
+            m_Frame.assign(4 + (isKeyFrame ? 30000 : 3000), 0);
+            m_Frame[3] = 1;
+            m_Frame[4] = isKeyFrame ? 0x65 : 0x41;
+            for (size_t i = 5; i < m_Frame.size(); ++i)
+            {
+                m_Frame[i] = static_cast<uint8_t>((i * 7 + index) | 1);
+            }
+
+            TEST_CHECK(m_Server.PushFrame(isKeyFrame ? k_Sps : nullptr, isKeyFrame ? sizeof(k_Sps) : 0,
+                                          isKeyFrame ? k_Pps : nullptr, isKeyFrame ? sizeof(k_Pps) : 0,
+                                          m_Frame.data(), m_Frame.size(), index * 10000000ull));
+        }
+
+        RtspServerCore       m_Server;
+        std::vector<uint8_t> m_Frame;
+        std::atomic<bool>    m_IsPushing;
+        std::thread          m_Thread;
+    };
+
+    // Receives the RTP packets sent for the duration.
+    std::vector<std::vector<uint8_t>> ReceivePackets(const Tests::UdpLoopback& socket, int milliseconds)
+    {
+        std::vector<std::vector<uint8_t>> packets;
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+        while (std::chrono::steady_clock::now() < end)
+        {
+            uint8_t packet[2048];
+            int size;
+            while ((size = socket.Receive(packet, sizeof(packet))) >= 0)
+            {
+                packets.emplace_back(packet, packet + size);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return packets;
+    }
+
+    // Contiguous sequence numbers of the stream SSRC, from a key frame: the SPS or a STAP-A
+    // of the parameter sets.
+    void CheckStream(const std::vector<const std::vector<uint8_t>*>& packets, uint32_t ssrc)
+    {
+        TEST_CHECK(packets.size() > 100);
+        const auto firstType = (*packets[0])[Rtp::k_HeaderSize] & 0x1f;
+        TEST_CHECK(firstType == 7 || firstType == 24);
+
+        auto sequence = Rtp::GetSequenceNumber(packets[0]->data());
+        for (const auto packet : packets)
+        {
+            TEST_CHECK(Rtp::IsValidPacket(packet->data(), packet->size()));
+            TEST_CHECK(Rtp::GetSsrc(packet->data()) == ssrc);
+            TEST_CHECK(Rtp::GetSequenceNumber(packet->data()) == sequence++);
+        }
+    }
+
+    uint32_t ParseSsrc(const std::string& transport)
+    {
+        const auto start = transport.find("ssrc=");
+        TEST_CHECK(start != std::string::npos);
+        return static_cast<uint32_t>(std::strtoul(transport.c_str() + start + 5, nullptr, 16));
+    }
+
+    // The session id, without the timeout.
+    std::string ParseSession(const Reply& reply)
+    {
+        const auto session = reply.GetHeader("Session");
+        return session.substr(0, session.find(';'));
+    }
+
+    void DescribesTheStream()
+    {
+        TestServer server;
+        RtspClient client(server.Get().GetPort());
+        const auto url = server.GetUrl();
+
+        auto reply = client.Request("OPTIONS", url, 1);
+        TEST_CHECK(reply.status == 200);
+        TEST_CHECK(reply.GetHeader("Public").find("DESCRIBE") != std::string::npos);
+
+        reply = client.Request("DESCRIBE", url, 2, "Accept: application/sdp\r\n");
+        TEST_CHECK(reply.status == 200);
+        TEST_CHECK(reply.GetHeader("Content-Type") == "application/sdp");
+        TEST_CHECK(reply.GetHeader("Content-Base") == url + "/");
+        TEST_CHECK(reply.body.find("m=video 0 RTP/AVP 96\r\n") != std::string::npos);
+        TEST_CHECK(reply.body.find("profile-level-id=42c01f") != std::string::npos);
+        TEST_CHECK(reply.body.find("sprop-parameter-sets=Z0LAH9oBQBbk,aM44gA==") != std::string::npos);
+        TEST_CHECK(reply.body.find("a=framesize:96 1280-720\r\n") != std::string::npos);
+        TEST_CHECK(reply.body.find("a=control:trackID=0\r\n") != std::string::npos);
+    }
+
+    void RejectsInvalidRequests()
+    {
+        TestServer server;
+        RtspClient client(server.Get().GetPort());
+        const auto url = server.GetUrl();
+
+        TEST_CHECK(client.Request("PLAY", url, 1, "Session: 1234\r\n").status == 454);
+        TEST_CHECK(client.Request("SETUP", url + "/trackID=0", 2).status == 461);
+        TEST_CHECK(client.Request("RECORD", url, 3).status == 405);
+
+        // Pipelined requests are answered in order.
+        client.SendRequest("OPTIONS", url, 4);
+        client.SendRequest("OPTIONS", url, 5);
+        Reply first;
+        Reply second;
+        TEST_CHECK(client.ReadReply(first) && client.ReadReply(second));
+        TEST_CHECK(first.GetHeader("CSeq") == "4" && second.GetHeader("CSeq") == "5");
+
+        // A request that can't be parsed closes the connection.
+        client.Send("garbage\r\n\r\n");
+        Reply reply;
+        TEST_CHECK(client.ReadReply(reply) && reply.status == 400);
+        TEST_CHECK(client.WaitForClose());
+    }
+
+    void PlaysOverUdp()
+    {
+        TestServer server;
+        RtspClient client(server.Get().GetPort());
+        const auto url = server.GetUrl();
+
+        Tests::UdpLoopback rtp;
+        Tests::UdpLoopback rtcp;
+        const auto clientPorts = std::to_string(rtp.GetPort()) + "-" + std::to_string(rtcp.GetPort());
+        const auto transportHeader = "Transport: RTP/AVP;unicast;client_port=" + clientPorts + "\r\n";
+
+        auto reply = client.Request("SETUP", url + "/trackID=0", 1, transportHeader);
+        TEST_CHECK(reply.status == 200);
+        const auto transport = reply.GetHeader("Transport");
+        TEST_CHECK(transport.find("client_port=" + clientPorts) != std::string::npos);
+        TEST_CHECK(transport.find("server_port=") != std::string::npos);
+        TEST_CHECK(reply.GetHeader("Session").find(";timeout=60") != std::string::npos);
+        const auto session = ParseSession(reply);
+        const auto ssrc = ParseSsrc(transport);
+        const auto serverRtcpPort = static_cast<uint16_t>(std::atoi(transport.c_str() + transport.find("server_port=") + 12) + 1);
+
+        // One session per connection.
+        TEST_CHECK(client.Request("SETUP", url + "/trackID=0", 2, transportHeader).status == 459);
+
+        reply = client.Request("PLAY", url, 3, "Session: " + session + "\r\nRange: npt=0.000-\r\n");
+        TEST_CHECK(reply.status == 200);
+        TEST_CHECK(reply.GetHeader("Session") == session);
+        TEST_CHECK(reply.GetHeader("RTP-Info") == "url=" + url);
+
+        const auto packets = ReceivePackets(rtp, 1000);
+        std::vector<const std::vector<uint8_t>*> stream;
+        for (const auto& packet : packets)
+        {
+            stream.push_back(&packet);
+        }
+        CheckStream(stream, ssrc);
+
+        // A NACK of a packet sent, from the RTCP port of the client, is answered with the packet.
+        const auto& lost = packets[packets.size() - 5];
+        uint8_t nack[16] = { 0x81, 205, 0, 3 };
+        Rtp::WriteUInt32(nack + 4, 0x1234);
+        Rtp::WriteUInt32(nack + 8, ssrc);
+        Rtp::WriteUInt16(nack + 12, Rtp::GetSequenceNumber(lost.data()));
+        rtcp.SendTo(serverRtcpPort, nack, sizeof(nack));
+
+        bool isRetransmitted = false;
+        for (const auto& packet : ReceivePackets(rtp, 500))
+        {
+            isRetransmitted |= packet == lost;
+        }
+        TEST_CHECK(isRetransmitted);
+
+        reply = client.Request("GET_PARAMETER", url, 4, "Session: " + session + "\r\n");
+        TEST_CHECK(reply.status == 200 && reply.GetHeader("Session") == session);
+
+        TEST_CHECK(client.Request("TEARDOWN", url, 5, "Session: " + session + "\r\n").status == 200);
+        ReceivePackets(rtp, 200);
+        TEST_CHECK(ReceivePackets(rtp, 300).empty());
+        TEST_CHECK(server.Get().GetPlayingCount() == 0);
+    }
+
+    void PlaysInterleaved()
+    {
+        TestServer server;
+        RtspClient client(server.Get().GetPort());
+        const auto url = server.GetUrl();
+
+        auto reply = client.Request("SETUP", url + "/trackID=0", 1, "Transport: RTP/AVP/TCP;unicast;interleaved=2-3\r\n");
+        TEST_CHECK(reply.status == 200);
+        const auto transport = reply.GetHeader("Transport");
+        TEST_CHECK(transport.find("interleaved=2-3") != std::string::npos);
+        const auto session = ParseSession(reply);
+
+        // The replies come in the stream, between the frames.
+        reply = client.Request("PLAY", url, 2, "Session: " + session + "\r\n");
+        TEST_CHECK(reply.status == 200);
+        client.ReadFrames(1000);
+        TEST_CHECK(client.Request("TEARDOWN", url, 3, "Session: " + session + "\r\n").status == 200);
+
+        std::vector<const std::vector<uint8_t>*> stream;
+        for (const auto& frame : client.frames)
+        {
+            TEST_CHECK(frame.channel == 2);
+            stream.push_back(&frame.packet);
+        }
+        CheckStream(stream, ParseSsrc(transport));
+
+        // Nothing follows the reply to TEARDOWN.
+        const auto frameCount = client.frames.size();
+        client.ReadFrames(300);
+        TEST_CHECK(client.frames.size() == frameCount);
+    }
+
+    void ClosesIdleConnections()
+    {
+        TestServer server(1);
+        RtspClient client(server.Get().GetPort());
+
+        // Closed between the timeout and the next housekeeping, a second later.
+        const auto start = std::chrono::steady_clock::now();
+        TEST_CHECK(client.WaitForClose());
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        TEST_CHECK(seconds > 0.9 && seconds < 2.5);
+    }
+
+    void ClosesConnectionsWhilePlaying()
+    {
+        TestServer server;
+        const auto url = server.GetUrl();
+
+        std::vector<std::unique_ptr<RtspClient>> clients;
+        for (int i = 0; i < 20; ++i)
+        {
+            clients.emplace_back(new RtspClient(server.Get().GetPort()));
+            auto& client = *clients.back();
+            const auto transport = (i % 2 == 0) ? "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n" : "Transport: RTP/AVP;unicast;client_port=9-10\r\n";
+            const auto reply = client.Request("SETUP", url, 1, transport);
+            TEST_CHECK(reply.status == 200);
+            client.SendRequest("PLAY", url, 2, "Session: " + ParseSession(reply) + "\r\n");
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        TEST_CHECK(server.Get().GetPlayingCount() == 20);
+
+        // Closed by the client without TEARDOWN, the interleaved ones in the middle of a frame.
+        clients.clear();
+        RtspServerStats stats = {};
+        for (int i = 0; i < 100; ++i)
+        {
+            server.Get().GetStats(stats);
+            if (stats.connections == 0)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        TEST_CHECK(stats.connections == 0 && stats.playingClients == 0);
+        TEST_CHECK(stats.accessUnitsPushed > 0 && stats.interleavedBytesSent > 0);
+    }
+}
+
+int main()
+{
+    // Writes to the closed connections fail with EPIPE instead of raising SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    TEST_RUN(DescribesTheStream);
+    TEST_RUN(RejectsInvalidRequests);
+    TEST_RUN(PlaysOverUdp);
+    TEST_RUN(PlaysInterleaved);
+    TEST_RUN(ClosesIdleConnections);
+    TEST_RUN(ClosesConnectionsWhilePlaying);
+    return 0;
+}
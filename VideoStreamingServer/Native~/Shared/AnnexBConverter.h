@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace LiveCaptureNative
+{
+    // Conversions between the two H264 bitstream layouts:
+    //   - AVCC (VideoToolbox, MP4 samples): each NAL unit is prefixed by its big-endian length.
+    //   - Annex B (NVENC, RTP packetizer): NAL units are separated by 00 00 01 / 00 00 00 01 start codes.
+    //
+    // Header-only and allocation-free: callers size their buffer once with the Get*Size functions
+    // (or use the in-place variant when the length fields are 4 bytes) and convert in a single pass.
+    // Every function validates the lengths against the input and returns false on a malformed stream.
+    namespace AnnexB
+    {
+        const uint8_t k_StartCode[4] = { 0, 0, 0, 1 };
+        const size_t  k_StartCodeSize = sizeof(k_StartCode);
+
+        inline uint32_t ReadLength(const uint8_t* data, size_t lengthSize)
+        {
+            uint32_t length = 0;
+            for (size_t i = 0; i < lengthSize; ++i)
+            {
+                length = (length << 8) | data[i];
+            }
+            return length;
+        }
+
+        inline void WriteLength(uint8_t* data, uint32_t length)
+        {
+            data[0] = static_cast<uint8_t>(length >> 24);
+            data[1] = static_cast<uint8_t>(length >> 16);
+            data[2] = static_cast<uint8_t>(length >> 8);
+            data[3] = static_cast<uint8_t>(length);
+        }
+
+        // Computes the size of the Annex B stream (4-byte start codes) for an AVCC stream.
+        inline bool GetAnnexBSize(const uint8_t* avcc, size_t size, size_t lengthSize, size_t& annexBSize)
+        {
+            if (lengthSize < 1 || lengthSize > 4)
+                return false;
+
+            annexBSize = 0;
+            size_t offset = 0;
+            while (offset < size)
+            {
+                if (size - offset < lengthSize)
+                    return false;
+
+                const size_t nalSize = ReadLength(avcc + offset, lengthSize);
+                if (nalSize > size - offset - lengthSize)
+                    return false;
+
+                annexBSize += k_StartCodeSize + nalSize;
+                offset += lengthSize + nalSize;
+            }
+            return true;
+        }
+
+        // Copies an AVCC stream into a pre-sized buffer, replacing the length fields by start codes.
+        inline bool AvccToAnnexB(const uint8_t* avcc,
+                                 size_t size,
+                                 size_t lengthSize,
+                                 uint8_t* annexB,
+                                 size_t capacity,
+                                 size_t& written)
+        {
+            if (lengthSize < 1 || lengthSize > 4)
+                return false;
+
+            written = 0;
+            size_t offset = 0;
+            while (offset < size)
+            {
+                if (size - offset < lengthSize)
+                    return false;
+
+                const size_t nalSize = ReadLength(avcc + offset, lengthSize);
+                if (nalSize > size - offset - lengthSize || k_StartCodeSize + nalSize > capacity - written)
+                    return false;
+
+                std::memcpy(annexB + written, k_StartCode, k_StartCodeSize);
+                std::memcpy(annexB + written + k_StartCodeSize, avcc + offset + lengthSize, nalSize);
+
+                written += k_StartCodeSize + nalSize;
+                offset += lengthSize + nalSize;
+            }
+            return true;
+        }
+
+        // Rewrites an AVCC stream with 4-byte length fields (VideoToolbox output) to Annex B in place,
+        // the size doesn't change. On failure the buffer may be partially converted.
+        inline bool AvccToAnnexBInPlace(uint8_t* data, size_t size)
+        {
+            size_t offset = 0;
+            while (offset < size)
+            {
+                if (size - offset < k_StartCodeSize)
+                    return false;
+
+                const size_t nalSize = ReadLength(data + offset, k_StartCodeSize);
+                if (nalSize > size - offset - k_StartCodeSize)
+                    return false;
+
+                std::memcpy(data + offset, k_StartCode, k_StartCodeSize);
+                offset += k_StartCodeSize + nalSize;
+            }
+            return true;
+        }
+
+        // Returns the first 00 00 01 start code in [begin, end), or end if there is none.
+        // startCodeSize is 4 when the start code is preceded by a zero byte.
+        // Words without any zero byte are skipped 8 bytes at a time; the load goes through memcpy
+        // so it stays alignment-safe and compiles to a single move.
+        inline const uint8_t* FindStartCode(const uint8_t* begin, const uint8_t* end, size_t& startCodeSize)
+        {
+            const uint64_t k_Ones = 0x0101010101010101ull;
+            const uint64_t k_Highs = 0x8080808080808080ull;
+
+            const uint8_t* p = begin;
+            while (end - p >= 3)
+            {
+                if (end - p >= 8)
+                {
+                    uint64_t word;
+                    std::memcpy(&word, p, sizeof(word));
+
+                    // Non-zero if any byte of the word is 0.
+                    if (((word - k_Ones) & ~word & k_Highs) == 0)
+                    {
+                        p += 8;
+                        continue;
+                    }
+                }
+
+                if (p[2] > 1)
+                {
+                    p += 3;
+                }
+                else if (p[2] == 1 && p[1] == 0 && p[0] == 0)
+                {
+                    startCodeSize = (p > begin && p[-1] == 0) ? 4 : 3;
+                    return p;
+                }
+                else
+                {
+                    ++p;
+                }
+            }
+            return end;
+        }
+
+        // Calls fn(const uint8_t* nal, size_t nalSize) for each NAL unit of an Annex B stream.
+        template <typename Fn> bool ForEachNalUnit(const uint8_t* annexB, size_t size, Fn fn)
+        {
+            const uint8_t* end = annexB + size;
+            size_t startCodeSize = 0;
+
+            const uint8_t* p = FindStartCode(annexB, end, startCodeSize);
+            if (p == end)
+                return false;
+
+            p += 3;
+            while (p < end)
+            {
+                const uint8_t* next = FindStartCode(p, end, startCodeSize);
+
+                // The zero byte of a 4-byte start code isn't part of the previous NAL unit.
+                const uint8_t* nalEnd = (next != end && startCodeSize == 4) ? next - 1 : next;
+                if (nalEnd > p)
+                {
+                    fn(p, static_cast<size_t>(nalEnd - p));
+                }
+                p = (next == end) ? end : next + 3;
+            }
+            return true;
+        }
+
+        // Computes the size of the AVCC stream (4-byte lengths) for an Annex B stream.
+        inline bool GetAvccSize(const uint8_t* annexB, size_t size, size_t& avccSize)
+        {
+            avccSize = 0;
+            return ForEachNalUnit(annexB, size, [&avccSize](const uint8_t*, size_t nalSize)
+            {
+                avccSize += k_StartCodeSize + nalSize;
+            });
+        }
+
+        // Copies an Annex B stream into a pre-sized buffer with 4-byte length fields.
+        inline bool AnnexBToAvcc(const uint8_t* annexB,
+                                 size_t size,
+                                 uint8_t* avcc,
+                                 size_t capacity,
+                                 size_t& written)
+        {
+            written = 0;
+            bool fits = true;
+
+            const bool valid = ForEachNalUnit(annexB, size, [&](const uint8_t* nal, size_t nalSize)
+            {
+                if (!fits || nalSize > UINT32_MAX || k_StartCodeSize + nalSize > capacity - written)
+                {
+                    fits = false;
+                    return;
+                }
+
+                WriteLength(avcc + written, static_cast<uint32_t>(nalSize));
+                std::memcpy(avcc + written + k_StartCodeSize, nal, nalSize);
+                written += k_StartCodeSize + nalSize;
+            });
+
+            return valid && fits;
+        }
+    }
+}
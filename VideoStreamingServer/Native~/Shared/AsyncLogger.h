@@ -0,0 +1,357 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Lowest level compiled in, as an int (see LogLevel). Calls through LIVECAPTURE_LOG below it are
+// removed by the compiler. Defaults to None: plugins opt in from their debug configuration.
+#ifndef LIVECAPTURE_LOG_LEVEL
+#define LIVECAPTURE_LOG_LEVEL 4
+#endif
+
+// LIVECAPTURE_LOG(LogLevel::Info, "format %d", value): printf-style, the arguments are only
+// evaluated when the level is compiled in and enabled at runtime.
+#define LIVECAPTURE_LOG(level, ...)                                                                \
+    do                                                                                             \
+    {                                                                                              \
+        if (static_cast<int>(level) >= LIVECAPTURE_LOG_LEVEL &&                                    \
+            ::LiveCaptureNative::AsyncLogger::Get().IsEnabled(level))                              \
+        {                                                                                          \
+            ::LiveCaptureNative::AsyncLogger::Get().Writef(level, __VA_ARGS__);                    \
+        }                                                                                          \
+    } while (0)
+
+namespace LiveCaptureNative
+{
+    enum class LogLevel : int
+    {
+        Debug = 0,
+        Info,
+        Warning,
+        Error,
+        None
+    };
+
+    // Logger shared by the encoder plugins, safe to call from the render thread and the encoder
+    // output threads.
+    //
+    // A call formats the message into a fixed-size record of a bounded multi-producer ring and
+    // returns; a background thread drains the ring into the log file. Producers never block or
+    // allocate: when the ring is full the message is dropped and counted, the flusher reports the
+    // drops in the file. Messages longer than a record are truncated.
+    //
+    // The instance is intentionally never destroyed: its thread must not be joined from the
+    // static destructors, which run under the loader lock on Windows. Call Close() when the plugin
+    // is unloaded.
+    class AsyncLogger final
+    {
+    public:
+        static const size_t k_RecordCount = 1024;
+        static const size_t k_MessageSize = 240;
+        static const size_t k_WakeThreshold = k_RecordCount / 4;
+
+        static AsyncLogger& Get()
+        {
+            static AsyncLogger* s_Instance = new AsyncLogger();
+            return *s_Instance;
+        }
+
+        AsyncLogger(const AsyncLogger&) = delete;
+        AsyncLogger& operator=(const AsyncLogger&) = delete;
+
+        // Opens the log file and starts the flusher. Messages written before are discarded.
+        bool Open(const std::string& path, bool append = false)
+        {
+            std::lock_guard<std::mutex> lock(m_ControlMutex);
+
+            if (m_File != nullptr)
+                return true;
+
+            m_File = std::fopen(path.c_str(), append ? "a" : "w");
+            if (m_File == nullptr)
+                return false;
+
+            m_StopRequested = false;
+            m_Flusher = std::thread(&AsyncLogger::FlusherLoop, this);
+            m_Opened.store(true, std::memory_order_release);
+            return true;
+        }
+
+        // Writes the pending messages, stops the flusher and closes the file.
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock(m_ControlMutex);
+
+            if (m_File == nullptr)
+                return;
+
+            m_Opened.store(false, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> wakeLock(m_WakeMutex);
+                m_StopRequested = true;
+            }
+            m_WakeCondition.notify_one();
+            m_Flusher.join();
+
+            std::fclose(m_File);
+            m_File = nullptr;
+        }
+
+        // Wakes the flusher and waits until the messages written so far are in the file.
+        void Flush()
+        {
+            if (!m_Opened.load(std::memory_order_acquire))
+                return;
+
+            const auto target = m_EnqueuePosition.load(std::memory_order_acquire);
+
+            std::unique_lock<std::mutex> lock(m_WakeMutex);
+            m_WakeRequested = true;
+            m_WakeCondition.notify_one();
+            m_FlushedCondition.wait_for(lock, std::chrono::seconds(1), [this, target]()
+            {
+                return m_FlushedPosition >= target || m_StopRequested;
+            });
+        }
+
+        void SetLevel(LogLevel level) { m_Level.store(static_cast<int>(level), std::memory_order_relaxed); }
+        LogLevel GetLevel() const { return static_cast<LogLevel>(m_Level.load(std::memory_order_relaxed)); }
+
+        inline bool IsEnabled(LogLevel level) const
+        {
+            return static_cast<int>(level) >= m_Level.load(std::memory_order_relaxed) &&
+                   level != LogLevel::None &&
+                   m_Opened.load(std::memory_order_relaxed);
+        }
+
+        inline uint64_t GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+        void Write(LogLevel level, const char* message)
+        {
+            Record* record = BeginRecord(level);
+            if (record == nullptr)
+                return;
+
+            size_t length = std::strlen(message);
+            if (length >= k_MessageSize)
+            {
+                length = k_MessageSize - 1;
+            }
+            std::memcpy(record->text, message, length);
+            record->length = static_cast<uint16_t>(length);
+
+            EndRecord(record);
+        }
+
+        void Writef(LogLevel level, const char* format, ...)
+        {
+            Record* record = BeginRecord(level);
+            if (record == nullptr)
+                return;
+
+            va_list args;
+            va_start(args, format);
+            const int length = std::vsnprintf(record->text, k_MessageSize, format, args);
+            va_end(args);
+
+            record->length = static_cast<uint16_t>(
+                (length < 0) ? 0 : (static_cast<size_t>(length) >= k_MessageSize ? k_MessageSize - 1 : length));
+
+            EndRecord(record);
+        }
+
+    private:
+        // Slot of the ring. sequence == position: free for the producer claiming that position,
+        // sequence == position + 1: filled, readable by the flusher.
+        struct Record
+        {
+            std::atomic<uint64_t> sequence;
+            uint64_t              time;
+            uint32_t              thread;
+            LogLevel              level;
+            uint16_t              length;
+            char                  text[k_MessageSize];
+        };
+
+        AsyncLogger() :
+            m_Level(static_cast<int>(LogLevel::Debug)),
+            m_Opened(false),
+            m_EnqueuePosition(0),
+            m_Dropped(0),
+            m_DequeuePosition(0),
+            m_File(nullptr),
+            m_StopRequested(false),
+            m_WakeRequested(false),
+            m_FlushedPosition(0)
+        {
+            for (size_t i = 0; i < k_RecordCount; ++i)
+            {
+                m_Records[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        // Claims the next record, or returns nullptr if the ring is full.
+        Record* BeginRecord(LogLevel level)
+        {
+            auto position = m_EnqueuePosition.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Record* record = &m_Records[position % k_RecordCount];
+                const auto sequence = record->sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<int64_t>(sequence - position);
+
+                if (difference == 0)
+                {
+                    if (m_EnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    {
+                        // Wake the flusher early on bursts rather than waiting for its period.
+                        // Notifying without the mutex can miss the wait, the period covers it.
+                        if ((position + 1) % k_WakeThreshold == 0)
+                        {
+                            m_WakeCondition.notify_one();
+                        }
+
+                        record->time = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now().time_since_epoch()).count());
+                        record->thread = static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+                        record->level = level;
+                        return record;
+                    }
+                }
+                else if (difference < 0)
+                {
+                    m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                else
+                {
+                    position = m_EnqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void EndRecord(Record* record)
+        {
+            const auto position = record->sequence.load(std::memory_order_relaxed);
+            record->sequence.store(position + 1, std::memory_order_release);
+        }
+
+        static const char* GetLevelName(LogLevel level)
+        {
+            switch (level)
+            {
+            case LogLevel::Debug:   return "Debug";
+            case LogLevel::Info:    return "Info";
+            case LogLevel::Warning: return "Warning";
+            case LogLevel::Error:   return "Error";
+            default:                return "";
+            }
+        }
+
+        // Flusher thread: writes the filled records in order, returns the number written.
+        size_t Drain()
+        {
+            size_t count = 0;
+            for (;;)
+            {
+                Record* record = &m_Records[m_DequeuePosition % k_RecordCount];
+                if (record->sequence.load(std::memory_order_acquire) != m_DequeuePosition + 1)
+                    break;
+
+                // Keep a single line per record, the messages often end with '\n' already.
+                size_t length = record->length;
+                while (length > 0 && (record->text[length - 1] == '\n' || record->text[length - 1] == '\r'))
+                {
+                    --length;
+                }
+
+                std::fprintf(m_File, "%llu [%s] [%08x] %.*s\n",
+                             static_cast<unsigned long long>(record->time),
+                             GetLevelName(record->level),
+                             record->thread,
+                             static_cast<int>(length),
+                             record->text);
+
+                record->sequence.store(m_DequeuePosition + k_RecordCount, std::memory_order_release);
+                ++m_DequeuePosition;
+                ++count;
+            }
+            return count;
+        }
+
+        void FlusherLoop()
+        {
+            uint64_t reportedDrops = m_Dropped.load(std::memory_order_relaxed);
+
+            for (;;)
+            {
+                bool stopping;
+                {
+                    std::unique_lock<std::mutex> lock(m_WakeMutex);
+                    m_WakeCondition.wait_for(lock, std::chrono::milliseconds(20), [this]()
+                    {
+                        return m_StopRequested || m_WakeRequested ||
+                               m_EnqueuePosition.load(std::memory_order_relaxed) - m_DequeuePosition >= k_WakeThreshold;
+                    });
+                    m_WakeRequested = false;
+                    stopping = m_StopRequested;
+                }
+
+                const auto written = Drain();
+
+                const auto dropped = m_Dropped.load(std::memory_order_relaxed);
+                if (dropped != reportedDrops)
+                {
+                    std::fprintf(m_File, "[Warning] %llu log messages dropped, the log ring was full.\n",
+                                 static_cast<unsigned long long>(dropped - reportedDrops));
+                    reportedDrops = dropped;
+                }
+
+                if (written > 0)
+                {
+                    std::fflush(m_File);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(m_WakeMutex);
+                    m_FlushedPosition = m_DequeuePosition;
+                }
+                m_FlushedCondition.notify_all();
+
+                if (stopping)
+                    break;
+            }
+        }
+
+        // Written by the producers.
+        std::atomic<int>      m_Level;
+        std::atomic<bool>     m_Opened;
+        std::atomic<uint64_t> m_EnqueuePosition;
+        std::atomic<uint64_t> m_Dropped;
+
+        // Owned by the flusher thread.
+        uint64_t              m_DequeuePosition;
+        std::FILE*            m_File;
+
+        std::mutex              m_ControlMutex;
+        std::mutex              m_WakeMutex;
+        std::condition_variable m_WakeCondition;
+        std::condition_variable m_FlushedCondition;
+        bool                    m_StopRequested;
+        bool                    m_WakeRequested;
+        uint64_t                m_FlushedPosition;
+        std::thread             m_Flusher;
+
+        Record m_Records[k_RecordCount];
+    };
+}
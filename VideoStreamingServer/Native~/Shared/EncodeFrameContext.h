@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "FrameTimecode.h"
+
+namespace LiveCaptureNative
+{
+    // Timing of one submitted frame, carried through the encoder to its output.
+    struct EncodeFrameContext
+    {
+        uint64_t      timestamp;  // Capture time given by Unity, in nanoseconds.
+        uint64_t      sequence;   // Submission order, unique per encoder.
+        uint64_t      submitTime; // GetEncodeClockNs() when the frame was handed to the encoder.
+        FrameTimecode timecode;   // Timecode of the capture, written to the SEI of the frame.
+    };
+
+    // Monotonic clock used to measure the encode latency.
+    inline uint64_t GetEncodeClockNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Contexts of the frames in flight, looked up from the value each encoder API carries from
+    // input to output (NVENC inputTimeStamp, VideoToolbox sourceFrameRefCon, MF sample time)
+    // instead of assuming the outputs come back in submission order.
+    //
+    // The submit thread writes, the encoder output thread reads. Slots are reused every Capacity
+    // frames; a frame still in flight after that reports a failed lookup instead of another
+    // frame's timing. Each slot is a small seqlock so that a read never sees a torn entry.
+    template <size_t Capacity> class EncodeFrameContextTable final
+    {
+    public:
+        EncodeFrameContextTable() :
+            m_NextSequence(0)
+        {
+            Reset();
+        }
+
+        EncodeFrameContextTable(const EncodeFrameContextTable&) = delete;
+        EncodeFrameContextTable& operator=(const EncodeFrameContextTable&) = delete;
+
+        // Submit thread: records a new frame and returns its context.
+        EncodeFrameContext Begin(uint64_t timestamp, const FrameTimecode& timecode = FrameTimecode())
+        {
+            EncodeFrameContext context;
+            context.timestamp = timestamp;
+            context.sequence = m_NextSequence++;
+            context.submitTime = GetEncodeClockNs();
+            context.timecode = timecode;
+
+            uint64_t timecodeWords[k_TimecodeWordCount] = {};
+            std::memcpy(timecodeWords, &timecode, sizeof(timecode));
+
+            auto& slot = m_Slots[context.sequence % Capacity];
+
+            slot.key.store(k_InvalidKey, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.timestamp.store(context.timestamp, std::memory_order_relaxed);
+            slot.submitTime.store(context.submitTime, std::memory_order_relaxed);
+            for (size_t i = 0; i < k_TimecodeWordCount; ++i)
+            {
+                slot.timecode[i].store(timecodeWords[i], std::memory_order_relaxed);
+            }
+            slot.key.store(context.sequence, std::memory_order_release);
+
+            return context;
+        }
+
+        // Output thread: finds the context of a frame from its sequence number.
+        bool Find(uint64_t sequence, EncodeFrameContext& context) const
+        {
+            return Read(m_Slots[sequence % Capacity], context) && context.sequence == sequence;
+        }
+
+        // Output thread: finds the context of a frame for which pred(context) returns true,
+        // for encoders that only carry a derived value (e.g. the MF sample time).
+        template <typename Pred> bool FindIf(Pred pred, EncodeFrameContext& context) const
+        {
+            for (const auto& slot : m_Slots)
+            {
+                if (Read(slot, context) && pred(context))
+                    return true;
+            }
+            return false;
+        }
+
+        // Forgets the frames in flight. Only call it when the encoder doesn't produce outputs.
+        void Reset()
+        {
+            for (auto& slot : m_Slots)
+            {
+                slot.key.store(k_InvalidKey, std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        static const uint64_t k_InvalidKey = ~0ull;
+        static const size_t   k_TimecodeWordCount = (sizeof(FrameTimecode) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+        struct Slot
+        {
+            std::atomic<uint64_t> key;
+            std::atomic<uint64_t> timestamp;
+            std::atomic<uint64_t> submitTime;
+            std::atomic<uint64_t> timecode[k_TimecodeWordCount];
+        };
+
+        static bool Read(const Slot& slot, EncodeFrameContext& context)
+        {
+            const auto key = slot.key.load(std::memory_order_acquire);
+            if (key == k_InvalidKey)
+                return false;
+
+            context.sequence = key;
+            context.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+            context.submitTime = slot.submitTime.load(std::memory_order_relaxed);
+
+            uint64_t timecodeWords[k_TimecodeWordCount];
+            for (size_t i = 0; i < k_TimecodeWordCount; ++i)
+            {
+                timecodeWords[i] = slot.timecode[i].load(std::memory_order_relaxed);
+            }
+            std::memcpy(&context.timecode, timecodeWords, sizeof(context.timecode));
+
+            // The slot was rewritten while reading.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return slot.key.load(std::memory_order_relaxed) == key;
+        }
+
+        uint64_t m_NextSequence;
+        Slot     m_Slots[Capacity];
+    };
+}
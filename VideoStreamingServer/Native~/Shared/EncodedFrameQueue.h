@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "EncoderBuffering.h"
+#include "EncoderStats.h"
+#include "SpscFrameRing.h"
+
+namespace LiveCaptureNative
+{
+    // Output queue of an encoder: a SpscFrameRing holding up to the configured output queue
+    // length, with the backpressure policy applied when it is full. Same threading as the ring,
+    // the producer is the encoder output thread and the consumer the Unity thread.
+    //
+    // DropOldest can't be done by the producer (the consumer may be reading the oldest frame), so
+    // the ring is allowed to grow past the queue length and the consumer discards the surplus in
+    // TrimOldest(), before it starts reading a frame. Capacity must hold twice k_MaxOutputQueueLength
+    // for that slack.
+    template <typename T, size_t Capacity> class EncodedFrameQueue final
+    {
+        static_assert(Capacity >= 2 * k_MaxOutputQueueLength, "EncodedFrameQueue needs slack for DropOldest.");
+
+    public:
+        explicit EncodedFrameQueue(EncoderStats& stats) :
+            m_Stats(&stats),
+            m_Length(static_cast<size_t>(k_MaxOutputQueueLength)),
+            m_Policy(BackpressurePolicy::DropNewest),
+            m_IsCancelled(false),
+            m_IsSkippingToKeyFrame(false),
+            m_IsKeyFrameRequested(false),
+            m_Dropped(0)
+        {
+        }
+
+        EncodedFrameQueue(const EncodedFrameQueue&) = delete;
+        EncodedFrameQueue& operator=(const EncodedFrameQueue&) = delete;
+
+        // Only call it when neither the producer nor the consumer is running, settings are validated.
+        void Configure(const EncoderBufferingSettings& settings)
+        {
+            m_Length = static_cast<size_t>(settings.outputQueueLength);
+            m_Policy = static_cast<BackpressurePolicy>(settings.policy);
+            m_Ring.SetLimit((m_Policy == BackpressurePolicy::DropOldest) ? 2 * m_Length : m_Length);
+            m_IsSkippingToKeyFrame = false;
+            m_IsKeyFrameRequested.store(false, std::memory_order_relaxed);
+        }
+
+        // Producer: returns the slot to fill, or nullptr if the policy drops the frame.
+        // The frame becomes visible to the consumer on Publish().
+        T* BeginWrite(bool isKeyFrame)
+        {
+            if (m_IsSkippingToKeyFrame)
+            {
+                if (!isKeyFrame)
+                {
+                    m_Stats->RecordSkipped();
+                    m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                    return nullptr;
+                }
+                m_IsSkippingToKeyFrame = false;
+            }
+
+            if (IsFull() && m_Policy == BackpressurePolicy::Block)
+            {
+                const auto start = GetEncodeClockNs();
+                WaitUntil([this]() { return !IsFull() || m_IsCancelled.load(std::memory_order_relaxed); },
+                          k_BackpressureTimeoutNs);
+                m_Stats->RecordBlocked(GetEncodeClockNs() - start);
+            }
+
+            if (IsFull())
+            {
+                m_Stats->RecordDropped();
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+
+                // The next frames reference the lost one: wait for a key frame, and ask for one now.
+                if (m_Policy == BackpressurePolicy::DropToKeyFrame)
+                {
+                    m_IsSkippingToKeyFrame = true;
+                    m_IsKeyFrameRequested.store(true, std::memory_order_relaxed);
+                }
+                return nullptr;
+            }
+
+            return m_Ring.BeginWrite();
+        }
+
+        void Publish()
+        {
+            m_Ring.Publish();
+        }
+
+        // Submit thread: true once after a frame was dropped with DropToKeyFrame, the next
+        // submitted frame should be a key frame.
+        bool ConsumeKeyFrameRequest()
+        {
+            return m_IsKeyFrameRequested.exchange(false, std::memory_order_relaxed);
+        }
+
+        // Releases a producer blocked in BeginWrite() and makes the following calls drop instead
+        // of waiting, e.g. while the session is stopped.
+        void SetCancelled(bool cancelled)
+        {
+            m_IsCancelled.store(cancelled, std::memory_order_relaxed);
+        }
+
+        // Consumer: applies DropOldest, discarding the frames past the queue length. Only call it
+        // before reading a new frame: the frame returned by Front() must stay until its Pop().
+        void TrimOldest()
+        {
+            if (m_Policy != BackpressurePolicy::DropOldest)
+                return;
+
+            while (m_Ring.GetSize() > m_Length && m_Ring.Pop())
+            {
+                m_Stats->RecordDroppedOldest();
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // Consumer: returns the oldest frame to consume, or nullptr if the queue is empty.
+        // The pointer stays valid until Pop().
+        T* Front()
+        {
+            return m_Ring.Front();
+        }
+
+        bool Pop()
+        {
+            return m_Ring.Pop();
+        }
+
+        // Same threading restriction as Configure().
+        void Clear()
+        {
+            m_Ring.Clear();
+            m_IsSkippingToKeyFrame = false;
+        }
+
+        template <typename Fn> void ForEachSlot(Fn fn)
+        {
+            m_Ring.ForEachSlot(fn);
+        }
+
+        inline size_t GetSize() const { return m_Ring.GetSize(); }
+
+        // Frames discarded by the policy, whatever the reason.
+        inline uint64_t GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+    private:
+        inline bool IsFull() const
+        {
+            return m_Ring.GetSize() >= m_Ring.GetLimit();
+        }
+
+        SpscFrameRing<T, Capacity> m_Ring;
+        EncoderStats*              m_Stats;
+        size_t                     m_Length;
+        BackpressurePolicy         m_Policy;
+        std::atomic<bool>          m_IsCancelled;
+        bool                       m_IsSkippingToKeyFrame; // Producer only.
+        std::atomic<bool>          m_IsKeyFrameRequested;
+        std::atomic<uint64_t>      m_Dropped;
+    };
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <thread>
+
+#include "EncodeFrameContext.h"
+
+namespace LiveCaptureNative
+{
+    // What an encoder does with a frame when its input buffers or its output queue are full.
+    // Values are shared with the C# BackpressurePolicy enum.
+    enum class BackpressurePolicy : int32_t
+    {
+        // The producer waits for room, up to k_BackpressureTimeoutNs, then drops the new frame.
+        // Nothing is lost while the consumer keeps up on average (recording).
+        Block = 0,
+
+        // The new frame is dropped. The queued frames are kept, so the stream stays decodable.
+        DropNewest = 1,
+
+        // The oldest queued encoded frames are discarded so that the consumer always gets the
+        // latest ones (preview). The decoder shows artifacts until the next key frame.
+        DropOldest = 2,
+
+        // The new frame is dropped and so are the following ones until the next key frame, which
+        // the encoder is asked to produce right away. The stream never references a lost frame.
+        DropToKeyFrame = 3,
+    };
+
+    // In-flight depth and output queue length of an encoder session, and the policy applied when
+    // they are exceeded. Blittable: the layout is mirrored by the C# EncoderBufferingSettings,
+    // keep both in sync. Zero fields select the encoder defaults.
+    struct EncoderBufferingSettings
+    {
+        int32_t inFlightDepth;     // Frames submitted to the encoder and not output yet.
+        int32_t outputQueueLength; // Encoded frames waiting to be consumed by Unity.
+        int32_t policy;            // BackpressurePolicy.
+    };
+
+    const int32_t k_MaxInFlightDepth = 16;
+    const int32_t k_MaxOutputQueueLength = 32;
+
+    // Longest wait of the Block policy. Past it the consumer is considered stalled (e.g. no client
+    // is connected) and the frame is dropped, so that the render thread can't hang.
+    const uint64_t k_BackpressureTimeoutNs = 100 * 1000 * 1000;
+
+    inline bool IsValidBackpressurePolicy(int32_t policy)
+    {
+        return policy >= static_cast<int32_t>(BackpressurePolicy::Block) &&
+               policy <= static_cast<int32_t>(BackpressurePolicy::DropToKeyFrame);
+    }
+
+    // Returns the settings the encoder runs with: defaults for the zero fields, the depth clamped
+    // to what the driver supports (maxInFlightDepth), the lengths to the shared limits, and
+    // DropNewest for an unknown policy.
+    inline EncoderBufferingSettings ValidateBufferingSettings(const EncoderBufferingSettings& requested,
+                                                              int32_t defaultInFlightDepth,
+                                                              int32_t maxInFlightDepth,
+                                                              int32_t defaultOutputQueueLength)
+    {
+        const auto clamp = [](int32_t value, int32_t min, int32_t max)
+        {
+            return (value < min) ? min : (value > max) ? max : value;
+        };
+
+        const auto maxDepth = clamp(maxInFlightDepth, 1, k_MaxInFlightDepth);
+
+        EncoderBufferingSettings settings;
+        settings.inFlightDepth = clamp((requested.inFlightDepth > 0) ? requested.inFlightDepth : defaultInFlightDepth,
+                                       1,
+                                       maxDepth);
+        settings.outputQueueLength = clamp((requested.outputQueueLength > 0) ? requested.outputQueueLength : defaultOutputQueueLength,
+                                           1,
+                                           k_MaxOutputQueueLength);
+        settings.policy = IsValidBackpressurePolicy(requested.policy)
+            ? requested.policy
+            : static_cast<int32_t>(BackpressurePolicy::DropNewest);
+        return settings;
+    }
+
+    inline bool operator==(const EncoderBufferingSettings& a, const EncoderBufferingSettings& b)
+    {
+        return a.inFlightDepth == b.inFlightDepth &&
+               a.outputQueueLength == b.outputQueueLength &&
+               a.policy == b.policy;
+    }
+
+    // Spins (yielding) until ready() or the timeout. Returns ready(). Backpressure waits are short
+    // and rare, an event per slot isn't worth it.
+    template <typename Ready> bool WaitUntil(Ready ready, uint64_t timeoutNs)
+    {
+        if (ready())
+            return true;
+
+        const auto start = GetEncodeClockNs();
+        while (!ready())
+        {
+            if (GetEncodeClockNs() - start > timeoutNs)
+                return false;
+
+            std::this_thread::yield();
+        }
+        return true;
+    }
+}
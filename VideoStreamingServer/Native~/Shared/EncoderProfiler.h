@@ -0,0 +1,249 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace LiveCaptureNative
+{
+    // Stages of a frame through a native encoder, shown as markers in the profiler timeline.
+    enum class EncoderMarker : int
+    {
+        Copy = 0,       // Copy of the Unity texture or buffer into the encoder input.
+        Convert,        // Pixel format or bitstream format conversion.
+        EncodePicture,  // Submission of the frame to the encoder.
+        WaitCompletion, // Wait for the encoder output.
+        LockBitstream,  // Read of the encoded bitstream.
+        QueueFrame,     // Hand-off of the encoded frame to the Unity thread.
+        Count
+    };
+
+    // Values sampled once per frame.
+    enum class EncoderCounter : int
+    {
+        QueueDepth = 0, // Encoded frames waiting to be consumed.
+        FrameBytes,     // Size of the encoded frame.
+        DroppedFrames,  // Encoded frames dropped because the queue was full, since the encoder started.
+        Count
+    };
+
+    inline const char* GetEncoderMarkerName(EncoderMarker marker)
+    {
+        switch (marker)
+        {
+        case EncoderMarker::Copy:           return "LiveCapture.Encoder.Copy";
+        case EncoderMarker::Convert:        return "LiveCapture.Encoder.Convert";
+        case EncoderMarker::EncodePicture:  return "LiveCapture.Encoder.EncodePicture";
+        case EncoderMarker::WaitCompletion: return "LiveCapture.Encoder.WaitCompletion";
+        case EncoderMarker::LockBitstream:  return "LiveCapture.Encoder.LockBitstream";
+        case EncoderMarker::QueueFrame:     return "LiveCapture.Encoder.QueueFrame";
+        default:                            return "LiveCapture.Encoder.Unknown";
+        }
+    }
+
+    inline const char* GetEncoderCounterName(EncoderCounter counter)
+    {
+        switch (counter)
+        {
+        case EncoderCounter::QueueDepth:    return "LiveCapture.Encoder.QueueDepth";
+        case EncoderCounter::FrameBytes:    return "LiveCapture.Encoder.FrameBytes";
+        case EncoderCounter::DroppedFrames: return "LiveCapture.Encoder.DroppedFrames";
+        default:                            return "LiveCapture.Encoder.Unknown";
+        }
+    }
+
+    // Receives the instrumentation of the encoders. The plugins install an implementation
+    // forwarding to IUnityProfiler when Unity provides one; the default does nothing, which also
+    // lets the instrumentation run outside of Unity.
+    class IEncoderProfiler
+    {
+    public:
+        virtual ~IEncoderProfiler() {}
+
+        // When false the callers skip the other calls, including the computation of the counters.
+        virtual bool IsEnabled() const = 0;
+
+        virtual void BeginSample(EncoderMarker marker) = 0;
+        virtual void EndSample(EncoderMarker marker) = 0;
+        virtual void SetCounter(EncoderCounter counter, uint64_t value) = 0;
+
+        // Makes the samples of a thread owned by the plugin visible in the profiler.
+        virtual void RegisterThread(const char* name) = 0;
+        virtual void UnregisterThread() = 0;
+    };
+
+    class NullEncoderProfiler final : public IEncoderProfiler
+    {
+    public:
+        bool IsEnabled() const override { return false; }
+        void BeginSample(EncoderMarker) override {}
+        void EndSample(EncoderMarker) override {}
+        void SetCounter(EncoderCounter, uint64_t) override {}
+        void RegisterThread(const char*) override {}
+        void UnregisterThread() override {}
+    };
+
+    // Keeps every call in order, so that tests can check the instrumentation outside of Unity.
+    // Thread-safe, the encoders call it from their own threads.
+    class RecordingEncoderProfiler final : public IEncoderProfiler
+    {
+    public:
+        enum class EventType
+        {
+            Begin,
+            End,
+            Counter,
+            RegisterThread,
+            UnregisterThread,
+        };
+
+        struct Event
+        {
+            EventType type;
+            int       id; // EncoderMarker or EncoderCounter, -1 for the threads.
+            uint64_t  value;
+        };
+
+        bool IsEnabled() const override { return true; }
+
+        void BeginSample(EncoderMarker marker) override { Add(EventType::Begin, static_cast<int>(marker), 0); }
+        void EndSample(EncoderMarker marker) override { Add(EventType::End, static_cast<int>(marker), 0); }
+        void SetCounter(EncoderCounter counter, uint64_t value) override { Add(EventType::Counter, static_cast<int>(counter), value); }
+        void RegisterThread(const char*) override { Add(EventType::RegisterThread, -1, 0); }
+        void UnregisterThread() override { Add(EventType::UnregisterThread, -1, 0); }
+
+        std::vector<Event> GetEvents() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Events;
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Events.clear();
+        }
+
+        // Number of calls of a type, for a marker or counter id or all of them.
+        size_t GetCount(EventType type, int id = -1) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            size_t count = 0;
+            for (const auto& event : m_Events)
+            {
+                count += (event.type == type && (id < 0 || event.id == id)) ? 1 : 0;
+            }
+            return count;
+        }
+
+        // The last value set, false if the counter was never set.
+        bool GetCounter(EncoderCounter counter, uint64_t& value) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (auto it = m_Events.rbegin(); it != m_Events.rend(); ++it)
+            {
+                if (it->type == EventType::Counter && it->id == static_cast<int>(counter))
+                {
+                    value = it->value;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        void Add(EventType type, int id, uint64_t value)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Events.push_back(Event{ type, id, value });
+        }
+
+        mutable std::mutex m_Mutex;
+        std::vector<Event> m_Events;
+    };
+
+    namespace internal
+    {
+        inline IEncoderProfiler* GetNullEncoderProfiler()
+        {
+            static NullEncoderProfiler s_NullProfiler;
+            return &s_NullProfiler;
+        }
+
+        inline std::atomic<IEncoderProfiler*>& GetEncoderProfilerSlot()
+        {
+            static std::atomic<IEncoderProfiler*> s_Profiler(GetNullEncoderProfiler());
+            return s_Profiler;
+        }
+    }
+
+    inline IEncoderProfiler& GetEncoderProfiler()
+    {
+        return *internal::GetEncoderProfilerSlot().load(std::memory_order_acquire);
+    }
+
+    // Installs the profiler used by the encoders, nullptr restores the no-op one. The previous
+    // profiler may still be in use by an encoder thread, it must outlive the encoders.
+    inline void SetEncoderProfiler(IEncoderProfiler* profiler)
+    {
+        internal::GetEncoderProfilerSlot().store(
+            (profiler != nullptr) ? profiler : internal::GetNullEncoderProfiler(),
+            std::memory_order_release);
+    }
+
+    // Counters of an encoder output queue (EncodedFrameQueue) after a frame of frameBytes was
+    // published to it.
+    template <typename Queue> inline void ProfileFrameQueued(const Queue& queue, uint64_t frameBytes)
+    {
+        auto& profiler = GetEncoderProfiler();
+        if (profiler.IsEnabled())
+        {
+            profiler.SetCounter(EncoderCounter::FrameBytes, frameBytes);
+            profiler.SetCounter(EncoderCounter::QueueDepth, queue.GetSize());
+            profiler.SetCounter(EncoderCounter::DroppedFrames, queue.GetDroppedCount());
+        }
+    }
+
+    // Counters of an encoder output queue after its backpressure policy dropped a frame.
+    template <typename Queue> inline void ProfileFrameDropped(const Queue& queue)
+    {
+        auto& profiler = GetEncoderProfiler();
+        if (profiler.IsEnabled())
+        {
+            profiler.SetCounter(EncoderCounter::DroppedFrames, queue.GetDroppedCount());
+        }
+    }
+
+    // Samples the enclosing scope under the given marker.
+    class EncoderProfilerScope final
+    {
+    public:
+        explicit EncoderProfilerScope(EncoderMarker marker) :
+            m_Profiler(GetEncoderProfiler()),
+            m_Marker(marker),
+            m_Enabled(m_Profiler.IsEnabled())
+        {
+            if (m_Enabled)
+            {
+                m_Profiler.BeginSample(m_Marker);
+            }
+        }
+
+        ~EncoderProfilerScope()
+        {
+            if (m_Enabled)
+            {
+                m_Profiler.EndSample(m_Marker);
+            }
+        }
+
+        EncoderProfilerScope(const EncoderProfilerScope&) = delete;
+        EncoderProfilerScope& operator=(const EncoderProfilerScope&) = delete;
+
+    private:
+        IEncoderProfiler& m_Profiler;
+        EncoderMarker     m_Marker;
+        bool              m_Enabled;
+    };
+}
@@ -0,0 +1,401 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "EncodeFrameContext.h"
+#include "EncoderBuffering.h"
+
+namespace LiveCaptureNative
+{
+    // Summary of a histogram at the time of a snapshot. Values are in the unit of the recorded
+    // samples; the percentiles are exact to within the bucket precision (1/8 of the value).
+    struct HistogramSummary
+    {
+        uint64_t count;
+        uint64_t min;
+        uint64_t max;
+        uint64_t mean;
+        uint64_t p50;
+        uint64_t p90;
+        uint64_t p99;
+    };
+
+    // Statistics of one encoder, returned by the GetEncoderStats export of the plugins. Blittable:
+    // the layout is mirrored by NativeEncoderStats on the C# side, keep both in sync.
+    struct EncoderStatsSnapshot
+    {
+        uint64_t framesSubmitted; // Frames handed to the encoder.
+        uint64_t framesEncoded;   // Frames output by the encoder and queued for Unity.
+        uint64_t keyFrames;       // Part of framesEncoded.
+        uint64_t droppedFrames;   // Encoded frames dropped because the queue was full (all the policies).
+        uint64_t bytesEncoded;    // Total size of framesEncoded.
+        uint64_t bitrate;         // Average output bitrate since the first encoded frame, in bits per second.
+        uint64_t queueDepth;      // Encoded frames waiting to be consumed.
+        uint64_t maxQueueDepth;
+
+        HistogramSummary copyTime;       // Copy or conversion of the input, in nanoseconds.
+        HistogramSummary encodeLatency;  // Submit to encoder output, in nanoseconds.
+        HistogramSummary consumeLatency; // Encoder output to consumed by Unity, in nanoseconds.
+        HistogramSummary frameBytes;     // Size of the encoded frames, in bytes.
+
+        // Buffering the encoder runs with, after validation (see EncoderBufferingSettings).
+        uint64_t inFlightDepth;
+        uint64_t outputQueueLength;
+        uint64_t backpressurePolicy;
+
+        uint64_t inputDroppedFrames;  // Frames not submitted because every input buffer was in flight.
+        uint64_t droppedOldestFrames; // Queued frames discarded for newer ones (DropOldest).
+        uint64_t skippedFrames;       // Encoded frames discarded while waiting for a key frame (DropToKeyFrame).
+        uint64_t blockedFrames;       // Frames that waited for room (Block), dropped or not.
+
+        HistogramSummary blockTime;   // Time spent waiting for room, in nanoseconds.
+    };
+
+    // Histogram with fixed log-linear buckets: each power of two is split in k_SubBucketCount
+    // linear buckets, so a recorded value is known to within 1/k_SubBucketCount of itself, from 1
+    // to 2^k_MaxExponent (about 18 minutes in nanoseconds, larger values fall in the last bucket).
+    //
+    // Record() is lock-free and can be called from several threads; Summarize() reads the buckets
+    // while they are written, its result is consistent to within the samples recorded meanwhile.
+    class StatsHistogram final
+    {
+    public:
+        static const int k_SubBucketBits = 3;
+        static const int k_SubBucketCount = 1 << k_SubBucketBits;
+        static const int k_MaxExponent = 40;
+        static const int k_BucketCount = (k_MaxExponent - k_SubBucketBits + 2) * k_SubBucketCount;
+
+        StatsHistogram()
+        {
+            Reset();
+        }
+
+        StatsHistogram(const StatsHistogram&) = delete;
+        StatsHistogram& operator=(const StatsHistogram&) = delete;
+
+        void Record(uint64_t value)
+        {
+            m_Buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+            m_Sum.fetch_add(value, std::memory_order_relaxed);
+
+            auto min = m_Min.load(std::memory_order_relaxed);
+            while (value < min && !m_Min.compare_exchange_weak(min, value, std::memory_order_relaxed))
+            {
+            }
+
+            auto max = m_Max.load(std::memory_order_relaxed);
+            while (value > max && !m_Max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void Summarize(HistogramSummary& summary) const
+        {
+            uint64_t counts[k_BucketCount];
+            uint64_t total = 0;
+            for (int i = 0; i < k_BucketCount; ++i)
+            {
+                counts[i] = m_Buckets[i].load(std::memory_order_relaxed);
+                total += counts[i];
+            }
+
+            summary = HistogramSummary();
+            if (total == 0)
+                return;
+
+            summary.count = total;
+            summary.min = m_Min.load(std::memory_order_relaxed);
+            summary.max = m_Max.load(std::memory_order_relaxed);
+            summary.mean = m_Sum.load(std::memory_order_relaxed) / total;
+            summary.p50 = GetPercentile(counts, total, summary, 50);
+            summary.p90 = GetPercentile(counts, total, summary, 90);
+            summary.p99 = GetPercentile(counts, total, summary, 99);
+        }
+
+        void Reset()
+        {
+            for (int i = 0; i < k_BucketCount; ++i)
+            {
+                m_Buckets[i].store(0, std::memory_order_relaxed);
+            }
+            m_Sum.store(0, std::memory_order_relaxed);
+            m_Min.store(UINT64_MAX, std::memory_order_relaxed);
+            m_Max.store(0, std::memory_order_relaxed);
+        }
+
+        static int GetBucketIndex(uint64_t value)
+        {
+            if (value < k_SubBucketCount)
+                return static_cast<int>(value);
+
+            int exponent = GetHighestBit(value);
+            if (exponent > k_MaxExponent)
+                return k_BucketCount - 1;
+
+            const int shift = exponent - k_SubBucketBits;
+            const int subBucket = static_cast<int>((value >> shift) & (k_SubBucketCount - 1));
+            return (shift + 1) * k_SubBucketCount + subBucket;
+        }
+
+        // Smallest value falling in the bucket.
+        static uint64_t GetBucketLowerBound(int index)
+        {
+            if (index < k_SubBucketCount)
+                return static_cast<uint64_t>(index);
+
+            const int shift = index / k_SubBucketCount - 1;
+            const uint64_t subBucket = static_cast<uint64_t>(index % k_SubBucketCount);
+            return (k_SubBucketCount + subBucket) << shift;
+        }
+
+        // Largest value falling in the bucket.
+        static uint64_t GetBucketUpperBound(int index)
+        {
+            if (index < k_SubBucketCount)
+                return static_cast<uint64_t>(index);
+            if (index == k_BucketCount - 1)
+                return UINT64_MAX;
+
+            const int shift = index / k_SubBucketCount - 1;
+            return GetBucketLowerBound(index) + ((uint64_t(1) << shift) - 1);
+        }
+
+    private:
+        static int GetHighestBit(uint64_t value)
+        {
+            int bit = 0;
+            for (int step = 32; step > 0; step >>= 1)
+            {
+                if (value >> step)
+                {
+                    value >>= step;
+                    bit += step;
+                }
+            }
+            return bit;
+        }
+
+        // Upper bound of the bucket holding the percentile, clamped to the recorded range.
+        static uint64_t GetPercentile(const uint64_t* counts, uint64_t total, const HistogramSummary& summary, int percentile)
+        {
+            const uint64_t rank = (total * percentile + 99) / 100;
+
+            uint64_t cumulated = 0;
+            for (int i = 0; i < k_BucketCount; ++i)
+            {
+                cumulated += counts[i];
+                if (cumulated >= rank)
+                {
+                    const auto value = GetBucketUpperBound(i);
+                    if (value > summary.max)
+                        return summary.max;
+                    if (value < summary.min)
+                        return summary.min;
+                    return value;
+                }
+            }
+            return summary.max;
+        }
+
+        std::atomic<uint64_t> m_Buckets[k_BucketCount];
+        std::atomic<uint64_t> m_Sum;
+        std::atomic<uint64_t> m_Min;
+        std::atomic<uint64_t> m_Max;
+    };
+
+    // Counters and histograms of one encoder. The Record methods are lock-free and called from
+    // the submit, encoder output and consume threads; Snapshot() can be called from any thread.
+    class EncoderStats final
+    {
+    public:
+        EncoderStats()
+        {
+            Reset();
+        }
+
+        EncoderStats(const EncoderStats&) = delete;
+        EncoderStats& operator=(const EncoderStats&) = delete;
+
+        // Submit thread, after the copy or conversion of the input.
+        void RecordCopy(uint64_t durationNs)
+        {
+            m_CopyTime.Record(durationNs);
+        }
+
+        // Submit thread, once the frame is handed to the encoder.
+        void RecordSubmit()
+        {
+            m_FramesSubmitted.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Output thread, once the encoded frame is queued. latencyNs is 0 when unknown.
+        void RecordEncoded(uint64_t latencyNs, uint64_t bytes, bool isKeyFrame, size_t queueDepth)
+        {
+            const auto now = GetEncodeClockNs();
+            uint64_t expected = 0;
+            m_FirstOutputTime.compare_exchange_strong(expected, now, std::memory_order_relaxed);
+            m_LastOutputTime.store(now, std::memory_order_relaxed);
+
+            if (latencyNs != 0)
+            {
+                m_EncodeLatency.Record(latencyNs);
+            }
+            m_FrameBytes.Record(bytes);
+            m_BytesEncoded.fetch_add(bytes, std::memory_order_relaxed);
+            if (isKeyFrame)
+            {
+                m_KeyFrames.fetch_add(1, std::memory_order_relaxed);
+            }
+            m_FramesEncoded.fetch_add(1, std::memory_order_relaxed);
+
+            SetQueueDepth(queueDepth);
+        }
+
+        // Output thread, when the queue is full and the encoded frame is discarded.
+        void RecordDropped()
+        {
+            m_DroppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Submit thread, when no input buffer is free and the frame isn't submitted.
+        void RecordInputDropped()
+        {
+            m_InputDroppedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Consume thread, when a queued frame is discarded for a newer one.
+        void RecordDroppedOldest()
+        {
+            m_DroppedOldestFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Output thread, when an encoded frame is discarded while waiting for a key frame.
+        void RecordSkipped()
+        {
+            m_SkippedFrames.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Submit or output thread, after waiting for room.
+        void RecordBlocked(uint64_t durationNs)
+        {
+            m_BlockedFrames.fetch_add(1, std::memory_order_relaxed);
+            m_BlockTime.Record(durationNs);
+        }
+
+        // When the session is configured.
+        void SetBuffering(const EncoderBufferingSettings& settings)
+        {
+            m_InFlightDepth.store(static_cast<uint64_t>(settings.inFlightDepth), std::memory_order_relaxed);
+            m_OutputQueueLength.store(static_cast<uint64_t>(settings.outputQueueLength), std::memory_order_relaxed);
+            m_BackpressurePolicy.store(static_cast<uint64_t>(settings.policy), std::memory_order_relaxed);
+        }
+
+        // Consume thread, once Unity is done with the frame. latencyNs is the time since the frame
+        // was queued.
+        void RecordConsumed(uint64_t latencyNs, size_t queueDepth)
+        {
+            m_ConsumeLatency.Record(latencyNs);
+            SetQueueDepth(queueDepth);
+        }
+
+        void Snapshot(EncoderStatsSnapshot& snapshot) const
+        {
+            snapshot = EncoderStatsSnapshot();
+            snapshot.framesSubmitted = m_FramesSubmitted.load(std::memory_order_relaxed);
+            snapshot.framesEncoded = m_FramesEncoded.load(std::memory_order_relaxed);
+            snapshot.keyFrames = m_KeyFrames.load(std::memory_order_relaxed);
+            snapshot.droppedFrames = m_DroppedFrames.load(std::memory_order_relaxed);
+            snapshot.bytesEncoded = m_BytesEncoded.load(std::memory_order_relaxed);
+            snapshot.queueDepth = m_QueueDepth.load(std::memory_order_relaxed);
+            snapshot.maxQueueDepth = m_MaxQueueDepth.load(std::memory_order_relaxed);
+
+            const auto first = m_FirstOutputTime.load(std::memory_order_relaxed);
+            const auto last = m_LastOutputTime.load(std::memory_order_relaxed);
+            if (first != 0 && last > first)
+            {
+                // Double rather than integer math, bytes * 8e9 overflows after a few GB.
+                snapshot.bitrate = static_cast<uint64_t>(
+                    static_cast<double>(snapshot.bytesEncoded) * 8.0 * 1e9 / static_cast<double>(last - first));
+            }
+
+            m_CopyTime.Summarize(snapshot.copyTime);
+            m_EncodeLatency.Summarize(snapshot.encodeLatency);
+            m_ConsumeLatency.Summarize(snapshot.consumeLatency);
+            m_FrameBytes.Summarize(snapshot.frameBytes);
+
+            snapshot.inFlightDepth = m_InFlightDepth.load(std::memory_order_relaxed);
+            snapshot.outputQueueLength = m_OutputQueueLength.load(std::memory_order_relaxed);
+            snapshot.backpressurePolicy = m_BackpressurePolicy.load(std::memory_order_relaxed);
+            snapshot.inputDroppedFrames = m_InputDroppedFrames.load(std::memory_order_relaxed);
+            snapshot.droppedOldestFrames = m_DroppedOldestFrames.load(std::memory_order_relaxed);
+            snapshot.skippedFrames = m_SkippedFrames.load(std::memory_order_relaxed);
+            snapshot.blockedFrames = m_BlockedFrames.load(std::memory_order_relaxed);
+            m_BlockTime.Summarize(snapshot.blockTime);
+        }
+
+        // Not synchronized with the Record methods, call it when the encoder is idle. The buffering
+        // settings are kept.
+        void Reset()
+        {
+            m_FramesSubmitted.store(0, std::memory_order_relaxed);
+            m_FramesEncoded.store(0, std::memory_order_relaxed);
+            m_KeyFrames.store(0, std::memory_order_relaxed);
+            m_DroppedFrames.store(0, std::memory_order_relaxed);
+            m_BytesEncoded.store(0, std::memory_order_relaxed);
+            m_QueueDepth.store(0, std::memory_order_relaxed);
+            m_MaxQueueDepth.store(0, std::memory_order_relaxed);
+            m_FirstOutputTime.store(0, std::memory_order_relaxed);
+            m_LastOutputTime.store(0, std::memory_order_relaxed);
+
+            m_CopyTime.Reset();
+            m_EncodeLatency.Reset();
+            m_ConsumeLatency.Reset();
+            m_FrameBytes.Reset();
+
+            m_InputDroppedFrames.store(0, std::memory_order_relaxed);
+            m_DroppedOldestFrames.store(0, std::memory_order_relaxed);
+            m_SkippedFrames.store(0, std::memory_order_relaxed);
+            m_BlockedFrames.store(0, std::memory_order_relaxed);
+            m_BlockTime.Reset();
+        }
+
+    private:
+        void SetQueueDepth(size_t queueDepth)
+        {
+            const auto depth = static_cast<uint64_t>(queueDepth);
+            m_QueueDepth.store(depth, std::memory_order_relaxed);
+
+            auto max = m_MaxQueueDepth.load(std::memory_order_relaxed);
+            while (depth > max && !m_MaxQueueDepth.compare_exchange_weak(max, depth, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        std::atomic<uint64_t> m_FramesSubmitted;
+        std::atomic<uint64_t> m_FramesEncoded;
+        std::atomic<uint64_t> m_KeyFrames;
+        std::atomic<uint64_t> m_DroppedFrames;
+        std::atomic<uint64_t> m_BytesEncoded;
+        std::atomic<uint64_t> m_QueueDepth;
+        std::atomic<uint64_t> m_MaxQueueDepth;
+        std::atomic<uint64_t> m_FirstOutputTime;
+        std::atomic<uint64_t> m_LastOutputTime;
+
+        StatsHistogram m_CopyTime;
+        StatsHistogram m_EncodeLatency;
+        StatsHistogram m_ConsumeLatency;
+        StatsHistogram m_FrameBytes;
+
+        std::atomic<uint64_t> m_InFlightDepth{ 0 };
+        std::atomic<uint64_t> m_OutputQueueLength{ 0 };
+        std::atomic<uint64_t> m_BackpressurePolicy{ 0 };
+        std::atomic<uint64_t> m_InputDroppedFrames;
+        std::atomic<uint64_t> m_DroppedOldestFrames;
+        std::atomic<uint64_t> m_SkippedFrames;
+        std::atomic<uint64_t> m_BlockedFrames;
+
+        StatsHistogram m_BlockTime;
+    };
+}
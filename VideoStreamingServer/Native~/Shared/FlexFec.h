@@ -0,0 +1,648 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LIVE_CAPTURE_FEC_SSE2 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define LIVE_CAPTURE_FEC_NEON 1
+#endif
+
+#include "Rtcp.h"
+#include "RtpPacket.h"
+
+namespace LiveCaptureNative
+{
+    // Forward error correction of the RTP video stream with the FlexFEC fixed masks (RFC 8627),
+    // so that isolated losses are repaired without the round trip of a retransmission.
+    //
+    // The media packets are arranged in blocks of L columns by D rows, in sequence order. A row
+    // repair packet is the XOR of the L consecutive packets of a row, a column repair packet the
+    // XOR of the D packets of a column, L apart. Rows repair isolated losses, columns bursts up to
+    // L packets long; with both, most patterns of two losses in a block are repaired.
+    //
+    // The repair packets are RTP packets of their own stream (payload type and SSRC of the
+    // settings), listing the protected SSRC in their CSRC list. Their FlexFEC header:
+    //
+    //    0                   1                   2                   3
+    //   |R|F|P|X|  CC   |M| PT recovery |        length recovery        |
+    //   |                          TS recovery                          |
+    //   |           SN base             |  L (columns)  |   D (rows)    |
+    //
+    // R is set for a row, F for a column. The recovery fields are the XOR of the same fields of
+    // the protected packets, the length being the size after the fixed RTP header. The payload is
+    // the XOR of what follows the fixed RTP header, the shorter packets padded with zeros.
+    //
+    // The encoder doesn't keep the media packets: each one is XORed into the parity of its row and
+    // column as it is sent, so the cost is a pass over the packet per protection level. The decoder
+    // is used by the test client and by tools, it reads what the encoder writes.
+    namespace FlexFec
+    {
+        const size_t k_HeaderSize = 12;
+
+        // RTP header with the protected SSRC, then the FlexFEC header.
+        const size_t k_RepairHeaderSize = Rtp::k_HeaderSize + 4 + k_HeaderSize;
+
+        // Largest media packet protected: its repair packet must fit in k_MaxPacketSize.
+        const size_t k_MaxProtectedSize = Rtp::k_MaxPacketSize - k_RepairHeaderSize + Rtp::k_HeaderSize;
+
+        const int32_t k_MaxColumns = 48;
+        const int32_t k_MaxRows = 48;
+
+        namespace Detail
+        {
+            // dst ^= src, the kernel of the encoder and the decoder.
+            inline void XorInto(uint8_t* dst, const uint8_t* src, size_t size)
+            {
+                size_t i = 0;
+#if defined(LIVE_CAPTURE_FEC_SSE2)
+                for (; i + 64 <= size; i += 64)
+                {
+                    const auto a0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+                    const auto a1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i + 16)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 16)));
+                    const auto a2 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i + 32)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 32)));
+                    const auto a3 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i + 48)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i + 48)));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a0);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 16), a1);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 32), a2);
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 48), a3);
+                }
+                for (; i + 16 <= size; i += 16)
+                {
+                    const auto a = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), a);
+                }
+#elif defined(LIVE_CAPTURE_FEC_NEON)
+                for (; i + 64 <= size; i += 64)
+                {
+                    const auto a0 = veorq_u8(vld1q_u8(dst + i), vld1q_u8(src + i));
+                    const auto a1 = veorq_u8(vld1q_u8(dst + i + 16), vld1q_u8(src + i + 16));
+                    const auto a2 = veorq_u8(vld1q_u8(dst + i + 32), vld1q_u8(src + i + 32));
+                    const auto a3 = veorq_u8(vld1q_u8(dst + i + 48), vld1q_u8(src + i + 48));
+                    vst1q_u8(dst + i, a0);
+                    vst1q_u8(dst + i + 16, a1);
+                    vst1q_u8(dst + i + 32, a2);
+                    vst1q_u8(dst + i + 48, a3);
+                }
+                for (; i + 16 <= size; i += 16)
+                {
+                    vst1q_u8(dst + i, veorq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+                }
+#endif
+                for (; i + 8 <= size; i += 8)
+                {
+                    uint64_t a, b;
+                    std::memcpy(&a, dst + i, 8);
+                    std::memcpy(&b, src + i, 8);
+                    a ^= b;
+                    std::memcpy(dst + i, &a, 8);
+                }
+                for (; i < size; ++i)
+                {
+                    dst[i] ^= src[i];
+                }
+            }
+
+            // Parity of the packets protected by a repair packet, accumulated as they are sent.
+            // Uses the layout of the repair packet: FlexFEC header, then the payload. The buffer
+            // grows to the largest packet protected, then doesn't allocate anymore.
+            class Parity final
+            {
+            public:
+                Parity() : m_Count(0), m_Size(0), m_Timestamp(0), m_SequenceBase(0)
+                {
+                    m_Data.resize(k_HeaderSize);
+                }
+
+                inline size_t GetCount() const { return m_Count; }
+
+                void Add(const uint8_t* packet, size_t size)
+                {
+                    const auto payloadSize = size - Rtp::k_HeaderSize;
+                    if (m_Count == 0)
+                    {
+                        std::memset(m_Data.data(), 0, k_HeaderSize);
+                        m_Size = 0;
+                        m_SequenceBase = Rtp::GetSequenceNumber(packet);
+                    }
+
+                    // The payload past the previous size is XORed with zeros: a copy.
+                    if (payloadSize > m_Size)
+                    {
+                        if (k_HeaderSize + payloadSize > m_Data.size())
+                            m_Data.resize(k_HeaderSize + payloadSize);
+                        std::memset(m_Data.data() + k_HeaderSize + m_Size, 0, payloadSize - m_Size);
+                        m_Size = payloadSize;
+                    }
+
+                    m_Data[0] ^= packet[0] & 0x3f;
+                    m_Data[1] ^= packet[1];
+                    m_Data[2] ^= static_cast<uint8_t>(payloadSize >> 8);
+                    m_Data[3] ^= static_cast<uint8_t>(payloadSize);
+                    XorInto(m_Data.data() + 4, packet + 4, 4);
+                    XorInto(m_Data.data() + k_HeaderSize, packet + Rtp::k_HeaderSize, payloadSize);
+
+                    m_Timestamp = Rtp::GetTimestamp(packet);
+                    ++m_Count;
+                }
+
+                // Writes the repair packet into out (k_RepairHeaderSize + payload), and resets.
+                size_t Write(bool isRow, uint8_t columns, uint8_t rows, uint8_t payloadType, uint16_t sequence, uint32_t ssrc, uint32_t protectedSsrc, uint8_t* out)
+                {
+                    out[0] = static_cast<uint8_t>((Rtp::k_Version << 6) | 1); // CC = 1.
+                    out[1] = payloadType & 0x7f;
+                    Rtp::SetSequenceNumber(out, sequence);
+                    Rtp::WriteUInt32(out + 4, m_Timestamp);
+                    Rtp::SetSsrc(out, ssrc);
+                    Rtp::WriteUInt32(out + Rtp::k_HeaderSize, protectedSsrc);
+
+                    auto header = out + Rtp::k_HeaderSize + 4;
+                    std::memcpy(header, m_Data.data(), k_HeaderSize);
+                    header[0] |= isRow ? 0x80 : 0x40;
+                    Rtp::WriteUInt16(header + 8, m_SequenceBase);
+                    header[10] = columns;
+                    header[11] = rows;
+                    std::memcpy(out + k_RepairHeaderSize, m_Data.data() + k_HeaderSize, m_Size);
+
+                    m_Count = 0;
+                    return k_RepairHeaderSize + m_Size;
+                }
+
+                void Reset() { m_Count = 0; }
+
+            private:
+                std::vector<uint8_t> m_Data;
+                size_t               m_Count;
+                size_t               m_Size;
+                uint32_t             m_Timestamp;
+                uint16_t             m_SequenceBase;
+            };
+        }
+    }
+
+    // Protection of a FlexFEC encoder. Zero fields select the defaults.
+    struct FlexFecSettings
+    {
+        int32_t  payloadType; // Dynamic payload type of the repair stream, announced in the SDP.
+        uint32_t ssrc;        // Of the repair stream.
+        int32_t  columns;     // L, packets per row. 0 disables the repair packets.
+        int32_t  rows;        // D, rows per block. Column repair packets are sent when above 1.
+        int32_t  isAdaptive;  // Choose L and D from the loss reported by the client instead.
+    };
+
+    struct FlexFecStats
+    {
+        uint64_t packetsProtected;
+        uint64_t rowPacketsSent;
+        uint64_t columnPacketsSent;
+        uint64_t bytesSent;       // Repair packets.
+        uint64_t blocksAbandoned; // Restarted on a gap in the sequence numbers.
+        int32_t  columns;         // Current protection.
+        int32_t  rows;
+        float    loss;            // Smoothed fraction lost reported by the client.
+    };
+
+    // Produces the repair packets of a media stream, after the packetizer. Called from the sender
+    // thread only, apart from OnRtcp() which takes the loss reports of the control port thread.
+    class FlexFecEncoder final
+    {
+    public:
+        static const int32_t k_DefaultPayloadType = 97;
+        static const int32_t k_DefaultColumns = 10;
+
+        // Smoothing of the fraction lost of the receiver reports.
+        static constexpr float k_LossSmoothing = 0.25f;
+
+        explicit FlexFecEncoder(const FlexFecSettings& settings) :
+            m_PayloadType(static_cast<uint8_t>((settings.payloadType > 0) ? settings.payloadType : k_DefaultPayloadType)),
+            m_Ssrc(settings.ssrc),
+            m_IsAdaptive(settings.isAdaptive != 0),
+            m_Columns(0),
+            m_Rows(0),
+            m_NextColumns(0),
+            m_NextRows(0),
+            m_BlockIndex(0),
+            m_ExpectedSequence(0),
+            m_Sequence(0),
+            m_ProtectedSsrc(0),
+            m_Loss(0.0f),
+            m_PacketsProtected(0),
+            m_RowPacketsSent(0),
+            m_ColumnPacketsSent(0),
+            m_BytesSent(0),
+            m_BlocksAbandoned(0)
+        {
+            const auto clamp = [](int32_t value, int32_t max) { return (value < 0) ? 0 : (value > max) ? max : value; };
+
+            m_Columns = m_IsAdaptive ? 0 : clamp(settings.columns, FlexFec::k_MaxColumns);
+            m_Rows = (m_Columns == 0) ? 0 : (settings.rows <= 0) ? 1 : clamp(settings.rows, FlexFec::k_MaxRows);
+            m_NextColumns = m_Columns;
+            m_NextRows = m_Rows;
+            m_ColumnParity.resize(FlexFec::k_MaxColumns);
+            m_Scratch.resize(Rtp::k_MaxPacketSize);
+        }
+
+        FlexFecEncoder(const FlexFecEncoder&) = delete;
+        FlexFecEncoder& operator=(const FlexFecEncoder&) = delete;
+
+        // Protects a media packet once its sequence number and SSRC are final, calling
+        // send(const uint8_t* packet, size_t size) for the repair packets it completes.
+        template<typename Send>
+        void Protect(const uint8_t* packet, size_t size, Send&& send)
+        {
+            if (!Rtp::IsValidPacket(packet, size))
+                return;
+
+            const auto sequence = Rtp::GetSequenceNumber(packet);
+            if (m_BlockIndex != 0 && (sequence != m_ExpectedSequence || size > FlexFec::k_MaxProtectedSize))
+            {
+                // The receiver couldn't tell which packets a repair packet covers.
+                ResetBlock();
+                ++m_BlocksAbandoned;
+            }
+            m_ExpectedSequence = static_cast<uint16_t>(sequence + 1);
+            m_ProtectedSsrc = Rtp::GetSsrc(packet);
+
+            // The protection changes between blocks, the receiver reads it from each repair packet.
+            if (m_BlockIndex == 0)
+            {
+                m_Columns = m_NextColumns.load(std::memory_order_relaxed);
+                m_Rows = m_NextRows.load(std::memory_order_relaxed);
+            }
+
+            if (m_Columns == 0 || size > FlexFec::k_MaxProtectedSize)
+                return;
+
+            const auto column = m_BlockIndex % m_Columns;
+            m_RowParity.Add(packet, size);
+            if (m_Rows > 1)
+            {
+                m_ColumnParity[column].Add(packet, size);
+            }
+            ++m_BlockIndex;
+            ++m_PacketsProtected;
+
+            if (m_RowParity.GetCount() == static_cast<size_t>(m_Columns))
+            {
+                SendRepair(m_RowParity, true, send);
+                ++m_RowPacketsSent;
+            }
+
+            // The last row completes the columns.
+            if (m_BlockIndex == m_Columns * m_Rows)
+            {
+                if (m_Rows > 1)
+                {
+                    for (int32_t i = 0; i < m_Columns; ++i)
+                    {
+                        SendRepair(m_ColumnParity[i], false, send);
+                        ++m_ColumnPacketsSent;
+                    }
+                }
+                m_BlockIndex = 0;
+            }
+        }
+
+        // Control port thread: adapts the protection to the fraction lost reported for ssrc.
+        void OnRtcp(const uint8_t* rtcp, size_t size, uint32_t ssrc)
+        {
+            Rtcp::ForEachReportBlock(rtcp, size, [this, ssrc](const Rtcp::ReportBlock& report)
+            {
+                if (report.ssrc == ssrc)
+                    OnLoss(report.fractionLost / 256.0f);
+            });
+        }
+
+        void OnLoss(float fractionLost)
+        {
+            if (!m_IsAdaptive)
+                return;
+
+            const auto loss = m_Loss.load(std::memory_order_relaxed);
+            const auto smoothed = loss + k_LossSmoothing * (fractionLost - loss);
+            m_Loss.store(smoothed, std::memory_order_relaxed);
+
+            // No protection below 0.5%, rows of 20 then 10, then blocks of 8x8 and 5x5 above 10%.
+            int32_t columns = 0;
+            int32_t rows = 0;
+            if (smoothed >= 0.1f)
+            {
+                columns = 5;
+                rows = 5;
+            }
+            else if (smoothed >= 0.05f)
+            {
+                columns = 8;
+                rows = 8;
+            }
+            else if (smoothed >= 0.02f)
+            {
+                columns = 10;
+                rows = 1;
+            }
+            else if (smoothed >= 0.005f)
+            {
+                columns = 20;
+                rows = 1;
+            }
+            m_NextColumns.store(columns, std::memory_order_relaxed);
+            m_NextRows.store(rows, std::memory_order_relaxed);
+        }
+
+        // Sender thread.
+        void GetStats(FlexFecStats& stats) const
+        {
+            stats.packetsProtected = m_PacketsProtected;
+            stats.rowPacketsSent = m_RowPacketsSent;
+            stats.columnPacketsSent = m_ColumnPacketsSent;
+            stats.bytesSent = m_BytesSent;
+            stats.blocksAbandoned = m_BlocksAbandoned;
+            stats.columns = m_Columns;
+            stats.rows = m_Rows;
+            stats.loss = m_Loss.load(std::memory_order_relaxed);
+        }
+
+    private:
+        void ResetBlock()
+        {
+            m_RowParity.Reset();
+            for (auto& parity : m_ColumnParity)
+            {
+                parity.Reset();
+            }
+            m_BlockIndex = 0;
+        }
+
+        template<typename Send>
+        void SendRepair(FlexFec::Detail::Parity& parity, bool isRow, Send& send)
+        {
+            const auto size = parity.Write(isRow,
+                static_cast<uint8_t>(m_Columns),
+                static_cast<uint8_t>(m_Rows),
+                m_PayloadType,
+                m_Sequence++,
+                m_Ssrc,
+                m_ProtectedSsrc,
+                m_Scratch.data());
+
+            send(static_cast<const uint8_t*>(m_Scratch.data()), size);
+            m_BytesSent += size;
+        }
+
+        const uint8_t  m_PayloadType;
+        const uint32_t m_Ssrc;
+        const bool     m_IsAdaptive;
+
+        int32_t  m_Columns;
+        int32_t  m_Rows;
+        std::atomic<int32_t> m_NextColumns;
+        std::atomic<int32_t> m_NextRows;
+        int32_t  m_BlockIndex;
+        uint16_t m_ExpectedSequence;
+        uint16_t m_Sequence;
+        uint32_t m_ProtectedSsrc;
+        std::atomic<float> m_Loss;
+
+        FlexFec::Detail::Parity              m_RowParity;
+        std::vector<FlexFec::Detail::Parity> m_ColumnParity;
+        std::vector<uint8_t>                 m_Scratch;
+
+        uint64_t m_PacketsProtected;
+        uint64_t m_RowPacketsSent;
+        uint64_t m_ColumnPacketsSent;
+        uint64_t m_BytesSent;
+        uint64_t m_BlocksAbandoned;
+    };
+
+    struct FlexFecDecoderStats
+    {
+        uint64_t mediaPacketsReceived;
+        uint64_t repairPacketsReceived;
+        uint64_t packetsRecovered;
+        uint64_t repairPacketsExpired; // Left the window with more than one protected packet missing.
+    };
+
+    // Rebuilds the media packets lost by a receiver from the repair packets of a FlexFecEncoder.
+    // Keeps the last k_WindowSize media packets; a repair packet missing more than one of them is
+    // kept until another one is received or recovered, or until it leaves the window.
+    class FlexFecDecoder final
+    {
+    public:
+        static const size_t k_WindowSize = 2048;
+        static const size_t k_MaxPendingRepairs = 256;
+
+        explicit FlexFecDecoder(uint32_t repairSsrc) :
+            m_RepairSsrc(repairSsrc),
+            m_HighestSequence(0),
+            m_HasSequence(false),
+            m_MediaPacketsReceived(0),
+            m_RepairPacketsReceived(0),
+            m_PacketsRecovered(0),
+            m_RepairPacketsExpired(0)
+        {
+            m_Window.resize(k_WindowSize);
+        }
+
+        FlexFecDecoder(const FlexFecDecoder&) = delete;
+        FlexFecDecoder& operator=(const FlexFecDecoder&) = delete;
+
+        // Adds a received packet of the media or of the repair stream, calling
+        // onRecovered(const uint8_t* packet, size_t size) for each media packet it rebuilds.
+        template<typename Callback>
+        void Receive(const uint8_t* packet, size_t size, Callback&& onRecovered)
+        {
+            if (!Rtp::IsValidPacket(packet, size))
+                return;
+
+            if (Rtp::GetSsrc(packet) == m_RepairSsrc)
+            {
+                const auto headerOffset = Rtp::k_HeaderSize + 4 * static_cast<size_t>(packet[0] & 0x0f);
+                if ((packet[0] & 0x0f) == 0 || size < headerOffset + FlexFec::k_HeaderSize)
+                    return;
+
+                // Flexible masks aren't produced by the encoder.
+                const auto header = packet + headerOffset;
+                if ((header[0] & 0xc0) == 0 || (header[0] & 0xc0) == 0xc0 || header[10] == 0)
+                    return;
+
+                ++m_RepairPacketsReceived;
+                if (m_Pending.size() == k_MaxPendingRepairs)
+                {
+                    m_Pending.erase(m_Pending.begin());
+                    ++m_RepairPacketsExpired;
+                }
+                m_Pending.emplace_back(packet, packet + size);
+            }
+            else
+            {
+                ++m_MediaPacketsReceived;
+                Store(packet, size);
+            }
+
+            // A recovered packet can complete other repair packets.
+            while (TryRecover(onRecovered))
+            {
+            }
+        }
+
+        void GetStats(FlexFecDecoderStats& stats) const
+        {
+            stats.mediaPacketsReceived = m_MediaPacketsReceived;
+            stats.repairPacketsReceived = m_RepairPacketsReceived;
+            stats.packetsRecovered = m_PacketsRecovered;
+            stats.repairPacketsExpired = m_RepairPacketsExpired;
+        }
+
+    private:
+        struct Slot
+        {
+            std::vector<uint8_t> packet;
+            uint16_t             sequence = 0;
+            bool                 isValid = false;
+        };
+
+        Slot& GetSlot(uint16_t sequence) { return m_Window[sequence % k_WindowSize]; }
+
+        const Slot* Find(uint16_t sequence)
+        {
+            const auto& slot = GetSlot(sequence);
+            return (slot.isValid && slot.sequence == sequence) ? &slot : nullptr;
+        }
+
+        void Store(const uint8_t* packet, size_t size)
+        {
+            const auto sequence = Rtp::GetSequenceNumber(packet);
+            if (!m_HasSequence || Rtp::SequenceDelta(m_HighestSequence, sequence) > 0)
+            {
+                m_HighestSequence = sequence;
+                m_HasSequence = true;
+            }
+
+            auto& slot = GetSlot(sequence);
+            slot.packet.assign(packet, packet + size);
+            slot.sequence = sequence;
+            slot.isValid = true;
+        }
+
+        // Recovers the packet missing from one of the pending repair packets, if any. Discards the
+        // repair packets with nothing missing or out of the window.
+        template<typename Callback>
+        bool TryRecover(Callback& onRecovered)
+        {
+            for (size_t i = 0; i < m_Pending.size();)
+            {
+                const auto& repair = m_Pending[i];
+                const auto header = repair.data() + Rtp::k_HeaderSize + 4 * static_cast<size_t>(repair[0] & 0x0f);
+                const auto isRow = (header[0] & 0x80) != 0;
+                const auto base = Rtp::ReadUInt16(header + 8);
+                const auto columns = header[10];
+                const auto count = isRow ? columns : header[11];
+                const auto step = isRow ? 1 : columns;
+
+                // Past half the window, the slots of the protected packets are being reused.
+                const auto isExpired = m_HasSequence && Rtp::SequenceDelta(base, m_HighestSequence) >= static_cast<int32_t>(k_WindowSize / 2);
+
+                size_t missing = 0;
+                uint16_t missingSequence = 0;
+                for (int32_t j = 0; j < count && !isExpired; ++j)
+                {
+                    const auto sequence = static_cast<uint16_t>(base + j * step);
+                    if (Find(sequence) == nullptr)
+                    {
+                        ++missing;
+                        missingSequence = sequence;
+                    }
+                }
+
+                if (isExpired || missing == 0)
+                {
+                    if (isExpired)
+                        ++m_RepairPacketsExpired;
+                    m_Pending.erase(m_Pending.begin() + static_cast<std::ptrdiff_t>(i));
+                    continue;
+                }
+
+                if (missing == 1)
+                {
+                    const auto recovered = Recover(repair, header, step, count, base, missingSequence);
+                    m_Pending.erase(m_Pending.begin() + static_cast<std::ptrdiff_t>(i));
+                    if (recovered)
+                    {
+                        const auto& slot = GetSlot(missingSequence);
+                        onRecovered(static_cast<const uint8_t*>(slot.packet.data()), slot.packet.size());
+                        return true;
+                    }
+                    continue;
+                }
+                ++i;
+            }
+            return false;
+        }
+
+        bool Recover(const std::vector<uint8_t>& repair, const uint8_t* header, int32_t step, int32_t count, uint16_t base, uint16_t missingSequence)
+        {
+            const auto payload = header + FlexFec::k_HeaderSize;
+            const auto payloadSize = static_cast<size_t>(repair.data() + repair.size() - payload);
+
+            m_Recovery.assign(header, header + FlexFec::k_HeaderSize);
+            m_Recovery.insert(m_Recovery.end(), payload, payload + payloadSize);
+
+            for (int32_t j = 0; j < count; ++j)
+            {
+                const auto sequence = static_cast<uint16_t>(base + j * step);
+                if (sequence == missingSequence)
+                    continue;
+
+                const auto& packet = Find(sequence)->packet;
+                const auto protectedSize = packet.size() - Rtp::k_HeaderSize;
+                if (protectedSize > payloadSize)
+                    return false;
+
+                m_Recovery[0] ^= packet[0] & 0x3f;
+                m_Recovery[1] ^= packet[1];
+                m_Recovery[2] ^= static_cast<uint8_t>(protectedSize >> 8);
+                m_Recovery[3] ^= static_cast<uint8_t>(protectedSize);
+                FlexFec::Detail::XorInto(m_Recovery.data() + 4, packet.data() + 4, 4);
+                FlexFec::Detail::XorInto(m_Recovery.data() + FlexFec::k_HeaderSize, packet.data() + Rtp::k_HeaderSize, protectedSize);
+            }
+
+            const size_t size = Rtp::ReadUInt16(m_Recovery.data() + 2);
+            if (size > payloadSize)
+                return false;
+
+            uint8_t rtpHeader[Rtp::k_HeaderSize];
+            rtpHeader[0] = static_cast<uint8_t>((Rtp::k_Version << 6) | (m_Recovery[0] & 0x3f));
+            rtpHeader[1] = m_Recovery[1];
+            Rtp::SetSequenceNumber(rtpHeader, missingSequence);
+            std::memcpy(rtpHeader + 4, m_Recovery.data() + 4, 4);
+            Rtp::SetSsrc(rtpHeader, Rtp::ReadUInt32(repair.data() + Rtp::k_HeaderSize));
+
+            auto& slot = GetSlot(missingSequence);
+            slot.packet.assign(rtpHeader, rtpHeader + Rtp::k_HeaderSize);
+            slot.packet.insert(slot.packet.end(), m_Recovery.data() + FlexFec::k_HeaderSize, m_Recovery.data() + FlexFec::k_HeaderSize + size);
+            slot.sequence = missingSequence;
+            slot.isValid = true;
+            ++m_PacketsRecovered;
+            return true;
+        }
+
+        const uint32_t m_RepairSsrc;
+
+        std::vector<Slot>                 m_Window;
+        std::vector<std::vector<uint8_t>> m_Pending; // Repair packets, in reception order.
+        std::vector<uint8_t>              m_Recovery;
+        uint16_t                          m_HighestSequence;
+        bool                              m_HasSequence;
+
+        uint64_t m_MediaPacketsReceived;
+        uint64_t m_RepairPacketsReceived;
+        uint64_t m_PacketsRecovered;
+        uint64_t m_RepairPacketsExpired;
+    };
+}
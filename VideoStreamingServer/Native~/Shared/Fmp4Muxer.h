@@ -0,0 +1,426 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace LiveCaptureNative
+{
+    // Fragmented MP4 (ISO BMFF) serialization of one H264 video track:
+    //   - the init segment (ftyp + moov with an avc1 sample entry and an empty sample table),
+    //   - one moof + mdat header per fragment, the samples (AVCC, 4-byte lengths) follow as is,
+    //   - the random access index (mfra) closing the file.
+    //
+    // Pure serialization, no I/O: the boxes are appended to a caller-owned vector, reserved once
+    // and reused, so that no allocation happens per fragment. Frame reordering is disabled in the
+    // encoders, decode and presentation times are the same (no ctts, no composition offsets).
+    namespace Fmp4
+    {
+        const uint32_t k_TrackId = 1;
+        const uint32_t k_DefaultTimescale = 90000;
+
+        // trun sample flags (ISO/IEC 14496-12 8.8.3.1).
+        const uint32_t k_SyncSampleFlags = 0x02000000;    // sample_depends_on = 2 (I frame).
+        const uint32_t k_NonSyncSampleFlags = 0x01010000; // sample_depends_on = 1, sample_is_non_sync_sample.
+
+        // Size of the mdat header written by WriteFragmentHeader(), the payload follows it.
+        const size_t k_MdatHeaderSize = 8;
+
+        // Largest payload of a fragment, the mdat size must fit in 32 bits.
+        const uint64_t k_MaxFragmentPayloadSize = UINT32_MAX - k_MdatHeaderSize;
+
+        struct TrackSettings
+        {
+            uint32_t width;
+            uint32_t height;
+            uint32_t timescale; // Ticks per second of the decode times and durations.
+        };
+
+        struct SampleInfo
+        {
+            uint32_t size;     // AVCC size in the payload.
+            uint32_t duration; // In timescale ticks.
+            bool     isKeyFrame;
+        };
+
+        // Entry of the random access index, one per fragment.
+        struct FragmentIndexEntry
+        {
+            uint64_t time;       // Decode time of the first sample, in timescale ticks.
+            uint64_t moofOffset; // From the start of the file.
+        };
+
+        // Converts a duration in nanoseconds to timescale ticks without overflowing 64 bits.
+        inline uint64_t NsToTicks(uint64_t ns, uint32_t timescale)
+        {
+            const uint64_t k_NsPerSecond = 1000000000ull;
+            return (ns / k_NsPerSecond) * timescale + (ns % k_NsPerSecond) * timescale / k_NsPerSecond;
+        }
+
+        // Appends big-endian fields and boxes to a buffer. Boxes are written with a placeholder
+        // size, patched by EndBox() once their content is known.
+        class BoxWriter final
+        {
+        public:
+            explicit BoxWriter(std::vector<uint8_t>& buffer) :
+                m_Buffer(&buffer)
+            {
+            }
+
+            inline size_t GetSize() const { return m_Buffer->size(); }
+
+            void U8(uint8_t value)
+            {
+                m_Buffer->push_back(value);
+            }
+
+            void U16(uint16_t value)
+            {
+                U8(static_cast<uint8_t>(value >> 8));
+                U8(static_cast<uint8_t>(value));
+            }
+
+            void U32(uint32_t value)
+            {
+                U16(static_cast<uint16_t>(value >> 16));
+                U16(static_cast<uint16_t>(value));
+            }
+
+            void U64(uint64_t value)
+            {
+                U32(static_cast<uint32_t>(value >> 32));
+                U32(static_cast<uint32_t>(value));
+            }
+
+            void FourCC(const char* type)
+            {
+                Bytes(reinterpret_cast<const uint8_t*>(type), 4);
+            }
+
+            void Bytes(const uint8_t* data, size_t size)
+            {
+                m_Buffer->insert(m_Buffer->end(), data, data + size);
+            }
+
+            void Zeros(size_t count)
+            {
+                m_Buffer->insert(m_Buffer->end(), count, 0);
+            }
+
+            // Returns the offset of the box, to pass to EndBox().
+            size_t BeginBox(const char* type)
+            {
+                const auto start = GetSize();
+                U32(0);
+                FourCC(type);
+                return start;
+            }
+
+            size_t BeginFullBox(const char* type, uint8_t version, uint32_t flags)
+            {
+                const auto start = BeginBox(type);
+                U32((static_cast<uint32_t>(version) << 24) | (flags & 0x00FFFFFF));
+                return start;
+            }
+
+            void EndBox(size_t start)
+            {
+                PatchU32(start, static_cast<uint32_t>(GetSize() - start));
+            }
+
+            void PatchU32(size_t offset, uint32_t value)
+            {
+                auto data = m_Buffer->data() + offset;
+                data[0] = static_cast<uint8_t>(value >> 24);
+                data[1] = static_cast<uint8_t>(value >> 16);
+                data[2] = static_cast<uint8_t>(value >> 8);
+                data[3] = static_cast<uint8_t>(value);
+            }
+
+        private:
+            std::vector<uint8_t>* m_Buffer;
+        };
+
+        namespace Detail
+        {
+            // Identity transform of the mvhd and tkhd boxes.
+            inline void WriteMatrix(BoxWriter& writer)
+            {
+                const uint32_t k_Matrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+                for (auto value : k_Matrix)
+                {
+                    writer.U32(value);
+                }
+            }
+
+            // AVCDecoderConfigurationRecord (ISO/IEC 14496-15 5.3.3.1). The profile, compatibility
+            // and level are the three bytes following the SPS NAL header. The extension fields of
+            // the high profiles are not written: the encoders use the baseline profile.
+            inline void WriteAvcC(BoxWriter& writer,
+                                  const uint8_t* sps,
+                                  size_t spsSize,
+                                  const uint8_t* pps,
+                                  size_t ppsSize)
+            {
+                const auto avcC = writer.BeginBox("avcC");
+                writer.U8(1);
+                writer.U8(sps[1]);
+                writer.U8(sps[2]);
+                writer.U8(sps[3]);
+                writer.U8(0xFF); // 6 reserved bits, lengthSizeMinusOne = 3.
+                writer.U8(0xE1); // 3 reserved bits, one SPS.
+                writer.U16(static_cast<uint16_t>(spsSize));
+                writer.Bytes(sps, spsSize);
+                writer.U8(1);    // One PPS.
+                writer.U16(static_cast<uint16_t>(ppsSize));
+                writer.Bytes(pps, ppsSize);
+                writer.EndBox(avcC);
+            }
+
+            inline void WriteSampleEntry(BoxWriter& writer,
+                                         const TrackSettings& settings,
+                                         const uint8_t* sps,
+                                         size_t spsSize,
+                                         const uint8_t* pps,
+                                         size_t ppsSize)
+            {
+                const auto stsd = writer.BeginFullBox("stsd", 0, 0);
+                writer.U32(1);
+
+                const auto avc1 = writer.BeginBox("avc1");
+                writer.Zeros(6);
+                writer.U16(1);           // data_reference_index.
+                writer.Zeros(16);        // pre_defined and reserved.
+                writer.U16(static_cast<uint16_t>(settings.width));
+                writer.U16(static_cast<uint16_t>(settings.height));
+                writer.U32(0x00480000);  // 72 dpi.
+                writer.U32(0x00480000);
+                writer.U32(0);
+                writer.U16(1);           // frame_count.
+                writer.Zeros(32);        // compressorname.
+                writer.U16(0x0018);      // depth.
+                writer.U16(0xFFFF);      // pre_defined = -1.
+                WriteAvcC(writer, sps, spsSize, pps, ppsSize);
+                writer.EndBox(avc1);
+
+                writer.EndBox(stsd);
+            }
+
+            // Empty sample table: the samples are described by the fragments.
+            inline void WriteEmptySampleTable(BoxWriter& writer)
+            {
+                const auto stts = writer.BeginFullBox("stts", 0, 0);
+                writer.U32(0);
+                writer.EndBox(stts);
+
+                const auto stsc = writer.BeginFullBox("stsc", 0, 0);
+                writer.U32(0);
+                writer.EndBox(stsc);
+
+                const auto stsz = writer.BeginFullBox("stsz", 0, 0);
+                writer.U32(0);
+                writer.U32(0);
+                writer.EndBox(stsz);
+
+                const auto stco = writer.BeginFullBox("stco", 0, 0);
+                writer.U32(0);
+                writer.EndBox(stco);
+            }
+        }
+
+        // Smallest SPS holding the profile, compatibility and level bytes.
+        const size_t k_MinSpsSize = 4;
+
+        // ftyp + moov. sps and pps are NAL units without start code.
+        inline bool WriteInitSegment(BoxWriter& writer,
+                                     const TrackSettings& settings,
+                                     const uint8_t* sps,
+                                     size_t spsSize,
+                                     const uint8_t* pps,
+                                     size_t ppsSize)
+        {
+            if (sps == nullptr || pps == nullptr || spsSize < k_MinSpsSize || ppsSize == 0 ||
+                spsSize > UINT16_MAX || ppsSize > UINT16_MAX ||
+                settings.width > UINT16_MAX || settings.height > UINT16_MAX || settings.timescale == 0)
+                return false;
+
+            const auto ftyp = writer.BeginBox("ftyp");
+            writer.FourCC("iso5");
+            writer.U32(0x00000200);
+            writer.FourCC("iso5");
+            writer.FourCC("iso6");
+            writer.FourCC("avc1");
+            writer.FourCC("mp41");
+            writer.EndBox(ftyp);
+
+            const auto moov = writer.BeginBox("moov");
+            {
+                const auto mvhd = writer.BeginFullBox("mvhd", 0, 0);
+                writer.U32(0);                  // creation_time.
+                writer.U32(0);                  // modification_time.
+                writer.U32(settings.timescale);
+                writer.U32(0);                  // duration: unknown, given by the fragments.
+                writer.U32(0x00010000);         // rate 1.0.
+                writer.U16(0x0100);             // volume 1.0.
+                writer.Zeros(10);
+                Detail::WriteMatrix(writer);
+                writer.Zeros(24);               // pre_defined.
+                writer.U32(k_TrackId + 1);      // next_track_ID.
+                writer.EndBox(mvhd);
+
+                const auto trak = writer.BeginBox("trak");
+                {
+                    const auto tkhd = writer.BeginFullBox("tkhd", 0, 0x000003); // Enabled, in movie.
+                    writer.U32(0);
+                    writer.U32(0);
+                    writer.U32(k_TrackId);
+                    writer.U32(0);
+                    writer.U32(0);              // duration.
+                    writer.Zeros(8);
+                    writer.U16(0);              // layer.
+                    writer.U16(0);              // alternate_group.
+                    writer.U16(0);              // volume, 0 for video.
+                    writer.U16(0);
+                    Detail::WriteMatrix(writer);
+                    writer.U32(settings.width << 16);
+                    writer.U32(settings.height << 16);
+                    writer.EndBox(tkhd);
+
+                    const auto mdia = writer.BeginBox("mdia");
+                    {
+                        const auto mdhd = writer.BeginFullBox("mdhd", 0, 0);
+                        writer.U32(0);
+                        writer.U32(0);
+                        writer.U32(settings.timescale);
+                        writer.U32(0);
+                        writer.U16(0x55C4);     // Packed ISO-639-2 "und".
+                        writer.U16(0);
+                        writer.EndBox(mdhd);
+
+                        const auto hdlr = writer.BeginFullBox("hdlr", 0, 0);
+                        writer.U32(0);
+                        writer.FourCC("vide");
+                        writer.Zeros(12);
+                        const char k_HandlerName[] = "VideoHandler";
+                        writer.Bytes(reinterpret_cast<const uint8_t*>(k_HandlerName), sizeof(k_HandlerName));
+                        writer.EndBox(hdlr);
+
+                        const auto minf = writer.BeginBox("minf");
+                        {
+                            const auto vmhd = writer.BeginFullBox("vmhd", 0, 0x000001);
+                            writer.Zeros(8);    // graphicsmode and opcolor.
+                            writer.EndBox(vmhd);
+
+                            const auto dinf = writer.BeginBox("dinf");
+                            const auto dref = writer.BeginFullBox("dref", 0, 0);
+                            writer.U32(1);
+                            const auto url = writer.BeginFullBox("url ", 0, 0x000001); // Same file.
+                            writer.EndBox(url);
+                            writer.EndBox(dref);
+                            writer.EndBox(dinf);
+
+                            const auto stbl = writer.BeginBox("stbl");
+                            Detail::WriteSampleEntry(writer, settings, sps, spsSize, pps, ppsSize);
+                            Detail::WriteEmptySampleTable(writer);
+                            writer.EndBox(stbl);
+                        }
+                        writer.EndBox(minf);
+                    }
+                    writer.EndBox(mdia);
+                }
+                writer.EndBox(trak);
+
+                const auto mvex = writer.BeginBox("mvex");
+                const auto trex = writer.BeginFullBox("trex", 0, 0);
+                writer.U32(k_TrackId);
+                writer.U32(1);                  // default_sample_description_index.
+                writer.U32(0);
+                writer.U32(0);
+                writer.U32(0);
+                writer.EndBox(trex);
+                writer.EndBox(mvex);
+            }
+            writer.EndBox(moov);
+            return true;
+        }
+
+        // moof + the header of the mdat holding the payloadSize bytes of samples, in order.
+        inline bool WriteFragmentHeader(BoxWriter& writer,
+                                        uint32_t sequenceNumber,
+                                        uint64_t baseDecodeTime,
+                                        const SampleInfo* samples,
+                                        size_t sampleCount,
+                                        uint64_t payloadSize)
+        {
+            if (sampleCount == 0 || sampleCount > UINT32_MAX || payloadSize > k_MaxFragmentPayloadSize)
+                return false;
+
+            const auto moof = writer.BeginBox("moof");
+
+            const auto mfhd = writer.BeginFullBox("mfhd", 0, 0);
+            writer.U32(sequenceNumber);
+            writer.EndBox(mfhd);
+
+            const auto traf = writer.BeginBox("traf");
+            {
+                const auto tfhd = writer.BeginFullBox("tfhd", 0, 0x020000); // default-base-is-moof.
+                writer.U32(k_TrackId);
+                writer.EndBox(tfhd);
+
+                const auto tfdt = writer.BeginFullBox("tfdt", 1, 0);
+                writer.U64(baseDecodeTime);
+                writer.EndBox(tfdt);
+
+                // data-offset, sample-duration, sample-size and sample-flags present.
+                const auto trun = writer.BeginFullBox("trun", 0, 0x000701);
+                writer.U32(static_cast<uint32_t>(sampleCount));
+                const auto dataOffset = writer.GetSize();
+                writer.U32(0);
+                for (size_t i = 0; i < sampleCount; ++i)
+                {
+                    writer.U32(samples[i].duration);
+                    writer.U32(samples[i].size);
+                    writer.U32(samples[i].isKeyFrame ? k_SyncSampleFlags : k_NonSyncSampleFlags);
+                }
+                writer.EndBox(trun);
+
+                // The samples start right after the mdat header, relative to the moof.
+                writer.EndBox(traf);
+                writer.EndBox(moof);
+                writer.PatchU32(dataOffset, static_cast<uint32_t>(writer.GetSize() - moof + k_MdatHeaderSize));
+            }
+
+            writer.U32(static_cast<uint32_t>(k_MdatHeaderSize + payloadSize));
+            writer.FourCC("mdat");
+            return true;
+        }
+
+        // mfra with one tfra entry per fragment, and the mfro that lets a reader find it from
+        // the end of the file.
+        inline void WriteRandomAccessIndex(BoxWriter& writer, const FragmentIndexEntry* entries, size_t count)
+        {
+            const auto mfra = writer.BeginBox("mfra");
+
+            const auto tfra = writer.BeginFullBox("tfra", 1, 0);
+            writer.U32(k_TrackId);
+            writer.U32(0);                      // 1-byte traf, trun and sample numbers.
+            writer.U32(static_cast<uint32_t>(count));
+            for (size_t i = 0; i < count; ++i)
+            {
+                writer.U64(entries[i].time);
+                writer.U64(entries[i].moofOffset);
+                writer.U8(1);
+                writer.U8(1);
+                writer.U8(1);
+            }
+            writer.EndBox(tfra);
+
+            const auto mfro = writer.BeginFullBox("mfro", 0, 0);
+            writer.U32(static_cast<uint32_t>(writer.GetSize() - mfra + 4));
+            writer.EndBox(mfro);
+
+            writer.EndBox(mfra);
+        }
+    }
+}
@@ -0,0 +1,588 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "AnnexBConverter.h"
+#include "Fmp4Muxer.h"
+#include "SpscFrameRing.h"
+
+namespace LiveCaptureNative
+{
+    // Recording options. Blittable: the layout is mirrored by the C# Fmp4RecorderSettings, keep
+    // both in sync. Zero fields select the defaults.
+    struct Fmp4RecorderSettings
+    {
+        int32_t minFragmentDurationMs; // A fragment is cut at the first key frame past this duration.
+        int32_t maxFragmentBytes;      // Sample bytes preallocated per fragment buffer.
+    };
+
+    enum class Fmp4RecorderStatus : int32_t
+    {
+        Stopped = 0,
+        Recording = 1,
+        Failed = 2,
+    };
+
+    enum class Fmp4RecorderError : int32_t
+    {
+        None = 0,
+        OpenFailed = 1,           // The file couldn't be created.
+        WriteFailed = 2,          // The disk is full or the file was removed.
+        ParameterSetsChanged = 3, // The stream resolution or profile changed, start a new recording.
+    };
+
+    // Recording statistics, returned by the GetRecordingStats export of the plugins. Blittable:
+    // the layout is mirrored by the C# Fmp4RecorderStats, keep both in sync.
+    struct Fmp4RecorderStats
+    {
+        int32_t  status;           // Fmp4RecorderStatus.
+        int32_t  error;            // Fmp4RecorderError, why the recording failed.
+        uint64_t framesRecorded;   // Frames added to a fragment.
+        uint64_t droppedFrames;    // Frames lost because the writer was behind, or larger than a fragment.
+        uint64_t fragmentsWritten; // Fragments in the file.
+        uint64_t bytesWritten;     // File size, the trailer included.
+        uint64_t duration;         // Recorded media time, in nanoseconds.
+    };
+
+    // Records an encoded H264 stream to a fragmented MP4 file.
+    //
+    // The producer (the encoder output thread) converts each Annex B frame to AVCC into the open
+    // fragment, a preallocated buffer of the ring below. A fragment is closed at the first key frame
+    // past the minimum duration, so that every fragment can be decoded on its own, and handed to a
+    // writer thread that serializes its moof and appends it to the file. Unless SetBlocking() was
+    // called, the producer never blocks on the disk: when every buffer waits for the writer the
+    // frames are dropped up to the next key frame.
+    //
+    // Crash safety: the file is a valid fragmented MP4 after each fragment. The writer flushes the
+    // fragment followed by the random access index (mfra), which the next fragment overwrites. If
+    // the process dies between two fragments the file is complete, trailer included; if it dies
+    // during a write, the fragments before are still readable.
+    class Fmp4Recorder final
+    {
+    public:
+        static const int32_t k_DefaultMinFragmentDurationMs = 1000;
+        static const int32_t k_DefaultMaxFragmentBytes = 8 * 1024 * 1024;
+        static const int32_t k_MaxFragmentBytes = 256 * 1024 * 1024;
+        static const size_t  k_FragmentSlotCount = 4;
+        static const size_t  k_ReservedSamplesPerFragment = 256;
+
+        Fmp4Recorder() :
+            m_File(nullptr),
+            m_Width(0),
+            m_Height(0),
+            m_MinFragmentDurationNs(0),
+            m_MaxFragmentBytes(0),
+            m_Current(nullptr),
+            m_HasParameterSets(false),
+            m_IsInitSegmentPending(false),
+            m_IsSkippingToKeyFrame(false),
+            m_IsBlocking(false),
+            m_NextSequenceNumber(1),
+            m_FirstTimestamp(0),
+            m_FragmentStartTimestamp(0),
+            m_LastTicks(0),
+            m_LastDuration(0),
+            m_FilePosition(0),
+            m_TrailerOffset(0),
+            m_StopRequested(false),
+            m_Status(static_cast<int32_t>(Fmp4RecorderStatus::Stopped)),
+            m_Error(static_cast<int32_t>(Fmp4RecorderError::None)),
+            m_FramesRecorded(0),
+            m_DroppedFrames(0),
+            m_FragmentsWritten(0),
+            m_BytesWritten(0),
+            m_Duration(0)
+        {
+        }
+
+        ~Fmp4Recorder()
+        {
+            Close();
+        }
+
+        Fmp4Recorder(const Fmp4Recorder&) = delete;
+        Fmp4Recorder& operator=(const Fmp4Recorder&) = delete;
+
+        // Creates the file (the path is UTF-8) and allocates the fragment buffers. The recording
+        // starts at the first key frame.
+        bool Open(const char* path, uint32_t width, uint32_t height, const Fmp4RecorderSettings& settings)
+        {
+            if (m_File != nullptr || path == nullptr)
+                return false;
+
+            m_File = OpenFile(path);
+            if (m_File == nullptr)
+            {
+                m_Status.store(static_cast<int32_t>(Fmp4RecorderStatus::Failed), std::memory_order_relaxed);
+                m_Error.store(static_cast<int32_t>(Fmp4RecorderError::OpenFailed), std::memory_order_relaxed);
+                return false;
+            }
+
+            const auto minDurationMs = (settings.minFragmentDurationMs > 0)
+                ? settings.minFragmentDurationMs
+                : k_DefaultMinFragmentDurationMs;
+            const auto maxBytes = (settings.maxFragmentBytes > 0)
+                ? ((settings.maxFragmentBytes < k_MaxFragmentBytes) ? settings.maxFragmentBytes : k_MaxFragmentBytes)
+                : k_DefaultMaxFragmentBytes;
+
+            m_Width = width;
+            m_Height = height;
+            m_MinFragmentDurationNs = static_cast<uint64_t>(minDurationMs) * 1000000ull;
+            m_MaxFragmentBytes = static_cast<size_t>(maxBytes);
+
+            m_Fragments.ForEachSlot([this](Fragment& fragment)
+            {
+                fragment.payload.reserve(m_MaxFragmentBytes);
+                fragment.samples.reserve(k_ReservedSamplesPerFragment);
+            });
+            m_Fragments.Clear();
+
+            m_Current = nullptr;
+            m_HasParameterSets = false;
+            m_IsInitSegmentPending = true;
+            m_IsSkippingToKeyFrame = false;
+            m_NextSequenceNumber = 1;
+            m_FilePosition = 0;
+            m_TrailerOffset = 0;
+            m_Index.clear();
+
+            m_FramesRecorded.store(0, std::memory_order_relaxed);
+            m_DroppedFrames.store(0, std::memory_order_relaxed);
+            m_FragmentsWritten.store(0, std::memory_order_relaxed);
+            m_BytesWritten.store(0, std::memory_order_relaxed);
+            m_Duration.store(0, std::memory_order_relaxed);
+            m_Error.store(static_cast<int32_t>(Fmp4RecorderError::None), std::memory_order_relaxed);
+            m_Status.store(static_cast<int32_t>(Fmp4RecorderStatus::Recording), std::memory_order_relaxed);
+
+            m_StopRequested = false;
+            m_Writer = std::thread(&Fmp4Recorder::WriterLoop, this);
+            return true;
+        }
+
+        // Closes the open fragment, waits for the writer and closes the file. Must not run
+        // concurrently with WriteFrame().
+        void Close()
+        {
+            if (m_File == nullptr)
+                return;
+
+            if (m_Current != nullptr)
+            {
+                PublishCurrent(m_LastTicks + EstimateLastDuration());
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_WakeMutex);
+                m_StopRequested = true;
+            }
+            m_WakeCondition.notify_one();
+            m_Writer.join();
+
+            std::fclose(m_File);
+            m_File = nullptr;
+
+            if (m_Status.load(std::memory_order_relaxed) == static_cast<int32_t>(Fmp4RecorderStatus::Recording))
+            {
+                m_Status.store(static_cast<int32_t>(Fmp4RecorderStatus::Stopped), std::memory_order_relaxed);
+            }
+        }
+
+        inline bool IsOpen() const { return m_File != nullptr; }
+
+        // When blocking, the producer waits for a fragment buffer instead of dropping frames. For
+        // writes faster than real time, e.g. a replay export. Set it before Open().
+        inline void SetBlocking(bool blocking) { m_IsBlocking = blocking; }
+
+        // Producer: adds an encoded frame (Annex B) with its capture time. Key frames carry the
+        // parameter sets (NAL units without start code), the first one starts the recording.
+        // Returns false if the frame isn't in the file.
+        bool WriteFrame(const uint8_t* data,
+                        size_t size,
+                        uint64_t timestampNs,
+                        bool isKeyFrame,
+                        const uint8_t* sps,
+                        size_t spsSize,
+                        const uint8_t* pps,
+                        size_t ppsSize)
+        {
+            if (m_File == nullptr || data == nullptr || size == 0 ||
+                m_Status.load(std::memory_order_relaxed) != static_cast<int32_t>(Fmp4RecorderStatus::Recording))
+                return false;
+
+            if (isKeyFrame && spsSize > 0 && ppsSize > 0 && !UpdateParameterSets(sps, spsSize, pps, ppsSize))
+                return false;
+
+            // Nothing can be decoded before the first key frame.
+            if (!m_HasParameterSets || (m_FramesRecorded.load(std::memory_order_relaxed) == 0 && !isKeyFrame))
+                return false;
+
+            if (m_FramesRecorded.load(std::memory_order_relaxed) == 0 && m_Current == nullptr && m_IsInitSegmentPending)
+            {
+                m_FirstTimestamp = timestampNs;
+                m_LastTicks = 0;
+            }
+
+            // Keep the decode times strictly increasing, whatever the capture clock did.
+            const auto elapsed = (timestampNs > m_FirstTimestamp) ? timestampNs - m_FirstTimestamp : 0;
+            auto ticks = Fmp4::NsToTicks(elapsed, Fmp4::k_DefaultTimescale);
+            if (m_Current != nullptr && ticks <= m_LastTicks)
+            {
+                ticks = m_LastTicks + 1;
+            }
+
+            size_t avccSize = 0;
+            if (!AnnexB::GetAvccSize(data, size, avccSize))
+                return false;
+
+            // Cut at a key frame past the minimum duration, or wherever the buffer is full.
+            if (m_Current != nullptr)
+            {
+                const auto fragmentDuration = timestampNs - m_FragmentStartTimestamp;
+                const auto isFull = m_Current->payload.size() + avccSize > m_MaxFragmentBytes;
+
+                if ((isKeyFrame && fragmentDuration >= m_MinFragmentDurationNs) || isFull)
+                {
+                    PublishCurrent(ticks);
+                }
+            }
+
+            // Larger than a whole fragment buffer.
+            if (avccSize > m_MaxFragmentBytes)
+            {
+                m_DroppedFrames.fetch_add(1, std::memory_order_relaxed);
+                m_IsSkippingToKeyFrame = true;
+                return false;
+            }
+
+            if (m_Current == nullptr && !BeginFragment(ticks, timestampNs, isKeyFrame))
+            {
+                m_DroppedFrames.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            auto& payload = m_Current->payload;
+            const auto offset = payload.size();
+            payload.resize(offset + avccSize);
+
+            size_t written = 0;
+            if (!AnnexB::AnnexBToAvcc(data, size, payload.data() + offset, avccSize, written))
+            {
+                payload.resize(offset);
+                return false;
+            }
+
+            auto& samples = m_Current->samples;
+            if (!samples.empty())
+            {
+                m_LastDuration = static_cast<uint32_t>(ticks - m_LastTicks);
+                samples.back().duration = m_LastDuration;
+            }
+
+            Fmp4::SampleInfo sample;
+            sample.size = static_cast<uint32_t>(written);
+            sample.duration = 0; // Known with the next frame.
+            sample.isKeyFrame = isKeyFrame;
+            samples.push_back(sample);
+
+            m_LastTicks = ticks;
+            m_FramesRecorded.fetch_add(1, std::memory_order_relaxed);
+            m_Duration.store(elapsed, std::memory_order_relaxed);
+            return true;
+        }
+
+        // Callable from any thread.
+        void GetStats(Fmp4RecorderStats& stats) const
+        {
+            stats.status = m_Status.load(std::memory_order_relaxed);
+            stats.error = m_Error.load(std::memory_order_relaxed);
+            stats.framesRecorded = m_FramesRecorded.load(std::memory_order_relaxed);
+            stats.droppedFrames = m_DroppedFrames.load(std::memory_order_relaxed);
+            stats.fragmentsWritten = m_FragmentsWritten.load(std::memory_order_relaxed);
+            stats.bytesWritten = m_BytesWritten.load(std::memory_order_relaxed);
+            stats.duration = m_Duration.load(std::memory_order_relaxed);
+        }
+
+    private:
+        // Slot of the ring: filled by the producer, serialized by the writer. The vectors keep
+        // their capacity from one fragment to the next.
+        struct Fragment
+        {
+            std::vector<uint8_t>          initSegment; // First fragment only.
+            std::vector<uint8_t>          payload;     // AVCC samples.
+            std::vector<Fmp4::SampleInfo> samples;
+            uint64_t                      baseDecodeTime = 0;
+            uint32_t                      sequenceNumber = 0;
+        };
+
+        static std::FILE* OpenFile(const char* path)
+        {
+#ifdef _WIN32
+            // fopen takes the ANSI code page on Windows, go through the wide variant for UTF-8 paths.
+            const int length = MultiByteToWideChar(CP_UTF8, 0, path, -1, nullptr, 0);
+            if (length <= 0)
+                return nullptr;
+
+            std::vector<wchar_t> widePath(static_cast<size_t>(length));
+            MultiByteToWideChar(CP_UTF8, 0, path, -1, widePath.data(), length);
+            return _wfopen(widePath.data(), L"wb");
+#else
+            return std::fopen(path, "wb");
+#endif
+        }
+
+        static bool SeekFile(std::FILE* file, uint64_t offset)
+        {
+#ifdef _WIN32
+            return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+#else
+            return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+        }
+
+        void Fail(Fmp4RecorderError error)
+        {
+            m_Error.store(static_cast<int32_t>(error), std::memory_order_relaxed);
+            m_Status.store(static_cast<int32_t>(Fmp4RecorderStatus::Failed), std::memory_order_relaxed);
+        }
+
+        // The sample entry is written once: a change of the parameter sets needs a new file.
+        bool UpdateParameterSets(const uint8_t* sps, size_t spsSize, const uint8_t* pps, size_t ppsSize)
+        {
+            if (!m_HasParameterSets)
+            {
+                if (spsSize < Fmp4::k_MinSpsSize)
+                    return false;
+
+                m_Sps.assign(sps, sps + spsSize);
+                m_Pps.assign(pps, pps + ppsSize);
+                m_HasParameterSets = true;
+                return true;
+            }
+
+            if (m_Sps.size() == spsSize && m_Pps.size() == ppsSize &&
+                std::memcmp(m_Sps.data(), sps, spsSize) == 0 &&
+                std::memcmp(m_Pps.data(), pps, ppsSize) == 0)
+                return true;
+
+            if (m_Current != nullptr)
+            {
+                PublishCurrent(m_LastTicks + EstimateLastDuration());
+            }
+            Fail(Fmp4RecorderError::ParameterSetsChanged);
+            return false;
+        }
+
+        bool BeginFragment(uint64_t ticks, uint64_t timestampNs, bool isKeyFrame)
+        {
+            // The frames after a drop reference a lost one.
+            if (m_IsSkippingToKeyFrame && !isKeyFrame)
+                return false;
+
+            m_Current = m_Fragments.BeginWrite();
+            while (m_Current == nullptr && m_IsBlocking &&
+                   m_Error.load(std::memory_order_relaxed) != static_cast<int32_t>(Fmp4RecorderError::WriteFailed))
+            {
+                // The period covers a notification missed between the check and the wait.
+                std::unique_lock<std::mutex> lock(m_WakeMutex);
+                m_SpaceCondition.wait_for(lock, std::chrono::milliseconds(10));
+                m_Current = m_Fragments.BeginWrite();
+            }
+
+            if (m_Current == nullptr)
+            {
+                m_IsSkippingToKeyFrame = true;
+                return false;
+            }
+
+            m_Current->initSegment.clear();
+            if (m_IsInitSegmentPending)
+            {
+                Fmp4::TrackSettings track;
+                track.width = m_Width;
+                track.height = m_Height;
+                track.timescale = Fmp4::k_DefaultTimescale;
+
+                Fmp4::BoxWriter writer(m_Current->initSegment);
+                Fmp4::WriteInitSegment(writer, track, m_Sps.data(), m_Sps.size(), m_Pps.data(), m_Pps.size());
+                m_IsInitSegmentPending = false;
+            }
+
+            m_Current->payload.clear();
+            m_Current->samples.clear();
+            m_Current->baseDecodeTime = ticks;
+            m_Current->sequenceNumber = m_NextSequenceNumber++;
+            m_FragmentStartTimestamp = timestampNs;
+            m_IsSkippingToKeyFrame = false;
+            return true;
+        }
+
+        // The last sample lasts until the next frame, endTicks.
+        void PublishCurrent(uint64_t endTicks)
+        {
+            auto& samples = m_Current->samples;
+            if (!samples.empty())
+            {
+                samples.back().duration = static_cast<uint32_t>((endTicks > m_LastTicks) ? endTicks - m_LastTicks : 1);
+            }
+
+            m_Current = nullptr;
+            if (samples.empty())
+                return;
+
+            m_Fragments.Publish();
+
+            // Notifying without the mutex can miss the wait, the period covers it.
+            m_WakeCondition.notify_one();
+        }
+
+        uint32_t EstimateLastDuration() const
+        {
+            // One frame at 30 fps when there was a single frame.
+            return (m_LastDuration > 0) ? m_LastDuration : Fmp4::k_DefaultTimescale / 30;
+        }
+
+        bool WriteBytes(const uint8_t* data, size_t size)
+        {
+            if (size == 0)
+                return true;
+
+            if (std::fwrite(data, 1, size, m_File) != size)
+                return false;
+
+            m_FilePosition += size;
+            return true;
+        }
+
+        // Writer thread: appends the fragment where the previous trailer starts, then the trailer.
+        bool WriteFragment(const Fragment& fragment)
+        {
+            if (m_FilePosition != m_TrailerOffset && !SeekFile(m_File, m_TrailerOffset))
+                return false;
+
+            m_FilePosition = m_TrailerOffset;
+
+            if (!WriteBytes(fragment.initSegment.data(), fragment.initSegment.size()))
+                return false;
+
+            Fmp4::FragmentIndexEntry entry;
+            entry.time = fragment.baseDecodeTime;
+            entry.moofOffset = m_FilePosition;
+
+            m_HeaderBuffer.clear();
+            Fmp4::BoxWriter headerWriter(m_HeaderBuffer);
+            if (!Fmp4::WriteFragmentHeader(headerWriter,
+                                           fragment.sequenceNumber,
+                                           fragment.baseDecodeTime,
+                                           fragment.samples.data(),
+                                           fragment.samples.size(),
+                                           fragment.payload.size()))
+                return false;
+
+            if (!WriteBytes(m_HeaderBuffer.data(), m_HeaderBuffer.size()) ||
+                !WriteBytes(fragment.payload.data(), fragment.payload.size()))
+                return false;
+
+            m_Index.push_back(entry);
+            m_TrailerOffset = m_FilePosition;
+
+            m_TrailerBuffer.clear();
+            Fmp4::BoxWriter trailerWriter(m_TrailerBuffer);
+            Fmp4::WriteRandomAccessIndex(trailerWriter, m_Index.data(), m_Index.size());
+
+            if (!WriteBytes(m_TrailerBuffer.data(), m_TrailerBuffer.size()) || std::fflush(m_File) != 0)
+                return false;
+
+            m_BytesWritten.store(m_FilePosition, std::memory_order_relaxed);
+            m_FragmentsWritten.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        void WriterLoop()
+        {
+            for (;;)
+            {
+                bool stopping;
+                {
+                    std::unique_lock<std::mutex> lock(m_WakeMutex);
+                    m_WakeCondition.wait_for(lock, std::chrono::milliseconds(50), [this]()
+                    {
+                        return m_StopRequested || m_Fragments.GetSize() > 0;
+                    });
+                    stopping = m_StopRequested;
+                }
+
+                while (auto fragment = m_Fragments.Front())
+                {
+                    // After a write error the fragments are only released.
+                    if (m_Error.load(std::memory_order_relaxed) != static_cast<int32_t>(Fmp4RecorderError::WriteFailed) &&
+                        !WriteFragment(*fragment))
+                    {
+                        Fail(Fmp4RecorderError::WriteFailed);
+                    }
+                    m_Fragments.Pop();
+                    m_SpaceCondition.notify_one();
+                }
+
+                // The producer is stopped once requested, the ring is drained.
+                if (stopping)
+                    return;
+            }
+        }
+
+        std::FILE* m_File;
+        uint32_t   m_Width;
+        uint32_t   m_Height;
+        uint64_t   m_MinFragmentDurationNs;
+        size_t     m_MaxFragmentBytes;
+
+        SpscFrameRing<Fragment, k_FragmentSlotCount> m_Fragments;
+
+        // Producer state.
+        Fragment*            m_Current;
+        std::vector<uint8_t> m_Sps;
+        std::vector<uint8_t> m_Pps;
+        bool                 m_HasParameterSets;
+        bool                 m_IsInitSegmentPending;
+        bool                 m_IsSkippingToKeyFrame;
+        bool                 m_IsBlocking;
+        uint32_t             m_NextSequenceNumber;
+        uint64_t             m_FirstTimestamp;
+        uint64_t             m_FragmentStartTimestamp;
+        uint64_t             m_LastTicks;
+        uint32_t             m_LastDuration;
+
+        // Writer state.
+        std::thread                           m_Writer;
+        std::vector<uint8_t>                  m_HeaderBuffer;
+        std::vector<uint8_t>                  m_TrailerBuffer;
+        std::vector<Fmp4::FragmentIndexEntry> m_Index;
+        uint64_t                              m_FilePosition;
+        uint64_t                              m_TrailerOffset;
+
+        std::mutex              m_WakeMutex;
+        std::condition_variable m_WakeCondition;
+        std::condition_variable m_SpaceCondition; // A fragment buffer was released, see SetBlocking().
+        bool                    m_StopRequested;
+
+        std::atomic<int32_t>  m_Status;
+        std::atomic<int32_t>  m_Error;
+        std::atomic<uint64_t> m_FramesRecorded;
+        std::atomic<uint64_t> m_DroppedFrames;
+        std::atomic<uint64_t> m_FragmentsWritten;
+        std::atomic<uint64_t> m_BytesWritten;
+        std::atomic<uint64_t> m_Duration;
+    };
+}
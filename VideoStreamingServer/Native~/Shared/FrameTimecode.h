@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace LiveCaptureNative
+{
+    // SMPTE timecode of a captured frame, given by the Live Capture timecode source.
+    // Blittable: the layout is mirrored by the C# FrameTimecode, keep both in sync.
+    struct FrameTimecode
+    {
+        int32_t hours;
+        int32_t minutes;
+        int32_t seconds;
+        int32_t frames;
+        int32_t subframe;
+        int32_t subframeResolution;
+        int32_t rateNumerator;   // 0 when the frame has no timecode.
+        int32_t rateDenominator;
+        int32_t isDropFrame;
+    };
+
+    inline bool HasTimecode(const FrameTimecode& timecode)
+    {
+        return timecode.rateNumerator > 0 && timecode.rateDenominator > 0;
+    }
+}
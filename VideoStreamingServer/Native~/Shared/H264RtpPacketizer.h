@@ -0,0 +1,201 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "AnnexBConverter.h"
+#include "RtpPacket.h"
+
+namespace LiveCaptureNative
+{
+    // An encoded access unit split into RTP payloads, shared by all the clients it is sent to:
+    // the senders only write the 12-byte RTP header of each client and point at the payloads.
+    struct RtpAccessUnit
+    {
+        struct Packet
+        {
+            uint32_t offset; // In payloads.
+            uint32_t size;
+            bool     isLast; // Sent with the marker bit.
+        };
+
+        std::vector<uint8_t> payloads; // Back to back.
+        std::vector<Packet>  packets;
+        uint32_t             timestamp; // 90 kHz clock.
+        uint8_t              payloadType;
+        bool                 isKeyFrame;
+
+        inline const uint8_t* GetPayload(const Packet& packet) const { return payloads.data() + packet.offset; }
+
+        // Writes the RTP header of a packet for a client.
+        inline void WriteHeader(const Packet& packet, uint16_t sequence, uint32_t ssrc, uint8_t* header) const
+        {
+            header[0] = static_cast<uint8_t>(Rtp::k_Version << 6);
+            header[1] = static_cast<uint8_t>((packet.isLast ? 0x80 : 0) | (payloadType & 0x7f));
+            Rtp::SetSequenceNumber(header, sequence);
+            Rtp::WriteUInt32(header + 4, timestamp);
+            Rtp::SetSsrc(header, ssrc);
+        }
+    };
+
+    using RtpAccessUnitRef = std::shared_ptr<const RtpAccessUnit>;
+
+    // Splits H264 access units (Annex B) into RTP payloads, non-interleaved mode (RFC 6184
+    // packetization-mode=1):
+    //   - a NAL unit larger than the payload size is fragmented in FU-A packets;
+    //   - consecutive small NAL units (parameter sets, SEI, slices of small frames) are aggregated
+    //     in STAP-A packets, with the highest NRI of the units;
+    //   - any other NAL unit is sent as is.
+    //
+    // The access units come from a small pool and are reused once no sender holds them anymore,
+    // so the packetizer doesn't allocate once the buffers have grown to the largest frame.
+    class H264RtpPacketizer final
+    {
+    public:
+        static const size_t k_DefaultMaxPayloadSize = 1200 - Rtp::k_HeaderSize;
+        static const size_t k_PoolSize = 8;
+        static const uint8_t k_DefaultPayloadType = 96;
+
+        explicit H264RtpPacketizer(size_t maxPayloadSize = k_DefaultMaxPayloadSize, uint8_t payloadType = k_DefaultPayloadType) :
+            m_MaxPayloadSize(std::max<size_t>(maxPayloadSize, 64)),
+            m_PayloadType(payloadType),
+            m_PendingSize(1)
+        {
+        }
+
+        H264RtpPacketizer(const H264RtpPacketizer&) = delete;
+        H264RtpPacketizer& operator=(const H264RtpPacketizer&) = delete;
+
+        // Packetizes an access unit, captured at timestampNs. Returns null if it has no NAL unit.
+        RtpAccessUnitRef Packetize(const uint8_t* annexB, size_t size, uint64_t timestampNs, bool isKeyFrame)
+        {
+            auto accessUnit = Acquire();
+            accessUnit->payloads.clear();
+            accessUnit->packets.clear();
+            accessUnit->timestamp = static_cast<uint32_t>(timestampNs * 9 / 100000);
+            accessUnit->payloadType = m_PayloadType;
+            accessUnit->isKeyFrame = isKeyFrame;
+
+            AnnexB::ForEachNalUnit(annexB, size, [this, &accessUnit](const uint8_t* nal, size_t nalSize)
+            {
+                if (nalSize + 2 + 1 > m_MaxPayloadSize)
+                {
+                    FlushAggregate(*accessUnit);
+                    Fragment(*accessUnit, nal, nalSize);
+                    return;
+                }
+
+                if (m_PendingSize + 2 + nalSize > m_MaxPayloadSize)
+                    FlushAggregate(*accessUnit);
+                m_Pending.push_back(Span{ nal, nalSize });
+                m_PendingSize += 2 + nalSize;
+            });
+            FlushAggregate(*accessUnit);
+
+            if (accessUnit->packets.empty())
+                return nullptr;
+
+            accessUnit->packets.back().isLast = true;
+            return accessUnit;
+        }
+
+    private:
+        static const uint8_t k_TypeStapA = 24;
+        static const uint8_t k_TypeFuA = 28;
+
+        struct Span
+        {
+            const uint8_t* data;
+            size_t         size;
+        };
+
+        // A pooled access unit no sender holds anymore, or a new one while they are all in use.
+        std::shared_ptr<RtpAccessUnit> Acquire()
+        {
+            for (auto& accessUnit : m_Pool)
+            {
+                if (accessUnit.use_count() == 1)
+                    return accessUnit;
+            }
+
+            auto accessUnit = std::make_shared<RtpAccessUnit>();
+            if (m_Pool.size() < k_PoolSize)
+                m_Pool.push_back(accessUnit);
+            return accessUnit;
+        }
+
+        void AddPacket(RtpAccessUnit& accessUnit, size_t offset)
+        {
+            RtpAccessUnit::Packet packet;
+            packet.offset = static_cast<uint32_t>(offset);
+            packet.size = static_cast<uint32_t>(accessUnit.payloads.size() - offset);
+            packet.isLast = false;
+            accessUnit.packets.push_back(packet);
+        }
+
+        void FlushAggregate(RtpAccessUnit& accessUnit)
+        {
+            if (m_Pending.empty())
+                return;
+
+            auto& payloads = accessUnit.payloads;
+            const auto offset = payloads.size();
+            if (m_Pending.size() == 1)
+            {
+                payloads.insert(payloads.end(), m_Pending[0].data, m_Pending[0].data + m_Pending[0].size);
+            }
+            else
+            {
+                uint8_t nri = 0;
+                for (const auto& nal : m_Pending)
+                {
+                    nri = std::max<uint8_t>(nri, nal.data[0] & 0x60);
+                }
+
+                payloads.push_back(static_cast<uint8_t>(nri | k_TypeStapA));
+                for (const auto& nal : m_Pending)
+                {
+                    payloads.push_back(static_cast<uint8_t>(nal.size >> 8));
+                    payloads.push_back(static_cast<uint8_t>(nal.size));
+                    payloads.insert(payloads.end(), nal.data, nal.data + nal.size);
+                }
+            }
+            AddPacket(accessUnit, offset);
+            m_Pending.clear();
+            m_PendingSize = 1;
+        }
+
+        void Fragment(RtpAccessUnit& accessUnit, const uint8_t* nal, size_t nalSize)
+        {
+            auto& payloads = accessUnit.payloads;
+            const auto indicator = static_cast<uint8_t>((nal[0] & 0xe0) | k_TypeFuA);
+            const auto type = static_cast<uint8_t>(nal[0] & 0x1f);
+            const auto fragmentSize = m_MaxPayloadSize - 2;
+
+            // The NAL header is carried by the FU indicator and header.
+            for (size_t position = 1; position < nalSize; position += fragmentSize)
+            {
+                const auto size = std::min(fragmentSize, nalSize - position);
+                const auto isStart = position == 1;
+                const auto isEnd = position + size == nalSize;
+
+                const auto offset = payloads.size();
+                payloads.push_back(indicator);
+                payloads.push_back(static_cast<uint8_t>((isStart ? 0x80 : 0) | (isEnd ? 0x40 : 0) | type));
+                payloads.insert(payloads.end(), nal + position, nal + position + size);
+                AddPacket(accessUnit, offset);
+            }
+        }
+
+        const size_t  m_MaxPayloadSize;
+        const uint8_t m_PayloadType;
+
+        std::vector<std::shared_ptr<RtpAccessUnit>> m_Pool;
+        std::vector<Span>                           m_Pending;     // Small NAL units to aggregate.
+        size_t                                      m_PendingSize; // Of their STAP-A: header, then a 16-bit size before each unit.
+    };
+}
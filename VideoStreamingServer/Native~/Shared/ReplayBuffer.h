@@ -0,0 +1,483 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace LiveCaptureNative
+{
+    // Size of the replay buffer of an encoder. Blittable: the layout is mirrored by the C#
+    // ReplayBufferSettings, keep both in sync. Zero fields select the defaults.
+    struct ReplayBufferSettings
+    {
+        int32_t capacityMB;    // Slab holding the encoded frames, allocated once.
+        int32_t maxDurationMs; // The oldest GOPs are evicted past this duration.
+        int32_t maxFrames;     // Entries of the frame index, allocated once.
+    };
+
+    // Content of a replay buffer, returned by the GetReplayBufferStats export of the plugins.
+    // Blittable: the layout is mirrored by the C# ReplayBufferStats, keep both in sync.
+    struct ReplayBufferStats
+    {
+        uint64_t capacityBytes;   // Slab size.
+        uint64_t framesStored;
+        uint64_t bytesStored;     // Frames and their parameter sets.
+        uint64_t oldestTimestamp; // Capture time of the oldest frame, a key frame. 0 when empty.
+        uint64_t newestTimestamp;
+        uint64_t framesAppended;
+        uint64_t framesDropped;   // No room without evicting a pinned frame, or after such a drop.
+        uint64_t gopsEvicted;
+    };
+
+    // A frame of a ReplayRange. The pointers stay valid as long as the range.
+    struct ReplayFrame
+    {
+        const uint8_t* data; // Annex B.
+        size_t         size;
+        const uint8_t* sps;  // Key frames only, NAL units without start code.
+        size_t         spsSize;
+        const uint8_t* pps;
+        size_t         ppsSize;
+        uint64_t       timestamp;
+        bool           isKeyFrame;
+    };
+
+    class ReplayBuffer;
+
+    // Frames of a replay buffer, read in place: the buffer doesn't evict them while the range is
+    // held. Starts with a key frame. Move-only, the frames are released with the range.
+    class ReplayRange final
+    {
+    public:
+        ReplayRange() : m_Buffer(nullptr), m_Pin(0), m_Begin(0), m_End(0) {}
+        ~ReplayRange() { Release(); }
+
+        ReplayRange(ReplayRange&& other) : m_Buffer(nullptr), m_Pin(0), m_Begin(0), m_End(0)
+        {
+            *this = std::move(other);
+        }
+
+        ReplayRange& operator=(ReplayRange&& other)
+        {
+            if (this != &other)
+            {
+                Release();
+                m_Buffer = other.m_Buffer;
+                m_Pin = other.m_Pin;
+                m_Begin = other.m_Begin;
+                m_End = other.m_End;
+                other.m_Buffer = nullptr;
+            }
+            return *this;
+        }
+
+        ReplayRange(const ReplayRange&) = delete;
+        ReplayRange& operator=(const ReplayRange&) = delete;
+
+        inline bool   IsValid() const { return m_Buffer != nullptr; }
+        inline size_t GetFrameCount() const { return IsValid() ? static_cast<size_t>(m_End - m_Begin) : 0; }
+
+        // Callable from any thread, without locking.
+        ReplayFrame GetFrame(size_t index) const;
+
+        void Release();
+
+    private:
+        friend class ReplayBuffer;
+
+        ReplayBuffer* m_Buffer;
+        size_t        m_Pin;
+        uint64_t      m_Begin; // Frame numbers, see ReplayBuffer.
+        uint64_t      m_End;
+    };
+
+    // Keeps the last encoded frames of a stream in memory, to save an instant replay without a
+    // recording running.
+    //
+    // The frames are copied, with the parameter sets of the key frames, into a slab allocated
+    // once: each record is contiguous, the slab is used as a ring and its end is skipped when a
+    // record doesn't fit. The index is a ring of entries numbered by append order, with a second
+    // ring holding the numbers of the key frames, sorted by timestamp for the lookups. Room is
+    // made by evicting the oldest GOP as a whole, so the buffer always starts with a key frame,
+    // and so that the duration stays within maxDurationMs.
+    //
+    // The producer (the encoder output thread) appends, any thread can acquire a range. A range
+    // pins its frames instead of copying them: a frame that could only be stored by evicting a
+    // pinned one is dropped, and the following ones up to the next key frame. The mutex is only
+    // held to update the index and to copy the appended frame, never while a range is read.
+    class ReplayBuffer final
+    {
+    public:
+        static const int32_t k_DefaultCapacityMB = 64;
+        static const int32_t k_MaxCapacityMB = 2048;
+        static const int32_t k_DefaultMaxDurationMs = 30 * 1000;
+        static const int32_t k_DefaultMaxFrames = 4096;
+        static const int32_t k_MaxFrames = 64 * 1024;
+        static const size_t  k_MaxRanges = 4;
+
+        // Allocates the slab and the index, memory use doesn't change afterwards.
+        explicit ReplayBuffer(const ReplayBufferSettings& settings) :
+            m_MaxDurationNs(0),
+            m_Head(0),
+            m_Tail(0),
+            m_KeyHead(0),
+            m_KeyTail(0),
+            m_WriteOffset(0),
+            m_BytesStored(0),
+            m_IsSkippingToKeyFrame(false),
+            m_FramesAppended(0),
+            m_FramesDropped(0),
+            m_GopsEvicted(0)
+        {
+            const auto clamp = [](int32_t value, int32_t defaultValue, int32_t max)
+            {
+                return (value <= 0) ? defaultValue : (value > max) ? max : value;
+            };
+
+            const auto capacityMB = clamp(settings.capacityMB, k_DefaultCapacityMB, k_MaxCapacityMB);
+            const auto maxFrames = clamp(settings.maxFrames, k_DefaultMaxFrames, k_MaxFrames);
+            const auto maxDurationMs = (settings.maxDurationMs > 0) ? settings.maxDurationMs : k_DefaultMaxDurationMs;
+
+            m_Slab.resize(static_cast<size_t>(capacityMB) * 1024 * 1024);
+            m_Entries.resize(static_cast<size_t>(maxFrames));
+            m_KeyFrames.resize(static_cast<size_t>(maxFrames));
+            m_MaxDurationNs = static_cast<uint64_t>(maxDurationMs) * 1000000ull;
+
+            for (auto& pin : m_Pins)
+            {
+                pin = k_Unpinned;
+            }
+        }
+
+        ReplayBuffer(const ReplayBuffer&) = delete;
+        ReplayBuffer& operator=(const ReplayBuffer&) = delete;
+
+        // Producer: copies an encoded frame (Annex B) into the buffer. Key frames carry their
+        // parameter sets (NAL units without start code). Timestamps must increase.
+        // Returns false if the frame was dropped.
+        bool Append(const uint8_t* data,
+                    size_t size,
+                    uint64_t timestamp,
+                    bool isKeyFrame,
+                    const uint8_t* sps,
+                    size_t spsSize,
+                    const uint8_t* pps,
+                    size_t ppsSize)
+        {
+            if (data == nullptr || size == 0)
+                return false;
+
+            if (!isKeyFrame || sps == nullptr || pps == nullptr)
+            {
+                spsSize = 0;
+                ppsSize = 0;
+            }
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            // Nothing can be decoded without the first key frame, or the frame dropped before.
+            if (!isKeyFrame && (m_IsSkippingToKeyFrame || IsEmpty()))
+                return Drop();
+
+            const auto recordSize = spsSize + ppsSize + size;
+            if (recordSize > m_Slab.size())
+                return Drop();
+
+            // The duration bound is soft, a pinned GOP stays.
+            while (GetKeyFrameCount() > 1)
+            {
+                const auto secondGopStart = GetEntry(m_KeyFrames[(m_KeyTail + 1) % m_KeyFrames.size()]).timestamp;
+                if (timestamp < secondGopStart || timestamp - secondGopStart < m_MaxDurationNs || !EvictOldestGop(isKeyFrame))
+                    break;
+            }
+
+            while (GetFrameCount() == m_Entries.size())
+            {
+                if (!EvictOldestGop(isKeyFrame))
+                    return Drop();
+            }
+
+            size_t offset = 0;
+            while (!FindSpace(recordSize, offset))
+            {
+                if (!EvictOldestGop(isKeyFrame))
+                    return Drop();
+            }
+
+            auto record = m_Slab.data() + offset;
+            if (spsSize > 0)
+            {
+                std::memcpy(record, sps, spsSize);
+                std::memcpy(record + spsSize, pps, ppsSize);
+            }
+            std::memcpy(record + spsSize + ppsSize, data, size);
+
+            auto& entry = m_Entries[m_Head % m_Entries.size()];
+            entry.offset = offset;
+            entry.spsSize = static_cast<uint32_t>(spsSize);
+            entry.ppsSize = static_cast<uint32_t>(ppsSize);
+            entry.size = static_cast<uint32_t>(size);
+            entry.timestamp = timestamp;
+            entry.isKeyFrame = isKeyFrame;
+
+            if (isKeyFrame)
+            {
+                m_KeyFrames[m_KeyHead % m_KeyFrames.size()] = m_Head;
+                ++m_KeyHead;
+                m_IsSkippingToKeyFrame = false;
+            }
+
+            ++m_Head;
+            m_WriteOffset = offset + recordSize;
+            m_BytesStored += recordSize;
+            ++m_FramesAppended;
+            return true;
+        }
+
+        // Acquires the frames captured from fromNs to toNs included. The range starts at the key
+        // frame at or before fromNs, or at the oldest frame. Returns false if it would be empty,
+        // or if k_MaxRanges ranges are already held.
+        bool Acquire(uint64_t fromNs, uint64_t toNs, ReplayRange& range)
+        {
+            range.Release();
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (IsEmpty())
+                return false;
+
+            // Last key frame at or before fromNs, the oldest frame is one.
+            auto low = m_KeyTail;
+            auto high = m_KeyHead;
+            while (high - low > 1)
+            {
+                const auto middle = low + (high - low) / 2;
+                if (GetEntry(m_KeyFrames[middle % m_KeyFrames.size()]).timestamp <= fromNs)
+                {
+                    low = middle;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            const auto begin = m_KeyFrames[low % m_KeyFrames.size()];
+
+            // First frame after toNs.
+            low = begin;
+            high = m_Head;
+            while (low < high)
+            {
+                const auto middle = low + (high - low) / 2;
+                if (GetEntry(middle).timestamp <= toNs)
+                {
+                    low = middle + 1;
+                }
+                else
+                {
+                    high = middle;
+                }
+            }
+            const auto end = low;
+
+            if (end <= begin)
+                return false;
+
+            for (size_t i = 0; i < k_MaxRanges; ++i)
+            {
+                if (m_Pins[i] == k_Unpinned)
+                {
+                    m_Pins[i] = begin;
+                    range.m_Buffer = this;
+                    range.m_Pin = i;
+                    range.m_Begin = begin;
+                    range.m_End = end;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Acquires the last durationNs of the buffer, or everything for 0.
+        bool AcquireLast(uint64_t durationNs, ReplayRange& range)
+        {
+            uint64_t newest;
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                if (IsEmpty())
+                    return false;
+
+                newest = GetEntry(m_Head - 1).timestamp;
+            }
+
+            const auto from = (durationNs == 0 || durationNs > newest) ? 0 : newest - durationNs;
+            return Acquire(from, UINT64_MAX, range);
+        }
+
+        void GetStats(ReplayBufferStats& stats) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            stats.capacityBytes = m_Slab.size();
+            stats.framesStored = GetFrameCount();
+            stats.bytesStored = m_BytesStored;
+            stats.oldestTimestamp = IsEmpty() ? 0 : GetEntry(m_Tail).timestamp;
+            stats.newestTimestamp = IsEmpty() ? 0 : GetEntry(m_Head - 1).timestamp;
+            stats.framesAppended = m_FramesAppended;
+            stats.framesDropped = m_FramesDropped;
+            stats.gopsEvicted = m_GopsEvicted;
+        }
+
+    private:
+        friend class ReplayRange;
+
+        static const uint64_t k_Unpinned = UINT64_MAX;
+
+        struct Entry
+        {
+            size_t   offset = 0;  // Of the record in the slab: SPS, PPS, then the frame.
+            uint32_t spsSize = 0;
+            uint32_t ppsSize = 0;
+            uint32_t size = 0;
+            uint64_t timestamp = 0;
+            bool     isKeyFrame = false;
+        };
+
+        inline bool   IsEmpty() const { return m_Head == m_Tail; }
+        inline size_t GetFrameCount() const { return static_cast<size_t>(m_Head - m_Tail); }
+        inline size_t GetKeyFrameCount() const { return static_cast<size_t>(m_KeyHead - m_KeyTail); }
+        inline const Entry& GetEntry(uint64_t frame) const { return m_Entries[frame % m_Entries.size()]; }
+        inline size_t GetRecordSize(const Entry& entry) const { return entry.spsSize + entry.ppsSize + entry.size; }
+
+        bool Drop()
+        {
+            ++m_FramesDropped;
+            m_IsSkippingToKeyFrame = true;
+            return false;
+        }
+
+        // Evicts the frames up to the second key frame, or all of them. Fails if one is pinned,
+        // or if the frame being appended isn't a key frame and would lose its references.
+        bool EvictOldestGop(bool isAppendingKeyFrame)
+        {
+            if (IsEmpty())
+                return false;
+
+            const auto end = (GetKeyFrameCount() > 1)
+                ? m_KeyFrames[(m_KeyTail + 1) % m_KeyFrames.size()]
+                : m_Head;
+
+            if (end == m_Head && !isAppendingKeyFrame)
+                return false;
+
+            for (const auto pin : m_Pins)
+            {
+                if (pin != k_Unpinned && pin < end)
+                    return false;
+            }
+
+            for (auto frame = m_Tail; frame < end; ++frame)
+            {
+                m_BytesStored -= GetRecordSize(GetEntry(frame));
+            }
+
+            m_Tail = end;
+            ++m_KeyTail;
+            ++m_GopsEvicted;
+            return true;
+        }
+
+        // Contiguous room for size bytes after the newest record, or at the start of the slab.
+        bool FindSpace(size_t size, size_t& offset)
+        {
+            if (IsEmpty())
+            {
+                m_WriteOffset = 0;
+                offset = 0;
+                return true;
+            }
+
+            const auto tailOffset = GetEntry(m_Tail).offset;
+            if (m_WriteOffset > tailOffset)
+            {
+                // The records are in [tailOffset, m_WriteOffset).
+                if (m_WriteOffset + size <= m_Slab.size())
+                {
+                    offset = m_WriteOffset;
+                    return true;
+                }
+                if (size <= tailOffset)
+                {
+                    offset = 0;
+                    return true;
+                }
+                return false;
+            }
+
+            // Wrapped: the records are in [tailOffset, end) and [0, m_WriteOffset).
+            if (m_WriteOffset + size <= tailOffset)
+            {
+                offset = m_WriteOffset;
+                return true;
+            }
+            return false;
+        }
+
+        ReplayFrame GetFrame(uint64_t frame) const
+        {
+            const auto& entry = GetEntry(frame);
+            const auto record = m_Slab.data() + entry.offset;
+
+            ReplayFrame result;
+            result.sps = (entry.spsSize > 0) ? record : nullptr;
+            result.spsSize = entry.spsSize;
+            result.pps = (entry.ppsSize > 0) ? record + entry.spsSize : nullptr;
+            result.ppsSize = entry.ppsSize;
+            result.data = record + entry.spsSize + entry.ppsSize;
+            result.size = entry.size;
+            result.timestamp = entry.timestamp;
+            result.isKeyFrame = entry.isKeyFrame;
+            return result;
+        }
+
+        void Unpin(size_t pin)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Pins[pin] = k_Unpinned;
+        }
+
+        std::vector<uint8_t>  m_Slab;
+        std::vector<Entry>    m_Entries;
+        std::vector<uint64_t> m_KeyFrames; // Frame numbers of the key frames.
+        uint64_t              m_MaxDurationNs;
+
+        mutable std::mutex m_Mutex;
+        uint64_t           m_Head; // Next frame number.
+        uint64_t           m_Tail; // Oldest frame number, always a key frame.
+        uint64_t           m_KeyHead;
+        uint64_t           m_KeyTail;
+        size_t             m_WriteOffset;
+        size_t             m_BytesStored;
+        bool               m_IsSkippingToKeyFrame;
+        uint64_t           m_Pins[k_MaxRanges]; // First frame of each range held.
+
+        uint64_t m_FramesAppended;
+        uint64_t m_FramesDropped;
+        uint64_t m_GopsEvicted;
+    };
+
+    inline ReplayFrame ReplayRange::GetFrame(size_t index) const
+    {
+        return m_Buffer->GetFrame(m_Begin + index);
+    }
+
+    inline void ReplayRange::Release()
+    {
+        if (m_Buffer != nullptr)
+        {
+            m_Buffer->Unpin(m_Pin);
+            m_Buffer = nullptr;
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "Fmp4Recorder.h"
+#include "ReplayBuffer.h"
+
+namespace LiveCaptureNative
+{
+    // Writes a range of a replay buffer to a fragmented MP4 file, on a thread of its own so that
+    // the caller (the Unity thread) doesn't wait for the disk. The range is read in place and
+    // released once written.
+    class ReplayExporter final
+    {
+    public:
+        ReplayExporter() : m_IsBusy(false)
+        {
+            m_Recorder.SetBlocking(true);
+        }
+
+        ~ReplayExporter()
+        {
+            Wait();
+        }
+
+        ReplayExporter(const ReplayExporter&) = delete;
+        ReplayExporter& operator=(const ReplayExporter&) = delete;
+
+        // Creates the file (the path is UTF-8) and starts writing the range. Fails if the file
+        // can't be created, or if an export is in progress.
+        bool Start(ReplayRange&& range, const char* path, uint32_t width, uint32_t height)
+        {
+            if (IsBusy() || !range.IsValid())
+                return false;
+
+            Wait();
+
+            const Fmp4RecorderSettings settings = { 0, 0 };
+            if (!m_Recorder.Open(path, width, height, settings))
+                return false;
+
+            m_Range = std::move(range);
+            m_IsBusy.store(true, std::memory_order_release);
+            m_Thread = std::thread(&ReplayExporter::Export, this);
+            return true;
+        }
+
+        // Waits for the export in progress, if any.
+        void Wait()
+        {
+            if (m_Thread.joinable())
+            {
+                m_Thread.join();
+            }
+        }
+
+        inline bool IsBusy() const { return m_IsBusy.load(std::memory_order_acquire); }
+
+        // Progress of the export in progress, or result of the last one.
+        void GetStats(Fmp4RecorderStats& stats) const
+        {
+            m_Recorder.GetStats(stats);
+        }
+
+    private:
+        void Export()
+        {
+            const auto count = m_Range.GetFrameCount();
+            for (size_t i = 0; i < count; ++i)
+            {
+                const auto frame = m_Range.GetFrame(i);
+                m_Recorder.WriteFrame(frame.data,
+                                      frame.size,
+                                      frame.timestamp,
+                                      frame.isKeyFrame,
+                                      frame.sps,
+                                      frame.spsSize,
+                                      frame.pps,
+                                      frame.ppsSize);
+            }
+
+            m_Recorder.Close();
+            m_Range.Release();
+            m_IsBusy.store(false, std::memory_order_release);
+        }
+
+        Fmp4Recorder      m_Recorder;
+        ReplayRange       m_Range;
+        std::thread       m_Thread;
+        std::atomic<bool> m_IsBusy;
+    };
+}
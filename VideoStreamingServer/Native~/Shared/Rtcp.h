@@ -0,0 +1,206 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "RtpPacket.h"
+
+namespace LiveCaptureNative
+{
+    // RTCP parsing and writing for the feedback the server acts on. Clients send compound packets
+    // (RFC 3550 section 6.1) on the control port: a receiver report, followed by feedback messages.
+    // The report blocks of the sender and receiver reports give the loss measured by the client,
+    // the generic NACK (RFC 4585 section 6.2.1) the packets to retransmit. Other packets are skipped.
+    //
+    //    0                   1                   2                   3
+    //   |V=2|P| FMT=1   |    PT=205     |          length               |
+    //   |                  SSRC of packet sender                        |
+    //   |                  SSRC of media source                         |
+    //   |            PID                |             BLP               |  (repeated)
+    //
+    // PID is a lost sequence number and bit i of BLP flags PID + i + 1 as lost too.
+    namespace Rtcp
+    {
+        const size_t  k_HeaderSize = 4;
+        const uint8_t k_PayloadTypeSenderReport = 200;
+        const uint8_t k_PayloadTypeReceiverReport = 201;
+        const uint8_t k_PayloadTypeRtpFeedback = 205;
+        const uint8_t k_FormatGenericNack = 1;
+
+        // Header, sender and media SSRC.
+        const size_t k_FeedbackHeaderSize = k_HeaderSize + 8;
+        const size_t k_NackEntrySize = 4;
+
+        // Header and sender SSRC, then the sender info for a sender report.
+        const size_t k_ReceiverReportHeaderSize = k_HeaderSize + 4;
+        const size_t k_SenderReportHeaderSize = k_ReceiverReportHeaderSize + 20;
+        const size_t k_ReportBlockSize = 24;
+
+        // Reception statistics of a client for one of the streams it receives (RFC 3550 section 6.4.1).
+        struct ReportBlock
+        {
+            uint32_t ssrc;            // Of the stream reported on.
+            uint8_t  fractionLost;    // Since the previous report, in 1/256.
+            int32_t  cumulativeLost;  // Can be negative with duplicates.
+            uint32_t highestSequence; // Extended highest sequence number received.
+            uint32_t jitter;          // Interarrival jitter, in timestamp units.
+        };
+
+        // Calls callback(const uint8_t* packet, size_t size) for each packet of a compound packet.
+        // Returns false, after the packets read so far, if the compound packet is malformed.
+        template<typename Callback>
+        bool ForEachPacket(const uint8_t* data, size_t size, Callback&& callback)
+        {
+            if (data == nullptr)
+                return false;
+
+            size_t offset = 0;
+            while (offset < size)
+            {
+                if (size - offset < k_HeaderSize || (data[offset] >> 6) != Rtp::k_Version)
+                    return false;
+
+                const size_t packetSize = (static_cast<size_t>(Rtp::ReadUInt16(data + offset + 2)) + 1) * 4;
+                if (packetSize > size - offset)
+                    return false;
+
+                callback(data + offset, packetSize);
+                offset += packetSize;
+            }
+            return true;
+        }
+
+        // Calls callback(const ReportBlock&) for each report block of the sender and receiver reports
+        // of a compound packet.
+        template<typename Callback>
+        bool ForEachReportBlock(const uint8_t* data, size_t size, Callback&& callback)
+        {
+            return ForEachPacket(data, size, [&callback](const uint8_t* packet, size_t packetSize)
+            {
+                size_t offset;
+                if (packet[1] == k_PayloadTypeReceiverReport)
+                {
+                    offset = k_ReceiverReportHeaderSize;
+                }
+                else if (packet[1] == k_PayloadTypeSenderReport)
+                {
+                    offset = k_SenderReportHeaderSize;
+                }
+                else
+                {
+                    return;
+                }
+
+                const size_t count = packet[0] & 0x1f;
+                for (size_t i = 0; i < count && offset + k_ReportBlockSize <= packetSize; ++i, offset += k_ReportBlockSize)
+                {
+                    const auto block = packet + offset;
+                    const auto cumulativeLost = (static_cast<uint32_t>(block[5]) << 16) | (static_cast<uint32_t>(block[6]) << 8) | block[7];
+
+                    ReportBlock report;
+                    report.ssrc = Rtp::ReadUInt32(block);
+                    report.fractionLost = block[4];
+                    report.cumulativeLost = static_cast<int32_t>(cumulativeLost << 8) >> 8; // 24-bit two's complement.
+                    report.highestSequence = Rtp::ReadUInt32(block + 8);
+                    report.jitter = Rtp::ReadUInt32(block + 12);
+                    callback(static_cast<const ReportBlock&>(report));
+                }
+            });
+        }
+
+        // Calls callback(uint32_t mediaSsrc, uint16_t sequence) for each sequence number reported
+        // lost by the generic NACKs of a compound packet, in the order of the packet.
+        template<typename Callback>
+        bool ForEachNackedSequence(const uint8_t* data, size_t size, Callback&& callback)
+        {
+            return ForEachPacket(data, size, [&callback](const uint8_t* packet, size_t packetSize)
+            {
+                if (packet[1] != k_PayloadTypeRtpFeedback || (packet[0] & 0x1f) != k_FormatGenericNack ||
+                    packetSize < k_FeedbackHeaderSize)
+                    return;
+
+                // Padding is counted in the length, its size is in the last byte.
+                if ((packet[0] & 0x20) != 0)
+                {
+                    const size_t padding = packet[packetSize - 1];
+                    if (padding > packetSize - k_FeedbackHeaderSize)
+                        return;
+                    packetSize -= padding;
+                }
+
+                const auto mediaSsrc = Rtp::ReadUInt32(packet + 8);
+                for (auto entry = packet + k_FeedbackHeaderSize; entry + k_NackEntrySize <= packet + packetSize; entry += k_NackEntrySize)
+                {
+                    const auto pid = Rtp::ReadUInt16(entry);
+                    const auto blp = Rtp::ReadUInt16(entry + 2);
+
+                    callback(mediaSsrc, pid);
+                    for (uint16_t bit = 0; bit < 16; ++bit)
+                    {
+                        if ((blp & (1u << bit)) != 0)
+                        {
+                            callback(mediaSsrc, static_cast<uint16_t>(pid + bit + 1));
+                        }
+                    }
+                }
+            });
+        }
+
+        // Number of bytes of the generic NACK reporting the given lost sequence numbers, sorted
+        // in sequence order.
+        inline size_t GetGenericNackSize(const uint16_t* lost, size_t count)
+        {
+            size_t entries = 0;
+            for (size_t i = 0; i < count;)
+            {
+                const auto pid = lost[i++];
+                while (i < count && Rtp::SequenceDelta(pid, lost[i]) >= 1 && Rtp::SequenceDelta(pid, lost[i]) <= 16)
+                {
+                    ++i;
+                }
+                ++entries;
+            }
+            return k_FeedbackHeaderSize + entries * k_NackEntrySize;
+        }
+
+        // Writes a generic NACK reporting the given lost sequence numbers, sorted in sequence order.
+        // Returns the number of bytes written, 0 if there is nothing to report or no room.
+        inline size_t WriteGenericNack(uint32_t senderSsrc,
+                                       uint32_t mediaSsrc,
+                                       const uint16_t* lost,
+                                       size_t count,
+                                       uint8_t* out,
+                                       size_t capacity)
+        {
+            if (lost == nullptr || count == 0 || out == nullptr)
+                return 0;
+
+            const auto size = GetGenericNackSize(lost, count);
+            if (size > capacity || size / 4 - 1 > 0xffff)
+                return 0;
+
+            out[0] = static_cast<uint8_t>((Rtp::k_Version << 6) | k_FormatGenericNack);
+            out[1] = k_PayloadTypeRtpFeedback;
+            Rtp::WriteUInt16(out + 2, static_cast<uint16_t>(size / 4 - 1));
+            Rtp::WriteUInt32(out + 4, senderSsrc);
+            Rtp::WriteUInt32(out + 8, mediaSsrc);
+
+            auto entry = out + k_FeedbackHeaderSize;
+            for (size_t i = 0; i < count;)
+            {
+                const auto pid = lost[i++];
+                uint16_t blp = 0;
+                while (i < count && Rtp::SequenceDelta(pid, lost[i]) >= 1 && Rtp::SequenceDelta(pid, lost[i]) <= 16)
+                {
+                    blp |= static_cast<uint16_t>(1u << (Rtp::SequenceDelta(pid, lost[i]) - 1));
+                    ++i;
+                }
+
+                Rtp::WriteUInt16(entry, pid);
+                Rtp::WriteUInt16(entry + 2, blp);
+                entry += k_NackEntrySize;
+            }
+            return size;
+        }
+    }
+}
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "H264RtpPacketizer.h"
+#include "RtpPacket.h"
+#include "Socket.h"
+
+namespace LiveCaptureNative
+{
+    struct RtpFanoutStats
+    {
+        uint64_t accessUnitsSent;
+        uint64_t packetsSent;    // Datagrams, all clients together.
+        uint64_t packetsDropped; // The socket buffer was full, or the destination unreachable.
+        uint64_t bytesSent;
+        uint64_t sendCalls;      // Calls to SendDatagrams(), each a batch of system calls.
+    };
+
+    // Sends the packetized access units to the UDP clients of a stream from one socket. The
+    // payloads are shared: for each client only the RTP headers are written, with its sequence
+    // numbers and SSRC, and each datagram is a two-entry gather list (header, shared payload)
+    // handed to the kernel in batches.
+    //
+    // A multicast group is a client like another: one copy of each packet reaches all the
+    // monitors that joined it, so a monitor wall costs the same as a single client.
+    //
+    // The datagrams are ordered packet by packet across the clients: when the socket buffer
+    // fills up, every client loses the end of the access unit instead of the last clients losing
+    // all of it. The sequence numbers advance for the dropped packets, so the receivers see the
+    // loss and can send NACKs for it.
+    //
+    // The sender thread calls Send(), the RTSP thread adds and removes the clients. The mutex is
+    // held during a send, like the connection list of the managed server.
+    class RtpFanout final
+    {
+    public:
+        static const int32_t k_InvalidClient = -1;
+
+        // The socket is owned by the caller and must outlive the fan-out.
+        explicit RtpFanout(Net::SocketHandle socket) :
+            m_Socket(socket),
+            m_NextClientId(0),
+            m_AccessUnitsSent(0),
+            m_PacketsSent(0),
+            m_PacketsDropped(0),
+            m_BytesSent(0),
+            m_SendCalls(0)
+        {
+        }
+
+        RtpFanout(const RtpFanout&) = delete;
+        RtpFanout& operator=(const RtpFanout&) = delete;
+
+        int32_t AddClient(const Net::Endpoint& endpoint, uint32_t ssrc, uint16_t sequence)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            Client client;
+            client.id = m_NextClientId++;
+            client.endpoint = endpoint;
+            client.ssrc = ssrc;
+            client.sequence = sequence;
+            m_Clients.push_back(client);
+            return client.id;
+        }
+
+        // Sends to a multicast group, with the given time to live. Fails if the address isn't a
+        // multicast one or the socket doesn't accept the TTL.
+        int32_t AddMulticastGroup(const Net::Endpoint& group, uint32_t ssrc, uint16_t sequence, int ttl)
+        {
+            if (!Net::IsMulticast(group) || !Net::SetMulticastTtl(m_Socket, group.address.ss_family, ttl))
+                return k_InvalidClient;
+
+            return AddClient(group, ssrc, sequence);
+        }
+
+        void RemoveClient(int32_t id)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (auto it = m_Clients.begin(); it != m_Clients.end(); ++it)
+            {
+                if (it->id == id)
+                {
+                    m_Clients.erase(it);
+                    return;
+                }
+            }
+        }
+
+        size_t GetClientCount() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Clients.size();
+        }
+
+        // The sequence number of the next packet sent to a client, for the RTP-Info of PLAY.
+        bool GetNextSequence(int32_t id, uint16_t& sequence) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (const auto& client : m_Clients)
+            {
+                if (client.id == id)
+                {
+                    sequence = client.sequence;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void Send(const RtpAccessUnit& accessUnit)
+        {
+            Send(accessUnit, [](int32_t, const uint8_t*, const uint8_t*, size_t) {});
+        }
+
+        // Sends an access unit to every client, then calls
+        // onSent(int32_t clientId, const uint8_t* header, const uint8_t* payload, size_t payloadSize)
+        // for each packet sent, to keep it for retransmission or protect it with FEC.
+        template<typename OnSent>
+        void Send(const RtpAccessUnit& accessUnit, OnSent&& onSent)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            const auto packetCount = accessUnit.packets.size();
+            const auto clientCount = m_Clients.size();
+            const auto count = packetCount * clientCount;
+            if (count == 0)
+                return;
+
+            // Only grows, to the largest access unit times the number of clients.
+            if (m_Headers.size() < count * Rtp::k_HeaderSize)
+            {
+                m_Headers.resize(count * Rtp::k_HeaderSize);
+                m_Buffers.resize(count * 2);
+                m_Datagrams.resize(count);
+            }
+
+            for (size_t p = 0; p < packetCount; ++p)
+            {
+                const auto& packet = accessUnit.packets[p];
+                for (size_t c = 0; c < clientCount; ++c)
+                {
+                    const auto& client = m_Clients[c];
+                    const auto index = p * clientCount + c;
+                    const auto header = m_Headers.data() + index * Rtp::k_HeaderSize;
+                    accessUnit.WriteHeader(packet, static_cast<uint16_t>(client.sequence + p), client.ssrc, header);
+
+                    auto buffers = m_Buffers.data() + index * 2;
+                    buffers[0] = Net::MakeBuffer(header, Rtp::k_HeaderSize);
+                    buffers[1] = Net::MakeBuffer(accessUnit.GetPayload(packet), packet.size);
+
+                    auto& datagram = m_Datagrams[index];
+                    datagram.endpoint = &client.endpoint;
+                    datagram.buffers = buffers;
+                    datagram.bufferCount = 2;
+                }
+            }
+
+            int error = 0;
+            const auto sent = Net::SendDatagrams(m_Socket, m_Datagrams.data(), count, error);
+
+            for (size_t index = 0; index < count; ++index)
+            {
+                if (!m_Datagrams[index].isSent)
+                    continue;
+
+                const auto& packet = accessUnit.packets[index / clientCount];
+                onSent(m_Clients[index % clientCount].id, m_Headers.data() + index * Rtp::k_HeaderSize, accessUnit.GetPayload(packet), static_cast<size_t>(packet.size));
+                m_BytesSent += Rtp::k_HeaderSize + packet.size;
+            }
+
+            for (auto& client : m_Clients)
+            {
+                client.sequence = static_cast<uint16_t>(client.sequence + packetCount);
+            }
+
+            ++m_AccessUnitsSent;
+            ++m_SendCalls;
+            m_PacketsSent += sent;
+            m_PacketsDropped += count - sent;
+        }
+
+        void GetStats(RtpFanoutStats& stats) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            stats.accessUnitsSent = m_AccessUnitsSent;
+            stats.packetsSent = m_PacketsSent;
+            stats.packetsDropped = m_PacketsDropped;
+            stats.bytesSent = m_BytesSent;
+            stats.sendCalls = m_SendCalls;
+        }
+
+    private:
+        struct Client
+        {
+            int32_t       id;
+            Net::Endpoint endpoint;
+            uint32_t      ssrc;
+            uint16_t      sequence; // Of the next packet.
+        };
+
+        const Net::SocketHandle m_Socket;
+
+        mutable std::mutex  m_Mutex;
+        std::vector<Client> m_Clients;
+        int32_t             m_NextClientId;
+
+        // Gather lists of the last send, reused.
+        std::vector<uint8_t>       m_Headers;
+        std::vector<Net::Buffer>   m_Buffers;
+        std::vector<Net::Datagram> m_Datagrams;
+
+        uint64_t m_AccessUnitsSent;
+        uint64_t m_PacketsSent;
+        uint64_t m_PacketsDropped;
+        uint64_t m_BytesSent;
+        uint64_t m_SendCalls;
+    };
+}
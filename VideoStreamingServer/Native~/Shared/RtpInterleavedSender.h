@@ -0,0 +1,484 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "EncodeFrameContext.h"
+#include "EncoderBuffering.h"
+#include "H264RtpPacketizer.h"
+#include "RtpPacket.h"
+#include "Socket.h"
+
+namespace LiveCaptureNative
+{
+    struct RtpInterleavedStats
+    {
+        uint64_t accessUnitsSent;    // Written or queued.
+        uint64_t accessUnitsDropped; // By the backpressure policy, or skipped to the next key frame.
+        uint64_t bytesSent;
+        uint64_t writeCalls;         // Calls to SendStream(), one per gather list.
+        uint64_t blockedNs;          // Time the Block policy waited for the socket.
+        uint64_t keyFrameRequests;
+        uint64_t queuedBytes;        // Not written yet.
+        uint64_t maxQueuedBytes;
+    };
+
+    enum class RtpInterleavedResult
+    {
+        Sent,         // Written to the socket.
+        Queued,       // Partly written, the rest waits for the socket: call Flush() when it is writable.
+        Dropped,      // By the backpressure policy.
+        Disconnected, // The connection failed, the socket should be closed.
+    };
+
+    // Sends RTP and RTCP over the TCP connection of an RTSP session (RFC 2326 section 10.12,
+    // "interleaved" transport), for the clients that can't receive UDP. Each packet is framed
+    // with '$', the channel and its 16-bit length:
+    //
+    //   | '$' | channel | length (16) | RTP header (12) | payload ... |
+    //
+    // The frame header and the RTP header of each packet are written side by side in a small
+    // buffer and the payloads are shared with the other clients of the access unit (RtpFanout):
+    // an access unit is a gather list of two entries per packet, written with writev() in one
+    // or a few calls.
+    //
+    // The socket is non-blocking. When its send buffer is full the rest of the access unit is
+    // kept, and completed before anything else is written, since the framing can't be cut. At
+    // most maxQueuedAccessUnits wait that way; past it the encoder backpressure policy applies,
+    // the same way as in EncodedFrameQueue:
+    //   - Block waits for the socket up to k_BackpressureTimeoutNs, then drops the access unit;
+    //   - DropNewest drops the access unit;
+    //   - DropOldest discards the queued access units not started yet, to send the latest one;
+    //   - DropToKeyFrame drops the access unit and the following ones until a key frame, which
+    //     is requested from the encoder through ConsumeKeyFrameRequest().
+    // The send buffer is the only buffering, so a slow client adds at most a few frames of
+    // latency instead of an unbounded queue.
+    //
+    // RTSP replies and RTCP packets share the connection and go through the same queue, they
+    // are never dropped. The sender thread calls Send(), the RTSP thread Flush() and SendData().
+    class RtpInterleavedSender final
+    {
+    public:
+        static const int32_t k_DefaultMaxQueuedAccessUnits = 2;
+        static const int32_t k_MaxQueuedAccessUnits = 16;
+        static const size_t  k_FrameHeaderSize = 4;
+
+        // Largest RTP packet the 16-bit frame length can carry.
+        static const size_t k_MaxPacketSize = 0xffff;
+
+        // The socket is owned by the caller and must outlive the sender. The RTCP packets are
+        // sent on rtpChannel + 1, as negotiated in the Transport header of SETUP.
+        RtpInterleavedSender(Net::SocketHandle socket,
+                             uint8_t rtpChannel,
+                             uint32_t ssrc,
+                             uint16_t sequence,
+                             BackpressurePolicy policy,
+                             int32_t maxQueuedAccessUnits = 0) :
+            m_Socket(socket),
+            m_RtpChannel(rtpChannel),
+            m_Ssrc(ssrc),
+            m_Sequence(sequence),
+            m_Policy(policy),
+            m_MaxQueuedAccessUnits(0),
+            m_Head(0),
+            m_Count(0),
+            m_QueuedAccessUnits(0),
+            m_IsSkippingToKeyFrame(false),
+            m_IsKeyFrameRequested(false),
+            m_IsDisconnected(false),
+            m_AccessUnitsSent(0),
+            m_AccessUnitsDropped(0),
+            m_BytesSent(0),
+            m_WriteCalls(0),
+            m_BlockedNs(0),
+            m_KeyFrameRequests(0),
+            m_QueuedBytes(0),
+            m_MaxQueuedBytes(0)
+        {
+            const auto clamp = [](int32_t value, int32_t min, int32_t max)
+            {
+                return (value < min) ? min : (value > max) ? max : value;
+            };
+
+            m_MaxQueuedAccessUnits = static_cast<size_t>(clamp((maxQueuedAccessUnits > 0) ? maxQueuedAccessUnits : k_DefaultMaxQueuedAccessUnits,
+                                                               1,
+                                                               k_MaxQueuedAccessUnits));
+            m_Entries.resize(m_MaxQueuedAccessUnits + k_MaxControlEntries);
+            m_Buffers.resize(Net::k_MaxStreamBuffers);
+        }
+
+        RtpInterleavedSender(const RtpInterleavedSender&) = delete;
+        RtpInterleavedSender& operator=(const RtpInterleavedSender&) = delete;
+
+        // Sends an access unit, after what is queued. The sequence numbers only advance for the
+        // access units sent: the connection is reliable, a gap would read as a loss.
+        RtpInterleavedResult Send(const RtpAccessUnitRef& accessUnit)
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+
+            if (!WriteQueued())
+                return RtpInterleavedResult::Disconnected;
+            if (accessUnit == nullptr)
+                return GetResult();
+
+            if (m_IsSkippingToKeyFrame)
+            {
+                if (!accessUnit->isKeyFrame)
+                {
+                    ++m_AccessUnitsDropped;
+                    return RtpInterleavedResult::Dropped;
+                }
+                m_IsSkippingToKeyFrame = false;
+            }
+
+            if (IsFull() && m_Policy == BackpressurePolicy::Block)
+            {
+                const auto start = GetEncodeClockNs();
+                const auto deadline = start + k_BackpressureTimeoutNs;
+                for (auto now = start; IsFull() && now < deadline; now = GetEncodeClockNs())
+                {
+                    // The RTSP thread may flush or reply meanwhile.
+                    lock.unlock();
+                    Net::WaitWritable(m_Socket, static_cast<int>((deadline - now + 999999) / 1000000));
+                    lock.lock();
+
+                    if (!WriteQueued())
+                        return RtpInterleavedResult::Disconnected;
+                }
+                m_BlockedNs += GetEncodeClockNs() - start;
+            }
+
+            if (IsFull() && m_Policy == BackpressurePolicy::DropOldest)
+                DiscardPendingAccessUnits();
+
+            if (IsFull())
+            {
+                ++m_AccessUnitsDropped;
+
+                // The next access units reference the lost one: wait for a key frame, and ask for one now.
+                if (m_Policy == BackpressurePolicy::DropToKeyFrame)
+                {
+                    m_IsSkippingToKeyFrame = true;
+                    m_IsKeyFrameRequested.store(true, std::memory_order_relaxed);
+                    ++m_KeyFrameRequests;
+                }
+                return RtpInterleavedResult::Dropped;
+            }
+
+            for (const auto& packet : accessUnit->packets)
+            {
+                if (Rtp::k_HeaderSize + packet.size > k_MaxPacketSize)
+                {
+                    ++m_AccessUnitsDropped;
+                    return RtpInterleavedResult::Dropped;
+                }
+            }
+
+            auto& entry = PushEntry();
+            entry.accessUnit = accessUnit;
+            entry.bytes.resize(accessUnit->packets.size() * k_PacketHeaderSize);
+            entry.size = 0;
+
+            auto header = entry.bytes.data();
+            for (const auto& packet : accessUnit->packets)
+            {
+                WriteFrameHeader(m_RtpChannel, Rtp::k_HeaderSize + packet.size, header);
+                accessUnit->WriteHeader(packet, m_Sequence++, m_Ssrc, header + k_FrameHeaderSize);
+                header += k_PacketHeaderSize;
+                entry.size += k_PacketHeaderSize + packet.size;
+            }
+
+            ++m_QueuedAccessUnits;
+            ++m_AccessUnitsSent;
+            m_QueuedBytes += entry.size;
+
+            if (!WriteQueued())
+                return RtpInterleavedResult::Disconnected;
+            return GetResult();
+        }
+
+        // Sends an RTCP packet (e.g. a sender report) on the control channel.
+        RtpInterleavedResult SendRtcp(const uint8_t* packet, size_t size)
+        {
+            if (packet == nullptr || size == 0 || size > k_MaxPacketSize)
+                return RtpInterleavedResult::Dropped;
+
+            uint8_t header[k_FrameHeaderSize];
+            WriteFrameHeader(static_cast<uint8_t>(m_RtpChannel + 1), size, header);
+            return SendData(header, sizeof(header), packet, size);
+        }
+
+        // Sends bytes as they are, e.g. an RTSP reply, between two access units. They are copied.
+        RtpInterleavedResult SendData(const uint8_t* data, size_t size)
+        {
+            return SendData(data, size, nullptr, 0);
+        }
+
+        // Writes what is queued, from the RTSP thread once the socket is writable again.
+        RtpInterleavedResult Flush()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (!WriteQueued())
+                return RtpInterleavedResult::Disconnected;
+            return GetResult();
+        }
+
+        // Something waits for the socket: the RTSP thread should poll it for writing.
+        bool HasQueued() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Count > 0;
+        }
+
+        // The next RTP sequence number, for the RTP-Info of PLAY.
+        uint16_t GetNextSequence() const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Sequence;
+        }
+
+        // Submit thread: true once after an access unit was dropped with DropToKeyFrame, the
+        // encoder should produce a key frame.
+        bool ConsumeKeyFrameRequest()
+        {
+            return m_IsKeyFrameRequested.exchange(false, std::memory_order_relaxed);
+        }
+
+        void GetStats(RtpInterleavedStats& stats) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            stats.accessUnitsSent = m_AccessUnitsSent;
+            stats.accessUnitsDropped = m_AccessUnitsDropped;
+            stats.bytesSent = m_BytesSent;
+            stats.writeCalls = m_WriteCalls;
+            stats.blockedNs = m_BlockedNs;
+            stats.keyFrameRequests = m_KeyFrameRequests;
+            stats.queuedBytes = m_QueuedBytes;
+            stats.maxQueuedBytes = m_MaxQueuedBytes;
+        }
+
+    private:
+        // Replies and RTCP packets queued at once, past it the connection is considered stalled.
+        static const size_t k_MaxControlEntries = 16;
+
+        // Frame header, then RTP header.
+        static const size_t k_PacketHeaderSize = k_FrameHeaderSize + Rtp::k_HeaderSize;
+
+        // An access unit, or control bytes when accessUnit is null.
+        struct Entry
+        {
+            RtpAccessUnitRef     accessUnit;
+            std::vector<uint8_t> bytes;   // The packet headers of an access unit, or the control bytes.
+            size_t               size;    // Bytes to write.
+            size_t               written;
+        };
+
+        static void WriteFrameHeader(uint8_t channel, size_t size, uint8_t* header)
+        {
+            header[0] = '$';
+            header[1] = channel;
+            Rtp::WriteUInt16(header + 2, static_cast<uint16_t>(size));
+        }
+
+        RtpInterleavedResult SendData(const uint8_t* data, size_t size, const uint8_t* data2, size_t size2)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (!WriteQueued())
+                return RtpInterleavedResult::Disconnected;
+            if (m_Count - m_QueuedAccessUnits >= k_MaxControlEntries)
+            {
+                m_IsDisconnected = true;
+                return RtpInterleavedResult::Disconnected;
+            }
+
+            auto& entry = PushEntry();
+            entry.accessUnit = nullptr;
+            entry.bytes.assign(data, data + size);
+            entry.bytes.insert(entry.bytes.end(), data2, data2 + size2);
+            entry.size = entry.bytes.size();
+            m_QueuedBytes += entry.size;
+
+            if (!WriteQueued())
+                return RtpInterleavedResult::Disconnected;
+            return GetResult();
+        }
+
+        inline bool IsFull() const { return m_QueuedAccessUnits >= m_MaxQueuedAccessUnits; }
+        inline Entry& GetEntry(size_t index) { return m_Entries[(m_Head + index) % m_Entries.size()]; }
+
+        inline RtpInterleavedResult GetResult() const
+        {
+            return (m_Count > 0) ? RtpInterleavedResult::Queued : RtpInterleavedResult::Sent;
+        }
+
+        Entry& PushEntry()
+        {
+            auto& entry = GetEntry(m_Count++);
+            entry.written = 0;
+            return entry;
+        }
+
+        void PopEntry()
+        {
+            auto& entry = m_Entries[m_Head];
+            if (entry.accessUnit != nullptr)
+            {
+                entry.accessUnit = nullptr;
+                --m_QueuedAccessUnits;
+            }
+            m_Head = (m_Head + 1) % m_Entries.size();
+            --m_Count;
+        }
+
+        // DropOldest: the queued access units nothing was written of yet, the control bytes are kept.
+        // They are the last ones numbered, so their sequence numbers are reused.
+        void DiscardPendingAccessUnits()
+        {
+            size_t kept = 0;
+            for (size_t i = 0; i < m_Count; ++i)
+            {
+                auto& entry = GetEntry(i);
+                if (entry.accessUnit != nullptr && entry.written == 0)
+                {
+                    ++m_AccessUnitsDropped;
+                    --m_QueuedAccessUnits;
+                    m_QueuedBytes -= entry.size;
+                    m_Sequence = static_cast<uint16_t>(m_Sequence - entry.accessUnit->packets.size());
+                    entry.accessUnit = nullptr;
+                    continue;
+                }
+
+                if (kept != i)
+                    std::swap(GetEntry(kept), entry);
+                ++kept;
+            }
+            m_Count = kept;
+        }
+
+        // Fills the gather list from the queued bytes, starting where the last write stopped.
+        size_t GatherQueued()
+        {
+            size_t count = 0;
+            const auto add = [this, &count](const void* data, size_t size)
+            {
+                m_Buffers[count++] = Net::MakeBuffer(data, size);
+            };
+
+            for (size_t i = 0; i < m_Count && count < m_Buffers.size(); ++i)
+            {
+                const auto& entry = GetEntry(i);
+                auto skip = entry.written;
+
+                if (entry.accessUnit == nullptr)
+                {
+                    add(entry.bytes.data() + skip, entry.size - skip);
+                    continue;
+                }
+
+                const auto& accessUnit = *entry.accessUnit;
+                auto header = entry.bytes.data();
+                for (const auto& packet : accessUnit.packets)
+                {
+                    // The entries after an access unit only follow its last packet.
+                    if (count + 2 > m_Buffers.size())
+                        return count;
+
+                    if (skip < k_PacketHeaderSize)
+                    {
+                        add(header + skip, k_PacketHeaderSize - skip);
+                        add(accessUnit.GetPayload(packet), packet.size);
+                        skip = 0;
+                    }
+                    else if (skip < k_PacketHeaderSize + packet.size)
+                    {
+                        skip -= k_PacketHeaderSize;
+                        add(accessUnit.GetPayload(packet) + skip, packet.size - skip);
+                        skip = 0;
+                    }
+                    else
+                    {
+                        skip -= k_PacketHeaderSize + packet.size;
+                    }
+                    header += k_PacketHeaderSize;
+                }
+            }
+            return count;
+        }
+
+        // Writes until the queue is empty or the socket buffer is full. Returns false once the
+        // connection failed.
+        bool WriteQueued()
+        {
+            if (m_IsDisconnected)
+                return false;
+
+            while (m_Count > 0)
+            {
+                const auto count = GatherQueued();
+
+                size_t written = 0;
+                int error = 0;
+                const auto isConnected = Net::SendStream(m_Socket, m_Buffers.data(), count, written, error);
+                ++m_WriteCalls;
+                if (!isConnected)
+                {
+                    m_IsDisconnected = true;
+                    return false;
+                }
+                if (written == 0)
+                    break;
+
+                m_BytesSent += written;
+                m_QueuedBytes -= written;
+                while (written > 0)
+                {
+                    auto& entry = m_Entries[m_Head];
+                    const auto remaining = entry.size - entry.written;
+                    if (written < remaining)
+                    {
+                        entry.written += written;
+                        break;
+                    }
+                    written -= remaining;
+                    PopEntry();
+                }
+            }
+
+            if (m_QueuedBytes > m_MaxQueuedBytes)
+                m_MaxQueuedBytes = m_QueuedBytes;
+            return true;
+        }
+
+        const Net::SocketHandle  m_Socket;
+        const uint8_t            m_RtpChannel;
+        const uint32_t           m_Ssrc;
+        uint16_t                 m_Sequence; // Of the next packet.
+        const BackpressurePolicy m_Policy;
+        size_t                   m_MaxQueuedAccessUnits;
+
+        mutable std::mutex       m_Mutex;
+        std::vector<Entry>       m_Entries; // Ring, from m_Head. The buffers are reused.
+        size_t                   m_Head;
+        size_t                   m_Count;
+        size_t                   m_QueuedAccessUnits;
+        std::vector<Net::Buffer> m_Buffers;
+
+        bool              m_IsSkippingToKeyFrame;
+        std::atomic<bool> m_IsKeyFrameRequested;
+        bool              m_IsDisconnected;
+
+        uint64_t m_AccessUnitsSent;
+        uint64_t m_AccessUnitsDropped;
+        uint64_t m_BytesSent;
+        uint64_t m_WriteCalls;
+        uint64_t m_BlockedNs;
+        uint64_t m_KeyFrameRequests;
+        uint64_t m_QueuedBytes;
+        uint64_t m_MaxQueuedBytes;
+    };
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace LiveCaptureNative
+{
+    // Fixed RTP header (RFC 3550 section 5.1), the layout written by the packetizer of the
+    // server: no CSRC and no extension, so the payload always starts at k_HeaderSize.
+    //
+    //    0                   1                   2                   3
+    //   |V=2|P|X|  CC   |M|     PT      |       sequence number         |
+    //   |                           timestamp                           |
+    //   |                             SSRC                              |
+    namespace Rtp
+    {
+        const size_t  k_HeaderSize = 12;
+        const uint8_t k_Version = 2;
+
+        // Largest RTP packet handled, the UDP payload limit rounded up.
+        const size_t k_MaxPacketSize = 64 * 1024;
+
+        inline uint16_t ReadUInt16(const uint8_t* data)
+        {
+            return static_cast<uint16_t>((data[0] << 8) | data[1]);
+        }
+
+        inline uint32_t ReadUInt32(const uint8_t* data)
+        {
+            return (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+                (static_cast<uint32_t>(data[2]) << 8) | data[3];
+        }
+
+        inline void WriteUInt16(uint8_t* data, uint16_t value)
+        {
+            data[0] = static_cast<uint8_t>(value >> 8);
+            data[1] = static_cast<uint8_t>(value);
+        }
+
+        inline void WriteUInt32(uint8_t* data, uint32_t value)
+        {
+            data[0] = static_cast<uint8_t>(value >> 24);
+            data[1] = static_cast<uint8_t>(value >> 16);
+            data[2] = static_cast<uint8_t>(value >> 8);
+            data[3] = static_cast<uint8_t>(value);
+        }
+
+        inline bool IsValidPacket(const uint8_t* packet, size_t size)
+        {
+            return packet != nullptr && size >= k_HeaderSize && size <= k_MaxPacketSize && (packet[0] >> 6) == k_Version;
+        }
+
+        inline bool GetMarker(const uint8_t* packet) { return (packet[1] & 0x80) != 0; }
+        inline uint8_t GetPayloadType(const uint8_t* packet) { return packet[1] & 0x7f; }
+        inline uint16_t GetSequenceNumber(const uint8_t* packet) { return ReadUInt16(packet + 2); }
+        inline uint32_t GetTimestamp(const uint8_t* packet) { return ReadUInt32(packet + 4); }
+        inline uint32_t GetSsrc(const uint8_t* packet) { return ReadUInt32(packet + 8); }
+
+        inline void SetSequenceNumber(uint8_t* packet, uint16_t sequence) { WriteUInt16(packet + 2, sequence); }
+        inline void SetSsrc(uint8_t* packet, uint32_t ssrc) { WriteUInt32(packet + 8, ssrc); }
+
+        // Signed distance from a to b in the 16-bit sequence space, positive when b is newer.
+        inline int32_t SequenceDelta(uint16_t a, uint16_t b)
+        {
+            return static_cast<int16_t>(static_cast<uint16_t>(b - a));
+        }
+    }
+}
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "Rtcp.h"
+#include "RtpPacket.h"
+
+namespace LiveCaptureNative
+{
+    // Bounds of the retransmission history of an RTP stream. Zero fields select the defaults.
+    struct RtpRetransmissionSettings
+    {
+        int32_t capacityKB;    // Slab holding the sent packets, allocated once.
+        int32_t maxAgeMs;      // Older packets aren't retransmitted, the frame is late anyway.
+        int32_t maxPackets;    // Entries of the sequence number index, allocated once.
+        int32_t minIntervalMs; // A packet isn't retransmitted again within this interval.
+    };
+
+    struct RtpRetransmissionStats
+    {
+        uint64_t capacityBytes;
+        uint64_t packetsStored;
+        uint64_t bytesStored;
+        uint64_t packetsAdded;
+        uint64_t packetsRequested;     // Sequence numbers reported lost by the NACKs of the client.
+        uint64_t packetsRetransmitted;
+        uint64_t packetsSuppressed;    // Requested again within minIntervalMs, or too many times.
+        uint64_t packetsUnavailable;   // Evicted, expired, or never sent.
+    };
+
+    enum class RtpRetransmitResult
+    {
+        Retransmit,
+        Suppressed,
+        Unavailable,
+    };
+
+    // History of the RTP packets sent to a client, to serve the generic NACKs (RFC 4585) it sends
+    // on the control port when packets are lost. The lost packets are sent again as they were,
+    // with their original sequence number, which receivers without RFC 4588 support reorder like
+    // any late packet.
+    //
+    // The packets are copied into a slab allocated once and used as a ring, the end is skipped
+    // when a packet doesn't fit. The index is a ring of entries addressed by the extended sequence
+    // number, so a lookup is a subtraction. Room is made by evicting the oldest packets, which are
+    // also dropped past maxAgeMs. Memory use doesn't depend on the bitrate: at high bitrates the
+    // history is simply shorter.
+    //
+    // The sender thread adds the packets after sending them, the thread reading the control port
+    // handles the feedback. The mutex is held to copy a packet in or out, never while sending.
+    class RtpRetransmissionBuffer final
+    {
+    public:
+        static const int32_t k_DefaultCapacityKB = 4 * 1024;
+        static const int32_t k_MaxCapacityKB = 256 * 1024;
+        static const int32_t k_DefaultMaxAgeMs = 1000;
+        static const int32_t k_DefaultMaxPackets = 4096;
+        static const int32_t k_MaxPackets = 16 * 1024; // Below half the sequence space, so lookups are unambiguous.
+        static const int32_t k_DefaultMinIntervalMs = 20;
+        static const uint32_t k_MaxRetransmissions = 4;
+
+        explicit RtpRetransmissionBuffer(const RtpRetransmissionSettings& settings) :
+            m_MaxAgeNs(0),
+            m_MinIntervalNs(0),
+            m_Head(0),
+            m_Tail(0),
+            m_LastSequence(0),
+            m_HasSequence(false),
+            m_WriteOffset(0),
+            m_BytesStored(0),
+            m_PacketsAdded(0),
+            m_PacketsRequested(0),
+            m_PacketsRetransmitted(0),
+            m_PacketsSuppressed(0),
+            m_PacketsUnavailable(0)
+        {
+            const auto clamp = [](int32_t value, int32_t defaultValue, int32_t max)
+            {
+                return (value <= 0) ? defaultValue : (value > max) ? max : value;
+            };
+
+            const auto capacityKB = clamp(settings.capacityKB, k_DefaultCapacityKB, k_MaxCapacityKB);
+            const auto maxPackets = clamp(settings.maxPackets, k_DefaultMaxPackets, k_MaxPackets);
+            const auto maxAgeMs = (settings.maxAgeMs > 0) ? settings.maxAgeMs : k_DefaultMaxAgeMs;
+            const auto minIntervalMs = (settings.minIntervalMs > 0) ? settings.minIntervalMs : k_DefaultMinIntervalMs;
+
+            m_Slab.resize(static_cast<size_t>(capacityKB) * 1024);
+            m_Entries.resize(static_cast<size_t>(maxPackets));
+            m_MaxAgeNs = static_cast<uint64_t>(maxAgeMs) * 1000000ull;
+            m_MinIntervalNs = static_cast<uint64_t>(minIntervalMs) * 1000000ull;
+            m_Scratch.resize(Rtp::k_MaxPacketSize);
+        }
+
+        RtpRetransmissionBuffer(const RtpRetransmissionBuffer&) = delete;
+        RtpRetransmissionBuffer& operator=(const RtpRetransmissionBuffer&) = delete;
+
+        // Sender: copies a packet once sent. Sequence numbers must increase, a gap of lost sends is
+        // allowed. Returns false if the packet isn't kept: malformed, out of order, or too large.
+        bool Add(const uint8_t* packet, size_t size, uint64_t nowNs)
+        {
+            if (!Rtp::IsValidPacket(packet, size) || size > m_Slab.size())
+                return false;
+
+            const auto sequence = Rtp::GetSequenceNumber(packet);
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            uint64_t index;
+            if (!m_HasSequence)
+            {
+                // Extended sequence numbers start past the first cycle, so m_Head - 1 never wraps.
+                index = 0x10000ull + sequence;
+                m_Head = m_Tail = index;
+            }
+            else
+            {
+                const auto delta = Rtp::SequenceDelta(m_LastSequence, sequence);
+                if (delta <= 0)
+                    return false;
+
+                index = m_Head - 1 + static_cast<uint64_t>(delta);
+                if (index - m_Tail >= m_Entries.size())
+                {
+                    // The jump is larger than the history, nothing stored is reachable anymore.
+                    EvictAll(index);
+                }
+            }
+
+            // The skipped sequence numbers were never sent.
+            for (; m_Head < index; ++m_Head)
+            {
+                if (m_Head - m_Tail == m_Entries.size())
+                    EvictOldest();
+                GetEntry(m_Head).isStored = false;
+            }
+            if (!IsEmpty() && !GetEntry(m_Tail).isStored)
+                m_Tail = m_Head;
+
+            while (!IsEmpty() && (m_Head - m_Tail == m_Entries.size() || IsExpired(GetEntry(m_Tail), nowNs)))
+            {
+                EvictOldest();
+            }
+
+            size_t offset = 0;
+            while (!FindSpace(size, offset))
+            {
+                EvictOldest();
+            }
+
+            std::memcpy(m_Slab.data() + offset, packet, size);
+
+            auto& entry = GetEntry(index);
+            entry.offset = offset;
+            entry.size = static_cast<uint32_t>(size);
+            entry.retransmissions = 0;
+            entry.sentNs = nowNs;
+            entry.lastRetransmitNs = 0;
+            entry.isStored = true;
+
+            m_Head = index + 1;
+            m_LastSequence = sequence;
+            m_HasSequence = true;
+            m_WriteOffset = offset + size;
+            m_BytesStored += size;
+            ++m_PacketsAdded;
+            return true;
+        }
+
+        // Copies a packet to retransmit into out, and counts the retransmission.
+        RtpRetransmitResult Retransmit(uint16_t sequence, uint64_t nowNs, uint8_t* out, size_t capacity, size_t& size)
+        {
+            size = 0;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            ++m_PacketsRequested;
+
+            const auto delta = Rtp::SequenceDelta(m_LastSequence, sequence);
+            const auto index = m_Head - 1 + static_cast<uint64_t>(static_cast<int64_t>(delta));
+            if (IsEmpty() || delta > 0 || index < m_Tail)
+                return Unavailable();
+
+            auto& entry = GetEntry(index);
+            if (!entry.isStored || IsExpired(entry, nowNs) || entry.size > capacity || out == nullptr)
+                return Unavailable();
+
+            if (entry.retransmissions >= k_MaxRetransmissions ||
+                (entry.lastRetransmitNs != 0 && nowNs - entry.lastRetransmitNs < m_MinIntervalNs))
+            {
+                ++m_PacketsSuppressed;
+                return RtpRetransmitResult::Suppressed;
+            }
+
+            std::memcpy(out, m_Slab.data() + entry.offset, entry.size);
+            size = entry.size;
+            ++entry.retransmissions;
+            entry.lastRetransmitNs = nowNs;
+            ++m_PacketsRetransmitted;
+            return RtpRetransmitResult::Retransmit;
+        }
+
+        // Feedback thread: serves the generic NACKs for ssrc in an RTCP compound packet, calling
+        // send(const uint8_t* packet, size_t size) for each packet to retransmit, without holding
+        // the mutex. Returns the number of packets retransmitted. Not reentrant, the scratch buffers
+        // are shared.
+        template<typename Send>
+        size_t HandleRtcp(const uint8_t* rtcp, size_t size, uint32_t ssrc, uint64_t nowNs, Send&& send)
+        {
+            m_Nacked.clear();
+            Rtcp::ForEachNackedSequence(rtcp, size, [this, ssrc](uint32_t mediaSsrc, uint16_t sequence)
+            {
+                if (mediaSsrc == ssrc)
+                    m_Nacked.push_back(sequence);
+            });
+
+            size_t retransmitted = 0;
+            for (const auto sequence : m_Nacked)
+            {
+                size_t packetSize = 0;
+                if (Retransmit(sequence, nowNs, m_Scratch.data(), m_Scratch.size(), packetSize) == RtpRetransmitResult::Retransmit)
+                {
+                    send(static_cast<const uint8_t*>(m_Scratch.data()), packetSize);
+                    ++retransmitted;
+                }
+            }
+            return retransmitted;
+        }
+
+        // Forgets the packets, when the sequence numbers of the stream restart.
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            EvictAll(m_Head);
+            m_HasSequence = false;
+        }
+
+        void GetStats(RtpRetransmissionStats& stats) const
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            stats.capacityBytes = m_Slab.size();
+            stats.packetsStored = 0;
+            for (auto index = m_Tail; index < m_Head; ++index)
+            {
+                stats.packetsStored += GetEntry(index).isStored ? 1 : 0;
+            }
+            stats.bytesStored = m_BytesStored;
+            stats.packetsAdded = m_PacketsAdded;
+            stats.packetsRequested = m_PacketsRequested;
+            stats.packetsRetransmitted = m_PacketsRetransmitted;
+            stats.packetsSuppressed = m_PacketsSuppressed;
+            stats.packetsUnavailable = m_PacketsUnavailable;
+        }
+
+    private:
+        struct Entry
+        {
+            size_t   offset = 0;
+            uint32_t size = 0;
+            uint32_t retransmissions = 0;
+            uint64_t sentNs = 0;
+            uint64_t lastRetransmitNs = 0;
+            bool     isStored = false;
+        };
+
+        inline bool IsEmpty() const { return m_Head == m_Tail; }
+        inline Entry& GetEntry(uint64_t index) { return m_Entries[index % m_Entries.size()]; }
+        inline const Entry& GetEntry(uint64_t index) const { return m_Entries[index % m_Entries.size()]; }
+        inline bool IsExpired(const Entry& entry, uint64_t nowNs) const { return nowNs > entry.sentNs && nowNs - entry.sentNs > m_MaxAgeNs; }
+
+        RtpRetransmitResult Unavailable()
+        {
+            ++m_PacketsUnavailable;
+            return RtpRetransmitResult::Unavailable;
+        }
+
+        // Evicts the oldest packet, and the gaps after it so the tail is always a stored packet.
+        void EvictOldest()
+        {
+            if (IsEmpty())
+                return;
+
+            auto& entry = GetEntry(m_Tail);
+            if (entry.isStored)
+            {
+                m_BytesStored -= entry.size;
+                entry.isStored = false;
+            }
+
+            ++m_Tail;
+            while (!IsEmpty() && !GetEntry(m_Tail).isStored)
+            {
+                ++m_Tail;
+            }
+        }
+
+        void EvictAll(uint64_t index)
+        {
+            for (auto i = m_Tail; i < m_Head; ++i)
+            {
+                GetEntry(i).isStored = false;
+            }
+            m_Head = m_Tail = index;
+            m_BytesStored = 0;
+            m_WriteOffset = 0;
+        }
+
+        // Contiguous room for size bytes after the newest packet, or at the start of the slab.
+        bool FindSpace(size_t size, size_t& offset)
+        {
+            if (IsEmpty())
+            {
+                m_WriteOffset = 0;
+                offset = 0;
+                return true;
+            }
+
+            const auto tailOffset = GetEntry(m_Tail).offset;
+            if (m_WriteOffset > tailOffset)
+            {
+                // The packets are in [tailOffset, m_WriteOffset).
+                if (m_WriteOffset + size <= m_Slab.size())
+                {
+                    offset = m_WriteOffset;
+                    return true;
+                }
+                if (size <= tailOffset)
+                {
+                    offset = 0;
+                    return true;
+                }
+                return false;
+            }
+
+            // Wrapped: the packets are in [tailOffset, end) and [0, m_WriteOffset).
+            if (m_WriteOffset + size <= tailOffset)
+            {
+                offset = m_WriteOffset;
+                return true;
+            }
+            return false;
+        }
+
+        std::vector<uint8_t> m_Slab;
+        std::vector<Entry>   m_Entries;
+        uint64_t             m_MaxAgeNs;
+        uint64_t             m_MinIntervalNs;
+
+        mutable std::mutex m_Mutex;
+        uint64_t           m_Head; // Next extended sequence number.
+        uint64_t           m_Tail; // Oldest stored packet.
+        uint16_t           m_LastSequence;
+        bool               m_HasSequence;
+        size_t             m_WriteOffset;
+        size_t             m_BytesStored;
+        uint64_t           m_PacketsAdded;
+        uint64_t           m_PacketsRequested;
+        uint64_t           m_PacketsRetransmitted;
+        uint64_t           m_PacketsSuppressed;
+        uint64_t           m_PacketsUnavailable;
+
+        // Feedback thread only.
+        std::vector<uint16_t> m_Nacked;
+        std::vector<uint8_t>  m_Scratch;
+    };
+}
@@ -0,0 +1,315 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+namespace LiveCaptureNative
+{
+    // Thin layer over BSD sockets and Winsock for the native RTP senders: the handle type, the
+    // error codes they test, and the scatter/gather sends. The batched UDP send uses sendmmsg()
+    // on Linux, one sendmsg() per datagram on macOS and WSASendTo() on Windows; the stream send
+    // uses writev() and WSASend(). Every variant sends the gather lists as they are, nothing is
+    // copied.
+    namespace Net
+    {
+#if defined(_WIN32)
+        using SocketHandle = SOCKET;
+        using SocketLength = int;
+        const SocketHandle k_InvalidSocket = INVALID_SOCKET;
+
+        // A gather list entry, layout compatible with WSABUF.
+        struct Buffer
+        {
+            ULONG       size;
+            const char* data;
+        };
+
+        inline Buffer MakeBuffer(const void* data, size_t size) { return Buffer{ static_cast<ULONG>(size), static_cast<const char*>(data) }; }
+        inline int  GetLastError() { return WSAGetLastError(); }
+        inline bool IsWouldBlock(int error) { return error == WSAEWOULDBLOCK; }
+        inline bool IsInterrupted(int error) { return error == WSAEINTR; }
+        inline void Close(SocketHandle socket) { closesocket(socket); }
+
+        inline bool SetNonBlocking(SocketHandle socket)
+        {
+            u_long mode = 1;
+            return ioctlsocket(socket, FIONBIO, &mode) == 0;
+        }
+
+        inline int Poll(pollfd* fds, size_t count, int timeoutMs) { return WSAPoll(fds, static_cast<ULONG>(count), timeoutMs); }
+#else
+        using SocketHandle = int;
+        using SocketLength = socklen_t;
+        const SocketHandle k_InvalidSocket = -1;
+
+        // A gather list entry, layout compatible with iovec.
+        struct Buffer
+        {
+            const void* data;
+            size_t      size;
+        };
+
+        inline Buffer MakeBuffer(const void* data, size_t size) { return Buffer{ data, size }; }
+        inline int  GetLastError() { return errno; }
+        inline bool IsWouldBlock(int error) { return error == EAGAIN || error == EWOULDBLOCK; }
+        inline bool IsInterrupted(int error) { return error == EINTR; }
+        inline void Close(SocketHandle socket) { close(socket); }
+
+        inline bool SetNonBlocking(SocketHandle socket)
+        {
+            const auto flags = fcntl(socket, F_GETFL, 0);
+            return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+        }
+
+        inline int Poll(pollfd* fds, size_t count, int timeoutMs) { return poll(fds, static_cast<nfds_t>(count), timeoutMs); }
+#endif
+
+        // Sends the small writes of a TCP connection (RTSP replies, interleaved packets) right away.
+        inline bool SetNoDelay(SocketHandle socket)
+        {
+            const int value = 1;
+            return setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+        }
+
+        // Waits until a socket can be written to, up to timeoutMs. Returns false on timeout or error.
+        inline bool WaitWritable(SocketHandle socket, int timeoutMs)
+        {
+            pollfd fd;
+            fd.fd = socket;
+            fd.events = POLLOUT;
+            fd.revents = 0;
+            return Poll(&fd, 1, timeoutMs) > 0 && (fd.revents & POLLOUT) != 0;
+        }
+
+        struct Endpoint
+        {
+            sockaddr_storage address;
+            SocketLength     size;
+        };
+
+        // Numeric IPv4 or IPv6 address, no name resolution.
+        inline bool ParseEndpoint(const char* host, uint16_t port, Endpoint& endpoint)
+        {
+            std::memset(&endpoint, 0, sizeof(endpoint));
+
+            auto ipv4 = reinterpret_cast<sockaddr_in*>(&endpoint.address);
+            if (inet_pton(AF_INET, host, &ipv4->sin_addr) == 1)
+            {
+                ipv4->sin_family = AF_INET;
+                ipv4->sin_port = htons(port);
+                endpoint.size = sizeof(sockaddr_in);
+                return true;
+            }
+
+            auto ipv6 = reinterpret_cast<sockaddr_in6*>(&endpoint.address);
+            if (inet_pton(AF_INET6, host, &ipv6->sin6_addr) == 1)
+            {
+                ipv6->sin6_family = AF_INET6;
+                ipv6->sin6_port = htons(port);
+                endpoint.size = sizeof(sockaddr_in6);
+                return true;
+            }
+            return false;
+        }
+
+        inline bool IsMulticast(const Endpoint& endpoint)
+        {
+            if (endpoint.address.ss_family == AF_INET)
+            {
+                const auto address = ntohl(reinterpret_cast<const sockaddr_in*>(&endpoint.address)->sin_addr.s_addr);
+                return (address >> 28) == 0xe;
+            }
+            if (endpoint.address.ss_family == AF_INET6)
+                return reinterpret_cast<const sockaddr_in6*>(&endpoint.address)->sin6_addr.s6_addr[0] == 0xff;
+            return false;
+        }
+
+        // Time to live of the multicast datagrams sent by a socket, 1 keeps them on the local network.
+        inline bool SetMulticastTtl(SocketHandle socket, int family, int ttl)
+        {
+#if defined(_WIN32)
+            const DWORD value = static_cast<DWORD>(ttl);
+#else
+            const int value = ttl;
+#endif
+            if (family == AF_INET6)
+                return setsockopt(socket, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+            return setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+        }
+
+        // A datagram to send: a gather list and its destination.
+        struct Datagram
+        {
+            const Endpoint* endpoint;
+            Buffer*         buffers;
+            size_t          bufferCount;
+            bool            isSent; // Set by SendDatagrams().
+        };
+
+        // Sends datagrams, in as few system calls as the platform allows. Returns the number sent.
+        // A datagram failing with an error (unreachable destination, too large) is skipped and the
+        // following ones are still sent; all the datagrams left are dropped when the socket buffer
+        // is full (non-blocking socket). isSent tells which datagrams were sent, error is the last
+        // error met.
+        inline size_t SendDatagrams(SocketHandle socket, Datagram* datagrams, size_t count, int& error)
+        {
+            error = 0;
+            size_t sent = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                datagrams[i].isSent = false;
+            }
+
+#if defined(__linux__)
+            const size_t k_MaxBatch = 64;
+            mmsghdr messages[k_MaxBatch];
+            size_t next = 0;
+            while (next < count)
+            {
+                const auto batch = (count - next < k_MaxBatch) ? count - next : k_MaxBatch;
+                for (size_t i = 0; i < batch; ++i)
+                {
+                    const auto& datagram = datagrams[next + i];
+                    auto& header = messages[i].msg_hdr;
+                    std::memset(&messages[i], 0, sizeof(messages[i]));
+                    header.msg_name = const_cast<sockaddr_storage*>(&datagram.endpoint->address);
+                    header.msg_namelen = datagram.endpoint->size;
+                    header.msg_iov = reinterpret_cast<iovec*>(datagram.buffers);
+                    header.msg_iovlen = datagram.bufferCount;
+                }
+
+                // A short batch stopped at a datagram that failed: the next call reports its error.
+                const auto result = sendmmsg(socket, messages, static_cast<unsigned int>(batch), 0);
+                if (result < 0)
+                {
+                    const auto lastError = GetLastError();
+                    if (IsInterrupted(lastError))
+                        continue;
+                    error = lastError;
+                    if (IsWouldBlock(lastError))
+                        break;
+                    ++next;
+                    continue;
+                }
+
+                for (size_t i = 0; i < static_cast<size_t>(result); ++i)
+                {
+                    datagrams[next + i].isSent = true;
+                }
+                next += static_cast<size_t>(result);
+                sent += static_cast<size_t>(result);
+            }
+#elif defined(_WIN32)
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto& datagram = datagrams[i];
+                DWORD bytesSent = 0;
+                if (WSASendTo(socket,
+                              reinterpret_cast<WSABUF*>(datagram.buffers),
+                              static_cast<DWORD>(datagram.bufferCount),
+                              &bytesSent,
+                              0,
+                              reinterpret_cast<const sockaddr*>(&datagram.endpoint->address),
+                              datagram.endpoint->size,
+                              nullptr,
+                              nullptr) != 0)
+                {
+                    error = GetLastError();
+                    if (IsWouldBlock(error))
+                        break;
+                    continue;
+                }
+                datagram.isSent = true;
+                ++sent;
+            }
+#else
+            for (size_t i = 0; i < count;)
+            {
+                auto& datagram = datagrams[i];
+                msghdr header;
+                std::memset(&header, 0, sizeof(header));
+                header.msg_name = const_cast<sockaddr_storage*>(&datagram.endpoint->address);
+                header.msg_namelen = datagram.endpoint->size;
+                header.msg_iov = reinterpret_cast<iovec*>(datagram.buffers);
+                header.msg_iovlen = static_cast<int>(datagram.bufferCount);
+
+                if (sendmsg(socket, &header, 0) < 0)
+                {
+                    const auto lastError = GetLastError();
+                    if (IsInterrupted(lastError))
+                        continue;
+                    error = lastError;
+                    if (IsWouldBlock(lastError))
+                        break;
+                    ++i;
+                    continue;
+                }
+                datagram.isSent = true;
+                ++sent;
+                ++i;
+            }
+#endif
+            return sent;
+        }
+
+        // Largest gather list of a stream send, below the IOV_MAX of every platform.
+        const size_t k_MaxStreamBuffers = 512;
+
+        // Writes a gather list to a stream socket, up to k_MaxStreamBuffers entries. Returns the
+        // number of bytes written, possibly a part of the list on a non-blocking socket, and
+        // false on an error other than a full send buffer.
+        inline bool SendStream(SocketHandle socket, Buffer* buffers, size_t count, size_t& written, int& error)
+        {
+            written = 0;
+            error = 0;
+            if (count > k_MaxStreamBuffers)
+                count = k_MaxStreamBuffers;
+
+#if defined(_WIN32)
+            DWORD bytesSent = 0;
+            if (WSASend(socket, reinterpret_cast<WSABUF*>(buffers), static_cast<DWORD>(count), &bytesSent, 0, nullptr, nullptr) != 0)
+            {
+                error = GetLastError();
+                return IsWouldBlock(error);
+            }
+            written = bytesSent;
+            return true;
+#else
+            for (;;)
+            {
+                const auto result = writev(socket, reinterpret_cast<const iovec*>(buffers), static_cast<int>(count));
+                if (result >= 0)
+                {
+                    written = static_cast<size_t>(result);
+                    return true;
+                }
+
+                error = GetLastError();
+                if (!IsInterrupted(error))
+                    return IsWouldBlock(error);
+            }
+#endif
+        }
+    }
+}
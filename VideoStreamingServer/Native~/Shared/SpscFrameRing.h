@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace LiveCaptureNative
+{
+    // Bounded single-producer / single-consumer ring of encoded frames, shared by the encoder
+    // backends. The producer is the encoder output thread (VideoToolbox callback, NVENC async
+    // thread), the consumer is the Unity thread reading the frames through BeginConsume/EndConsume.
+    //
+    // Slots are preallocated and never destroyed while the ring lives: a slot is handed to the
+    // producer with its previous content, so vector members keep their capacity and act as slab
+    // storage. Once every slot has held a frame of the stream size, no more allocation happens.
+    //
+    // When the ring is full the new frame is dropped: the consumer may still be reading the
+    // oldest slot, so the producer can't reclaim it without a lock. The ring is full when it
+    // holds GetLimit() frames, Capacity unless lowered with SetLimit().
+    template <typename T, size_t Capacity> class SpscFrameRing final
+    {
+        static_assert(Capacity >= 2, "SpscFrameRing needs at least two slots.");
+
+    public:
+        SpscFrameRing() :
+            m_Head(0),
+            m_Tail(0),
+            m_Dropped(0),
+            m_Limit(Capacity)
+        {
+        }
+
+        SpscFrameRing(const SpscFrameRing&) = delete;
+        SpscFrameRing& operator=(const SpscFrameRing&) = delete;
+
+        // Producer: returns the slot to fill, or nullptr if the ring is full.
+        // The frame becomes visible to the consumer on Publish().
+        T* BeginWrite()
+        {
+            const auto tail = m_Tail.load(std::memory_order_relaxed);
+            if (tail - m_Head.load(std::memory_order_acquire) >= m_Limit.load(std::memory_order_relaxed))
+            {
+                m_Dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            return &m_Slots[tail % Capacity];
+        }
+
+        void Publish()
+        {
+            m_Tail.store(m_Tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Consumer: returns the oldest frame, or nullptr if the ring is empty.
+        // The pointer stays valid until Pop().
+        T* Front()
+        {
+            const auto head = m_Head.load(std::memory_order_relaxed);
+            if (head == m_Tail.load(std::memory_order_acquire))
+                return nullptr;
+
+            return &m_Slots[head % Capacity];
+        }
+
+        bool Pop()
+        {
+            const auto head = m_Head.load(std::memory_order_relaxed);
+            if (head == m_Tail.load(std::memory_order_acquire))
+                return false;
+
+            m_Head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Drops the queued frames, the slots keep their storage. Only call it when neither
+        // the producer nor the consumer is running (e.g. when the session is stopped).
+        void Clear()
+        {
+            m_Head.store(m_Tail.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        // Applies fn to every slot, e.g. to reserve the storage up front.
+        // Same threading restriction as Clear().
+        template <typename Fn> void ForEachSlot(Fn fn)
+        {
+            for (auto& slot : m_Slots)
+            {
+                fn(slot);
+            }
+        }
+
+        inline size_t GetSize() const
+        {
+            return static_cast<size_t>(m_Tail.load(std::memory_order_acquire) - m_Head.load(std::memory_order_acquire));
+        }
+
+        inline uint64_t GetDroppedCount() const { return m_Dropped.load(std::memory_order_relaxed); }
+
+        // Number of frames the ring holds before dropping, clamped to [1, Capacity]. Frames already
+        // queued above a lowered limit stay until consumed.
+        void SetLimit(size_t limit)
+        {
+            m_Limit.store((limit < 1) ? 1 : (limit > Capacity) ? Capacity : limit, std::memory_order_relaxed);
+        }
+
+        inline size_t GetLimit() const { return m_Limit.load(std::memory_order_relaxed); }
+
+        static constexpr size_t GetCapacity() { return Capacity; }
+
+    private:
+        // Keep the indices on separate cache lines, each one is written by a single thread.
+        // Padded rather than aligned: the owners are allocated with new, which doesn't honor
+        // over-aligned types before C++17.
+        static const size_t k_CacheLineSize = 64;
+
+        std::atomic<uint64_t> m_Head;
+        char                  m_HeadPadding[k_CacheLineSize - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> m_Tail;
+        char                  m_TailPadding[k_CacheLineSize - sizeof(std::atomic<uint64_t>)];
+        std::atomic<uint64_t> m_Dropped;
+        std::atomic<size_t>   m_Limit;
+
+        T m_Slots[Capacity];
+    };
+}
@@ -0,0 +1,486 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "AnnexBConverter.h"
+#include "FrameTimecode.h"
+
+namespace LiveCaptureNative
+{
+    // SEI NAL unit stamping each encoded access unit with its capture timecode, so that recorded
+    // and streamed video can be aligned with the takes instead of guessing an offset:
+    //   - user_data_unregistered (payload type 5, H264 and HEVC): the Live Capture UUID followed
+    //     by the timecode, its frame rate, the frame sequence number and the capture timestamp;
+    //   - time_code (payload type 136, HEVC only): the timecode for tools reading the standard SEI.
+    //
+    // H264 pic_timing isn't written: its syntax depends on the HRD and pic_struct flags of the SPS
+    // VUI, which the hardware encoders choose. The user data carries the same information.
+    //
+    // Header-only and allocation-free apart from InsertMetadata(), which grows the caller's vector.
+    // The parser reads what the writer produces, for tests and for tools validating recordings.
+    namespace Sei
+    {
+        enum class Codec
+        {
+            H264,
+            Hevc,
+        };
+
+        struct FrameMetadata
+        {
+            FrameTimecode timecode;
+            uint64_t      sequence;  // Submission order, unique per encoder.
+            uint64_t      timestamp; // Capture time given by Unity, in nanoseconds.
+        };
+
+        // bbb6d3a7-babc-4af3-a86d-43f7eb41a57b, identifies the Live Capture user data.
+        const uint8_t k_MetadataUuid[16] = {
+            0xbb, 0xb6, 0xd3, 0xa7, 0xba, 0xbc, 0x4a, 0xf3, 0xa8, 0x6d, 0x43, 0xf7, 0xeb, 0x41, 0xa5, 0x7b
+        };
+        const uint8_t k_MetadataVersion = 1;
+
+        // UUID, version, flags, h/m/s, frames, subframe, resolution, rate, sequence, timestamp.
+        const size_t k_MetadataPayloadSize = 16 + 1 + 1 + 3 + 2 + 2 + 2 + 8 + 8 + 8;
+
+        // time_code with one full clock timestamp: 43 bits, padded to a byte.
+        const size_t k_TimeCodePayloadSize = 6;
+
+        // Largest NAL unit written by WriteMetadataNal(), start code and emulation prevention included.
+        const size_t k_MaxNalSize = 128;
+
+        const uint32_t k_PayloadTypeUserDataUnregistered = 5;
+        const uint32_t k_PayloadTypeTimeCode = 136;
+
+        const uint8_t k_MetadataFlagTimecode = 0x01;
+        const uint8_t k_MetadataFlagDropFrame = 0x02;
+
+        namespace Detail
+        {
+            const uint8_t k_H264SeiType = 6;
+            const uint8_t k_HevcPrefixSeiType = 39;
+            const uint8_t k_HevcSuffixSeiType = 40;
+
+            // Big-endian bit writer for the time_code payload.
+            class BitWriter final
+            {
+            public:
+                BitWriter(uint8_t* data, size_t size) :
+                    m_Data(data),
+                    m_BitPosition(0)
+                {
+                    std::memset(data, 0, size);
+                }
+
+                void Write(uint32_t value, int bitCount)
+                {
+                    for (int i = bitCount - 1; i >= 0; --i)
+                    {
+                        if ((value >> i) & 1)
+                            m_Data[m_BitPosition / 8] |= static_cast<uint8_t>(0x80 >> (m_BitPosition % 8));
+                        ++m_BitPosition;
+                    }
+                }
+
+                // payload_bit_equal_to_one and the zero bits up to the next byte.
+                void WriteTrailingBits()
+                {
+                    if (m_BitPosition % 8 == 0)
+                        return;
+
+                    Write(1, 1);
+                    m_BitPosition = (m_BitPosition + 7) & ~static_cast<size_t>(7);
+                }
+
+                size_t GetSize() const { return (m_BitPosition + 7) / 8; }
+
+            private:
+                uint8_t* m_Data;
+                size_t   m_BitPosition;
+            };
+
+            class BitReader final
+            {
+            public:
+                BitReader(const uint8_t* data, size_t size) :
+                    m_Data(data),
+                    m_BitCount(size * 8),
+                    m_BitPosition(0)
+                {
+                }
+
+                bool Read(int bitCount, uint32_t& value)
+                {
+                    if (m_BitPosition + bitCount > m_BitCount)
+                        return false;
+
+                    value = 0;
+                    for (int i = 0; i < bitCount; ++i, ++m_BitPosition)
+                    {
+                        value = (value << 1) | ((m_Data[m_BitPosition / 8] >> (7 - m_BitPosition % 8)) & 1);
+                    }
+                    return true;
+                }
+
+            private:
+                const uint8_t* m_Data;
+                size_t         m_BitCount;
+                size_t         m_BitPosition;
+            };
+
+            inline uint8_t* WriteBigEndian(uint8_t* data, uint64_t value, size_t size)
+            {
+                for (size_t i = 0; i < size; ++i)
+                {
+                    data[i] = static_cast<uint8_t>(value >> (8 * (size - 1 - i)));
+                }
+                return data + size;
+            }
+
+            inline uint64_t ReadBigEndian(const uint8_t* data, size_t size)
+            {
+                uint64_t value = 0;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    value = (value << 8) | data[i];
+                }
+                return value;
+            }
+
+            inline uint8_t ClampByte(int32_t value)
+            {
+                return static_cast<uint8_t>(value < 0 ? 0 : (value > 0xFF ? 0xFF : value));
+            }
+
+            inline uint16_t ClampShort(int32_t value)
+            {
+                return static_cast<uint16_t>(value < 0 ? 0 : (value > 0xFFFF ? 0xFFFF : value));
+            }
+
+            inline size_t WriteMetadataPayload(const FrameMetadata& metadata, uint8_t* payload)
+            {
+                const auto& timecode = metadata.timecode;
+                const bool hasTimecode = HasTimecode(timecode);
+
+                uint8_t flags = 0;
+                if (hasTimecode)
+                    flags |= k_MetadataFlagTimecode;
+                if (hasTimecode && timecode.isDropFrame != 0)
+                    flags |= k_MetadataFlagDropFrame;
+
+                auto p = payload;
+                std::memcpy(p, k_MetadataUuid, sizeof(k_MetadataUuid));
+                p += sizeof(k_MetadataUuid);
+                *p++ = k_MetadataVersion;
+                *p++ = flags;
+                *p++ = hasTimecode ? ClampByte(timecode.hours) : 0;
+                *p++ = hasTimecode ? ClampByte(timecode.minutes) : 0;
+                *p++ = hasTimecode ? ClampByte(timecode.seconds) : 0;
+                p = WriteBigEndian(p, hasTimecode ? ClampShort(timecode.frames) : 0, 2);
+                p = WriteBigEndian(p, hasTimecode ? ClampShort(timecode.subframe) : 0, 2);
+                p = WriteBigEndian(p, hasTimecode ? ClampShort(timecode.subframeResolution) : 0, 2);
+                p = WriteBigEndian(p, hasTimecode ? static_cast<uint32_t>(timecode.rateNumerator) : 0, 4);
+                p = WriteBigEndian(p, hasTimecode ? static_cast<uint32_t>(timecode.rateDenominator) : 0, 4);
+                p = WriteBigEndian(p, metadata.sequence, 8);
+                p = WriteBigEndian(p, metadata.timestamp, 8);
+                return static_cast<size_t>(p - payload);
+            }
+
+            inline bool ReadMetadataPayload(const uint8_t* payload, size_t size, FrameMetadata& metadata)
+            {
+                if (size < k_MetadataPayloadSize || std::memcmp(payload, k_MetadataUuid, sizeof(k_MetadataUuid)) != 0)
+                    return false;
+
+                // Later versions only append fields.
+                auto p = payload + sizeof(k_MetadataUuid);
+                if (*p++ < k_MetadataVersion)
+                    return false;
+
+                const uint8_t flags = *p++;
+                metadata = FrameMetadata();
+
+                auto& timecode = metadata.timecode;
+                timecode.hours = *p++;
+                timecode.minutes = *p++;
+                timecode.seconds = *p++;
+                timecode.frames = static_cast<int32_t>(ReadBigEndian(p, 2));
+                timecode.subframe = static_cast<int32_t>(ReadBigEndian(p + 2, 2));
+                timecode.subframeResolution = static_cast<int32_t>(ReadBigEndian(p + 4, 2));
+                timecode.rateNumerator = static_cast<int32_t>(ReadBigEndian(p + 6, 4));
+                timecode.rateDenominator = static_cast<int32_t>(ReadBigEndian(p + 10, 4));
+                timecode.isDropFrame = (flags & k_MetadataFlagDropFrame) != 0 ? 1 : 0;
+                p += 14;
+
+                if ((flags & k_MetadataFlagTimecode) == 0)
+                    metadata.timecode = FrameTimecode();
+
+                metadata.sequence = ReadBigEndian(p, 8);
+                metadata.timestamp = ReadBigEndian(p + 8, 8);
+                return true;
+            }
+
+            // HEVC time_code (ITU-T H.265 D.2.27) with one full clock timestamp.
+            inline size_t WriteTimeCodePayload(const FrameTimecode& timecode, uint8_t* payload)
+            {
+                BitWriter writer(payload, k_TimeCodePayloadSize);
+
+                writer.Write(1, 2);                               // num_clock_ts
+                writer.Write(1, 1);                               // clock_timestamp_flag
+                writer.Write(0, 1);                               // units_field_based_flag
+                writer.Write(timecode.isDropFrame != 0 ? 4 : 0, 5); // counting_type
+                writer.Write(1, 1);                               // full_timestamp_flag
+                writer.Write(0, 1);                               // discontinuity_flag
+                writer.Write(0, 1);                               // cnt_dropped_flag
+                writer.Write(ClampShort(timecode.frames) & 0x1FF, 9);
+                writer.Write(ClampByte(timecode.seconds) & 0x3F, 6);
+                writer.Write(ClampByte(timecode.minutes) & 0x3F, 6);
+                writer.Write(ClampByte(timecode.hours) & 0x1F, 5);
+                writer.Write(0, 5);                               // time_offset_length
+                writer.WriteTrailingBits();
+
+                return writer.GetSize();
+            }
+
+            inline bool ReadTimeCodePayload(const uint8_t* payload, size_t size, FrameTimecode& timecode)
+            {
+                BitReader reader(payload, size);
+                uint32_t numClockTs, clockTimestampFlag, unitsFieldBased, countingType, fullTimestamp;
+                uint32_t discontinuity, cntDropped, frames, seconds, minutes, hours;
+
+                if (!reader.Read(2, numClockTs) || numClockTs == 0 ||
+                    !reader.Read(1, clockTimestampFlag) || clockTimestampFlag == 0 ||
+                    !reader.Read(1, unitsFieldBased) ||
+                    !reader.Read(5, countingType) ||
+                    !reader.Read(1, fullTimestamp) || fullTimestamp == 0 ||
+                    !reader.Read(1, discontinuity) ||
+                    !reader.Read(1, cntDropped) ||
+                    !reader.Read(9, frames) ||
+                    !reader.Read(6, seconds) ||
+                    !reader.Read(6, minutes) ||
+                    !reader.Read(5, hours))
+                {
+                    return false;
+                }
+
+                // The frame rate isn't part of the message.
+                timecode = FrameTimecode();
+                timecode.hours = static_cast<int32_t>(hours);
+                timecode.minutes = static_cast<int32_t>(minutes);
+                timecode.seconds = static_cast<int32_t>(seconds);
+                timecode.frames = static_cast<int32_t>(frames);
+                timecode.isDropFrame = countingType == 4 ? 1 : 0;
+                return true;
+            }
+
+            inline uint8_t* WriteMessageHeader(uint8_t* rbsp, uint32_t payloadType, size_t payloadSize)
+            {
+                for (; payloadType >= 0xFF; payloadType -= 0xFF)
+                {
+                    *rbsp++ = 0xFF;
+                }
+                *rbsp++ = static_cast<uint8_t>(payloadType);
+
+                for (; payloadSize >= 0xFF; payloadSize -= 0xFF)
+                {
+                    *rbsp++ = 0xFF;
+                }
+                *rbsp++ = static_cast<uint8_t>(payloadSize);
+                return rbsp;
+            }
+
+            inline bool IsSeiNal(Codec codec, const uint8_t* nal)
+            {
+                if (codec == Codec::H264)
+                    return (nal[0] & 0x1F) == k_H264SeiType;
+
+                const uint8_t type = (nal[0] >> 1) & 0x3F;
+                return type == k_HevcPrefixSeiType || type == k_HevcSuffixSeiType;
+            }
+
+            // Slices: H264 types 1 to 5, HEVC types 0 to 31.
+            inline bool IsVclNal(Codec codec, const uint8_t* nal)
+            {
+                if (codec == Codec::H264)
+                {
+                    const uint8_t type = nal[0] & 0x1F;
+                    return type >= 1 && type <= 5;
+                }
+                return ((nal[0] >> 1) & 0x3F) < 32;
+            }
+
+            inline size_t GetNalHeaderSize(Codec codec)
+            {
+                return codec == Codec::H264 ? 1 : 2;
+            }
+        }
+
+        // Writes the metadata SEI NAL unit of an access unit, with a 4-byte start code.
+        // Returns its size, or 0 if capacity is smaller than k_MaxNalSize.
+        inline size_t WriteMetadataNal(Codec codec, const FrameMetadata& metadata, uint8_t* nal, size_t capacity)
+        {
+            if (capacity < k_MaxNalSize)
+                return 0;
+
+            uint8_t rbsp[k_MaxNalSize];
+            auto p = Detail::WriteMessageHeader(rbsp, k_PayloadTypeUserDataUnregistered, k_MetadataPayloadSize);
+            p += Detail::WriteMetadataPayload(metadata, p);
+
+            if (codec == Codec::Hevc && HasTimecode(metadata.timecode))
+            {
+                p = Detail::WriteMessageHeader(p, k_PayloadTypeTimeCode, k_TimeCodePayloadSize);
+                p += Detail::WriteTimeCodePayload(metadata.timecode, p);
+            }
+
+            *p++ = 0x80; // rbsp_trailing_bits
+
+            auto out = nal;
+            std::memcpy(out, AnnexB::k_StartCode, AnnexB::k_StartCodeSize);
+            out += AnnexB::k_StartCodeSize;
+
+            if (codec == Codec::H264)
+            {
+                *out++ = Detail::k_H264SeiType; // nal_ref_idc 0
+            }
+            else
+            {
+                *out++ = Detail::k_HevcPrefixSeiType << 1; // nuh_layer_id 0
+                *out++ = 1;                                // nuh_temporal_id_plus1
+            }
+
+            // Emulation prevention: no 00 00 0x sequence (x <= 3) inside the NAL unit.
+            int zeroCount = 0;
+            for (auto r = rbsp; r < p; ++r)
+            {
+                if (zeroCount == 2 && *r <= 3)
+                {
+                    *out++ = 3;
+                    zeroCount = 0;
+                }
+                *out++ = *r;
+                zeroCount = (*r == 0) ? zeroCount + 1 : 0;
+            }
+
+            return static_cast<size_t>(out - nal);
+        }
+
+        // Calls fn(uint32_t payloadType, const uint8_t* payload, size_t payloadSize) for each SEI
+        // message of an Annex B access unit. Only the first 512 bytes of each SEI NAL unit are read.
+        template <typename Fn> void ForEachSeiMessage(Codec codec, const uint8_t* annexB, size_t size, Fn fn)
+        {
+            AnnexB::ForEachNalUnit(annexB, size, [&](const uint8_t* nal, size_t nalSize)
+            {
+                const size_t headerSize = Detail::GetNalHeaderSize(codec);
+                if (nalSize <= headerSize || !Detail::IsSeiNal(codec, nal))
+                    return;
+
+                // Removes the emulation prevention bytes.
+                uint8_t rbsp[512];
+                size_t rbspSize = 0;
+                int zeroCount = 0;
+                for (size_t i = headerSize; i < nalSize && rbspSize < sizeof(rbsp); ++i)
+                {
+                    if (zeroCount == 2 && nal[i] == 3)
+                    {
+                        zeroCount = 0;
+                        continue;
+                    }
+                    rbsp[rbspSize++] = nal[i];
+                    zeroCount = (nal[i] == 0) ? zeroCount + 1 : 0;
+                }
+
+                // Stops at rbsp_trailing_bits.
+                size_t position = 0;
+                while (position + 2 <= rbspSize && rbsp[position] != 0x80)
+                {
+                    uint32_t payloadType = 0;
+                    while (position < rbspSize && rbsp[position] == 0xFF)
+                    {
+                        payloadType += rbsp[position++];
+                    }
+                    if (position >= rbspSize)
+                        return;
+                    payloadType += rbsp[position++];
+
+                    size_t payloadSize = 0;
+                    while (position < rbspSize && rbsp[position] == 0xFF)
+                    {
+                        payloadSize += rbsp[position++];
+                    }
+                    if (position >= rbspSize)
+                        return;
+                    payloadSize += rbsp[position++];
+
+                    if (payloadSize > rbspSize - position)
+                        return;
+
+                    fn(payloadType, rbsp + position, payloadSize);
+                    position += payloadSize;
+                }
+            });
+        }
+
+        // Reads the Live Capture user data of an access unit.
+        inline bool ReadMetadata(Codec codec, const uint8_t* annexB, size_t size, FrameMetadata& metadata)
+        {
+            bool found = false;
+            ForEachSeiMessage(codec, annexB, size, [&](uint32_t payloadType, const uint8_t* payload, size_t payloadSize)
+            {
+                if (!found && payloadType == k_PayloadTypeUserDataUnregistered)
+                {
+                    found = Detail::ReadMetadataPayload(payload, payloadSize, metadata);
+                }
+            });
+            return found;
+        }
+
+        // Reads the HEVC time_code SEI of an access unit. The frame rate is left to 0.
+        inline bool ReadTimeCode(const uint8_t* annexB, size_t size, FrameTimecode& timecode)
+        {
+            bool found = false;
+            ForEachSeiMessage(Codec::Hevc, annexB, size, [&](uint32_t payloadType, const uint8_t* payload, size_t payloadSize)
+            {
+                if (!found && payloadType == k_PayloadTypeTimeCode)
+                {
+                    found = Detail::ReadTimeCodePayload(payload, payloadSize, timecode);
+                }
+            });
+            return found;
+        }
+
+        // Returns where the SEI NAL unit of an access unit goes: at the start code of the first
+        // slice, after the access unit delimiter, the parameter sets and the encoder's own SEI.
+        // Returns size when the access unit has no slice.
+        inline size_t GetMetadataOffset(Codec codec, const uint8_t* annexB, size_t size)
+        {
+            const uint8_t* end = annexB + size;
+            size_t startCodeSize = 0;
+
+            const uint8_t* p = AnnexB::FindStartCode(annexB, end, startCodeSize);
+            while (p != end)
+            {
+                const uint8_t* nal = p + 3;
+                if (nal < end && Detail::IsVclNal(codec, nal))
+                    return static_cast<size_t>(p - annexB) - (startCodeSize - 3);
+
+                p = AnnexB::FindStartCode(nal, end, startCodeSize);
+            }
+            return size;
+        }
+
+        // Inserts the metadata SEI NAL unit into an Annex B access unit, before its first slice.
+        inline bool InsertMetadata(Codec codec, const FrameMetadata& metadata, std::vector<uint8_t>& accessUnit)
+        {
+            const size_t offset = GetMetadataOffset(codec, accessUnit.data(), accessUnit.size());
+            if (offset == accessUnit.size())
+                return false;
+
+            uint8_t nal[k_MaxNalSize];
+            const size_t nalSize = WriteMetadataNal(codec, metadata, nal, sizeof(nal));
+
+            accessUnit.insert(accessUnit.begin() + offset, nal, nal + nalSize);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,502 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "EncodeFrameContext.h"
+
+namespace LiveCaptureNative
+{
+    // Chrome trace event phases.
+    enum class TracePhase : char
+    {
+        Begin = 'B',
+        End = 'E',
+        Complete = 'X', // Has a duration, can be recorded after the fact from another thread.
+        Instant = 'i',
+        FlowStart = 's',
+        FlowStep = 't',
+        FlowEnd = 'f'
+    };
+
+    // Where a scope is in the flow linking the stages of a frame.
+    enum class TraceFlow : int
+    {
+        None = 0,
+        Start,
+        Step,
+        End
+    };
+
+    // Records the stages of the frames through the video pipeline, from the Unity readback to the
+    // socket send, and writes them as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+    //
+    // Each thread writes to its own ring of k_EventsPerThread events, allocated on the first event
+    // of the thread and reused by the threads started later; recording doesn't allocate, lock or
+    // wait. The rings keep the most recent events: a dump shows the last moments before it. The
+    // events carry the id of their frame, the capture timestamp, and the flow events of a frame
+    // link its stages across the threads.
+    //
+    // Like AsyncLogger, the instance is never destroyed.
+    class TraceRecorder final
+    {
+    public:
+        static const size_t k_EventsPerThread = 8192;
+        static const size_t k_MaxThreads = 32;
+        static const size_t k_MaxNames = 256;
+        static const size_t k_MaxNameLength = 64;
+
+        static TraceRecorder& Get()
+        {
+            static TraceRecorder* s_Instance = new TraceRecorder();
+            return *s_Instance;
+        }
+
+        TraceRecorder(const TraceRecorder&) = delete;
+        TraceRecorder& operator=(const TraceRecorder&) = delete;
+
+        void SetEnabled(bool enabled) { m_Enabled.store(enabled, std::memory_order_relaxed); }
+        inline bool IsEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+
+        // Records an event on the calling thread. name must outlive the recorder: a literal or a
+        // string returned by GetName().
+        void Record(TracePhase phase, const char* name, uint64_t frameId, uint64_t time, uint64_t duration = 0)
+        {
+            if (!IsEnabled())
+                return;
+
+            ThreadBuffer* buffer = GetThreadBuffer();
+            if (buffer == nullptr)
+                return;
+
+            const auto head = buffer->head.load(std::memory_order_relaxed);
+            auto& event = buffer->events[head % k_EventsPerThread];
+            event.time.store(time, std::memory_order_relaxed);
+            event.duration.store(duration, std::memory_order_relaxed);
+            event.frameId.store(frameId, std::memory_order_relaxed);
+            event.name.store(name, std::memory_order_relaxed);
+            event.phase.store(static_cast<char>(phase), std::memory_order_relaxed);
+            buffer->head.store(head + 1, std::memory_order_release);
+        }
+
+        void Record(TracePhase phase, const char* name, uint64_t frameId)
+        {
+            if (IsEnabled())
+            {
+                Record(phase, name, frameId, GetEncodeClockNs());
+            }
+        }
+
+        // Flow events connect the enclosing slices of a frame, they share one name.
+        void RecordFlow(TraceFlow flow, uint64_t frameId, uint64_t time)
+        {
+            switch (flow)
+            {
+            case TraceFlow::Start: Record(TracePhase::FlowStart, "Frame", frameId, time); break;
+            case TraceFlow::Step:  Record(TracePhase::FlowStep, "Frame", frameId, time); break;
+            case TraceFlow::End:   Record(TracePhase::FlowEnd, "Frame", frameId, time); break;
+            default: break;
+            }
+        }
+
+        // Names the calling thread in the trace. Doesn't allocate the ring of the thread, the name
+        // is kept until the thread records an event.
+        void SetThreadName(const char* name)
+        {
+            auto& slot = GetThreadSlot();
+            CopyName(slot.name, name);
+
+            if (slot.buffer != nullptr)
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                CopyName(slot.buffer->threadName, name);
+            }
+        }
+
+        // Registers a name given at runtime (by the managed side), returns its id or -1 when the
+        // table is full. Registering the same name again returns the same id.
+        int RegisterName(const char* name)
+        {
+            if (name == nullptr)
+                return -1;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            const auto count = m_NameCount.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (std::strncmp(m_Names[i], name, k_MaxNameLength - 1) == 0)
+                    return static_cast<int>(i);
+            }
+
+            if (count == k_MaxNames)
+                return -1;
+
+            CopyName(m_Names[count], name);
+            m_NameCount.store(count + 1, std::memory_order_release);
+            return static_cast<int>(count);
+        }
+
+        // Name registered with RegisterName(), nullptr if the id is unknown.
+        const char* GetName(int id) const
+        {
+            if (id < 0 || static_cast<size_t>(id) >= m_NameCount.load(std::memory_order_acquire))
+                return nullptr;
+
+            return m_Names[id];
+        }
+
+        // Discards the recorded events.
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            for (size_t i = 0; i < m_ThreadCount; ++i)
+            {
+                m_Threads[i]->clearedHead.store(m_Threads[i]->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+            }
+        }
+
+        // Writes the recorded events as Chrome trace JSON. Can be called while recording, the events
+        // recorded meanwhile may be missing from the output.
+        bool WriteChromeJson(std::FILE* file)
+        {
+            if (file == nullptr)
+                return false;
+
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            std::fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", file);
+
+            bool first = true;
+            std::vector<Event> events;
+            events.reserve(k_EventsPerThread);
+
+            for (size_t i = 0; i < m_ThreadCount; ++i)
+            {
+                const auto& buffer = *m_Threads[i];
+                const auto threadId = static_cast<unsigned>(i + 1);
+
+                if (buffer.threadName[0] != '\0')
+                {
+                    std::fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"",
+                                 first ? "" : ",\n", threadId);
+                    WriteEscaped(file, buffer.threadName);
+                    std::fputs("\"}}", file);
+                    first = false;
+                }
+
+                CopyEvents(buffer, events);
+
+                for (const auto& event : events)
+                {
+                    std::fprintf(file, "%s{\"ph\":\"%c\",\"cat\":\"LiveCapture\",\"name\":\"", first ? "" : ",\n", event.phase);
+                    WriteEscaped(file, event.name);
+                    std::fprintf(file, "\",\"pid\":1,\"tid\":%u,\"ts\":%llu.%03u",
+                                 threadId,
+                                 static_cast<unsigned long long>(event.time / 1000),
+                                 static_cast<unsigned>(event.time % 1000));
+
+                    switch (static_cast<TracePhase>(event.phase))
+                    {
+                    case TracePhase::Complete:
+                        std::fprintf(file, ",\"dur\":%llu.%03u",
+                                     static_cast<unsigned long long>(event.duration / 1000),
+                                     static_cast<unsigned>(event.duration % 1000));
+                        break;
+                    case TracePhase::Instant:
+                        std::fputs(",\"s\":\"t\"", file);
+                        break;
+                    case TracePhase::FlowStart:
+                    case TracePhase::FlowStep:
+                    case TracePhase::FlowEnd:
+                        // Bind to the enclosing slice rather than to the next one.
+                        std::fprintf(file, ",\"id\":\"0x%llx\",\"bp\":\"e\"", static_cast<unsigned long long>(event.frameId));
+                        break;
+                    default:
+                        break;
+                    }
+
+                    std::fprintf(file, ",\"args\":{\"frame\":%llu}}", static_cast<unsigned long long>(event.frameId));
+                    first = false;
+                }
+            }
+
+            std::fputs("\n]}\n", file);
+            return std::ferror(file) == 0;
+        }
+
+        bool DumpChromeJson(const char* path)
+        {
+            if (path == nullptr)
+                return false;
+
+            std::FILE* file = std::fopen(path, "w");
+            if (file == nullptr)
+                return false;
+
+            const bool result = WriteChromeJson(file);
+            return std::fclose(file) == 0 && result;
+        }
+
+    private:
+        struct EventSlot
+        {
+            std::atomic<uint64_t>    time;
+            std::atomic<uint64_t>    duration;
+            std::atomic<uint64_t>    frameId;
+            std::atomic<const char*> name;
+            std::atomic<char>        phase;
+        };
+
+        struct Event
+        {
+            uint64_t    time;
+            uint64_t    duration;
+            uint64_t    frameId;
+            const char* name;
+            char        phase;
+        };
+
+        struct ThreadBuffer
+        {
+            std::atomic<uint64_t> head;        // Written by the owner thread only.
+            std::atomic<uint64_t> clearedHead; // Events before it were discarded by Clear().
+            std::atomic<bool>     inUse;
+            char                  threadName[k_MaxNameLength];
+            EventSlot             events[k_EventsPerThread];
+        };
+
+        // Releases the thread's ring when the thread exits, for the next thread to reuse.
+        struct ThreadSlot
+        {
+            ThreadBuffer* buffer = nullptr;
+            bool          exhausted = false;
+            char          name[k_MaxNameLength] = {};
+
+            ~ThreadSlot()
+            {
+                if (buffer != nullptr)
+                {
+                    buffer->inUse.store(false, std::memory_order_release);
+                }
+            }
+        };
+
+        TraceRecorder() :
+            m_Enabled(false),
+            m_NameCount(0),
+            m_ThreadCount(0),
+            m_Threads()
+        {
+        }
+
+        static ThreadSlot& GetThreadSlot()
+        {
+            static thread_local ThreadSlot t_Slot;
+            return t_Slot;
+        }
+
+        ThreadBuffer* GetThreadBuffer()
+        {
+            auto& slot = GetThreadSlot();
+            if (slot.buffer == nullptr && !slot.exhausted)
+            {
+                slot.buffer = AcquireThreadBuffer(slot.name);
+                slot.exhausted = slot.buffer == nullptr;
+            }
+            return slot.buffer;
+        }
+
+        // Once per thread: allocates a ring, or reuses the ring of an exited thread once
+        // k_MaxThreads are allocated so that the events of the exited threads are kept meanwhile.
+        ThreadBuffer* AcquireThreadBuffer(const char* threadName)
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+
+            if (m_ThreadCount < k_MaxThreads)
+            {
+                auto buffer = new ThreadBuffer();
+                buffer->head.store(0, std::memory_order_relaxed);
+                buffer->clearedHead.store(0, std::memory_order_relaxed);
+                buffer->inUse.store(true, std::memory_order_relaxed);
+                CopyName(buffer->threadName, threadName);
+                m_Threads[m_ThreadCount++] = buffer;
+                return buffer;
+            }
+
+            for (size_t i = 0; i < m_ThreadCount; ++i)
+            {
+                auto buffer = m_Threads[i];
+                bool expected = false;
+                if (buffer->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire))
+                {
+                    buffer->clearedHead.store(buffer->head.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    CopyName(buffer->threadName, threadName);
+                    return buffer;
+                }
+            }
+
+            return nullptr;
+        }
+
+        // Copies the events of a ring that are not overwritten while being read.
+        static void CopyEvents(const ThreadBuffer& buffer, std::vector<Event>& events)
+        {
+            events.clear();
+
+            const auto head = buffer.head.load(std::memory_order_acquire);
+            const auto cleared = buffer.clearedHead.load(std::memory_order_relaxed);
+            auto begin = (head > k_EventsPerThread) ? head - k_EventsPerThread : 0;
+            if (begin < cleared)
+            {
+                begin = cleared;
+            }
+
+            for (auto i = begin; i < head; ++i)
+            {
+                const auto& slot = buffer.events[i % k_EventsPerThread];
+                Event event;
+                event.time = slot.time.load(std::memory_order_relaxed);
+                event.duration = slot.duration.load(std::memory_order_relaxed);
+                event.frameId = slot.frameId.load(std::memory_order_relaxed);
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.phase = slot.phase.load(std::memory_order_relaxed);
+                events.push_back(event);
+            }
+
+            // The owner thread kept writing: the slot of the event it writes now, at index
+            // headAfter, held the event headAfter - k_EventsPerThread. Drop it and the older ones.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const auto headAfter = buffer.head.load(std::memory_order_relaxed);
+            if (headAfter + 1 > begin + k_EventsPerThread)
+            {
+                const auto overwritten = headAfter + 1 - k_EventsPerThread - begin;
+                events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(
+                    (overwritten < events.size()) ? overwritten : events.size()));
+            }
+        }
+
+        static void CopyName(char* destination, const char* name)
+        {
+            size_t length = 0;
+            if (name != nullptr)
+            {
+                for (; length < k_MaxNameLength - 1 && name[length] != '\0'; ++length)
+                {
+                    destination[length] = name[length];
+                }
+            }
+            destination[length] = '\0';
+        }
+
+        static void WriteEscaped(std::FILE* file, const char* text)
+        {
+            if (text == nullptr)
+                return;
+
+            for (; *text != '\0'; ++text)
+            {
+                const auto c = static_cast<unsigned char>(*text);
+                if (c == '"' || c == '\\')
+                {
+                    std::fputc('\\', file);
+                    std::fputc(c, file);
+                }
+                else if (c < 0x20)
+                {
+                    std::fprintf(file, "\\u%04x", c);
+                }
+                else
+                {
+                    std::fputc(c, file);
+                }
+            }
+        }
+
+        std::atomic<bool>   m_Enabled;
+        std::atomic<size_t> m_NameCount;
+        char                m_Names[k_MaxNames][k_MaxNameLength];
+
+        // Guards the thread list, the names and the dumps. Never taken while recording.
+        std::mutex    m_Mutex;
+        size_t        m_ThreadCount;
+        ThreadBuffer* m_Threads[k_MaxThreads];
+    };
+
+    // Records the enclosing scope as a slice of the given frame, optionally linked to its other
+    // stages by a flow event.
+    class TraceScope final
+    {
+    public:
+        TraceScope(const char* name, uint64_t frameId, TraceFlow flow = TraceFlow::None) :
+            m_Name(name),
+            m_FrameId(frameId),
+            m_Enabled(TraceRecorder::Get().IsEnabled())
+        {
+            if (m_Enabled)
+            {
+                auto& recorder = TraceRecorder::Get();
+                const auto time = GetEncodeClockNs();
+                recorder.Record(TracePhase::Begin, m_Name, m_FrameId, time);
+                recorder.RecordFlow(flow, m_FrameId, time);
+            }
+        }
+
+        ~TraceScope()
+        {
+            if (m_Enabled)
+            {
+                TraceRecorder::Get().Record(TracePhase::End, m_Name, m_FrameId, GetEncodeClockNs());
+            }
+        }
+
+        TraceScope(const TraceScope&) = delete;
+        TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+        const char* m_Name;
+        uint64_t    m_FrameId;
+        bool        m_Enabled;
+    };
+
+    // Begin and end of a scope named by TraceRecorder::RegisterName(), for the managed side.
+    inline void TraceBeginNamed(int nameId, uint64_t frameId, TraceFlow flow)
+    {
+        auto& recorder = TraceRecorder::Get();
+        const char* name = recorder.GetName(nameId);
+        if (!recorder.IsEnabled() || name == nullptr)
+            return;
+
+        const auto time = GetEncodeClockNs();
+        recorder.Record(TracePhase::Begin, name, frameId, time);
+        recorder.RecordFlow(flow, frameId, time);
+    }
+
+    inline void TraceEndNamed(int nameId, uint64_t frameId)
+    {
+        auto& recorder = TraceRecorder::Get();
+        const char* name = recorder.GetName(nameId);
+        if (recorder.IsEnabled() && name != nullptr)
+        {
+            recorder.Record(TracePhase::End, name, frameId, GetEncodeClockNs());
+        }
+    }
+
+    // Records a stage measured after the fact, such as the time a frame spent in the encoder,
+    // linked to the other stages of the frame.
+    inline void TraceComplete(const char* name, uint64_t frameId, uint64_t startTime, uint64_t endTime, TraceFlow flow = TraceFlow::Step)
+    {
+        auto& recorder = TraceRecorder::Get();
+        if (!recorder.IsEnabled() || startTime == 0 || endTime < startTime)
+            return;
+
+        // The flow binds to the slice enclosing it, place it inside rather than on an edge.
+        recorder.Record(TracePhase::Complete, name, frameId, startTime, endTime - startTime);
+        recorder.RecordFlow(flow, frameId, startTime + (endTime - startTime) / 2);
+    }
+}
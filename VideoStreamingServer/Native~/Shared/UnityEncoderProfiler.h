@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef> // NULL, used by IUnityProfiler.h.
+
+#include "Unity/IUnityInterface.h"
+#include "Unity/IUnityProfiler.h"
+
+#include "EncoderProfiler.h"
+
+namespace LiveCaptureNative
+{
+    // Forwards the encoder instrumentation to the Unity profiler. The markers are created once,
+    // in the Video category; each counter is a marker with a single value, emitted as an instant
+    // event so that its value shows in the timeline.
+    class UnityEncoderProfiler final : public IEncoderProfiler
+    {
+    public:
+        explicit UnityEncoderProfiler(IUnityProfiler* profiler) :
+            m_Profiler(profiler),
+            m_Markers(),
+            m_Counters()
+        {
+            // The profiler is compiled out of release players.
+            m_Available = m_Profiler != nullptr && m_Profiler->IsAvailable() != 0;
+            if (!m_Available)
+                return;
+
+            for (int i = 0; i < static_cast<int>(EncoderMarker::Count); ++i)
+            {
+                m_Profiler->CreateMarker(&m_Markers[i],
+                                         GetEncoderMarkerName(static_cast<EncoderMarker>(i)),
+                                         kUnityProfilerCategoryVideo,
+                                         kUnityProfilerMarkerFlagDefault,
+                                         0);
+            }
+
+            for (int i = 0; i < static_cast<int>(EncoderCounter::Count); ++i)
+            {
+                const auto counter = static_cast<EncoderCounter>(i);
+                if (m_Profiler->CreateMarker(&m_Counters[i],
+                                             GetEncoderCounterName(counter),
+                                             kUnityProfilerCategoryVideo,
+                                             kUnityProfilerMarkerFlagDefault,
+                                             1) != 0)
+                {
+                    m_Counters[i] = nullptr;
+                    continue;
+                }
+
+                m_Profiler->SetMarkerMetadataName(m_Counters[i],
+                                                  0,
+                                                  "Value",
+                                                  kUnityProfilerMarkerDataTypeUInt64,
+                                                  (counter == EncoderCounter::FrameBytes)
+                                                      ? kUnityProfilerMarkerDataUnitBytes
+                                                      : kUnityProfilerMarkerDataUnitCount);
+            }
+        }
+
+        bool IsEnabled() const override
+        {
+            return m_Available && m_Profiler->IsEnabled() != 0;
+        }
+
+        void BeginSample(EncoderMarker marker) override
+        {
+            const auto desc = m_Markers[static_cast<int>(marker)];
+            if (desc != nullptr)
+            {
+                m_Profiler->BeginSample(desc);
+            }
+        }
+
+        void EndSample(EncoderMarker marker) override
+        {
+            const auto desc = m_Markers[static_cast<int>(marker)];
+            if (desc != nullptr)
+            {
+                m_Profiler->EndSample(desc);
+            }
+        }
+
+        void SetCounter(EncoderCounter counter, uint64_t value) override
+        {
+            const auto desc = m_Counters[static_cast<int>(counter)];
+            if (desc == nullptr)
+                return;
+
+            UnityProfilerMarkerData data = {};
+            data.type = kUnityProfilerMarkerDataTypeUInt64;
+            data.size = sizeof(value);
+            data.ptr = &value;
+
+            m_Profiler->EmitEvent(desc, kUnityProfilerMarkerEventTypeSingle, 1, &data);
+        }
+
+        void RegisterThread(const char* name) override
+        {
+            if (m_Available)
+            {
+                m_Profiler->RegisterThread(nullptr, "Live Capture", name);
+            }
+        }
+
+        void UnregisterThread() override
+        {
+            if (m_Available)
+            {
+                m_Profiler->UnregisterThread(0);
+            }
+        }
+
+    private:
+        IUnityProfiler*                 m_Profiler;
+        bool                            m_Available;
+        const UnityProfilerMarkerDesc*  m_Markers[static_cast<int>(EncoderMarker::Count)];
+        const UnityProfilerMarkerDesc*  m_Counters[static_cast<int>(EncoderCounter::Count)];
+    };
+}
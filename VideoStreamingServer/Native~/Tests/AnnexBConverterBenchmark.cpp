@@ -0,0 +1,56 @@
+#include "TestUtils.h"
+#include "AnnexBConverter.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace AnnexB = LiveCaptureNative::AnnexB;
+
+// Throughput of the conversions on an 8 MB stream of 1400 byte NAL units (one slice per packet),
+// free of zero bytes like most of an entropy coded payload.
+int main()
+{
+    std::mt19937 random(1);
+    std::vector<uint8_t> avcc(8 << 20);
+    for (auto& byte : avcc)
+    {
+        byte = static_cast<uint8_t>(random() | 1);
+    }
+
+    size_t offset = 0;
+    while (offset + 4 < avcc.size())
+    {
+        const auto nalSize = (std::min)(static_cast<size_t>(1400), avcc.size() - offset - 4);
+        AnnexB::WriteLength(&avcc[offset], static_cast<uint32_t>(nalSize));
+        offset += 4 + nalSize;
+    }
+    avcc.resize(offset);
+
+    std::vector<uint8_t> annexB(avcc.size());
+    std::vector<uint8_t> back(avcc.size());
+    std::vector<uint8_t> inPlace(avcc.size());
+    size_t written = 0;
+    bool succeeded = true;
+
+    LiveCaptureNative::Tests::Benchmark("AvccToAnnexB", 20, avcc.size(), [&]()
+    {
+        succeeded &= AnnexB::AvccToAnnexB(avcc.data(), avcc.size(), 4, annexB.data(), annexB.size(), written);
+    });
+
+    LiveCaptureNative::Tests::Benchmark("Copy + AvccToAnnexBInPlace", 20, avcc.size(), [&]()
+    {
+        inPlace = avcc;
+        succeeded &= AnnexB::AvccToAnnexBInPlace(inPlace.data(), inPlace.size());
+    });
+
+    LiveCaptureNative::Tests::Benchmark("AnnexBToAvcc", 20, avcc.size(), [&]()
+    {
+        succeeded &= AnnexB::AnnexBToAvcc(annexB.data(), annexB.size(), back.data(), back.size(), written);
+    });
+
+    TEST_CHECK(succeeded);
+    TEST_CHECK(inPlace == annexB);
+    TEST_CHECK(back == avcc);
+    return 0;
+}
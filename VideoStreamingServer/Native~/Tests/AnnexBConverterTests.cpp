@@ -0,0 +1,191 @@
+#include "TestUtils.h"
+#include "AnnexBConverter.h"
+
+#include <random>
+#include <vector>
+
+namespace AnnexB = LiveCaptureNative::AnnexB;
+
+namespace
+{
+    using Bytes = std::vector<uint8_t>;
+
+    // A NAL unit as an encoder writes it: non-zero header, emulation prevention applied
+    // (no 00 00 0x with x <= 3) and no trailing zero byte.
+    Bytes RandomNalUnit(std::mt19937& random, size_t size)
+    {
+        Bytes nal(size);
+        for (auto& byte : nal)
+        {
+            byte = (random() % 4 == 0) ? 0 : static_cast<uint8_t>(random());
+        }
+
+        nal[0] = 0x65;
+        for (size_t i = 2; i < size; ++i)
+        {
+            if (nal[i - 2] == 0 && nal[i - 1] == 0 && nal[i] <= 3)
+            {
+                nal[i] = 4;
+            }
+        }
+        if (nal.back() == 0)
+        {
+            nal.back() = 7;
+        }
+        return nal;
+    }
+
+    Bytes ToAvcc(const std::vector<Bytes>& nals, size_t lengthSize)
+    {
+        Bytes avcc;
+        for (const auto& nal : nals)
+        {
+            for (size_t i = 0; i < lengthSize; ++i)
+            {
+                avcc.push_back(static_cast<uint8_t>(nal.size() >> (8 * (lengthSize - 1 - i))));
+            }
+            avcc.insert(avcc.end(), nal.begin(), nal.end());
+        }
+        return avcc;
+    }
+
+    Bytes ToAnnexB(const std::vector<Bytes>& nals)
+    {
+        Bytes annexB;
+        for (const auto& nal : nals)
+        {
+            annexB.insert(annexB.end(), AnnexB::k_StartCode, AnnexB::k_StartCode + AnnexB::k_StartCodeSize);
+            annexB.insert(annexB.end(), nal.begin(), nal.end());
+        }
+        return annexB;
+    }
+
+    void RoundTripsRandomStreams()
+    {
+        std::mt19937 random(1);
+
+        for (int iteration = 0; iteration < 20000; ++iteration)
+        {
+            std::vector<Bytes> nals(1 + random() % 6);
+            for (auto& nal : nals)
+            {
+                nal = RandomNalUnit(random, 1 + random() % 300);
+            }
+
+            const auto avcc = ToAvcc(nals, 4);
+            const auto expected = ToAnnexB(nals);
+
+            size_t annexBSize = 0;
+            TEST_CHECK(AnnexB::GetAnnexBSize(avcc.data(), avcc.size(), 4, annexBSize));
+            TEST_CHECK(annexBSize == expected.size());
+
+            Bytes annexB(annexBSize);
+            size_t written = 0;
+            TEST_CHECK(AnnexB::AvccToAnnexB(avcc.data(), avcc.size(), 4, annexB.data(), annexB.size(), written));
+            TEST_CHECK(written == expected.size() && annexB == expected);
+
+            auto inPlace = avcc;
+            TEST_CHECK(AnnexB::AvccToAnnexBInPlace(inPlace.data(), inPlace.size()));
+            TEST_CHECK(inPlace == expected);
+
+            size_t avccSize = 0;
+            TEST_CHECK(AnnexB::GetAvccSize(annexB.data(), annexB.size(), avccSize));
+            TEST_CHECK(avccSize == avcc.size());
+
+            Bytes back(avccSize);
+            TEST_CHECK(AnnexB::AnnexBToAvcc(annexB.data(), annexB.size(), back.data(), back.size(), written));
+            TEST_CHECK(written == avcc.size() && back == avcc);
+        }
+    }
+
+    void ConvertsShortLengthFields()
+    {
+        std::mt19937 random(2);
+        const std::vector<Bytes> nals = { RandomNalUnit(random, 10), RandomNalUnit(random, 300), RandomNalUnit(random, 1) };
+
+        for (size_t lengthSize = 1; lengthSize <= 4; ++lengthSize)
+        {
+            // A single byte can't hold a 300 byte length.
+            const auto& used = (lengthSize == 1) ? std::vector<Bytes>({ nals[0], nals[2] }) : nals;
+            const auto avcc = ToAvcc(used, lengthSize);
+            const auto expected = ToAnnexB(used);
+
+            size_t annexBSize = 0;
+            TEST_CHECK(AnnexB::GetAnnexBSize(avcc.data(), avcc.size(), lengthSize, annexBSize));
+            TEST_CHECK(annexBSize == expected.size());
+
+            Bytes annexB(annexBSize);
+            size_t written = 0;
+            TEST_CHECK(AnnexB::AvccToAnnexB(avcc.data(), avcc.size(), lengthSize, annexB.data(), annexB.size(), written));
+            TEST_CHECK(annexB == expected);
+        }
+
+        size_t size = 0;
+        TEST_CHECK(!AnnexB::GetAnnexBSize(nals[0].data(), nals[0].size(), 0, size));
+        TEST_CHECK(!AnnexB::GetAnnexBSize(nals[0].data(), nals[0].size(), 5, size));
+    }
+
+    void SplitsThreeAndFourByteStartCodes()
+    {
+        const Bytes annexB = { 0, 0, 1, 0x67, 1, 2, 0, 0, 1, 0x68, 9, 0, 0, 0, 1, 0x65, 5 };
+        const Bytes expected = { 0, 0, 0, 3, 0x67, 1, 2, 0, 0, 0, 2, 0x68, 9, 0, 0, 0, 2, 0x65, 5 };
+
+        Bytes avcc(64);
+        size_t written = 0;
+        TEST_CHECK(AnnexB::AnnexBToAvcc(annexB.data(), annexB.size(), avcc.data(), avcc.size(), written));
+        avcc.resize(written);
+        TEST_CHECK(avcc == expected);
+
+        // Start codes found across the 8-byte fast path boundary.
+        for (size_t padding = 0; padding < 16; ++padding)
+        {
+            Bytes stream(padding, 0xff);
+            stream.insert(stream.end(), { 0, 0, 1, 0x41 });
+            size_t startCodeSize = 0;
+            const auto found = AnnexB::FindStartCode(stream.data(), stream.data() + stream.size(), startCodeSize);
+            TEST_CHECK(found == stream.data() + padding && startCodeSize == 3);
+        }
+    }
+
+    void RejectsMalformedStreams()
+    {
+        std::mt19937 random(3);
+        const auto avcc = ToAvcc({ RandomNalUnit(random, 100), RandomNalUnit(random, 50) }, 4);
+
+        // Truncated anywhere: in a length field or in a NAL unit.
+        for (size_t size = 1; size < avcc.size(); ++size)
+        {
+            if (size == 104)
+                continue; // Ends exactly after the first NAL unit, which is valid.
+
+            size_t annexBSize = 0;
+            TEST_CHECK(!AnnexB::GetAnnexBSize(avcc.data(), size, 4, annexBSize));
+
+            auto copy = avcc;
+            TEST_CHECK(!AnnexB::AvccToAnnexBInPlace(copy.data(), size));
+        }
+
+        // Too small an output buffer.
+        Bytes annexB(avcc.size() - 1);
+        size_t written = 0;
+        TEST_CHECK(!AnnexB::AvccToAnnexB(avcc.data(), avcc.size(), 4, annexB.data(), annexB.size(), written));
+
+        const auto valid = ToAnnexB({ RandomNalUnit(random, 100) });
+        Bytes small(valid.size() - 1);
+        TEST_CHECK(!AnnexB::AnnexBToAvcc(valid.data(), valid.size(), small.data(), small.size(), written));
+
+        // No start code at all.
+        const Bytes noStartCode = { 0x65, 1, 2, 3 };
+        size_t avccSize = 0;
+        TEST_CHECK(!AnnexB::GetAvccSize(noStartCode.data(), noStartCode.size(), avccSize));
+    }
+}
+
+int main()
+{
+    TEST_RUN(RoundTripsRandomStreams);
+    TEST_RUN(ConvertsShortLengthFields);
+    TEST_RUN(SplitsThreeAndFourByteStartCodes);
+    TEST_RUN(RejectsMalformedStreams);
+    return 0;
+}
@@ -0,0 +1,127 @@
+#define LIVECAPTURE_LOG_LEVEL 0
+
+#include "AsyncLogger.h"
+#include "TestUtils.h"
+
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const char* const k_LogPath = "AsyncLoggerBenchmark.log";
+    const char* const k_BaselinePath = "AsyncLoggerBenchmark.baseline.log";
+
+    // The previous debug log: the file is opened, appended to and closed on each message.
+    void WriteBaseline(const char* message, int value)
+    {
+        std::ofstream file;
+        file.open(k_BaselinePath, std::ios_base::app | std::ios_base::out);
+        file << message << value << "\n";
+        file.close();
+    }
+
+    size_t CountLines(const char* path, const char* text)
+    {
+        std::ifstream file(path);
+        std::string line;
+        size_t count = 0;
+        while (std::getline(file, line))
+        {
+            if (line.find(text) != std::string::npos)
+            {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    void RenderThreadCost()
+    {
+        const int count = 20000;
+
+        std::remove(k_BaselinePath);
+        Tests::Benchmark("Open, write and close per message", count, 0, []()
+        {
+            static int i = 0;
+            WriteBaseline("Info, frame encoded: ", i++);
+        });
+
+        auto& logger = AsyncLogger::Get();
+        TEST_CHECK(logger.Open(k_LogPath));
+        logger.SetLevel(LogLevel::Debug);
+
+        const auto droppedBefore = logger.GetDroppedCount();
+        Tests::Benchmark("AsyncLogger, enabled", count, 0, []()
+        {
+            static int i = 0;
+            LIVECAPTURE_LOG(LogLevel::Info, "Info, frame encoded: %d", i);
+
+            // A render thread logs a few messages per frame, let the flusher keep up.
+            if ((++i & 511) == 0)
+            {
+                std::this_thread::yield();
+            }
+        });
+        logger.Flush();
+
+        // Every message is either in the file or counted as dropped.
+        const auto dropped = logger.GetDroppedCount() - droppedBefore;
+        TEST_CHECK(CountLines(k_LogPath, "frame encoded") + dropped == static_cast<size_t>(count));
+
+        logger.SetLevel(LogLevel::Error);
+        Tests::Benchmark("AsyncLogger, disabled at runtime", count * 100, 0, []()
+        {
+            static int i = 0;
+            LIVECAPTURE_LOG(LogLevel::Info, "Info, frame encoded: %d", i++);
+        });
+        logger.SetLevel(LogLevel::Debug);
+
+        logger.Close();
+    }
+
+    void ConcurrentProducers()
+    {
+        const int threadCount = 4;
+        const int count = 2000;
+
+        auto& logger = AsyncLogger::Get();
+        TEST_CHECK(logger.Open(k_LogPath));
+        const auto droppedBefore = logger.GetDroppedCount();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([t]()
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    LIVECAPTURE_LOG(LogLevel::Warning, "Output thread %d, frame %d", t, i);
+                    if ((i & 63) == 0)
+                    {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+        logger.Close();
+
+        const auto dropped = logger.GetDroppedCount() - droppedBefore;
+        std::printf("Dropped %llu of %d messages\n", static_cast<unsigned long long>(dropped), threadCount * count);
+        TEST_CHECK(CountLines(k_LogPath, "Output thread") + dropped == static_cast<size_t>(threadCount * count));
+    }
+}
+
+int main()
+{
+    TEST_RUN(RenderThreadCost);
+    TEST_RUN(ConcurrentProducers);
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include "CopySlotScheduler.h"
+#include "TestUtils.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace NvencPlugin;
+
+    // Fence of a GPU queue simulated on the CPU: the signals are queued in submission order and
+    // only reached when the test executes them, or when a wait forces the queue forward.
+    class StepFence final : public ICopyFence
+    {
+    public:
+        uint64_t GetCompletedValue() override
+        {
+            return m_Completed;
+        }
+
+        void WaitForValue(uint64_t value) override
+        {
+            ++m_WaitCount;
+            while (m_Completed < value)
+            {
+                TEST_CHECK(!m_Pending.empty()); // Waiting on a value never signaled would hang.
+                Execute(1);
+            }
+        }
+
+        void Signal(uint64_t value)
+        {
+            m_Pending.push_back(value);
+        }
+
+        void Execute(int count)
+        {
+            while (count-- > 0 && !m_Pending.empty())
+            {
+                TEST_CHECK(m_Pending.front() > m_Completed);
+                m_Completed = m_Pending.front();
+                m_Pending.pop_front();
+            }
+        }
+
+        int GetWaitCount() const
+        {
+            return m_WaitCount;
+        }
+
+    private:
+        uint64_t             m_Completed = 0;
+        std::deque<uint64_t> m_Pending;
+        int                  m_WaitCount = 0;
+    };
+
+    void NoStallWhenTheGpuKeepsUp()
+    {
+        StepFence fence;
+        CopySlotScheduler scheduler(fence, 4);
+
+        // The GPU runs one frame behind the render thread.
+        for (uint32_t i = 0; i < 100; ++i)
+        {
+            const auto slot = scheduler.AcquireSlot();
+            TEST_CHECK(slot == i % 4);
+
+            const auto value = scheduler.Submit(slot);
+            TEST_CHECK(value == i + 1);
+            TEST_CHECK(!scheduler.IsComplete(value));
+            fence.Signal(value);
+
+            if (i > 0)
+            {
+                fence.Execute(1);
+            }
+        }
+
+        TEST_CHECK(scheduler.GetStallCount() == 0);
+        TEST_CHECK(fence.GetWaitCount() == 0);
+        TEST_CHECK(scheduler.GetLastFenceValue() == 100);
+    }
+
+    void StallWaitsForTheSlotOnly()
+    {
+        StepFence fence;
+        CopySlotScheduler scheduler(fence, 4);
+
+        for (int i = 0; i < 4; ++i)
+        {
+            fence.Signal(scheduler.Submit(scheduler.AcquireSlot()));
+        }
+
+        // The GPU hasn't run any copy: reusing the first slot waits for its copy, not the others.
+        TEST_CHECK(scheduler.AcquireSlot() == 0);
+        TEST_CHECK(fence.GetCompletedValue() == 1);
+        TEST_CHECK(scheduler.GetStallCount() == 1);
+        TEST_CHECK(!scheduler.IsComplete(2));
+
+        fence.Signal(scheduler.Submit(0));
+        scheduler.WaitIdle();
+        TEST_CHECK(fence.GetCompletedValue() == 5);
+
+        // Nothing left to wait for.
+        const auto waits = fence.GetWaitCount();
+        scheduler.WaitIdle();
+        TEST_CHECK(fence.GetWaitCount() == waits);
+    }
+
+    void SingleSlotSerializesTheCopies()
+    {
+        StepFence fence;
+        CopySlotScheduler zeroSlots(fence, 0);
+        TEST_CHECK(zeroSlots.GetSlotCount() == 1);
+
+        CopySlotScheduler scheduler(fence, 1);
+        for (int i = 0; i < 10; ++i)
+        {
+            TEST_CHECK(scheduler.AcquireSlot() == 0);
+            fence.Signal(scheduler.Submit(0));
+        }
+        TEST_CHECK(scheduler.GetStallCount() == 9);
+    }
+
+    // Fence signaled by a thread running the copies, like a copy queue would.
+    class ThreadFence final : public ICopyFence
+    {
+    public:
+        uint64_t GetCompletedValue() override
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Completed;
+        }
+
+        void WaitForValue(uint64_t value) override
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Condition.wait(lock, [this, value]() { return m_Completed >= value; });
+        }
+
+        void Signal(uint64_t value)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Completed = value;
+            }
+            m_Condition.notify_all();
+        }
+
+    private:
+        std::mutex              m_Mutex;
+        std::condition_variable m_Condition;
+        uint64_t                m_Completed = 0;
+    };
+
+    void CopiesNeverReadAReusedSlot()
+    {
+        const uint32_t slotCount = 3;
+        const int frameCount = 20000;
+
+        ThreadFence fence;
+        CopySlotScheduler scheduler(fence, slotCount);
+
+        // Each slot holds the frame number recorded into it, the copy thread reads it back later.
+        std::vector<int> slots(slotCount, -1);
+        std::vector<int> copied;
+        std::deque<std::pair<uint32_t, uint64_t>> queue;
+        std::mutex queueMutex;
+        std::condition_variable queueCondition;
+        bool done = false;
+
+        std::thread copyThread([&]()
+        {
+            for (;;)
+            {
+                std::pair<uint32_t, uint64_t> copy;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    queueCondition.wait(lock, [&]() { return done || !queue.empty(); });
+                    if (queue.empty())
+                        return;
+                    copy = queue.front();
+                    queue.pop_front();
+                }
+
+                // The recording thread doesn't write the slot again before the fence is signaled.
+                copied.push_back(slots[copy.first]);
+                fence.Signal(copy.second);
+            }
+        });
+
+        for (int i = 0; i < frameCount; ++i)
+        {
+            const auto slot = scheduler.AcquireSlot();
+            slots[slot] = i;
+
+            const auto value = scheduler.Submit(slot);
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                queue.emplace_back(slot, value);
+            }
+            queueCondition.notify_one();
+        }
+
+        scheduler.WaitIdle();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            done = true;
+        }
+        queueCondition.notify_one();
+        copyThread.join();
+
+        TEST_CHECK(copied.size() == static_cast<size_t>(frameCount));
+        for (int i = 0; i < frameCount; ++i)
+        {
+            TEST_CHECK(copied[i] == i);
+        }
+        std::printf("%llu stalls for %d frames\n", static_cast<unsigned long long>(scheduler.GetStallCount()), frameCount);
+    }
+}
+
+int main()
+{
+    TEST_RUN(NoStallWhenTheGpuKeepsUp);
+    TEST_RUN(StallWaitsForTheSlotOnly);
+    TEST_RUN(SingleSlotSerializesTheCopies);
+    TEST_RUN(CopiesNeverReadAReusedSlot);
+    return 0;
+}
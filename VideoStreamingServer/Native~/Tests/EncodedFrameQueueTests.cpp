@@ -0,0 +1,204 @@
+#include "EncodedFrameQueue.h"
+#include "TestUtils.h"
+
+#include <thread>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    struct Frame
+    {
+        uint64_t id;
+    };
+
+    using Queue = EncodedFrameQueue<Frame, 2 * k_MaxOutputQueueLength>;
+
+    void Configure(Queue& queue, EncoderStats& stats, int length, BackpressurePolicy policy)
+    {
+        const EncoderBufferingSettings requested = { 0, length, static_cast<int32_t>(policy) };
+        const auto settings = ValidateBufferingSettings(requested, 4, k_MaxInFlightDepth, 8);
+        queue.Configure(settings);
+        stats.SetBuffering(settings);
+        queue.Clear();
+    }
+
+    bool Write(Queue& queue, uint64_t id, bool isKeyFrame = false)
+    {
+        auto frame = queue.BeginWrite(isKeyFrame);
+        if (frame == nullptr)
+            return false;
+
+        frame->id = id;
+        queue.Publish();
+        return true;
+    }
+
+    // The consumer as driven by the plugins: BeginConsume peeks the frame, EndConsume pops it.
+    Frame* BeginConsume(Queue& queue)
+    {
+        queue.TrimOldest();
+        return queue.Front();
+    }
+
+    uint64_t EndConsume(Queue& queue)
+    {
+        const auto frame = queue.Front();
+        TEST_CHECK(frame != nullptr);
+
+        const auto id = frame->id;
+        TEST_CHECK(queue.Pop());
+        return id;
+    }
+
+    void DropNewest()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::DropNewest);
+
+        for (uint64_t i = 0; i < 4; ++i)
+        {
+            TEST_CHECK(Write(queue, i) == (i < 2));
+        }
+
+        TEST_CHECK(queue.GetSize() == 2);
+        TEST_CHECK(BeginConsume(queue)->id == 0);
+        TEST_CHECK(queue.GetDroppedCount() == 2);
+    }
+
+    void DropOldest()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::DropOldest);
+
+        for (uint64_t i = 0; i < 4; ++i)
+        {
+            TEST_CHECK(Write(queue, i));
+        }
+
+        // Trimmed by the consumer, not the producer.
+        TEST_CHECK(queue.GetSize() == 4);
+        TEST_CHECK(queue.Front()->id == 0);
+        TEST_CHECK(BeginConsume(queue)->id == 2);
+        TEST_CHECK(queue.GetSize() == 2);
+        TEST_CHECK(EndConsume(queue) == 2);
+        TEST_CHECK(BeginConsume(queue)->id == 3);
+
+        EncoderStatsSnapshot snapshot;
+        stats.Snapshot(snapshot);
+        TEST_CHECK(snapshot.droppedOldestFrames == 2);
+        TEST_CHECK(queue.GetDroppedCount() == 2);
+    }
+
+    void DropOldestKeepsTheFrameBeingConsumed()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 1, BackpressurePolicy::DropOldest);
+
+        // Frame 2 arrives while frame 1 is consumed: ending the consumption pops frame 1 only.
+        TEST_CHECK(Write(queue, 1));
+        TEST_CHECK(BeginConsume(queue)->id == 1);
+        TEST_CHECK(Write(queue, 2));
+        TEST_CHECK(EndConsume(queue) == 1);
+
+        TEST_CHECK(BeginConsume(queue)->id == 2);
+        TEST_CHECK(EndConsume(queue) == 2);
+        TEST_CHECK(BeginConsume(queue) == nullptr);
+        TEST_CHECK(queue.GetDroppedCount() == 0);
+
+        // The frame read by the consumer is never the one trimmed, even when it is the oldest.
+        TEST_CHECK(Write(queue, 3));
+        const auto frame = BeginConsume(queue);
+        TEST_CHECK(frame->id == 3);
+        TEST_CHECK(Write(queue, 4));
+        TEST_CHECK(queue.Front() == frame);
+        TEST_CHECK(frame->id == 3);
+        TEST_CHECK(EndConsume(queue) == 3);
+        TEST_CHECK(BeginConsume(queue)->id == 4);
+    }
+
+    void DropToKeyFrame()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::DropToKeyFrame);
+
+        const bool isKeyFrame[] = { true, false, false, false, false, true, false };
+        for (uint64_t i = 0; i < 7; ++i)
+        {
+            if (i == 5)
+            {
+                EndConsume(queue);
+                EndConsume(queue);
+            }
+            Write(queue, i, isKeyFrame[i]);
+        }
+
+        // Frame 2 was dropped, the following ones are skipped until the key frame 5.
+        TEST_CHECK(queue.ConsumeKeyFrameRequest());
+        TEST_CHECK(!queue.ConsumeKeyFrameRequest());
+        TEST_CHECK(BeginConsume(queue)->id == 5);
+        TEST_CHECK(queue.GetSize() == 2);
+
+        EncoderStatsSnapshot snapshot;
+        stats.Snapshot(snapshot);
+        TEST_CHECK(snapshot.droppedFrames == 1);
+        TEST_CHECK(snapshot.skippedFrames == 2);
+    }
+
+    void BlockLosesNothing()
+    {
+        const uint64_t count = 10000;
+
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::Block);
+
+        std::thread consumer([&queue, count]()
+        {
+            for (uint64_t next = 0; next < count;)
+            {
+                if (BeginConsume(queue) == nullptr)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                TEST_CHECK(EndConsume(queue) == next);
+                ++next;
+            }
+        });
+
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            TEST_CHECK(Write(queue, i));
+        }
+        consumer.join();
+        TEST_CHECK(queue.GetDroppedCount() == 0);
+
+        // With a stalled consumer, the producer gives up after the timeout.
+        TEST_CHECK(Write(queue, 0));
+        TEST_CHECK(Write(queue, 1));
+        const auto start = GetEncodeClockNs();
+        TEST_CHECK(!Write(queue, 2));
+        TEST_CHECK(GetEncodeClockNs() - start >= k_BackpressureTimeoutNs);
+
+        // Cancelled, it doesn't wait anymore.
+        queue.SetCancelled(true);
+        const auto cancelStart = GetEncodeClockNs();
+        TEST_CHECK(!Write(queue, 3));
+        TEST_CHECK(GetEncodeClockNs() - cancelStart < k_BackpressureTimeoutNs);
+    }
+}
+
+int main()
+{
+    TEST_RUN(DropNewest);
+    TEST_RUN(DropOldest);
+    TEST_RUN(DropOldestKeepsTheFrameBeingConsumed);
+    TEST_RUN(DropToKeyFrame);
+    TEST_RUN(BlockLosesNothing);
+    return 0;
+}
@@ -0,0 +1,225 @@
+#include "EncodedFrameQueue.h"
+#include "EncoderProfiler.h"
+#include "TestUtils.h"
+
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    using EventType = RecordingEncoderProfiler::EventType;
+
+    struct Frame
+    {
+        uint64_t id;
+    };
+
+    using Queue = EncodedFrameQueue<Frame, 2 * k_MaxOutputQueueLength>;
+
+    void Configure(Queue& queue, EncoderStats& stats, int length, BackpressurePolicy policy)
+    {
+        const EncoderBufferingSettings requested = { 0, length, static_cast<int32_t>(policy) };
+        const auto settings = ValidateBufferingSettings(requested, 4, k_MaxInFlightDepth, 8);
+        queue.Configure(settings);
+        stats.SetBuffering(settings);
+        queue.Clear();
+    }
+
+    // The hand-off of an encoded frame as the plugins do it.
+    bool AddEncodedFrame(Queue& queue, uint64_t id, uint64_t frameBytes)
+    {
+        EncoderProfilerScope profilerScope(EncoderMarker::QueueFrame);
+
+        auto frame = queue.BeginWrite(false);
+        if (frame == nullptr)
+        {
+            ProfileFrameDropped(queue);
+            return false;
+        }
+
+        frame->id = id;
+        queue.Publish();
+        ProfileFrameQueued(queue, frameBytes);
+        return true;
+    }
+
+    uint64_t GetCounter(const RecordingEncoderProfiler& profiler, EncoderCounter counter)
+    {
+        uint64_t value = 0;
+        TEST_CHECK(profiler.GetCounter(counter, value));
+        return value;
+    }
+
+    // Each end closes the last sample begun, on every thread as the samples don't cross threads here.
+    bool IsBalanced(const std::vector<RecordingEncoderProfiler::Event>& events)
+    {
+        std::vector<int> open;
+        for (const auto& event : events)
+        {
+            if (event.type == EventType::Begin)
+            {
+                open.push_back(event.id);
+            }
+            else if (event.type == EventType::End)
+            {
+                if (open.empty() || open.back() != event.id)
+                    return false;
+                open.pop_back();
+            }
+        }
+        return open.empty();
+    }
+
+    void ScopesNest()
+    {
+        RecordingEncoderProfiler profiler;
+        SetEncoderProfiler(&profiler);
+        {
+            EncoderProfilerScope copy(EncoderMarker::Copy);
+            {
+                EncoderProfilerScope convert(EncoderMarker::Convert);
+            }
+            EncoderProfilerScope encode(EncoderMarker::EncodePicture);
+        }
+        SetEncoderProfiler(nullptr);
+
+        const auto events = profiler.GetEvents();
+        TEST_CHECK(events.size() == 6);
+        TEST_CHECK(IsBalanced(events));
+
+        const EventType types[] = { EventType::Begin, EventType::Begin, EventType::End, EventType::Begin, EventType::End, EventType::End };
+        const EncoderMarker markers[] = { EncoderMarker::Copy, EncoderMarker::Convert, EncoderMarker::Convert,
+                                          EncoderMarker::EncodePicture, EncoderMarker::EncodePicture, EncoderMarker::Copy };
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            TEST_CHECK(events[i].type == types[i]);
+            TEST_CHECK(events[i].id == static_cast<int>(markers[i]));
+        }
+    }
+
+    void QueueCountersFollowTheHandOff()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::DropNewest);
+
+        RecordingEncoderProfiler profiler;
+        SetEncoderProfiler(&profiler);
+
+        TEST_CHECK(AddEncodedFrame(queue, 0, 1000));
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::FrameBytes) == 1000);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::QueueDepth) == 1);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::DroppedFrames) == 0);
+
+        TEST_CHECK(AddEncodedFrame(queue, 1, 2000));
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::FrameBytes) == 2000);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::QueueDepth) == 2);
+
+        // Full: the frame is dropped, only the drop count changes.
+        TEST_CHECK(!AddEncodedFrame(queue, 2, 3000));
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::DroppedFrames) == 1);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::FrameBytes) == 2000);
+        TEST_CHECK(profiler.GetCount(EventType::Counter, static_cast<int>(EncoderCounter::FrameBytes)) == 2);
+
+        TEST_CHECK(queue.Pop());
+        TEST_CHECK(AddEncodedFrame(queue, 3, 4000));
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::FrameBytes) == 4000);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::QueueDepth) == 2);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::DroppedFrames) == 1);
+
+        SetEncoderProfiler(nullptr);
+
+        // One sample per hand-off, dropped or not.
+        TEST_CHECK(IsBalanced(profiler.GetEvents()));
+        TEST_CHECK(profiler.GetCount(EventType::Begin, static_cast<int>(EncoderMarker::QueueFrame)) == 4);
+        TEST_CHECK(profiler.GetCount(EventType::Begin) == 4);
+    }
+
+    void ThreadedHandOff()
+    {
+        constexpr uint64_t k_FrameCount = 1000;
+
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 4, BackpressurePolicy::Block);
+
+        RecordingEncoderProfiler profiler;
+        SetEncoderProfiler(&profiler);
+
+        // The encoder output thread, the consumer pops on the main thread.
+        std::thread producer([&queue]() {
+            auto& threadProfiler = GetEncoderProfiler();
+            threadProfiler.RegisterThread("Test Output");
+            for (uint64_t i = 0; i < k_FrameCount; ++i)
+            {
+                TEST_CHECK(AddEncodedFrame(queue, i, 100 + i));
+            }
+            threadProfiler.UnregisterThread();
+        });
+
+        for (uint64_t expected = 0; expected < k_FrameCount;)
+        {
+            const auto frame = queue.Front();
+            if (frame == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            TEST_CHECK(frame->id == expected++);
+            TEST_CHECK(queue.Pop());
+        }
+        producer.join();
+
+        SetEncoderProfiler(nullptr);
+
+        TEST_CHECK(IsBalanced(profiler.GetEvents()));
+        TEST_CHECK(profiler.GetCount(EventType::RegisterThread) == 1);
+        TEST_CHECK(profiler.GetCount(EventType::UnregisterThread) == 1);
+        TEST_CHECK(profiler.GetCount(EventType::Begin, static_cast<int>(EncoderMarker::QueueFrame)) == k_FrameCount);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::FrameBytes) == 100 + k_FrameCount - 1);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::DroppedFrames) == 0);
+        TEST_CHECK(GetCounter(profiler, EncoderCounter::QueueDepth) <= 4);
+    }
+
+    void NothingAfterReset()
+    {
+        EncoderStats stats;
+        Queue queue(stats);
+        Configure(queue, stats, 2, BackpressurePolicy::DropNewest);
+
+        RecordingEncoderProfiler profiler;
+        SetEncoderProfiler(&profiler);
+        {
+            // A sample begun before the reset still ends on its profiler.
+            EncoderProfilerScope scope(EncoderMarker::WaitCompletion);
+            SetEncoderProfiler(nullptr);
+            TEST_CHECK(!GetEncoderProfiler().IsEnabled());
+
+            EncoderProfilerScope inner(EncoderMarker::LockBitstream);
+            TEST_CHECK(AddEncodedFrame(queue, 0, 1000));
+        }
+
+        const auto events = profiler.GetEvents();
+        TEST_CHECK(events.size() == 2);
+        TEST_CHECK(IsBalanced(events));
+        TEST_CHECK(events[0].id == static_cast<int>(EncoderMarker::WaitCompletion));
+
+        TEST_CHECK(AddEncodedFrame(queue, 1, 1000));
+        TEST_CHECK(!AddEncodedFrame(queue, 2, 1000));
+        GetEncoderProfiler().RegisterThread("Test");
+        GetEncoderProfiler().UnregisterThread();
+        TEST_CHECK(profiler.GetEvents().size() == 2);
+    }
+}
+
+int main()
+{
+    TEST_RUN(ScopesNest);
+    TEST_RUN(QueueCountersFollowTheHandOff);
+    TEST_RUN(ThreadedHandOff);
+    TEST_RUN(NothingAfterReset);
+    return 0;
+}
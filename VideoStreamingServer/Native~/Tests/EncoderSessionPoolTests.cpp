@@ -0,0 +1,183 @@
+#include "TestUtils.h"
+#include "EncoderSessionPool.h"
+
+#include <vector>
+
+using NvencPlugin::EncoderSessionPool;
+
+namespace
+{
+    // Same rules as the NVENC session key: same device and format, at least the requested size,
+    // preferring the exact size which needs no reallocation.
+    struct FakeKey
+    {
+        int device;
+        int format;
+        int width;
+        int height;
+
+        int Match(const FakeKey& request) const
+        {
+            if (device != request.device || format != request.format ||
+                width < request.width || height < request.height)
+                return -1;
+
+            return (width == request.width && height == request.height) ? 1 : 0;
+        }
+    };
+
+    // Stands in for an encoder session, the pool never looks inside.
+    struct FakeSession
+    {
+        int id;
+    };
+
+    struct Backend
+    {
+        std::vector<int> destroyed;
+
+        EncoderSessionPool<FakeKey, FakeSession>::DestroyCallback Callback()
+        {
+            return [this](FakeSession* session)
+            {
+                destroyed.push_back(session->id);
+                delete session;
+            };
+        }
+    };
+
+    void AcquirePrefersTheBestMatch()
+    {
+        Backend backend;
+        EncoderSessionPool<FakeKey, FakeSession> pool(1000, 8, backend.Callback());
+
+        pool.Release({ 0, 0, 3840, 2160 }, new FakeSession{ 1 }, 100);
+        pool.Release({ 0, 0, 1920, 1080 }, new FakeSession{ 2 }, 100);
+        pool.Release({ 0, 0, 1280, 720 }, new FakeSession{ 3 }, 100);
+
+        // Exact size wins over a larger session, even a more recently parked one.
+        FakeKey key = {};
+        auto session = pool.Acquire({ 0, 0, 1920, 1080 }, &key);
+        TEST_CHECK(session != nullptr && session->id == 2);
+        TEST_CHECK(key.width == 1920 && key.height == 1080);
+        delete session;
+
+        // No exact match: a larger session can be reconfigured, the most recently parked first.
+        pool.Release({ 0, 0, 2560, 1440 }, new FakeSession{ 4 }, 100);
+        session = pool.Acquire({ 0, 0, 1600, 900 });
+        TEST_CHECK(session != nullptr && session->id == 4);
+        delete session;
+
+        // Other devices, formats and smaller sessions never match.
+        TEST_CHECK(pool.Acquire({ 1, 0, 1280, 720 }) == nullptr);
+        TEST_CHECK(pool.Acquire({ 0, 1, 1280, 720 }) == nullptr);
+        TEST_CHECK(pool.Acquire({ 0, 0, 7680, 4320 }) == nullptr);
+
+        TEST_CHECK(pool.GetIdleCount() == 2);
+        TEST_CHECK(pool.GetIdleBytes() == 200);
+        TEST_CHECK(backend.destroyed.empty());
+    }
+
+    void EvictsLeastRecentlyParkedByCount()
+    {
+        Backend backend;
+        EncoderSessionPool<FakeKey, FakeSession> pool(1000, 2, backend.Callback());
+
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 1 }, 10);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 2 }, 10);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 3 }, 10);
+
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 1 }));
+        TEST_CHECK(pool.GetIdleCount() == 2);
+        TEST_CHECK(pool.GetIdleBytes() == 20);
+
+        // A session acquired then parked again becomes the most recent one.
+        auto session = pool.Acquire({ 0, 0, 640, 480 });
+        TEST_CHECK(session != nullptr && session->id == 3);
+        pool.Release({ 0, 0, 640, 480 }, session, 10);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 4 }, 10);
+
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 1, 2 }));
+    }
+
+    void EvictsLeastRecentlyParkedByBytes()
+    {
+        Backend backend;
+        EncoderSessionPool<FakeKey, FakeSession> pool(100, 8, backend.Callback());
+
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 1 }, 40);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 2 }, 40);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 3 }, 40);
+
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 1 }));
+        TEST_CHECK(pool.GetIdleBytes() == 80);
+
+        // A session larger than the whole budget is destroyed right away, after the older ones.
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 4 }, 150);
+
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 1, 2, 3, 4 }));
+        TEST_CHECK(pool.GetIdleCount() == 0);
+        TEST_CHECK(pool.GetIdleBytes() == 0);
+    }
+
+    void RemoveIfDestroysTheMatchingSessions()
+    {
+        Backend backend;
+        EncoderSessionPool<FakeKey, FakeSession> pool(1000, 8, backend.Callback());
+
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 1 }, 10);
+        pool.Release({ 1, 0, 640, 480 }, new FakeSession{ 2 }, 20);
+        pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 3 }, 30);
+
+        // E.g. the graphics device 0 was lost.
+        pool.RemoveIf([](const FakeKey& key) { return key.device == 0; });
+
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 3, 1 }));
+        TEST_CHECK(pool.GetIdleCount() == 1);
+        TEST_CHECK(pool.GetIdleBytes() == 20);
+
+        auto session = pool.Acquire({ 1, 0, 640, 480 });
+        TEST_CHECK(session != nullptr && session->id == 2);
+        delete session;
+    }
+
+    void DestroyCallbackOwnsTheParkedSessions()
+    {
+        Backend backend;
+        {
+            EncoderSessionPool<FakeKey, FakeSession> pool(1000, 8, backend.Callback());
+
+            pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 1 }, 10);
+            pool.Release({ 0, 0, 640, 480 }, new FakeSession{ 2 }, 10);
+            pool.Release({ 0, 0, 640, 480 }, nullptr, 10);
+
+            // An acquired session belongs to the caller again.
+            auto session = pool.Acquire({ 0, 0, 640, 480 });
+            TEST_CHECK(session != nullptr && session->id == 2);
+            delete session;
+
+            TEST_CHECK(backend.destroyed.empty());
+        }
+
+        // The pool destroys what is still parked.
+        TEST_CHECK(backend.destroyed == std::vector<int>({ 1 }));
+
+        // Without a callback the sessions are only forgotten.
+        FakeSession leftover = { 3 };
+        {
+            EncoderSessionPool<FakeKey, FakeSession> pool(1000, 8, nullptr);
+            pool.Release({ 0, 0, 640, 480 }, &leftover, 10);
+        }
+        TEST_CHECK(leftover.id == 3);
+    }
+}
+
+int main()
+{
+    TEST_RUN(AcquirePrefersTheBestMatch);
+    TEST_RUN(EvictsLeastRecentlyParkedByCount);
+    TEST_RUN(EvictsLeastRecentlyParkedByBytes);
+    TEST_RUN(RemoveIfDestroysTheMatchingSessions);
+    TEST_RUN(DestroyCallbackOwnsTheParkedSessions);
+    return 0;
+}
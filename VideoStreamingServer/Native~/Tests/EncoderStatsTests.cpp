@@ -0,0 +1,149 @@
+#include "EncoderStats.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    void BucketBounds()
+    {
+        // The buckets cover the whole range without gap or overlap.
+        TEST_CHECK(StatsHistogram::GetBucketLowerBound(0) == 0);
+        for (int i = 1; i < StatsHistogram::k_BucketCount; ++i)
+        {
+            TEST_CHECK(StatsHistogram::GetBucketUpperBound(i - 1) + 1 == StatsHistogram::GetBucketLowerBound(i));
+        }
+        TEST_CHECK(StatsHistogram::GetBucketUpperBound(StatsHistogram::k_BucketCount - 1) == UINT64_MAX);
+
+        // Each value falls in the bucket of its bounds, known to within 1/8 of itself below 2^40.
+        std::mt19937_64 random(1);
+        for (int i = 0; i < 200000; ++i)
+        {
+            const uint64_t value = (i < 1024) ? static_cast<uint64_t>(i) : random() >> (random() % 64);
+            const int index = StatsHistogram::GetBucketIndex(value);
+            TEST_CHECK(index >= 0 && index < StatsHistogram::k_BucketCount);
+
+            const auto lower = StatsHistogram::GetBucketLowerBound(index);
+            const auto upper = StatsHistogram::GetBucketUpperBound(index);
+            TEST_CHECK(lower <= value && value <= upper);
+
+            if (value < (uint64_t(1) << StatsHistogram::k_MaxExponent))
+            {
+                TEST_CHECK((upper - lower) * StatsHistogram::k_SubBucketCount <= value);
+            }
+        }
+
+        // Both ends of each bucket map back to it.
+        for (int i = 0; i < StatsHistogram::k_BucketCount; ++i)
+        {
+            TEST_CHECK(StatsHistogram::GetBucketIndex(StatsHistogram::GetBucketLowerBound(i)) == i);
+            TEST_CHECK(StatsHistogram::GetBucketIndex(StatsHistogram::GetBucketUpperBound(i)) == i);
+        }
+        TEST_CHECK(StatsHistogram::GetBucketIndex(UINT64_MAX) == StatsHistogram::k_BucketCount - 1);
+    }
+
+    void EmptySummary()
+    {
+        StatsHistogram histogram;
+        HistogramSummary summary;
+        histogram.Summarize(summary);
+        TEST_CHECK(summary.count == 0 && summary.min == 0 && summary.max == 0 && summary.p99 == 0);
+    }
+
+    void PercentilesWithinBucketPrecision()
+    {
+        StatsHistogram histogram;
+        std::vector<uint64_t> values;
+        std::mt19937_64 random(2);
+        for (int i = 0; i < 100000; ++i)
+        {
+            const uint64_t value = 1000 + random() % 10000000;
+            values.push_back(value);
+            histogram.Record(value);
+        }
+        std::sort(values.begin(), values.end());
+
+        HistogramSummary summary;
+        histogram.Summarize(summary);
+        TEST_CHECK(summary.count == values.size());
+        TEST_CHECK(summary.min == values.front() && summary.max == values.back());
+
+        // The percentile is the upper bound of the bucket holding the exact one.
+        const auto check = [&values](uint64_t percentile, int rank)
+        {
+            const auto exact = values[values.size() * rank / 100 - 1];
+            TEST_CHECK(percentile >= exact);
+            TEST_CHECK(percentile - exact <= exact / StatsHistogram::k_SubBucketCount);
+        };
+        check(summary.p50, 50);
+        check(summary.p90, 90);
+        check(summary.p99, 99);
+
+        // Clamped to the recorded range.
+        StatsHistogram single;
+        single.Record(1001);
+        single.Summarize(summary);
+        TEST_CHECK(summary.p50 == 1001 && summary.p99 == 1001 && summary.mean == 1001);
+
+        histogram.Reset();
+        histogram.Summarize(summary);
+        TEST_CHECK(summary.count == 0);
+    }
+
+    void ConcurrentRecording()
+    {
+        const int threadCount = 4;
+        const int count = 50000;
+
+        EncoderStats stats;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; ++t)
+        {
+            threads.emplace_back([&stats, t]()
+            {
+                for (int i = 0; i < count; ++i)
+                {
+                    stats.RecordSubmit();
+                    stats.RecordCopy(i);
+                    stats.RecordEncoded(i + 1, 100, i % 30 == 0, t);
+                    stats.RecordConsumed(5, 0);
+                }
+            });
+        }
+
+        // Snapshots taken while the counters are written.
+        EncoderStatsSnapshot snapshot;
+        for (int i = 0; i < 50; ++i)
+        {
+            stats.Snapshot(snapshot);
+            TEST_CHECK(snapshot.framesEncoded <= static_cast<uint64_t>(threadCount * count));
+        }
+        for (auto& thread : threads)
+        {
+            thread.join();
+        }
+
+        stats.Snapshot(snapshot);
+        TEST_CHECK(snapshot.framesSubmitted == threadCount * count);
+        TEST_CHECK(snapshot.framesEncoded == threadCount * count);
+        TEST_CHECK(snapshot.bytesEncoded == 100ull * threadCount * count);
+        TEST_CHECK(snapshot.maxQueueDepth == threadCount - 1);
+        TEST_CHECK(snapshot.encodeLatency.count == threadCount * count);
+        TEST_CHECK(snapshot.encodeLatency.min == 1 && snapshot.encodeLatency.max == count);
+        TEST_CHECK(snapshot.consumeLatency.p99 == 5);
+    }
+}
+
+int main()
+{
+    TEST_RUN(BucketBounds);
+    TEST_RUN(EmptySummary);
+    TEST_RUN(PercentilesWithinBucketPrecision);
+    TEST_RUN(ConcurrentRecording);
+    return 0;
+}
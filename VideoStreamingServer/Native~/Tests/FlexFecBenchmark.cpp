@@ -0,0 +1,108 @@
+#include "TestUtils.h"
+#include "FlexFec.h"
+
+#include <random>
+#include <vector>
+
+using namespace LiveCaptureNative;
+
+namespace
+{
+    std::vector<uint8_t> MakePacket(uint16_t sequence, size_t size)
+    {
+        std::vector<uint8_t> packet(size, static_cast<uint8_t>(sequence));
+        packet[0] = 0x80;
+        packet[1] = 96;
+        Rtp::SetSequenceNumber(packet.data(), sequence);
+        Rtp::SetSsrc(packet.data(), 7);
+        return packet;
+    }
+
+    // Last media sequence number protected by a repair packet, from its FlexFEC header.
+    uint16_t GetLastProtected(const std::vector<uint8_t>& repair)
+    {
+        const auto header = repair.data() + Rtp::k_HeaderSize + 4;
+        const auto base = Rtp::ReadUInt16(header + 8);
+        const bool isRow = (header[0] & 0x80) != 0;
+        return static_cast<uint16_t>(isRow ? base + header[10] - 1 : base + (header[11] - 1) * header[10]);
+    }
+}
+
+// Cost of the XOR kernel and of the encoder and decoder per 1200 byte packet, for rows of 10
+// and 5x5 blocks. The decoder receives the stream with 2% of the media packets lost.
+int main()
+{
+    std::vector<uint8_t> a(1500, 1);
+    std::vector<uint8_t> b(1500, 2);
+    const auto xorSeconds = Tests::Benchmark("XorInto 1200 B", 1000000, 1200, [&]()
+    {
+        FlexFec::Detail::XorInto(a.data(), b.data(), 1200);
+    });
+    const auto bytewiseSeconds = Tests::Benchmark("Bytewise XOR 1200 B", 100000, 1200, [&]()
+    {
+        for (size_t i = 0; i < 1200; ++i)
+        {
+            a[i] ^= b[i];
+        }
+    });
+    std::printf("XorInto: %.1fx the bytewise loop\n", bytewiseSeconds / xorSeconds);
+
+    std::vector<std::vector<uint8_t>> packets;
+    for (uint32_t i = 0; i < 65536; ++i)
+    {
+        packets.push_back(MakePacket(static_cast<uint16_t>(i), 1200));
+    }
+
+    const int32_t blocks[][2] = { { 10, 1 }, { 5, 5 } };
+    for (const auto& block : blocks)
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "Encode L=%d D=%d, per packet", block[0], block[1]);
+
+        FlexFecEncoder encoder(FlexFecSettings{ 0, 99, block[0], block[1], 0 });
+        std::vector<std::vector<uint8_t>> repairs;
+        size_t next = 0;
+        Tests::Benchmark(name, static_cast<int>(packets.size()), 1200, [&]()
+        {
+            const auto& packet = packets[next++];
+            encoder.Protect(packet.data(), packet.size(), [&repairs](const uint8_t* repair, size_t size)
+            {
+                repairs.emplace_back(repair, repair + size);
+            });
+        });
+
+        // The repair packets are received once the media packets they protect were sent.
+        std::snprintf(name, sizeof(name), "Decode L=%d D=%d, per packet", block[0], block[1]);
+
+        FlexFecDecoder decoder(99);
+        std::mt19937 random(5);
+        size_t lost = 0;
+        size_t recovered = 0;
+        size_t nextRepair = 0;
+        next = 0;
+        Tests::Benchmark(name, static_cast<int>(packets.size()), 1200, [&]()
+        {
+            const auto sequence = static_cast<uint16_t>(next);
+            const auto& packet = packets[next++];
+            if (random() % 50 != 0)
+            {
+                decoder.Receive(packet.data(), packet.size(), [&recovered](const uint8_t*, size_t) { ++recovered; });
+            }
+            else
+            {
+                ++lost;
+            }
+
+            while (nextRepair < repairs.size() && Rtp::SequenceDelta(GetLastProtected(repairs[nextRepair]), sequence) >= 0)
+            {
+                const auto& repair = repairs[nextRepair++];
+                decoder.Receive(repair.data(), repair.size(), [&recovered](const uint8_t*, size_t) { ++recovered; });
+            }
+        });
+        std::printf("%zu of %zu lost packets recovered\n", recovered, lost);
+
+        TEST_CHECK(!repairs.empty());
+        TEST_CHECK(recovered > 0 && recovered <= lost);
+    }
+    return 0;
+}
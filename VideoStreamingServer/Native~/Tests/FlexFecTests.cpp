@@ -0,0 +1,249 @@
+#include "FlexFec.h"
+#include "TestUtils.h"
+#include "UdpLoopback.h"
+
+#include <random>
+#include <set>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const uint32_t k_MediaSsrc = 7;
+    const uint32_t k_RepairSsrc = 99;
+
+    std::vector<uint8_t> MakePacket(uint16_t sequence, size_t size, bool marker)
+    {
+        std::vector<uint8_t> packet(size);
+        packet[0] = 0x80;
+        packet[1] = static_cast<uint8_t>((marker ? 0x80 : 0) | 96);
+        Rtp::SetSequenceNumber(packet.data(), sequence);
+        Rtp::WriteUInt32(packet.data() + 4, sequence / 7 * 3000u);
+        Rtp::SetSsrc(packet.data(), k_MediaSsrc);
+        for (size_t i = Rtp::k_HeaderSize; i < size; ++i)
+        {
+            packet[i] = static_cast<uint8_t>(sequence * 31 + i * 7);
+        }
+        return packet;
+    }
+
+    void XorMatchesBytewise()
+    {
+        std::mt19937 random(1);
+        std::vector<uint8_t> src(300);
+        std::vector<uint8_t> dst(300);
+        for (size_t size = 0; size < 200; ++size)
+        {
+            for (size_t offset = 0; offset < 4; ++offset)
+            {
+                for (size_t i = 0; i < src.size(); ++i)
+                {
+                    src[i] = static_cast<uint8_t>(random());
+                    dst[i] = static_cast<uint8_t>(random());
+                }
+
+                auto expected = dst;
+                for (size_t i = 0; i < size; ++i)
+                {
+                    expected[offset + i] ^= src[i + 1];
+                }
+
+                FlexFec::Detail::XorInto(dst.data() + offset, src.data() + 1, size);
+                TEST_CHECK(dst == expected);
+            }
+        }
+    }
+
+    void RecoversTheLossesOfABlock()
+    {
+        // A 5x5 block: any single loss is repaired by its row, any pair by rows or columns.
+        for (int first = 0; first < 25; ++first)
+        {
+            for (int second = -1; second < 25; ++second)
+            {
+                FlexFecEncoder encoder(FlexFecSettings{ 0, k_RepairSsrc, 5, 5, 0 });
+                FlexFecDecoder decoder(k_RepairSsrc);
+
+                // Across the sequence number wrap, of different sizes.
+                std::vector<std::vector<uint8_t>> packets;
+                std::vector<std::vector<uint8_t>> repairs;
+                for (int i = 0; i < 25; ++i)
+                {
+                    packets.push_back(MakePacket(static_cast<uint16_t>(65530 + i), 20 + i * 13, i == 24));
+                    encoder.Protect(packets.back().data(), packets.back().size(), [&repairs](const uint8_t* repair, size_t size)
+                    {
+                        repairs.emplace_back(repair, repair + size);
+                    });
+                }
+                TEST_CHECK(repairs.size() == 10);
+
+                for (int i = 0; i < 25; ++i)
+                {
+                    if (i != first && i != second)
+                    {
+                        decoder.Receive(packets[i].data(), packets[i].size(), [](const uint8_t*, size_t) { TEST_CHECK(false); });
+                    }
+                }
+
+                int recovered = 0;
+                for (const auto& repair : repairs)
+                {
+                    decoder.Receive(repair.data(), repair.size(), [&](const uint8_t* packet, size_t size)
+                    {
+                        const auto index = static_cast<uint16_t>(Rtp::GetSequenceNumber(packet) - 65530);
+                        TEST_CHECK(index < 25);
+                        TEST_CHECK(packets[index].size() == size && std::memcmp(packets[index].data(), packet, size) == 0);
+                        ++recovered;
+                    });
+                }
+                TEST_CHECK(recovered == ((second < 0 || second == first) ? 1 : 2));
+            }
+        }
+    }
+
+    void GapRestartsTheBlock()
+    {
+        FlexFecEncoder encoder(FlexFecSettings{ 0, k_RepairSsrc, 4, 1, 0 });
+
+        // Packet 4 was never protected: the row starting at 1 is abandoned, the next one starts at 5.
+        int repairs = 0;
+        for (const uint16_t sequence : { 1, 2, 3, 5, 6, 7, 8 })
+        {
+            const auto packet = MakePacket(sequence, 100, false);
+            encoder.Protect(packet.data(), packet.size(), [&repairs](const uint8_t* repair, size_t)
+            {
+                TEST_CHECK(Rtp::GetSsrc(repair) == k_RepairSsrc);
+                TEST_CHECK(Rtp::ReadUInt32(repair + Rtp::k_HeaderSize) == k_MediaSsrc);
+                TEST_CHECK(Rtp::ReadUInt16(repair + Rtp::k_HeaderSize + 4 + 8) == 5);
+                ++repairs;
+            });
+        }
+        TEST_CHECK(repairs == 1);
+
+        FlexFecStats stats;
+        encoder.GetStats(stats);
+        TEST_CHECK(stats.blocksAbandoned == 1);
+    }
+
+    void AdaptsToTheReportedLoss()
+    {
+        // A receiver report of 25% (64/256) lost and a cumulative loss of -2 (duplicates).
+        uint8_t report[32] = { 0x81, 201, 0, 7 };
+        Rtp::WriteUInt32(report + 8, 0xabc);
+        report[12] = 64;
+        report[13] = 0xff;
+        report[14] = 0xff;
+        report[15] = 0xfe;
+
+        int blocks = 0;
+        TEST_CHECK(Rtcp::ForEachReportBlock(report, sizeof(report), [&blocks](const Rtcp::ReportBlock& block)
+        {
+            TEST_CHECK(block.ssrc == 0xabc && block.fractionLost == 64 && block.cumulativeLost == -2);
+            ++blocks;
+        }));
+        TEST_CHECK(blocks == 1);
+
+        FlexFecEncoder encoder(FlexFecSettings{ 0, k_RepairSsrc, 0, 0, 1 });
+        for (int i = 0; i < 20; ++i)
+        {
+            encoder.OnLoss(0.08f);
+        }
+
+        // The protection changes at the start of a block.
+        const auto first = MakePacket(1, 100, false);
+        encoder.Protect(first.data(), first.size(), [](const uint8_t*, size_t) {});
+        FlexFecStats stats;
+        encoder.GetStats(stats);
+        TEST_CHECK(stats.columns == 8 && stats.rows == 8);
+
+        // Without loss, the protection stops after the block.
+        for (int i = 0; i < 40; ++i)
+        {
+            encoder.OnLoss(0.0f);
+        }
+        for (uint16_t sequence = 2; sequence < 70; ++sequence)
+        {
+            const auto packet = MakePacket(sequence, 100, false);
+            encoder.Protect(packet.data(), packet.size(), [](const uint8_t*, size_t) {});
+        }
+        encoder.GetStats(stats);
+        TEST_CHECK(stats.columns == 0);
+    }
+
+    void RecoversLossesOverTheLoopback()
+    {
+        const size_t count = 5000;
+        const uint32_t lossPercent = 3;
+
+        Tests::UdpLoopback sender;
+        Tests::UdpLoopback receiver;
+        FlexFecEncoder encoder(FlexFecSettings{ 0, k_RepairSsrc, 5, 5, 0 });
+        FlexFecDecoder decoder(k_RepairSsrc);
+
+        std::mt19937 random(11);
+        std::vector<std::vector<uint8_t>> packets;
+        for (size_t i = 0; i < count; ++i)
+        {
+            packets.push_back(MakePacket(static_cast<uint16_t>(i), 200 + random() % 1000, false));
+        }
+
+        // The media and the repair packets are lost at the same rate.
+        size_t lost = 0;
+        const auto send = [&](const uint8_t* packet, size_t size)
+        {
+            if (random() % 100 < lossPercent)
+            {
+                lost += (Rtp::GetSsrc(packet) == k_MediaSsrc) ? 1 : 0;
+                return;
+            }
+            sender.SendTo(receiver.GetPort(), packet, size);
+        };
+
+        std::set<uint16_t> delivered;
+        const auto onRecovered = [&](const uint8_t* packet, size_t size)
+        {
+            const auto sequence = Rtp::GetSequenceNumber(packet);
+            TEST_CHECK(sequence < count && delivered.count(sequence) == 0);
+            TEST_CHECK(packets[sequence].size() == size && std::memcmp(packets[sequence].data(), packet, size) == 0);
+            delivered.insert(sequence);
+        };
+
+        uint8_t packet[Rtp::k_MaxPacketSize];
+        for (const auto& media : packets)
+        {
+            send(media.data(), media.size());
+            encoder.Protect(media.data(), media.size(), send);
+
+            int size;
+            while ((size = receiver.Receive(packet, sizeof(packet))) >= 0)
+            {
+                if (Rtp::GetSsrc(packet) == k_MediaSsrc)
+                {
+                    delivered.insert(Rtp::GetSequenceNumber(packet));
+                }
+                decoder.Receive(packet, size, onRecovered);
+            }
+        }
+
+        FlexFecDecoderStats stats;
+        decoder.GetStats(stats);
+        const auto residual = count - delivered.size();
+        std::printf("%zu of %zu packets lost, %llu recovered, %zu missing\n",
+                    lost, count, static_cast<unsigned long long>(stats.packetsRecovered), residual);
+
+        TEST_CHECK(lost > count / 50);
+        TEST_CHECK(stats.packetsRecovered > 0 && stats.packetsRecovered <= lost);
+        TEST_CHECK(residual == lost - stats.packetsRecovered);
+        TEST_CHECK(residual * 10 < lost);
+    }
+}
+
+int main()
+{
+    TEST_RUN(XorMatchesBytewise);
+    TEST_RUN(RecoversTheLossesOfABlock);
+    TEST_RUN(GapRestartsTheBlock);
+    TEST_RUN(AdaptsToTheReportedLoss);
+    TEST_RUN(RecoversLossesOverTheLoopback);
+    return 0;
+}
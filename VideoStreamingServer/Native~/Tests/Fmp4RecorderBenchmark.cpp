@@ -0,0 +1,113 @@
+#include "TestUtils.h"
+#include "Fmp4Recorder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace LiveCaptureNative;
+
+namespace
+{
+    const char* const k_Path = "Fmp4RecorderBenchmark.mp4";
+    const uint8_t k_Sps[] = { 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8 };
+    const uint8_t k_Pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+
+    // A frame of one NAL unit, with its start code.
+    std::vector<uint8_t> MakeFrame(size_t frameSize)
+    {
+        std::vector<uint8_t> frame(4 + frameSize, 0x55);
+        frame[0] = 0;
+        frame[1] = 0;
+        frame[2] = 0;
+        frame[3] = 1;
+        return frame;
+    }
+
+    bool WriteFrame(Fmp4Recorder& recorder, std::vector<uint8_t>& frame, int index, int gopSize, uint64_t frameDurationNs)
+    {
+        const bool isKeyFrame = (index % gopSize) == 0;
+        frame[4] = isKeyFrame ? 0x65 : 0x41;
+
+        return recorder.WriteFrame(frame.data(), frame.size(), 1000000000ull + index * frameDurationNs, isKeyFrame,
+                                   isKeyFrame ? k_Sps : nullptr, isKeyFrame ? sizeof(k_Sps) : 0,
+                                   isKeyFrame ? k_Pps : nullptr, isKeyFrame ? sizeof(k_Pps) : 0);
+    }
+}
+
+// Cost of recording 20 KB frames: WriteFrame alone, then WriteFrame with the writer thread
+// appending every fragment to the file, the producer blocking on it so that nothing is dropped.
+// Then a 240 fps stream of 100 KB frames, paced as an encoder would deliver it: the writer must
+// keep up without the recorder dropping a frame.
+int main()
+{
+    const int k_FrameCount = 600;
+    const size_t k_FrameSize = 20000;
+    const uint64_t k_FrameDurationNs = 16666667;
+
+    auto frame = MakeFrame(k_FrameSize);
+
+    // Short fragments, so that the writer runs all along.
+    const Fmp4RecorderSettings settings = { 250, 0 };
+
+    Fmp4Recorder recorder;
+    recorder.SetBlocking(true);
+
+    TEST_CHECK(recorder.Open(k_Path, 1920, 1080, settings));
+    int index = 0;
+    bool succeeded = true;
+    Tests::Benchmark("WriteFrame, 20 KB frames", k_FrameCount, frame.size(), [&]()
+    {
+        succeeded &= WriteFrame(recorder, frame, index++, 15, k_FrameDurationNs);
+    });
+    recorder.Close();
+    TEST_CHECK(succeeded);
+
+    Fmp4RecorderStats stats;
+    const auto fileSeconds = Tests::Benchmark("WriteFrame and writer thread, 20 KB frames", 5, k_FrameCount * frame.size(), [&]()
+    {
+        TEST_CHECK(recorder.Open(k_Path, 1920, 1080, settings));
+        for (int i = 0; i < k_FrameCount; ++i)
+        {
+            succeeded &= WriteFrame(recorder, frame, i, 15, k_FrameDurationNs);
+        }
+        recorder.Close();
+
+        recorder.GetStats(stats);
+        TEST_CHECK(stats.framesRecorded == static_cast<uint64_t>(k_FrameCount));
+        TEST_CHECK(stats.droppedFrames == 0);
+    });
+    TEST_CHECK(succeeded);
+    std::printf("%.1f us per 20 KB frame, %.1f MB/s written to the file\n",
+                fileSeconds * 1e6 / k_FrameCount, stats.bytesWritten / fileSeconds / 1e6);
+
+    // Real time: two seconds at 240 fps, a key frame every quarter second.
+    const int k_RealTimeFrameCount = 480;
+    const uint64_t k_RealTimeFrameDurationNs = 1000000000ull / 240;
+    auto largeFrame = MakeFrame(100000);
+
+    Fmp4Recorder realTimeRecorder;
+    TEST_CHECK(realTimeRecorder.Open(k_Path, 1920, 1080, Fmp4RecorderSettings{ 0, 0 }));
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < k_RealTimeFrameCount; ++i)
+    {
+        std::this_thread::sleep_until(start + std::chrono::nanoseconds(i * k_RealTimeFrameDurationNs));
+        WriteFrame(realTimeRecorder, largeFrame, i, 60, k_RealTimeFrameDurationNs);
+    }
+    realTimeRecorder.Close();
+
+    realTimeRecorder.GetStats(stats);
+    std::printf("240 fps, 100 KB frames: %llu frames recorded, %llu dropped, %llu fragments\n",
+                static_cast<unsigned long long>(stats.framesRecorded),
+                static_cast<unsigned long long>(stats.droppedFrames),
+                static_cast<unsigned long long>(stats.fragmentsWritten));
+
+    TEST_CHECK(stats.error == static_cast<int32_t>(Fmp4RecorderError::None));
+    TEST_CHECK(stats.framesRecorded == static_cast<uint64_t>(k_RealTimeFrameCount));
+    TEST_CHECK(stats.droppedFrames == 0);
+
+    std::remove(k_Path);
+    return 0;
+}
@@ -0,0 +1,155 @@
+#include "Fmp4Recorder.h"
+#include "Mp4Checker.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const char* const k_Path = "Fmp4RecorderTests.mp4";
+    const uint8_t k_Sps[] = { 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8 };
+    const uint8_t k_Pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+    const uint64_t k_FrameDurationNs = 16666667;
+
+    // Writes frames of one NAL unit, a key frame every gopSize frames. Returns the frames accepted.
+    int WriteFrames(Fmp4Recorder& recorder, int first, int count, int gopSize, size_t frameSize)
+    {
+        std::vector<uint8_t> frame(4 + frameSize, 0x55);
+        frame[0] = 0;
+        frame[1] = 0;
+        frame[2] = 0;
+        frame[3] = 1;
+
+        int accepted = 0;
+        for (int i = first; i < first + count; ++i)
+        {
+            const bool isKeyFrame = (i % gopSize) == 0;
+            frame[4] = isKeyFrame ? 0x65 : 0x41;
+
+            if (recorder.WriteFrame(frame.data(), frame.size(), 1000000000ull + i * k_FrameDurationNs, isKeyFrame,
+                                    isKeyFrame ? k_Sps : nullptr, isKeyFrame ? sizeof(k_Sps) : 0,
+                                    isKeyFrame ? k_Pps : nullptr, isKeyFrame ? sizeof(k_Pps) : 0))
+            {
+                ++accepted;
+            }
+        }
+        return accepted;
+    }
+
+    void RecordsAValidFile()
+    {
+        Fmp4Recorder recorder;
+        recorder.SetBlocking(true);
+        TEST_CHECK(recorder.Open(k_Path, 1920, 1080, Fmp4RecorderSettings{ 0, 0 }));
+        TEST_CHECK(WriteFrames(recorder, 0, 300, 30, 20000) == 300);
+        recorder.Close();
+
+        Fmp4RecorderStats stats;
+        recorder.GetStats(stats);
+        TEST_CHECK(stats.status == static_cast<int32_t>(Fmp4RecorderStatus::Stopped));
+        TEST_CHECK(stats.error == static_cast<int32_t>(Fmp4RecorderError::None));
+
+        Tests::Mp4Summary summary;
+        Tests::CheckFragmentedMp4(k_Path, summary);
+        TEST_CHECK(summary.width == 1920 && summary.height == 1080);
+        TEST_CHECK(std::search(summary.avcC.begin(), summary.avcC.end(), k_Sps, k_Sps + sizeof(k_Sps)) != summary.avcC.end());
+        TEST_CHECK(std::search(summary.avcC.begin(), summary.avcC.end(), k_Pps, k_Pps + sizeof(k_Pps)) != summary.avcC.end());
+
+        // A fragment per second, cut at the key frames: 60 frames each.
+        TEST_CHECK(summary.fragmentOffsets.size() == 5);
+        TEST_CHECK(summary.samples.size() == 300);
+        for (size_t i = 0; i < summary.samples.size(); ++i)
+        {
+            const auto& sample = summary.samples[i];
+            TEST_CHECK(sample.isKeyFrame == (i % 30 == 0));
+            TEST_CHECK(sample.size == 4 + 20000);
+            TEST_CHECK(sample.duration == 1500);
+            TEST_CHECK(sample.decodeTime == i * 1500);
+        }
+
+        TEST_CHECK(stats.framesRecorded == 300);
+        TEST_CHECK(stats.droppedFrames == 0);
+        TEST_CHECK(stats.fragmentsWritten == summary.fragmentOffsets.size());
+        TEST_CHECK(stats.bytesWritten == summary.fileSize);
+        TEST_CHECK(stats.duration == 299 * k_FrameDurationNs);
+    }
+
+    void StartsAtTheFirstKeyFrame()
+    {
+        Fmp4Recorder recorder;
+        recorder.SetBlocking(true);
+        TEST_CHECK(recorder.Open(k_Path, 640, 360, Fmp4RecorderSettings{ 0, 0 }));
+
+        // Frames 1 to 29 can't be decoded, frame 30 is the first key frame.
+        TEST_CHECK(WriteFrames(recorder, 1, 89, 30, 1000) == 60);
+        recorder.Close();
+
+        Tests::Mp4Summary summary;
+        Tests::CheckFragmentedMp4(k_Path, summary);
+        TEST_CHECK(summary.samples.size() == 60);
+        TEST_CHECK(summary.samples.front().isKeyFrame && summary.samples.front().decodeTime == 0);
+    }
+
+    void CutsFullFragments()
+    {
+        Fmp4Recorder recorder;
+        recorder.SetBlocking(true);
+        TEST_CHECK(recorder.Open(k_Path, 640, 360, Fmp4RecorderSettings{ 0, 10 * 1004 }));
+
+        // Ten frames per fragment buffer, a key frame every 100.
+        TEST_CHECK(WriteFrames(recorder, 0, 200, 100, 1000) == 200);
+
+        // Larger than a fragment buffer: dropped, and the frames up to the next key frame too.
+        TEST_CHECK(WriteFrames(recorder, 200, 1, 100, 20000) == 0);
+        TEST_CHECK(WriteFrames(recorder, 201, 99, 100, 1000) == 0);
+        TEST_CHECK(WriteFrames(recorder, 300, 1, 100, 1000) == 1);
+        recorder.Close();
+
+        Fmp4RecorderStats stats;
+        recorder.GetStats(stats);
+        TEST_CHECK(stats.framesRecorded == 201);
+        TEST_CHECK(stats.droppedFrames == 100);
+
+        Tests::Mp4Summary summary;
+        Tests::CheckFragmentedMp4(k_Path, summary);
+        TEST_CHECK(summary.samples.size() == 201);
+        TEST_CHECK(summary.fragmentOffsets.size() == 21);
+        TEST_CHECK(summary.samples.back().isKeyFrame);
+    }
+
+    void StopsOnParameterSetChange()
+    {
+        Fmp4Recorder recorder;
+        recorder.SetBlocking(true);
+        TEST_CHECK(recorder.Open(k_Path, 640, 360, Fmp4RecorderSettings{ 0, 0 }));
+        TEST_CHECK(WriteFrames(recorder, 0, 45, 30, 1000) == 45);
+
+        // A new resolution: the recording fails, the frames before stay readable.
+        const uint8_t sps[] = { 0x67, 0x64, 0x00, 0x28, 0xac, 0x2b, 0x40, 0x3c, 0x01 };
+        const uint8_t frame[] = { 0, 0, 0, 1, 0x65, 0x88, 0x84 };
+        TEST_CHECK(!recorder.WriteFrame(frame, sizeof(frame), 2000000000ull, true, sps, sizeof(sps), k_Pps, sizeof(k_Pps)));
+        TEST_CHECK(WriteFrames(recorder, 60, 1, 30, 1000) == 0);
+        recorder.Close();
+
+        Fmp4RecorderStats stats;
+        recorder.GetStats(stats);
+        TEST_CHECK(stats.status == static_cast<int32_t>(Fmp4RecorderStatus::Failed));
+        TEST_CHECK(stats.error == static_cast<int32_t>(Fmp4RecorderError::ParameterSetsChanged));
+
+        Tests::Mp4Summary summary;
+        Tests::CheckFragmentedMp4(k_Path, summary);
+        TEST_CHECK(summary.samples.size() == 45);
+    }
+}
+
+int main()
+{
+    TEST_RUN(RecordsAValidFile);
+    TEST_RUN(StartsAtTheFirstKeyFrame);
+    TEST_RUN(CutsFullFragments);
+    TEST_RUN(StopsOnParameterSetChange);
+    std::remove(k_Path);
+    return 0;
+}
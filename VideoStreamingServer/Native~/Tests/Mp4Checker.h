@@ -0,0 +1,291 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "TestUtils.h"
+
+namespace LiveCaptureNative
+{
+    namespace Tests
+    {
+        // What CheckFragmentedMp4() read from a file.
+        struct Mp4Sample
+        {
+            uint64_t decodeTime;
+            uint32_t duration;
+            uint32_t size;
+            bool     isKeyFrame;
+        };
+
+        struct Mp4Summary
+        {
+            uint32_t                width = 0;
+            uint32_t                height = 0;
+            std::vector<uint8_t>    avcC;
+            std::vector<uint64_t>   fragmentOffsets;
+            std::vector<Mp4Sample>  samples;
+            uint64_t                fileSize = 0;
+        };
+
+        inline std::vector<uint8_t> ReadFile(const char* path)
+        {
+            std::vector<uint8_t> data;
+            std::FILE* file = std::fopen(path, "rb");
+            TEST_CHECK(file != nullptr);
+
+            uint8_t buffer[65536];
+            size_t read;
+            while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+            {
+                data.insert(data.end(), buffer, buffer + read);
+            }
+            std::fclose(file);
+            return data;
+        }
+
+        // Walks the boxes of a fragmented MP4 as written by Fmp4Muxer and checks its structure:
+        // ftyp, moov, then moof + mdat pairs, and the mfra trailer indexing every moof. The samples
+        // must be AVCC, the decode times strictly increasing, and the fragments numbered in order.
+        // Fails the test on the first inconsistency.
+        class Mp4Checker final
+        {
+        public:
+            explicit Mp4Checker(const std::vector<uint8_t>& data) :
+                m_Data(data)
+            {
+            }
+
+            void Check(Mp4Summary& summary)
+            {
+                summary = Mp4Summary();
+                summary.fileSize = m_Data.size();
+
+                std::vector<Box> top;
+                ReadBoxes(0, m_Data.size(), top);
+                TEST_CHECK(top.size() >= 3);
+                TEST_CHECK(top.front().type == "ftyp");
+                TEST_CHECK(top[1].type == "moov");
+                TEST_CHECK(top.back().type == "mfra");
+
+                CheckMovie(top[1], summary);
+
+                uint32_t sequenceNumber = 0;
+                uint64_t nextDecodeTime = 0;
+                for (size_t i = 2; i + 1 < top.size(); i += 2)
+                {
+                    TEST_CHECK(top[i].type == "moof");
+                    TEST_CHECK(top[i + 1].type == "mdat");
+                    CheckFragment(top[i], top[i + 1], sequenceNumber, nextDecodeTime, summary);
+                }
+                TEST_CHECK(top.size() % 2 == 1);
+
+                CheckIndex(top.back(), summary);
+            }
+
+        private:
+            struct Box
+            {
+                std::string type;
+                size_t      offset;
+                size_t      size;
+
+                size_t Begin() const { return offset + 8; }
+                size_t End() const { return offset + size; }
+            };
+
+            uint32_t U32(size_t offset) const
+            {
+                TEST_CHECK(offset + 4 <= m_Data.size());
+                return (static_cast<uint32_t>(m_Data[offset]) << 24) | (static_cast<uint32_t>(m_Data[offset + 1]) << 16) |
+                       (static_cast<uint32_t>(m_Data[offset + 2]) << 8) | m_Data[offset + 3];
+            }
+
+            uint64_t U64(size_t offset) const
+            {
+                return (static_cast<uint64_t>(U32(offset)) << 32) | U32(offset + 4);
+            }
+
+            uint16_t U16(size_t offset) const
+            {
+                TEST_CHECK(offset + 2 <= m_Data.size());
+                return static_cast<uint16_t>((m_Data[offset] << 8) | m_Data[offset + 1]);
+            }
+
+            // The boxes must tile [begin, end) exactly.
+            void ReadBoxes(size_t begin, size_t end, std::vector<Box>& boxes) const
+            {
+                boxes.clear();
+                size_t offset = begin;
+                while (offset < end)
+                {
+                    TEST_CHECK(end - offset >= 8);
+                    Box box;
+                    box.offset = offset;
+                    box.size = U32(offset);
+                    box.type.assign(reinterpret_cast<const char*>(&m_Data[offset + 4]), 4);
+                    TEST_CHECK(box.size >= 8 && box.size <= end - offset);
+                    boxes.push_back(box);
+                    offset += box.size;
+                }
+                TEST_CHECK(offset == end);
+            }
+
+            Box Find(const std::vector<Box>& boxes, const char* type) const
+            {
+                for (const auto& box : boxes)
+                {
+                    if (box.type == type)
+                        return box;
+                }
+                std::fprintf(stderr, "missing %s box\n", type);
+                TEST_CHECK(false);
+                return boxes.front();
+            }
+
+            std::vector<Box> Children(const Box& box, size_t headerSize = 0) const
+            {
+                std::vector<Box> children;
+                ReadBoxes(box.Begin() + headerSize, box.End(), children);
+                return children;
+            }
+
+            void CheckMovie(const Box& moov, Mp4Summary& summary) const
+            {
+                const auto movie = Children(moov);
+                Find(movie, "mvhd");
+                Find(Children(Find(movie, "mvex")), "trex");
+
+                const auto track = Children(Find(movie, "trak"));
+                const auto tkhd = Find(track, "tkhd");
+                summary.width = U32(tkhd.End() - 8) >> 16;
+                summary.height = U32(tkhd.End() - 4) >> 16;
+
+                const auto media = Children(Find(track, "mdia"));
+                Find(media, "mdhd");
+                Find(media, "hdlr");
+
+                const auto sampleTable = Children(Find(Children(Find(media, "minf")), "stbl"));
+                const auto stsd = Find(sampleTable, "stsd");
+                TEST_CHECK(U32(stsd.Begin() + 4) == 1);
+
+                // The avc1 sample entry: 78 bytes of fields before its boxes.
+                const auto entries = Children(stsd, 8);
+                const auto avc1 = Find(entries, "avc1");
+                TEST_CHECK(U16(avc1.Begin() + 24) == summary.width);
+                TEST_CHECK(U16(avc1.Begin() + 26) == summary.height);
+
+                const auto avcC = Find(Children(avc1, 78), "avcC");
+                summary.avcC.assign(m_Data.begin() + avcC.Begin(), m_Data.begin() + avcC.End());
+                TEST_CHECK(!summary.avcC.empty() && summary.avcC[0] == 1);
+            }
+
+            void CheckFragment(const Box& moof,
+                               const Box& mdat,
+                               uint32_t& sequenceNumber,
+                               uint64_t& nextDecodeTime,
+                               Mp4Summary& summary) const
+            {
+                summary.fragmentOffsets.push_back(moof.offset);
+
+                const auto fragment = Children(moof);
+                const auto mfhd = Find(fragment, "mfhd");
+                const auto number = U32(mfhd.Begin() + 4);
+                TEST_CHECK(number > sequenceNumber);
+                sequenceNumber = number;
+
+                const auto trackFragment = Children(Find(fragment, "traf"));
+                Find(trackFragment, "tfhd");
+
+                const auto tfdt = Find(trackFragment, "tfdt");
+                TEST_CHECK(m_Data[tfdt.Begin()] == 1);
+                auto decodeTime = U64(tfdt.Begin() + 4);
+                TEST_CHECK(decodeTime >= nextDecodeTime);
+
+                const auto trun = Find(trackFragment, "trun");
+                TEST_CHECK((U32(trun.Begin()) & 0xFFFFFF) == 0x000701);
+                const auto sampleCount = U32(trun.Begin() + 4);
+                TEST_CHECK(sampleCount > 0);
+                TEST_CHECK(trun.size == 8 + 12 + 12 * static_cast<size_t>(sampleCount));
+
+                // The data offset is relative to the moof and points right after the mdat header.
+                TEST_CHECK(moof.offset + U32(trun.Begin() + 8) == mdat.Begin());
+
+                size_t payloadSize = 0;
+                for (uint32_t i = 0; i < sampleCount; ++i)
+                {
+                    const auto entry = trun.Begin() + 12 + 12 * static_cast<size_t>(i);
+                    Mp4Sample sample;
+                    sample.decodeTime = decodeTime;
+                    sample.duration = U32(entry);
+                    sample.size = U32(entry + 4);
+                    const auto flags = U32(entry + 8);
+                    TEST_CHECK(flags == 0x02000000 || flags == 0x01010000);
+                    sample.isKeyFrame = flags == 0x02000000;
+                    TEST_CHECK(sample.duration > 0);
+
+                    CheckAvccSample(mdat.Begin() + payloadSize, sample.size);
+
+                    payloadSize += sample.size;
+                    decodeTime += sample.duration;
+                    summary.samples.push_back(sample);
+                }
+                TEST_CHECK(payloadSize == mdat.size - 8);
+                nextDecodeTime = decodeTime;
+            }
+
+            void CheckAvccSample(size_t offset, size_t size) const
+            {
+                const auto end = offset + size;
+                while (offset < end)
+                {
+                    TEST_CHECK(end - offset >= 4);
+                    const auto nalSize = U32(offset);
+                    TEST_CHECK(nalSize > 0 && nalSize <= end - offset - 4);
+                    offset += 4 + nalSize;
+                }
+                TEST_CHECK(offset == end);
+            }
+
+            void CheckIndex(const Box& mfra, const Mp4Summary& summary) const
+            {
+                // The mfro at the end of the file gives the size of the mfra.
+                TEST_CHECK(U32(m_Data.size() - 4) == mfra.size);
+
+                const auto index = Children(mfra);
+                Find(index, "mfro");
+                const auto tfra = Find(index, "tfra");
+                TEST_CHECK(m_Data[tfra.Begin()] == 1);
+
+                const auto count = U32(tfra.Begin() + 12);
+                TEST_CHECK(count == summary.fragmentOffsets.size());
+                TEST_CHECK(tfra.size == 8 + 16 + 19 * static_cast<size_t>(count));
+
+                size_t sample = 0;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    const auto entry = tfra.Begin() + 16 + 19 * static_cast<size_t>(i);
+                    TEST_CHECK(U64(entry + 8) == summary.fragmentOffsets[i]);
+
+                    // The time of the entry is the decode time of the first sample of the fragment.
+                    while (sample < summary.samples.size() && summary.samples[sample].decodeTime < U64(entry))
+                    {
+                        ++sample;
+                    }
+                    TEST_CHECK(sample < summary.samples.size() && summary.samples[sample].decodeTime == U64(entry));
+                }
+            }
+
+            const std::vector<uint8_t>& m_Data;
+        };
+
+        inline void CheckFragmentedMp4(const char* path, Mp4Summary& summary)
+        {
+            const auto data = ReadFile(path);
+            Mp4Checker(data).Check(summary);
+        }
+    }
+}
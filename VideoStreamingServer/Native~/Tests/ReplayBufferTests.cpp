@@ -0,0 +1,307 @@
+#include "ReplayBuffer.h"
+#include "TestUtils.h"
+
+#include <random>
+#include <vector>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const uint8_t k_Sps[] = { 0x67, 0x42, 0xc0, 0x1f, 0xda, 0x01, 0x40, 0x16, 0xe8 };
+    const uint8_t k_Pps[] = { 0x68, 0xce, 0x3c, 0x80 };
+    const uint64_t k_FrameDurationNs = 16666667;
+
+    // An Annex B frame tagged with its timestamp, to check that the stored bytes are the right ones.
+    std::vector<uint8_t> MakeFrame(size_t size, bool isKeyFrame, uint64_t timestamp)
+    {
+        std::vector<uint8_t> frame(size, 0x55);
+        frame[0] = 0;
+        frame[1] = 0;
+        frame[2] = 0;
+        frame[3] = 1;
+        frame[4] = isKeyFrame ? 0x65 : 0x41;
+        std::memcpy(&frame[5], &timestamp, sizeof(timestamp));
+        return frame;
+    }
+
+    bool Append(ReplayBuffer& buffer, size_t size, bool isKeyFrame, uint64_t timestamp)
+    {
+        const auto frame = MakeFrame(size, isKeyFrame, timestamp);
+        return buffer.Append(frame.data(), frame.size(), timestamp, isKeyFrame,
+                             k_Sps, sizeof(k_Sps), k_Pps, sizeof(k_Pps));
+    }
+
+    uint64_t GetTag(const ReplayFrame& frame)
+    {
+        uint64_t tag;
+        std::memcpy(&tag, frame.data + 5, sizeof(tag));
+        return tag;
+    }
+
+    void CheckFrames(const ReplayRange& range)
+    {
+        TEST_CHECK(range.GetFrameCount() > 0);
+
+        const auto first = range.GetFrame(0);
+        TEST_CHECK(first.isKeyFrame);
+
+        uint64_t previous = 0;
+        for (size_t i = 0; i < range.GetFrameCount(); ++i)
+        {
+            const auto frame = range.GetFrame(i);
+            TEST_CHECK(i == 0 || frame.timestamp > previous);
+            TEST_CHECK(frame.data[3] == 1 && frame.data[4] == (frame.isKeyFrame ? 0x65 : 0x41));
+            TEST_CHECK(GetTag(frame) == frame.timestamp);
+
+            if (frame.isKeyFrame)
+            {
+                TEST_CHECK(frame.spsSize == sizeof(k_Sps) && std::memcmp(frame.sps, k_Sps, sizeof(k_Sps)) == 0);
+                TEST_CHECK(frame.ppsSize == sizeof(k_Pps) && std::memcmp(frame.pps, k_Pps, sizeof(k_Pps)) == 0);
+            }
+            else
+            {
+                TEST_CHECK(frame.sps == nullptr && frame.spsSize == 0 && frame.ppsSize == 0);
+            }
+            previous = frame.timestamp;
+        }
+    }
+
+    // Checks the whole content against the stats, returns the stats.
+    ReplayBufferStats CheckContent(ReplayBuffer& buffer)
+    {
+        ReplayBufferStats stats;
+        buffer.GetStats(stats);
+
+        ReplayRange range;
+        if (!buffer.AcquireLast(0, range))
+        {
+            TEST_CHECK(stats.framesStored == 0 && stats.bytesStored == 0);
+            return stats;
+        }
+
+        CheckFrames(range);
+
+        size_t bytes = 0;
+        for (size_t i = 0; i < range.GetFrameCount(); ++i)
+        {
+            const auto frame = range.GetFrame(i);
+            bytes += frame.spsSize + frame.ppsSize + frame.size;
+        }
+
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.framesStored == range.GetFrameCount());
+        TEST_CHECK(stats.bytesStored == bytes);
+        TEST_CHECK(stats.bytesStored <= stats.capacityBytes);
+        TEST_CHECK(stats.oldestTimestamp == range.GetFrame(0).timestamp);
+        TEST_CHECK(stats.newestTimestamp == range.GetFrame(range.GetFrameCount() - 1).timestamp);
+        return stats;
+    }
+
+    void DurationBound()
+    {
+        ReplayBuffer buffer(ReplayBufferSettings{ 4, 3000, 0 });
+
+        // 10 s at 60 fps, a key frame every half second.
+        uint64_t timestamp = 1000000;
+        for (int i = 0; i < 600; ++i)
+        {
+            TEST_CHECK(Append(buffer, 3000, i % 30 == 0, timestamp));
+            timestamp += k_FrameDurationNs;
+            CheckContent(buffer);
+        }
+
+        // Whole GOPs are evicted: between 3 s and 3 s plus a GOP are kept.
+        const auto stats = CheckContent(buffer);
+        const auto span = stats.newestTimestamp - stats.oldestTimestamp;
+        TEST_CHECK(span >= 3000000000ull - k_FrameDurationNs && span < 3500000000ull);
+        TEST_CHECK(stats.framesAppended == 600 && stats.framesDropped == 0);
+        TEST_CHECK(stats.gopsEvicted == 20 - stats.framesStored / 30);
+    }
+
+    void ByteBoundWithWrapAround()
+    {
+        ReplayBuffer buffer(ReplayBufferSettings{ 1, 600000, 0 });
+
+        std::mt19937 random(1);
+        uint64_t timestamp = 1000000;
+        bool hasWrapped = false;
+        const uint8_t* previousData = nullptr;
+
+        for (int i = 0; i < 5000; ++i)
+        {
+            const bool isKeyFrame = i % 20 == 0;
+            const size_t size = 1000 + random() % (isKeyFrame ? 60000 : 15000);
+            TEST_CHECK(Append(buffer, size, isKeyFrame, timestamp));
+            timestamp += k_FrameDurationNs;
+
+            const auto stats = CheckContent(buffer);
+            TEST_CHECK(stats.bytesStored <= 1024 * 1024);
+
+            // The newest record starts back at the beginning of the slab.
+            ReplayRange range;
+            TEST_CHECK(buffer.AcquireLast(0, range));
+            const auto newest = range.GetFrame(range.GetFrameCount() - 1);
+            const auto data = (newest.sps != nullptr) ? newest.sps : newest.data;
+            hasWrapped |= previousData != nullptr && data < previousData;
+            previousData = data;
+        }
+        TEST_CHECK(hasWrapped);
+
+        ReplayBufferStats stats;
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.framesDropped == 0);
+        TEST_CHECK(stats.gopsEvicted > 0);
+
+        // Larger than the slab: dropped, and the following frames up to a key frame.
+        TEST_CHECK(!Append(buffer, 2 * 1024 * 1024, true, timestamp));
+        TEST_CHECK(!Append(buffer, 1000, false, timestamp + 1));
+        TEST_CHECK(Append(buffer, 1000, true, timestamp + 2));
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.framesDropped == 2);
+        CheckContent(buffer);
+    }
+
+    void IndexBound()
+    {
+        ReplayBuffer buffer(ReplayBufferSettings{ 8, 600000, 100 });
+
+        uint64_t timestamp = 1000000;
+        for (int i = 0; i < 1000; ++i)
+        {
+            TEST_CHECK(Append(buffer, 2000, i % 10 == 0, timestamp));
+            timestamp += k_FrameDurationNs;
+
+            const auto stats = CheckContent(buffer);
+            TEST_CHECK(stats.framesStored <= 100);
+        }
+
+        // The whole oldest GOP goes to make room for the 101st frame.
+        const auto stats = CheckContent(buffer);
+        TEST_CHECK(stats.framesStored > 90);
+        TEST_CHECK(stats.framesDropped == 0);
+    }
+
+    void Pinning()
+    {
+        ReplayBuffer buffer(ReplayBufferSettings{ 8, 600000, 100 });
+
+        uint64_t timestamp = 1000000;
+        ReplayRange pinned;
+        uint64_t pinnedFirst = 0;
+        size_t pinnedCount = 0;
+        int appended = 0;
+
+        for (int i = 0; i < 300; ++i)
+        {
+            const bool isKeyFrame = i % 10 == 0;
+            if (Append(buffer, 2000, isKeyFrame, timestamp))
+            {
+                ++appended;
+            }
+            timestamp += k_FrameDurationNs;
+
+            if (i == 150)
+            {
+                TEST_CHECK(buffer.AcquireLast(0, pinned));
+                pinnedFirst = pinned.GetFrame(0).timestamp;
+                pinnedCount = pinned.GetFrameCount();
+            }
+
+            // The pinned frames are neither evicted nor overwritten, the new ones are dropped.
+            if (pinned.IsValid())
+            {
+                TEST_CHECK(pinned.GetFrameCount() == pinnedCount);
+                TEST_CHECK(pinned.GetFrame(0).timestamp == pinnedFirst);
+                CheckFrames(pinned);
+            }
+
+            if (i == 250)
+            {
+                ReplayBufferStats stats;
+                buffer.GetStats(stats);
+                TEST_CHECK(stats.oldestTimestamp == pinnedFirst);
+                TEST_CHECK(stats.framesDropped > 0);
+                pinned.Release();
+                TEST_CHECK(!pinned.IsValid() && pinned.GetFrameCount() == 0);
+            }
+            CheckContent(buffer);
+        }
+
+        // Released, the frames after the next key frame are stored again.
+        ReplayBufferStats stats;
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.framesAppended == static_cast<uint64_t>(appended));
+        TEST_CHECK(stats.framesDropped == static_cast<uint64_t>(300 - appended));
+        TEST_CHECK(stats.oldestTimestamp > pinnedFirst);
+        TEST_CHECK(stats.newestTimestamp == timestamp - k_FrameDurationNs);
+    }
+
+    void RangeLookups()
+    {
+        ReplayBuffer buffer(ReplayBufferSettings{ 8, 0, 0 });
+
+        ReplayRange range;
+        TEST_CHECK(!buffer.AcquireLast(0, range));
+        TEST_CHECK(!buffer.Acquire(0, UINT64_MAX, range));
+
+        // Nothing can be decoded before the first key frame.
+        TEST_CHECK(!Append(buffer, 100, false, 500000));
+
+        // A frame per millisecond, a key frame every 10.
+        for (uint64_t i = 0; i < 100; ++i)
+        {
+            TEST_CHECK(Append(buffer, 100, i % 10 == 0, i * 1000000));
+        }
+
+        // From the key frame at or before the start, up to the end included.
+        TEST_CHECK(buffer.Acquire(25000000, 47000000, range));
+        TEST_CHECK(range.GetFrame(0).timestamp == 20000000);
+        TEST_CHECK(range.GetFrameCount() == 28);
+        CheckFrames(range);
+
+        TEST_CHECK(buffer.Acquire(30000000, 30000000, range));
+        TEST_CHECK(range.GetFrame(0).timestamp == 30000000 && range.GetFrameCount() == 1);
+
+        TEST_CHECK(buffer.AcquireLast(5000000, range));
+        TEST_CHECK(range.GetFrame(0).timestamp == 90000000 && range.GetFrameCount() == 10);
+
+        TEST_CHECK(buffer.AcquireLast(0, range));
+        TEST_CHECK(range.GetFrame(0).timestamp == 0 && range.GetFrameCount() == 100);
+
+        // Past the newest frame: the last GOP. Before the oldest frame: nothing.
+        TEST_CHECK(buffer.Acquire(200000000, UINT64_MAX, range));
+        TEST_CHECK(range.GetFrame(0).timestamp == 90000000);
+        TEST_CHECK(Append(buffer, 100, true, 200000000));
+        range.Release();
+
+        ReplayBuffer later(ReplayBufferSettings{ 1, 0, 0 });
+        TEST_CHECK(Append(later, 100, true, 10000000));
+        TEST_CHECK(!later.Acquire(0, 5000000, range));
+
+        // At most k_MaxRanges ranges are held.
+        ReplayRange ranges[ReplayBuffer::k_MaxRanges];
+        for (auto& held : ranges)
+        {
+            TEST_CHECK(buffer.AcquireLast(0, held));
+        }
+        TEST_CHECK(!buffer.AcquireLast(0, range));
+
+        ReplayRange moved(std::move(ranges[0]));
+        TEST_CHECK(!ranges[0].IsValid() && moved.IsValid());
+        TEST_CHECK(!buffer.AcquireLast(0, range));
+
+        moved.Release();
+        TEST_CHECK(buffer.AcquireLast(0, range));
+    }
+}
+
+int main()
+{
+    TEST_RUN(DurationBound);
+    TEST_RUN(ByteBoundWithWrapAround);
+    TEST_RUN(IndexBound);
+    TEST_RUN(Pinning);
+    TEST_RUN(RangeLookups);
+    return 0;
+}
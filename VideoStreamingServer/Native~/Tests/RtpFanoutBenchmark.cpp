@@ -0,0 +1,99 @@
+#include "TestUtils.h"
+#include "RtpFanout.h"
+
+#include <random>
+#include <vector>
+
+using namespace LiveCaptureNative;
+
+namespace
+{
+    Net::SocketHandle OpenUdpSocket(Net::Endpoint& endpoint)
+    {
+        const auto handle = socket(AF_INET, SOCK_DGRAM, 0);
+        TEST_CHECK(handle >= 0);
+        TEST_CHECK(Net::ParseEndpoint("127.0.0.1", 0, endpoint));
+        TEST_CHECK(bind(handle, reinterpret_cast<const sockaddr*>(&endpoint.address), endpoint.size) == 0);
+        TEST_CHECK(getsockname(handle, reinterpret_cast<sockaddr*>(&endpoint.address), &endpoint.size) == 0);
+        return handle;
+    }
+}
+
+// CPU cost of sending a 60 KB access unit to 1, 8 and 32 clients over the loopback: one copy of
+// each packet per client and a sendto() each, as the managed server does, against the fan-out
+// sharing the payloads and batching the sends. The receivers don't read, the loopback drops what
+// doesn't fit in their buffers without slowing the sender down.
+int main()
+{
+    std::mt19937 random(7);
+    std::vector<uint8_t> accessUnit = { 0, 0, 0, 1, 0x65 };
+    for (int i = 0; i < 60000; ++i)
+    {
+        accessUnit.push_back(static_cast<uint8_t>(random() | 1));
+    }
+
+    H264RtpPacketizer packetizer;
+    const auto packetCount = packetizer.Packetize(accessUnit.data(), accessUnit.size(), 0, true)->packets.size();
+
+    for (const int clientCount : { 1, 8, 32 })
+    {
+        Net::Endpoint senderEndpoint;
+        const auto sender = OpenUdpSocket(senderEndpoint);
+        std::vector<Net::SocketHandle> receivers(clientCount);
+        std::vector<Net::Endpoint> endpoints(clientCount);
+        for (int c = 0; c < clientCount; ++c)
+        {
+            receivers[c] = OpenUdpSocket(endpoints[c]);
+        }
+
+        char name[64];
+        std::snprintf(name, sizeof(name), "%d clients, copy and sendto per packet", clientCount);
+
+        std::vector<uint8_t> packet;
+        uint16_t sequence = 0;
+        bool succeeded = true;
+        const auto copySeconds = Tests::Benchmark(name, 100, 0, [&]()
+        {
+            const auto packetized = packetizer.Packetize(accessUnit.data(), accessUnit.size(), 0, true);
+            for (int c = 0; c < clientCount; ++c)
+            {
+                for (const auto& source : packetized->packets)
+                {
+                    packet.resize(Rtp::k_HeaderSize + source.size);
+                    packetized->WriteHeader(source, sequence++, 0x100 + c, packet.data());
+                    std::memcpy(packet.data() + Rtp::k_HeaderSize, packetized->GetPayload(source), source.size);
+                    succeeded &= sendto(sender, packet.data(), packet.size(), 0,
+                                        reinterpret_cast<const sockaddr*>(&endpoints[c].address), endpoints[c].size) >= 0;
+                }
+            }
+        });
+
+        RtpFanout fanout(sender);
+        for (int c = 0; c < clientCount; ++c)
+        {
+            fanout.AddClient(endpoints[c], 0x100 + c, 0);
+        }
+
+        std::snprintf(name, sizeof(name), "%d clients, fan-out", clientCount);
+        const auto fanoutSeconds = Tests::Benchmark(name, 100, 0, [&]()
+        {
+            fanout.Send(*packetizer.Packetize(accessUnit.data(), accessUnit.size(), 0, true));
+        });
+
+        RtpFanoutStats stats;
+        fanout.GetStats(stats);
+        std::printf("%d clients, %zu packets per access unit: fan-out %.2fx faster, %llu send calls\n",
+                    clientCount, packetCount, copySeconds / fanoutSeconds, static_cast<unsigned long long>(stats.sendCalls));
+
+        TEST_CHECK(succeeded);
+        TEST_CHECK(stats.packetsSent == 100 * packetCount * clientCount);
+        TEST_CHECK(stats.packetsDropped == 0);
+
+        for (const auto receiver : receivers)
+        {
+            Net::Close(receiver);
+        }
+        Net::Close(sender);
+    }
+    return 0;
+}
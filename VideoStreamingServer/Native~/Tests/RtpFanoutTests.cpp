@@ -0,0 +1,239 @@
+#include "RtpFanout.h"
+#include "TestUtils.h"
+
+#include <random>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    // UDP socket bound to an ephemeral loopback port, and its endpoint.
+    struct UdpSocket
+    {
+        Net::SocketHandle handle;
+        Net::Endpoint     endpoint;
+
+        UdpSocket()
+        {
+            handle = socket(AF_INET, SOCK_DGRAM, 0);
+            TEST_CHECK(handle >= 0);
+            TEST_CHECK(Net::ParseEndpoint("127.0.0.1", 0, endpoint));
+            TEST_CHECK(bind(handle, reinterpret_cast<const sockaddr*>(&endpoint.address), endpoint.size) == 0);
+            TEST_CHECK(getsockname(handle, reinterpret_cast<sockaddr*>(&endpoint.address), &endpoint.size) == 0);
+
+            const int bufferSize = 8 * 1024 * 1024;
+            setsockopt(handle, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+        }
+
+        ~UdpSocket()
+        {
+            Net::Close(handle);
+        }
+
+        int Receive(uint8_t* buffer, size_t capacity) const
+        {
+            const auto size = recv(handle, buffer, capacity, MSG_DONTWAIT);
+            return (size < 0) ? -1 : static_cast<int>(size);
+        }
+    };
+
+    std::vector<uint8_t> MakeAccessUnit(size_t frameSize, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::vector<uint8_t> accessUnit;
+        const auto append = [&](uint8_t type, size_t size)
+        {
+            accessUnit.insert(accessUnit.end(), { 0, 0, 0, 1, type });
+            for (size_t i = 1; i < size; ++i)
+            {
+                accessUnit.push_back(static_cast<uint8_t>(random() | 1));
+            }
+        };
+
+        append(0x67, 20);
+        append(0x68, 6);
+        append(0x06, 40);
+        append(0x65, frameSize);
+        append(0x65, 300);
+        return accessUnit;
+    }
+
+    // Rebuilds the Annex B access unit from the single NAL unit, STAP-A and FU-A packets.
+    std::vector<uint8_t> Depacketize(const std::vector<std::vector<uint8_t>>& packets)
+    {
+        std::vector<uint8_t> accessUnit;
+        std::vector<uint8_t> fragmented;
+        const auto append = [&accessUnit](const uint8_t* nal, size_t size)
+        {
+            accessUnit.insert(accessUnit.end(), { 0, 0, 0, 1 });
+            accessUnit.insert(accessUnit.end(), nal, nal + size);
+        };
+
+        for (const auto& packet : packets)
+        {
+            const auto payload = packet.data() + Rtp::k_HeaderSize;
+            const auto size = packet.size() - Rtp::k_HeaderSize;
+            const auto type = payload[0] & 0x1f;
+            if (type == 24)
+            {
+                size_t offset = 1;
+                while (offset < size)
+                {
+                    const size_t nalSize = Rtp::ReadUInt16(payload + offset);
+                    append(payload + offset + 2, nalSize);
+                    offset += 2 + nalSize;
+                }
+                TEST_CHECK(offset == size);
+            }
+            else if (type == 28)
+            {
+                if ((payload[1] & 0x80) != 0)
+                {
+                    fragmented.assign(1, static_cast<uint8_t>((payload[0] & 0xe0) | (payload[1] & 0x1f)));
+                }
+                fragmented.insert(fragmented.end(), payload + 2, payload + size);
+                if ((payload[1] & 0x40) != 0)
+                {
+                    append(fragmented.data(), fragmented.size());
+                }
+            }
+            else
+            {
+                append(payload, size);
+            }
+        }
+        return accessUnit;
+    }
+
+    void SkipsTheDatagramsInError()
+    {
+        UdpSocket sender;
+        UdpSocket receiver;
+
+        // An IPv6 destination on an IPv4 socket fails, the datagrams around it are still sent.
+        Net::Endpoint unreachable;
+        TEST_CHECK(Net::ParseEndpoint("::1", 5004, unreachable));
+
+        const uint8_t payloads[5] = { 0, 1, 2, 3, 4 };
+        Net::Buffer buffers[5];
+        Net::Datagram datagrams[5];
+        for (int i = 0; i < 5; ++i)
+        {
+            buffers[i] = Net::MakeBuffer(&payloads[i], 1);
+            datagrams[i].endpoint = (i == 1 || i == 2) ? &unreachable : &receiver.endpoint;
+            datagrams[i].buffers = &buffers[i];
+            datagrams[i].bufferCount = 1;
+            datagrams[i].isSent = (i % 2) == 0;
+        }
+
+        int error = 0;
+        TEST_CHECK(Net::SendDatagrams(sender.handle, datagrams, 5, error) == 3);
+        TEST_CHECK(error != 0 && !Net::IsWouldBlock(error));
+        for (int i = 0; i < 5; ++i)
+        {
+            TEST_CHECK(datagrams[i].isSent == (i != 1 && i != 2));
+        }
+
+        uint8_t received;
+        TEST_CHECK(receiver.Receive(&received, 1) == 1 && received == 0);
+        TEST_CHECK(receiver.Receive(&received, 1) == 1 && received == 3);
+        TEST_CHECK(receiver.Receive(&received, 1) == 1 && received == 4);
+        TEST_CHECK(receiver.Receive(&received, 1) < 0);
+    }
+
+    void SendsEveryPacketToEveryClient()
+    {
+        UdpSocket sender;
+        UdpSocket receivers[3];
+        RtpFanout fanout(sender.handle);
+        H264RtpPacketizer packetizer;
+
+        // The last client is unreachable: its datagrams, interleaved with the others, are skipped.
+        Net::Endpoint unreachable;
+        TEST_CHECK(Net::ParseEndpoint("::1", 5004, unreachable));
+
+        std::vector<int32_t> ids;
+        uint16_t sequences[3];
+        for (int c = 0; c < 3; ++c)
+        {
+            sequences[c] = static_cast<uint16_t>(65530 + c * 1000);
+            ids.push_back(fanout.AddClient(receivers[c].endpoint, 0x100 + c, sequences[c]));
+        }
+        const auto unreachableId = fanout.AddClient(unreachable, 0x200, 0);
+        TEST_CHECK(fanout.GetClientCount() == 4);
+
+        size_t packetCount = 0;
+        for (int frame = 0; frame < 20; ++frame)
+        {
+            const auto accessUnit = MakeAccessUnit(500 + frame * 3000, frame);
+            const auto packetized = packetizer.Packetize(accessUnit.data(), accessUnit.size(), 1000000000ull * frame / 30, frame == 0);
+            TEST_CHECK(packetized != nullptr);
+            const auto packets = packetized->packets.size();
+            packetCount += packets;
+
+            size_t sent = 0;
+            fanout.Send(*packetized, [&](int32_t id, const uint8_t* header, const uint8_t*, size_t)
+            {
+                TEST_CHECK(id != unreachableId);
+                TEST_CHECK((header[0] >> 6) == 2);
+                ++sent;
+            });
+            TEST_CHECK(sent == packets * 3);
+
+            // Each client gets its own sequence numbers and SSRC, the marker on the last packet.
+            for (int c = 0; c < 3; ++c)
+            {
+                std::vector<std::vector<uint8_t>> received;
+                uint8_t packet[2048];
+                int size;
+                while ((size = receivers[c].Receive(packet, sizeof(packet))) >= 0)
+                {
+                    TEST_CHECK(size > static_cast<int>(Rtp::k_HeaderSize) && size <= 1200);
+                    TEST_CHECK(Rtp::GetSsrc(packet) == static_cast<uint32_t>(0x100 + c));
+                    TEST_CHECK(Rtp::GetSequenceNumber(packet) == sequences[c]++);
+                    TEST_CHECK(Rtp::GetMarker(packet) == (received.size() + 1 == packets));
+                    received.emplace_back(packet, packet + size);
+                }
+                TEST_CHECK(received.size() == packets);
+                TEST_CHECK(Depacketize(received) == accessUnit);
+
+                uint16_t next;
+                TEST_CHECK(fanout.GetNextSequence(ids[c], next) && next == sequences[c]);
+            }
+        }
+
+        RtpFanoutStats stats;
+        fanout.GetStats(stats);
+        TEST_CHECK(stats.accessUnitsSent == 20 && stats.sendCalls == 20);
+        TEST_CHECK(stats.packetsSent == packetCount * 3);
+        TEST_CHECK(stats.packetsDropped == packetCount);
+
+        fanout.RemoveClient(unreachableId);
+        TEST_CHECK(fanout.GetClientCount() == 3);
+        uint16_t next;
+        TEST_CHECK(!fanout.GetNextSequence(unreachableId, next));
+    }
+
+    void AddsMulticastGroupsOnly()
+    {
+        UdpSocket sender;
+        RtpFanout fanout(sender.handle);
+
+        Net::Endpoint unicast;
+        TEST_CHECK(Net::ParseEndpoint("127.0.0.1", 5004, unicast));
+        TEST_CHECK(fanout.AddMulticastGroup(unicast, 1, 1, 1) == RtpFanout::k_InvalidClient);
+
+        Net::Endpoint group;
+        TEST_CHECK(Net::ParseEndpoint("239.255.42.1", 5004, group));
+        TEST_CHECK(fanout.AddMulticastGroup(group, 1, 1, 1) != RtpFanout::k_InvalidClient);
+        TEST_CHECK(fanout.GetClientCount() == 1);
+    }
+}
+
+int main()
+{
+    TEST_RUN(SkipsTheDatagramsInError);
+    TEST_RUN(SendsEveryPacketToEveryClient);
+    TEST_RUN(AddsMulticastGroupsOnly);
+    return 0;
+}
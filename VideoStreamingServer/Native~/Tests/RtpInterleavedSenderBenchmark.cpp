@@ -0,0 +1,240 @@
+#include "TestUtils.h"
+#include "RtpInterleavedSender.h"
+#include "SocketPair.h"
+
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <thread>
+#include <vector>
+
+using namespace LiveCaptureNative;
+
+namespace
+{
+    const uint8_t k_RtpChannel = 0;
+    const uint32_t k_Ssrc = 0x1234;
+    const size_t k_AccessUnitSize = 60000;
+
+    // An access unit of one slice, captured at timestampNs.
+    RtpAccessUnitRef Packetize(H264RtpPacketizer& packetizer, uint64_t timestampNs, bool isKeyFrame)
+    {
+        std::vector<uint8_t> accessUnit = { 0, 0, 0, 1, static_cast<uint8_t>(isKeyFrame ? 0x65 : 0x41) };
+        for (size_t i = 1; i < k_AccessUnitSize; ++i)
+        {
+            accessUnit.push_back(static_cast<uint8_t>((i * 7) | 1));
+        }
+        return packetizer.Packetize(accessUnit.data(), accessUnit.size(), timestampNs, isKeyFrame);
+    }
+
+    // Access unit index sends at 10 ms, its RTP timestamp.
+    uint64_t GetTimestampNs(int index)
+    {
+        return index * 10000000ull;
+    }
+
+    int GetIndex(uint32_t timestamp)
+    {
+        return static_cast<int>(timestamp / 900);
+    }
+
+    // Reads the interleaved stream at a limited rate. Each access unit is timed when its last
+    // packet arrives, against the time it was given to the sender, and the sequence numbers must
+    // have no gap.
+    class RateLimitedReader final
+    {
+    public:
+        RateLimitedReader(int socket, double bytesPerSecond, std::chrono::steady_clock::time_point start, const std::vector<std::atomic<int64_t>>& sendTimesNs) :
+            m_Socket(socket),
+            m_BytesPerSecond(bytesPerSecond),
+            m_Start(start),
+            m_SendTimesNs(sendTimesNs),
+            m_BytesRead(0),
+            m_Sequence(0),
+            m_HasSequence(false)
+        {
+        }
+
+        // Reads what the rate allows, returns false once nothing was available.
+        bool Read()
+        {
+            const auto now = std::chrono::steady_clock::now();
+            const auto budget = m_BytesPerSecond * std::chrono::duration<double>(now - m_Start).count() - m_BytesRead;
+            if (budget < 1)
+                return true;
+
+            uint8_t data[16 * 1024];
+            const auto size = recv(m_Socket, data, std::min(sizeof(data), static_cast<size_t>(budget)), MSG_DONTWAIT);
+            if (size <= 0)
+                return false;
+
+            m_BytesRead += size;
+            m_Buffer.insert(m_Buffer.end(), data, data + size);
+
+            size_t offset = 0;
+            while (m_Buffer.size() - offset >= 4)
+            {
+                TEST_CHECK(m_Buffer[offset] == '$');
+                const size_t length = Rtp::ReadUInt16(&m_Buffer[offset + 2]);
+                if (m_Buffer.size() - offset < 4 + length)
+                    break;
+
+                const auto packet = &m_Buffer[offset + 4];
+                TEST_CHECK(m_Buffer[offset + 1] == k_RtpChannel);
+                TEST_CHECK(Rtp::IsValidPacket(packet, length));
+                TEST_CHECK(!m_HasSequence || Rtp::GetSequenceNumber(packet) == m_Sequence);
+                m_Sequence = static_cast<uint16_t>(Rtp::GetSequenceNumber(packet) + 1);
+                m_HasSequence = true;
+
+                if (Rtp::GetMarker(packet))
+                {
+                    const auto index = GetIndex(Rtp::GetTimestamp(packet));
+                    TEST_CHECK(index >= 0 && static_cast<size_t>(index) < m_SendTimesNs.size());
+                    const auto sendTime = m_Start + std::chrono::nanoseconds(m_SendTimesNs[index].load(std::memory_order_acquire));
+                    latenciesMs.push_back(std::chrono::duration<double, std::milli>(now - sendTime).count());
+
+                    const auto captureTime = m_Start + std::chrono::nanoseconds(GetTimestampNs(index));
+                    captureLatenciesMs.push_back(std::chrono::duration<double, std::milli>(now - captureTime).count());
+                }
+                offset += 4 + length;
+            }
+            m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + offset);
+            return true;
+        }
+
+        std::vector<double> latenciesMs;
+        std::vector<double> captureLatenciesMs; // Includes the time Block held the sender thread.
+
+    private:
+        int                                   m_Socket;
+        double                                m_BytesPerSecond;
+        std::chrono::steady_clock::time_point m_Start;
+        const std::vector<std::atomic<int64_t>>& m_SendTimesNs;
+        double                                m_BytesRead;
+        uint16_t                              m_Sequence;
+        bool                                  m_HasSequence;
+        std::vector<uint8_t>                  m_Buffer;
+    };
+
+    // Streams access units at 100 per second to a reader limited to bytesPerSecond, with a key
+    // frame every 30 or on request. Returns the p50 head-of-line latency in milliseconds: from
+    // Send() to the last packet read, the time spent behind the access units queued before.
+    double StreamToSlowReader(const char* name, BackpressurePolicy policy, int32_t queueLength, double bytesPerSecond, int count)
+    {
+        Tests::SocketPair sockets(128 * 1024);
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, policy, queueLength);
+
+        const auto start = std::chrono::steady_clock::now();
+        const auto frameDuration = std::chrono::milliseconds(10);
+
+        // The client, the RTSP thread flushes what the reads made room for.
+        std::atomic<bool> isDone(false);
+        std::vector<std::atomic<int64_t>> sendTimesNs(count);
+        RateLimitedReader reader(sockets.receiver, bytesPerSecond, start, sendTimesNs);
+        std::thread client([&]()
+        {
+            for (;;)
+            {
+                const bool isLast = isDone.load();
+                if (!reader.Read() && isLast && !sender.HasQueued())
+                    break;
+
+                sender.Flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+
+        for (int i = 0; i < count; ++i)
+        {
+            std::this_thread::sleep_until(start + i * frameDuration);
+            const bool isKeyFrame = (i % 30) == 0 || sender.ConsumeKeyFrameRequest();
+            const auto accessUnit = Packetize(packetizer, GetTimestampNs(i), isKeyFrame);
+
+            sendTimesNs[i].store(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+                                 std::memory_order_release);
+            const auto result = sender.Send(accessUnit);
+            TEST_CHECK(result != RtpInterleavedResult::Disconnected);
+        }
+        isDone = true;
+        client.join();
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        auto& latencies = reader.latenciesMs;
+        TEST_CHECK(!latencies.empty());
+        // DropOldest also counts the queued access units it discards as sent.
+        TEST_CHECK(latencies.size() + stats.accessUnitsDropped == static_cast<uint64_t>(count));
+
+        auto& captureLatencies = reader.captureLatenciesMs;
+        std::sort(latencies.begin(), latencies.end());
+        std::sort(captureLatencies.begin(), captureLatencies.end());
+        const auto p50 = latencies[latencies.size() / 2];
+        std::printf("%s: p50 %.1f ms, p99 %.1f ms, p50 from the capture %.1f ms, %zu of %d access units received\n",
+                    name, p50, latencies[latencies.size() * 99 / 100], captureLatencies[captureLatencies.size() / 2], latencies.size(), count);
+        return p50;
+    }
+}
+
+// Throughput of the sender writing 60 KB access units to a client reading as fast as it can,
+// then the head-of-line latency of a 48 Mbit/s stream, 100 access units per second, to a client
+// reading at 30 Mbit/s over 128 KB socket buffers: with a 16-deep blocking queue, and with a
+// depth of 2 for each policy.
+int main()
+{
+    // Writes to the closed socket fail with EPIPE instead of raising SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    {
+        Tests::SocketPair sockets(4 * 1024 * 1024);
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::Block, 16);
+
+        const auto accessUnit = Packetize(packetizer, 0, true);
+        size_t wireSize = 0;
+        for (const auto& packet : accessUnit->packets)
+        {
+            wireSize += RtpInterleavedSender::k_FrameHeaderSize + Rtp::k_HeaderSize + packet.size;
+        }
+
+        std::thread client([&sockets]()
+        {
+            std::vector<uint8_t> data(256 * 1024);
+            while (recv(sockets.receiver, data.data(), data.size(), 0) > 0)
+            {
+            }
+        });
+
+        const int count = 5000;
+        const auto seconds = Tests::Benchmark("Send, 60 KB access units", count, wireSize, [&]()
+        {
+            TEST_CHECK(sender.Send(accessUnit) != RtpInterleavedResult::Disconnected);
+        });
+        while (sender.HasQueued())
+        {
+            Net::WaitWritable(sockets.sender, 100);
+            TEST_CHECK(sender.Flush() != RtpInterleavedResult::Disconnected);
+        }
+        shutdown(sockets.sender, SHUT_WR);
+        client.join();
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        std::printf("%zu packets per access unit, %.2f write calls per access unit, %.2f GB/s\n",
+                    accessUnit->packets.size(), static_cast<double>(stats.writeCalls) / count, wireSize / seconds / 1e9);
+        TEST_CHECK(stats.accessUnitsDropped == 0);
+        TEST_CHECK(stats.bytesSent == count * wireSize);
+    }
+
+    const double readerRate = 30e6 / 8;
+    const int count = 200;
+    const auto deepBlock = StreamToSlowReader("Block, 16 access units", BackpressurePolicy::Block, 16, readerRate, count);
+    const auto block = StreamToSlowReader("Block, 2 access units", BackpressurePolicy::Block, 2, readerRate, count);
+    StreamToSlowReader("DropNewest, 2 access units", BackpressurePolicy::DropNewest, 2, readerRate, count);
+    StreamToSlowReader("DropOldest, 2 access units", BackpressurePolicy::DropOldest, 2, readerRate, count);
+    StreamToSlowReader("DropToKeyFrame, 2 access units", BackpressurePolicy::DropToKeyFrame, 2, readerRate, count);
+
+    // A deep queue only adds to the latency of a client that can't keep up.
+    TEST_CHECK(deepBlock > block);
+    return 0;
+}
@@ -0,0 +1,383 @@
+#include "RtpInterleavedSender.h"
+#include "SocketPair.h"
+#include "TestUtils.h"
+
+#include <csignal>
+#include <string>
+#include <thread>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const uint8_t k_RtpChannel = 0;
+    const uint32_t k_Ssrc = 0x1234;
+
+    using Tests::SocketPair;
+
+    // Parses the interleaved stream as a client would: '$' frames and RTSP messages.
+    class InterleavedReader final
+    {
+    public:
+        struct Frame
+        {
+            uint8_t              channel;
+            std::vector<uint8_t> packet;
+        };
+
+        // Reads what is available, returns false once nothing was.
+        bool Read(int socket)
+        {
+            uint8_t data[16 * 1024];
+            const auto size = recv(socket, data, sizeof(data), MSG_DONTWAIT);
+            if (size <= 0)
+                return false;
+
+            m_Buffer.insert(m_Buffer.end(), data, data + size);
+
+            size_t offset = 0;
+            while (m_Buffer.size() - offset >= 4)
+            {
+                if (m_Buffer[offset] != '$')
+                {
+                    const std::string text(m_Buffer.begin() + offset, m_Buffer.end());
+                    const auto end = text.find("\r\n\r\n");
+                    if (end == std::string::npos)
+                        break;
+
+                    TEST_CHECK(text.compare(0, 9, "RTSP/1.0 ") == 0);
+                    messages.push_back(text.substr(0, end + 4));
+                    order.push_back(-static_cast<int>(messages.size()));
+                    offset += end + 4;
+                    continue;
+                }
+
+                const size_t length = Rtp::ReadUInt16(&m_Buffer[offset + 2]);
+                if (m_Buffer.size() - offset < 4 + length)
+                    break;
+
+                Frame frame;
+                frame.channel = m_Buffer[offset + 1];
+                frame.packet.assign(m_Buffer.begin() + offset + 4, m_Buffer.begin() + offset + 4 + length);
+                TEST_CHECK(frame.channel == k_RtpChannel || frame.channel == k_RtpChannel + 1);
+                frames.push_back(std::move(frame));
+                order.push_back(static_cast<int>(frames.size()));
+                offset += 4 + length;
+            }
+            m_Buffer.erase(m_Buffer.begin(), m_Buffer.begin() + offset);
+            return true;
+        }
+
+        // Reads until the sender has written everything.
+        void ReadAll(int socket, RtpInterleavedSender& sender)
+        {
+            for (;;)
+            {
+                while (Read(socket))
+                {
+                    sender.Flush();
+                }
+                if (!sender.HasQueued())
+                    break;
+                sender.Flush();
+            }
+            while (Read(socket))
+            {
+            }
+            TEST_CHECK(m_Buffer.empty());
+        }
+
+        // The RTP packets, checked for contiguous sequence numbers. Returns the access units
+        // received, each as the timestamp of its packets.
+        std::vector<uint32_t> CheckRtp(uint16_t firstSequence) const
+        {
+            std::vector<uint32_t> accessUnits;
+            auto sequence = firstSequence;
+            bool isStart = true;
+            for (const auto& frame : frames)
+            {
+                if (frame.channel != k_RtpChannel)
+                    continue;
+
+                const auto packet = frame.packet.data();
+                TEST_CHECK(Rtp::IsValidPacket(packet, frame.packet.size()));
+                TEST_CHECK(Rtp::GetSsrc(packet) == k_Ssrc);
+                TEST_CHECK(Rtp::GetSequenceNumber(packet) == sequence++);
+                TEST_CHECK(isStart || Rtp::GetTimestamp(packet) == accessUnits.back());
+
+                if (isStart)
+                {
+                    accessUnits.push_back(Rtp::GetTimestamp(packet));
+                }
+                isStart = Rtp::GetMarker(packet);
+            }
+            TEST_CHECK(isStart);
+            return accessUnits;
+        }
+
+        std::vector<Frame>       frames;
+        std::vector<std::string> messages;
+        std::vector<int>         order; // Frame numbers from 1, message numbers from -1.
+
+    private:
+        std::vector<uint8_t> m_Buffer;
+    };
+
+    // An access unit of one slice, fragmented in about size / 1188 packets. Captured at index
+    // milliseconds, its RTP timestamp identifies it.
+    RtpAccessUnitRef Packetize(H264RtpPacketizer& packetizer, uint32_t index, size_t size, bool isKeyFrame)
+    {
+        std::vector<uint8_t> accessUnit = { 0, 0, 0, 1, static_cast<uint8_t>(isKeyFrame ? 0x65 : 0x41) };
+        for (size_t i = 1; i < size; ++i)
+        {
+            accessUnit.push_back(static_cast<uint8_t>((i * 7 + index) | 1));
+        }
+        return packetizer.Packetize(accessUnit.data(), accessUnit.size(), index * 1000000ull, isKeyFrame);
+    }
+
+    uint32_t GetTimestamp(uint32_t index)
+    {
+        return index * 90;
+    }
+
+    void SendData(RtpInterleavedSender& sender, const char* text)
+    {
+        TEST_CHECK(sender.SendData(reinterpret_cast<const uint8_t*>(text), std::strlen(text)) != RtpInterleavedResult::Disconnected);
+    }
+
+    void KeepsTheFramingAcrossPartialWrites()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 65000, BackpressurePolicy::DropNewest, 8);
+
+        // A reply larger than the socket buffer: the next writes are queued behind the rest of it.
+        const auto reply = "RTSP/1.0 200 OK\r\nCSeq: 1\r\nX-Padding: " + std::string(256 * 1024, 'a') + "\r\n\r\n";
+        SendData(sender, reply.c_str());
+        TEST_CHECK(sender.HasQueued());
+
+        // Access units longer than a gather list, between control bytes. After the odd buffer of
+        // the reply, the gather list is one short of the next packet in the first access unit: it
+        // must stop there, not take the bytes of the next reply.
+        TEST_CHECK(sender.Send(Packetize(packetizer, 0, 400000, true)) == RtpInterleavedResult::Queued);
+        SendData(sender, "RTSP/1.0 200 OK\r\nCSeq: 2\r\n\r\n");
+        const uint8_t report[28] = { 0x80, 200, 0, 6 };
+        TEST_CHECK(sender.SendRtcp(report, sizeof(report)) == RtpInterleavedResult::Queued);
+        TEST_CHECK(sender.Send(Packetize(packetizer, 1, 700000, false)) == RtpInterleavedResult::Queued);
+        SendData(sender, "RTSP/1.0 200 OK\r\nCSeq: 3\r\n\r\n");
+
+        // The next write takes a whole gather list once the client has read what was sent.
+        const int bufferSize = 4 * 1024 * 1024;
+        setsockopt(sockets.sender, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+
+        InterleavedReader reader;
+        while (reader.Read(sockets.receiver))
+        {
+        }
+        reader.ReadAll(sockets.receiver, sender);
+
+        const auto accessUnits = reader.CheckRtp(65000);
+        TEST_CHECK(accessUnits.size() == 2);
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            TEST_CHECK(accessUnits[i] == GetTimestamp(i));
+        }
+
+        // The replies and the report come in order, between the access units.
+        TEST_CHECK(reader.messages.size() == 3);
+        for (size_t i = 0; i < 3; ++i)
+        {
+            TEST_CHECK(reader.messages[i].find("CSeq: " + std::to_string(i + 1)) != std::string::npos);
+        }
+
+        const auto firstSize = Packetize(packetizer, 0, 400000, true)->packets.size();
+        const auto secondSize = Packetize(packetizer, 1, 700000, false)->packets.size();
+        TEST_CHECK(firstSize > Net::k_MaxStreamBuffers / 2 && secondSize > Net::k_MaxStreamBuffers);
+
+        // Frames are numbered from 1 and messages from -1 in the order read.
+        std::vector<int> expected;
+        int frameNumber = 0;
+        const auto appendFrames = [&expected, &frameNumber](size_t count)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                expected.push_back(++frameNumber);
+            }
+        };
+        expected.push_back(-1);
+        appendFrames(firstSize);
+        expected.push_back(-2);
+        appendFrames(1 + secondSize);
+        expected.push_back(-3);
+        TEST_CHECK(reader.order == expected);
+        TEST_CHECK(reader.frames[firstSize].channel == k_RtpChannel + 1);
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        TEST_CHECK(stats.accessUnitsSent == 2 && stats.accessUnitsDropped == 0);
+        TEST_CHECK(stats.queuedBytes == 0);
+    }
+
+    // Sends access units to a client that doesn't read until the sender gives up. Returns the
+    // results of the sends.
+    std::vector<RtpInterleavedResult> SendToStalledClient(RtpInterleavedSender& sender, H264RtpPacketizer& packetizer, int count, const bool* isKeyFrame = nullptr)
+    {
+        std::vector<RtpInterleavedResult> results;
+        for (int i = 0; i < count; ++i)
+        {
+            const bool key = (isKeyFrame != nullptr) ? isKeyFrame[i] : (i == 0);
+            results.push_back(sender.Send(Packetize(packetizer, i, 50000, key)));
+            TEST_CHECK(results.back() != RtpInterleavedResult::Disconnected);
+        }
+        return results;
+    }
+
+    void DropNewestKeepsTheQueuedAccessUnits()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::DropNewest, 2);
+
+        const auto results = SendToStalledClient(sender, packetizer, 20);
+        TEST_CHECK(results.back() == RtpInterleavedResult::Dropped);
+
+        InterleavedReader reader;
+        reader.ReadAll(sockets.receiver, sender);
+
+        // The first access units arrive whole and numbered without gaps, the others were dropped.
+        const auto accessUnits = reader.CheckRtp(0);
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        TEST_CHECK(accessUnits.size() == stats.accessUnitsSent);
+        TEST_CHECK(stats.accessUnitsSent + stats.accessUnitsDropped == 20);
+        for (uint32_t i = 0; i < accessUnits.size(); ++i)
+        {
+            TEST_CHECK(accessUnits[i] == GetTimestamp(i));
+        }
+        TEST_CHECK(stats.maxQueuedBytes > 0 && stats.queuedBytes == 0);
+    }
+
+    void DropOldestSendsTheLatest()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::DropOldest, 2);
+
+        const auto results = SendToStalledClient(sender, packetizer, 20);
+        TEST_CHECK(results.back() == RtpInterleavedResult::Queued);
+
+        InterleavedReader reader;
+        reader.ReadAll(sockets.receiver, sender);
+
+        // The access unit being written is completed, the latest one is sent after it, and the
+        // sequence numbers of the discarded ones are reused.
+        const auto accessUnits = reader.CheckRtp(0);
+        TEST_CHECK(accessUnits.size() < 20);
+        TEST_CHECK(accessUnits.back() == GetTimestamp(19));
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        TEST_CHECK(stats.accessUnitsDropped > 0);
+        TEST_CHECK(stats.accessUnitsSent - stats.accessUnitsDropped == accessUnits.size());
+    }
+
+    void DropToKeyFrameRequestsOne()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::DropToKeyFrame, 2);
+
+        bool isKeyFrame[20] = { true };
+        const auto results = SendToStalledClient(sender, packetizer, 20, isKeyFrame);
+        TEST_CHECK(results.back() == RtpInterleavedResult::Dropped);
+        TEST_CHECK(sender.ConsumeKeyFrameRequest());
+        TEST_CHECK(!sender.ConsumeKeyFrameRequest());
+
+        // The socket drained, delta frames are still skipped until the key frame.
+        InterleavedReader reader;
+        reader.ReadAll(sockets.receiver, sender);
+        TEST_CHECK(sender.Send(Packetize(packetizer, 20, 1000, false)) == RtpInterleavedResult::Dropped);
+        TEST_CHECK(sender.Send(Packetize(packetizer, 21, 1000, true)) == RtpInterleavedResult::Sent);
+        reader.ReadAll(sockets.receiver, sender);
+
+        const auto accessUnits = reader.CheckRtp(0);
+        TEST_CHECK(accessUnits.back() == GetTimestamp(21));
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        TEST_CHECK(stats.keyFrameRequests >= 1);
+        TEST_CHECK(stats.accessUnitsSent == accessUnits.size());
+    }
+
+    void BlockWaitsForTheClient()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::Block, 2);
+
+        // A slow client: the sender waits for it instead of dropping, the RTSP thread flushes.
+        bool isDone = false;
+        std::mutex mutex;
+        InterleavedReader reader;
+        std::thread client([&]()
+        {
+            for (;;)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (isDone)
+                        break;
+                }
+                // About 3 MB/s, slower than the sender.
+                reader.Read(sockets.receiver);
+                sender.Flush();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        });
+
+        for (uint32_t i = 0; i < 40; ++i)
+        {
+            TEST_CHECK(sender.Send(Packetize(packetizer, i, 50000, i == 0)) != RtpInterleavedResult::Dropped);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            isDone = true;
+        }
+        client.join();
+        reader.ReadAll(sockets.receiver, sender);
+
+        const auto accessUnits = reader.CheckRtp(0);
+        TEST_CHECK(accessUnits.size() == 40);
+
+        RtpInterleavedStats stats;
+        sender.GetStats(stats);
+        TEST_CHECK(stats.accessUnitsDropped == 0);
+        TEST_CHECK(stats.blockedNs > 0);
+    }
+
+    void DisconnectsWhenTheClientCloses()
+    {
+        SocketPair sockets;
+        H264RtpPacketizer packetizer;
+        RtpInterleavedSender sender(sockets.sender, k_RtpChannel, k_Ssrc, 0, BackpressurePolicy::DropNewest, 2);
+
+        shutdown(sockets.receiver, SHUT_RDWR);
+        TEST_CHECK(sender.Send(Packetize(packetizer, 0, 1000, true)) == RtpInterleavedResult::Disconnected);
+        TEST_CHECK(sender.Flush() == RtpInterleavedResult::Disconnected);
+    }
+}
+
+int main()
+{
+    // Writes to the closed socket fail with EPIPE instead of raising SIGPIPE.
+    signal(SIGPIPE, SIG_IGN);
+
+    TEST_RUN(KeepsTheFramingAcrossPartialWrites);
+    TEST_RUN(DropNewestKeepsTheQueuedAccessUnits);
+    TEST_RUN(DropOldestSendsTheLatest);
+    TEST_RUN(DropToKeyFrameRequestsOne);
+    TEST_RUN(BlockWaitsForTheClient);
+    TEST_RUN(DisconnectsWhenTheClientCloses);
+    return 0;
+}
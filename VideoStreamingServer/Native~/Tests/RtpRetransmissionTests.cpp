@@ -0,0 +1,308 @@
+#include "RtpRetransmissionBuffer.h"
+#include "TestUtils.h"
+#include "UdpLoopback.h"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const uint64_t k_StartNs = 1000000000ull;
+    const uint64_t k_MsNs = 1000000ull;
+
+    std::vector<uint8_t> MakePacket(uint16_t sequence, uint32_t ssrc, size_t size)
+    {
+        std::vector<uint8_t> packet(size);
+        packet[0] = 0x80;
+        packet[1] = 96;
+        Rtp::SetSequenceNumber(packet.data(), sequence);
+        Rtp::WriteUInt32(packet.data() + 4, sequence * 3000u);
+        Rtp::SetSsrc(packet.data(), ssrc);
+        for (size_t i = Rtp::k_HeaderSize; i < size; ++i)
+        {
+            packet[i] = static_cast<uint8_t>(sequence * 31 + i);
+        }
+        return packet;
+    }
+
+    void NackRoundTrip()
+    {
+        // Sorted in sequence order across the wrap, some within the bitmask of the previous one.
+        const uint16_t lost[] = { 65530, 65531, 65535, 3, 10, 40 };
+        uint8_t nack[256];
+        const auto size = Rtcp::WriteGenericNack(1, 0xabcd, lost, 6, nack, sizeof(nack));
+        TEST_CHECK(size == Rtcp::k_FeedbackHeaderSize + 2 * 4);
+        TEST_CHECK(size == Rtcp::GetGenericNackSize(lost, 6));
+        TEST_CHECK(Rtcp::WriteGenericNack(1, 0xabcd, lost, 6, nack, size - 1) == 0);
+
+        // In a compound packet, after a receiver report.
+        uint8_t compound[512] = { 0x80, 201, 0, 1, 0, 0, 0, 1 };
+        std::memcpy(compound + 8, nack, size);
+
+        std::vector<uint16_t> read;
+        TEST_CHECK(Rtcp::ForEachNackedSequence(compound, 8 + size, [&read](uint32_t ssrc, uint16_t sequence)
+        {
+            TEST_CHECK(ssrc == 0xabcd);
+            read.push_back(sequence);
+        }));
+        TEST_CHECK(read.size() == 6 && std::equal(read.begin(), read.end(), lost));
+
+        TEST_CHECK(!Rtcp::ForEachNackedSequence(compound, 8 + size - 1, [](uint32_t, uint16_t) {}));
+    }
+
+    void BoundsAndSuppression()
+    {
+        RtpRetransmissionBuffer buffer(RtpRetransmissionSettings{ 64, 100, 64, 20 });
+        std::vector<uint8_t> out(Rtp::k_MaxPacketSize);
+        size_t size = 0;
+
+        // Across the sequence number wrap, more packets than the index holds.
+        const uint64_t now = k_StartNs;
+        for (uint32_t i = 0; i < 200; ++i)
+        {
+            const auto packet = MakePacket(static_cast<uint16_t>(65500 + i), 7, 500);
+            TEST_CHECK(buffer.Add(packet.data(), packet.size(), now));
+        }
+
+        RtpRetransmissionStats stats;
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.packetsStored <= 64 && stats.bytesStored <= 64 * 1024);
+        TEST_CHECK(stats.bytesStored == stats.packetsStored * 500);
+
+        const auto last = static_cast<uint16_t>(65500 + 199);
+        TEST_CHECK(buffer.Retransmit(last, now, out.data(), out.size(), size) == RtpRetransmitResult::Retransmit);
+        TEST_CHECK(size == 500 && std::memcmp(out.data(), MakePacket(last, 7, 500).data(), size) == 0);
+
+        // Not again within minIntervalMs.
+        TEST_CHECK(buffer.Retransmit(last, now + 5 * k_MsNs, out.data(), out.size(), size) == RtpRetransmitResult::Suppressed);
+        TEST_CHECK(buffer.Retransmit(last, now + 25 * k_MsNs, out.data(), out.size(), size) == RtpRetransmitResult::Retransmit);
+
+        // Never sent, evicted, expired.
+        TEST_CHECK(buffer.Retransmit(static_cast<uint16_t>(last + 1), now, out.data(), out.size(), size) == RtpRetransmitResult::Unavailable);
+        TEST_CHECK(buffer.Retransmit(65500, now, out.data(), out.size(), size) == RtpRetransmitResult::Unavailable);
+        TEST_CHECK(buffer.Retransmit(static_cast<uint16_t>(last - 60), now + 200 * k_MsNs, out.data(), out.size(), size) ==
+                   RtpRetransmitResult::Unavailable);
+
+        // Out of order packets are rejected, the gap of a lost send isn't retransmitted.
+        const auto late = MakePacket(static_cast<uint16_t>(last - 3), 7, 100);
+        TEST_CHECK(!buffer.Add(late.data(), late.size(), now));
+        const auto afterGap = MakePacket(static_cast<uint16_t>(last + 6), 7, 300);
+        TEST_CHECK(buffer.Add(afterGap.data(), afterGap.size(), now + 1));
+        TEST_CHECK(buffer.Retransmit(static_cast<uint16_t>(last + 3), now + 1, out.data(), out.size(), size) == RtpRetransmitResult::Unavailable);
+        TEST_CHECK(buffer.Retransmit(static_cast<uint16_t>(last + 6), now + 1, out.data(), out.size(), size) == RtpRetransmitResult::Retransmit);
+
+        // Expired packets are evicted when adding.
+        const auto later = MakePacket(static_cast<uint16_t>(last + 7), 7, 300);
+        TEST_CHECK(buffer.Add(later.data(), later.size(), now + 500 * k_MsNs));
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.packetsStored == 1);
+
+        // A jump larger than the index forgets everything.
+        const auto jump = MakePacket(static_cast<uint16_t>(last + 20000), 7, 300);
+        TEST_CHECK(buffer.Add(jump.data(), jump.size(), now + 500 * k_MsNs + 1));
+        buffer.GetStats(stats);
+        TEST_CHECK(stats.packetsStored == 1 && stats.bytesStored == 300);
+    }
+
+    void SlabWrapsAround()
+    {
+        RtpRetransmissionBuffer buffer(RtpRetransmissionSettings{ 32, 1000, 256, 1 });
+        std::vector<uint8_t> out(Rtp::k_MaxPacketSize);
+        std::map<uint16_t, size_t> sizes;
+        std::mt19937 random(1);
+
+        uint16_t sequence = 100;
+        for (uint64_t i = 0; i < 20000; ++i)
+        {
+            sequence += (random() % 50 == 0) ? 3 : 1;
+            const size_t packetSize = Rtp::k_HeaderSize + random() % 9000;
+            const auto packet = MakePacket(sequence, 9, packetSize);
+            TEST_CHECK(buffer.Add(packet.data(), packet.size(), k_StartNs + i));
+            sizes[sequence] = packetSize;
+
+            // Whatever is still stored comes back intact.
+            const auto requested = static_cast<uint16_t>(sequence - random() % 300);
+            size_t size = 0;
+            if (buffer.Retransmit(requested, k_StartNs + i + 10 * k_MsNs * i, out.data(), out.size(), size) == RtpRetransmitResult::Retransmit)
+            {
+                TEST_CHECK(size == sizes[requested]);
+                TEST_CHECK(std::memcmp(out.data(), MakePacket(requested, 9, size).data(), size) == 0);
+            }
+
+            RtpRetransmissionStats stats;
+            buffer.GetStats(stats);
+            TEST_CHECK(stats.bytesStored <= 32 * 1024);
+        }
+    }
+
+    // A receiver of an RTP stream over the loopback: reports the missing packets in NACKs.
+    class NackingReceiver final
+    {
+    public:
+        NackingReceiver(uint32_t ssrc, uint16_t firstSequence, size_t count) :
+            m_Ssrc(ssrc),
+            m_FirstSequence(firstSequence),
+            m_Received(count, false),
+            m_LastNackNs(count, 0),
+            m_ReceivedCount(0),
+            m_Highest(-1)
+        {
+        }
+
+        const Tests::UdpLoopback& GetSocket() const { return m_Socket; }
+        bool IsComplete() const { return m_ReceivedCount == m_Received.size(); }
+        size_t GetReceivedCount() const { return m_ReceivedCount; }
+
+        // The last packets are only known missing from the sender report giving the last one sent.
+        void OnSenderReport() { m_Highest = static_cast<int>(m_Received.size()); }
+
+        void Receive()
+        {
+            uint8_t packet[Rtp::k_MaxPacketSize];
+            int size;
+            while ((size = m_Socket.Receive(packet, sizeof(packet))) >= 0)
+            {
+                TEST_CHECK(Rtp::GetSsrc(packet) == m_Ssrc);
+                const auto sequence = Rtp::GetSequenceNumber(packet);
+                const auto index = static_cast<uint16_t>(sequence - m_FirstSequence);
+                TEST_CHECK(index < m_Received.size());
+                TEST_CHECK(std::memcmp(packet, MakePacket(sequence, m_Ssrc, GetPacketSize(sequence)).data(), size) == 0);
+
+                if (!m_Received[index])
+                {
+                    m_Received[index] = true;
+                    ++m_ReceivedCount;
+                }
+                m_Highest = std::max(m_Highest, static_cast<int>(index));
+            }
+        }
+
+        // Reports the packets missing below the highest received, at most once per interval each.
+        void SendNacks(uint16_t port, uint64_t nowNs, uint64_t intervalNs)
+        {
+            std::vector<uint16_t> lost;
+            for (int i = 0; i < m_Highest; ++i)
+            {
+                if (!m_Received[i] && nowNs - m_LastNackNs[i] >= intervalNs)
+                {
+                    lost.push_back(static_cast<uint16_t>(m_FirstSequence + i));
+                    m_LastNackNs[i] = nowNs;
+                }
+            }
+
+            for (size_t i = 0; i < lost.size(); i += 64)
+            {
+                uint8_t nack[512];
+                const auto size = Rtcp::WriteGenericNack(1, m_Ssrc, lost.data() + i, std::min<size_t>(64, lost.size() - i), nack, sizeof(nack));
+                TEST_CHECK(size > 0);
+                m_Socket.SendTo(port, nack, size);
+            }
+        }
+
+        static size_t GetPacketSize(uint16_t sequence)
+        {
+            return 200 + (sequence * 7919u) % 1200;
+        }
+
+    private:
+        Tests::UdpLoopback    m_Socket;
+        uint32_t              m_Ssrc;
+        uint16_t              m_FirstSequence;
+        std::vector<bool>     m_Received;
+        std::vector<uint64_t> m_LastNackNs;
+        size_t                m_ReceivedCount;
+        int                   m_Highest;
+    };
+
+    void RecoversLossesOverTheLoopback()
+    {
+        const uint32_t ssrc = 0x4321fade;
+        const uint16_t firstSequence = 60000;
+        const size_t count = 20000;
+        const double loss = 0.1;
+
+        // The clock is simulated, one packet per millisecond, so the run doesn't depend on the load.
+        RtpRetransmissionBuffer history(RtpRetransmissionSettings{ 0, 0, 0, 0 });
+        Tests::UdpLoopback media;
+        Tests::UdpLoopback control;
+        NackingReceiver receiver(ssrc, firstSequence, count);
+
+        std::mt19937 random(3);
+        std::bernoulli_distribution isLost(loss);
+        size_t lostCount = 0;
+        uint64_t now = k_StartNs;
+
+        // The sender drops packets, the retransmissions are dropped at the same rate.
+        const auto serveNacks = [&]()
+        {
+            uint8_t rtcp[2048];
+            int size;
+            while ((size = control.Receive(rtcp, sizeof(rtcp))) >= 0)
+            {
+                history.HandleRtcp(rtcp, size, ssrc, now, [&](const uint8_t* packet, size_t packetSize)
+                {
+                    if (!isLost(random))
+                    {
+                        media.SendTo(receiver.GetSocket().GetPort(), packet, packetSize);
+                    }
+                });
+            }
+            receiver.Receive();
+        };
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const auto sequence = static_cast<uint16_t>(firstSequence + i);
+            const auto packet = MakePacket(sequence, ssrc, NackingReceiver::GetPacketSize(sequence));
+            if (isLost(random))
+            {
+                ++lostCount;
+            }
+            else
+            {
+                media.SendTo(receiver.GetSocket().GetPort(), packet.data(), packet.size());
+            }
+            TEST_CHECK(history.Add(packet.data(), packet.size(), now));
+            now += k_MsNs;
+
+            if (i % 20 == 19)
+            {
+                receiver.Receive();
+                receiver.SendNacks(control.GetPort(), now, 30 * k_MsNs);
+                serveNacks();
+            }
+        }
+
+        receiver.OnSenderReport();
+        for (int round = 0; round < 20 && !receiver.IsComplete(); ++round)
+        {
+            now += 30 * k_MsNs;
+            receiver.Receive();
+            receiver.SendNacks(control.GetPort(), now, 30 * k_MsNs);
+            serveNacks();
+        }
+
+        RtpRetransmissionStats stats;
+        history.GetStats(stats);
+        std::printf("%zu of %zu packets lost, %llu retransmitted, %zu received\n",
+                    lostCount, count, static_cast<unsigned long long>(stats.packetsRetransmitted), receiver.GetReceivedCount());
+
+        TEST_CHECK(lostCount > count / 20);
+        TEST_CHECK(receiver.IsComplete());
+        TEST_CHECK(stats.packetsAdded == count);
+        TEST_CHECK(stats.packetsRetransmitted >= lostCount);
+        TEST_CHECK(stats.packetsUnavailable == 0);
+    }
+}
+
+int main()
+{
+    TEST_RUN(NackRoundTrip);
+    TEST_RUN(BoundsAndSuppression);
+    TEST_RUN(SlabWrapsAround);
+    TEST_RUN(RecoversLossesOverTheLoopback);
+    return 0;
+}
@@ -0,0 +1,303 @@
+#include "TestUtils.h"
+#include "CpuNV12Converter.h"
+#include "SimulcastScheduler.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using NvencPlugin::CpuImage;
+using NvencPlugin::CpuNV12Converter;
+using NvencPlugin::INV12Converter;
+using NvencPlugin::SimulcastLayerDesc;
+using NvencPlugin::SimulcastScheduler;
+
+namespace
+{
+    const uint64_t k_Second = 1000000000ull;
+
+    struct Image
+    {
+        std::vector<uint8_t> pixels;
+        CpuImage             view;
+
+        Image(int width, int height, int bytesPerPixel, int rows)
+        {
+            pixels.assign(static_cast<size_t>(width) * bytesPerPixel * rows, 0);
+            view = { pixels.data(), width, height, width * bytesPerPixel };
+        }
+
+        static Image Bgra(int width, int height) { return Image(width, height, 4, height); }
+        static Image NV12(int width, int height) { return Image(width, height, 1, height + height / 2); }
+
+        void Fill(int x0, int x1, uint8_t r, uint8_t g, uint8_t b)
+        {
+            for (int y = 0; y < view.height; ++y)
+            {
+                for (int x = x0; x < x1; ++x)
+                {
+                    uint8_t* pixel = view.data + y * view.stride + 4 * x;
+                    pixel[0] = b;
+                    pixel[1] = g;
+                    pixel[2] = r;
+                    pixel[3] = 255;
+                }
+            }
+        }
+
+        uint8_t Luma(int x, int y) const { return view.data[y * view.stride + x]; }
+
+        uint8_t Cb(int x, int y) const { return view.data[(view.height + y / 2) * view.stride + (x & ~1)]; }
+
+        uint8_t Cr(int x, int y) const { return view.data[(view.height + y / 2) * view.stride + (x & ~1) + 1]; }
+    };
+
+    // Stands in for an encoder of the group: converts its input like the NVENC layers do, and
+    // records what it was asked to encode.
+    struct FakeLayer
+    {
+        int                             id;
+        Image                           input;
+        std::unique_ptr<INV12Converter> converter;
+        std::vector<uint64_t>           timestamps;
+
+        FakeLayer(int layerId, const CpuImage* staging, int width, int height) :
+            id(layerId),
+            input(Image::NV12(width, height)),
+            converter(new CpuNV12Converter(staging, width, height))
+        {
+        }
+    };
+
+    // Same flow as NvencSimulcastGroup::EncodeFrame, with a CPU copy and the CPU converters.
+    struct FakeGroup
+    {
+        SimulcastScheduler                      scheduler;
+        std::vector<int>                        scheduled;
+        Image                                   staging;
+        std::vector<std::unique_ptr<FakeLayer>> layers;
+        int                                     copies = 0;
+
+        FakeGroup(int width, int height) :
+            staging(Image::Bgra(width, height))
+        {
+        }
+
+        FakeLayer& AddLayer(int id, int width, int height)
+        {
+            layers.emplace_back(new FakeLayer(id, &staging.view, width, height));
+            return *layers.back();
+        }
+
+        void EncodeFrame(const Image& source, uint64_t timestamp)
+        {
+            scheduler.Schedule(timestamp, scheduled);
+
+            bool sourceReady = false;
+            for (const auto id : scheduled)
+            {
+                for (auto& layer : layers)
+                {
+                    if (layer->id != id)
+                        continue;
+
+                    if (!sourceReady)
+                    {
+                        std::memcpy(staging.pixels.data(), source.pixels.data(), source.pixels.size());
+                        ++copies;
+                        sourceReady = true;
+                    }
+
+                    TEST_CHECK(layer->converter->ConvertToNV12(&layer->input.view));
+                    layer->timestamps.push_back(timestamp);
+                }
+            }
+        }
+    };
+
+    uint8_t GrayLuma(uint8_t value)
+    {
+        return static_cast<uint8_t>(16 + (value * 219 + 127) / 255);
+    }
+
+    void SchedulesEachLayerAtItsFrameRate()
+    {
+        SimulcastScheduler scheduler;
+        const SimulcastLayerDesc layers[] = { { 1, 60, 0 }, { 2, 30, 5 }, { 3, 0, 1 } };
+        scheduler.SetLayers(layers, 3);
+        TEST_CHECK(scheduler.GetLayerCount() == 3);
+
+        std::vector<int> ids;
+        int counts[4] = {};
+
+        for (int frame = 0; frame < 600; ++frame)
+        {
+            // 60 Hz source with up to 1 ms of jitter.
+            const uint64_t timestamp = frame * k_Second / 60 + (frame % 3) * 500000;
+            scheduler.Schedule(timestamp, ids);
+
+            // By decreasing priority.
+            if (frame == 0)
+            {
+                TEST_CHECK(ids == std::vector<int>({ 2, 3, 1 }));
+            }
+
+            for (const auto id : ids)
+            {
+                ++counts[id];
+            }
+        }
+
+        TEST_CHECK(counts[1] == 600);
+        TEST_CHECK(counts[2] == 300);
+        // No frame rate: every source frame.
+        TEST_CHECK(counts[3] == 600);
+    }
+
+    void KeepsTheCadenceAcrossReconfiguration()
+    {
+        SimulcastScheduler scheduler;
+        const SimulcastLayerDesc layers[] = { { 1, 30, 0 } };
+        scheduler.SetLayers(layers, 1);
+
+        std::vector<int> ids;
+        scheduler.Schedule(0, ids);
+        TEST_CHECK(ids.size() == 1);
+
+        // A layer keeping its id keeps its timing: the next 60 Hz frame is still too early.
+        const SimulcastLayerDesc reconfigured[] = { { 1, 30, 0 }, { 2, 30, 1 } };
+        scheduler.SetLayers(reconfigured, 2);
+        scheduler.Schedule(k_Second / 60, ids);
+        TEST_CHECK(ids == std::vector<int>({ 2 }));
+
+        scheduler.Schedule(2 * k_Second / 60, ids);
+        TEST_CHECK(ids == std::vector<int>({ 1 }));
+
+        // After a stall longer than a period, the layer restarts from the current frame
+        // instead of catching up with a burst.
+        scheduler.Schedule(k_Second, ids);
+        TEST_CHECK(ids == std::vector<int>({ 2, 1 }));
+        scheduler.Schedule(k_Second + k_Second / 60, ids);
+        TEST_CHECK(ids.empty());
+        scheduler.Schedule(k_Second + 2 * k_Second / 60, ids);
+        TEST_CHECK(ids == std::vector<int>({ 2, 1 }));
+    }
+
+    void ConvertsToStudioRangeBT709()
+    {
+        auto source = Image::Bgra(4, 4);
+        auto output = Image::NV12(4, 4);
+        CpuNV12Converter converter(4, 4, 4, 4);
+
+        const struct
+        {
+            uint8_t r, g, b;
+            uint8_t y, cb, cr;
+        } colors[] = {
+            { 0, 0, 0, 16, 128, 128 },
+            { 255, 255, 255, 235, 128, 128 },
+            { 255, 0, 0, 63, 102, 240 },
+            { 0, 255, 0, 173, 42, 26 },
+            { 128, 128, 128, 126, 128, 128 },
+            { 0, 0, 255, 32, 240, 118 },
+        };
+
+        for (const auto& color : colors)
+        {
+            source.Fill(0, 4, color.r, color.g, color.b);
+            TEST_CHECK(converter.ConvertRGBToNV12(&source.view, &output.view));
+
+            for (int y = 0; y < 4; ++y)
+            {
+                for (int x = 0; x < 4; ++x)
+                {
+                    TEST_CHECK(output.Luma(x, y) == color.y);
+                    TEST_CHECK(output.Cb(x, y) == color.cb);
+                    TEST_CHECK(output.Cr(x, y) == color.cr);
+                }
+            }
+        }
+    }
+
+    void ScalesWithAlignedTexelCenters()
+    {
+        // Left half black, right half white.
+        auto source = Image::Bgra(16, 8);
+        source.Fill(8, 16, 255, 255, 255);
+
+        // Downscaling by 2 averages pairs of texels of the same half.
+        auto half = Image::NV12(8, 4);
+        CpuNV12Converter downscale(16, 8, 8, 4);
+        TEST_CHECK(downscale.ConvertRGBToNV12(&source.view, &half.view));
+        for (int y = 0; y < 4; ++y)
+        {
+            for (int x = 0; x < 8; ++x)
+            {
+                TEST_CHECK(half.Luma(x, y) == (x < 4 ? 16 : 235));
+            }
+        }
+
+        // Upscaling interpolates around the edge only, monotonically.
+        auto doubled = Image::NV12(32, 16);
+        CpuNV12Converter upscale(16, 8, 32, 16);
+        TEST_CHECK(upscale.ConvertRGBToNV12(&source.view, &doubled.view));
+        TEST_CHECK(doubled.Luma(0, 0) == 16 && doubled.Luma(14, 0) == 16);
+        TEST_CHECK(doubled.Luma(17, 0) == 235 && doubled.Luma(31, 15) == 235);
+        TEST_CHECK(doubled.Luma(15, 0) > 16 && doubled.Luma(15, 0) < doubled.Luma(16, 0) && doubled.Luma(16, 0) < 235);
+
+        // Mismatched or odd sizes are rejected.
+        TEST_CHECK(!downscale.ConvertRGBToNV12(&source.view, &doubled.view));
+        auto odd = Image::NV12(7, 4);
+        CpuNV12Converter oddConverter(16, 8, 7, 4);
+        TEST_CHECK(!oddConverter.ConvertRGBToNV12(&source.view, &odd.view));
+    }
+
+    void CopiesOnceForAllTheScheduledLayers()
+    {
+        FakeGroup group(64, 32);
+        auto& monitor = group.AddLayer(1, 64, 32);
+        auto& tablet = group.AddLayer(2, 32, 16);
+
+        const SimulcastLayerDesc layers[] = { { 1, 60, 1 }, { 2, 30, 0 } };
+        group.scheduler.SetLayers(layers, 2);
+
+        auto source = Image::Bgra(64, 32);
+        for (int frame = 0; frame < 60; ++frame)
+        {
+            // A different solid color per frame, to check each layer converted the current one.
+            const uint8_t value = static_cast<uint8_t>(frame * 4);
+            source.Fill(0, 64, value, value, value);
+            group.EncodeFrame(source, frame * k_Second / 60);
+
+            const uint8_t expected = GrayLuma(value);
+            TEST_CHECK(monitor.input.Luma(63, 31) == expected);
+            if (frame % 2 == 0)
+            {
+                TEST_CHECK(tablet.input.Luma(31, 15) == expected);
+            }
+        }
+
+        TEST_CHECK(monitor.timestamps.size() == 60);
+        TEST_CHECK(tablet.timestamps.size() == 30);
+        TEST_CHECK(group.copies == 60);
+
+        // Without any layer due, the source isn't even copied.
+        const SimulcastLayerDesc slow[] = { { 2, 30, 0 } };
+        group.scheduler.SetLayers(slow, 1);
+        group.EncodeFrame(source, 60 * k_Second / 60);
+        TEST_CHECK(group.copies == 61);
+        group.EncodeFrame(source, 61 * k_Second / 60);
+        TEST_CHECK(group.copies == 61);
+        TEST_CHECK(monitor.timestamps.size() == 60);
+    }
+}
+
+int main()
+{
+    TEST_RUN(SchedulesEachLayerAtItsFrameRate);
+    TEST_RUN(KeepsTheCadenceAcrossReconfiguration);
+    TEST_RUN(ConvertsToStudioRangeBT709);
+    TEST_RUN(ScalesWithAlignedTexelCenters);
+    TEST_RUN(CopiesOnceForAllTheScheduledLayers);
+    return 0;
+}
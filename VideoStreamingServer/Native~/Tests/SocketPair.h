@@ -0,0 +1,41 @@
+#pragma once
+
+#include <sys/socket.h>
+
+#include "Socket.h"
+#include "TestUtils.h"
+
+namespace LiveCaptureNative
+{
+    namespace Tests
+    {
+        // A connected pair of stream sockets with small buffers: the sender side is non-blocking
+        // and fills up after a few access units, the test reads the other side when it chooses to.
+        struct SocketPair
+        {
+            int sender;
+            int receiver;
+
+            explicit SocketPair(int bufferSize = 64 * 1024)
+            {
+                int sockets[2];
+                TEST_CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+                sender = sockets[0];
+                receiver = sockets[1];
+
+                setsockopt(sender, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize));
+                setsockopt(receiver, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+                TEST_CHECK(Net::SetNonBlocking(sender));
+            }
+
+            ~SocketPair()
+            {
+                Net::Close(sender);
+                Net::Close(receiver);
+            }
+
+            SocketPair(const SocketPair&) = delete;
+            SocketPair& operator=(const SocketPair&) = delete;
+        };
+    }
+}
@@ -0,0 +1,208 @@
+#include "TestUtils.h"
+#include "SpscFrameRing.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using LiveCaptureNative::SpscFrameRing;
+
+namespace
+{
+    struct Frame
+    {
+        std::vector<uint8_t> data;
+        uint64_t             sequence;
+    };
+
+    // Variable frame sizes, like key frames among delta frames.
+    size_t FrameSize(uint64_t sequence)
+    {
+        return (sequence % 30 == 0) ? 4096 : 64 + sequence % 512;
+    }
+
+    void Write(Frame& frame, uint64_t sequence)
+    {
+        frame.sequence = sequence;
+        frame.data.resize(FrameSize(sequence));
+        for (size_t i = 0; i < frame.data.size(); ++i)
+        {
+            frame.data[i] = static_cast<uint8_t>(sequence + i);
+        }
+    }
+
+    bool IsIntact(const Frame& frame)
+    {
+        if (frame.data.size() != FrameSize(frame.sequence))
+            return false;
+
+        for (size_t i = 0; i < frame.data.size(); ++i)
+        {
+            if (frame.data[i] != static_cast<uint8_t>(frame.sequence + i))
+                return false;
+        }
+        return true;
+    }
+
+    // The producer retries when the ring is full: every frame must arrive once, in order, intact.
+    void StressWithoutLoss()
+    {
+        const uint64_t count = 200000;
+        SpscFrameRing<Frame, 8> ring;
+
+        std::thread producer([&ring, count]()
+        {
+            for (uint64_t sequence = 0; sequence < count; ++sequence)
+            {
+                Frame* frame;
+                while ((frame = ring.BeginWrite()) == nullptr)
+                {
+                    std::this_thread::yield();
+                }
+                Write(*frame, sequence);
+                ring.Publish();
+            }
+        });
+
+        uint64_t expected = 0;
+        while (expected < count)
+        {
+            const Frame* frame = ring.Front();
+            if (frame == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            TEST_CHECK(frame->sequence == expected);
+            TEST_CHECK(IsIntact(*frame));
+            TEST_CHECK(ring.GetSize() >= 1 && ring.GetSize() <= 8);
+            TEST_CHECK(ring.Pop());
+            ++expected;
+        }
+
+        producer.join();
+
+        TEST_CHECK(ring.Front() == nullptr);
+        TEST_CHECK(!ring.Pop());
+        TEST_CHECK(ring.GetSize() == 0);
+    }
+
+    // The producer drops when the ring is full, like the encoder output threads: the frames
+    // that arrive are in order and intact, and every other one is counted as dropped.
+    void StressWithDrops()
+    {
+        const uint64_t count = 200000;
+        SpscFrameRing<Frame, 4> ring;
+        ring.SetLimit(3);
+
+        std::atomic<bool> done(false);
+        std::thread producer([&ring, &done, count]()
+        {
+            for (uint64_t sequence = 0; sequence < count; ++sequence)
+            {
+                if (auto frame = ring.BeginWrite())
+                {
+                    Write(*frame, sequence);
+                    ring.Publish();
+                }
+
+                if (sequence % 64 == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+            done = true;
+        });
+
+        uint64_t received = 0;
+        uint64_t next = 0;
+        for (;;)
+        {
+            const bool isDone = done;
+            const Frame* frame = ring.Front();
+            if (frame == nullptr)
+            {
+                if (isDone)
+                    break;
+                std::this_thread::yield();
+                continue;
+            }
+
+            TEST_CHECK(frame->sequence >= next);
+            TEST_CHECK(IsIntact(*frame));
+            TEST_CHECK(ring.GetSize() <= 3);
+            next = frame->sequence + 1;
+            ++received;
+            ring.Pop();
+        }
+
+        producer.join();
+
+        TEST_CHECK(received > 0);
+        TEST_CHECK(received + ring.GetDroppedCount() == count);
+    }
+
+    // Slots are handed back with their storage: once every slot held the largest frame,
+    // writing frames allocates no more.
+    void ReusesTheSlotStorage()
+    {
+        SpscFrameRing<Frame, 4> ring;
+        ring.ForEachSlot([](Frame& frame) { frame.data.reserve(4096); });
+
+        std::vector<const uint8_t*> buffers;
+        ring.ForEachSlot([&buffers](Frame& frame) { buffers.push_back(frame.data.data()); });
+
+        for (uint64_t sequence = 0; sequence < 1000; ++sequence)
+        {
+            auto frame = ring.BeginWrite();
+            TEST_CHECK(frame != nullptr);
+            Write(*frame, sequence);
+            TEST_CHECK(frame->data.data() == buffers[sequence % 4]);
+            ring.Publish();
+
+            TEST_CHECK(ring.Front()->sequence == sequence);
+            ring.Pop();
+        }
+    }
+
+    void DropsNewestWhenFull()
+    {
+        SpscFrameRing<Frame, 4> ring;
+        ring.SetLimit(2);
+
+        for (uint64_t sequence = 0; sequence < 3; ++sequence)
+        {
+            if (auto frame = ring.BeginWrite())
+            {
+                Write(*frame, sequence);
+                ring.Publish();
+            }
+        }
+
+        TEST_CHECK(ring.GetSize() == 2);
+        TEST_CHECK(ring.GetDroppedCount() == 1);
+        TEST_CHECK(ring.Front()->sequence == 0);
+
+        // The limit is clamped, and queued frames above a lowered limit stay.
+        ring.SetLimit(0);
+        TEST_CHECK(ring.GetLimit() == 1);
+        TEST_CHECK(ring.BeginWrite() == nullptr);
+        TEST_CHECK(ring.GetSize() == 2);
+        ring.SetLimit(100);
+        TEST_CHECK(ring.GetLimit() == 4);
+
+        ring.Clear();
+        TEST_CHECK(ring.Front() == nullptr);
+        TEST_CHECK(ring.BeginWrite() != nullptr);
+    }
+}
+
+int main()
+{
+    TEST_RUN(StressWithoutLoss);
+    TEST_RUN(StressWithDrops);
+    TEST_RUN(ReusesTheSlotStorage);
+    TEST_RUN(DropsNewestWhenFull);
+    return 0;
+}
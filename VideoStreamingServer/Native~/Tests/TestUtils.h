@@ -0,0 +1,54 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+
+// Each test is an executable run by ctest: a failed check prints its location and exits
+// with an error code, so that the remaining checks don't run on a broken state.
+#define TEST_CHECK(condition)                                                                    \
+    do                                                                                           \
+    {                                                                                            \
+        if (!(condition))                                                                        \
+        {                                                                                        \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);  \
+            std::exit(1);                                                                        \
+        }                                                                                        \
+    } while (false)
+
+namespace LiveCaptureNative
+{
+    namespace Tests
+    {
+        inline void Run(const char* name, void (*test)())
+        {
+            std::printf("%s\n", name);
+            test();
+        }
+
+        // Runs fn iterations times and prints the duration per iteration, and the throughput when
+        // bytesPerIteration is set. Returns the seconds per iteration.
+        template <typename Fn> double Benchmark(const char* name, int iterations, size_t bytesPerIteration, Fn fn)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < iterations; ++i)
+            {
+                fn();
+            }
+            const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+            if (bytesPerIteration > 0)
+            {
+                std::printf("%s: %.3f us, %.1f MB/s\n", name, seconds * 1e6, bytesPerIteration / seconds / 1e6);
+            }
+            else
+            {
+                std::printf("%s: %.3f us\n", name, seconds * 1e6);
+            }
+            return seconds;
+        }
+    }
+}
+
+#define TEST_RUN(test) LiveCaptureNative::Tests::Run(#test, test)
@@ -0,0 +1,195 @@
+#include "TimecodeSei.h"
+#include "TestUtils.h"
+
+#include <algorithm>
+#include <initializer_list>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    const Sei::Codec k_Codecs[] = { Sei::Codec::H264, Sei::Codec::Hevc };
+
+    // An access unit as the encoders output it: delimiter, parameter sets, the encoder's own SEI,
+    // then the slices. The H264 key frame slice holds an emulation prevention byte.
+    std::vector<uint8_t> MakeAccessUnit(Sei::Codec codec)
+    {
+        std::vector<uint8_t> accessUnit;
+        const auto append = [&accessUnit](std::initializer_list<uint8_t> nal, bool isLongStartCode)
+        {
+            if (isLongStartCode)
+            {
+                accessUnit.push_back(0);
+            }
+            accessUnit.insert(accessUnit.end(), { 0, 0, 1 });
+            accessUnit.insert(accessUnit.end(), nal);
+        };
+
+        if (codec == Sei::Codec::H264)
+        {
+            append({ 0x09, 0xf0 }, true);
+            append({ 0x67, 0x42, 0x00, 0x1f }, true);
+            append({ 0x68, 0xce }, true);
+            append({ 0x06, 0x05, 0x01, 0xaa, 0x80 }, false);
+            append({ 0x65, 0x88, 0x00, 0x00, 0x03, 0x01, 0x84 }, true);
+            append({ 0x41, 0x9a }, false);
+        }
+        else
+        {
+            append({ 0x46, 0x01, 0x50 }, true);
+            append({ 0x40, 0x01, 0x0c }, true);
+            append({ 0x42, 0x01, 0x01 }, true);
+            append({ 0x44, 0x01, 0xc1 }, true);
+            append({ 0x26, 0x01, 0xaf, 0x00, 0x00, 0x03, 0x02 }, true);
+        }
+        return accessUnit;
+    }
+
+    Sei::FrameMetadata MakeMetadata()
+    {
+        Sei::FrameMetadata metadata = {};
+        metadata.timecode = FrameTimecode{ 13, 59, 58, 29, 25600, 51200, 30000, 1001, 1 };
+        metadata.sequence = 0x0000000100000003ull;
+        metadata.timestamp = 0x0000000000000300ull;
+        return metadata;
+    }
+
+    void InsertsBeforeTheFirstSlice()
+    {
+        for (const auto codec : k_Codecs)
+        {
+            auto accessUnit = MakeAccessUnit(codec);
+            const auto original = accessUnit;
+            const auto offset = Sei::GetMetadataOffset(codec, accessUnit.data(), accessUnit.size());
+            TEST_CHECK(offset < original.size());
+
+            TEST_CHECK(Sei::InsertMetadata(codec, MakeMetadata(), accessUnit));
+            const auto nalSize = accessUnit.size() - original.size();
+            TEST_CHECK(nalSize > 0 && nalSize <= Sei::k_MaxNalSize);
+
+            // The NAL units around the inserted one are left untouched.
+            TEST_CHECK(std::equal(original.begin(), original.begin() + offset, accessUnit.begin()));
+            TEST_CHECK(std::equal(original.begin() + offset, original.end(), accessUnit.begin() + offset + nalSize));
+
+            const uint8_t* nal = &accessUnit[offset];
+            TEST_CHECK(nal[0] == 0 && nal[1] == 0 && nal[2] == 0 && nal[3] == 1);
+            TEST_CHECK(Sei::Detail::IsSeiNal(codec, nal + 4));
+            for (size_t i = 4; i + 2 < nalSize; ++i)
+            {
+                TEST_CHECK(!(nal[i] == 0 && nal[i + 1] == 0 && nal[i + 2] <= 2));
+            }
+
+            // The inserted SEI is the NAL unit right before the first slice.
+            int index = 0;
+            int firstSlice = -1;
+            const uint8_t* previous = nullptr;
+            const uint8_t* beforeFirstSlice = nullptr;
+            AnnexB::ForEachNalUnit(accessUnit.data(), accessUnit.size(), [&](const uint8_t* unit, size_t)
+            {
+                if (firstSlice < 0 && Sei::Detail::IsVclNal(codec, unit))
+                {
+                    firstSlice = index;
+                    beforeFirstSlice = previous;
+                }
+                previous = unit;
+                ++index;
+            });
+            TEST_CHECK(firstSlice > 0 && beforeFirstSlice == nal + 4);
+        }
+    }
+
+    void ReadsWhatWasWritten()
+    {
+        for (const auto codec : k_Codecs)
+        {
+            const auto metadata = MakeMetadata();
+            auto accessUnit = MakeAccessUnit(codec);
+            TEST_CHECK(Sei::InsertMetadata(codec, metadata, accessUnit));
+
+            Sei::FrameMetadata read = {};
+            TEST_CHECK(Sei::ReadMetadata(codec, accessUnit.data(), accessUnit.size(), read));
+            TEST_CHECK(std::memcmp(&read.timecode, &metadata.timecode, sizeof(metadata.timecode)) == 0);
+            TEST_CHECK(read.sequence == metadata.sequence);
+            TEST_CHECK(read.timestamp == metadata.timestamp);
+
+            // The standard time_code is only written for HEVC, without the frame rate.
+            FrameTimecode timecode = {};
+            if (codec == Sei::Codec::Hevc)
+            {
+                TEST_CHECK(Sei::ReadTimeCode(accessUnit.data(), accessUnit.size(), timecode));
+                TEST_CHECK(timecode.hours == 13 && timecode.minutes == 59 && timecode.seconds == 58);
+                TEST_CHECK(timecode.frames == 29 && timecode.isDropFrame == 1);
+                TEST_CHECK(timecode.rateNumerator == 0);
+            }
+            else
+            {
+                TEST_CHECK(!Sei::ReadTimeCode(accessUnit.data(), accessUnit.size(), timecode));
+            }
+
+            // Without the SEI, nothing is read.
+            const auto original = MakeAccessUnit(codec);
+            TEST_CHECK(!Sei::ReadMetadata(codec, original.data(), original.size(), read));
+        }
+    }
+
+    void ReadsFramesWithoutTimecode()
+    {
+        for (const auto codec : k_Codecs)
+        {
+            Sei::FrameMetadata metadata = {};
+            metadata.sequence = 7;
+            auto accessUnit = MakeAccessUnit(codec);
+            TEST_CHECK(Sei::InsertMetadata(codec, metadata, accessUnit));
+
+            Sei::FrameMetadata read = {};
+            TEST_CHECK(Sei::ReadMetadata(codec, accessUnit.data(), accessUnit.size(), read));
+            TEST_CHECK(!HasTimecode(read.timecode));
+            TEST_CHECK(read.sequence == 7);
+
+            FrameTimecode timecode = {};
+            TEST_CHECK(!Sei::ReadTimeCode(accessUnit.data(), accessUnit.size(), timecode));
+        }
+    }
+
+    void EscapesZeroPayloads()
+    {
+        for (const auto codec : k_Codecs)
+        {
+            // All the fields to zero: the most emulation prevention bytes.
+            uint8_t nal[Sei::k_MaxNalSize];
+            TEST_CHECK(Sei::WriteMetadataNal(codec, Sei::FrameMetadata(), nal, sizeof(nal) - 1) == 0);
+            const auto size = Sei::WriteMetadataNal(codec, Sei::FrameMetadata(), nal, sizeof(nal));
+            TEST_CHECK(size > 0 && size <= Sei::k_MaxNalSize);
+
+            std::vector<uint8_t> accessUnit(nal, nal + size);
+            accessUnit.insert(accessUnit.end(), { 0, 0, 1, static_cast<uint8_t>(codec == Sei::Codec::H264 ? 0x65 : 0x26), 0x01 });
+
+            Sei::FrameMetadata read = {};
+            read.sequence = 99;
+            TEST_CHECK(Sei::ReadMetadata(codec, accessUnit.data(), accessUnit.size(), read));
+            TEST_CHECK(read.sequence == 0 && read.timestamp == 0);
+        }
+    }
+
+    void SkipsAccessUnitsWithoutSlice()
+    {
+        for (const auto codec : k_Codecs)
+        {
+            std::vector<uint8_t> accessUnit = { 0, 0, 0, 1, 0x67, 0x01 };
+            const auto original = accessUnit;
+            TEST_CHECK(Sei::GetMetadataOffset(codec, accessUnit.data(), accessUnit.size()) == accessUnit.size());
+            TEST_CHECK(!Sei::InsertMetadata(codec, MakeMetadata(), accessUnit));
+            TEST_CHECK(accessUnit == original);
+        }
+    }
+}
+
+int main()
+{
+    TEST_RUN(InsertsBeforeTheFirstSlice);
+    TEST_RUN(ReadsWhatWasWritten);
+    TEST_RUN(ReadsFramesWithoutTimecode);
+    TEST_RUN(EscapesZeroPayloads);
+    TEST_RUN(SkipsAccessUnitsWithoutSlice);
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "TraceRecorder.h"
+#include "TestUtils.h"
+
+#include <string>
+#include <thread>
+
+namespace
+{
+    using namespace LiveCaptureNative;
+
+    std::string WriteJson()
+    {
+        std::FILE* file = std::tmpfile();
+        TEST_CHECK(file != nullptr);
+        TEST_CHECK(TraceRecorder::Get().WriteChromeJson(file));
+
+        std::string json(static_cast<size_t>(std::ftell(file)), '\0');
+        std::rewind(file);
+        TEST_CHECK(std::fread(&json[0], 1, json.size(), file) == json.size());
+        std::fclose(file);
+        return json;
+    }
+
+    size_t Count(const std::string& text, const std::string& pattern)
+    {
+        size_t count = 0;
+        for (auto i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + pattern.size()))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    void DisabledRecordsNothing()
+    {
+        auto& recorder = TraceRecorder::Get();
+        recorder.SetEnabled(false);
+        recorder.Record(TracePhase::Instant, "Disabled", 1);
+        {
+            TraceScope scope("Disabled", 1, TraceFlow::Start);
+        }
+        TraceComplete("Disabled", 1, 1, 2);
+
+        const auto json = WriteJson();
+        TEST_CHECK(json.find("\"traceEvents\":[") != std::string::npos);
+        TEST_CHECK(json.find("Disabled") == std::string::npos);
+    }
+
+    void RegisteredNames()
+    {
+        auto& recorder = TraceRecorder::Get();
+        recorder.SetEnabled(true);
+        recorder.Clear();
+
+        const int id = recorder.RegisterName("Rtsp \"Send\"");
+        TEST_CHECK(id >= 0);
+        TEST_CHECK(recorder.RegisterName("Rtsp \"Send\"") == id);
+        TEST_CHECK(recorder.RegisterName(nullptr) == -1);
+        TEST_CHECK(recorder.GetName(id + 1) == nullptr);
+        TEST_CHECK(recorder.GetName(-1) == nullptr);
+
+        TraceBeginNamed(id, 7, TraceFlow::None);
+        TraceEndNamed(id, 7);
+
+        // The quotes of the name are escaped.
+        const auto json = WriteJson();
+        TEST_CHECK(Count(json, "\"name\":\"Rtsp \\\"Send\\\"\"") == 2);
+    }
+
+    void ScopesAndFlows()
+    {
+        auto& recorder = TraceRecorder::Get();
+        recorder.SetEnabled(true);
+        recorder.Clear();
+        recorder.SetThreadName("Render \"Thread\"");
+
+        {
+            TraceScope scope("Encoder.Copy", 42, TraceFlow::Start);
+        }
+        const auto now = GetEncodeClockNs();
+        TraceComplete("Encoder.Encode", 42, now - 2500, now);
+        {
+            TraceScope scope("Rtsp.Send", 42, TraceFlow::End);
+        }
+
+        const auto json = WriteJson();
+        TEST_CHECK(json.find("\"name\":\"thread_name\"") != std::string::npos);
+        TEST_CHECK(json.find("Render \\\"Thread\\\"") != std::string::npos);
+        TEST_CHECK(Count(json, "\"ph\":\"B\"") == 2);
+        TEST_CHECK(Count(json, "\"ph\":\"E\"") == 2);
+        TEST_CHECK(json.find("\"ph\":\"X\",\"cat\":\"LiveCapture\",\"name\":\"Encoder.Encode\"") != std::string::npos);
+        TEST_CHECK(json.find("\"dur\":2.500") != std::string::npos);
+
+        // One flow links the three stages of the frame.
+        TEST_CHECK(Count(json, "\"ph\":\"s\"") == 1);
+        TEST_CHECK(Count(json, "\"ph\":\"t\"") == 1);
+        TEST_CHECK(Count(json, "\"ph\":\"f\"") == 1);
+        TEST_CHECK(Count(json, "\"id\":\"0x2a\",\"bp\":\"e\"") == 3);
+        TEST_CHECK(Count(json, "\"args\":{\"frame\":42}") == 8);
+
+        // Complete events without a start time or ending before it are ignored.
+        recorder.Clear();
+        TraceComplete("Encoder.Encode", 42, now, now - 1);
+        TraceComplete("Encoder.Encode", 42, 0, now);
+        TEST_CHECK(WriteJson().find("Encoder.Encode") == std::string::npos);
+    }
+
+    void RingKeepsTheLatestEvents()
+    {
+        auto& recorder = TraceRecorder::Get();
+        recorder.SetEnabled(true);
+        recorder.Clear();
+
+        const size_t count = TraceRecorder::k_EventsPerThread + 100;
+        std::thread thread([count]()
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                TraceRecorder::Get().Record(TracePhase::Instant, "Ring", i);
+            }
+        });
+        thread.join();
+
+        // A full ring is read as if its owner were writing the next event: the oldest one is left out.
+        const auto json = WriteJson();
+        TEST_CHECK(Count(json, "\"name\":\"Ring\"") == TraceRecorder::k_EventsPerThread - 1);
+        TEST_CHECK(json.find("\"args\":{\"frame\":100}") == std::string::npos);
+        TEST_CHECK(json.find("\"args\":{\"frame\":101}") != std::string::npos);
+        TEST_CHECK(json.find("\"args\":{\"frame\":" + std::to_string(count - 1) + "}") != std::string::npos);
+
+        recorder.Clear();
+        TEST_CHECK(WriteJson().find("\"name\":\"Ring\"") == std::string::npos);
+    }
+
+    void DumpWhileRecording()
+    {
+        auto& recorder = TraceRecorder::Get();
+        recorder.SetEnabled(true);
+        recorder.Clear();
+
+        std::atomic<bool> done(false);
+        std::thread writer([&done]()
+        {
+            TraceRecorder::Get().SetThreadName("Writer");
+            for (uint64_t i = 0; i < 100000; ++i)
+            {
+                TraceScope scope("Write", i, TraceFlow::Step);
+            }
+            done.store(true);
+        });
+
+        // Each dump is a complete document, whatever the writer overwrites meanwhile.
+        do
+        {
+            const auto json = WriteJson();
+            TEST_CHECK(json.compare(json.size() - 4, 4, "\n]}\n") == 0);
+            TEST_CHECK(Count(json, "{\"ph\"") <= TraceRecorder::k_EventsPerThread + 1);
+        } while (!done.load());
+        writer.join();
+
+        TEST_CHECK(Count(WriteJson(), "\"name\":\"Write\"") > 0);
+        recorder.SetEnabled(false);
+    }
+}
+
+int main()
+{
+    TEST_RUN(DisabledRecordsNothing);
+    TEST_RUN(RegisteredNames);
+    TEST_RUN(ScopesAndFlows);
+    TEST_RUN(RingKeepsTheLatestEvents);
+    TEST_RUN(DumpWhileRecording);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "TestUtils.h"
+
+namespace LiveCaptureNative
+{
+    namespace Tests
+    {
+        // UDP socket bound to an ephemeral loopback port. Datagrams sent on the loopback are queued
+        // to the receiving socket before sendto() returns, so a test can send then read them back
+        // on the same thread without waiting.
+        class UdpLoopback final
+        {
+        public:
+            explicit UdpLoopback(int receiveBufferSize = 8 * 1024 * 1024)
+            {
+                m_Socket = socket(AF_INET, SOCK_DGRAM, 0);
+                TEST_CHECK(m_Socket >= 0);
+
+                setsockopt(m_Socket, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+
+                sockaddr_in address = MakeAddress(0);
+                TEST_CHECK(bind(m_Socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0);
+
+                socklen_t length = sizeof(address);
+                TEST_CHECK(getsockname(m_Socket, reinterpret_cast<sockaddr*>(&address), &length) == 0);
+                m_Port = ntohs(address.sin_port);
+            }
+
+            ~UdpLoopback()
+            {
+                close(m_Socket);
+            }
+
+            UdpLoopback(const UdpLoopback&) = delete;
+            UdpLoopback& operator=(const UdpLoopback&) = delete;
+
+            int GetHandle() const { return m_Socket; }
+            uint16_t GetPort() const { return m_Port; }
+
+            void SendTo(uint16_t port, const uint8_t* data, size_t size) const
+            {
+                const sockaddr_in address = MakeAddress(port);
+                TEST_CHECK(sendto(m_Socket, data, size, 0, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) ==
+                           static_cast<ssize_t>(size));
+            }
+
+            // Returns the size of the next queued datagram, or -1 when there is none. Doesn't wait.
+            int Receive(uint8_t* buffer, size_t capacity) const
+            {
+                const auto size = recv(m_Socket, buffer, capacity, MSG_DONTWAIT);
+                return (size < 0) ? -1 : static_cast<int>(size);
+            }
+
+            static sockaddr_in MakeAddress(uint16_t port)
+            {
+                sockaddr_in address = {};
+                address.sin_family = AF_INET;
+                address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+                address.sin_port = htons(port);
+                return address;
+            }
+
+        private:
+            int      m_Socket;
+            uint16_t m_Port;
+        };
+    }
+}
@@ -0,0 +1,113 @@
+using System;
+using System.Runtime.InteropServices;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// What a native encoder does with a frame when its input buffers or its output queue are full.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::BackpressurePolicy (Native~/Shared/EncoderBuffering.h), keep both in sync.
+    /// </remarks>
+    enum BackpressurePolicy
+    {
+        /// <summary>
+        /// The encoder waits for room, up to 100 milliseconds, then drops the new frame. Nothing is lost while
+        /// the frames are consumed as fast as they are encoded on average.
+        /// </summary>
+        Block = 0,
+
+        /// <summary>
+        /// The new frame is dropped, the queued frames are kept.
+        /// </summary>
+        DropNewest = 1,
+
+        /// <summary>
+        /// The oldest queued frames are discarded, so that the latest ones are always consumed. The decoded
+        /// stream shows artifacts until the next key frame.
+        /// </summary>
+        DropOldest = 2,
+
+        /// <summary>
+        /// The new frame is dropped, and so are the following ones until the key frame the encoder is asked for.
+        /// </summary>
+        DropToKeyFrame = 3,
+    }
+
+    /// <summary>
+    /// The number of frames a native encoder keeps in flight and in its output queue, and the policy applied when
+    /// they are exceeded.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::EncoderBufferingSettings (Native~/Shared/EncoderBuffering.h), keep both in sync.
+    /// Zero fields select the encoder defaults. The encoder clamps the values to what the device supports, the
+    /// values it runs with are reported in <see cref="NativeEncoderStats"/>.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct EncoderBufferingSettings : IEquatable<EncoderBufferingSettings>
+    {
+        /// <summary>
+        /// Buffering for a live preview: the latest frame is always sent, at the cost of artifacts when the network
+        /// can't keep up.
+        /// </summary>
+        public static EncoderBufferingSettings lowLatency => new EncoderBufferingSettings
+        {
+            inFlightDepth = 2,
+            outputQueueLength = 1,
+            policy = BackpressurePolicy.DropOldest,
+        };
+
+        /// <summary>
+        /// Buffering for a recording: deeper queues absorb the stalls and no frame is dropped while the average
+        /// throughput is sustained.
+        /// </summary>
+        public static EncoderBufferingSettings highThroughput => new EncoderBufferingSettings
+        {
+            inFlightDepth = 8,
+            outputQueueLength = 16,
+            policy = BackpressurePolicy.Block,
+        };
+
+        /// <summary>
+        /// The number of frames submitted to the encoder and not output yet. An input buffer is allocated for each.
+        /// </summary>
+        public int inFlightDepth;
+
+        /// <summary>
+        /// The number of encoded frames waiting to be consumed.
+        /// </summary>
+        public int outputQueueLength;
+
+        /// <summary>
+        /// What the encoder does when <see cref="inFlightDepth"/> or <see cref="outputQueueLength"/> is exceeded.
+        /// </summary>
+        public BackpressurePolicy policy;
+
+        public bool Equals(EncoderBufferingSettings other)
+        {
+            return
+                inFlightDepth == other.inFlightDepth &&
+                outputQueueLength == other.outputQueueLength &&
+                policy == other.policy;
+        }
+
+        public override bool Equals(object obj)
+        {
+            return obj is EncoderBufferingSettings other && Equals(other);
+        }
+
+        public override int GetHashCode()
+        {
+            unchecked
+            {
+                var hashCode = inFlightDepth;
+                hashCode = (hashCode * 397) ^ outputQueueLength;
+                hashCode = (hashCode * 397) ^ (int)policy;
+                return hashCode;
+            }
+        }
+
+        public static bool operator ==(EncoderBufferingSettings a, EncoderBufferingSettings b) => a.Equals(b);
+        public static bool operator !=(EncoderBufferingSettings a, EncoderBufferingSettings b) => !a.Equals(b);
+    }
+}
@@ -0,0 +1,274 @@
+using System;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// How a traced stage links to the other stages of the same frame.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::TraceFlow (Native~/Shared/TraceRecorder.h), keep both in sync.
+    /// </remarks>
+    enum TraceFlow
+    {
+        None = 0,
+        Start = 1,
+        Step = 2,
+        End = 3,
+    }
+
+    /// <summary>
+    /// The name of a traced stage, registered once with the native trace recorder of the active encoder.
+    /// </summary>
+    sealed class TraceMarker
+    {
+        internal readonly string name;
+        internal VideoEncoder registeredEncoder = VideoEncoder.NoEncoder;
+        internal int id = -1;
+
+        public TraceMarker(string name)
+        {
+            this.name = name;
+        }
+    }
+
+    /// <summary>
+    /// Records the managed stages of the video pipeline into the trace recorder of the native encoder plugin,
+    /// so that they share its clock and end up in the same Chrome trace (viewable in Perfetto) as the native
+    /// stages. The events of a frame are keyed by its capture timestamp in nanoseconds.
+    /// </summary>
+    static class EncoderTrace
+    {
+        /// <summary>
+        /// Ends a stage when disposed.
+        /// </summary>
+        public struct Scope : IDisposable
+        {
+            readonly VideoEncoder m_Encoder;
+            readonly int m_NameId;
+            readonly ulong m_FrameId;
+
+            internal Scope(VideoEncoder encoder, int nameId, ulong frameId)
+            {
+                m_Encoder = encoder;
+                m_NameId = nameId;
+                m_FrameId = frameId;
+            }
+
+            public void Dispose()
+            {
+                if (m_NameId >= 0)
+                {
+                    End(m_Encoder, m_NameId, m_FrameId);
+                }
+            }
+        }
+
+        static VideoEncoder s_Encoder = VideoEncoder.NoEncoder;
+        static bool s_Enabled;
+
+        /// <summary>
+        /// Whether the pipeline events are recorded.
+        /// </summary>
+        public static bool enabled
+        {
+            get => s_Enabled;
+            set
+            {
+                s_Enabled = value;
+                SetEnabled(s_Encoder, value);
+            }
+        }
+
+        /// <summary>
+        /// Sets the encoder plugin the events are recorded into.
+        /// </summary>
+        /// <param name="encoder">The active encoder.</param>
+        public static void SetEncoder(VideoEncoder encoder)
+        {
+            if (encoder == s_Encoder)
+                return;
+
+            SetEnabled(s_Encoder, false);
+            s_Encoder = encoder;
+            SetEnabled(s_Encoder, s_Enabled);
+        }
+
+        /// <summary>
+        /// Begins a stage of a frame.
+        /// </summary>
+        /// <param name="marker">The name of the stage.</param>
+        /// <param name="frameId">The capture timestamp of the frame in nanoseconds.</param>
+        /// <param name="flow">How the stage links to the other stages of the frame.</param>
+        /// <returns>A scope that ends the stage when disposed.</returns>
+        public static Scope Begin(TraceMarker marker, ulong frameId, TraceFlow flow = TraceFlow.None)
+        {
+            var encoder = s_Encoder;
+
+            if (!s_Enabled || encoder == VideoEncoder.NoEncoder)
+                return new Scope(encoder, -1, frameId);
+
+            if (marker.registeredEncoder != encoder)
+            {
+                marker.id = RegisterName(encoder, marker.name);
+                marker.registeredEncoder = encoder;
+            }
+
+            if (marker.id >= 0)
+            {
+                Begin(encoder, marker.id, frameId, flow);
+            }
+
+            return new Scope(encoder, marker.id, frameId);
+        }
+
+        /// <summary>
+        /// Names the calling thread in the trace.
+        /// </summary>
+        /// <param name="name">The name of the thread.</param>
+        public static void SetThreadName(string name)
+        {
+            switch (s_Encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    MediaFoundationH264EncoderPlugin.TraceSetThreadName(name);
+                    break;
+                case VideoEncoder.NvencH264:
+                    NvencH264EncoderPlugin.TraceSetThreadName(name);
+                    break;
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    MacOSH264EncoderPlugin.TraceSetThreadName(name);
+                    break;
+#endif
+            }
+        }
+
+        /// <summary>
+        /// Discards the recorded events.
+        /// </summary>
+        public static void Clear()
+        {
+            switch (s_Encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    MediaFoundationH264EncoderPlugin.TraceClear();
+                    break;
+                case VideoEncoder.NvencH264:
+                    NvencH264EncoderPlugin.TraceClear();
+                    break;
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    MacOSH264EncoderPlugin.TraceClear();
+                    break;
+#endif
+            }
+        }
+
+        /// <summary>
+        /// Writes the recorded events to a Chrome trace file, which Perfetto and chrome://tracing open.
+        /// </summary>
+        /// <param name="path">The path of the JSON file to write.</param>
+        /// <returns>True if the file was written; false otherwise.</returns>
+        public static bool Dump(string path)
+        {
+            switch (s_Encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    return MediaFoundationH264EncoderPlugin.TraceDump(path);
+                case VideoEncoder.NvencH264:
+                    return NvencH264EncoderPlugin.TraceDump(path);
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    return MacOSH264EncoderPlugin.TraceDump(path);
+#endif
+                default:
+                    return false;
+            }
+        }
+
+        static void SetEnabled(VideoEncoder encoder, bool value)
+        {
+            switch (encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    MediaFoundationH264EncoderPlugin.TraceSetEnabled(value);
+                    break;
+                case VideoEncoder.NvencH264:
+                    NvencH264EncoderPlugin.TraceSetEnabled(value);
+                    break;
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    MacOSH264EncoderPlugin.TraceSetEnabled(value);
+                    break;
+#endif
+            }
+        }
+
+        static int RegisterName(VideoEncoder encoder, string name)
+        {
+            switch (encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    return MediaFoundationH264EncoderPlugin.TraceRegisterName(name);
+                case VideoEncoder.NvencH264:
+                    return NvencH264EncoderPlugin.TraceRegisterName(name);
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    return MacOSH264EncoderPlugin.TraceRegisterName(name);
+#endif
+                default:
+                    return -1;
+            }
+        }
+
+        static void Begin(VideoEncoder encoder, int nameId, ulong frameId, TraceFlow flow)
+        {
+            switch (encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    MediaFoundationH264EncoderPlugin.TraceBegin(nameId, frameId, (int)flow);
+                    break;
+                case VideoEncoder.NvencH264:
+                    NvencH264EncoderPlugin.TraceBegin(nameId, frameId, (int)flow);
+                    break;
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    MacOSH264EncoderPlugin.TraceBegin(nameId, frameId, (int)flow);
+                    break;
+#endif
+            }
+        }
+
+        static void End(VideoEncoder encoder, int nameId, ulong frameId)
+        {
+            switch (encoder)
+            {
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+                case VideoEncoder.MediaFoundationH264:
+                    MediaFoundationH264EncoderPlugin.TraceEnd(nameId, frameId);
+                    break;
+                case VideoEncoder.NvencH264:
+                    NvencH264EncoderPlugin.TraceEnd(nameId, frameId);
+                    break;
+#endif
+#if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
+                case VideoEncoder.VideoToolboxH264:
+                    MacOSH264EncoderPlugin.TraceEnd(nameId, frameId);
+                    break;
+#endif
+            }
+        }
+    }
+}
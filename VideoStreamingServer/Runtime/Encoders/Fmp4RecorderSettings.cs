@@ -0,0 +1,123 @@
+using System.Runtime.InteropServices;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// The state of the recording of a native encoder.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::Fmp4RecorderStatus (Native~/Shared/Fmp4Recorder.h), keep both in sync.
+    /// </remarks>
+    enum Fmp4RecorderStatus
+    {
+        /// <summary>
+        /// No recording was started, or the last one was stopped and its file is complete.
+        /// </summary>
+        Stopped = 0,
+
+        /// <summary>
+        /// The encoded frames are being written to the file.
+        /// </summary>
+        Recording = 1,
+
+        /// <summary>
+        /// The recording stopped on an error, see <see cref="Fmp4RecorderError"/>. The fragments written before it
+        /// can still be played.
+        /// </summary>
+        Failed = 2,
+    }
+
+    /// <summary>
+    /// Why the recording of a native encoder failed.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::Fmp4RecorderError (Native~/Shared/Fmp4Recorder.h), keep both in sync.
+    /// </remarks>
+    enum Fmp4RecorderError
+    {
+        None = 0,
+
+        /// <summary>
+        /// The file couldn't be created.
+        /// </summary>
+        OpenFailed = 1,
+
+        /// <summary>
+        /// The disk is full or the file was removed.
+        /// </summary>
+        WriteFailed = 2,
+
+        /// <summary>
+        /// The resolution or the profile of the stream changed, a new recording must be started.
+        /// </summary>
+        ParameterSetsChanged = 3,
+    }
+
+    /// <summary>
+    /// Options of the fragmented MP4 recording of a native encoder.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::Fmp4RecorderSettings (Native~/Shared/Fmp4Recorder.h), keep both in sync.
+    /// Zero fields select the defaults.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct Fmp4RecorderSettings
+    {
+        /// <summary>
+        /// The minimum duration of a fragment, 1000 by default. A fragment ends at the first key frame past it, and
+        /// is the most that is lost if the application crashes.
+        /// </summary>
+        public int minFragmentDurationMs;
+
+        /// <summary>
+        /// The encoded bytes a fragment can hold, 8 MB by default. Four buffers of this size are allocated when the
+        /// recording starts; a fragment ends early when its buffer is full.
+        /// </summary>
+        public int maxFragmentBytes;
+    }
+
+    /// <summary>
+    /// Statistics of the recording of a native encoder, returned by the GetRecordingStats export of the plugins.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::Fmp4RecorderStats (Native~/Shared/Fmp4Recorder.h), keep both in sync.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct Fmp4RecorderStats
+    {
+        /// <summary>
+        /// The state of the recording.
+        /// </summary>
+        public Fmp4RecorderStatus status;
+
+        /// <summary>
+        /// Why the recording failed, when <see cref="status"/> is <see cref="Fmp4RecorderStatus.Failed"/>.
+        /// </summary>
+        public Fmp4RecorderError error;
+
+        /// <summary>
+        /// The number of frames added to the file.
+        /// </summary>
+        public ulong framesRecorded;
+
+        /// <summary>
+        /// The number of frames lost because the disk couldn't keep up, or larger than a fragment.
+        /// </summary>
+        public ulong droppedFrames;
+
+        /// <summary>
+        /// The number of fragments written to the file.
+        /// </summary>
+        public ulong fragmentsWritten;
+
+        /// <summary>
+        /// The size of the file.
+        /// </summary>
+        public ulong bytesWritten;
+
+        /// <summary>
+        /// The recorded duration, in nanoseconds.
+        /// </summary>
+        public ulong duration;
+    }
+}
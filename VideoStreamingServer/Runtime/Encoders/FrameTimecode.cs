@@ -0,0 +1,66 @@
+using System.Runtime.InteropServices;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// The SMPTE timecode of a captured frame, written by the native encoders to the SEI of the encoded frame
+    /// along with its sequence number and timestamp.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::FrameTimecode (Native~/Shared/FrameTimecode.h), keep both in sync.
+    /// The default value has no frame rate and means the frame has no timecode.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct FrameTimecode
+    {
+        /// <summary>
+        /// The hour digit of the timecode.
+        /// </summary>
+        public int hours;
+
+        /// <summary>
+        /// The minute digit of the timecode.
+        /// </summary>
+        public int minutes;
+
+        /// <summary>
+        /// The second digit of the timecode.
+        /// </summary>
+        public int seconds;
+
+        /// <summary>
+        /// The frame digit of the timecode.
+        /// </summary>
+        public int frames;
+
+        /// <summary>
+        /// The time within the frame, in units of <see cref="subframeResolution"/>.
+        /// </summary>
+        public int subframe;
+
+        /// <summary>
+        /// The number of subframes per frame.
+        /// </summary>
+        public int subframeResolution;
+
+        /// <summary>
+        /// The numerator of the timecode frame rate, zero when the frame has no timecode.
+        /// </summary>
+        public int rateNumerator;
+
+        /// <summary>
+        /// The denominator of the timecode frame rate.
+        /// </summary>
+        public int rateDenominator;
+
+        /// <summary>
+        /// One when the timecode uses drop frame numbering.
+        /// </summary>
+        public int isDropFrame;
+
+        /// <summary>
+        /// Is there a timecode for the frame.
+        /// </summary>
+        public bool isValid => rateNumerator > 0 && rateDenominator > 0;
+    }
+}
@@ -111,8 +111,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         /// <param name="imageData">The image data in bytes. It includes a width and a height that match the ones you configured through <see cref="IEncoder.Setup"/>.</param>
         /// <param name="timeStamp">The time in nanoseconds the image was sampled at since the start of the video stream.</param>
+        /// <param name="timecode">The timecode of the image, written to the SEI of the encoded frame.</param>
         /// <param name="frame">The encoded image frame.</param>
-        void Encode(in NativeArray<byte> imageData, ulong timeStamp, H264EncodedFrame frame);
+        void Encode(in NativeArray<byte> imageData, ulong timeStamp, in FrameTimecode timecode, H264EncodedFrame frame);
     }
 
     /// <summary>
@@ -125,7 +126,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         /// <param name="renderTexture">The texture to encode.</param>
         /// <param name="timestamp">The time in nanoseconds the image was sampled at since the start of the video stream.</param>
-        void Encode(RenderTexture renderTexture, ulong timestamp);
+        /// <param name="timecode">The timecode of the image, written to the SEI of the encoded frame.</param>
+        void Encode(RenderTexture renderTexture, ulong timestamp, in FrameTimecode timecode);
 
         /// <summary>
         /// Retrieves the data of the first encoded frame found in the plugin.
@@ -1,6 +1,7 @@
 #if UNITY_EDITOR_OSX || UNITY_STANDALONE_OSX
 using System;
 using System.Runtime.InteropServices;
+using System.Text;
 using UnityEngine;
 using UnityEngine.Rendering;
 
@@ -39,6 +40,75 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         [DllImport(MacOSLib)]
         extern public unsafe static bool GetIsKeyFrame(IntPtr encoder);
+
+        [DllImport(MacOSLib)]
+        extern public static ulong GetSequenceNumber(IntPtr encoder);
+
+        [DllImport(MacOSLib)]
+        extern public static ulong GetEncodeLatency(IntPtr encoder);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetEncoderStats(IntPtr encoder, out NativeEncoderStats stats);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool StartRecording(IntPtr encoder, byte[] utf8Path, ref Fmp4RecorderSettings settings);
+
+        [DllImport(MacOSLib)]
+        extern public static void StopRecording(IntPtr encoder);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetRecordingStats(IntPtr encoder, out Fmp4RecorderStats stats);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool ConfigureReplayBuffer(IntPtr encoder, ref ReplayBufferSettings settings);
+
+        [DllImport(MacOSLib, EntryPoint = "ConfigureReplayBuffer")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool DisableReplayBuffer(IntPtr encoder, IntPtr settings);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool SaveReplay(IntPtr encoder, byte[] utf8Path, ulong durationNs);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetReplayBufferStats(IntPtr encoder, out ReplayBufferStats stats);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetReplayExportStats(IntPtr encoder, out Fmp4RecorderStats stats);
+
+        [DllImport(MacOSLib)]
+        extern public static void TraceSetEnabled([MarshalAs(UnmanagedType.U1)] bool enabled);
+
+        [DllImport(MacOSLib)]
+        extern public static void TraceClear();
+
+        [DllImport(MacOSLib)]
+        extern public static int TraceRegisterName(string name);
+
+        [DllImport(MacOSLib)]
+        extern public static void TraceSetThreadName(string name);
+
+        [DllImport(MacOSLib)]
+        extern public static void TraceBegin(int nameId, ulong frameId, int flow);
+
+        [DllImport(MacOSLib)]
+        extern public static void TraceEnd(int nameId, ulong frameId);
+
+        [DllImport(MacOSLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool TraceDump(string path);
+
+        [DllImport(MacOSLib)]
+        extern public static int GetInputTextureCount(IntPtr encoder);
+
+        [DllImport(MacOSLib)]
+        extern public static IntPtr GetInputTexture(IntPtr encoder, int index);
     }
 
     /// <summary>
@@ -100,6 +170,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Should the encoder expect SRGB textures.
             /// </summary>
             public bool useSRGB;
+
+            /// <summary>
+            /// The buffering of the encoder session.
+            /// </summary>
+            public EncoderBufferingSettings buffering;
         }
 
         /// <summary>
@@ -123,6 +198,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// The frame time stamp.
             /// </summary>
             public ulong timestamp;
+
+            /// <summary>
+            /// The frame timecode, written to the SEI of the encoded frame.
+            /// </summary>
+            public FrameTimecode timecode;
         }
 
         EncoderSettingsID m_SettingsID;
@@ -130,10 +210,31 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         EncoderStatus     m_EncoderStatus;
         int               m_FinalizeID;
         CommandBuffer     m_CommandBuffer;
+        Texture2D[]       m_InputTextures;
 
         /// <inheritdoc/>
         public EncoderFormat encoderFormat => EncoderFormat.R8G8B8;
 
+        /// <summary>
+        /// The submission order of the last frame returned by <see cref="ConsumeData"/>.
+        /// </summary>
+        internal ulong lastSequenceNumber { get; private set; }
+
+        /// <summary>
+        /// The time between the submission and the output of the last frame returned by <see cref="ConsumeData"/>, in nanoseconds.
+        /// </summary>
+        internal ulong lastEncodeLatency { get; private set; }
+
+        /// <summary>
+        /// The frames kept in flight and queued by the encoder, and what it drops when they are exceeded,
+        /// applied on the next <see cref="Setup"/>.
+        /// </summary>
+        /// <remarks>
+        /// Use <see cref="EncoderBufferingSettings.lowLatency"/> for a preview and <see cref="EncoderBufferingSettings.highThroughput"/>
+        /// for a recording. The default selects the encoder defaults.
+        /// </remarks>
+        internal EncoderBufferingSettings buffering { get; set; }
+
         /// <inheritdoc/>
         unsafe public EncoderStatus initialized
         {
@@ -172,6 +273,39 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
 
             DisposeCommandBuffer();
+            DisposeInputTextures();
+        }
+
+        /// <summary>
+        /// Gets the textures sharing their memory with the encoder input buffers.
+        /// </summary>
+        /// <remarks>
+        /// Rendering into one of these textures and passing it to <see cref="EncodeInputTexture"/> avoids
+        /// copying the frame. Use them in turn: a texture is only free again once the following ones were submitted.
+        /// Returns null until the encoder is initialized.
+        /// </remarks>
+        unsafe internal Texture2D[] GetInputTextures()
+        {
+            if (initialized != EncoderStatus.Initialized)
+                return null;
+
+            if (m_InputTextures == null)
+            {
+                fixed(int* encoderPtr = &m_SettingsID.encoderId)
+                {
+                    var count = MacOSH264EncoderPlugin.GetInputTextureCount((IntPtr)encoderPtr);
+                    var linear = !m_SettingsID.useSRGB;
+
+                    m_InputTextures = new Texture2D[count];
+                    for (var i = 0; i < count; ++i)
+                    {
+                        var texturePtr = MacOSH264EncoderPlugin.GetInputTexture((IntPtr)encoderPtr, i);
+                        m_InputTextures[i] = Texture2D.CreateExternalTexture(m_SettingsID.settings.width,
+                            m_SettingsID.settings.height, TextureFormat.BGRA32, false, linear, texturePtr);
+                    }
+                }
+            }
+            return m_InputTextures;
         }
 
         /// <summary>
@@ -184,6 +318,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             m_SettingsID.encoderId = m_Counter++;
             m_SettingsID.encoderFormat = encoderFormat;
             m_SettingsID.useSRGB = QualitySettings.activeColorSpace != ColorSpace.Gamma;
+            m_SettingsID.buffering = buffering;
 
             if (m_CommandBuffer != null)
                 DisposeCommandBuffer();
@@ -214,7 +349,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         }
 
         /// <inheritdoc/>
-        unsafe public void Encode(RenderTexture renderTexture, ulong timestamp)
+        unsafe public void Encode(RenderTexture renderTexture, ulong timestamp, in FrameTimecode timecode)
         {
             if (m_EncoderStatus == EncoderStatus.Failed)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
@@ -224,6 +359,33 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 m_TextureID.encoderId = m_SettingsID.encoderId;
                 m_TextureID.renderTexture = renderTexture.GetNativeTexturePtr();
                 m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
+
+                ExecuteMacOSCommand(EMacOSRenderEvent.Encode, "Mac OS Encoder Encode", (IntPtr)encoderPtr);
+            }
+        }
+
+        /// <summary>
+        /// Queues a command on the render thread to encode a frame rendered into one of the <see cref="GetInputTextures"/> textures.
+        /// </summary>
+        /// <param name="index">The index of the input texture.</param>
+        /// <param name="timestamp">The frame time stamp.</param>
+        /// <param name="timecode">The frame timecode, written to the SEI of the encoded frame.</param>
+        unsafe internal void EncodeInputTexture(int index, ulong timestamp, in FrameTimecode timecode)
+        {
+            if (m_EncoderStatus == EncoderStatus.Failed)
+                throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
+
+            var inputTextures = GetInputTextures();
+            if (inputTextures == null || index < 0 || index >= inputTextures.Length)
+                throw new ArgumentOutOfRangeException(nameof(index));
+
+            fixed(EncoderTextureID* encoderPtr = &m_TextureID)
+            {
+                m_TextureID.encoderId = m_SettingsID.encoderId;
+                m_TextureID.renderTexture = inputTextures[index].GetNativeTexturePtr();
+                m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
 
                 ExecuteMacOSCommand(EMacOSRenderEvent.Encode, "Mac OS Encoder Encode", (IntPtr)encoderPtr);
             }
@@ -254,6 +416,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                     // Retrieve the timestamp.
                     timestamp = MacOSH264EncoderPlugin.GetTimeStamp((IntPtr)encoderPtr);
+                    lastSequenceNumber = MacOSH264EncoderPlugin.GetSequenceNumber((IntPtr)encoderPtr);
+                    lastEncodeLatency = MacOSH264EncoderPlugin.GetEncodeLatency((IntPtr)encoderPtr);
 
                     if (isKeyFrame)
                     {
@@ -284,6 +448,145 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        /// <summary>
+        /// Gets the counters and latency histograms of the native encoder, to monitor its backpressure.
+        /// </summary>
+        /// <param name="stats">The statistics since the encoder was set up.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetStats(out NativeEncoderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.GetEncoderStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Starts recording the encoded frames to a fragmented MP4 file, replacing the current recording if any.
+        /// </summary>
+        /// <remarks>
+        /// The frames are written by a native thread, in fragments starting at a key frame, and the file can be played
+        /// back up to the last fragment even if the application stops unexpectedly. The frames dropped from the output
+        /// queue are recorded too. The recording ends on <see cref="StopRecording"/>, or when the encoder is disposed.
+        /// </remarks>
+        /// <param name="path">The path of the file to create.</param>
+        /// <param name="settings">The fragmentation options.</param>
+        /// <returns>True if the file was created; false otherwise.</returns>
+        internal unsafe bool StartRecording(string path, Fmp4RecorderSettings settings)
+        {
+            if (string.IsNullOrEmpty(path))
+                return false;
+
+            var utf8Path = Encoding.UTF8.GetBytes(path + '\0');
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.StartRecording((IntPtr)encoderPtr, utf8Path, ref settings);
+            }
+        }
+
+        /// <summary>
+        /// Writes the last fragment of the recording and closes its file.
+        /// </summary>
+        internal unsafe void StopRecording()
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                MacOSH264EncoderPlugin.StopRecording((IntPtr)encoderPtr);
+            }
+        }
+
+        /// <summary>
+        /// Gets the statistics of the current recording, or of the last one once stopped.
+        /// </summary>
+        /// <param name="stats">The recording statistics.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetRecordingStats(out Fmp4RecorderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.GetRecordingStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Starts keeping the last encoded frames in memory, so that they can be saved with <see cref="SaveReplay"/>.
+        /// </summary>
+        /// <remarks>
+        /// The frames kept are discarded when the settings change or the encoder is disposed.
+        /// </remarks>
+        /// <param name="settings">The size of the replay buffer.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool EnableReplayBuffer(ReplayBufferSettings settings)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.ConfigureReplayBuffer((IntPtr)encoderPtr, ref settings);
+            }
+        }
+
+        /// <summary>
+        /// Releases the replay buffer and the frames it holds.
+        /// </summary>
+        internal unsafe void DisableReplayBuffer()
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                MacOSH264EncoderPlugin.DisableReplayBuffer((IntPtr)encoderPtr, IntPtr.Zero);
+            }
+        }
+
+        /// <summary>
+        /// Saves the end of the replay buffer to a fragmented MP4 file, in the background.
+        /// </summary>
+        /// <remarks>
+        /// The replay starts at a key frame, so it can be slightly longer than requested. Use
+        /// <see cref="TryGetReplayExportStats"/> to know when the file is complete.
+        /// </remarks>
+        /// <param name="path">The path of the file to create.</param>
+        /// <param name="duration">The duration to save, or zero for the whole buffer.</param>
+        /// <returns>True if the export started; false if the buffer is disabled or empty, or if a replay is already
+        /// being saved.</returns>
+        internal unsafe bool SaveReplay(string path, TimeSpan duration)
+        {
+            if (string.IsNullOrEmpty(path))
+                return false;
+
+            var utf8Path = Encoding.UTF8.GetBytes(path + '\0');
+            var durationNs = (ulong)Math.Max(0L, duration.Ticks) * 100UL;
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.SaveReplay((IntPtr)encoderPtr, utf8Path, durationNs);
+            }
+        }
+
+        /// <summary>
+        /// Gets the content of the replay buffer.
+        /// </summary>
+        /// <param name="stats">The replay buffer statistics.</param>
+        /// <returns>True if the replay buffer is enabled; false otherwise.</returns>
+        internal unsafe bool TryGetReplayBufferStats(out ReplayBufferStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.GetReplayBufferStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Gets the progress of the replay being saved, or the result of the last one.
+        /// </summary>
+        /// <param name="stats">The export statistics, <see cref="Fmp4RecorderStatus.Recording"/> while in progress.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetReplayExportStats(out Fmp4RecorderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return MacOSH264EncoderPlugin.GetReplayExportStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
         /// <summary>
         /// Queues a Mac OS command on the render thread.
         /// </summary>
@@ -312,6 +615,18 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 m_CommandBuffer = null;
             }
         }
+
+        void DisposeInputTextures()
+        {
+            if (m_InputTextures == null)
+                return;
+
+            foreach (var texture in m_InputTextures)
+            {
+                UnityEngine.Object.Destroy(texture);
+            }
+            m_InputTextures = null;
+        }
     }
 }
 #endif
@@ -19,7 +19,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         [DllImport("H264Encoder", EntryPoint = "Encode")]
         [return : MarshalAs(UnmanagedType.U1)]
-        extern public unsafe static bool EncodeFrame(IntPtr encoder, byte* pixelData, ulong timeStampNs);
+        extern public unsafe static bool EncodeFrame(IntPtr encoder, byte* pixelData, ulong timeStampNs, in FrameTimecode timecode);
 
         [DllImport("H264Encoder", EntryPoint = "BeginConsume")]
         [return : MarshalAs(UnmanagedType.U1)]
@@ -38,6 +38,36 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         [DllImport("H264Encoder", EntryPoint = "GetPps")]
         extern public unsafe static uint GetPpsNAL(IntPtr encoder, byte* ppsData);
+
+        [DllImport("H264Encoder", EntryPoint = "GetFrameTiming")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetFrameTiming(IntPtr encoder, out ulong sequence, out ulong encodeLatencyNs);
+
+        [DllImport("H264Encoder", EntryPoint = "GetEncoderStats")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetEncoderStats(IntPtr encoder, out NativeEncoderStats stats);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceSetEnabled")]
+        extern public static void TraceSetEnabled([MarshalAs(UnmanagedType.U1)] bool enabled);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceClear")]
+        extern public static void TraceClear();
+
+        [DllImport("H264Encoder", EntryPoint = "TraceRegisterName")]
+        extern public static int TraceRegisterName(string name);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceSetThreadName")]
+        extern public static void TraceSetThreadName(string name);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceBegin")]
+        extern public static void TraceBegin(int nameId, ulong frameId, int flow);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceEnd")]
+        extern public static void TraceEnd(int nameId, ulong frameId);
+
+        [DllImport("H264Encoder", EntryPoint = "TraceDump")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool TraceDump(string path);
     }
 
     /// <summary>
@@ -54,6 +84,16 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public EncoderFormat encoderFormat => EncoderFormat.NV12;
 
+        /// <summary>
+        /// The submission order of the last encoded frame.
+        /// </summary>
+        internal ulong lastSequenceNumber { get; private set; }
+
+        /// <summary>
+        /// The time between the submission and the output of the last encoded frame, in nanoseconds.
+        /// </summary>
+        internal ulong lastEncodeLatency { get; private set; }
+
         ~MediaFoundationH264Encoder()
         {
             Dispose();
@@ -98,7 +138,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         }
 
         /// <inheritdoc/>
-        public void Encode(in NativeArray<byte> imageData, ulong timeStamp, H264EncodedFrame frame)
+        public void Encode(in NativeArray<byte> imageData, ulong timeStamp, in FrameTimecode timecode, H264EncodedFrame frame)
         {
             if (m_Encoder == IntPtr.Zero)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
@@ -108,16 +148,32 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             if (imageData.Length != expectedSize)
                 throw new ArgumentException($"NV12 image buffer is {imageData.Length} bytes long, but the encoder expects {expectedSize} bytes.", nameof(imageData));
 
-            var success = EncodeFrame(imageData, timeStamp, frame);
+            var success = EncodeFrame(imageData, timeStamp, timecode, frame);
 
             if (!success)
                 Debug.LogError($"Error encoding frame at t = {timeStamp / 1000000} ms");
         }
 
-        unsafe bool EncodeFrame(in NativeArray<byte> imageData, ulong timeStamp, H264EncodedFrame frame)
+        /// <summary>
+        /// Gets the counters and latency histograms of the native encoder, to monitor its backpressure.
+        /// </summary>
+        /// <param name="stats">The statistics since the encoder was set up.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal bool TryGetStats(out NativeEncoderStats stats)
+        {
+            if (m_Encoder == IntPtr.Zero)
+            {
+                stats = default;
+                return false;
+            }
+
+            return MediaFoundationH264EncoderPlugin.GetEncoderStats(m_Encoder, out stats);
+        }
+
+        unsafe bool EncodeFrame(in NativeArray<byte> imageData, ulong timeStamp, in FrameTimecode timecode, H264EncodedFrame frame)
         {
             Profiler.BeginSample("EncodeFrame");
-            var success = MediaFoundationH264EncoderPlugin.EncodeFrame(m_Encoder, (byte*)imageData.GetUnsafeReadOnlyPtr(), timeStamp);
+            var success = MediaFoundationH264EncoderPlugin.EncodeFrame(m_Encoder, (byte*)imageData.GetUnsafeReadOnlyPtr(), timeStamp, timecode);
             Profiler.EndSample();
 
             if (!success)
@@ -143,6 +199,12 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             if (!success)
                 return false;
 
+            if (MediaFoundationH264EncoderPlugin.GetFrameTiming(m_Encoder, out var sequence, out var encodeLatency))
+            {
+                lastSequenceNumber = sequence;
+                lastEncodeLatency = encodeLatency;
+            }
+
             if (isKeyFrame)
             {
                 var sz = MediaFoundationH264EncoderPlugin.GetSpsNAL(m_Encoder, (byte*)0);
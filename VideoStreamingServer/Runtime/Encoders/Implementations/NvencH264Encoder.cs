@@ -1,6 +1,7 @@
 #if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
 using System;
 using System.Runtime.InteropServices;
+using System.Text;
 using UnityEngine;
 using UnityEngine.Rendering;
 
@@ -45,6 +46,87 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         [DllImport(k_NvEncLib)]
         extern public unsafe static bool GetIsKeyFrame(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static ulong GetSequenceNumber(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static ulong GetEncodeLatency(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetEncoderStats(IntPtr id, out NativeEncoderStats stats);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool StartRecording(IntPtr id, byte[] utf8Path, ref Fmp4RecorderSettings settings);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void StopRecording(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetRecordingStats(IntPtr id, out Fmp4RecorderStats stats);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool ConfigureReplayBuffer(IntPtr id, ref ReplayBufferSettings settings);
+
+        [DllImport(k_NvEncLib, EntryPoint = "ConfigureReplayBuffer")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool DisableReplayBuffer(IntPtr id, IntPtr settings);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool SaveReplay(IntPtr id, byte[] utf8Path, ulong durationNs);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetReplayBufferStats(IntPtr id, out ReplayBufferStats stats);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetReplayExportStats(IntPtr id, out Fmp4RecorderStats stats);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void TraceSetEnabled([MarshalAs(UnmanagedType.U1)] bool enabled);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void TraceClear();
+
+        [DllImport(k_NvEncLib)]
+        extern public static int TraceRegisterName(string name);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void TraceSetThreadName(string name);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void TraceBegin(int nameId, ulong frameId, int flow);
+
+        [DllImport(k_NvEncLib)]
+        extern public static void TraceEnd(int nameId, ulong frameId);
+
+        [DllImport(k_NvEncLib)]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool TraceDump(string path);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool BeginConsumeSlice(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool EndConsumeSlice(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public unsafe static uint GetSliceData(IntPtr id, byte* sliceData);
+
+        [DllImport(k_NvEncLib)]
+        extern public static ulong GetSliceTimeStamp(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static uint GetSliceIndex(IntPtr id);
+
+        [DllImport(k_NvEncLib)]
+        extern public static bool GetSliceIsLast(IntPtr id);
     }
 
     /// <summary>
@@ -76,6 +158,16 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Liberates resources and destroys the encoder session.
             /// </summary>
             Finalize,
+
+            /// <summary>
+            /// Encodes a frame into every scheduled layer of a simulcast group.
+            /// </summary>
+            EncodeSimulcast,
+
+            /// <summary>
+            /// Creates, updates or destroys a simulcast group.
+            /// </summary>
+            ConfigureSimulcast,
         };
 
         /// <summary>
@@ -99,6 +191,16 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// Gets the encoder supported format.
             /// </summary>
             public EncoderFormat encoderFormat;
+
+            /// <summary>
+            /// The number of slices per frame. Sub-frame output is enabled when greater than 1.
+            /// </summary>
+            public int sliceCount;
+
+            /// <summary>
+            /// The buffering of the encoder session.
+            /// </summary>
+            public EncoderBufferingSettings buffering;
         }
 
         /// <summary>
@@ -122,6 +224,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// The frame time stamp.
             /// </summary>
             public ulong timestamp;
+
+            /// <summary>
+            /// The frame timecode, written to the SEI of the encoded frame.
+            /// </summary>
+            public FrameTimecode timecode;
         }
 
         EncoderSettingsID m_SettingsID;
@@ -133,6 +240,40 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public EncoderFormat encoderFormat => EncoderFormat.R8G8B8;
 
+        /// <summary>
+        /// The id identifying the encoder instance in the plugin.
+        /// </summary>
+        internal int encoderId => m_SettingsID.encoderId;
+
+        /// <summary>
+        /// The submission order of the last frame returned by <see cref="ConsumeData"/>.
+        /// </summary>
+        internal ulong lastSequenceNumber { get; private set; }
+
+        /// <summary>
+        /// The time between the submission and the output of the last frame returned by <see cref="ConsumeData"/>, in nanoseconds.
+        /// </summary>
+        internal ulong lastEncodeLatency { get; private set; }
+
+        /// <summary>
+        /// The number of slices each frame is split into, applied on the next <see cref="Setup"/>.
+        /// </summary>
+        /// <remarks>
+        /// When greater than 1, the slices can be consumed with <see cref="ConsumeSlice"/> while the rest
+        /// of the frame is still being encoded, so that the transmission can start earlier.
+        /// </remarks>
+        internal int sliceCount { get; set; }
+
+        /// <summary>
+        /// The frames kept in flight and queued by the encoder, and what it drops when they are exceeded,
+        /// applied on the next <see cref="Setup"/>.
+        /// </summary>
+        /// <remarks>
+        /// Use <see cref="EncoderBufferingSettings.lowLatency"/> for a preview and <see cref="EncoderBufferingSettings.highThroughput"/>
+        /// for a recording. The default selects the encoder defaults.
+        /// </remarks>
+        internal EncoderBufferingSettings buffering { get; set; }
+
         /// <inheritdoc/>
         public unsafe EncoderStatus initialized
         {
@@ -177,6 +318,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             m_SettingsID.settings = settings;
             m_SettingsID.encoderId = ++m_Counter;
             m_SettingsID.encoderFormat = encoderFormat;
+            m_SettingsID.sliceCount = sliceCount;
+            m_SettingsID.buffering = buffering;
 
             DisposeCommandBuffer();
             m_CommandBuffer = new CommandBuffer();
@@ -206,7 +349,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         }
 
         /// <inheritdoc/>
-        public unsafe void Encode(RenderTexture renderTexture, ulong timestamp)
+        public unsafe void Encode(RenderTexture renderTexture, ulong timestamp, in FrameTimecode timecode)
         {
             if (m_EncoderStatus == EncoderStatus.Failed)
                 throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
@@ -216,6 +359,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 m_TextureID.encoderId = m_SettingsID.encoderId;
                 m_TextureID.renderTexture = renderTexture.GetNativeTexturePtr();
                 m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
 
                 ExecuteNvencCommand(ENvencRenderEvent.Encode, "NVENC Encode", (IntPtr)encoderPtr);
             }
@@ -246,6 +390,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                     // Retrieve the timestamp.
                     timestamp = NvencH264EncoderPlugin.GetTimeStamp((IntPtr)encoderPtr);
+                    lastSequenceNumber = NvencH264EncoderPlugin.GetSequenceNumber((IntPtr)encoderPtr);
+                    lastEncodeLatency = NvencH264EncoderPlugin.GetEncodeLatency((IntPtr)encoderPtr);
 
                     if (isKeyFrame)
                     {
@@ -275,6 +421,190 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        /// <summary>
+        /// Gets the counters and latency histograms of the native encoder, to monitor its backpressure.
+        /// </summary>
+        /// <param name="stats">The statistics since the encoder was set up.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetStats(out NativeEncoderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.GetEncoderStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Starts recording the encoded frames to a fragmented MP4 file, replacing the current recording if any.
+        /// </summary>
+        /// <remarks>
+        /// The frames are written by a native thread, in fragments starting at a key frame, and the file can be played
+        /// back up to the last fragment even if the application stops unexpectedly. The frames dropped from the output
+        /// queue are recorded too. The recording ends on <see cref="StopRecording"/>, or when the encoder is disposed.
+        /// </remarks>
+        /// <param name="path">The path of the file to create.</param>
+        /// <param name="settings">The fragmentation options.</param>
+        /// <returns>True if the file was created; false otherwise.</returns>
+        internal unsafe bool StartRecording(string path, Fmp4RecorderSettings settings)
+        {
+            if (string.IsNullOrEmpty(path))
+                return false;
+
+            var utf8Path = Encoding.UTF8.GetBytes(path + '\0');
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.StartRecording((IntPtr)encoderPtr, utf8Path, ref settings);
+            }
+        }
+
+        /// <summary>
+        /// Writes the last fragment of the recording and closes its file.
+        /// </summary>
+        internal unsafe void StopRecording()
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                NvencH264EncoderPlugin.StopRecording((IntPtr)encoderPtr);
+            }
+        }
+
+        /// <summary>
+        /// Gets the statistics of the current recording, or of the last one once stopped.
+        /// </summary>
+        /// <param name="stats">The recording statistics.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetRecordingStats(out Fmp4RecorderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.GetRecordingStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Starts keeping the last encoded frames in memory, so that they can be saved with <see cref="SaveReplay"/>.
+        /// </summary>
+        /// <remarks>
+        /// The frames kept are discarded when the settings change or the encoder is disposed.
+        /// </remarks>
+        /// <param name="settings">The size of the replay buffer.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool EnableReplayBuffer(ReplayBufferSettings settings)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.ConfigureReplayBuffer((IntPtr)encoderPtr, ref settings);
+            }
+        }
+
+        /// <summary>
+        /// Releases the replay buffer and the frames it holds.
+        /// </summary>
+        internal unsafe void DisableReplayBuffer()
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                NvencH264EncoderPlugin.DisableReplayBuffer((IntPtr)encoderPtr, IntPtr.Zero);
+            }
+        }
+
+        /// <summary>
+        /// Saves the end of the replay buffer to a fragmented MP4 file, in the background.
+        /// </summary>
+        /// <remarks>
+        /// The replay starts at a key frame, so it can be slightly longer than requested. Use
+        /// <see cref="TryGetReplayExportStats"/> to know when the file is complete.
+        /// </remarks>
+        /// <param name="path">The path of the file to create.</param>
+        /// <param name="duration">The duration to save, or zero for the whole buffer.</param>
+        /// <returns>True if the export started; false if the buffer is disabled or empty, or if a replay is already
+        /// being saved.</returns>
+        internal unsafe bool SaveReplay(string path, TimeSpan duration)
+        {
+            if (string.IsNullOrEmpty(path))
+                return false;
+
+            var utf8Path = Encoding.UTF8.GetBytes(path + '\0');
+            var durationNs = (ulong)Math.Max(0L, duration.Ticks) * 100UL;
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.SaveReplay((IntPtr)encoderPtr, utf8Path, durationNs);
+            }
+        }
+
+        /// <summary>
+        /// Gets the content of the replay buffer.
+        /// </summary>
+        /// <param name="stats">The replay buffer statistics.</param>
+        /// <returns>True if the replay buffer is enabled; false otherwise.</returns>
+        internal unsafe bool TryGetReplayBufferStats(out ReplayBufferStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.GetReplayBufferStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Gets the progress of the replay being saved, or the result of the last one.
+        /// </summary>
+        /// <param name="stats">The export statistics, <see cref="Fmp4RecorderStatus.Recording"/> while in progress.</param>
+        /// <returns>True if the encoder exists; false otherwise.</returns>
+        internal unsafe bool TryGetReplayExportStats(out Fmp4RecorderStats stats)
+        {
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                return NvencH264EncoderPlugin.GetReplayExportStats((IntPtr)encoderPtr, out stats);
+            }
+        }
+
+        /// <summary>
+        /// Gets the oldest encoded slice, when sub-frame output is enabled.
+        /// </summary>
+        /// <param name="slice">The buffer receiving the slice NAL units, resized if needed.</param>
+        /// <param name="size">The size of the slice data.</param>
+        /// <param name="timestamp">The time stamp of the frame the slice belongs to.</param>
+        /// <param name="sliceIndex">The index of the slice in its frame.</param>
+        /// <param name="isLastSlice">Whether the slice completes its frame.</param>
+        /// <returns>True if a slice was available; false otherwise.</returns>
+        internal unsafe bool ConsumeSlice(ref byte[] slice, out int size, out ulong timestamp, out int sliceIndex, out bool isLastSlice)
+        {
+            if (m_EncoderStatus == EncoderStatus.Failed)
+                throw new InvalidOperationException("Encoder is disposed and needs to be setup before encoding a frame.");
+
+            fixed(int* encoderPtr = &m_SettingsID.encoderId)
+            {
+                size = 0;
+                timestamp = 0;
+                sliceIndex = 0;
+                isLastSlice = false;
+
+                var existingSlice = NvencH264EncoderPlugin.BeginConsumeSlice((IntPtr)encoderPtr);
+                if (existingSlice)
+                {
+                    size = (int)NvencH264EncoderPlugin.GetSliceData((IntPtr)encoderPtr, null);
+
+                    if (slice == null || slice.Length < size)
+                        slice = new byte[size];
+
+                    fixed(byte* slicePtr = slice)
+                    {
+                        NvencH264EncoderPlugin.GetSliceData((IntPtr)encoderPtr, slicePtr);
+                    }
+
+                    timestamp = NvencH264EncoderPlugin.GetSliceTimeStamp((IntPtr)encoderPtr);
+                    sliceIndex = (int)NvencH264EncoderPlugin.GetSliceIndex((IntPtr)encoderPtr);
+                    isLastSlice = NvencH264EncoderPlugin.GetSliceIsLast((IntPtr)encoderPtr);
+
+                    // Liberate the current encoded slice in the Plugin.
+                    NvencH264EncoderPlugin.EndConsumeSlice((IntPtr)encoderPtr);
+                }
+                return existingSlice;
+            }
+        }
+
         /// <summary>
         /// Queues an Nvenc command on the render thread.
         /// </summary>
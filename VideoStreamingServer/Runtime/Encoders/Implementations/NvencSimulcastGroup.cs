@@ -0,0 +1,164 @@
+#if UNITY_EDITOR_WIN || UNITY_STANDALONE_WIN
+using System;
+using System.Runtime.InteropServices;
+using UnityEngine;
+using UnityEngine.Rendering;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// Encodes one texture into several <see cref="NvencH264Encoder"/> instances (layers) of different resolutions
+    /// and bit rates, with a single copy of the source texture per frame.
+    /// </summary>
+    /// <remarks>
+    /// Each layer keeps its own encoder, so its output is consumed with <see cref="NvencH264Encoder.ConsumeData"/>
+    /// as for a standalone encoder. The layers must be setup with the <see cref="EncoderFormat.R8G8B8"/> format.
+    /// A layer is encoded at the frame rate of its own <see cref="EncoderSettings"/>.
+    /// </remarks>
+    class NvencSimulcastGroup : IDisposable
+    {
+        /// <summary>
+        /// The maximum number of layers in a group.
+        /// </summary>
+        public const int MaxLayers = 4;
+
+        /// <summary>
+        /// The data struct sent to the Low Level Native Plugin when calling
+        /// <see cref="NvencH264Encoder.ENvencRenderEvent.ConfigureSimulcast"/>.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        unsafe struct SimulcastGroupID
+        {
+            public int groupId;
+            public int layerCount;
+            public fixed int encoderIds[MaxLayers];
+            public fixed int priorities[MaxLayers];
+        }
+
+        /// <summary>
+        /// The data struct sent to the Low Level Native Plugin when calling
+        /// <see cref="NvencH264Encoder.ENvencRenderEvent.EncodeSimulcast"/>.
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        struct SimulcastTextureID
+        {
+            public IntPtr renderTexture;
+            public int groupId;
+            public int width;
+            public int height;
+            public ulong timestamp;
+            public FrameTimecode timecode;
+        }
+
+        static int s_Counter;
+
+        SimulcastGroupID m_GroupID;
+        SimulcastTextureID m_TextureID;
+        CommandBuffer m_CommandBuffer;
+
+        /// <summary>
+        /// Creates a new, empty, simulcast group.
+        /// </summary>
+        public NvencSimulcastGroup()
+        {
+            m_GroupID.groupId = ++s_Counter;
+            m_CommandBuffer = new CommandBuffer();
+        }
+
+        ~NvencSimulcastGroup()
+        {
+            Dispose();
+        }
+
+        /// <summary>
+        /// Sets the layers of the group.
+        /// </summary>
+        /// <param name="encoders">The initialized encoders to feed.</param>
+        /// <param name="priorities">The order in which the layers are submitted each frame, highest first.
+        /// Can be null to use the order of the encoders.</param>
+        public unsafe void SetLayers(NvencH264Encoder[] encoders, int[] priorities = null)
+        {
+            if (encoders == null)
+                throw new ArgumentNullException(nameof(encoders));
+            if (encoders.Length > MaxLayers)
+                throw new ArgumentException($"A simulcast group supports at most {MaxLayers} layers.", nameof(encoders));
+            if (priorities != null && priorities.Length != encoders.Length)
+                throw new ArgumentException("There must be one priority per encoder.", nameof(priorities));
+
+            m_GroupID.layerCount = encoders.Length;
+
+            for (var i = 0; i < encoders.Length; ++i)
+            {
+                m_GroupID.encoderIds[i] = encoders[i].encoderId;
+                m_GroupID.priorities[i] = priorities != null ? priorities[i] : encoders.Length - i;
+            }
+
+            fixed(SimulcastGroupID* groupPtr = &m_GroupID)
+            {
+                Execute(NvencH264Encoder.ENvencRenderEvent.ConfigureSimulcast, "NVENC Configure Simulcast", (IntPtr)groupPtr);
+            }
+        }
+
+        /// <summary>
+        /// Queues a command on the render thread to encode a texture into the layers scheduled for this frame.
+        /// </summary>
+        /// <param name="renderTexture">The texture to encode.</param>
+        /// <param name="timestamp">The time in nanoseconds the image was sampled at since the start of the video stream.</param>
+        /// <param name="timecode">The timecode of the image, written to the SEI of each layer.</param>
+        public unsafe void Encode(RenderTexture renderTexture, ulong timestamp, in FrameTimecode timecode)
+        {
+            if (m_CommandBuffer == null)
+                throw new ObjectDisposedException(nameof(NvencSimulcastGroup));
+
+            fixed(SimulcastTextureID* texturePtr = &m_TextureID)
+            {
+                m_TextureID.groupId = m_GroupID.groupId;
+                m_TextureID.renderTexture = renderTexture.GetNativeTexturePtr();
+                m_TextureID.width = renderTexture.width;
+                m_TextureID.height = renderTexture.height;
+                m_TextureID.timestamp = timestamp;
+                m_TextureID.timecode = timecode;
+
+                Execute(NvencH264Encoder.ENvencRenderEvent.EncodeSimulcast, "NVENC Encode Simulcast", (IntPtr)texturePtr);
+            }
+        }
+
+        /// <summary>
+        /// Queues a command on the render thread to destroy the group. The layer encoders are not disposed.
+        /// </summary>
+        public unsafe void Dispose()
+        {
+            if (m_CommandBuffer == null)
+                return;
+
+            m_GroupID.layerCount = 0;
+
+            fixed(SimulcastGroupID* groupPtr = &m_GroupID)
+            {
+                Execute(NvencH264Encoder.ENvencRenderEvent.ConfigureSimulcast, "NVENC Destroy Simulcast", (IntPtr)groupPtr);
+            }
+
+            m_CommandBuffer.Release();
+            m_CommandBuffer = null;
+
+            GC.SuppressFinalize(this);
+        }
+
+        void Execute(NvencH264Encoder.ENvencRenderEvent id, string commandName, IntPtr data)
+        {
+            m_CommandBuffer.Clear();
+            m_CommandBuffer.name = commandName;
+
+            switch (SystemInfo.graphicsDeviceType)
+            {
+                case GraphicsDeviceType.Direct3D11:
+                case GraphicsDeviceType.Direct3D12:
+                    m_CommandBuffer.IssuePluginEventAndData(NvencH264EncoderPlugin.GetRenderEventFunc(), (int)id, data);
+                    break;
+            }
+
+            Graphics.ExecuteCommandBuffer(m_CommandBuffer);
+        }
+    }
+}
+#endif
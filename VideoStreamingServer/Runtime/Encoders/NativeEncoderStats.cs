@@ -0,0 +1,152 @@
+using System.Runtime.InteropServices;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// Summary of a latency or size histogram kept by a native encoder.
+    /// </summary>
+    /// <remarks>
+    /// The percentiles are exact to within 1/8 of their value.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct NativeHistogramSummary
+    {
+        public ulong count;
+        public ulong min;
+        public ulong max;
+        public ulong mean;
+        public ulong p50;
+        public ulong p90;
+        public ulong p99;
+    }
+
+    /// <summary>
+    /// Statistics of a native encoder since it was created, returned by the GetEncoderStats export of the plugins.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::EncoderStatsSnapshot (Native~/Shared/EncoderStats.h), keep both in sync.
+    /// Durations are in nanoseconds.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct NativeEncoderStats
+    {
+        /// <summary>
+        /// The number of frames handed to the encoder.
+        /// </summary>
+        public ulong framesSubmitted;
+
+        /// <summary>
+        /// The number of frames output by the encoder.
+        /// </summary>
+        public ulong framesEncoded;
+
+        /// <summary>
+        /// The number of key frames in <see cref="framesEncoded"/>.
+        /// </summary>
+        public ulong keyFrames;
+
+        /// <summary>
+        /// The number of encoded frames dropped because the output queue was full.
+        /// </summary>
+        /// <remarks>
+        /// Frames are dropped when they are not consumed as fast as they are encoded, whatever the
+        /// <see cref="backpressurePolicy"/>. With <see cref="BackpressurePolicy.Block"/> only after the wait timed out.
+        /// </remarks>
+        public ulong droppedFrames;
+
+        /// <summary>
+        /// The total size of the encoded frames, in bytes.
+        /// </summary>
+        public ulong bytesEncoded;
+
+        /// <summary>
+        /// The average output bitrate since the first encoded frame, in bits per second.
+        /// </summary>
+        public ulong bitrate;
+
+        /// <summary>
+        /// The number of encoded frames waiting to be consumed.
+        /// </summary>
+        public ulong queueDepth;
+
+        /// <summary>
+        /// The largest <see cref="queueDepth"/> reached.
+        /// </summary>
+        public ulong maxQueueDepth;
+
+        /// <summary>
+        /// The time spent copying or converting the input frames.
+        /// </summary>
+        public NativeHistogramSummary copyTime;
+
+        /// <summary>
+        /// The time between the submission of the frames and their output by the encoder.
+        /// </summary>
+        public NativeHistogramSummary encodeLatency;
+
+        /// <summary>
+        /// The time between the output of the frames and their consumption.
+        /// </summary>
+        public NativeHistogramSummary consumeLatency;
+
+        /// <summary>
+        /// The size of the encoded frames, in bytes.
+        /// </summary>
+        public NativeHistogramSummary frameBytes;
+
+        /// <summary>
+        /// The number of frames the encoder keeps in flight, as validated against the device capabilities.
+        /// </summary>
+        public ulong inFlightDepth;
+
+        /// <summary>
+        /// The length of the output queue the encoder runs with.
+        /// </summary>
+        public ulong outputQueueLength;
+
+        /// <summary>
+        /// The <see cref="BackpressurePolicy"/> the encoder runs with.
+        /// </summary>
+        public ulong backpressurePolicy;
+
+        /// <summary>
+        /// The number of frames not submitted because every input buffer was in flight.
+        /// </summary>
+        public ulong inputDroppedFrames;
+
+        /// <summary>
+        /// The number of queued frames discarded for newer ones, with <see cref="BackpressurePolicy.DropOldest"/>.
+        /// </summary>
+        public ulong droppedOldestFrames;
+
+        /// <summary>
+        /// The number of encoded frames discarded while waiting for a key frame, with <see cref="BackpressurePolicy.DropToKeyFrame"/>.
+        /// </summary>
+        public ulong skippedFrames;
+
+        /// <summary>
+        /// The number of frames that waited for room, with <see cref="BackpressurePolicy.Block"/>.
+        /// </summary>
+        public ulong blockedFrames;
+
+        /// <summary>
+        /// The time spent waiting for room, with <see cref="BackpressurePolicy.Block"/>.
+        /// </summary>
+        public NativeHistogramSummary blockTime;
+
+        /// <summary>
+        /// The buffering the encoder runs with.
+        /// </summary>
+        public EncoderBufferingSettings buffering => new EncoderBufferingSettings
+        {
+            inFlightDepth = (int)inFlightDepth,
+            outputQueueLength = (int)outputQueueLength,
+            policy = (BackpressurePolicy)backpressurePolicy,
+        };
+
+        /// <summary>
+        /// The fraction of the encoded frames that are key frames.
+        /// </summary>
+        public float keyFrameRatio => framesEncoded > 0 ? (float)keyFrames / framesEncoded : 0f;
+    }
+}
@@ -0,0 +1,83 @@
+using System.Runtime.InteropServices;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// The size of the instant replay buffer of a native encoder, which keeps the last encoded frames in memory.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::ReplayBufferSettings (Native~/Shared/ReplayBuffer.h), keep both in sync.
+    /// Zero fields select the defaults. The memory is allocated when the buffer is enabled and doesn't grow; the
+    /// oldest GOPs are evicted as a whole to make room.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct ReplayBufferSettings
+    {
+        /// <summary>
+        /// The memory holding the encoded frames, 64 MB by default.
+        /// </summary>
+        public int capacityMB;
+
+        /// <summary>
+        /// The duration kept, 30 seconds by default.
+        /// </summary>
+        public int maxDurationMs;
+
+        /// <summary>
+        /// The maximum number of frames kept, 4096 by default.
+        /// </summary>
+        public int maxFrames;
+    }
+
+    /// <summary>
+    /// Content of the instant replay buffer of a native encoder, returned by the GetReplayBufferStats export of the
+    /// plugins.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::ReplayBufferStats (Native~/Shared/ReplayBuffer.h), keep both in sync.
+    /// Timestamps are capture times, in nanoseconds.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct ReplayBufferStats
+    {
+        /// <summary>
+        /// The memory allocated for the encoded frames.
+        /// </summary>
+        public ulong capacityBytes;
+
+        /// <summary>
+        /// The number of frames that can be saved.
+        /// </summary>
+        public ulong framesStored;
+
+        /// <summary>
+        /// The memory used by the frames stored.
+        /// </summary>
+        public ulong bytesStored;
+
+        /// <summary>
+        /// The capture time of the oldest frame, a key frame. Zero when the buffer is empty.
+        /// </summary>
+        public ulong oldestTimestamp;
+
+        /// <summary>
+        /// The capture time of the newest frame.
+        /// </summary>
+        public ulong newestTimestamp;
+
+        /// <summary>
+        /// The number of frames added to the buffer.
+        /// </summary>
+        public ulong framesAppended;
+
+        /// <summary>
+        /// The number of frames that couldn't be kept while a replay was being saved.
+        /// </summary>
+        public ulong framesDropped;
+
+        /// <summary>
+        /// The number of GOPs evicted to make room.
+        /// </summary>
+        public ulong gopsEvicted;
+    }
+}
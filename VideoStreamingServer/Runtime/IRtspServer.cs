@@ -0,0 +1,36 @@
+using System;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// The RTSP server the <see cref="VideoStreamingServer"/> sends the encoded frames to.
+    /// </summary>
+    interface IRtspServer : IDisposable
+    {
+        /// <summary>
+        /// The TCP port the server listens on.
+        /// </summary>
+        int port { get; }
+
+        /// <summary>
+        /// Starts accepting the clients.
+        /// </summary>
+        /// <returns>False if the server was already started.</returns>
+        bool StartListen();
+
+        /// <summary>
+        /// Closes the timed out sessions.
+        /// </summary>
+        /// <returns>True if at least one client is playing the stream.</returns>
+        bool RefreshConnectionList();
+
+        /// <summary>
+        /// Sends an encoded frame to the playing clients.
+        /// </summary>
+        /// <param name="timeStampNs">The capture time of the frame, in nanoseconds.</param>
+        /// <param name="spsNalu">The sequence parameter set, without start code.</param>
+        /// <param name="ppsNalu">The picture parameter set, without start code.</param>
+        /// <param name="imageNalu">The picture, in Annex B format.</param>
+        void SendNALUs(ulong timeStampNs, ArraySegment<byte> spsNalu, ArraySegment<byte> ppsNalu, ArraySegment<byte> imageNalu);
+    }
+}
@@ -0,0 +1,204 @@
+using System;
+using System.Runtime.InteropServices;
+using System.Threading;
+
+namespace Unity.LiveCapture.VideoStreaming.Server
+{
+    /// <summary>
+    /// Configuration of the native RTSP server.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::RtspServerSettings (Native~/RtspServer/Includes/RtspServerCore.h), keep both in
+    /// sync. Zero fields select the defaults.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct NativeRtspServerSettings
+    {
+        /// <summary>
+        /// The RTSP port, 0 lets the system pick one.
+        /// </summary>
+        public int port;
+
+        /// <summary>
+        /// The first port tried for the RTP/RTCP pair sending to the UDP clients, 50000 by default.
+        /// </summary>
+        public int rtpPort;
+
+        /// <summary>
+        /// The maximum payload of the RTP packets, below the path MTU.
+        /// </summary>
+        public int maxPayloadSize;
+
+        /// <summary>
+        /// What happens to the frames when a client receiving the stream over its RTSP connection can't keep up.
+        /// </summary>
+        public BackpressurePolicy interleavedPolicy;
+
+        /// <summary>
+        /// The number of frames waiting for the connection of such a client, 2 by default.
+        /// </summary>
+        public int interleavedQueueLength;
+
+        /// <summary>
+        /// The time a UDP client may go without RTSP or RTCP messages before its session is closed, 60 by default.
+        /// </summary>
+        public int sessionTimeoutSeconds;
+
+        /// <summary>
+        /// The memory keeping the sent packets for retransmission, 4 MB by default.
+        /// </summary>
+        public int retransmissionCapacityKB;
+    }
+
+    /// <summary>
+    /// Activity of the native RTSP server.
+    /// </summary>
+    /// <remarks>
+    /// Mirrors LiveCaptureNative::RtspServerStats (Native~/RtspServer/Includes/RtspServerCore.h), keep both in sync.
+    /// </remarks>
+    [StructLayout(LayoutKind.Sequential)]
+    struct NativeRtspServerStats
+    {
+        public int connections;
+        public int playingClients;
+        public ulong accessUnitsPushed;
+        public ulong packetsSent;
+        public ulong packetsDropped;
+        public ulong packetsRetransmitted;
+        public ulong interleavedBytesSent;
+        public ulong interleavedDropped;
+    }
+
+    struct NativeRtspServerPlugin
+    {
+        const string k_Lib = "LiveCaptureRtspServer";
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerCreate")]
+        extern public static IntPtr Create(in NativeRtspServerSettings settings);
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerDestroy")]
+        extern public static void Destroy(IntPtr server);
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerGetPort")]
+        extern public static int GetPort(IntPtr server);
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerGetPlayingCount")]
+        extern public static int GetPlayingCount(IntPtr server);
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerPushFrame")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public unsafe static bool PushFrame(IntPtr server, byte* sps, int spsSize, byte* pps, int ppsSize, byte* image, int imageSize, ulong timeStampNs);
+
+        [DllImport(k_Lib, EntryPoint = "RtspServerGetStats")]
+        [return : MarshalAs(UnmanagedType.U1)]
+        extern public static bool GetStats(IntPtr server, out NativeRtspServerStats stats);
+    }
+
+    /// <summary>
+    /// An RTSP server running in the LiveCaptureRtspServer plugin.
+    /// </summary>
+    /// <remarks>
+    /// The plugin accepts the clients, handles their sessions and packetizes the frames on its own thread; each frame
+    /// crosses to native code once, whatever the number of clients.
+    /// </remarks>
+    class NativeRtspServer : IRtspServer
+    {
+        // The idle wait of the server loop when no client plays, as the managed server's loop does nothing then.
+        const int k_IdleWaitMs = 10;
+
+        IntPtr m_Server;
+
+        public int port => m_Server != IntPtr.Zero ? NativeRtspServerPlugin.GetPort(m_Server) : 0;
+
+        /// <summary>
+        /// Starts the server, listening right away.
+        /// </summary>
+        /// <param name="portNumber">The TCP port to listen on, 0 lets the system pick one.</param>
+        /// <exception cref="DllNotFoundException">The plugin isn't available on this platform.</exception>
+        /// <exception cref="InvalidOperationException">The sockets of the server couldn't be bound.</exception>
+        public NativeRtspServer(int portNumber)
+        {
+            var settings = new NativeRtspServerSettings
+            {
+                port = portNumber,
+                interleavedPolicy = BackpressurePolicy.DropToKeyFrame,
+            };
+
+            m_Server = NativeRtspServerPlugin.Create(settings);
+
+            if (m_Server == IntPtr.Zero)
+                throw new InvalidOperationException($"Failed to start the RTSP server on port {portNumber}.");
+        }
+
+        ~NativeRtspServer()
+        {
+            Dispose(false);
+        }
+
+        public bool StartListen()
+        {
+            return m_Server != IntPtr.Zero;
+        }
+
+        public bool RefreshConnectionList()
+        {
+            if (m_Server != IntPtr.Zero && NativeRtspServerPlugin.GetPlayingCount(m_Server) > 0)
+                return true;
+
+            Thread.Sleep(k_IdleWaitMs);
+            return false;
+        }
+
+        public unsafe void SendNALUs(ulong timeStampNs, ArraySegment<byte> spsNalu, ArraySegment<byte> ppsNalu, ArraySegment<byte> imageNalu)
+        {
+            if (m_Server == IntPtr.Zero || imageNalu.Count == 0)
+                return;
+
+            using (var sps = new PinnedBufferScope(spsNalu))
+            using (var pps = new PinnedBufferScope(ppsNalu))
+            using (var image = new PinnedBufferScope(imageNalu))
+            {
+                NativeRtspServerPlugin.PushFrame(
+                    m_Server,
+                    spsNalu.Array != null ? sps.pointer + spsNalu.Offset : null,
+                    spsNalu.Count,
+                    ppsNalu.Array != null ? pps.pointer + ppsNalu.Offset : null,
+                    ppsNalu.Count,
+                    image.pointer + imageNalu.Offset,
+                    imageNalu.Count,
+                    timeStampNs);
+            }
+        }
+
+        /// <summary>
+        /// Gets the activity of the server.
+        /// </summary>
+        /// <param name="stats">The counters, since the server started.</param>
+        /// <returns>False if the server is disposed.</returns>
+        public bool TryGetStats(out NativeRtspServerStats stats)
+        {
+            if (m_Server == IntPtr.Zero)
+            {
+                stats = default;
+                return false;
+            }
+
+            return NativeRtspServerPlugin.GetStats(m_Server, out stats);
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        void Dispose(bool disposing)
+        {
+            if (m_Server != IntPtr.Zero)
+            {
+                NativeRtspServerPlugin.Destroy(m_Server);
+                m_Server = IntPtr.Zero;
+            }
+        }
+    }
+}
@@ -24,7 +24,7 @@ using UnityEngine.Profiling;
 // demo without needing native APIs or cross compiled C libraries for H264
 namespace Unity.LiveCapture.VideoStreaming.Server
 {
-    class RtspServer : IDisposable
+    class RtspServer : IRtspServer
     {
         const int h264_width = 224; // Tiny needs 128x96
         const int h264_height = 224;
@@ -36,6 +36,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         const uint global_ssrc = 0x4321FADE; // 8 hex digits
 
+        static readonly TraceMarker s_PacketizeMarker = new TraceMarker("RtspServer.Packetize");
+        static readonly TraceMarker s_SendMarker = new TraceMarker("RtspServer.Send");
+
         private TcpListener _RTSPServerListener;
         private ManualResetEvent _Stopping;
         private Thread _ListenTread;
@@ -524,6 +527,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         public void SendNALUs(ulong timeStampNs, ArraySegment<byte> spsNalu, ArraySegment<byte> ppsNalu, ArraySegment<byte> imageNalu)
         {
+            var packetizeScope = EncoderTrace.Begin(s_PacketizeMarker, timeStampNs, TraceFlow.Step);
+
             UInt32 rtp_timestamp = (UInt32)(timeStampNs * 9 / 100000); // 90kHz clock
 
             // Build a list of 1 or more RTP packets
@@ -772,6 +777,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 Profiler.EndSample();
             }
 
+            packetizeScope.Dispose();
+
+            var sendScope = EncoderTrace.Begin(s_SendMarker, timeStampNs, TraceFlow.End);
             Profiler.BeginSample($"Send {rtp_packets.Count} RTP packets to {rtsp_list.Count} clients.");
 
             lock (rtsp_list)
@@ -862,6 +870,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
 
             Profiler.EndSample();
+            sendScope.Dispose();
         }
 
         public bool RefreshConnectionList()
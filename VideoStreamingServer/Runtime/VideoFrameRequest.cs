@@ -12,6 +12,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// </summary>
         public float elapsedTime { get; }
 
+        /// <summary>
+        /// The time in nanoseconds at which this image was requested, used as the timestamp of the encoded frame.
+        /// </summary>
+        public ulong timestamp { get; }
+
         /// <summary>
         /// The width of the video frame.
         /// </summary>
@@ -26,6 +31,11 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// The pixel format of the video texture.
         /// </summary>
         public EncoderFormat format { get; }
+
+        /// <summary>
+        /// The timecode of the frame when this image was requested, written to the SEI of the encoded frame.
+        /// </summary>
+        public FrameTimecode timecode { get; }
     }
 
     /// <summary>
@@ -40,6 +50,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public float elapsedTime { get; }
 
+        /// <inheritdoc/>
+        public ulong timestamp => (ulong)(elapsedTime * 1000000000);
+
         /// <inheritdoc/>
         public int width { get; }
 
@@ -49,6 +62,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public EncoderFormat format { get; }
 
+        /// <inheritdoc/>
+        public FrameTimecode timecode { get; }
+
         /// <summary>
         /// Determines if the request has been processed.
         /// </summary>
@@ -67,13 +83,15 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <param name="height">The height of the video frame.</param>
         /// <param name="elapsedTime">The time in seconds at which this image was requested.</param>
         /// <param name="format">The pixel format of the video texture.</param>
-        public AsyncGPUVideoFrameRequest(AsyncGPUReadbackRequest request, int width, int height, float elapsedTime, EncoderFormat format)
+        /// <param name="timecode">The timecode of the frame when this image was requested.</param>
+        public AsyncGPUVideoFrameRequest(AsyncGPUReadbackRequest request, int width, int height, float elapsedTime, EncoderFormat format, FrameTimecode timecode)
         {
             m_Request = request;
             this.width = width;
             this.height = height;
             this.elapsedTime = elapsedTime;
             this.format = format;
+            this.timecode = timecode;
         }
 
         /// <summary>
@@ -101,6 +119,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public float elapsedTime { get; }
 
+        /// <inheritdoc/>
+        public ulong timestamp => (ulong)(elapsedTime * 1000000000);
+
         /// <inheritdoc/>
         public int width { get; }
 
@@ -110,6 +131,9 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <inheritdoc/>
         public EncoderFormat format { get; }
 
+        /// <inheritdoc/>
+        public FrameTimecode timecode { get; }
+
         /// <summary>
         /// The captured render texture of the video Frame.
         /// </summary>
@@ -123,13 +147,15 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <param name="elapsedTime">The time in seconds at which this image was requested.</param>
         /// <param name="renderTexture">The texture containing the video frame.</param>
         /// <param name="format">The pixel format of the video texture.</param>
-        public DirectAccessVideoFrameRequest(int width, int height, float elapsedTime, RenderTexture renderTexture, EncoderFormat format)
+        /// <param name="timecode">The timecode of the frame when this image was requested.</param>
+        public DirectAccessVideoFrameRequest(int width, int height, float elapsedTime, RenderTexture renderTexture, EncoderFormat format, FrameTimecode timecode)
         {
             this.renderTexture = renderTexture;
             this.width = width;
             this.height = height;
             this.elapsedTime = elapsedTime;
             this.format = format;
+            this.timecode = timecode;
         }
     }
 }
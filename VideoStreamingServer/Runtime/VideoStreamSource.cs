@@ -50,6 +50,12 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         /// <returns>The resolution in pixels.</returns>
         Vector2Int GetResolution();
 
+        /// <summary>
+        /// Gets the timecode of the current frame, written to the encoded video stream.
+        /// </summary>
+        /// <returns>The timecode, or the default value when there is none.</returns>
+        FrameTimecode GetTimecode();
+
         /// <summary>
         /// Called by the <see cref="VideoStreamSource"/> this sink has been registered to when a new frame
         /// is ready to consume.
@@ -99,6 +105,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
         class SinkState
         {
+            static readonly TraceMarker s_CaptureMarker = new TraceMarker("VideoStreamSource.Capture");
+
             readonly IVideoStreamSink m_Sink;
             readonly Queue<AsyncGPUVideoFrameRequest> m_FrameStream = new Queue<AsyncGPUVideoFrameRequest>();
             float m_StartTime = 0f;
@@ -142,7 +150,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             /// <param name="encoderFormat">The texture format.</param>
             public void EnqueueFrame(AsyncGPUReadbackRequest request, int width, int height, EncoderFormat encoderFormat)
             {
-                var frame = new AsyncGPUVideoFrameRequest(request, width, height, GetElapsedTime(), encoderFormat);
+                var frame = new AsyncGPUVideoFrameRequest(request, width, height, GetElapsedTime(), encoderFormat, m_Sink.GetTimecode());
+                var traceScope = EncoderTrace.Begin(s_CaptureMarker, frame.timestamp, TraceFlow.Start);
 
                 // Using AsyncGPUReadback asynchronously introduces a few frames of latency,
                 // so we optionally allow reading the result back synchronously.
@@ -166,12 +175,17 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 }
 
                 m_LastFrameIndex = GetFrameIndex();
+                traceScope.Dispose();
             }
 
             public void ConsumeFrameDirect(int width, int height, RenderTexture renderTexture, EncoderFormat encoderFormat)
             {
-                var frame = new DirectAccessVideoFrameRequest(width, height, GetElapsedTime(), renderTexture, encoderFormat);
-                m_Sink.ConsumeFrame(frame);
+                var frame = new DirectAccessVideoFrameRequest(width, height, GetElapsedTime(), renderTexture, encoderFormat, m_Sink.GetTimecode());
+
+                using (EncoderTrace.Begin(s_CaptureMarker, frame.timestamp, TraceFlow.Start))
+                {
+                    m_Sink.ConsumeFrame(frame);
+                }
 
                 m_LastFrameIndex = GetFrameIndex();
             }
@@ -91,12 +91,16 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         // we want a low gop size to recover quickly if packets are dropped
         const int k_GopSize = 2;
 
+        static readonly TraceMarker s_EnqueueFrameMarker = new TraceMarker("VideoStreamingServer.EnqueueFrame");
+        static readonly TraceMarker s_EncodeMarker = new TraceMarker("VideoStreamingServer.Encode");
+
         struct BufferedFrame
         {
             public EncoderSettings settings;
             public EncoderFormat encoderFormat;
             public NativeArray<byte> data;
             public ulong timestamp;
+            public FrameTimecode timecode;
         }
 
         VideoEncoder m_RequestedEncoder = VideoEncoder.NoEncoder;
@@ -106,7 +110,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         bool m_Disposed;
 
         Thread m_Thread;
-        RtspServer m_Server;
+        IRtspServer m_Server;
         BlockingCollection<BufferedFrame> m_BufferedFrames;
 
         /// <summary>
@@ -167,6 +171,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                         m_Encoder?.Dispose();
                         m_Encoder = EncoderUtilities.InitializeEncoder(encoderToUse);
+                        EncoderTrace.SetEncoder(encoderToUse);
                     }
                     finally
                     {
@@ -211,7 +216,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
             try
             {
-                m_Server = new RtspServer(port, null, null);
+                m_Server = CreateServer(port);
                 m_Server.StartListen();
 
                 isRunning = true;
@@ -226,6 +231,24 @@ namespace Unity.LiveCapture.VideoStreaming.Server
             }
         }
 
+        static IRtspServer CreateServer(int port)
+        {
+            // The native server packetizes and sends the frames off the managed heap, the managed one remains for the
+            // platforms the plugin isn't built for.
+            try
+            {
+                return new NativeRtspServer(port);
+            }
+            catch (DllNotFoundException)
+            {
+            }
+            catch (EntryPointNotFoundException)
+            {
+            }
+
+            return new RtspServer(port, null, null);
+        }
+
         /// <summary>
         /// Shuts down the video server.
         /// </summary>
@@ -304,6 +327,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
             if (m_Encoder is ISoftwareEncoder)
             {
+                var traceScope = EncoderTrace.Begin(s_EnqueueFrameMarker, frame.timestamp, TraceFlow.Step);
+
                 m_BufferedFrames.Add(new BufferedFrame
                 {
                     settings = new EncoderSettings
@@ -318,7 +343,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     // We need to copy the frame data, since the request data could be cleared if the frame ends
                     // before the encoder finishes using the data.
                     data = new NativeArray<byte>(frame.GetData(), Allocator.Persistent),
-                    timestamp = (ulong)(frame.elapsedTime * 1000000000),
+                    timestamp = frame.timestamp,
+                    timecode = frame.timecode,
                 });
 
                 // This is required so that if the encoding is slower than the rate at which
@@ -328,6 +354,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 {
                     f.data.Dispose();
                 }
+
+                traceScope.Dispose();
             }
         }
 
@@ -353,7 +381,8 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 gopSize = k_GopSize,
             };
             var texture = frame.renderTexture;
-            var timestamp = (ulong)(frame.elapsedTime * 1000000000);
+            var timestamp = frame.timestamp;
+            var timecode = frame.timecode;
 
             try
             {
@@ -361,6 +390,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
 
                 if (m_Encoder is IHardwareEncoder encoder)
                 {
+                    var traceScope = EncoderTrace.Begin(s_EncodeMarker, timestamp, TraceFlow.Step);
                     Profiler.BeginSample($"Encode Frame");
 
                     switch (encoder.initialized)
@@ -373,9 +403,10 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                     }
 
                     encoder.UpdateSettings(settings);
-                    encoder.Encode(texture, timestamp);
+                    encoder.Encode(texture, timestamp, timecode);
 
                     Profiler.EndSample();
+                    traceScope.Dispose();
                 }
             }
             finally
@@ -392,6 +423,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         void ServerLoop()
         {
             Profiler.BeginThreadProfiling("Video Streaming Servers", $"Server Port: {port}");
+            EncoderTrace.SetThreadName($"Video Streaming Server {port}");
 
             try
             {
@@ -440,6 +472,7 @@ namespace Unity.LiveCapture.VideoStreaming.Server
         {
             while (!m_BufferedFrames.IsCompleted && m_BufferedFrames.TryTake(out var frame))
             {
+                var traceScope = EncoderTrace.Begin(s_EncodeMarker, frame.timestamp, TraceFlow.Step);
                 Profiler.BeginSample($"Encode Frame");
 
                 switch (softwareEncoder.initialized)
@@ -452,9 +485,10 @@ namespace Unity.LiveCapture.VideoStreaming.Server
                 }
 
                 softwareEncoder.UpdateSettings(frame.settings);
-                softwareEncoder.Encode(frame.data, frame.timestamp, encodedFrame);
+                softwareEncoder.Encode(frame.data, frame.timestamp, frame.timecode, encodedFrame);
 
                 Profiler.EndSample();
+                traceScope.Dispose();
                 Profiler.BeginSample($"Send NALUs");
 
                 m_Server.SendNALUs(